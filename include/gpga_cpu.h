@@ -0,0 +1,50 @@
+#ifndef GPGA_CPU_H
+#define GPGA_CPU_H
+
+// Host C++ prelude for kernels emitted with --emit-cpp / run with --run-cpu.
+// Maps the MSL address-space qualifiers and the metal_stdlib builtins used by
+// the codegen onto standard C++ so the same kernel bodies build with the host
+// compiler. Kernels become static functions; the per-kernel extern "C" entry
+// points appended by the C++ emitter iterate them over a gid range.
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint8_t uchar;
+typedef uint16_t ushort;
+typedef uint32_t uint;
+typedef uint64_t ulong;
+
+#define kernel static inline
+#define device
+#define thread
+#define threadgroup
+#ifndef constant
+#define constant const
+#endif
+
+// Metal's atomic_uint shares the layout of uint, as does std::atomic<uint>.
+typedef std::atomic<uint> atomic_uint;
+static_assert(sizeof(atomic_uint) == sizeof(uint),
+              "atomic_uint must alias uint storage");
+using std::atomic_fetch_add_explicit;
+using std::atomic_load_explicit;
+using std::atomic_store_explicit;
+using std::memory_order_relaxed;
+
+static inline uint popcount(uint value) {
+  return static_cast<uint>(__builtin_popcount(value));
+}
+static inline ulong popcount(ulong value) {
+  return static_cast<ulong>(__builtin_popcountll(value));
+}
+template <typename T>
+static inline T max(T a, T b) {
+  return (a < b) ? b : a;
+}
+template <typename T>
+static inline T min(T a, T b) {
+  return (b < a) ? b : a;
+}
+
+#endif
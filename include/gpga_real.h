@@ -4,6 +4,8 @@
 #if defined(__METAL_VERSION__)
 #include <metal_stdlib>
 using namespace metal;
+#elif defined(GPGA_CPU_BACKEND)
+#include "gpga_cpu.h"
 #else
 #include <cstdint>
 // Fallback typedefs for editors/non-Metal tooling.
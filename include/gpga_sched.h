@@ -4,6 +4,8 @@
 #if defined(__METAL_VERSION__)
 #include <metal_stdlib>
 using namespace metal;
+#elif defined(GPGA_CPU_BACKEND)
+#include "gpga_cpu.h"
 #else
 #include <cstdint>
 // Fallback typedefs for editors/non-Metal tooling.
@@ -159,6 +161,9 @@ struct GpgaSchedVmCaseHeader {
   uint entry_offset;
   uint expr_offset;
   uint default_target;
+  uint table_offset;
+  uint table_mask;
+  uint wild_count;
 };
 struct GpgaSchedVmCondEntry {
   uint kind;
@@ -245,6 +250,7 @@ constant constexpr uint GPGA_SCHED_VM_ASSIGN_FLAG_IS_BIT_SELECT = 1u << 3u;
 constant constexpr uint GPGA_SCHED_VM_ASSIGN_FLAG_IS_RANGE = 1u << 4u;
 constant constexpr uint GPGA_SCHED_VM_ASSIGN_FLAG_IS_INDEXED_RANGE = 1u << 5u;
 constant constexpr uint GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST = 1u << 6u;
+constant constexpr uint GPGA_SCHED_VM_ASSIGN_FLAG_COND_RHS = 1u << 7u;
 constant constexpr uint GPGA_SCHED_VM_FORCE_FLAG_PROCEDURAL = 1u << 0u;
 constant constexpr uint GPGA_SCHED_VM_FORCE_FLAG_FALLBACK = 1u << 1u;
 constant constexpr uint GPGA_SCHED_VM_FORCE_FLAG_OVERRIDE_REG = 1u << 2u;
@@ -279,6 +285,45 @@ constant constexpr uint GPGA_SCHED_VM_SERVICE_ARG_KIND_REAL = 3u;
 constant constexpr uint GPGA_SCHED_VM_SERVICE_ARG_KIND_WIDE = 4u;
 constant constexpr uint GPGA_SCHED_VM_SERVICE_RET_ASSIGN_FLAG_FALLBACK = 1u << 0u;
 
+#if defined(__METAL_VERSION__) || defined(GPGA_CPU_BACKEND)
+// Bit-packed 1-bit signals (--pack-bits): each signal owns one bit of the
+// per-gid 64-bit word of its group segment. GpgaBitPlane stands in for the
+// signal's `device uint*` so `sig[gid]` reads and writes keep working; every
+// write is a read-modify-write of the owning gid's word only.
+struct GpgaBitRef {
+  device ulong* word;
+  ulong mask;
+
+  operator uint() const { return ((*word & mask) != 0ul) ? 1u : 0u; }
+  GpgaBitRef operator=(uint value) const {
+    *word = ((value & 1u) != 0u) ? (*word | mask) : (*word & ~mask);
+    return *this;
+  }
+  GpgaBitRef operator=(const GpgaBitRef& other) const {
+    return *this = static_cast<uint>(other);
+  }
+  GpgaBitRef operator&=(uint value) const {
+    return *this = static_cast<uint>(*this) & value;
+  }
+  GpgaBitRef operator|=(uint value) const {
+    return *this = static_cast<uint>(*this) | value;
+  }
+  GpgaBitRef operator^=(uint value) const {
+    return *this = static_cast<uint>(*this) ^ value;
+  }
+};
+
+struct GpgaBitPlane {
+  device ulong* words;
+  ulong mask;
+
+  GpgaBitRef operator[](uint gid) const {
+    GpgaBitRef ref = {words + gid, mask};
+    return ref;
+  }
+};
+#endif
+
 #define GPGA_SCHED_DEFINE_PROC_PARENT(...) \
 constant uint gpga_proc_parent[(GPGA_SCHED_PROC_COUNT > 0u) ? \
     GPGA_SCHED_PROC_COUNT : 1u] = { __VA_ARGS__ };
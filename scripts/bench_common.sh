@@ -0,0 +1,7 @@
+# Helpers shared by the scripts/run_*_bench.sh benchmarks; source it.
+
+# Wall clock in milliseconds. `date +%s%N` is GNU-only and the /bin/bash 3.2
+# that ships with macOS has no EPOCHREALTIME, so ask perl.
+now_ms() {
+  perl -MTime::HiRes=time -e 'printf "%d\n", time() * 1000'
+}
@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Case lookup benchmark: generates CPU-style decoders driven by an LFSR for
+# METALFPGA_CASE_BENCH_CYCLES cycles, runs each on the host SchedulerVm
+# interpreter (--sched-vm --vm-profile) with the kLut/kBucket case tables
+# and with METALFPGA_CASE_TABLES=0 (linear scan), and reports the case op
+# count and average cycles per case. Decoders:
+#   dense:  256-label case on an 8-bit opcode (kLut)
+#   sparse: RV32-style case on {funct7, funct3, opcode} (kBucket)
+#   casez:  the sparse decoder with a few don't-care rows up front (run
+#           with --4state)
+# Extra arguments go to metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CYCLES="${METALFPGA_CASE_BENCH_CYCLES:-20000}"
+OUT_DIR="${METALFPGA_CASE_BENCH_DIR:-"$ROOT/artifacts/case_bench"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+for kind in dense sparse casez; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  if [[ -f "$design" ]]; then
+    continue
+  fi
+  awk -v kind="$kind" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    print "  reg [31:0] lfsr;";
+    print "  reg [31:0] insn;";
+    print "  reg [15:0] ctl;";
+    print "  reg [31:0] acc;";
+    print "  initial begin";
+    print "    clk = 0;";
+    print "    lfsr = 32'\''h1;";
+    print "    acc = 0;";
+    printf "    #%d $finish;\n", cycles * 2;
+    print "  end";
+    print "  always #1 clk = ~clk;";
+    print "  always @(posedge clk) begin";
+    print "    lfsr = {lfsr[30:0], lfsr[31] ^ lfsr[21] ^ lfsr[1] ^ lfsr[0]};";
+    if (kind == "dense") {
+      print "    insn = lfsr;";
+      print "    case (insn[7:0])";
+      for (i = 0; i < 256; ++i) {
+        printf "      8'\''d%d: ctl = 16'\''d%d;\n", i, (i * 37 + 11) % 65536;
+      }
+      print "    endcase";
+    } else {
+      # Pick opcodes and funct fields from the RV32IM table so that about
+      # half of the random instructions decode.
+      split("0110011 0010011 0000011 0100011 1100011 1101111 1100111 0110111 0010111 1110011 0001111", ops, " ");
+      print "    insn = {lfsr[31:25], 10'\''b0, lfsr[14:12], 5'\''b0, 2'\''b0, lfsr[6:2], 2'\''b11};";
+      print "    insn[6:2] = (lfsr[16]) ? 5'\''b01100 : insn[6:2];";
+      print "    ctl = 16'\''hffff;";
+      if (kind == "casez") {
+        print "    casez ({insn[31:25], insn[14:12], insn[6:0]})";
+        print "      17'\''b???????_???_1110011: ctl = 16'\''d1000;";
+        print "      17'\''b???????_???_0001111: ctl = 16'\''d1001;";
+      } else {
+        print "    case ({insn[31:25], insn[14:12], insn[6:0]})";
+      }
+      n = 0;
+      for (o = 1; o <= 11; ++o) {
+        for (f3 = 0; f3 < 8; ++f3) {
+          f7max = (ops[o] == "0110011") ? 2 : 1;
+          for (f7 = 0; f7 < f7max; ++f7) {
+            f7v = (f7 == 0) ? "0000000" : "0100000";
+            if (ops[o] == "0110011" && f3 == 0 && f7 == 0) {
+              f7v = "0000001";
+            }
+            f3v = sprintf("%d%d%d", int(f3 / 4) % 2, int(f3 / 2) % 2, f3 % 2);
+            printf "      17'\''b%s_%s_%s: ctl = 16'\''d%d;\n", f7v, f3v, ops[o], ++n;
+          }
+        }
+      }
+      print "      default: ctl = 16'\''d0;";
+      print "    endcase";
+    }
+    print "    acc = acc * 31 + ctl;";
+    print "  end";
+    print "endmodule";
+  }' > "$design"
+done
+
+for kind in dense sparse casez; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  flags=()
+  if [[ "$kind" == "casez" ]]; then
+    flags+=(--4state)
+  fi
+  for tables in 1 0; do
+    mode="tables"
+    if [[ "$tables" == "0" ]]; then
+      mode="linear"
+    fi
+    report="$(METALFPGA_CASE_TABLES="$tables" "$CLI" "$design" --top top \
+      --sched-vm --vm-profile ${flags[@]+"${flags[@]}"} "$@" 2>&1)"
+    line="$(grep -E '^  case +count=' <<<"$report" || true)"
+    count="$(sed -n 's/.*count= *\([0-9]*\).*/\1/p' <<<"$line")"
+    avg="$(sed -n 's/.*avg= *\([0-9]*\).*/\1/p' <<<"$line")"
+    echo "${kind} ${mode}: ${count:-?} cases, ${avg:-?} cycles/case"
+  done
+done
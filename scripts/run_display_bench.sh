@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# $display throughput benchmark: generates a clocked design that prints
+# METALFPGA_DISPLAY_BENCH_LINES formatted lines per cycle (a mix of %d, %0d,
+# %h, %b, %05d, %s and a default-formatted $display) for
+# METALFPGA_DISPLAY_BENCH_CYCLES cycles, runs it on the CPU backend with
+# stdout redirected to a file, and reports printed lines per second of wall
+# time. Extra arguments go to metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+LINES="${METALFPGA_DISPLAY_BENCH_LINES:-8}"
+CYCLES="${METALFPGA_DISPLAY_BENCH_CYCLES:-20000}"
+OUT_DIR="${METALFPGA_DISPLAY_BENCH_DIR:-"$ROOT/artifacts/display_bench"}"
+DESIGN="$OUT_DIR/design_${LINES}x${CYCLES}.v"
+
+source "$ROOT/scripts/bench_common.sh"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+if [[ ! -f "$DESIGN" ]]; then
+  awk -v lines="$LINES" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    print "  reg [31:0] cnt;";
+    print "  reg [15:0] data;";
+    print "  reg [63:0] acc;";
+    print "  reg [8*6:1] tag;";
+    print "  initial begin";
+    print "    clk = 0;";
+    print "    cnt = 0;";
+    print "    data = 16'\''h1234;";
+    print "    acc = 0;";
+    print "    tag = \"bench\";";
+    printf "    #%d $finish;\n", cycles * 2;
+    print "  end";
+    print "  always #1 clk = ~clk;";
+    print "  always @(posedge clk) begin";
+    print "    cnt <= cnt + 1;";
+    print "    data <= data ^ cnt[15:0];";
+    print "    acc <= acc + {cnt, data};";
+    for (i = 0; i < lines; ++i) {
+      k = i % 4;
+      if (k == 0) {
+        printf "    $display(\"line %d cnt=%%0d data=%%h acc=%%d\", cnt, data, acc);\n", i;
+      } else if (k == 1) {
+        printf "    $display(\"%%s %d: %%b %%05d|%%8h\", tag, data, cnt[15:0], acc[31:0]);\n", i;
+      } else if (k == 2) {
+        printf "    $display(cnt, \" \", data, \" %d\");\n", i;
+      } else {
+        printf "    $display(\"[%%0t] %d acc=%%h\", $time, acc);\n", i;
+      }
+    }
+    print "  end";
+    print "endmodule";
+  }' > "$DESIGN"
+fi
+
+log="$OUT_DIR/run.log"
+out="$OUT_DIR/stdout.txt"
+start_ms="$(now_ms)"
+# The whole run is one dispatch whose service ring holds every line.
+"$CLI" "$DESIGN" --top top --run-cpu --max-steps 4000000000 \
+  --service-capacity "$((LINES * CYCLES + 16))" "$@" >"$out" 2>"$log"
+end_ms="$(now_ms)"
+printed="$(wc -l <"$out")"
+ms="$((end_ms - start_ms))"
+echo "display: $printed lines, $(wc -c <"$out") bytes, wall ${ms} ms," \
+     "$((printed * 1000 / (ms > 0 ? ms : 1))) lines/s"
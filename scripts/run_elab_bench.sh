@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Elaboration benchmark: generates a design of METALFPGA_ELAB_BENCH_MIDS
+# `mid` instances, each chaining METALFPGA_ELAB_BENCH_LEAVES parameterized
+# `leaf` instances with expression-heavy assigns, and reports parse and
+# elaborate time, instance body cache hits and peak RSS
+# (metalfpga_cli --elab-bench). CPU-only.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+MIDS="${METALFPGA_ELAB_BENCH_MIDS:-50}"
+LEAVES="${METALFPGA_ELAB_BENCH_LEAVES:-20}"
+RUNS="${METALFPGA_ELAB_BENCH_RUNS:-3}"
+DESIGN="${METALFPGA_ELAB_BENCH_DESIGN:-"$ROOT/artifacts/elab_bench/design_${MIDS}x${LEAVES}.v"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$(dirname "$DESIGN")"
+if [[ ! -f "$DESIGN" ]]; then
+  awk -v mids="$MIDS" -v leaves="$LEAVES" 'BEGIN {
+    print "module leaf #(parameter W = 8, parameter K = 3) (input wire clk,";
+    print "    input wire [W-1:0] a, input wire [W-1:0] b,";
+    print "    output reg [W-1:0] q, output wire [W-1:0] y);";
+    for (i = 0; i < 24; ++i) {
+      printf "  wire [W-1:0] t%d;\n", i;
+    }
+    for (i = 0; i < 24; ++i) {
+      src = (i == 0) ? "a" : sprintf("t%d", i - 1);
+      printf "  assign t%d = ((%s + b) ^ (a >> %d)) & ({W{1'\''b1}} - (b[%d] ? %s : ~a)) | (K * %d);\n",
+             i, src, i % 7, i % 4, src, i + 1;
+    }
+    print "  assign y = t23 ^ t11;";
+    print "  always @(posedge clk) begin";
+    print "    if (a[0] && b[1]) q <= t23 + q;";
+    print "    else if (a == b) q <= q - t5;";
+    print "    else q <= (q << 1) | t7[0];";
+    print "  end";
+    print "endmodule";
+    print "module mid #(parameter W = 8) (input wire clk, input wire [W-1:0] a,";
+    print "    output wire [W-1:0] y);";
+    for (i = 0; i <= leaves; ++i) {
+      printf "  wire [W-1:0] c%d;\n", i;
+    }
+    print "  assign c0 = a;";
+    for (i = 0; i < leaves; ++i) {
+      printf "  wire [W-1:0] q%d;\n", i;
+      printf "  leaf #(.W(W), .K(%d)) u%d (.clk(clk), .a(c%d), .b(a), .q(q%d), .y(c%d));\n",
+             i, i, i, i, i + 1;
+    }
+    printf "  assign y = c%d;\n", leaves;
+    print "endmodule";
+    print "module top(input wire clk, input wire [15:0] a, output wire [15:0] y);";
+    for (i = 0; i <= mids; ++i) {
+      printf "  wire [15:0] m%d;\n", i;
+    }
+    print "  assign m0 = a;";
+    for (i = 0; i < mids; ++i) {
+      printf "  mid #(.W(16)) g%d (.clk(clk), .a(m%d), .y(m%d));\n", i, i, i + 1;
+    }
+    printf "  assign y = m%d;\n", mids;
+    print "endmodule";
+  }' > "$DESIGN"
+fi
+
+run=1
+while [[ "$run" -le "$RUNS" ]]; do
+  echo "=== run ${run} ==="
+  "$CLI" "$DESIGN" --top top "$@" --elab-bench
+  run=$((run + 1))
+done
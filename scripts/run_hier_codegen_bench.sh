@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Hierarchical codegen benchmark: generates a combinational design chaining
+# METALFPGA_HIER_BENCH_INSTANCES copies of one expression-heavy `stage`
+# module, emits MSL flat and with --hier-codegen, and reports the MSL line
+# count, size and emit time of each. Emit time comes from the artifact cache
+# miss report, so every run uses a fresh cache directory. CPU-only.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+INSTANCES="${METALFPGA_HIER_BENCH_INSTANCES:-500}"
+OUT_DIR="${METALFPGA_HIER_BENCH_DIR:-"$ROOT/artifacts/hier_codegen_bench"}"
+DESIGN="$OUT_DIR/design_${INSTANCES}.v"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+if [[ ! -f "$DESIGN" ]]; then
+  awk -v instances="$INSTANCES" 'BEGIN {
+    print "module stage(input wire [15:0] a, input wire [15:0] b,";
+    print "    output wire [15:0] y);";
+    for (i = 0; i < 16; ++i) {
+      printf "  wire [15:0] t%d;\n", i;
+    }
+    for (i = 0; i < 16; ++i) {
+      src = (i == 0) ? "a" : sprintf("t%d", i - 1);
+      printf "  assign t%d = ((%s + b) ^ (a >> %d)) & (b[%d] ? %s : ~a);\n",
+             i, src, i % 7, i % 4, src;
+    }
+    print "  assign y = t15 ^ t7;";
+    print "endmodule";
+    print "module top(input wire [15:0] a, input wire [15:0] b,";
+    print "    output wire [15:0] y);";
+    for (i = 0; i <= instances; ++i) {
+      printf "  wire [15:0] c%d;\n", i;
+    }
+    print "  assign c0 = a;";
+    for (i = 0; i < instances; ++i) {
+      printf "  stage u%d (.a(c%d), .b(b), .y(c%d));\n", i, i, i + 1;
+    }
+    printf "  assign y = c%d;\n", instances;
+    print "endmodule";
+  }' > "$DESIGN"
+fi
+
+for mode in flat hier; do
+  flags=()
+  if [[ "$mode" == "hier" ]]; then
+    flags+=(--hier-codegen)
+  fi
+  cache_dir="$OUT_DIR/cache_${mode}"
+  rm -rf "$cache_dir"
+  msl="$OUT_DIR/design_${INSTANCES}_${mode}.metal"
+  report="$(METALFPGA_ARTIFACT_CACHE="$cache_dir" "$CLI" "$DESIGN" --top top \
+    --artifact-cache --emit-msl "$msl" ${flags[@]+"${flags[@]}"} "$@" 2>&1 >/dev/null)"
+  emit_ms="$(sed -n 's/.*emit \([0-9.]*\) ms).*/\1/p' <<<"$report")"
+  echo "${mode}: $(wc -l <"$msl") lines, $(wc -c <"$msl") bytes, emit ${emit_ms:-?} ms"
+done
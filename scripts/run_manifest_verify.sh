@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Emits the scheduler manifest for every file in the corpus and checks it
+# against the regex MSL scanner (metalfpga_cli --check-manifest). CPU-only.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CORPUS="${METALFPGA_CORPUS:-"$ROOT/deprecated/verilog"}"
+LOG="${METALFPGA_MANIFEST_LOG:-"$ROOT/artifacts/manifest_verify.log"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$(dirname "$LOG")"
+: > "$LOG"
+
+total=0
+passed=0
+failed=0
+skipped=0
+while IFS= read -r file; do
+  for mode in "" "--4state" "--sched-vm" "--4state --sched-vm"; do
+    total=$((total + 1))
+    # shellcheck disable=SC2086
+    if output="$("$CLI" "$file" $mode --check-manifest 2>&1)"; then
+      passed=$((passed + 1))
+    elif grep -q "manifest check failed" <<<"$output"; then
+      failed=$((failed + 1))
+      {
+        echo "FAIL $file $mode"
+        echo "$output"
+      } >> "$LOG"
+    else
+      # Parse/elaboration failures are not manifest regressions.
+      skipped=$((skipped + 1))
+    fi
+  done
+done < <(find "$CORPUS" -name '*.v' | sort)
+
+echo "manifest verify: total=$total passed=$passed failed=$failed skipped=$skipped"
+echo "log: $LOG"
+if [[ "$failed" -gt 0 ]]; then
+  exit 1
+fi
@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Bit-packing benchmark: generates a clocked design of
+# METALFPGA_PACK_BENCH_FLOPS 1-bit flops (a ring of xor/and gates over scalar
+# regs) that runs METALFPGA_PACK_BENCH_CYCLES cycles, then runs it on the CPU
+# backend with and without --pack-bits over METALFPGA_PACK_BENCH_COUNT
+# instances. Each mode gets one untimed warm-up run, which fills the kernel
+# cache (METALFPGA_CPU_CACHE, a fresh directory under the output dir unless
+# set), then METALFPGA_PACK_BENCH_REPEAT timed runs. Reports packed state
+# size, median and min wall time and, when `perf` is available, cache
+# references/misses of the last run. Extra arguments go to metalfpga_cli
+# (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+FLOPS="${METALFPGA_PACK_BENCH_FLOPS:-512}"
+CYCLES="${METALFPGA_PACK_BENCH_CYCLES:-1000}"
+COUNT="${METALFPGA_PACK_BENCH_COUNT:-256}"
+MAX_STEPS="${METALFPGA_PACK_BENCH_MAX_STEPS:-100000000}"
+REPEAT="${METALFPGA_PACK_BENCH_REPEAT:-5}"
+OUT_DIR="${METALFPGA_PACK_BENCH_DIR:-"$ROOT/artifacts/pack_bits_bench"}"
+DESIGN="$OUT_DIR/design_${FLOPS}x${CYCLES}.v"
+export METALFPGA_CPU_CACHE="${METALFPGA_CPU_CACHE:-"$OUT_DIR/cpu_cache"}"
+
+source "$ROOT/scripts/bench_common.sh"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+if [[ ! "$REPEAT" =~ ^[1-9][0-9]*$ ]]; then
+  echo "METALFPGA_PACK_BENCH_REPEAT must be a positive integer" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+if [[ ! -f "$DESIGN" ]]; then
+  awk -v flops="$FLOPS" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    for (i = 0; i < flops; ++i) {
+      printf "  reg q%d;\n", i;
+    }
+    print "  initial begin";
+    print "    clk = 0;";
+    for (i = 0; i < flops; ++i) {
+      printf "    q%d = %d;\n", i, (i % 3 == 0);
+    }
+    printf "    repeat (%d) begin\n", cycles * 2;
+    print "      #1 clk = ~clk;";
+    print "    end";
+    print "    $finish;";
+    print "  end";
+    print "  always @(posedge clk) begin";
+    for (i = 0; i < flops; ++i) {
+      a = (i + 1) % flops;
+      b = (i + 7) % flops;
+      c = (i + flops - 1) % flops;
+      printf "    q%d <= (q%d ^ q%d) | (q%d & ~q%d);\n", i, a, b, c, i;
+    }
+    print "  end";
+    print "endmodule";
+  }' > "$DESIGN"
+fi
+
+have_perf=0
+if command -v perf >/dev/null 2>&1 &&
+    perf stat -e cache-misses true >/dev/null 2>&1; then
+  have_perf=1
+fi
+
+for mode in plain packed; do
+  flags=()
+  if [[ "$mode" == "packed" ]]; then
+    flags+=(--pack-bits)
+  fi
+  log="$OUT_DIR/run_${mode}.log"
+  cmd=("$CLI" "$DESIGN" --top top --run-cpu --run-verbose --count "$COUNT"
+       --max-steps "$MAX_STEPS" ${flags[@]+"${flags[@]}"} "$@")
+  "${cmd[@]}" >"$log" 2>&1
+  walls=()
+  for ((run = 0; run < REPEAT; ++run)); do
+    start_ms="$(now_ms)"
+    if [[ "$have_perf" == "1" ]]; then
+      perf stat -x, -e cache-references,cache-misses \
+        -o "$OUT_DIR/perf_${mode}.txt" "${cmd[@]}" >"$log" 2>&1
+    else
+      "${cmd[@]}" >"$log" 2>&1
+    fi
+    end_ms="$(now_ms)"
+    walls+=("$((end_ms - start_ms))")
+  done
+  sorted=($(printf '%s\n' "${walls[@]}" | sort -n))
+  state="$(sed -n 's/^packed state: \(.*\)$/\1/p' "$log" | head -n 1)"
+  line="${mode}: state ${state:-?}, wall median ${sorted[$((REPEAT / 2))]} ms"
+  line+=" min ${sorted[0]} ms over ${REPEAT} runs"
+  if [[ "$have_perf" == "1" ]]; then
+    refs="$(awk -F, '$3 ~ /cache-references/ {print $1}' "$OUT_DIR/perf_${mode}.txt")"
+    misses="$(awk -F, '$3 ~ /cache-misses/ {print $1}' "$OUT_DIR/perf_${mode}.txt")"
+    line+=", cache refs ${refs:-?}, misses ${misses:-?}"
+  fi
+  echo "$line"
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Front-end throughput benchmark: generates a flat gate-level netlist of
+# METALFPGA_PARSE_BENCH_GATES primitives and reports read/preprocess/
+# tokenize/parse MB/s and tokens/s (metalfpga_cli --parse-bench). Extra
+# arguments are parsed alongside the netlist. CPU-only.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+GATES="${METALFPGA_PARSE_BENCH_GATES:-20000}"
+RUNS="${METALFPGA_PARSE_BENCH_RUNS:-3}"
+NETLIST="${METALFPGA_PARSE_BENCH_NETLIST:-"$ROOT/artifacts/parse_bench/netlist_${GATES}.v"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$(dirname "$NETLIST")"
+if [[ ! -f "$NETLIST" ]]; then
+  awk -v gates="$GATES" 'BEGIN {
+    srand(1);
+    split("and or xor nand nor xnor", kinds, " ");
+    print "module parse_bench(input wire a, input wire b, output wire y);";
+    for (i = 0; i < gates; ++i) {
+      printf "  wire n%d;\n", i;
+    }
+    for (i = 0; i < gates; ++i) {
+      lo = (i > 64) ? i - 64 : 0;
+      x = (i == 0) ? "a" : sprintf("n%d", lo + int(rand() * (i - lo)));
+      z = (i == 0) ? "b" : sprintf("n%d", lo + int(rand() * (i - lo)));
+      printf "  %s g%d (n%d, %s, %s);\n", kinds[1 + int(rand() * 6)], i, i, x, z;
+    }
+    printf "  assign y = n%d;\n", gates - 1;
+    print "endmodule";
+  }' > "$NETLIST"
+fi
+
+run=1
+while [[ "$run" -le "$RUNS" ]]; do
+  echo "=== run ${run} ==="
+  "$CLI" "$NETLIST" "$@" --parse-bench
+  run=$((run + 1))
+done
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# $readmemh load benchmark: for each size in METALFPGA_READMEM_BENCH_SIZES_MB
+# generates a hex image of that many MiB (one 32-bit word per line) and a
+# design whose memory holds it, then times --run-cpu with the line-by-line
+# loader (METALFPGA_MEM_IMAGE_THREADS=0) and with the mapped multi-threaded
+# loader. The same design run with an empty image is subtracted, so the
+# reported times and MiB/s are for the load itself. Extra arguments go to
+# metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+SIZES="${METALFPGA_READMEM_BENCH_SIZES_MB:-1 16 256}"
+OUT_DIR="${METALFPGA_READMEM_BENCH_DIR:-"$ROOT/artifacts/readmem_bench"}"
+
+source "$ROOT/scripts/bench_common.sh"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+run_ms() {
+  local start_ms end_ms
+  start_ms="$(now_ms)"
+  env "$@" >/dev/null 2>>"$OUT_DIR/run.log"
+  end_ms="$(now_ms)"
+  echo "$((end_ms - start_ms))"
+}
+
+: > "$OUT_DIR/empty.hex"
+for mb in $SIZES; do
+  words="$((mb * 1024 * 1024 / 9))"
+  image="$OUT_DIR/image_${mb}mb.hex"
+  if [[ ! -f "$image" ]]; then
+    awk -v n="$words" 'BEGIN {
+      for (i = 0; i < n; ++i) {
+        printf "%08x\n", (i * 40503 + 12345) % 4294967296;
+      }
+    }' > "$image"
+  fi
+  for kind in image empty; do
+    file="$image"
+    [[ "$kind" == empty ]] && file="$OUT_DIR/empty.hex"
+    printf 'module top;\n  reg [31:0] mem [0:%d];\n' "$((words - 1))" \
+      > "$OUT_DIR/design_${mb}mb_${kind}.v"
+    printf '  initial $readmemh("%s", mem);\nendmodule\n' "$file" \
+      >> "$OUT_DIR/design_${mb}mb_${kind}.v"
+  done
+  design="$OUT_DIR/design_${mb}mb_image.v"
+  baseline="$OUT_DIR/design_${mb}mb_empty.v"
+  args=(--top top --run-cpu "$@")
+  # The first run fills the --run-cpu kernel cache.
+  run_ms "$CLI" "$baseline" "${args[@]}" >/dev/null
+  base_ms="$(run_ms "$CLI" "$baseline" "${args[@]}")"
+  slow_ms="$(run_ms METALFPGA_MEM_IMAGE_THREADS=0 "$CLI" "$design" \
+    "${args[@]}")"
+  fast_ms="$(run_ms "$CLI" "$design" "${args[@]}")"
+  awk -v mb="$mb" -v words="$words" -v base="$base_ms" -v slow="$slow_ms" \
+      -v fast="$fast_ms" 'BEGIN {
+    slow = (slow > base) ? slow - base : 1;
+    fast = (fast > base) ? fast - base : 1;
+    printf "readmemh %d MiB (%d words): line-by-line %d ms (%.1f MiB/s), " \
+           "mapped %d ms (%.1f MiB/s), %.2fx\n",
+           mb, words, slow, mb * 1000 / slow, fast, mb * 1000 / fast,
+           slow / fast;
+  }'
+done
@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# VCD snapshot benchmark: for each count in METALFPGA_VCD_BENCH_SIGNALS,
+# generates a clocked design whose dumped state is a memory of that many
+# 8-bit words (each element is one VCD signal) with only a few elements
+# written per cycle, runs it on the CPU backend with --vcd-dir and
+# --vcd-steps 1, and reports the writer's own snapshot time from
+# --run-verbose ("vcd:" line) next to the total wall time.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+SIGNALS="${METALFPGA_VCD_BENCH_SIGNALS:-"1000 4000 10000"}"
+CYCLES="${METALFPGA_VCD_BENCH_CYCLES:-200}"
+OUT_DIR="${METALFPGA_VCD_BENCH_DIR:-"$ROOT/artifacts/vcd_bench"}"
+
+source "$ROOT/scripts/bench_common.sh"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+for n in $SIGNALS; do
+  design="$OUT_DIR/design_${n}x${CYCLES}.v"
+  if [[ ! -f "$design" ]]; then
+    awk -v n="$n" -v cycles="$CYCLES" 'BEGIN {
+      print "module top;";
+      print "  reg clk;";
+      print "  reg [31:0] cnt;";
+      printf "  reg [7:0] mem [0:%d];\n", n - 1;
+      print "  integer i;";
+      print "  initial begin";
+      printf "    $dumpfile(\"bench_%d.vcd\");\n", n;
+      print "    $dumpvars(0, top);";
+      print "    clk = 0;";
+      print "    cnt = 0;";
+      printf "    for (i = 0; i < %d; i = i + 1) mem[i] = 0;\n", n;
+      printf "    repeat (%d) #1 clk = ~clk;\n", cycles * 2;
+      print "    $finish;";
+      print "  end";
+      print "  always @(posedge clk) begin";
+      print "    cnt <= cnt + 1;";
+      printf "    mem[cnt %% %d] <= cnt[7:0];\n", n;
+      printf "    mem[(cnt * 7) %% %d] <= cnt[7:0] ^ 8'\''h5a;\n", n;
+      print "  end";
+      print "endmodule";
+    }' > "$design"
+  fi
+  run_dir="$OUT_DIR/run_$n"
+  rm -rf "$run_dir"
+  mkdir -p "$run_dir"
+  log="$run_dir/run.log"
+  start_ms="$(now_ms)"
+  "$CLI" "$design" --top top --run-cpu --run-verbose --vcd-dir "$run_dir" \
+    --vcd-steps 1 "$@" >"$log" 2>&1
+  end_ms="$(now_ms)"
+  vcd="$(sed -n 's/^vcd: \(.*\)$/\1/p' "$log" | tail -n 1)"
+  echo "signals $n: ${vcd:-no vcd stats}," \
+       "wall $((end_ms - start_ms)) ms"
+done
@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Expression register benchmark: generates clocked designs driven by an
+# LFSR for METALFPGA_VM_EXPR_BENCH_CYCLES cycles, profiles each on the host
+# SchedulerVm interpreter (--sched-vm --vm-profile) with subexpression
+# sharing on and off (METALFPGA_VM_EXPR_REGS=1/0), and reports the
+# expression ops executed and their cycles. Designs:
+#   shared: assigns reusing a decoded field and a sum several times
+#   mux:    a 32-way ternary chain on one selector field
+#   deep:   a 48-level ternary chain (deeper than the expression stack;
+#           spilled to registers in both modes)
+# Extra arguments go to metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CYCLES="${METALFPGA_VM_EXPR_BENCH_CYCLES:-20000}"
+OUT_DIR="${METALFPGA_VM_EXPR_BENCH_DIR:-"$ROOT/artifacts/vm_expr_bench"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+for kind in shared mux deep; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  if [[ -f "$design" ]]; then
+    continue
+  fi
+  awk -v kind="$kind" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    print "  reg [31:0] lfsr;";
+    print "  reg [31:0] acc, x, y, z;";
+    print "  initial begin";
+    print "    clk = 0;";
+    print "    lfsr = 32'\''h1;";
+    print "    acc = 0;";
+    printf "    #%d $finish;\n", cycles * 2;
+    print "  end";
+    print "  always #1 clk = ~clk;";
+    print "  always @(posedge clk) begin";
+    print "    lfsr = {lfsr[30:0], lfsr[31] ^ lfsr[21] ^ lfsr[1] ^ lfsr[0]};";
+    if (kind == "shared") {
+      print "    x = ((lfsr[31:2] + acc) ^ (lfsr[31:2] + acc) >> 3) + ((lfsr[31:2] + acc) & 32'\''hff);";
+      print "    y = (lfsr[7:4] == 4'\''d3) ? (lfsr[31:2] + acc) : ((lfsr[7:4] == 4'\''d5) ? ((lfsr[31:2] + acc) >> 1) : ((lfsr[31:2] + acc) << 1));";
+      print "    acc = acc + (x ^ y) + ((x ^ y) >> 7) + ((x ^ y) << 3);";
+    } else {
+      n = (kind == "mux") ? 32 : 48;
+      e = "acc";
+      for (k = n - 1; k >= 0; --k) {
+        e = sprintf("(lfsr[9:3] == 7'\''d%d) ? (acc + %d) : %s", k, k * 3 + 1, e);
+      }
+      print "    acc = " e ";";
+    }
+    print "  end";
+    print "endmodule";
+  }' > "$design"
+done
+
+for kind in shared mux deep; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  for regs in 1 0; do
+    mode="shared"
+    if [[ "$regs" == "0" ]]; then
+      mode="unshared"
+    fi
+    report="$(METALFPGA_VM_EXPR_REGS="$regs" "$CLI" "$design" --top top \
+      --sched-vm --vm-profile "$@" 2>&1)"
+    cycles="$(sed -n 's/^vm expr ops (cycles=\([0-9]*\)).*/\1/p' \
+      <<<"$report")"
+    ops="$(awk '/^vm expr ops/ { on = 1; next } /^[^ ]/ { on = 0 }
+      on { for (i = 1; i <= NF; ++i) if ($i ~ /^count=/) {
+        v = $i; sub(/count=/, "", v); if (v == "") v = $(i + 1); s += v } }
+      END { print s + 0 }' <<<"$report")"
+    echo "${kind} ${mode}: ${ops} expr ops, ${cycles:-?} expr cycles"
+  done
+done
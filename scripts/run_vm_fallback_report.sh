@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Scheduler VM fallback report: runs --vm-fallback-report on every design of
+# a corpus (default deprecated/verilog/pass) in 2-state and 4-state mode and
+# sums the per-design counts: statements left to the non-VM path by kind
+# (assign, delay_assign, force, release, service, ...) and by reason.
+# Designs without procs (purely combinational, no scheduler) are counted as
+# "no_procs"; any other design whose layout fails is listed and counted as
+# "layout_failed".
+# Extra arguments go to metalfpga_cli.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CORPUS="${METALFPGA_VM_FALLBACK_CORPUS:-"$ROOT/deprecated/verilog/pass"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+for mode in 2state 4state; do
+  flags=()
+  if [[ "$mode" == "4state" ]]; then
+    flags+=(--4state)
+  fi
+  for design in "$CORPUS"/*.v; do
+    "$CLI" "$design" --vm-fallback-report ${flags[@]+"${flags[@]}"} \
+      "$@" 2>&1 | sed "s|^|$(basename "$design") |" || true
+  done | awk -v mode="$mode" '
+    $2 == "vm-fallback-report:" && /at least one proc/ {
+      ++counts["no_procs"];
+      next;
+    }
+    $2 == "vm-fallback-report:" && / layout failed/ {
+      failed[$1] = 1;
+      ++counts["layout_failed"];
+      next;
+    }
+    NF == 3 && $3 ~ /^[0-9]+$/ {
+      counts[$2] += $3;
+      if ($3 > 0) {
+        hit[$1] = 1;
+      }
+      next;
+    }
+    NF == 4 && $2 == "reason" && $4 ~ /^[0-9]+$/ {
+      reasons[$3] += $4;
+      next;
+    }
+    END {
+      n = 0;
+      for (d in hit) {
+        ++n;
+      }
+      printf "%s: %d designs with fallbacks\n", mode, n;
+      split("assign delay_assign force release service service_ret " \
+            "callgroup no_procs layout_failed", keys, " ");
+      for (i = 1; i in keys; ++i) {
+        printf "  %-14s %d\n", keys[i], counts[keys[i]];
+      }
+      sort = "sort";
+      for (r in reasons) {
+        printf "  reason %-32s %d\n", r, reasons[r] | sort;
+      }
+      close(sort);
+      for (d in failed) {
+        printf "  layout failed: %s\n", d | sort;
+      }
+      close(sort);
+    }'
+done
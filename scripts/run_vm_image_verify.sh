@@ -0,0 +1,176 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Scheduler VM image check: for every design of a corpus (default
+# deprecated/verilog/pass) with a VM layout, in 2-state and 4-state mode:
+#   - emits a .gpgavm image and runs --run-cpu from it; the output must
+#     match a run without the image;
+#   - writes corrupted copies with a valid checksum (every expression op
+#     widened to 0x2000003 bits; every packed slot given a 3-byte word) and
+#     checks --vm-image rejects them with exit code 1;
+#   - with METALFPGA_VM_IMAGE_FUZZ=N, flips N random bytes one image at a
+#     time (checksum fixed up) and checks the run either rejects the image
+#     or finishes, never crashing or hanging.
+# Designs whose plain run does not finish within METALFPGA_TIMEOUT_SECS
+# (default 60) are skipped. Needs python3 for the checksum. CPU-only.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CORPUS="${METALFPGA_VM_IMAGE_CORPUS:-"$ROOT/deprecated/verilog/pass"}"
+FUZZ="${METALFPGA_VM_IMAGE_FUZZ:-0}"
+OUT_DIR="${METALFPGA_VM_IMAGE_DIR:-"$ROOT/artifacts/vm_image_verify"}"
+LOG="$OUT_DIR/verify.log"
+TIMEOUT_SECS="${METALFPGA_TIMEOUT_SECS:-60}"
+
+TIMEOUT_BIN=""
+if command -v gtimeout >/dev/null 2>&1; then
+  TIMEOUT_BIN="gtimeout"
+elif command -v timeout >/dev/null 2>&1; then
+  TIMEOUT_BIN="timeout"
+fi
+
+# Exit status 124 (timeout) or 142 (perl alarm) when the run hangs.
+run_with_timeout() {
+  if [[ -n "$TIMEOUT_BIN" ]]; then
+    "$TIMEOUT_BIN" "${TIMEOUT_SECS}s" "$@"
+    return $?
+  fi
+  perl -e 'alarm shift; exec @ARGV' "$TIMEOUT_SECS" "$@"
+}
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+if ! command -v python3 >/dev/null 2>&1; then
+  echo "python3 not found" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+: > "$LOG"
+
+# corrupt SRC DST MODE [SEED]: MODE is widths, slots or flip.
+corrupt() {
+  python3 - "$@" <<'PY'
+import random, struct, sys
+src, dst, mode = sys.argv[1:4]
+buf = bytearray(open(src, "rb").read())
+header_bytes, section_count = struct.unpack_from("<II", buf, 8)
+sections = {}
+for i in range(section_count):
+    sid, elem, off, count = struct.unpack_from("<IIQQ", buf, header_bytes + 24 * i)
+    sections[sid] = (elem, off, count)
+touched = False
+if mode == "widths":
+    # Expression words (section 17): ops are op|arg<<8 plus a width word;
+    # kDone (0) is a single word.
+    _, off, count = sections[17]
+    ip = 0
+    while ip + 1 < count:
+        if buf[off + 4 * ip] == 0:
+            ip += 1
+            continue
+        struct.pack_into("<I", buf, off + 4 * (ip + 1), 0x2000003)
+        touched = True
+        ip += 2
+elif mode == "slots":
+    # Packed slots (section 4): {word_size, array_size}.
+    _, off, count = sections[4]
+    for i in range(count):
+        struct.pack_into("<I", buf, off + 8 * i, 3)
+        touched = True
+else:
+    rng = random.Random(int(sys.argv[4]))
+    spans = [(off, elem * count) for elem, off, count in sections.values()
+             if count]
+    off, size = rng.choice(spans)
+    buf[off + rng.randrange(size)] ^= 1 << rng.randrange(8)
+    touched = True
+if not touched:
+    sys.exit(3)
+# 64-bit FNV-1a over the file as 8-byte words, checksum field (24) zeroed.
+struct.pack_into("<Q", buf, 24, 0)
+h = 0xCBF29CE484222325
+for (word,) in struct.iter_unpack("<Q", bytes(buf)):
+    h = ((h ^ word) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+struct.pack_into("<Q", buf, 24, h)
+open(dst, "wb").write(buf)
+PY
+}
+
+total=0
+passed=0
+failed=0
+skipped=0
+fail() {
+  failed=$((failed + 1))
+  echo "FAIL $*" >> "$LOG"
+}
+for design in "$CORPUS"/*.v; do
+  name="$(basename "$design" .v)"
+  for mode in "" "--4state"; do
+    image="$OUT_DIR/$name$mode.gpgavm"
+    bad="$OUT_DIR/$name$mode.bad.gpgavm"
+    # shellcheck disable=SC2086
+    if ! "$CLI" "$design" --sched-vm $mode --emit-vm-image "$image" \
+        >/dev/null 2>&1; then
+      # No scheduler, or the design does not build.
+      skipped=$((skipped + 1))
+      continue
+    fi
+    rc=0
+    # shellcheck disable=SC2086
+    want="$(run_with_timeout "$CLI" "$design" --run-cpu --sched-vm $mode \
+      2>&1)" || rc=$?
+    if [[ "$rc" -gt 1 ]]; then
+      skipped=$((skipped + 1))
+      continue
+    fi
+    total=$((total + 1))
+    ok=1
+    # shellcheck disable=SC2086
+    got="$(run_with_timeout "$CLI" "$design" --run-cpu --sched-vm $mode \
+      --vm-image "$image" 2>&1 || true)"
+    if [[ "$want" != "$got" ]]; then
+      fail "$name$mode: run from image differs"
+      ok=0
+    fi
+    for kind in widths slots; do
+      if ! corrupt "$image" "$bad" "$kind"; then
+        continue
+      fi
+      rc=0
+      # shellcheck disable=SC2086
+      output="$(run_with_timeout "$CLI" "$design" --run-cpu --sched-vm $mode \
+        --vm-image "$bad" 2>&1)" || rc=$?
+      if [[ "$rc" -ne 1 ]] || ! grep -q "scheduler VM image:" <<<"$output"; then
+        fail "$name$mode: $kind-corrupted image not rejected (exit $rc)"
+        ok=0
+      fi
+    done
+    for ((seed = 1; seed <= FUZZ; ++seed)); do
+      corrupt "$image" "$bad" flip "$seed"
+      rc=0
+      # shellcheck disable=SC2086
+      run_with_timeout "$CLI" "$design" --run-cpu --sched-vm $mode \
+        --vm-image "$bad" >/dev/null 2>&1 || rc=$?
+      if [[ "$rc" -gt 1 ]]; then
+        cp "$bad" "$OUT_DIR/$name$mode.crash$seed.gpgavm"
+        fail "$name$mode: flip seed $seed exited $rc"
+        ok=0
+      fi
+    done
+    rm -f "$bad"
+    if [[ "$ok" -eq 1 ]]; then
+      passed=$((passed + 1))
+    fi
+  done
+done
+
+echo "vm image verify: total=$total passed=$passed failed=$failed" \
+  "skipped=$skipped"
+echo "log: $LOG"
+if [[ "$failed" -gt 0 ]]; then
+  exit 1
+fi
@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Scheduler VM peephole benchmark: generates clocked designs driven by an
+# LFSR for METALFPGA_VM_OPT_BENCH_CYCLES cycles, profiles each on the host
+# SchedulerVm interpreter (--sched-vm --vm-profile --sched-vm-opt) and
+# reports the dynamic instruction count and VM cycles before and after the
+# pass. Designs:
+#   ifelse: nested if/else chains (kBranch, jump threading)
+#   assign: long runs of blocking and nonblocking assigns (kAssignRun)
+#   loop:   a for loop accumulating over the LFSR bits (kBranch)
+# Extra arguments go to metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+CYCLES="${METALFPGA_VM_OPT_BENCH_CYCLES:-20000}"
+OUT_DIR="${METALFPGA_VM_OPT_BENCH_DIR:-"$ROOT/artifacts/vm_opt_bench"}"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+for kind in ifelse assign loop; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  if [[ -f "$design" ]]; then
+    continue
+  fi
+  awk -v kind="$kind" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    print "  reg [31:0] lfsr;";
+    print "  reg [31:0] acc;";
+    print "  reg [31:0] r [0:15];";
+    print "  reg [31:0] t0, t1, t2, t3;";
+    print "  integer i;";
+    print "  initial begin";
+    print "    clk = 0;";
+    print "    lfsr = 32'\''h1;";
+    print "    acc = 0;";
+    printf "    #%d $finish;\n", cycles * 2;
+    print "  end";
+    print "  always #1 clk = ~clk;";
+    print "  always @(posedge clk) begin";
+    print "    lfsr = {lfsr[30:0], lfsr[31] ^ lfsr[21] ^ lfsr[1] ^ lfsr[0]};";
+    if (kind == "ifelse") {
+      for (k = 0; k < 8; ++k) {
+        printf "    if (lfsr[%d]) begin\n", k;
+        printf "      if (lfsr[%d]) acc = acc + %d;\n", k + 8, k + 1;
+        printf "      else acc = acc ^ %d;\n", k * 7 + 3;
+        print "    end else begin";
+        printf "      acc = acc - %d;\n", k + 2;
+        print "    end";
+      }
+    } else if (kind == "assign") {
+      print "    t0 = lfsr + acc;";
+      print "    t1 = t0 ^ (lfsr >> 3);";
+      print "    t2 = t1 + (t0 << 1);";
+      print "    t3 = t2 ^ t1;";
+      for (k = 0; k < 16; ++k) {
+        printf "    r[%d] <= t%d + %d;\n", k, k % 4, k;
+      }
+      print "    acc = acc + t3;";
+    } else {
+      print "    for (i = 0; i < 16; i = i + 1) begin";
+      print "      if (lfsr[i]) acc = acc + i;";
+      print "      else acc = acc ^ i;";
+      print "    end";
+    }
+    print "  end";
+    print "endmodule";
+  }' > "$design"
+done
+
+for kind in ifelse assign loop; do
+  design="$OUT_DIR/${kind}_${CYCLES}.v"
+  report="$("$CLI" "$design" --top top --sched-vm --vm-profile \
+    --sched-vm-opt "$@" 2>&1)"
+  ops="$(sed -n 's/^vm opt: .*dynamic ops \([0-9]* -> [0-9]*\).*/\1/p' \
+    <<<"$report")"
+  cycles="$(sed -n 's/^vm ops (cycles=\([0-9]*\)).*/\1/p' <<<"$report" |
+    paste -sd' ' | sed 's/ / -> /')"
+  echo "${kind}: dynamic ops ${ops:-?}, vm cycles ${cycles:-?}"
+done
@@ -0,0 +1,88 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Waveform format benchmark: generates a clocked design with
+# METALFPGA_WAVE_BENCH_COUNTERS free-running counters of mixed widths and a
+# METALFPGA_WAVE_BENCH_WORDS-word memory written twice per cycle, runs it on
+# the CPU backend for METALFPGA_WAVE_BENCH_CYCLES cycles with
+# --wave-format vcd and --wave-format gpgawf, and reports file size and the
+# writer's snapshot time (--run-verbose "vcd:" line) for each. The gpgawf
+# file is then converted with metalfpga_wave2vcd and compared with the VCD.
+# Extra arguments go to metalfpga_cli (e.g. --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+WAVE2VCD="${METALFPGA_WAVE2VCD:-"$ROOT/build/metalfpga_wave2vcd"}"
+COUNTERS="${METALFPGA_WAVE_BENCH_COUNTERS:-64}"
+WORDS="${METALFPGA_WAVE_BENCH_WORDS:-256}"
+CYCLES="${METALFPGA_WAVE_BENCH_CYCLES:-20000}"
+OUT_DIR="${METALFPGA_WAVE_BENCH_DIR:-"$ROOT/artifacts/wave_bench"}"
+DESIGN="$OUT_DIR/design_${COUNTERS}x${WORDS}x${CYCLES}.v"
+
+source "$ROOT/scripts/bench_common.sh"
+
+for tool in "$CLI" "$WAVE2VCD"; do
+  if [[ ! -x "$tool" ]]; then
+    echo "tool not found/executable: $tool" >&2
+    exit 1
+  fi
+done
+
+mkdir -p "$OUT_DIR"
+
+if [[ ! -f "$DESIGN" ]]; then
+  awk -v counters="$COUNTERS" -v words="$WORDS" -v cycles="$CYCLES" 'BEGIN {
+    print "module top;";
+    print "  reg clk;";
+    print "  reg [31:0] cnt;";
+    for (i = 0; i < counters; ++i) {
+      printf "  reg [%d:0] c%d;\n", (i % 4) * 16 + 7, i;
+    }
+    printf "  reg [15:0] mem [0:%d];\n", words - 1;
+    print "  integer i;";
+    print "  initial begin";
+    print "    $dumpfile(\"bench.vcd\");";
+    print "    $dumpvars(0, top);";
+    print "    clk = 0;";
+    print "    cnt = 0;";
+    for (i = 0; i < counters; ++i) {
+      printf "    c%d = 0;\n", i;
+    }
+    printf "    for (i = 0; i < %d; i = i + 1) mem[i] = 0;\n", words;
+    printf "    #%d $finish;\n", cycles * 2;
+    print "  end";
+    print "  always #1 clk = ~clk;";
+    print "  always @(posedge clk) begin";
+    print "    cnt <= cnt + 1;";
+    for (i = 0; i < counters; ++i) {
+      printf "    c%d <= c%d + %d;\n", i, i, i % 5 + 1;
+    }
+    printf "    mem[cnt %% %d] <= cnt[15:0];\n", words;
+    printf "    mem[(cnt * 7) %% %d] <= cnt[15:0] ^ 16'\''h5a5a;\n", words;
+    print "  end";
+    print "endmodule";
+  }' > "$DESIGN"
+fi
+
+for format in vcd gpgawf; do
+  run_dir="$OUT_DIR/run_$format"
+  rm -rf "$run_dir"
+  mkdir -p "$run_dir"
+  log="$run_dir/run.log"
+  start_ms="$(now_ms)"
+  "$CLI" "$DESIGN" --top top --run-cpu --run-verbose --vcd-dir "$run_dir" \
+    --vcd-steps 1 --wave-format "$format" "$@" >"$log" 2>&1
+  end_ms="$(now_ms)"
+  file="$run_dir/bench.$format"
+  vcd="$(sed -n 's/^vcd: \(.*\)$/\1/p' "$log" | tail -n 1)"
+  echo "$format: $(wc -c <"$file") bytes, ${vcd:-no vcd stats}," \
+       "wall $((end_ms - start_ms)) ms"
+done
+
+"$WAVE2VCD" "$OUT_DIR/run_gpgawf/bench.gpgawf"
+if cmp -s "$OUT_DIR/run_vcd/bench.vcd" "$OUT_DIR/run_gpgawf/bench.vcd"; then
+  echo "wave2vcd: matches direct VCD"
+else
+  echo "wave2vcd: differs from direct VCD" >&2
+  exit 1
+fi
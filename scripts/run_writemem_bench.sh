@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# $writememh dump benchmark: for each size in METALFPGA_WRITEMEM_BENCH_SIZES_MB
+# builds a 32-bit memory whose $writememh dump is that many MiB, loads it
+# with $readmemh and dumps it, timing --run-cpu with the per-word writer
+# (METALFPGA_MEM_IMAGE_THREADS=0) and with the chunked writer. The same
+# design run without the dump is subtracted, so the reported times and MiB/s
+# are for the dump itself. Extra arguments go to metalfpga_cli (e.g.
+# --4state).
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+CLI="${METALFPGA_CLI:-"$ROOT/build/metalfpga_cli"}"
+SIZES="${METALFPGA_WRITEMEM_BENCH_SIZES_MB:-1 16 256}"
+OUT_DIR="${METALFPGA_WRITEMEM_BENCH_DIR:-"$ROOT/artifacts/writemem_bench"}"
+
+source "$ROOT/scripts/bench_common.sh"
+
+if [[ ! -x "$CLI" ]]; then
+  echo "metalfpga_cli not found/executable: $CLI" >&2
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+
+run_ms() {
+  local start_ms end_ms
+  start_ms="$(now_ms)"
+  env "$@" >/dev/null 2>>"$OUT_DIR/run.log"
+  end_ms="$(now_ms)"
+  echo "$((end_ms - start_ms))"
+}
+
+for mb in $SIZES; do
+  words="$((mb * 1024 * 1024 / 9))"
+  image="$OUT_DIR/image_${mb}mb.hex"
+  dump="$OUT_DIR/dump_${mb}mb.hex"
+  if [[ ! -f "$image" ]]; then
+    awk -v n="$words" 'BEGIN {
+      for (i = 0; i < n; ++i) {
+        printf "%08x\n", (i * 40503 + 12345) % 4294967296;
+      }
+    }' > "$image"
+  fi
+  for kind in dump load; do
+    design="$OUT_DIR/design_${mb}mb_${kind}.v"
+    printf 'module top;\n  reg [31:0] mem [0:%d];\n' "$((words - 1))" \
+      > "$design"
+    printf '  initial begin\n    $readmemh("%s", mem);\n' "$image" >> "$design"
+    if [[ "$kind" == dump ]]; then
+      printf '    $writememh("%s", mem);\n' "$dump" >> "$design"
+    fi
+    printf '  end\nendmodule\n' >> "$design"
+  done
+  design="$OUT_DIR/design_${mb}mb_dump.v"
+  baseline="$OUT_DIR/design_${mb}mb_load.v"
+  args=(--top top --run-cpu "$@")
+  # The first run fills the --run-cpu kernel cache.
+  run_ms "$CLI" "$baseline" "${args[@]}" >/dev/null
+  run_ms "$CLI" "$design" "${args[@]}" >/dev/null
+  base_ms="$(run_ms "$CLI" "$baseline" "${args[@]}")"
+  slow_ms="$(run_ms METALFPGA_MEM_IMAGE_THREADS=0 "$CLI" "$design" \
+    "${args[@]}")"
+  slow_sum="$(cksum <"$dump")"
+  fast_ms="$(run_ms "$CLI" "$design" "${args[@]}")"
+  if [[ "$(cksum <"$dump")" != "$slow_sum" ]]; then
+    echo "writememh ${mb} MiB: dumps differ between writers" >&2
+    exit 1
+  fi
+  awk -v mb="$mb" -v words="$words" -v base="$base_ms" -v slow="$slow_ms" \
+      -v fast="$fast_ms" 'BEGIN {
+    slow = (slow > base) ? slow - base : 1;
+    fast = (fast > base) ? fast - base : 1;
+    printf "writememh %d MiB (%d words): per-word %d ms (%.1f MiB/s), " \
+           "chunked %d ms (%.1f MiB/s), %.2fx\n",
+           mb, words, slow, mb * 1000 / slow, fast, mb * 1000 / fast,
+           slow / fast;
+  }'
+done
@@ -0,0 +1,302 @@
+#include "codegen/cpp_codegen.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utils/msl_naming.hh"
+
+namespace gpga {
+
+namespace {
+
+struct CpuKernelParam {
+  std::string type;
+  std::string name;
+  std::string attribute;
+};
+
+struct CpuKernelSignature {
+  std::string name;
+  std::vector<CpuKernelParam> params;
+};
+
+std::string TrimSpaces(const std::string& text) {
+  size_t start = 0;
+  while (start < text.size() &&
+         (text[start] == ' ' || text[start] == '\t' || text[start] == '\n' ||
+          text[start] == '\r')) {
+    ++start;
+  }
+  size_t end = text.size();
+  while (end > start &&
+         (text[end - 1] == ' ' || text[end - 1] == '\t' ||
+          text[end - 1] == '\n' || text[end - 1] == '\r')) {
+    --end;
+  }
+  return text.substr(start, end - start);
+}
+
+std::vector<std::string> SplitParams(const std::string& text) {
+  std::vector<std::string> out;
+  int depth = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    char c = text[i];
+    if (c == '(' || c == '[' || c == '<') {
+      ++depth;
+    } else if (c == ')' || c == ']' || c == '>') {
+      --depth;
+    } else if (c == ',' && depth == 0) {
+      out.push_back(TrimSpaces(text.substr(start, i - start)));
+      start = i + 1;
+    }
+  }
+  std::string tail = TrimSpaces(text.substr(start));
+  if (!tail.empty()) {
+    out.push_back(tail);
+  }
+  return out;
+}
+
+bool ParseKernelParam(const std::string& text, CpuKernelParam* out) {
+  std::string decl = text;
+  size_t attr_open = text.find("[[");
+  if (attr_open != std::string::npos) {
+    size_t attr_close = text.find("]]", attr_open + 2);
+    if (attr_close == std::string::npos) {
+      return false;
+    }
+    out->attribute =
+        TrimSpaces(text.substr(attr_open + 2, attr_close - attr_open - 2));
+    decl = text.substr(0, attr_open);
+  }
+  decl = TrimSpaces(decl);
+  size_t name_start = decl.size();
+  while (name_start > 0 && IsMslIdentChar(decl[name_start - 1])) {
+    --name_start;
+  }
+  if (name_start == decl.size() || name_start == 0) {
+    return false;
+  }
+  out->name = decl.substr(name_start);
+  out->type = TrimSpaces(decl.substr(0, name_start));
+  return !out->type.empty();
+}
+
+bool ParseBufferIndex(const std::string& attribute, uint32_t* index) {
+  const std::string prefix = "buffer(";
+  if (attribute.compare(0, prefix.size(), prefix) != 0 ||
+      attribute.back() != ')') {
+    return false;
+  }
+  std::string digits =
+      attribute.substr(prefix.size(), attribute.size() - prefix.size() - 1);
+  if (digits.empty()) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (char c : digits) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    value = value * 10u + static_cast<uint32_t>(c - '0');
+  }
+  *index = value;
+  return true;
+}
+
+bool CollectKernelSignatures(const std::string& msl,
+                             std::vector<CpuKernelSignature>* out,
+                             std::string* error) {
+  const std::string token = "kernel void ";
+  size_t pos = 0;
+  while ((pos = msl.find(token, pos)) != std::string::npos) {
+    if (pos > 0 && msl[pos - 1] != '\n') {
+      pos += token.size();
+      continue;
+    }
+    size_t name_start = pos + token.size();
+    size_t open = msl.find('(', name_start);
+    if (open == std::string::npos) {
+      break;
+    }
+    CpuKernelSignature sig;
+    sig.name = TrimSpaces(msl.substr(name_start, open - name_start));
+    int depth = 0;
+    size_t close = open;
+    for (; close < msl.size(); ++close) {
+      if (msl[close] == '(') {
+        ++depth;
+      } else if (msl[close] == ')') {
+        if (--depth == 0) {
+          break;
+        }
+      }
+    }
+    if (close >= msl.size()) {
+      if (error) {
+        *error = "unterminated kernel signature for " + sig.name;
+      }
+      return false;
+    }
+    for (const auto& text :
+         SplitParams(msl.substr(open + 1, close - open - 1))) {
+      CpuKernelParam param;
+      if (!ParseKernelParam(text, &param)) {
+        if (error) {
+          *error = "unsupported kernel parameter in " + sig.name + ": " + text;
+        }
+        return false;
+      }
+      sig.params.push_back(std::move(param));
+    }
+    out->push_back(std::move(sig));
+    pos = close;
+  }
+  return true;
+}
+
+// Attribute specifiers ([[buffer(N)]], [[id(N)]], thread positions) carry no
+// meaning for the host compiler once the entry points bind them explicitly.
+std::string StripAttributes(const std::string& source) {
+  std::string out;
+  out.reserve(source.size());
+  size_t pos = 0;
+  while (pos < source.size()) {
+    size_t open = source.find("[[", pos);
+    if (open == std::string::npos) {
+      out.append(source, pos, std::string::npos);
+      break;
+    }
+    size_t close = source.find("]]", open + 2);
+    if (close == std::string::npos) {
+      out.append(source, pos, std::string::npos);
+      break;
+    }
+    size_t end = open;
+    while (end > pos && source[end - 1] == ' ') {
+      --end;
+    }
+    out.append(source, pos, end - pos);
+    pos = close + 2;
+  }
+  return out;
+}
+
+bool EmitCpuEntry(const CpuKernelSignature& sig, std::ostringstream& out,
+                  std::string* error) {
+  std::ostringstream bind;
+  std::vector<std::string> args;
+  for (size_t i = 0; i < sig.params.size(); ++i) {
+    const CpuKernelParam& param = sig.params[i];
+    uint32_t index = 0;
+    if (ParseBufferIndex(param.attribute, &index)) {
+      std::string local = "gpga_arg" + std::to_string(i);
+      std::string slot = "gpga_buffers[" + std::to_string(index) + "]";
+      if (!param.type.empty() && param.type.back() == '&') {
+        std::string base =
+            TrimSpaces(param.type.substr(0, param.type.size() - 1));
+        bind << "  " << param.type << " " << local << " = *(" << base << "*)"
+             << slot << ";\n";
+      } else {
+        bind << "  " << param.type << " " << local << " = (" << param.type
+             << ")" << slot << ";\n";
+      }
+      args.push_back(local);
+    } else if (param.attribute == "thread_position_in_grid" ||
+               param.attribute == "threadgroup_position_in_grid") {
+      // CPU dispatch runs threadgroups of one thread.
+      args.push_back("gpga_gid");
+    } else if (param.attribute == "thread_position_in_threadgroup") {
+      args.push_back("0u");
+    } else {
+      if (error) {
+        *error = "unsupported kernel parameter binding in " + sig.name + ": " +
+                 param.name + " [[" + param.attribute + "]]";
+      }
+      return false;
+    }
+  }
+  out << "extern \"C\" void " << sig.name << kCpuKernelEntrySuffix
+      << "(void* const* gpga_buffers, uint gpga_gid_begin,\n"
+      << "    uint gpga_gid_end) {\n"
+      << bind.str()
+      << "  for (uint gpga_gid = gpga_gid_begin; gpga_gid < gpga_gid_end; "
+         "++gpga_gid) {\n"
+      << "    " << sig.name << "(";
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (i > 0) {
+      out << ", ";
+    }
+    out << args[i];
+  }
+  out << ");\n"
+      << "  }\n"
+      << "}\n\n";
+  return true;
+}
+
+}  // namespace
+
+bool TranslateMslToCpp(const std::string& msl, std::string* out,
+                       std::string* error) {
+  if (!out) {
+    if (error) {
+      *error = "C++ output pointer is null";
+    }
+    return false;
+  }
+  std::vector<CpuKernelSignature> kernels;
+  if (!CollectKernelSignatures(msl, &kernels, error)) {
+    return false;
+  }
+
+  std::ostringstream body;
+  std::istringstream in(msl);
+  std::string line;
+  bool wrote_prelude = false;
+  while (std::getline(in, line)) {
+    if (line == "#include <metal_stdlib>") {
+      if (!wrote_prelude) {
+        body << "#define GPGA_CPU_BACKEND 1\n#include \"gpga_cpu.h\"\n";
+        wrote_prelude = true;
+      }
+      continue;
+    }
+    if (line == "using namespace metal;") {
+      continue;
+    }
+    if (line == "#include \"gpga_real_decl.h\"") {
+      // The Metal backend links the real helpers from a separate dynamic
+      // library; on the host they are compiled into the same unit.
+      body << "#include \"gpga_real.h\"\n";
+      continue;
+    }
+    body << line << "\n";
+  }
+
+  std::ostringstream cpp;
+  cpp << "// Host C++ build of the MSL kernels (metalfpga --emit-cpp).\n";
+  if (!wrote_prelude) {
+    cpp << "#define GPGA_CPU_BACKEND 1\n#include \"gpga_cpu.h\"\n";
+  }
+  cpp << StripAttributes(body.str());
+  cpp << "\n// CPU entry points: run the kernel for gid in [gid_begin, gid_end).\n";
+  for (const auto& sig : kernels) {
+    if (!EmitCpuEntry(sig, cpp, error)) {
+      return false;
+    }
+  }
+  *out = cpp.str();
+  return true;
+}
+
+bool EmitCppStub(const Module& module, const MslEmitOptions& options,
+                 std::string* out, std::string* error) {
+  return TranslateMslToCpp(EmitMSLStub(module, options), out, error);
+}
+
+}  // namespace gpga
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+#include "codegen/msl_codegen.hh"
+#include "frontend/ast.hh"
+
+namespace gpga {
+
+// Suffix of the extern "C" entry point emitted for every kernel. The entry is
+//   void <kernel>__cpu(void* const* buffers, uint gid_begin, uint gid_end)
+// where buffers[N] is the contents pointer (plus offset) bound at [[buffer(N)]].
+constexpr const char* kCpuKernelEntrySuffix = "__cpu";
+
+// Host C++ flavour of EmitMSLStub: the same kernels, built on include/gpga_cpu.h
+// so they compile with the host compiler (see --emit-cpp / --run-cpu).
+bool EmitCppStub(const Module& module, const MslEmitOptions& options,
+                 std::string* out, std::string* error);
+
+// Rewrites MSL produced by EmitMSLStub into a host C++ translation unit and
+// appends one entry point per kernel. Fails on kernel parameters the CPU
+// backend cannot bind.
+bool TranslateMslToCpp(const std::string& msl, std::string* out,
+                       std::string* error);
+
+}  // namespace gpga
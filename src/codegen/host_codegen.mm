@@ -298,6 +298,7 @@ std::string EmitHostStub(const Module& module) {
   }
 
   out << "#include \"runtime/metal_runtime.hh\"\n";
+  out << "#include \"runtime/sched_manifest.hh\"\n";
   out << "#include \"gpga_sched.h\"\n";
   out << "#include <algorithm>\n";
   out << "#include <chrono>\n";
@@ -589,7 +590,16 @@ std::string EmitHostStub(const Module& module) {
   out << "    sched_source = expanded_source;\n";
   out << "  }\n";
   out << "  gpga::SchedulerConstants sched;\n";
-  out << "  gpga::ParseSchedulerConstants(sched_source, &sched, &error);\n";
+  out << "  gpga::SchedulerManifest manifest;\n";
+  out << "  std::string manifest_error;\n";
+  out << "  if (gpga::LoadSchedulerManifest(gpga::SchedulerManifestPathForMsl(msl_path),\n";
+  out << "                                  &manifest, &manifest_error) &&\n";
+  out << "      gpga::SchedulerManifestMatchesSource(manifest, msl_source)) {\n";
+  out << "    sched = manifest.sched;\n";
+  out << "    runtime.SetKernelBindingTables(manifest.kernels);\n";
+  out << "  } else {\n";
+  out << "    gpga::ParseSchedulerConstants(sched_source, &sched, &error);\n";
+  out << "  }\n";
   out << "  profiler.Mark(\"parse_sched\");\n";
   out << "  gpga::ModuleInfo module = BuildModuleInfo();\n";
   out << "  module.four_state = sched_source.find(\"gpga_4state.h\") != std::string::npos;\n\n";
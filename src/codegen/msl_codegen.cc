@@ -14,13 +14,21 @@
 #include <unordered_set>
 #include <vector>
 
+#include "core/bit_packing.hh"
 #include "core/scheduler_vm.hh"
+#include "core/scheduler_vm_opt.hh"
+#include "core/state_locality.hh"
+#include "runtime/sched_manifest.hh"
 #include "utils/msl_naming.hh"
 
 namespace gpga {
 
 namespace {
 
+// --prune-xz: the packed state segment (and VM slot) every buffer-backed
+// X/Z-free net points its _xz at. Nothing stores a nonzero value there.
+constexpr const char* kPackedXzZeroName = "__gpga_xz_zero";
+
 class ConditionalStringBuf final : public std::stringbuf {
  public:
   void set_enabled(bool enabled) { enabled_ = enabled; }
@@ -732,6 +740,19 @@ bool HasUserTaskCall(const Module& module,
 const std::unordered_map<std::string, int>* g_task_arg_widths = nullptr;
 const std::unordered_map<std::string, bool>* g_task_arg_signed = nullptr;
 const std::unordered_map<std::string, bool>* g_task_arg_real = nullptr;
+// Flat local names rebound to instance state by hierarchical codegen.
+const std::unordered_map<std::string, std::string>* g_msl_local_aliases =
+    nullptr;
+
+std::string MslLocalName(const std::string& name) {
+  if (g_msl_local_aliases) {
+    auto it = g_msl_local_aliases->find(name);
+    if (it != g_msl_local_aliases->end()) {
+      return it->second;
+    }
+  }
+  return MslName(name);
+}
 
 int ExprWidth(const Expr& expr, const Module& module);
 
@@ -3483,6 +3504,18 @@ std::vector<int> CollectWideWidths(const Module& module) {
   return result;
 }
 
+// Width of the scheduler VM wide evaluator: the widest value over 64 bits
+// the design computes, or 0 when every value fits in 64 bits.
+uint32_t SchedulerVmExprWideBits(const Module& module) {
+  uint32_t wide_bits = 0u;
+  for (int width : CollectWideWidths(module)) {
+    if (width > 64) {
+      wide_bits = std::max(wide_bits, static_cast<uint32_t>(width));
+    }
+  }
+  return wide_bits;
+}
+
 void CollectSystemTaskInfo(const Statement& stmt, SystemTaskInfo* info) {
   if (!info) {
     return;
@@ -3722,6 +3755,532 @@ std::vector<size_t> OrderAssigns(const Module& module) {
   return ordered;
 }
 
+// True when `a` in the instance at `prefix_a` and `b` in the instance at
+// `prefix_b` are the same expression once each instance prefix is stripped.
+bool ExprMatchesAcrossInstances(const Expr* a, const Expr* b,
+                                const std::string& prefix_a,
+                                const std::string& prefix_b) {
+  if (!a || !b) {
+    return a == b;
+  }
+  if (a->kind != b->kind || a->string_value != b->string_value ||
+      a->number != b->number || a->value_bits != b->value_bits ||
+      a->x_bits != b->x_bits || a->z_bits != b->z_bits ||
+      a->number_width != b->number_width || a->has_width != b->has_width ||
+      a->has_base != b->has_base || a->base_char != b->base_char ||
+      a->is_signed != b->is_signed ||
+      a->is_real_literal != b->is_real_literal || a->op != b->op ||
+      a->unary_op != b->unary_op || a->msb != b->msb || a->lsb != b->lsb ||
+      a->has_range != b->has_range || a->indexed_range != b->indexed_range ||
+      a->indexed_desc != b->indexed_desc ||
+      a->indexed_width != b->indexed_width || a->repeat != b->repeat ||
+      a->elements.size() != b->elements.size() ||
+      a->call_args.size() != b->call_args.size()) {
+    return false;
+  }
+  if (a->ident != b->ident &&
+      (a->ident.compare(0, prefix_a.size(), prefix_a) != 0 ||
+       b->ident.compare(0, prefix_b.size(), prefix_b) != 0 ||
+       a->ident.compare(prefix_a.size(), std::string::npos, b->ident,
+                        prefix_b.size(), std::string::npos) != 0)) {
+    return false;
+  }
+  const Expr* a_children[] = {a->operand.get(),   a->lhs.get(),
+                              a->rhs.get(),       a->condition.get(),
+                              a->then_expr.get(), a->else_expr.get(),
+                              a->base.get(),      a->index.get(),
+                              a->msb_expr.get(),  a->lsb_expr.get(),
+                              a->repeat_expr.get()};
+  const Expr* b_children[] = {b->operand.get(),   b->lhs.get(),
+                              b->rhs.get(),       b->condition.get(),
+                              b->then_expr.get(), b->else_expr.get(),
+                              b->base.get(),      b->index.get(),
+                              b->msb_expr.get(),  b->lsb_expr.get(),
+                              b->repeat_expr.get()};
+  for (size_t i = 0; i < sizeof(a_children) / sizeof(a_children[0]); ++i) {
+    if (!ExprMatchesAcrossInstances(a_children[i], b_children[i], prefix_a,
+                                    prefix_b)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < a->elements.size(); ++i) {
+    if (!ExprMatchesAcrossInstances(a->elements[i].get(),
+                                    b->elements[i].get(), prefix_a,
+                                    prefix_b)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < a->call_args.size(); ++i) {
+    if (!ExprMatchesAcrossInstances(a->call_args[i].get(),
+                                    b->call_args[i].get(), prefix_a,
+                                    prefix_b)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Hierarchical codegen for one kernel. An instance body is the set of
+// assigns that drive the instance's own signals from its own signals; the
+// instances of a group whose bodies match share one state struct and one
+// eval function, and each body becomes a call on that instance's slot in a
+// per-group state array (a segment of the gpga_inst_state buffer). Port
+// connections stay inline in the kernel.
+struct MslInstanceGroupPlan {
+  std::string module_name;
+  std::string struct_name;
+  std::string eval_name;
+  std::string array_name;
+  std::vector<std::string> members;
+  // Instance prefixes by slot; slots follow evaluation order.
+  std::vector<std::string> prefixes;
+  // Body of the first instance in evaluation order; the other instances'
+  // bodies match it assign for assign.
+  std::vector<size_t> body;
+};
+
+// Instances [slot_begin, slot_end) of one group evaluated back to back, as
+// one call or one loop over the slots.
+struct MslInstanceCall {
+  size_t group = 0;
+  size_t slot_begin = 0;
+  size_t slot_end = 0;
+};
+
+struct MslHierarchyPlan {
+  std::vector<MslInstanceGroupPlan> groups;
+  // Assign order with every instance body contiguous.
+  std::vector<size_t> order;
+  // First assign of each run of instance bodies -> the run; the remaining
+  // assigns of the run are folded into it.
+  std::unordered_map<size_t, MslInstanceCall> calls;
+  std::unordered_set<size_t> folded;
+  // Flat local name -> member of its instance's state slot.
+  std::unordered_map<std::string, std::string> aliases;
+};
+
+// Fills `plan` for the groups that can share a body; returns false (leaving
+// the kernel flat) when none can or the instance bodies cannot be ordered
+// as units.
+bool PlanHierarchicalAssigns(const Module& module,
+                             const std::vector<InstanceGroup>& groups,
+                             const std::unordered_set<std::string>& locals,
+                             MslHierarchyPlan* plan) {
+  const size_t count = module.assigns.size();
+  std::unordered_map<std::string, std::vector<size_t>> lhs_to_indices;
+  lhs_to_indices.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    lhs_to_indices[module.assigns[i].lhs].push_back(i);
+  }
+  std::unordered_map<std::string, const Net*> nets_by_name;
+  nets_by_name.reserve(module.nets.size());
+  for (const auto& net : module.nets) {
+    nets_by_name[net.name] = &net;
+  }
+
+  // Candidate instances: every member is a scalar, single-driver local.
+  struct Candidate {
+    size_t group = 0;
+    std::string prefix;
+    std::vector<size_t> body;
+  };
+  std::vector<Candidate> candidates;
+  std::unordered_map<std::string, size_t> owner;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    for (const auto& prefix : groups[g].prefixes) {
+      bool ok = !groups[g].members.empty();
+      for (const auto& member : groups[g].members) {
+        const std::string name = prefix + member;
+        auto net_it = nets_by_name.find(name);
+        if (net_it == nets_by_name.end() || locals.count(name) == 0 ||
+            net_it->second->is_real || net_it->second->width > 64) {
+          ok = false;
+          break;
+        }
+        auto lhs_it = lhs_to_indices.find(name);
+        if (lhs_it != lhs_to_indices.end() &&
+            (lhs_it->second.size() > 1 ||
+             module.assigns[lhs_it->second.front()].lhs_has_range)) {
+          ok = false;
+          break;
+        }
+      }
+      if (!ok) {
+        continue;
+      }
+      for (const auto& member : groups[g].members) {
+        owner[prefix + member] = candidates.size();
+      }
+      Candidate candidate;
+      candidate.group = g;
+      candidate.prefix = prefix;
+      candidates.push_back(std::move(candidate));
+    }
+  }
+  if (candidates.empty()) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    const auto& assign = module.assigns[i];
+    auto it = owner.find(assign.lhs);
+    if (it == owner.end() || !assign.rhs) {
+      continue;
+    }
+    std::unordered_set<std::string> deps;
+    CollectIdentifiers(*assign.rhs, &deps);
+    bool own = true;
+    for (const auto& dep : deps) {
+      auto dep_it = owner.find(dep);
+      if (dep_it == owner.end() || dep_it->second != it->second) {
+        own = false;
+        break;
+      }
+    }
+    if (own) {
+      candidates[it->second].body.push_back(i);
+    }
+  }
+
+  // Keep the instances whose bodies match the group's first instance;
+  // `instance_bodies` holds each kept instance's body in evaluation order.
+  std::vector<std::vector<std::vector<size_t>>> instance_bodies;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const Candidate* first = nullptr;
+    std::vector<const Candidate*> kept;
+    for (const auto& candidate : candidates) {
+      if (candidate.group != g || candidate.body.empty()) {
+        continue;
+      }
+      if (!first) {
+        first = &candidate;
+        kept.push_back(first);
+        continue;
+      }
+      if (candidate.body.size() != first->body.size()) {
+        continue;
+      }
+      bool match = true;
+      for (const auto& member : groups[g].members) {
+        if (nets_by_name[candidate.prefix + member]->width !=
+            nets_by_name[first->prefix + member]->width) {
+          match = false;
+          break;
+        }
+      }
+      for (size_t j = 0; match && j < first->body.size(); ++j) {
+        const Assign& a = module.assigns[first->body[j]];
+        const Assign& b = module.assigns[candidate.body[j]];
+        match = a.lhs.compare(first->prefix.size(), std::string::npos, b.lhs,
+                              candidate.prefix.size(), std::string::npos) ==
+                    0 &&
+                ExprMatchesAcrossInstances(a.rhs.get(), b.rhs.get(),
+                                           first->prefix, candidate.prefix);
+      }
+      if (match) {
+        kept.push_back(&candidate);
+      }
+    }
+    if (kept.size() < 2) {
+      continue;
+    }
+
+    // Order the shared body by its internal dependencies.
+    const std::vector<size_t>& body = first->body;
+    std::unordered_map<std::string, size_t> body_lhs;
+    for (size_t j = 0; j < body.size(); ++j) {
+      body_lhs[module.assigns[body[j]].lhs] = j;
+    }
+    std::vector<int> indegree(body.size(), 0);
+    std::vector<std::vector<size_t>> edges(body.size());
+    for (size_t j = 0; j < body.size(); ++j) {
+      std::unordered_set<std::string> deps;
+      CollectIdentifiers(*module.assigns[body[j]].rhs, &deps);
+      for (const auto& dep : deps) {
+        auto it = body_lhs.find(dep);
+        if (it != body_lhs.end() && it->second != j) {
+          edges[it->second].push_back(j);
+          indegree[j]++;
+        }
+      }
+    }
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+        ready;
+    for (size_t j = 0; j < body.size(); ++j) {
+      if (indegree[j] == 0) {
+        ready.push(j);
+      }
+    }
+    std::vector<size_t> body_order;
+    while (!ready.empty()) {
+      size_t current = ready.top();
+      ready.pop();
+      body_order.push_back(current);
+      for (size_t next : edges[current]) {
+        if (--indegree[next] == 0) {
+          ready.push(next);
+        }
+      }
+    }
+    if (body_order.size() != body.size()) {
+      continue;
+    }
+
+    MslInstanceGroupPlan group;
+    group.module_name = groups[g].module_name;
+    group.members = groups[g].members;
+    for (size_t j : body_order) {
+      group.body.push_back(body[j]);
+    }
+    std::vector<std::vector<size_t>> bodies;
+    for (const Candidate* candidate : kept) {
+      group.prefixes.push_back(candidate->prefix);
+      std::vector<size_t> ordered_body;
+      for (size_t j : body_order) {
+        ordered_body.push_back(candidate->body[j]);
+      }
+      bodies.push_back(std::move(ordered_body));
+    }
+    plan->groups.push_back(std::move(group));
+    instance_bodies.push_back(std::move(bodies));
+  }
+  if (plan->groups.empty()) {
+    return false;
+  }
+
+  // Topological order over assigns with each instance body as one node,
+  // preferring the lowest assign index like OrderAssigns. Inline assigns go
+  // first; once none is ready, every ready instance of one group is placed,
+  // so independent instances (and their port connections) line up as one
+  // run of slots. A body split by other logic (a parent around its children,
+  // or instances wired into a false loop) would close a cycle; the outermost
+  // such groups are dropped and the order retried.
+  std::vector<bool> active(plan->groups.size(), true);
+  std::vector<size_t> node_of(count);
+  std::vector<size_t> node_key;
+  std::vector<std::pair<size_t, size_t>> node_instance;
+  const std::pair<size_t, size_t> kNoInstance(SIZE_MAX, SIZE_MAX);
+  std::vector<size_t> order;
+  while (true) {
+    std::fill(node_of.begin(), node_of.end(), SIZE_MAX);
+    node_key.clear();
+    node_instance.clear();
+    for (size_t g = 0; g < plan->groups.size(); ++g) {
+      if (!active[g]) {
+        continue;
+      }
+      for (size_t k = 0; k < instance_bodies[g].size(); ++k) {
+        const auto& body = instance_bodies[g][k];
+        for (size_t index : body) {
+          node_of[index] = node_key.size();
+        }
+        node_key.push_back(*std::min_element(body.begin(), body.end()));
+        node_instance.push_back({g, k});
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (node_of[i] == SIZE_MAX) {
+        node_of[i] = node_key.size();
+        node_key.push_back(i);
+        node_instance.push_back(kNoInstance);
+      }
+    }
+    const size_t node_count = node_key.size();
+    std::vector<std::vector<size_t>> edges(node_count);
+    std::vector<std::vector<size_t>> reverse_edges(node_count);
+    std::vector<int> indegree(node_count, 0);
+    std::vector<int> outdegree(node_count, 0);
+    for (size_t i = 0; i < count; ++i) {
+      const auto& assign = module.assigns[i];
+      if (!assign.rhs) {
+        continue;
+      }
+      std::unordered_set<std::string> deps;
+      CollectIdentifiers(*assign.rhs, &deps);
+      for (const auto& dep : deps) {
+        if (dep == assign.lhs) {
+          continue;
+        }
+        auto it = lhs_to_indices.find(dep);
+        if (it == lhs_to_indices.end()) {
+          continue;
+        }
+        for (size_t producer : it->second) {
+          if (node_of[producer] == node_of[i]) {
+            continue;
+          }
+          edges[node_of[producer]].push_back(node_of[i]);
+          reverse_edges[node_of[i]].push_back(node_of[producer]);
+          indegree[node_of[i]]++;
+          outdegree[node_of[producer]]++;
+        }
+      }
+    }
+    using KeyedNode = std::pair<size_t, size_t>;
+    using ReadyQueue = std::priority_queue<KeyedNode, std::vector<KeyedNode>,
+                                           std::greater<KeyedNode>>;
+    ReadyQueue ready;
+    std::vector<ReadyQueue> ready_instances(plan->groups.size());
+    auto make_ready = [&](size_t n) {
+      if (node_instance[n] == kNoInstance) {
+        ready.push({node_key[n], n});
+      } else {
+        ready_instances[node_instance[n].first].push({node_key[n], n});
+      }
+    };
+    auto place = [&](size_t n) {
+      order.push_back(n);
+      for (size_t next : edges[n]) {
+        if (--indegree[next] == 0) {
+          make_ready(next);
+        }
+      }
+    };
+    for (size_t n = 0; n < node_count; ++n) {
+      if (indegree[n] == 0) {
+        make_ready(n);
+      }
+    }
+    order.clear();
+    while (true) {
+      if (!ready.empty()) {
+        const size_t current = ready.top().second;
+        ready.pop();
+        place(current);
+        continue;
+      }
+      size_t next_group = SIZE_MAX;
+      for (size_t g = 0; g < ready_instances.size(); ++g) {
+        if (!ready_instances[g].empty() &&
+            (next_group == SIZE_MAX ||
+             ready_instances[g].top() < ready_instances[next_group].top())) {
+          next_group = g;
+        }
+      }
+      if (next_group == SIZE_MAX) {
+        break;
+      }
+      auto& batch = ready_instances[next_group];
+      while (!batch.empty()) {
+        const size_t current = batch.top().second;
+        batch.pop();
+        place(current);
+      }
+    }
+    if (order.size() == node_count) {
+      break;
+    }
+    // Nodes left by both the forward and the reverse sort lie between
+    // cycles; drop the groups of the shallowest instances among them.
+    std::vector<size_t> sinks;
+    for (size_t n = 0; n < node_count; ++n) {
+      if (outdegree[n] == 0) {
+        sinks.push_back(n);
+      }
+    }
+    while (!sinks.empty()) {
+      const size_t current = sinks.back();
+      sinks.pop_back();
+      for (size_t prev : reverse_edges[current]) {
+        if (--outdegree[prev] == 0) {
+          sinks.push_back(prev);
+        }
+      }
+    }
+    size_t shallowest = SIZE_MAX;
+    for (size_t n = 0; n < node_count; ++n) {
+      if (indegree[n] > 0 && outdegree[n] > 0 &&
+          node_instance[n] != kNoInstance) {
+        const auto& instance = node_instance[n];
+        shallowest = std::min(
+            shallowest,
+            plan->groups[instance.first].prefixes[instance.second].size());
+      }
+    }
+    if (shallowest == SIZE_MAX) {
+      *plan = MslHierarchyPlan{};
+      return false;
+    }
+    for (size_t n = 0; n < node_count; ++n) {
+      if (indegree[n] > 0 && outdegree[n] > 0 &&
+          node_instance[n] != kNoInstance) {
+        const auto& instance = node_instance[n];
+        if (plan->groups[instance.first].prefixes[instance.second].size() ==
+            shallowest) {
+          active[instance.first] = false;
+        }
+      }
+    }
+  }
+
+  // Slots follow the evaluation order, so adjacent instances of a group
+  // have consecutive slots.
+  std::vector<size_t> kept_index(plan->groups.size(), SIZE_MAX);
+  std::vector<std::vector<size_t>> slot_order(plan->groups.size());
+  std::vector<std::pair<size_t, size_t>> node_slot(node_key.size(),
+                                                   kNoInstance);
+  std::vector<MslInstanceGroupPlan> kept_groups;
+  for (size_t node : order) {
+    const auto& instance = node_instance[node];
+    if (instance == kNoInstance) {
+      continue;
+    }
+    const size_t g = instance.first;
+    if (kept_index[g] == SIZE_MAX) {
+      kept_index[g] = kept_groups.size();
+      kept_groups.emplace_back();
+    }
+    node_slot[node] = {kept_index[g], slot_order[g].size()};
+    slot_order[g].push_back(instance.second);
+  }
+  for (size_t g = 0; g < plan->groups.size(); ++g) {
+    if (kept_index[g] == SIZE_MAX) {
+      continue;
+    }
+    const size_t index = kept_index[g];
+    MslInstanceGroupPlan group = std::move(plan->groups[g]);
+    group.struct_name = "GpgaInst" + std::to_string(index);
+    group.eval_name = "gpga_inst" + std::to_string(index) + "_eval";
+    group.array_name = "__gpga_inst" + std::to_string(index);
+    std::vector<std::string> prefixes;
+    for (size_t slot = 0; slot < slot_order[g].size(); ++slot) {
+      prefixes.push_back(group.prefixes[slot_order[g][slot]]);
+      const std::string base =
+          group.array_name + "[" + std::to_string(slot) + "].";
+      for (const auto& member : group.members) {
+        plan->aliases[prefixes.back() + member] = base + MslName(member);
+      }
+    }
+    group.prefixes = std::move(prefixes);
+    kept_groups[index] = std::move(group);
+  }
+  plan->groups = std::move(kept_groups);
+  if (plan->groups.empty()) {
+    *plan = MslHierarchyPlan{};
+    return false;
+  }
+  MslInstanceCall* run = nullptr;
+  for (size_t node : order) {
+    const auto& instance = node_instance[node];
+    if (instance == kNoInstance) {
+      run = nullptr;
+      plan->order.push_back(node_key[node]);
+      continue;
+    }
+    const auto& body = instance_bodies[instance.first][instance.second];
+    const auto& slot = node_slot[node];
+    if (run && run->group == slot.first && run->slot_end == slot.second) {
+      run->slot_end += 1;
+      plan->folded.insert(body.begin(), body.end());
+    } else {
+      run = &plan->calls[body.front()];
+      *run = MslInstanceCall{slot.first, slot.second, slot.second + 1};
+      plan->folded.insert(body.begin() + 1, body.end());
+    }
+    plan->order.insert(plan->order.end(), body.begin(), body.end());
+  }
+  return true;
+}
+
 int MinimalWidth(uint64_t value) {
   if (value == 0) {
     return 1;
@@ -5363,7 +5922,7 @@ std::string EmitExpr(const Expr& expr, const Module& module,
         return MslName(expr.ident) + "[gid]";
       }
       if (locals.count(expr.ident) > 0) {
-        return MslName(expr.ident);
+        return MslLocalName(expr.ident);
       }
       return MslName(expr.ident);
     }
@@ -7189,7 +7748,8 @@ void BuildSchedulerVmSignalLayout(
     std::vector<SchedulerVmPackedSlot>* packed_slots,
     std::vector<SchedulerVmSignalEntry>* signal_entries,
     std::unordered_map<std::string, uint32_t>* signal_ids,
-    bool four_state) {
+    bool four_state,
+    const std::unordered_set<std::string>* two_state_nets) {
   if (!packed_slots || !signal_entries || !signal_ids) {
     return;
   }
@@ -7261,12 +7821,22 @@ void BuildSchedulerVmSignalLayout(
     packed_ids.emplace(name, static_cast<uint32_t>(packed_slots->size()));
     packed_slots->push_back(slot);
   };
+  // --prune-xz: buffer-backed X/Z-free nets get no xz slot of their own;
+  // their entries point at one zero slot after all the others, matching the
+  // shared zero segment of the packed state.
+  std::unordered_set<std::string> xz_free;
   auto add_signal_slots = [&](const std::string& name, uint32_t width,
                               uint32_t array_size, bool is_real) {
     add_slot(MslValName(name), width, array_size, is_real);
-    if (four_state) {
-      add_slot(MslXzName(name), width, array_size, is_real);
+    if (!four_state) {
+      return;
     }
+    if (two_state_nets && two_state_nets->count(name) > 0 &&
+        array_size <= 1u && width <= 64u && !is_real) {
+      xz_free.insert(name);
+      return;
+    }
+    add_slot(MslXzName(name), width, array_size, is_real);
   };
   for (const auto& port : module.ports) {
     const uint32_t width = static_cast<uint32_t>(port.width);
@@ -7287,6 +7857,11 @@ void BuildSchedulerVmSignalLayout(
         std::max(1, net->array_size));
     add_signal_slots(net->name, width, array_size, net->is_real);
   }
+  uint32_t zero_slot = 0u;
+  if (!xz_free.empty()) {
+    zero_slot = static_cast<uint32_t>(packed_slots->size());
+    add_slot(kPackedXzZeroName, 64u, 1u, false);
+  }
   auto add_signal = [&](const std::string& name, uint32_t width,
                         uint32_t array_size, bool is_real) {
     if (signal_ids->find(name) != signal_ids->end()) {
@@ -7299,7 +7874,10 @@ void BuildSchedulerVmSignalLayout(
     SchedulerVmSignalEntry entry;
     entry.val_slot = val_it->second;
     entry.xz_slot = val_it->second;
-    if (four_state) {
+    const bool two_state = xz_free.count(name) > 0;
+    if (two_state) {
+      entry.xz_slot = zero_slot;
+    } else if (four_state) {
       const auto xz_it = packed_ids.find(MslXzName(name));
       if (xz_it == packed_ids.end()) {
         return;
@@ -7309,6 +7887,9 @@ void BuildSchedulerVmSignalLayout(
     entry.width = width;
     entry.array_size = std::max<uint32_t>(1u, array_size);
     entry.flags = is_real ? kSchedulerVmSignalFlagReal : 0u;
+    if (two_state) {
+      entry.flags |= kSchedulerVmSignalFlagTwoState;
+    }
     (*signal_ids)[name] = static_cast<uint32_t>(signal_entries->size());
     signal_entries->push_back(entry);
   };
@@ -7329,12 +7910,21 @@ struct SchedulerVmExprEmitContext {
   SchedulerVmExprBuilder* builder = nullptr;
   uint32_t depth = 0u;
   uint32_t max_depth = 0u;
+  // Rhs root of a kAssign expression and the width of its target: integer
+  // power at the root is evaluated at the assignment width.
+  const Expr* assign_root = nullptr;
+  uint32_t assign_width = 0u;
 };
 
+// kValue expressions run on eval_expr (narrow integers only); kCond,
+// kService and kAssign ones run on the cond evaluator, which also handles
+// real and wide values. kAssign adds integer power, which only the cond
+// evaluator implements.
 enum class SchedulerVmExprUse {
   kValue = 0u,
   kCond = 1u,
   kService = 2u,
+  kAssign = 3u,
 };
 
 bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
@@ -7343,8 +7933,7 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
       !ctx->builder || !out_width) {
     return false;
   }
-  const bool allow_wide = (use == SchedulerVmExprUse::kCond ||
-                           use == SchedulerVmExprUse::kService);
+  const bool allow_wide = (use != SchedulerVmExprUse::kValue);
   const bool allow_real = allow_wide;
   const bool allow_calls = allow_real;
   const bool expr_is_real = ExprIsRealValue(expr, *ctx->module);
@@ -7355,10 +7944,12 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
   if (width <= 0 || (width > 64 && !allow_wide)) {
     return false;
   }
+  // Depth is only tracked: FinishSchedulerVmExpr spills anything deeper
+  // than the stack into registers.
   auto bump_depth = [&]() -> bool {
     ctx->depth += 1u;
     ctx->max_depth = std::max(ctx->max_depth, ctx->depth);
-    return ctx->max_depth <= kSchedulerVmExprStackMax;
+    return true;
   };
   auto pop_binary = [&]() -> bool {
     if (ctx->depth < 2u) {
@@ -7403,9 +7994,6 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
     }
     ctx->depth = ctx->depth - arg_count + 1u;
     ctx->max_depth = std::max(ctx->max_depth, ctx->depth);
-    if (ctx->max_depth > kSchedulerVmExprStackMax) {
-      return false;
-    }
     uint32_t arg = static_cast<uint32_t>(op);
     if (signed_arg) {
       arg |= kSchedulerVmExprSignedFlag;
@@ -7414,9 +8002,17 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
     return true;
   };
   auto emit_mask = [&](uint32_t width) -> bool {
-    if (width == 0u || width > 64u) {
+    if (width == 0u || (width > 64u && !allow_wide)) {
       return false;
     }
+    if (width > 64u) {
+      // The wide evaluator truncates every result to its op width, so a
+      // unary plus narrows without a mask constant wider than 64 bits.
+      ctx->builder->EmitOp(
+          SchedulerVmExprOp::kUnary,
+          static_cast<uint32_t>(SchedulerVmExprUnaryOp::kPlus), width);
+      return true;
+    }
     uint64_t mask = MaskForWidth64(static_cast<int>(width));
     if (!push_const(mask, width)) {
       return false;
@@ -7562,7 +8158,29 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
         return false;
       }
       if (expr.op == 'p') {
-        return false;
+        if (ExprIsRealValue(*expr.lhs, *ctx->module) ||
+            ExprIsRealValue(*expr.rhs, *ctx->module)) {
+          if (!emit_call(SchedulerVmExprCallOp::kPow, 64u, 2u, false)) {
+            return false;
+          }
+          *out_width = 64u;
+          return true;
+        }
+        if (use != SchedulerVmExprUse::kAssign || lhs_width > 64u ||
+            rhs_width > 64u) {
+          return false;
+        }
+        uint32_t pow_width = lhs_width;
+        if (&expr == ctx->assign_root && ctx->assign_width > pow_width) {
+          pow_width = std::min<uint32_t>(ctx->assign_width, 64u);
+        }
+        if (!emit_binary(SchedulerVmExprBinaryOp::kPow, pow_width,
+                         ExprSigned(*expr.lhs, *ctx->module) &&
+                             ExprSigned(*expr.rhs, *ctx->module))) {
+          return false;
+        }
+        *out_width = pow_width;
+        return true;
       }
       SchedulerVmExprBinaryOp op = SchedulerVmExprBinaryOp::kAdd;
       uint32_t result_width =
@@ -7669,6 +8287,41 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
         return false;
       }
       {
+        // Bits of an indexed part-select past the top of the base read as x
+        // (IEEE 1364 5.2.1): unless the start is a constant that keeps the
+        // window inside the base, the select becomes
+        //   (start < base_width) ? (sel | (x << (base_width - start))) : x
+        // which re-evaluates the start, so only side-effect-free starts get
+        // the fill.
+        const int static_base_width = ExprWidth(*expr.base, *ctx->module);
+        bool x_fill = false;
+        if (expr.indexed_range && expr.indexed_width > 0 && expr.lsb_expr &&
+            expr.indexed_width <= 64 && static_base_width > 0 &&
+            !ExprHasSystemCall(*expr.lsb_expr)) {
+          const Expr& start = *expr.lsb_expr;
+          x_fill = !(start.kind == ExprKind::kNumber &&
+                     start.IsFullyDetermined() &&
+                     start.value_bits +
+                             static_cast<uint64_t>(expr.indexed_width) <=
+                         static_cast<uint64_t>(static_base_width));
+        }
+        auto push_slice_x = [&](uint32_t slice_width) -> bool {
+          const uint64_t mask = MaskForWidth64(static_cast<int>(slice_width));
+          const uint32_t base = ctx->builder->EmitImmTable(
+              {0u, 0u, static_cast<uint32_t>(mask & 0xFFFFFFFFu),
+               static_cast<uint32_t>((mask >> 32) & 0xFFFFFFFFu)});
+          ctx->builder->EmitOp(SchedulerVmExprOp::kPushConstXz, base,
+                               slice_width);
+          return bump_depth();
+        };
+        uint32_t idx_width = 0u;
+        if (x_fill) {
+          if (!EmitSchedulerVmCondExpr(*expr.lsb_expr, ctx, use, &idx_width) ||
+              !push_const(static_cast<uint64_t>(static_base_width), 32u) ||
+              !emit_binary(SchedulerVmExprBinaryOp::kLt, 1u, false)) {
+            return false;
+          }
+        }
         uint32_t base_width = 0u;
         if (!EmitSchedulerVmCondExpr(*expr.base, ctx, use, &base_width)) {
           return false;
@@ -7679,10 +8332,9 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
         if (expr.indexed_range && expr.indexed_width > 0 && expr.lsb_expr) {
           uint32_t slice_width =
               static_cast<uint32_t>(expr.indexed_width);
-          if (slice_width == 0u || slice_width > 64u) {
+          if (slice_width == 0u || (slice_width > 64u && !allow_wide)) {
             return false;
           }
-          uint32_t idx_width = 0u;
           if (!EmitSchedulerVmCondExpr(*expr.lsb_expr, ctx, use, &idx_width)) {
             return false;
           }
@@ -7696,6 +8348,23 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
           if (!emit_mask(slice_width)) {
             return false;
           }
+          if (x_fill) {
+            uint32_t start_width = 0u;
+            if (!push_slice_x(slice_width) ||
+                !push_const(static_cast<uint64_t>(static_base_width), 32u) ||
+                !EmitSchedulerVmCondExpr(*expr.lsb_expr, ctx, use,
+                                         &start_width) ||
+                !emit_binary(SchedulerVmExprBinaryOp::kSub, 32u, false) ||
+                !emit_binary(SchedulerVmExprBinaryOp::kShl, slice_width,
+                             false) ||
+                !emit_binary(SchedulerVmExprBinaryOp::kOr, slice_width,
+                             false) ||
+                !push_slice_x(slice_width) || !pop_ternary()) {
+              return false;
+            }
+            ctx->builder->EmitOp(SchedulerVmExprOp::kTernary, 0u,
+                                 slice_width);
+          }
           *out_width = slice_width;
           return true;
         }
@@ -7706,7 +8375,7 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
         }
         uint32_t slice_width =
             static_cast<uint32_t>(std::max(0, hi - lo + 1));
-        if (slice_width == 0u || slice_width > 64u) {
+        if (slice_width == 0u || (slice_width > 64u && !allow_wide)) {
           return false;
         }
         if (!push_const(static_cast<uint64_t>(lo), 32u)) {
@@ -8184,6 +8853,45 @@ bool EmitSchedulerVmCondExpr(const Expr& expr, SchedulerVmExprEmitContext* ctx,
   return false;
 }
 
+// METALFPGA_VM_EXPR_REGS=0 stops sharing repeated subexpressions through
+// registers (for benchmarking); deep expressions still spill.
+bool ExprRegsEnabled() {
+  static int cached = -1;
+  if (cached < 0) {
+    const char* env = std::getenv("METALFPGA_VM_EXPR_REGS");
+    cached = (env != nullptr && std::strcmp(env, "0") == 0) ? 0 : 1;
+  }
+  return cached != 0;
+}
+
+// Runs the register pass over the expression emitted from word_base on and
+// appends its kDone. Fails only when an expression deeper than the stack
+// cannot be spilled.
+bool FinishSchedulerVmExpr(SchedulerVmExprBuilder* builder, size_t word_base,
+                           uint32_t max_depth) {
+  SchedulerVmExprOptOptions options;
+  options.share = ExprRegsEnabled();
+  const bool too_deep = max_depth > kSchedulerVmExprStackMax;
+  if (options.share || too_deep) {
+    const std::vector<uint32_t>& words = builder->words();
+    std::vector<uint32_t> rewritten;
+    uint32_t reg_count = 0u;
+    SchedulerVmExprOptStats stats;
+    if (OptimizeSchedulerVmExpr(words.data() + word_base,
+                                words.data() + words.size(),
+                                builder->imm_words(), options, &rewritten,
+                                &reg_count, &stats)) {
+      if (stats.shared != 0u || stats.spilled != 0u) {
+        builder->ReplaceWords(word_base, rewritten, reg_count);
+      }
+    } else if (too_deep) {
+      return false;
+    }
+  }
+  builder->EmitOp(SchedulerVmExprOp::kDone);
+  return true;
+}
+
 bool TryEmitSchedulerVmCondExpr(
     const Expr& expr, SchedulerVmExprUse use, const Module& module,
     const std::unordered_map<std::string, uint32_t>& signal_ids,
@@ -8201,8 +8909,57 @@ bool TryEmitSchedulerVmCondExpr(
   ctx.builder = builder;
   uint32_t width = 0u;
   bool ok = EmitSchedulerVmCondExpr(expr, &ctx, use, &width);
-  if (ok && ctx.max_depth <= kSchedulerVmExprStackMax) {
-    builder->EmitOp(SchedulerVmExprOp::kDone);
+  if (ok && FinishSchedulerVmExpr(builder, word_base, ctx.max_depth)) {
+    *out_offset = static_cast<uint32_t>(word_base);
+    return true;
+  }
+  builder->Truncate(word_base, imm_base);
+  return false;
+}
+
+// Rhs of a kSchedulerVmAssignFlagCondRhs assign. The value is converted to
+// the target type the way the non-VM path does: integers to real by value,
+// reals to integer by truncation.
+bool TryEmitSchedulerVmAssignRhs(
+    const Expr& rhs, bool lhs_real, int target_width, const Module& module,
+    const std::unordered_map<std::string, uint32_t>& signal_ids,
+    const std::vector<SchedulerVmSignalEntry>& signal_entries,
+    SchedulerVmExprBuilder* builder, uint32_t* out_offset) {
+  if (!builder || !out_offset) {
+    return false;
+  }
+  const size_t word_base = builder->words().size();
+  const size_t imm_base = builder->imm_words().size();
+  SchedulerVmExprEmitContext ctx;
+  ctx.module = &module;
+  ctx.signal_ids = &signal_ids;
+  ctx.signal_entries = &signal_entries;
+  ctx.builder = builder;
+  ctx.assign_root = &rhs;
+  if (!lhs_real && target_width > 0) {
+    ctx.assign_width = static_cast<uint32_t>(target_width);
+  }
+  uint32_t width = 0u;
+  bool ok = EmitSchedulerVmCondExpr(rhs, &ctx, SchedulerVmExprUse::kAssign,
+                                    &width);
+  const bool rhs_real = ExprIsRealValue(rhs, module);
+  if (ok && lhs_real != rhs_real) {
+    SchedulerVmExprCallOp op = SchedulerVmExprCallOp::kIToR;
+    uint32_t result_width = 64u;
+    bool signed_arg = ExprSigned(rhs, module);
+    if (!lhs_real) {
+      op = SchedulerVmExprCallOp::kRToI;
+      result_width = static_cast<uint32_t>(target_width);
+      signed_arg = true;
+      ok = (target_width > 0 && target_width <= 64);
+    }
+    uint32_t arg = static_cast<uint32_t>(op);
+    if (signed_arg) {
+      arg |= kSchedulerVmExprSignedFlag;
+    }
+    builder->EmitOp(SchedulerVmExprOp::kCall, arg, result_width);
+  }
+  if (ok && FinishSchedulerVmExpr(builder, word_base, ctx.max_depth)) {
     *out_offset = static_cast<uint32_t>(word_base);
     return true;
   }
@@ -8210,6 +8967,88 @@ bool TryEmitSchedulerVmCondExpr(
   return false;
 }
 
+bool FoldSchedulerVmRealConst(const Expr& expr, double* out) {
+  switch (expr.kind) {
+    case ExprKind::kNumber:
+      if (expr.x_bits != 0 || expr.z_bits != 0) {
+        return false;
+      }
+      if (IsRealLiteralExpr(expr)) {
+        std::memcpy(out, &expr.value_bits, sizeof(*out));
+      } else {
+        *out = static_cast<double>(expr.value_bits);
+      }
+      return true;
+    case ExprKind::kUnary:
+      if (!expr.operand || (expr.unary_op != '+' && expr.unary_op != '-') ||
+          !FoldSchedulerVmRealConst(*expr.operand, out)) {
+        return false;
+      }
+      if (expr.unary_op == '-') {
+        *out = -*out;
+      }
+      return true;
+    case ExprKind::kBinary: {
+      double lhs = 0.0;
+      double rhs = 0.0;
+      if (!expr.lhs || !expr.rhs || !FoldSchedulerVmRealConst(*expr.lhs, &lhs) ||
+          !FoldSchedulerVmRealConst(*expr.rhs, &rhs)) {
+        return false;
+      }
+      if (expr.op == '+') {
+        *out = lhs + rhs;
+      } else if (expr.op == '-') {
+        *out = lhs - rhs;
+      } else if (expr.op == '*') {
+        *out = lhs * rhs;
+      } else if (expr.op == '/') {
+        *out = lhs / rhs;
+      } else {
+        return false;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Integer form of a real delay: constant reals (also as the arms of a
+// rise/fall select) become 64-bit literals truncated the way the non-VM
+// path converts delays. Null when the delay is not constant.
+std::unique_ptr<Expr> FoldSchedulerVmRealDelay(const Expr& expr) {
+  double value = 0.0;
+  if (FoldSchedulerVmRealConst(expr, &value)) {
+    int64_t whole = 0;
+    if (value > -9.2e18 && value < 9.2e18) {
+      whole = static_cast<int64_t>(value);
+    }
+    auto out = std::make_unique<Expr>();
+    out->kind = ExprKind::kNumber;
+    out->has_base = true;
+    out->has_width = true;
+    out->number_width = 64;
+    out->number = static_cast<uint64_t>(whole);
+    out->value_bits = out->number;
+    return out;
+  }
+  if (expr.kind != ExprKind::kTernary || !expr.condition ||
+      !expr.then_expr || !expr.else_expr) {
+    return nullptr;
+  }
+  auto then_expr = FoldSchedulerVmRealDelay(*expr.then_expr);
+  auto else_expr = FoldSchedulerVmRealDelay(*expr.else_expr);
+  if (!then_expr || !else_expr) {
+    return nullptr;
+  }
+  auto out = std::make_unique<Expr>();
+  out->kind = ExprKind::kTernary;
+  out->condition = CloneExpr(*expr.condition);
+  out->then_expr = std::move(then_expr);
+  out->else_expr = std::move(else_expr);
+  return out;
+}
+
 enum class SchedulerVmServiceKind : uint32_t {
   kDisplay = 0u,
   kMonitor = 1u,
@@ -8406,7 +9245,7 @@ bool BuildSchedulerVmServiceTables(
     auto bump_depth = [&]() -> bool {
       ctx.depth += 1u;
       ctx.max_depth = std::max(ctx.max_depth, ctx.depth);
-      return ctx.max_depth <= kSchedulerVmExprStackMax;
+      return true;
     };
     auto pop_ternary = [&]() -> bool {
       if (ctx.depth < 3u) {
@@ -8472,10 +9311,9 @@ bool BuildSchedulerVmServiceTables(
     if (!pop_ternary()) {
       return fail("string_ternary_stack_failed");
     }
-    if (ctx.max_depth > kSchedulerVmExprStackMax) {
+    if (!FinishSchedulerVmExpr(ctx.builder, word_base, ctx.max_depth)) {
       return fail("string_ternary_stack_overflow");
     }
-    ctx.builder->EmitOp(SchedulerVmExprOp::kDone);
     SchedulerVmServiceArg arg;
     arg.kind = kSchedulerVmServiceArgString;
     arg.width = 32u;
@@ -9348,6 +10186,306 @@ bool BuildSchedulerVmServiceTables(
   return true;
 }
 
+struct SchedulerVmCaseLabel {
+  uint64_t want = 0u;
+  // casex: X/Z bits of the label; casez: its Z bits and those of a constant
+  // selector; case: X/Z bits the selector has to repeat.
+  uint64_t aux = 0u;
+  uint32_t target = 0u;
+};
+
+// Constant labels of a case statement and the lookup picked for them.
+struct SchedulerVmCasePlan {
+  SchedulerVmCaseKind kind = SchedulerVmCaseKind::kCase;
+  uint32_t width = 0u;
+  std::vector<SchedulerVmCaseLabel> labels;
+  SchedulerVmCaseStrategy strategy = SchedulerVmCaseStrategy::kLinear;
+  // kLut: target of every selector value.
+  std::vector<uint32_t> lut;
+  // kBucket: first target of every value with a label without don't-care
+  // bits, in label order, and the labels with them (casex/casez only).
+  std::vector<std::pair<uint64_t, uint32_t>> exact;
+  std::vector<uint32_t> wild;
+};
+
+// Fills plan->labels when every label is a constant of the selector width
+// (at most 64 bits) and casez labels have no X bits.
+bool CollectSchedulerVmCaseLabels(const Statement& stmt, const Module& module,
+                                  SchedulerVmCasePlan* plan) {
+  plan->labels.clear();
+  if (!stmt.case_expr || stmt.case_items.empty()) {
+    return false;
+  }
+  int case_width = ExprWidth(*stmt.case_expr, module);
+  if (case_width <= 0 || case_width > 64) {
+    return false;
+  }
+  plan->width = static_cast<uint32_t>(case_width);
+  plan->kind = SchedulerVmCaseKind::kCase;
+  if (stmt.case_kind == CaseKind::kCaseX) {
+    plan->kind = SchedulerVmCaseKind::kCaseX;
+  } else if (stmt.case_kind == CaseKind::kCaseZ) {
+    plan->kind = SchedulerVmCaseKind::kCaseZ;
+  }
+  const std::unordered_map<std::string, int64_t> empty_params;
+  uint64_t case_z_bits = 0u;
+  if (stmt.case_expr->kind == ExprKind::kNumber) {
+    FourStateValue case_const;
+    if (EvalConstExpr4State(*stmt.case_expr, empty_params, &case_const,
+                            nullptr)) {
+      case_z_bits = case_const.z_bits;
+    }
+  }
+  const uint64_t mask = MaskForWidth64(case_width);
+  for (size_t item_idx = 0; item_idx < stmt.case_items.size(); ++item_idx) {
+    for (const auto& label_expr : stmt.case_items[item_idx].labels) {
+      if (!label_expr) {
+        continue;
+      }
+      if (ExprWidth(*label_expr, module) != case_width) {
+        return false;
+      }
+      FourStateValue label_value;
+      if (!EvalConstExpr4State(*label_expr, empty_params, &label_value,
+                               nullptr)) {
+        return false;
+      }
+      if (plan->kind == SchedulerVmCaseKind::kCaseZ &&
+          label_value.x_bits != 0u) {
+        return false;
+      }
+      SchedulerVmCaseLabel label;
+      label.want = label_value.value_bits & mask;
+      label.aux = (label_value.x_bits | label_value.z_bits) & mask;
+      if (plan->kind == SchedulerVmCaseKind::kCaseZ) {
+        label.aux = (label_value.z_bits | case_z_bits) & mask;
+      }
+      label.target = static_cast<uint32_t>(item_idx);
+      plan->labels.push_back(label);
+    }
+  }
+  return true;
+}
+
+// METALFPGA_CASE_TABLES=0 keeps every case on the linear scan (for
+// benchmarking the tables against it).
+bool CaseTablesEnabled() {
+  static int cached = -1;
+  if (cached < 0) {
+    const char* env = std::getenv("METALFPGA_CASE_TABLES");
+    cached = (env != nullptr && std::strcmp(env, "0") == 0) ? 0 : 1;
+  }
+  return cached != 0;
+}
+
+// Picks plan->strategy and builds its lookup from plan->labels. A plain
+// case label with X/Z bits never matches a selector without them, so only
+// casex/casez labels expand over their don't-care bits.
+void PlanSchedulerVmCaseLookup(SchedulerVmCasePlan* plan) {
+  plan->lut.clear();
+  plan->exact.clear();
+  plan->wild.clear();
+  const bool wildcards = plan->kind != SchedulerVmCaseKind::kCase;
+  uint32_t wild_count = 0u;
+  for (const auto& label : plan->labels) {
+    if (label.aux != 0u && wildcards) {
+      ++wild_count;
+    }
+  }
+  plan->strategy = SchedulerVmCaseStrategy::kLinear;
+  if (!CaseTablesEnabled()) {
+    return;
+  }
+  plan->strategy = SelectSchedulerVmCaseStrategy(
+      plan->width, static_cast<uint32_t>(plan->labels.size()), wild_count);
+  if (plan->strategy == SchedulerVmCaseStrategy::kLut) {
+    plan->lut.assign(size_t{1} << plan->width, kSchedulerVmCaseNoTarget);
+    // Later labels first, so the first matching label writes last.
+    for (size_t i = plan->labels.size(); i-- > 0;) {
+      const SchedulerVmCaseLabel& label = plan->labels[i];
+      if (label.aux == 0u) {
+        plan->lut[label.want] = label.target;
+        continue;
+      }
+      if (!wildcards) {
+        continue;
+      }
+      const uint64_t base = label.want & ~label.aux;
+      for (uint64_t sub = label.aux;; sub = (sub - 1u) & label.aux) {
+        plan->lut[base | sub] = label.target;
+        if (sub == 0u) {
+          break;
+        }
+      }
+    }
+    return;
+  }
+  if (plan->strategy == SchedulerVmCaseStrategy::kBucket) {
+    std::unordered_set<uint64_t> seen;
+    for (size_t i = 0; i < plan->labels.size(); ++i) {
+      const SchedulerVmCaseLabel& label = plan->labels[i];
+      if (label.aux == 0u) {
+        if (seen.insert(label.want).second) {
+          plan->exact.emplace_back(label.want, label.target);
+        }
+      } else if (wildcards) {
+        plan->wild.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+}
+
+// Appends the kLut/kBucket table of `plan` to `words` and points `header`
+// at it.
+void AppendSchedulerVmCaseTable(const SchedulerVmCasePlan& plan,
+                                SchedulerVmCaseHeader* header,
+                                std::vector<uint64_t>* words) {
+  header->strategy = static_cast<uint32_t>(plan.strategy);
+  header->table_offset = static_cast<uint32_t>(words->size());
+  if (plan.strategy == SchedulerVmCaseStrategy::kLut) {
+    header->table_mask = static_cast<uint32_t>(plan.lut.size() - 1u);
+    for (size_t i = 0; i < plan.lut.size(); i += 2) {
+      uint64_t hi = (i + 1 < plan.lut.size()) ? plan.lut[i + 1]
+                                              : kSchedulerVmCaseNoTarget;
+      words->push_back(static_cast<uint64_t>(plan.lut[i]) | (hi << 32u));
+    }
+    return;
+  }
+  if (plan.strategy != SchedulerVmCaseStrategy::kBucket) {
+    header->table_offset = 0u;
+    return;
+  }
+  // At most half of the slots are used, so every probe ends.
+  uint32_t slots = 2u;
+  while (slots < plan.exact.size() * 2u) {
+    slots <<= 1u;
+  }
+  header->table_mask = slots - 1u;
+  const size_t base = words->size();
+  words->resize(base + static_cast<size_t>(slots) * 2u, 0u);
+  for (size_t i = 0; i < slots; ++i) {
+    (*words)[base + i * 2u + 1u] = kSchedulerVmCaseNoTarget;
+  }
+  for (const auto& exact : plan.exact) {
+    uint32_t slot = SchedulerVmCaseSlot(exact.first, header->table_mask);
+    while ((*words)[base + slot * 2u + 1u] != kSchedulerVmCaseNoTarget) {
+      slot = (slot + 1u) & header->table_mask;
+    }
+    (*words)[base + slot * 2u] = exact.first;
+    (*words)[base + slot * 2u + 1u] = exact.second;
+  }
+  header->wild_count = static_cast<uint32_t>(plan.wild.size());
+  for (uint32_t index : plan.wild) {
+    words->push_back(index);
+  }
+}
+
+// Set by EmitCaseTableHit when a four-state selector has X/Z bits: the
+// labels are then tested one by one as without a table.
+constexpr uint32_t kCaseHitScan = 0xFFFFFFFEu;
+
+// Straight-line form of the kLut/kBucket lookup: declares `uint <hit>` as
+// the index of the first item with a label matching `case_val`
+// (kSchedulerVmCaseNoTarget for none), found by a switch the compiler can
+// lower to a jump table. `case_xz` is empty for two-state selectors; a
+// four-state selector with X/Z bits sets kCaseHitScan. `case_val` and
+// `case_xz` must be side-effect free. Returns false, emitting nothing, when
+// the case keeps its chain of label tests.
+bool EmitCaseTableHit(std::ostream& out, const Statement& stmt,
+                      const Module& module, const std::string& case_val,
+                      const std::string& case_xz, const std::string& hit,
+                      int indent) {
+  SchedulerVmCasePlan plan;
+  if (!CollectSchedulerVmCaseLabels(stmt, module, &plan)) {
+    return false;
+  }
+  PlanSchedulerVmCaseLookup(&plan);
+  if (plan.strategy == SchedulerVmCaseStrategy::kLinear) {
+    return false;
+  }
+  const bool wide = plan.width > 32u;
+  auto literal = [&](uint64_t value) {
+    return std::to_string(value) + (wide ? "ul" : "u");
+  };
+  const std::string mask = literal(MaskForWidth64(plan.width));
+  std::string pad(indent, ' ');
+  out << pad << "uint " << hit << " = " << kSchedulerVmCaseNoTarget << "u;\n";
+  if (!case_xz.empty()) {
+    out << pad << "if (((" << case_xz << ") & " << mask << ") != "
+        << literal(0) << ") {\n";
+    out << pad << "  " << hit << " = " << kCaseHitScan << "u;\n";
+    out << pad << "} else {\n";
+    pad += "  ";
+  }
+  // Selector values per target, in target order.
+  std::vector<std::pair<uint32_t, std::vector<uint64_t>>> groups;
+  std::unordered_map<uint32_t, size_t> group_index;
+  auto add_value = [&](uint64_t value, uint32_t target) {
+    auto it = group_index.find(target);
+    if (it == group_index.end()) {
+      it = group_index.emplace(target, groups.size()).first;
+      groups.emplace_back(target, std::vector<uint64_t>());
+    }
+    groups[it->second].second.push_back(value);
+  };
+  if (plan.strategy == SchedulerVmCaseStrategy::kLut) {
+    for (size_t value = 0; value < plan.lut.size(); ++value) {
+      if (plan.lut[value] != kSchedulerVmCaseNoTarget) {
+        add_value(value, plan.lut[value]);
+      }
+    }
+  } else {
+    for (const auto& exact : plan.exact) {
+      add_value(exact.first, exact.second);
+    }
+  }
+  std::sort(groups.begin(), groups.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  out << pad << "switch ((" << case_val << ") & " << mask << ") {\n";
+  for (const auto& group : groups) {
+    for (uint64_t value : group.second) {
+      out << pad << "  case " << literal(value) << ":\n";
+    }
+    out << pad << "    " << hit << " = " << group.first << "u;\n";
+    out << pad << "    break;\n";
+  }
+  out << pad << "  default:\n";
+  out << pad << "    break;\n";
+  out << pad << "}\n";
+  // Labels with don't-care bits win over a later exact label.
+  bool first = true;
+  for (uint32_t index : plan.wild) {
+    const SchedulerVmCaseLabel& label = plan.labels[index];
+    const uint64_t care = ~label.aux & MaskForWidth64(plan.width);
+    out << pad << (first ? "if (" : "} else if (") << hit << " > "
+        << label.target << "u && (((" << case_val << ") ^ "
+        << literal(label.want & care) << ") & " << literal(care) << ") == "
+        << literal(0) << ") {\n";
+    out << pad << "  " << hit << " = " << label.target << "u;\n";
+    first = false;
+  }
+  if (!first) {
+    out << pad << "}\n";
+  }
+  if (!case_xz.empty()) {
+    out << std::string(indent, ' ') << "}\n";
+  }
+  return true;
+}
+
+// Test of item `index` against the hit of EmitCaseTableHit; `cond` is the
+// item's label test for four-state selectors with X/Z bits (empty for
+// two-state ones).
+std::string CaseTableItemCond(const std::string& hit, size_t index,
+                              const std::string& cond) {
+  std::string item = "(" + hit + " == " + std::to_string(index) + "u)";
+  if (cond.empty()) {
+    return item;
+  }
+  return "(" + item + " || (" + hit + " == " + std::to_string(kCaseHitScan) +
+         "u && (" + cond + ")))";
+}
+
 bool BuildSchedulerVmCaseTables(
     const Module& module, const SchedulerVmTables& tables,
     const std::unordered_map<std::string, uint32_t>& signal_ids,
@@ -9364,7 +10502,6 @@ bool BuildSchedulerVmCaseTables(
   out->entries.clear();
   out->words.clear();
   out->headers.resize(tables.case_stmts.size());
-  const std::unordered_map<std::string, int64_t> empty_params;
   for (size_t case_id = 0; case_id < tables.case_stmts.size(); ++case_id) {
     const Statement* stmt = tables.case_stmts[case_id];
     SchedulerVmCaseHeader header;
@@ -9392,67 +10529,9 @@ bool BuildSchedulerVmCaseTables(
       continue;
     }
     header.width = static_cast<uint32_t>(case_width);
-    SchedulerVmCaseKind kind = SchedulerVmCaseKind::kCase;
-    if (stmt->case_kind == CaseKind::kCaseX) {
-      kind = SchedulerVmCaseKind::kCaseX;
-    } else if (stmt->case_kind == CaseKind::kCaseZ) {
-      kind = SchedulerVmCaseKind::kCaseZ;
-    }
-    header.kind = static_cast<uint32_t>(kind);
-    const size_t entry_base = out->entries.size();
-    const size_t word_base = out->words.size();
-    bool eligible = true;
-    uint64_t case_z_bits = 0u;
-    if (stmt->case_expr->kind == ExprKind::kNumber) {
-      FourStateValue case_const;
-      if (EvalConstExpr4State(*stmt->case_expr, empty_params, &case_const,
-                              nullptr)) {
-        case_z_bits = case_const.z_bits;
-      }
-    }
-    for (size_t item_idx = 0; item_idx < stmt->case_items.size() && eligible;
-         ++item_idx) {
-      const auto& item = stmt->case_items[item_idx];
-      for (const auto& label_expr : item.labels) {
-        if (!label_expr) {
-          continue;
-        }
-        int label_width = ExprWidth(*label_expr, module);
-        if (label_width != case_width) {
-          eligible = false;
-          break;
-        }
-        FourStateValue label_value;
-        if (!EvalConstExpr4State(*label_expr, empty_params, &label_value,
-                                 nullptr)) {
-          eligible = false;
-          break;
-        }
-        if (kind == SchedulerVmCaseKind::kCaseZ &&
-            label_value.x_bits != 0u) {
-          eligible = false;
-          break;
-        }
-        uint64_t mask = MaskForWidth64(case_width);
-        uint64_t label_val = label_value.value_bits & mask;
-        uint64_t label_xz = (label_value.x_bits | label_value.z_bits) & mask;
-        uint64_t label_aux = label_xz;
-        if (kind == SchedulerVmCaseKind::kCaseZ) {
-          label_aux = (label_value.z_bits | case_z_bits) & mask;
-        }
-        uint32_t want_offset =
-            static_cast<uint32_t>(out->words.size());
-        out->words.push_back(label_val);
-        uint32_t care_offset =
-            static_cast<uint32_t>(out->words.size());
-        out->words.push_back(label_aux);
-        SchedulerVmCaseEntry entry;
-        entry.want_offset = want_offset;
-        entry.care_offset = care_offset;
-        entry.target = static_cast<uint32_t>(item_idx);
-        out->entries.push_back(entry);
-      }
-    }
+    SchedulerVmCasePlan plan;
+    bool eligible = CollectSchedulerVmCaseLabels(*stmt, module, &plan);
+    header.kind = static_cast<uint32_t>(plan.kind);
     if (eligible) {
       if (!expr_builder) {
         eligible = false;
@@ -9472,14 +10551,22 @@ bool BuildSchedulerVmCaseTables(
       }
     }
     if (!eligible) {
-      out->entries.resize(entry_base);
-      out->words.resize(word_base);
       out->headers[case_id] = header;
       continue;
     }
-    header.entry_offset = static_cast<uint32_t>(entry_base);
-    header.entry_count =
-        static_cast<uint32_t>(out->entries.size() - entry_base);
+    header.entry_offset = static_cast<uint32_t>(out->entries.size());
+    header.entry_count = static_cast<uint32_t>(plan.labels.size());
+    for (const auto& label : plan.labels) {
+      SchedulerVmCaseEntry entry;
+      entry.want_offset = static_cast<uint32_t>(out->words.size());
+      out->words.push_back(label.want);
+      entry.care_offset = static_cast<uint32_t>(out->words.size());
+      out->words.push_back(label.aux);
+      entry.target = label.target;
+      out->entries.push_back(entry);
+    }
+    PlanSchedulerVmCaseLookup(&plan);
+    AppendSchedulerVmCaseTable(plan, &header, &out->words);
     out->headers[case_id] = header;
   }
   return true;
@@ -10059,7 +11146,8 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
     SchedulerVmLayout* out,
     std::string* error,
     bool four_state,
-    SchedulerVmFallbackDiagnostics* diag) {
+    SchedulerVmFallbackDiagnostics* diag,
+    const std::unordered_set<std::string>* two_state_nets) {
   if (diag) {
     diag->assign_fallbacks.clear();
     diag->service_fallbacks.clear();
@@ -10769,7 +11857,7 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
   std::vector<SchedulerVmSignalEntry> signal_entries;
   std::unordered_map<std::string, uint32_t> signal_ids;
   BuildSchedulerVmSignalLayout(module, &signal_slots, &signal_entries,
-                               &signal_ids, four_state);
+                               &signal_ids, four_state, two_state_nets);
   std::vector<uint8_t> case_vm_ok;
   if (!tables.case_stmts.empty()) {
     SchedulerVmExprBuilder case_expr_builder;
@@ -11267,24 +12355,26 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
         add_reason("override_target");
         ok = false;
       }
-      if (ok && SignalIsReal(module, stmt->assign.lhs)) {
-        add_reason("lhs_is_real");
-        ok = false;
-      }
+      // Real and wide (>64-bit) targets take their rhs from the cond
+      // evaluator (kSchedulerVmAssignFlagCondRhs).
+      const bool lhs_real = stmt && SignalIsReal(module, stmt->assign.lhs);
       bool wide_const_assign = false;
-      if (ok && (base_width <= 0 || base_width > 64)) {
-        if (base_width > 64 && rhs_is_string_literal && !is_array &&
-            !is_bit_select && !is_range && !is_indexed_range) {
-          wide_const_assign = true;
-        } else {
+      bool wide_target = false;
+      if (ok && base_width <= 0) {
         std::ostringstream os;
         os << "lhs_width_invalid:" << base_width;
         add_reason(os.str());
         ok = false;
+      }
+      if (ok && base_width > 64) {
+        if (rhs_is_string_literal && !is_array && !is_bit_select &&
+            !is_range && !is_indexed_range) {
+          wide_const_assign = true;
+        } else {
+          wide_target = true;
         }
       }
-      if (ok && (target_width <= 0 || target_width > 64) &&
-          !wide_const_assign) {
+      if (ok && (target_width <= 0 || target_width > base_width)) {
         std::ostringstream os;
         os << "lhs_range_width_invalid:" << target_width;
         add_reason(os.str());
@@ -11296,6 +12386,7 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
       }
       const size_t expr_word_base = expr_builder.words().size();
       const size_t expr_imm_base = expr_builder.imm_words().size();
+      const size_t cond_base = out->cond_entries.size();
       if (ok) {
         auto it = signal_ids.find(stmt->assign.lhs);
         if (it == signal_ids.end()) {
@@ -11320,10 +12411,29 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
         rhs_offset = expr_builder.EmitImmTable(imm);
         entry.flags |= kSchedulerVmAssignFlagWideConst;
       } else if (ok) {
-        ok = TryEmitSchedulerVmCondExpr(*stmt->assign.rhs,
-                                        SchedulerVmExprUse::kValue, module,
-                                        signal_ids, out->signal_entries,
-                                        &expr_builder, &rhs_offset);
+        bool cond_rhs = lhs_real || wide_target;
+        if (!cond_rhs) {
+          cond_rhs = !TryEmitSchedulerVmCondExpr(
+              *stmt->assign.rhs, SchedulerVmExprUse::kValue, module,
+              signal_ids, out->signal_entries, &expr_builder, &rhs_offset);
+        }
+        if (cond_rhs) {
+          uint32_t expr_offset = 0u;
+          ok = TryEmitSchedulerVmAssignRhs(*stmt->assign.rhs, lhs_real,
+                                           target_width, module, signal_ids,
+                                           out->signal_entries, &expr_builder,
+                                           &expr_offset);
+          if (ok) {
+            SchedulerVmCondEntry cond;
+            cond.kind = static_cast<uint32_t>(SchedulerVmCondKind::kExpr);
+            cond.val = 0u;
+            cond.xz = 0u;
+            cond.expr_offset = expr_offset;
+            rhs_offset = static_cast<uint32_t>(out->cond_entries.size());
+            out->cond_entries.push_back(cond);
+            entry.flags |= kSchedulerVmAssignFlagCondRhs;
+          }
+        }
         if (!ok) {
           add_reason("rhs_unencodable");
           rhs_unencodable = true;
@@ -11347,6 +12457,8 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
       }
       if (!ok) {
         expr_builder.Truncate(expr_word_base, expr_imm_base);
+        out->cond_entries.resize(cond_base);
+        entry.flags &= ~kSchedulerVmAssignFlagCondRhs;
         entry.flags |= kSchedulerVmAssignFlagFallback;
         entry.signal_id = 0u;
         rhs_offset = kSchedulerVmExprNoExtra;
@@ -11636,8 +12748,15 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
                                         signal_ids, out->signal_entries,
                                         &expr_builder, &rhs_offset);
       }
+      std::unique_ptr<Expr> folded_delay;
+      const Expr* delay_expr = info.delay_expr;
+      if (ok && ExprIsRealValue(*delay_expr, module)) {
+        folded_delay = FoldSchedulerVmRealDelay(*delay_expr);
+        delay_expr = folded_delay.get();
+        ok = (delay_expr != nullptr);
+      }
       if (ok) {
-        ok = TryEmitSchedulerVmCondExpr(*info.delay_expr,
+        ok = TryEmitSchedulerVmCondExpr(*delay_expr,
                                         SchedulerVmExprUse::kValue, module,
                                         signal_ids, out->signal_entries,
                                         &expr_builder, &delay_offset);
@@ -11811,6 +12930,64 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
     }
     out->edge_star_expr_offsets.push_back(expr_offset);
   }
+  out->edge_wait_entries.clear();
+  out->edge_item_kinds.clear();
+  out->edge_wait_entries.reserve(edge_waits.size());
+  out->edge_item_kinds.reserve(edge_item_exprs.size());
+  auto edge_kind_of = [](EventEdgeKind edge) -> SchedulerVmEdgeKind {
+    switch (edge) {
+      case EventEdgeKind::kPosedge:
+        return SchedulerVmEdgeKind::kPosedge;
+      case EventEdgeKind::kNegedge:
+        return SchedulerVmEdgeKind::kNegedge;
+      case EventEdgeKind::kAny:
+      default:
+        return SchedulerVmEdgeKind::kAny;
+    }
+  };
+  for (const auto& info : edge_waits) {
+    SchedulerVmEdgeWaitEntry entry;
+    entry.item_offset = static_cast<uint32_t>(info.item_offset);
+    entry.star_offset = static_cast<uint32_t>(info.star_offset);
+    if (!info.items.empty()) {
+      entry.kind = static_cast<uint32_t>(SchedulerVmEdgeKind::kList);
+      entry.item_count = static_cast<uint32_t>(info.items.size());
+      for (const auto& item : info.items) {
+        out->edge_item_kinds.push_back(
+            static_cast<uint32_t>(edge_kind_of(item.edge)));
+      }
+    } else if (info.expr) {
+      const SchedulerVmEdgeKind kind = edge_kind_of(
+          info.stmt ? info.stmt->event_edge : EventEdgeKind::kAny);
+      entry.kind = static_cast<uint32_t>(kind);
+      entry.item_count = 1u;
+      out->edge_item_kinds.push_back(static_cast<uint32_t>(kind));
+    } else {
+      entry.kind = static_cast<uint32_t>(SchedulerVmEdgeKind::kAny);
+      entry.star_count = static_cast<uint32_t>(info.star_signals.size());
+    }
+    out->edge_wait_entries.push_back(entry);
+  }
+  out->delay_expr_offsets.clear();
+  if (!tables.delay_exprs.empty()) {
+    out->delay_expr_offsets.reserve(tables.delay_exprs.size());
+  }
+  for (const Expr* expr : tables.delay_exprs) {
+    uint32_t expr_offset = kSchedulerVmExprNoExtra;
+    if (expr) {
+      const size_t expr_word_base = expr_builder.words().size();
+      const size_t expr_imm_base = expr_builder.imm_words().size();
+      bool ok = TryEmitSchedulerVmCondExpr(*expr, SchedulerVmExprUse::kValue,
+                                           module, signal_ids,
+                                           out->signal_entries, &expr_builder,
+                                           &expr_offset);
+      if (!ok) {
+        expr_builder.Truncate(expr_word_base, expr_imm_base);
+        expr_offset = kSchedulerVmExprNoExtra;
+      }
+    }
+    out->delay_expr_offsets.push_back(expr_offset);
+  }
   out->repeat_expr_offsets.clear();
   if (!tables.repeat_stmts.empty()) {
     out->repeat_expr_offsets.reserve(tables.repeat_stmts.size());
@@ -11833,15 +13010,19 @@ static bool BuildSchedulerVmLayoutFromModuleImpl(
   }
   out->expr_table.words = expr_builder.words();
   out->expr_table.imm_words = expr_builder.imm_words();
+  out->expr_table.reg_count = expr_builder.reg_count();
+  out->expr_table.wide_bits = SchedulerVmExprWideBits(module);
   return true;
 }
 
-bool BuildSchedulerVmLayoutFromModule(const Module& module,
-                                      SchedulerVmLayout* out,
-                                      std::string* error,
-                                      bool four_state) {
+bool BuildSchedulerVmLayoutFromModule(
+    const Module& module,
+    SchedulerVmLayout* out,
+    std::string* error,
+    bool four_state,
+    const std::unordered_set<std::string>* two_state_nets) {
   return BuildSchedulerVmLayoutFromModuleImpl(module, out, error, four_state,
-                                              nullptr);
+                                              nullptr, two_state_nets);
 }
 
 bool BuildSchedulerVmLayoutFromModuleWithDiag(
@@ -11849,12 +13030,196 @@ bool BuildSchedulerVmLayoutFromModuleWithDiag(
     SchedulerVmLayout* out,
     std::string* error,
     bool four_state,
-    SchedulerVmFallbackDiagnostics* diag) {
+    SchedulerVmFallbackDiagnostics* diag,
+    const std::unordered_set<std::string>* two_state_nets) {
   return BuildSchedulerVmLayoutFromModuleImpl(module, out, error, four_state,
-                                              diag);
+                                              diag, two_state_nets);
+}
+
+void BuildSchedulerVmContinuousAssigns(
+    const Module& module, bool four_state, SchedulerVmLayout* layout,
+    std::vector<SchedulerVmContinuousAssign>* out, uint32_t* skipped) {
+  out->clear();
+  *skipped = 0u;
+  // Same signal ids as the layout was built with.
+  std::vector<SchedulerVmPackedSlot> slots;
+  std::vector<SchedulerVmSignalEntry> entries;
+  std::unordered_map<std::string, uint32_t> signal_ids;
+  BuildSchedulerVmSignalLayout(module, &slots, &entries, &signal_ids,
+                               four_state, nullptr);
+  std::unordered_map<std::string, uint32_t> drivers;
+  for (const auto& assign : module.assigns) {
+    ++drivers[assign.lhs];
+  }
+  for (const auto& sw : module.switches) {
+    drivers[sw.a] += 2u;
+    drivers[sw.b] += 2u;
+  }
+  // Wires without a state slot are computed inline by the kernels; do the
+  // same by substituting their rhs where that keeps the width.
+  TaskSubst inline_wires;
+  for (const auto& assign : module.assigns) {
+    if (assign.rhs && !assign.lhs_has_range && !assign.has_strength &&
+        drivers[assign.lhs] == 1u && signal_ids.count(assign.lhs) == 0 &&
+        !SignalIsReal(module, assign.lhs) &&
+        ExprWidth(*assign.rhs, module) == SignalWidth(module, assign.lhs)) {
+      inline_wires.exprs[assign.lhs] = assign.rhs.get();
+    }
+  }
+  SchedulerVmExprBuilder builder;
+  builder.ReplaceWords(0u, layout->expr_table.words,
+                       layout->expr_table.reg_count);
+  builder.EmitImmTable(layout->expr_table.imm_words);
+  for (const auto& assign : module.assigns) {
+    const auto id = signal_ids.find(assign.lhs);
+    if (id == signal_ids.end() && inline_wires.exprs.count(assign.lhs) > 0) {
+      continue;
+    }
+    if (!assign.rhs || assign.lhs_has_range || assign.has_strength ||
+        drivers[assign.lhs] != 1u || id == signal_ids.end() ||
+        entries[id->second].width > 64u ||
+        entries[id->second].array_size != 1u) {
+      ++*skipped;
+      continue;
+    }
+    std::unique_ptr<Expr> rhs = CloneExpr(*assign.rhs);
+    // One round per inlined wire covers any acyclic chain; a cycle leaves
+    // an identifier without a slot and the rhs is skipped below.
+    for (size_t round = 0; round < inline_wires.exprs.size(); ++round) {
+      std::unordered_set<std::string> idents;
+      CollectIdentifiers(*rhs, &idents);
+      bool pending = false;
+      for (const auto& name : idents) {
+        pending = pending || inline_wires.exprs.count(name) > 0;
+      }
+      if (!pending) {
+        break;
+      }
+      rhs = CloneExprSubst(*rhs, inline_wires);
+    }
+    const bool lhs_real =
+        (entries[id->second].flags & kSchedulerVmSignalFlagReal) != 0u;
+    uint32_t offset = 0u;
+    if (!TryEmitSchedulerVmAssignRhs(
+            *rhs, lhs_real,
+            static_cast<int>(entries[id->second].width), module, signal_ids,
+            entries, &builder, &offset)) {
+      ++*skipped;
+      continue;
+    }
+    out->push_back(SchedulerVmContinuousAssign{id->second, offset});
+  }
+  layout->expr_table.words = builder.words();
+  layout->expr_table.imm_words = builder.imm_words();
+  layout->expr_table.reg_count = builder.reg_count();
+}
+
+namespace {
+
+SchedulerConstants MakeManifestConstants(
+    uint32_t proc_count, uint32_t event_count, uint32_t edge_count,
+    uint32_t edge_star_count, uint32_t repeat_count, uint32_t delay_count,
+    uint32_t max_dnba, uint32_t monitor_count, uint32_t monitor_max_args,
+    uint32_t strobe_count, uint32_t service_max_args,
+    uint32_t service_wide_words, uint32_t string_count, uint32_t force_count,
+    uint32_t pcont_count, uint32_t timing_check_count) {
+  SchedulerConstants sched;
+  sched.proc_count = proc_count;
+  sched.event_count = event_count;
+  sched.edge_count = edge_count;
+  sched.edge_star_count = edge_star_count;
+  sched.repeat_count = repeat_count;
+  sched.delay_count = delay_count;
+  sched.max_dnba = max_dnba;
+  sched.monitor_count = monitor_count;
+  sched.monitor_max_args = monitor_max_args;
+  sched.strobe_count = strobe_count;
+  sched.service_max_args = service_max_args;
+  sched.service_wide_words = service_wide_words;
+  sched.string_count = string_count;
+  sched.force_count = force_count;
+  sched.pcont_count = pcont_count;
+  sched.timing_check_count = timing_check_count;
+  sched.has_scheduler = proc_count > 0u;
+  sched.has_services = service_max_args > 0u;
+  return sched;
 }
 
-std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
+// The per-slot arrays of a SchedulerVm expression evaluator stack, as
+// {element type, name}: `__gpga_<name>` is the stack array and
+// `__gpga_reg_<name>` its register file.
+using SchedulerVmExprSlotArrays =
+    std::vector<std::pair<std::string, std::string>>;
+
+SchedulerVmExprSlotArrays MakeSchedulerVmExprSlotArrays(bool with_xz,
+                                                        bool with_real,
+                                                        uint32_t wide_bits) {
+  SchedulerVmExprSlotArrays arrays = {{"ulong", "vals"}};
+  if (with_xz) {
+    arrays.emplace_back("ulong", "xzs");
+  }
+  arrays.emplace_back("uint", "widths");
+  if (with_real) {
+    arrays.emplace_back("bool", "is_real");
+  }
+  if (wide_bits > 64u) {
+    const std::string wide = "GpgaWide" + std::to_string(wide_bits);
+    arrays.emplace_back(wide, "wide_vals");
+    if (with_xz) {
+      arrays.emplace_back(wide, "wide_xzs");
+    }
+  }
+  return arrays;
+}
+
+void EmitSchedulerVmExprRegDecls(std::ostream& out,
+                                 const SchedulerVmExprSlotArrays& arrays,
+                                 int indent) {
+  const std::string pad(static_cast<size_t>(indent), ' ');
+  for (const auto& array : arrays) {
+    out << pad << "thread " << array.first << " __gpga_reg_" << array.second
+        << "[GPGA_SCHED_VM_EXPR_REG_COUNT];\n";
+  }
+}
+
+// kLoadReg/kStoreReg cases for the evaluator's op switch.
+void EmitSchedulerVmExprRegCases(std::ostream& out,
+                                 const SchedulerVmExprSlotArrays& arrays,
+                                 int indent) {
+  const std::string pad(static_cast<size_t>(indent), ' ');
+  out << pad << "case GPGA_SCHED_VM_EXPR_OP_LOAD_REG: {\n";
+  out << pad << "  if (__gpga_sp >= GPGA_SCHED_VM_EXPR_STACK_MAX ||\n";
+  out << pad << "      __gpga_arg >= GPGA_SCHED_VM_EXPR_REG_COUNT) {\n";
+  out << pad << "    __gpga_expr_ok = false;\n";
+  out << pad << "    break;\n";
+  out << pad << "  }\n";
+  out << pad << "  __gpga_ip += 1u;\n";
+  for (const auto& array : arrays) {
+    out << pad << "  __gpga_" << array.second << "[__gpga_sp] = __gpga_reg_"
+        << array.second << "[__gpga_arg];\n";
+  }
+  out << pad << "  __gpga_sp += 1u;\n";
+  out << pad << "  break;\n";
+  out << pad << "}\n";
+  out << pad << "case GPGA_SCHED_VM_EXPR_OP_STORE_REG: {\n";
+  out << pad << "  if (__gpga_sp == 0u ||\n";
+  out << pad << "      __gpga_arg >= GPGA_SCHED_VM_EXPR_REG_COUNT) {\n";
+  out << pad << "    __gpga_expr_ok = false;\n";
+  out << pad << "    break;\n";
+  out << pad << "  }\n";
+  out << pad << "  __gpga_ip += 1u;\n";
+  out << pad << "  __gpga_sp -= 1u;\n";
+  for (const auto& array : arrays) {
+    out << pad << "  __gpga_reg_" << array.second << "[__gpga_arg] = __gpga_"
+        << array.second << "[__gpga_sp];\n";
+  }
+  out << pad << "  break;\n";
+  out << pad << "}\n";
+}
+
+std::string EmitMSLStubSource(const Module& module,
+                              const MslEmitOptions& options,
+                              SchedulerManifest* manifest) {
   const bool needs_scheduler = ModuleNeedsScheduler(module);
   const bool four_state = options.four_state;
   ConditionalStringBuf out_buf;
@@ -11865,14 +13230,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     out << "#include \"gpga_4state.h\"\n";
   }
   std::vector<int> wide_widths = CollectWideWidths(module);
-  uint32_t vm_expr_wide_bits = 0u;
+  const uint32_t vm_expr_wide_bits = SchedulerVmExprWideBits(module);
   uint32_t vm_expr_wide_words = 0u;
-  for (int width : wide_widths) {
-    if (width > 64) {
-      vm_expr_wide_bits =
-          std::max(vm_expr_wide_bits, static_cast<uint32_t>(width));
-    }
-  }
   if (vm_expr_wide_bits > 64u) {
     vm_expr_wide_words = (vm_expr_wide_bits + 63u) / 64u;
   }
@@ -12021,6 +13380,9 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
   const SystemTaskInfo system_task_info = BuildSystemTaskInfo(module);
   const uint32_t service_wide_words = CollectServiceWideWordCount(module);
   if (four_state) {
+    if (options.instance_groups && options.hier_fallback) {
+      *options.hier_fallback = "4-state kernels are emitted flat";
+    }
     auto suffix_for_width = [](int width) -> std::string {
       return (width > 32) ? "ul" : "u";
     };
@@ -12302,6 +13664,24 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         buffered_regs.insert(net.name);
       }
     }
+    // --prune-xz: proven X/Z-free nets held in kernel locals carry no xz lane;
+    // reads see a known-zero xz and the fs_* helpers fold to 2-state ops.
+    // Buffer-backed ones (wires read by scheduled code) drop their xz segment
+    // from the packed state and point _xz at one shared zero segment instead;
+    // 1-bit ones under --pack-bits keep their bitset xz bit.
+    std::unordered_set<std::string> xz_free_locals;
+    std::unordered_set<std::string> xz_free_buffered;
+    if (options.two_state_nets) {
+      const bool bit_packed_scalars = options.pack_bits && !options.sched_vm;
+      for (const auto& name : *options.two_state_nets) {
+        if (buffered_regs.count(name) == 0) {
+          xz_free_locals.insert(name);
+        } else if (needs_scheduler &&
+                   !(bit_packed_scalars && SignalWidth(module, name) == 1)) {
+          xz_free_buffered.insert(name);
+        }
+      }
+    }
 
     struct FsExpr {
       std::string val;
@@ -13489,13 +14869,22 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           }
           if (buffered_regs.count(expr.ident) > 0) {
             int width = SignalWidth(module, expr.ident);
+            if (xz_free_buffered.count(expr.ident) > 0) {
+              return FsExpr{val_name(expr.ident) + "[gid]",
+                            literal_for_width(0, width), drive_full(width),
+                            width};
+            }
             return FsExpr{val_name(expr.ident) + "[gid]",
                           xz_name(expr.ident) + "[gid]",
                           drive_full(width), width};
           }
+          int width = SignalWidth(module, expr.ident);
+          if (xz_free_locals.count(expr.ident) > 0) {
+            return FsExpr{val_name(expr.ident), literal_for_width(0, width),
+                          drive_full(width), width};
+          }
           return FsExpr{val_name(expr.ident), xz_name(expr.ident),
-                        drive_full(SignalWidth(module, expr.ident)),
-                        SignalWidth(module, expr.ident)};
+                        drive_full(width), width};
         }
         case ExprKind::kNumber: {
           int width = expr.has_width && expr.number_width > 0
@@ -13990,6 +15379,19 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               shift = maybe_hoist_full(shift, active_cse->indent, false, false);
             }
             std::string mask = mask_literal(width);
+            // Window bits past the top of the base read as x (IEEE 1364
+            // 5.2.1); `avail` is how many base bits the window still covers.
+            auto past_end = [&](const std::string& avail) -> std::string {
+              std::string covered =
+                  "(" + avail + " >= " + std::to_string(width) + "u)";
+              if (width > 64) {
+                return "gpga_wide_select_" + std::to_string(width) + "(" +
+                       covered + ", " + drive_zero(width) + ", " +
+                       wide_shl(mask, avail, width) + ")";
+              }
+              return "(" + covered + " ? " + drive_zero(width) + " : ((" +
+                     mask + " << " + avail + ") & " + mask + "))";
+            };
             if (base.width > 64) {
               if (shift.is_const) {
                 if (shift.const_xz != 0) {
@@ -13998,7 +15400,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                 uint32_t idx_val =
                     static_cast<uint32_t>(shift.const_val);
                 if (idx_val >= static_cast<uint32_t>(base.width)) {
-                  return fs_const_expr(0u, 0u, MaskForWidth64(width), width);
+                  return fs_allx_expr(width);
                 }
                 std::string idx = std::to_string(idx_val) + "u";
                 std::string val =
@@ -14007,6 +15409,17 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                     wide_extract(base.xz, base.width, width, idx);
                 std::string drive =
                     wide_extract(base.drive, base.width, width, idx);
+                uint32_t avail = static_cast<uint32_t>(base.width) - idx_val;
+                if (avail < static_cast<uint32_t>(width)) {
+                  std::string oob = past_end(std::to_string(avail) + "u");
+                  if (width > 64) {
+                    xz = wide_or(xz, oob, width);
+                    drive = wide_or(drive, oob, width);
+                  } else {
+                    xz = "(" + xz + " | " + oob + ")";
+                    drive = "(" + drive + " | " + oob + ")";
+                  }
+                }
                 return FsExpr{val, xz, drive, width};
               }
               std::string idx = to_uint(shift.val, shift.width);
@@ -14020,6 +15433,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                   wide_extract(base.xz, base.width, width, idx);
               std::string drive =
                   wide_extract(base.drive, base.width, width, idx);
+              std::string oob = past_end(
+                  "(" + std::to_string(base.width) + "u - " + idx + ")");
               if (width > 64) {
                 std::string select_fn =
                     "gpga_wide_select_" + std::to_string(width);
@@ -14028,20 +15443,23 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                     ", " + zero + ")";
                 std::string xz_sel =
                     select_fn + "(" + xguard + ", " +
-                    select_fn + "(" + bounds + ", " + xz + ", " + zero + "), " +
-                    mask + ")";
+                    select_fn + "(" + bounds + ", " +
+                    wide_or(xz, oob, width) + ", " + mask + "), " + mask + ")";
                 std::string drive_sel =
                     select_fn + "(" + xguard + ", " +
-                    select_fn + "(" + bounds + ", " + drive + ", " + mask +
-                    "), " + mask + ")";
+                    select_fn + "(" + bounds + ", " +
+                    wide_or(drive, oob, width) + ", " + mask + "), " + mask +
+                    ")";
                 return FsExpr{val_sel, xz_sel, drive_sel, width};
               }
+              xz = "(" + xz + " | " + oob + ")";
+              drive = "(" + drive + " | " + oob + ")";
               std::string val_sel =
                   "((" + xguard + ") ? ((" + bounds + ") ? " + val + " : " +
                   zero + ") : " + zero + ")";
               std::string xz_sel =
                   "((" + xguard + ") ? ((" + bounds + ") ? " + xz + " : " +
-                  zero + ") : " + mask + ")";
+                  mask + ") : " + mask + ")";
               std::string drive_sel =
                   "((" + xguard + ") ? ((" + bounds + ") ? " + drive + " : " +
                   mask + ") : " + mask + ")";
@@ -14054,15 +15472,21 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               uint32_t idx_val =
                   static_cast<uint32_t>(shift.const_val);
               if (idx_val >= static_cast<uint32_t>(base.width)) {
-                return fs_const_expr(0u, 0u, MaskForWidth64(width), width);
+                return fs_allx_expr(width);
               }
               std::string idx = std::to_string(idx_val) + "u";
+              uint32_t avail = static_cast<uint32_t>(base.width) - idx_val;
+              uint64_t oob_bits =
+                  MaskForWidth64(width) &
+                  ~MaskForWidth64(static_cast<int>(
+                      std::min<uint32_t>(avail, 64u)));
               if (base.is_const && base.width <= 64 && idx_val < 64) {
                 uint64_t mask_value = MaskForWidth64(width);
                 uint64_t val_bits = (base.const_val >> idx_val) & mask_value;
-                uint64_t xz_bits = (base.const_xz >> idx_val) & mask_value;
+                uint64_t xz_bits =
+                    ((base.const_xz >> idx_val) & mask_value) | oob_bits;
                 uint64_t drive_bits =
-                    (base.const_drive >> idx_val) & mask_value;
+                    ((base.const_drive >> idx_val) & mask_value) | oob_bits;
                 return fs_const_expr(val_bits, xz_bits, drive_bits, width);
               }
               std::string val =
@@ -14071,6 +15495,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                   "((" + base.xz + " >> " + idx + ") & " + mask + ")";
               std::string drive =
                   "((" + base.drive + " >> " + idx + ") & " + mask + ")";
+              if (oob_bits != 0) {
+                std::string oob = literal_for_width(oob_bits, width);
+                xz = "(" + xz + " | " + oob + ")";
+                drive = "(" + drive + " | " + oob + ")";
+              }
               return FsExpr{val, xz, drive, width};
             }
             std::string idx = to_uint(shift.val, shift.width);
@@ -14082,14 +15511,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                 "((" + xguard + ") ? ((" + bounds + ") ? ((" + base.val +
                 " >> " + idx + ") & " + mask + ") : " + zero + ") : " + zero +
                 ")";
+            std::string oob = past_end(
+                "(" + std::to_string(base.width) + "u - " + idx + ")");
             std::string xz =
-                "((" + xguard + ") ? ((" + bounds + ") ? ((" + base.xz +
-                " >> " + idx + ") & " + mask + ") : " + zero + ") : " + mask +
-                ")";
+                "((" + xguard + ") ? ((" + bounds + ") ? (((" + base.xz +
+                " >> " + idx + ") & " + mask + ") | " + oob + ") : " + mask +
+                ") : " + mask + ")";
             std::string drive =
-                "((" + xguard + ") ? ((" + bounds + ") ? ((" + base.drive +
-                " >> " + idx + ") & " + mask + ") : " + mask + ") : " + mask +
-                ")";
+                "((" + xguard + ") ? ((" + bounds + ") ? (((" + base.drive +
+                " >> " + idx + ") & " + mask + ") | " + oob + ") : " + mask +
+                ") : " + mask + ")";
             return FsExpr{val, xz, drive, width};
           }
           int lo = std::min(expr.msb, expr.lsb);
@@ -15099,7 +16530,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     if (options.sched_vm && needs_scheduler) {
       SchedulerVmLayout vm_layout_tmp;
       if (BuildSchedulerVmLayoutFromModule(module, &vm_layout_tmp, nullptr,
-                                           options.four_state)) {
+                                           options.four_state,
+                                           &xz_free_buffered)) {
         emit_fallback_kernel = VmLayoutNeedsCallGroup(vm_layout_tmp);
       }
     }
@@ -15108,6 +16540,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       std::string name;
       std::string type;
       int array_size = 1;
+      // Pointer into the shared zero segment instead of a segment of its own.
+      bool xz_zero = false;
     };
     std::unordered_map<std::string, int> signal_array_sizes;
     signal_array_sizes.reserve(module.nets.size());
@@ -15128,32 +16562,39 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                            reg_names.size() * 2 +
                            trireg_nets.size() * 3 +
                            array_nets.size() * 2);
+    std::vector<std::string> state_names;
+    state_names.reserve(module.ports.size() + reg_names.size());
     for (const auto& port : module.ports) {
-      std::string type = TypeForWidth(port.width);
-      PackedSignal val;
-      val.name = val_name(port.name);
-      val.type = type;
-      val.array_size = 1;
-      packed_signals.push_back(std::move(val));
-      PackedSignal xz;
-      xz.name = xz_name(port.name);
-      xz.type = type;
-      xz.array_size = 1;
-      packed_signals.push_back(std::move(xz));
-    }
-    for (const auto& reg : reg_names) {
-      std::string type = TypeForWidth(SignalWidth(module, reg));
-      int arr = array_size_for(reg);
+      state_names.push_back(port.name);
+    }
+    state_names.insert(state_names.end(), reg_names.begin(), reg_names.end());
+    std::vector<std::string> cold_state_names;
+    const bool locality_layout =
+        pack_signals && options.locality_layout && !options.sched_vm;
+    if (locality_layout) {
+      StateLocalityOrder locality = OrderStateByLocality(module, state_names);
+      state_names = std::move(locality.hot);
+      cold_state_names = std::move(locality.cold);
+    }
+    auto add_state_signal = [&](const std::string& name) {
+      const Port* port = FindPort(module, name);
+      std::string type =
+          TypeForWidth(port ? port->width : SignalWidth(module, name));
+      int arr = port ? 1 : array_size_for(name);
       PackedSignal val;
-      val.name = val_name(reg);
+      val.name = val_name(name);
       val.type = type;
       val.array_size = arr;
       packed_signals.push_back(std::move(val));
       PackedSignal xz;
-      xz.name = xz_name(reg);
+      xz.name = xz_name(name);
       xz.type = type;
       xz.array_size = arr;
+      xz.xz_zero = xz_free_buffered.count(name) > 0;
       packed_signals.push_back(std::move(xz));
+    };
+    for (const auto& name : state_names) {
+      add_state_signal(name);
     }
     for (const auto* reg : trireg_nets) {
       std::string type = TypeForWidth(SignalWidth(module, reg->name));
@@ -15188,13 +16629,72 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       xz.array_size = arr;
       packed_signals.push_back(std::move(xz));
     }
+    for (const auto& name : cold_state_names) {
+      add_state_signal(name);
+    }
+    if (pack_signals && !xz_free_buffered.empty()) {
+      PackedSignal zero;
+      zero.name = kPackedXzZeroName;
+      zero.type = "ulong";
+      packed_signals.push_back(std::move(zero));
+    }
+    // --pack-bits: scalar 1-bit ports and regs share 64-bit bitset words
+    // placed ahead of the regular segments of each packed state buffer.
+    std::unordered_map<std::string, std::pair<uint32_t, uint32_t>>
+        packed_bit_of;
+    uint32_t packed_bit_groups = 0u;
+    if (pack_signals && options.pack_bits && !options.sched_vm) {
+      std::vector<std::string> bit_candidates;
+      bit_candidates.reserve(module.ports.size() + reg_names.size());
+      for (const auto& port : module.ports) {
+        bit_candidates.push_back(port.name);
+      }
+      bit_candidates.insert(bit_candidates.end(), reg_names.begin(),
+                            reg_names.end());
+      PackedBitLayout bit_layout =
+          BuildPackedBitLayout(module, bit_candidates, true);
+      packed_bit_groups = bit_layout.group_count;
+      for (const auto& entry : bit_layout.slots) {
+        packed_bit_of[val_name(entry.first)] = {entry.second.group,
+                                                entry.second.val_bit};
+        packed_bit_of[xz_name(entry.first)] = {
+            entry.second.group, static_cast<uint32_t>(entry.second.xz_bit)};
+      }
+    }
+    auto emit_packed_bit_groups = [&](const std::string& words_prefix,
+                                      const std::string& buffer,
+                                      const std::string& offset,
+                                      const std::string& count) {
+      for (uint32_t group = 0; group < packed_bit_groups; ++group) {
+        out << "  device ulong* " << words_prefix << group
+            << " = (device ulong*)(" << buffer << " + " << offset << ");\n";
+        out << "  " << offset << " += (ulong)" << count << " * 8ul;\n";
+      }
+    };
+    auto emit_packed_bit_plane = [&](const std::string& words_prefix,
+                                     const std::string& packed_name,
+                                     const std::string& decl_name) -> bool {
+      auto it = packed_bit_of.find(packed_name);
+      if (it == packed_bit_of.end()) {
+        return false;
+      }
+      out << "  GpgaBitPlane " << decl_name << " = {" << words_prefix
+          << it->second.first << ", 1ul << " << it->second.second << "u};\n";
+      return true;
+    };
     auto emit_packed_signal_setup = [&](const std::string& count_expr) {
       if (!pack_signals) {
         return;
       }
       out << "  uint __gpga_count = " << count_expr << ";\n";
       out << "  ulong __gpga_offset = 0ul;\n";
+      emit_packed_bit_groups("__gpga_bits", "gpga_state", "__gpga_offset",
+                             "__gpga_count");
       for (const auto& sig : packed_signals) {
+        if (sig.xz_zero ||
+            emit_packed_bit_plane("__gpga_bits", sig.name, sig.name)) {
+          continue;
+        }
         int array_size = std::max(1, sig.array_size);
         out << "  __gpga_offset = (__gpga_offset + 7ul) & ~7ul;\n";
         out << "  device " << sig.type << "* " << sig.name
@@ -15202,6 +16702,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         out << "  __gpga_offset += (ulong)__gpga_count * " << array_size
             << "u * (ulong)sizeof(" << sig.type << ");\n";
       }
+      for (const auto& sig : packed_signals) {
+        if (sig.xz_zero) {
+          out << "  device " << sig.type << "* " << sig.name << " = (device "
+              << sig.type << "*)" << kPackedXzZeroName << ";\n";
+        }
+      }
     };
     auto emit_packed_nb_setup = [&](const std::string& count_expr) {
       if (!pack_nb || packed_nb_signals.empty()) {
@@ -15209,7 +16715,18 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       }
       out << "  uint __gpga_nb_count = " << count_expr << ";\n";
       out << "  ulong __gpga_nb_offset = 0ul;\n";
+      emit_packed_bit_groups("__gpga_nb_bits", "nb_state", "__gpga_nb_offset",
+                             "__gpga_nb_count");
       for (const auto& sig : packed_signals) {
+        if (sig.xz_zero) {
+          continue;
+        }
+        if (packed_bit_of.count(sig.name) > 0) {
+          if (nb_packed_names.count(sig.name) > 0u) {
+            emit_packed_bit_plane("__gpga_nb_bits", sig.name, "nb_" + sig.name);
+          }
+          continue;
+        }
         int array_size = std::max(1, sig.array_size);
         out << "  __gpga_nb_offset = (__gpga_nb_offset + 7ul) & ~7ul;\n";
         if (nb_packed_names.count(sig.name) > 0u) {
@@ -15221,25 +16738,25 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << "u * (ulong)sizeof(" << sig.type << ");\n";
       }
     };
-    std::vector<PackedSignal> packed_force_signals;
     auto emit_packed_force_setup = [&](const std::string& count_expr) {
       if (!needs_force_shadow) {
         return;
       }
-      if (packed_force_signals.empty()) {
-        packed_force_signals.reserve(packed_signals.size());
-        for (const auto& sig : packed_signals) {
-          PackedSignal shadow = sig;
-          shadow.name = shadow_any_name(sig.name);
-          packed_force_signals.push_back(std::move(shadow));
-        }
-      }
       out << "  uint __gpga_force_count = " << count_expr << ";\n";
       out << "  ulong __gpga_force_offset = 0ul;\n";
-      for (const auto& sig : packed_force_signals) {
+      emit_packed_bit_groups("__gpga_force_bits", "sched_force_state",
+                             "__gpga_force_offset", "__gpga_force_count");
+      for (const auto& sig : packed_signals) {
+        if (sig.xz_zero || sig.name == kPackedXzZeroName) {
+          continue;
+        }
+        std::string shadow = shadow_any_name(sig.name);
+        if (emit_packed_bit_plane("__gpga_force_bits", sig.name, shadow)) {
+          continue;
+        }
         int array_size = std::max(1, sig.array_size);
         out << "  __gpga_force_offset = (__gpga_force_offset + 7ul) & ~7ul;\n";
-        out << "  device " << sig.type << "* " << sig.name
+        out << "  device " << sig.type << "* " << shadow
             << " = (device " << sig.type << "*)(sched_force_state + __gpga_force_offset);\n";
         out << "  __gpga_force_offset += (ulong)__gpga_force_count * " << array_size
             << "u * (ulong)sizeof(" << sig.type << ");\n";
@@ -16003,18 +17520,25 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             if (IsOutputPort(module, assign.lhs) ||
                 regs_ctx.count(assign.lhs) > 0) {
               out << "  " << lhs.val << " = " << rhs.val << ";\n";
-              out << "  " << lhs.xz << " = " << rhs.xz << ";\n";
+              if (xz_free_buffered.count(assign.lhs) == 0) {
+                out << "  " << lhs.xz << " = " << rhs.xz << ";\n";
+              }
             } else if (locals_ctx.count(assign.lhs) > 0) {
+              bool xz_free = xz_free_locals.count(assign.lhs) > 0;
               if (declared_ctx && declared_ctx->count(assign.lhs) == 0) {
                 std::string type = TypeForWidth(lhs.width);
                 out << "  " << type << " " << lhs.val << " = " << rhs.val
                     << ";\n";
-                out << "  " << type << " " << lhs.xz << " = " << rhs.xz
-                    << ";\n";
+                if (!xz_free) {
+                  out << "  " << type << " " << lhs.xz << " = " << rhs.xz
+                      << ";\n";
+                }
                 declared_ctx->insert(assign.lhs);
               } else {
                 out << "  " << lhs.val << " = " << rhs.val << ";\n";
-                out << "  " << lhs.xz << " = " << rhs.xz << ";\n";
+                if (!xz_free) {
+                  out << "  " << lhs.xz << " = " << rhs.xz << ";\n";
+                }
               }
             }
             if (switch_nets.count(assign.lhs) > 0) {
@@ -16548,10 +18072,19 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                                     cache)
                 : FsExpr{literal_for_width(0, 1), literal_for_width(0, 1),
                          drive_full(1), 1};
+        case_expr = hoist_full_for_use(case_expr, indent);
+        std::string case_hit =
+            "__gpga_case_hit" + std::to_string(fs_temp_index++);
+        if (!EmitCaseTableHit(out, stmt, module, case_expr.val, case_expr.xz,
+                              case_hit, indent)) {
+          case_hit.clear();
+        }
         std::unordered_map<int, FsExpr> case_width_cache;
         bool first_case = true;
         std::unordered_set<std::string> case_blocked;
-        for (const auto& item : stmt.case_items) {
+        for (size_t item_index = 0; item_index < stmt.case_items.size();
+             ++item_index) {
+          const auto& item = stmt.case_items[item_index];
           std::string cond;
           for (const auto& label : item.labels) {
             int label_width = ExprWidth(*label, module);
@@ -16575,6 +18108,9 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           if (cond.empty()) {
             continue;
           }
+          if (!case_hit.empty()) {
+            cond = CaseTableItemCond(case_hit, item_index, cond);
+          }
           if (first_case) {
             out << pad << "if (" << cond << ") {\n";
             first_case = false;
@@ -17238,8 +18774,10 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         std::string mask = mask_literal(net.width);
         out << "  " << type << " " << val_name(net.name) << " = " << zero
             << ";\n";
-        out << "  " << type << " " << xz_name(net.name) << " = " << mask
-            << ";\n";
+        if (xz_free_locals.count(net.name) == 0) {
+          out << "  " << type << " " << xz_name(net.name) << " = " << mask
+              << ";\n";
+        }
         init_declared.insert(net.name);
       }
 
@@ -17953,10 +19491,19 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                                       indent, cache)
                   : FsExpr{literal_for_width(0, 1),
                            literal_for_width(0, 1), drive_full(1), 1};
+          case_expr = hoist_full_for_use(case_expr, indent);
+          std::string case_hit =
+              "__gpga_case_hit" + std::to_string(fs_temp_index++);
+          if (!EmitCaseTableHit(out, stmt, module, case_expr.val, case_expr.xz,
+                                case_hit, indent)) {
+            case_hit.clear();
+          }
           std::unordered_map<int, FsExpr> case_width_cache;
           bool first_case = true;
           std::unordered_set<std::string> case_blocked;
-          for (const auto& item : stmt.case_items) {
+          for (size_t item_index = 0; item_index < stmt.case_items.size();
+               ++item_index) {
+            const auto& item = stmt.case_items[item_index];
             std::string cond;
             for (const auto& label : item.labels) {
               int label_width = ExprWidth(*label, module);
@@ -17980,6 +19527,9 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             if (cond.empty()) {
               continue;
             }
+            if (!case_hit.empty()) {
+              cond = CaseTableItemCond(case_hit, item_index, cond);
+            }
             if (first_case) {
               out << pad << "if (" << cond << ") {\n";
               first_case = false;
@@ -19538,8 +21088,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         uint32_t vm_service_assign_count = 0u;
         uint32_t vm_service_arg_count = 0u;
         uint32_t vm_words_per_proc = kSchedulerVmWordsPerProc;
+        uint32_t vm_bytecode_words =
+            static_cast<uint32_t>(procs.size()) * kSchedulerVmWordsPerProc;
         uint32_t vm_expr_word_count = 0u;
         uint32_t vm_expr_imm_word_count = 0u;
+        uint32_t vm_expr_reg_count = 0u;
         uint32_t vm_signal_count = 0u;
         bool vm_needs_call_group = false;
         if (options.sched_vm) {
@@ -19564,8 +21117,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           vm_service_assign_count =
               static_cast<uint32_t>(vm_tables.service_assign_stmts.size());
           if (BuildSchedulerVmLayoutFromModule(
-                  module, &vm_layout, nullptr, options.four_state)) {
+                  module, &vm_layout, nullptr, options.four_state,
+                  &xz_free_buffered)) {
             vm_words_per_proc = vm_layout.words_per_proc;
+            vm_bytecode_words =
+                static_cast<uint32_t>(vm_layout.bytecode.size());
             vm_case_header_count =
                 static_cast<uint32_t>(vm_layout.case_headers.size());
             vm_case_entry_count =
@@ -19581,6 +21137,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                 static_cast<uint32_t>(vm_layout.expr_table.words.size());
             vm_expr_imm_word_count =
                 static_cast<uint32_t>(vm_layout.expr_table.imm_words.size());
+            vm_expr_reg_count = vm_layout.expr_table.reg_count;
             vm_signal_count =
                 static_cast<uint32_t>(vm_layout.signal_entries.size());
             vm_service_arg_count =
@@ -19604,6 +21161,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           vm_service_arg_count = 0u;
           vm_expr_word_count = 0u;
           vm_expr_imm_word_count = 0u;
+          vm_expr_reg_count = 0u;
           vm_signal_count = 0u;
         }
         if (options.sched_vm) {
@@ -19710,8 +21268,49 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           vm_service_arg_count = 0u;
           vm_expr_word_count = 0u;
           vm_expr_imm_word_count = 0u;
+          vm_expr_reg_count = 0u;
           vm_signal_count = 0u;
         }
+        if (manifest) {
+          SchedulerConstants sched = MakeManifestConstants(
+              static_cast<uint32_t>(procs.size()),
+              static_cast<uint32_t>(module.events.size()),
+              static_cast<uint32_t>(edge_item_count),
+              static_cast<uint32_t>(edge_star_count), repeat_count, delay_count,
+              max_dnba, monitor_count, monitor_max_args, strobe_count,
+              service_max_args, service_wide_words_local, string_count,
+              static_cast<uint32_t>(force_target_list.size()),
+              static_cast<uint32_t>(passign_target_list.size()),
+              timing_check_count);
+          sched.packed_bit_groups = packed_bit_groups;
+          sched.locality_layout = locality_layout;
+          sched.prune_xz = !xz_free_buffered.empty();
+          if (options.sched_vm) {
+            sched.vm_enabled = true;
+            sched.vm_bytecode_words = vm_bytecode_words;
+            sched.vm_cond_count = vm_cond_count;
+            sched.vm_assign_count = vm_assign_count;
+            sched.vm_force_count = vm_force_count;
+            sched.vm_release_count = vm_release_count;
+            sched.vm_service_call_count = vm_service_call_count;
+            sched.vm_service_assign_count = vm_service_assign_count;
+            sched.vm_service_arg_count = vm_service_arg_count;
+            sched.vm_call_frame_words = kSchedulerVmCallFrameWords;
+            sched.vm_call_frame_depth = kSchedulerVmCallFrameDepth;
+            sched.vm_case_header_count = vm_case_header_count;
+            sched.vm_case_entry_count = vm_case_entry_count;
+            sched.vm_case_word_count = vm_case_word_count;
+            sched.vm_expr_word_count = vm_expr_word_count;
+            sched.vm_expr_imm_word_count = vm_expr_imm_word_count;
+            sched.vm_signal_count = vm_signal_count;
+          }
+          manifest->sched = sched;
+          manifest->has_vm_layout =
+              options.sched_vm && !vm_layout.bytecode.empty();
+          if (manifest->has_vm_layout) {
+            manifest->vm_layout = vm_layout;
+          }
+        }
         out << "GPGA_SCHED_DEFINE_CONSTANTS(" << procs.size() << "u, "
             << root_proc_count << "u, " << module.events.size() << "u, "
             << edge_item_count << "u, " << edge_star_count << "u, "
@@ -19728,12 +21327,22 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << sched_proc_group_size << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_PROC_GROUP_COUNT = "
             << sched_proc_group_count << "u;\n";
+        if (packed_bit_groups > 0u) {
+          out << "constant constexpr uint GPGA_SCHED_PACKED_BIT_GROUPS = "
+              << packed_bit_groups << "u;\n";
+        }
+        if (locality_layout) {
+          out << "constant constexpr uint GPGA_SCHED_LOCALITY_LAYOUT = 1u;\n";
+        }
+        if (!xz_free_buffered.empty()) {
+          out << "constant constexpr uint GPGA_SCHED_PRUNE_XZ = 1u;\n";
+        }
         if (options.sched_vm) {
           out << "constant constexpr uint GPGA_SCHED_VM_ENABLED = 1u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_WORDS_PER_PROC = "
               << vm_words_per_proc << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_BYTECODE_WORDS = "
-                 "GPGA_SCHED_PROC_COUNT * GPGA_SCHED_VM_WORDS_PER_PROC;\n";
+              << vm_bytecode_words << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_COND_COUNT = "
               << vm_cond_count << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_ASSIGN_COUNT = "
@@ -19776,6 +21385,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               << static_cast<uint32_t>(SchedulerVmCondKind::kExpr) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_STACK_MAX = "
               << kSchedulerVmExprStackMax << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_EXPR_REG_COUNT = "
+              << vm_expr_reg_count << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_WIDE_WORDS = "
               << vm_expr_wide_words << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_WIDE_BITS = "
@@ -19800,6 +21411,10 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               << static_cast<uint32_t>(SchedulerVmExprOp::kIndex) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_CALL = "
               << static_cast<uint32_t>(SchedulerVmExprOp::kCall) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_LOAD_REG = "
+              << static_cast<uint32_t>(SchedulerVmExprOp::kLoadReg) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_STORE_REG = "
+              << static_cast<uint32_t>(SchedulerVmExprOp::kStoreReg) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_UNARY_PLUS = "
               << static_cast<uint32_t>(SchedulerVmExprUnaryOp::kPlus) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_UNARY_MINUS = "
@@ -19888,6 +21503,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kDiv) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_MOD = "
               << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kMod) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_POW = "
+              << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kPow) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_SHL = "
               << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kShl) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_SHR = "
@@ -19930,6 +21547,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               << static_cast<uint32_t>(SchedulerVmCaseKind::kCaseX) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_CASE_KIND_CASEZ = "
               << static_cast<uint32_t>(SchedulerVmCaseKind::kCaseZ) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_CASE_STRATEGY_LINEAR = "
+              << static_cast<uint32_t>(SchedulerVmCaseStrategy::kLinear) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_CASE_STRATEGY_LUT = "
+              << static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut) << "u;\n";
+          out << "constant constexpr ulong GPGA_SCHED_VM_CASE_HASH_MUL = "
+              << kSchedulerVmCaseHashMul << "ul;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_OP_DONE = "
               << static_cast<uint32_t>(SchedulerVmOp::kDone) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_OP_CALL_GROUP = "
@@ -19986,6 +21609,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               << static_cast<uint32_t>(SchedulerVmOp::kRet) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_OP_HALT_SIM = "
               << static_cast<uint32_t>(SchedulerVmOp::kHaltSim) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_OP_ASSIGN_RUN = "
+              << static_cast<uint32_t>(SchedulerVmOp::kAssignRun) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_OP_BRANCH = "
+              << static_cast<uint32_t>(SchedulerVmOp::kBranch) << "u;\n";
+          out << "constant constexpr uint GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP = "
+              << static_cast<uint32_t>(SchedulerVmOp::kWaitEdgeLoop) << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_OP_MASK = "
               << kSchedulerVmOpMask << "u;\n";
           out << "constant constexpr uint GPGA_SCHED_VM_OP_SHIFT = "
@@ -23878,11 +25507,19 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                 *stmt.case_expr, ExprWidth(*stmt.case_expr, module), indent,
                 cache);
             case_expr = hoist_full_for_use(case_expr, indent);
+            std::string case_hit =
+                "__gpga_case_hit" + std::to_string(fs_temp_index++);
+            if (!EmitCaseTableHit(out, stmt, module, case_expr.val,
+                                  case_expr.xz, case_hit, indent)) {
+              case_hit.clear();
+            }
             std::unordered_map<int, FsExpr> case_width_cache;
             bool first = true;
             std::unordered_set<std::string> case_blocked;
-            for (const auto& item : stmt.case_items) {
-              if (StatementListIsEmpty(item.body)) {
+            for (size_t item_index = 0; item_index < stmt.case_items.size();
+                 ++item_index) {
+              const auto& item = stmt.case_items[item_index];
+              if (case_hit.empty() && StatementListIsEmpty(item.body)) {
                 continue;
               }
               std::string cond;
@@ -23909,6 +25546,9 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               if (cond.empty()) {
                 continue;
               }
+              if (!case_hit.empty()) {
+                cond = CaseTableItemCond(case_hit, item_index, cond);
+              }
               if (first) {
                 out << pad << "if (" << cond << ") {\n";
                 first = false;
@@ -24453,6 +26093,9 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "  thread bool& finished = *finished_ptr;\n";
           out << "  thread bool& stopped = *stopped_ptr;\n";
           out << "  thread ulong& __gpga_time = *__gpga_time_ptr;\n";
+          emit_packed_signal_setup("sched.count");
+          emit_packed_nb_setup("sched.count");
+          emit_packed_force_setup("sched.count");
           const int kPcChunkSize = 32;
           int max_pc = pc_done;
           for (int pc_value : pc_for_index) {
@@ -26512,6 +28155,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "          ? fs_smod64(lhs, rhs, out_width)\n";
           out << "          : fs_mod64(lhs, rhs, out_width);\n";
           out << "    }\n";
+          out << "  } else if (op == GPGA_SCHED_VM_EXPR_BINARY_POW) {\n";
+          out << "    if (is_signed) {\n";
+          out << "      lhs = fs_sext64(lhs, lhs_width, out_width);\n";
+          out << "      rhs = fs_sext64(rhs, rhs_width, out_width);\n";
+          out << "      out = fs_spow64(lhs, rhs, out_width);\n";
+          out << "    } else {\n";
+          out << "      lhs = fs_resize64(lhs, out_width);\n";
+          out << "      rhs = fs_resize64(rhs, out_width);\n";
+          out << "      out = fs_pow64(lhs, rhs, out_width);\n";
+          out << "    }\n";
           out << "  } else {\n";
           out << "    return false;\n";
           out << "  }\n";
@@ -26594,6 +28247,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             out << "      thread GpgaWide" << vm_expr_wide_bits
                 << " __gpga_wide_xzs[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
           }
+          if (vm_expr_reg_count > 0u) {
+            EmitSchedulerVmExprRegDecls(
+                out,
+                MakeSchedulerVmExprSlotArrays(true, true, vm_expr_wide_bits),
+                6);
+          }
           out << "      while (__gpga_expr_ok) {\n";
           out << "        uint __gpga_instr = sched_vm_expr[__gpga_ip++];\n";
           out << "        uint __gpga_op = (__gpga_instr & 0xFFu);\n";
@@ -27880,16 +29539,31 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "              __gpga_xzs[__gpga_sp - 2u] = __gpga_out_xz;\n";
           out << "              __gpga_widths[__gpga_sp - 2u] = __gpga_width;\n";
           out << "              __gpga_is_real[__gpga_sp - 2u] = __gpga_out_real;\n";
+          out << "              __gpga_sp -= 1u;\n";
+          out << "              break;\n";
+          out << "            }\n";
           if (vm_expr_wide_bits > 64u) {
             out << "            if (__gpga_width > 64u) {\n";
             out << "              GpgaWide" << vm_expr_wide_bits
-                << " __gpga_lhs_wide_val = __gpga_wide_vals[__gpga_sp - 2u];\n";
+                << " __gpga_lhs_wide_val = (__gpga_lhs_width > 64u)\n";
+            out << "                  ? __gpga_wide_vals[__gpga_sp - 2u]\n";
+            out << "                  : gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_lhs);\n";
             out << "              GpgaWide" << vm_expr_wide_bits
-                << " __gpga_rhs_wide_val = __gpga_wide_vals[__gpga_sp - 1u];\n";
+                << " __gpga_lhs_wide_xz = (__gpga_lhs_width > 64u)\n";
+            out << "                  ? __gpga_wide_xzs[__gpga_sp - 2u]\n";
+            out << "                  : gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_lhs_xz);\n";
             out << "              GpgaWide" << vm_expr_wide_bits
-                << " __gpga_lhs_wide_xz = __gpga_wide_xzs[__gpga_sp - 2u];\n";
+                << " __gpga_rhs_wide_val = (__gpga_rhs_width > 64u)\n";
+            out << "                  ? __gpga_wide_vals[__gpga_sp - 1u]\n";
+            out << "                  : gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_rhs);\n";
             out << "              GpgaWide" << vm_expr_wide_bits
-                << " __gpga_rhs_wide_xz = __gpga_wide_xzs[__gpga_sp - 1u];\n";
+                << " __gpga_rhs_wide_xz = (__gpga_rhs_width > 64u)\n";
+            out << "                  ? __gpga_wide_xzs[__gpga_sp - 1u]\n";
+            out << "                  : gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_rhs_xz);\n";
             out << "              __gpga_lhs_wide_val = gpga_sched_vm_wide_mask_value(\n";
             out << "                  __gpga_lhs_wide_val, __gpga_lhs_width);\n";
             out << "              __gpga_rhs_wide_val = gpga_sched_vm_wide_mask_value(\n";
@@ -28300,9 +29974,6 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             out << "              break;\n";
             out << "            }\n";
           }
-          out << "              __gpga_sp -= 1u;\n";
-          out << "              break;\n";
-          out << "            }\n";
           out << "            FourState64 __gpga_lhs_fs =\n";
           out << "                fs_make64(__gpga_lhs, __gpga_lhs_xz, __gpga_lhs_width);\n";
           out << "            FourState64 __gpga_rhs_fs =\n";
@@ -28446,22 +30117,6 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "                        gpga_double_from_u64(__gpga_src_val_masked);\n";
           if (vm_expr_wide_bits > 64u) {
             out << "                  }\n";
-          } else {
-            out << "                  if (__gpga_src_width > 64u) {\n";
-            out << "                    __gpga_expr_ok = false;\n";
-            out << "                    break;\n";
-            out << "                  }\n";
-            out << "                  ulong __gpga_src_mask = (__gpga_src_width >= 64u)\n";
-            out << "                      ? ~0ul\n";
-            out << "                      : ((__gpga_src_width == 0u)\n";
-            out << "                             ? 0ul\n";
-            out << "                             : ((1ul << __gpga_src_width) - 1ul));\n";
-            out << "                  __gpga_src_any_xz =\n";
-            out << "                      ((__gpga_src_xz & __gpga_src_mask) != 0ul);\n";
-            out << "                  ulong __gpga_src_val_masked =\n";
-            out << "                      __gpga_src_val & __gpga_src_mask;\n";
-            out << "                  __gpga_src_real_val =\n";
-            out << "                      gpga_double_from_u64(__gpga_src_val_masked);\n";
           }
           out << "                  if (__gpga_src_any_xz) {\n";
           out << "                    __gpga_out_val = 0ul;\n";
@@ -28584,6 +30239,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "            __gpga_sp -= 2u;\n";
           out << "            break;\n";
           out << "          }\n";
+          if (vm_expr_reg_count > 0u) {
+            EmitSchedulerVmExprRegCases(
+                out,
+                MakeSchedulerVmExprSlotArrays(true, true, vm_expr_wide_bits),
+                10);
+          }
           out << "          default: {\n";
           out << "            __gpga_expr_ok = false;\n";
           out << "            break;\n";
@@ -28638,6 +30299,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "  thread ulong __gpga_vals[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
           out << "  thread ulong __gpga_xzs[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
           out << "  thread uint __gpga_widths[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
+          if (vm_expr_reg_count > 0u) {
+            EmitSchedulerVmExprRegDecls(
+                out,
+                MakeSchedulerVmExprSlotArrays(true, false, 0u),
+                2);
+          }
           out << "  while (__gpga_expr_ok) {\n";
           out << "    uint __gpga_instr = sched_vm_expr[__gpga_ip++];\n";
           out << "    uint __gpga_op = (__gpga_instr & 0xFFu);\n";
@@ -29000,6 +30667,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "        __gpga_sp -= 2u;\n";
           out << "        break;\n";
           out << "      }\n";
+          if (vm_expr_reg_count > 0u) {
+            EmitSchedulerVmExprRegCases(
+                out,
+                MakeSchedulerVmExprSlotArrays(true, false, 0u),
+                6);
+          }
           out << "      default: {\n";
           out << "        __gpga_expr_ok = false;\n";
           out << "        break;\n";
@@ -29234,9 +30907,6 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "  }\n";
           out << "  const GpgaSchedVmSignalEntry __gpga_sig =\n";
           out << "      sched_vm_signal_entry[__gpga_entry.signal_id];\n";
-          out << "  if ((__gpga_sig.flags & GPGA_SCHED_VM_SIGNAL_FLAG_REAL) != 0u) {\n";
-          out << "    return false;\n";
-          out << "  }\n";
           if (pack_nb && !packed_nb_signals.empty()) {
             out << "  device uchar* __gpga_state = use_nb ? nb_state : gpga_state;\n";
           } else {
@@ -29361,6 +31031,44 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "             : ((1ul << __gpga_header.width) - 1ul));\n";
           out << "  __gpga_case_val &= __gpga_mask;\n";
           out << "  __gpga_case_xz &= __gpga_mask;\n";
+          out << "  if (__gpga_header.strategy != GPGA_SCHED_VM_CASE_STRATEGY_LINEAR &&\n";
+          out << "      __gpga_case_xz == 0ul) {\n";
+          out << "    const uint __gpga_table = __gpga_header.table_offset;\n";
+          out << "    if (__gpga_header.strategy == GPGA_SCHED_VM_CASE_STRATEGY_LUT) {\n";
+          out << "      ulong __gpga_pair = sched_vm_case_words[__gpga_table + uint(__gpga_case_val >> 1ul)];\n";
+          out << "      return uint(__gpga_pair >> ((__gpga_case_val & 1ul) * 32ul));\n";
+          out << "    }\n";
+          out << "    uint __gpga_slot = uint((__gpga_case_val * GPGA_SCHED_VM_CASE_HASH_MUL) >> 32ul) &\n";
+          out << "        __gpga_header.table_mask;\n";
+          out << "    #pragma clang loop unroll(disable)\n";
+          out << "    for (uint __gpga_probe = 0u; __gpga_probe <= __gpga_header.table_mask; ++__gpga_probe) {\n";
+          out << "      uint __gpga_target = uint(sched_vm_case_words[__gpga_table + __gpga_slot * 2u + 1u]);\n";
+          out << "      if (__gpga_target == 0xFFFFFFFFu) {\n";
+          out << "        break;\n";
+          out << "      }\n";
+          out << "      if (sched_vm_case_words[__gpga_table + __gpga_slot * 2u] == __gpga_case_val) {\n";
+          out << "        __gpga_match = __gpga_target;\n";
+          out << "        break;\n";
+          out << "      }\n";
+          out << "      __gpga_slot = (__gpga_slot + 1u) & __gpga_header.table_mask;\n";
+          out << "    }\n";
+          out << "    const uint __gpga_wild = __gpga_table + (__gpga_header.table_mask + 1u) * 2u;\n";
+          out << "    #pragma clang loop unroll(disable)\n";
+          out << "    for (uint __gpga_w = 0u; __gpga_w < __gpga_header.wild_count; ++__gpga_w) {\n";
+          out << "      const GpgaSchedVmCaseEntry __gpga_entry_rec = sched_vm_case_entry[\n";
+          out << "          __gpga_header.entry_offset + uint(sched_vm_case_words[__gpga_wild + __gpga_w])];\n";
+          out << "      if (__gpga_entry_rec.target >= __gpga_match) {\n";
+          out << "        break;\n";
+          out << "      }\n";
+          out << "      ulong __gpga_want = sched_vm_case_words[__gpga_entry_rec.want_offset];\n";
+          out << "      ulong __gpga_aux = sched_vm_case_words[__gpga_entry_rec.care_offset];\n";
+          out << "      if (((__gpga_case_val ^ __gpga_want) & ~__gpga_aux) == 0ul) {\n";
+          out << "        __gpga_match = __gpga_entry_rec.target;\n";
+          out << "        break;\n";
+          out << "      }\n";
+          out << "    }\n";
+          out << "    return __gpga_match;\n";
+          out << "  }\n";
           out << "  #pragma clang loop unroll(disable)\n";
           out << "  for (uint __gpga_entry = 0u; __gpga_entry < __gpga_header.entry_count; ++__gpga_entry) {\n";
           out << "    const GpgaSchedVmCaseEntry __gpga_entry_rec = "
@@ -29393,6 +31101,142 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "  return __gpga_match;\n";
           out << "}\n";
         }
+        if (options.sched_vm && vm_expr_wide_bits > 64u) {
+          const std::string wide_bits = std::to_string(vm_expr_wide_bits);
+          out << "static __attribute__((noinline)) bool gpga_"
+              << MslName(module.name) << "_sched_vm_apply_assign_wide(";
+          emit_sched_param_decls(2);
+          out << ",\n  uint pid,\n  uint assign_id,\n  GpgaWide" << wide_bits
+              << " val,\n  GpgaWide" << wide_bits << " xz,\n"
+                 "  uint idx_val,\n  uint idx_xz,\n  bool use_nb) {\n";
+          out << "  const GpgaSchedVmAssignEntry __gpga_entry =\n";
+          out << "      sched_vm_assign_entry[assign_id];\n";
+          out << "  const GpgaSchedVmSignalEntry __gpga_sig =\n";
+          out << "      sched_vm_signal_entry[__gpga_entry.signal_id];\n";
+          if (pack_nb && !packed_nb_signals.empty()) {
+            out << "  device uchar* __gpga_state = use_nb ? nb_state : gpga_state;\n";
+          } else {
+            out << "  (void)use_nb;\n";
+            out << "  device uchar* __gpga_state = gpga_state;\n";
+          }
+          out << "  uint __gpga_storage_width = __gpga_sig.width;\n";
+          out << "  if (__gpga_storage_width <= 64u ||\n";
+          out << "      __gpga_storage_width > GPGA_SCHED_VM_EXPR_WIDE_BITS) {\n";
+          out << "    return false;\n";
+          out << "  }\n";
+          out << "  uint __gpga_storage_words = (__gpga_storage_width + 63u) >> 6u;\n";
+          out << "  ulong __gpga_stride = (ulong)__gpga_storage_words * 8ul;\n";
+          out << "  ulong __gpga_elem = (ulong)gid * (ulong)__gpga_sig.array_size;\n";
+          out << "  if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_ARRAY) != 0u) {\n";
+          out << "    if (idx_xz != 0u || idx_val >= __gpga_entry.array_size) {\n";
+          out << "      return true;\n";
+          out << "    }\n";
+          out << "    __gpga_elem = (ulong)gid * (ulong)__gpga_entry.array_size +\n";
+          out << "        (ulong)idx_val;\n";
+          out << "  } else if (__gpga_sig.array_size != 1u) {\n";
+          out << "    return false;\n";
+          out << "  }\n";
+          out << "  uint __gpga_start = 0u;\n";
+          out << "  uint __gpga_width = __gpga_storage_width;\n";
+          out << "  if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_BIT_SELECT) != 0u) {\n";
+          out << "    if (idx_xz != 0u || idx_val >= __gpga_entry.base_width) {\n";
+          out << "      return true;\n";
+          out << "    }\n";
+          out << "    __gpga_start = idx_val;\n";
+          out << "    __gpga_width = 1u;\n";
+          out << "  } else if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_RANGE) != 0u) {\n";
+          out << "    bool __gpga_indexed =\n";
+          out << "        ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_INDEXED_RANGE) != 0u);\n";
+          out << "    if (__gpga_indexed && idx_xz != 0u) {\n";
+          out << "      return true;\n";
+          out << "    }\n";
+          out << "    __gpga_start = __gpga_indexed ? idx_val : __gpga_entry.range_lsb;\n";
+          out << "    __gpga_width = __gpga_entry.width;\n";
+          out << "    if (__gpga_width == 0u || __gpga_entry.base_width < __gpga_width ||\n";
+          out << "        __gpga_start > __gpga_entry.base_width - __gpga_width) {\n";
+          out << "      return true;\n";
+          out << "    }\n";
+          out << "  }\n";
+          out << "  GpgaWide" << wide_bits
+              << " __gpga_mask = gpga_wide_shl_" << wide_bits
+              << "(gpga_sched_vm_wide_mask_bits(__gpga_width), __gpga_start);\n";
+          out << "  GpgaWide" << wide_bits
+              << " __gpga_bits = gpga_wide_shl_" << wide_bits
+              << "(val, __gpga_start);\n";
+          out << "  device ulong* __gpga_val_words = (device ulong*)(__gpga_state +\n";
+          out << "      (ulong)__gpga_sig.val_offset + __gpga_elem * __gpga_stride);\n";
+          out << "  GpgaWide" << wide_bits
+              << " __gpga_xz_bits = gpga_wide_shl_" << wide_bits
+              << "(xz, __gpga_start);\n";
+          out << "  device ulong* __gpga_xz_words = (device ulong*)(__gpga_state +\n";
+          out << "      (ulong)__gpga_sig.xz_offset + __gpga_elem * __gpga_stride);\n";
+          out << "  #pragma clang loop unroll(disable)\n";
+          out << "  for (uint __gpga_w = 0u; __gpga_w < __gpga_storage_words; ++__gpga_w) {\n";
+          out << "    ulong __gpga_m = __gpga_mask.w[__gpga_w];\n";
+          out << "    __gpga_val_words[__gpga_w] = (__gpga_val_words[__gpga_w] & ~__gpga_m) |\n";
+          out << "        (__gpga_bits.w[__gpga_w] & __gpga_m);\n";
+          out << "    __gpga_xz_words[__gpga_w] = (__gpga_xz_words[__gpga_w] & ~__gpga_m) |\n";
+          out << "        (__gpga_xz_bits.w[__gpga_w] & __gpga_m);\n";
+          out << "  }\n";
+          out << "  return true;\n";
+          out << "}\n";
+        }
+        if (options.sched_vm) {
+          out << "static __attribute__((noinline)) bool gpga_"
+              << MslName(module.name) << "_sched_vm_assign_cond_rhs(";
+          emit_sched_param_decls(2);
+          out << ",\n  uint pid,\n  uint assign_id,\n  uint idx_val,\n"
+                 "  uint idx_xz,\n  bool use_nb) {\n";
+          out << "  const GpgaSchedVmAssignEntry __gpga_entry =\n";
+          out << "      sched_vm_assign_entry[assign_id];\n";
+          out << "  uint __gpga_cond_val = 0u;\n";
+          out << "  uint __gpga_cond_xz = 0u;\n";
+          out << "  ulong __gpga_val = 0ul;\n";
+          out << "  ulong __gpga_xz = 0ul;\n";
+          out << "  uint __gpga_width = 0u;\n";
+          if (vm_expr_wide_bits > 64u) {
+            out << "  GpgaWide" << vm_expr_wide_bits << " __gpga_wide_val = gpga_wide_zero_"
+                << vm_expr_wide_bits << "();\n";
+            out << "  GpgaWide" << vm_expr_wide_bits << " __gpga_wide_xz = gpga_wide_zero_"
+                << vm_expr_wide_bits << "();\n";
+          }
+          out << "  gpga_" << MslName(module.name) << "_sched_vm_eval_cond(";
+          emit_sched_param_names();
+          out << ", pid, __gpga_entry.rhs_expr, &__gpga_cond_val, &__gpga_cond_xz,\n"
+                 "      &__gpga_val, &__gpga_xz, &__gpga_width";
+          if (vm_expr_wide_bits > 64u) {
+            out << ", &__gpga_wide_val, &__gpga_wide_xz";
+          }
+          out << ");\n";
+          out << "  if (__gpga_width == 0u) {\n";
+          out << "    return false;\n";
+          out << "  }\n";
+          if (vm_expr_wide_bits > 64u) {
+            out << "  if (sched_vm_signal_entry[__gpga_entry.signal_id].width > 64u) {\n";
+            out << "    if (__gpga_width <= 64u) {\n";
+            out << "      __gpga_wide_val = gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_val);\n";
+            out << "      __gpga_wide_xz = gpga_wide_from_u64_" << vm_expr_wide_bits
+                << "(__gpga_xz);\n";
+            out << "    }\n";
+            out << "    return gpga_" << MslName(module.name)
+                << "_sched_vm_apply_assign_wide(";
+            emit_sched_param_names();
+            out << ", pid, assign_id, __gpga_wide_val, __gpga_wide_xz,\n"
+                   "        idx_val, idx_xz, use_nb);\n";
+            out << "  }\n";
+          }
+          out << "  ulong __gpga_mask = (__gpga_entry.width >= 64u)\n";
+          out << "      ? ~0ul\n";
+          out << "      : ((__gpga_entry.width == 0u)\n";
+          out << "             ? 0ul\n";
+          out << "             : ((1ul << __gpga_entry.width) - 1ul));\n";
+          out << "  return gpga_" << MslName(module.name) << "_sched_vm_apply_assign(";
+          emit_sched_param_names();
+          out << ", pid, assign_id, __gpga_val & __gpga_mask,\n"
+                 "      __gpga_xz & __gpga_mask, idx_val, idx_xz, use_nb);\n";
+          out << "}\n";
+        }
         if (options.sched_vm) {
           out << "static __attribute__((noinline)) void gpga_"
               << MslName(module.name) << "_sched_vm_exec_assign_blocking(";
@@ -29428,7 +31272,15 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "      }\n";
           out << "    }\n";
           out << "    if (__gpga_ok) {\n";
-          out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
+          out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_COND_RHS) != 0u) {\n";
+          out << "        if (!gpga_" << MslName(module.name)
+              << "_sched_vm_assign_cond_rhs(";
+          emit_sched_param_names();
+          out << ", pid, assign_id,\n";
+          out << "            __gpga_idx_val, __gpga_idx_xz, false)) {\n";
+          out << "          __gpga_ok = false;\n";
+          out << "        }\n";
+          out << "      } else if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
           out << "        if (!gpga_" << MslName(module.name)
               << "_sched_vm_apply_assign(";
           emit_sched_param_names();
@@ -29515,7 +31367,15 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             out << "      }\n";
             out << "    }\n";
             out << "    if (__gpga_ok) {\n";
-            out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
+            out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_COND_RHS) != 0u) {\n";
+            out << "        if (!gpga_" << MslName(module.name)
+                << "_sched_vm_assign_cond_rhs(";
+            emit_sched_param_names();
+            out << ", pid, assign_id,\n";
+            out << "            __gpga_idx_val, __gpga_idx_xz, true)) {\n";
+            out << "          __gpga_ok = false;\n";
+            out << "        }\n";
+            out << "      } else if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
             out << "        if (!gpga_" << MslName(module.name)
                 << "_sched_vm_apply_assign(";
             emit_sched_param_names();
@@ -30682,6 +32542,39 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "      __gpga_ip = __gpga_next_ip;\n";
           out << "      continue;\n";
           out << "    }\n";
+          out << "    if (__gpga_op == GPGA_SCHED_VM_OP_ASSIGN_RUN) {\n";
+          out << "      if (__gpga_next_ip + __gpga_arg > __gpga_bc_len) {\n";
+          out << "        sched_error[gid] = 1u;\n";
+          out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+          out << "        sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+          out << "        return;\n";
+          out << "      }\n";
+          out << "      #pragma clang loop unroll(disable)\n";
+          out << "      for (uint __gpga_k = 0u; __gpga_k < __gpga_arg; ++__gpga_k) {\n";
+          out << "        uint __gpga_run_instr =\n"
+                 "            sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip + __gpga_k];\n";
+          out << "        uint __gpga_run_id = __gpga_run_instr >> GPGA_SCHED_VM_OP_SHIFT;\n";
+          out << "        if (__gpga_run_id >= GPGA_SCHED_VM_ASSIGN_COUNT) {\n";
+          out << "          sched_error[gid] = 1u;\n";
+          out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+          out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+          out << "          return;\n";
+          out << "        }\n";
+          out << "        if ((__gpga_run_instr & GPGA_SCHED_VM_OP_MASK) == GPGA_SCHED_VM_OP_ASSIGN_NB) {\n";
+          out << "          gpga_" << MslName(module.name)
+              << "_sched_vm_exec_assign_nb(";
+          emit_sched_param_names();
+          out << ", pid, idx, __gpga_run_id);\n";
+          out << "        } else {\n";
+          out << "          gpga_" << MslName(module.name)
+              << "_sched_vm_exec_assign_blocking(";
+          emit_sched_param_names();
+          out << ", pid, idx, __gpga_run_id);\n";
+          out << "        }\n";
+          out << "      }\n";
+          out << "      __gpga_ip = __gpga_next_ip + __gpga_arg;\n";
+          out << "      continue;\n";
+          out << "    }\n";
           out << "    if (__gpga_op == GPGA_SCHED_VM_OP_ASSIGN_DELAY) {\n";
           out << "      if (__gpga_arg >= GPGA_SCHED_DELAY_COUNT) {\n";
           out << "        sched_error[gid] = 1u;\n";
@@ -31080,7 +32973,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "      sched_vm_ip[__gpga_vm_idx] = 0u;\n";
           out << "      return;\n";
           out << "    }\n";
-          out << "    if (__gpga_op == GPGA_SCHED_VM_OP_JUMP_IF) {\n";
+          out << "    if (__gpga_op == GPGA_SCHED_VM_OP_JUMP_IF ||\n";
+          out << "        __gpga_op == GPGA_SCHED_VM_OP_BRANCH) {\n";
           out << "      if (__gpga_next_ip >= __gpga_bc_len) {\n";
           out << "        sched_error[gid] = 1u;\n";
           out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -31088,6 +32982,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "        return;\n";
           out << "      }\n";
           out << "      uint __gpga_target = sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip];\n";
+          out << "      uint __gpga_fall_ip = __gpga_next_ip + 1u;\n";
+          out << "      if (__gpga_op == GPGA_SCHED_VM_OP_BRANCH) {\n";
+          out << "        if (__gpga_fall_ip >= __gpga_bc_len) {\n";
+          out << "          sched_error[gid] = 1u;\n";
+          out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+          out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+          out << "          return;\n";
+          out << "        }\n";
+          out << "        __gpga_fall_ip = sched_vm_bytecode[__gpga_bc_base + __gpga_fall_ip];\n";
+          out << "      }\n";
           out << "      if (__gpga_arg >= GPGA_SCHED_VM_COND_COUNT) {\n";
           out << "        sched_error[gid] = 1u;\n";
           out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -31114,7 +33018,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "        sched_vm_ip[__gpga_vm_idx] = 0u;\n";
           out << "        return;\n";
           out << "      }\n";
-          out << "      __gpga_ip = __gpga_take ? __gpga_target : (__gpga_next_ip + 1u);\n";
+          out << "      __gpga_ip = __gpga_take ? __gpga_target : __gpga_fall_ip;\n";
           out << "      continue;\n";
           out << "    }\n";
           out << "    if (__gpga_op == GPGA_SCHED_VM_OP_CASE) {\n";
@@ -31443,7 +33347,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "      return;\n";
           }
           out << "    }\n";
-          out << "    if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE) {\n";
+          out << "    if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE ||\n";
+          out << "        __gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP) {\n";
           out << "      if (__gpga_arg >= GPGA_SCHED_EDGE_WAIT_COUNT) {\n";
           out << "        sched_error[gid] = 1u;\n";
           out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -31493,7 +33398,17 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           out << "        }\n";
           out << "      }\n";
           }
-          out << "      sched_vm_ip[__gpga_vm_idx] = __gpga_next_ip;\n";
+          out << "      uint __gpga_resume_ip = __gpga_next_ip;\n";
+          out << "      if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP) {\n";
+          out << "        if (__gpga_next_ip >= __gpga_bc_len) {\n";
+          out << "          sched_error[gid] = 1u;\n";
+          out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+          out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+          out << "          return;\n";
+          out << "        }\n";
+          out << "        __gpga_resume_ip = sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip];\n";
+          out << "      }\n";
+          out << "      sched_vm_ip[__gpga_vm_idx] = __gpga_resume_ip;\n";
           out << "      sched_state[idx] = GPGA_SCHED_PROC_BLOCKED;\n";
           out << "      return;\n";
           }
@@ -31750,22 +33665,33 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
   std::vector<PackedSignal> packed_nb_signals;
   std::unordered_set<std::string> nb_packed_names;
   bool needs_force_shadow = false;
+  const bool locality_layout =
+      pack_signals && options.locality_layout && !options.sched_vm;
   if (pack_signals) {
     packed_signals.reserve(module.ports.size() + reg_names.size() +
                            trireg_nets.size() * 2 + array_nets.size());
+    std::vector<std::string> state_names;
+    state_names.reserve(module.ports.size() + reg_names.size());
     for (const auto& port : module.ports) {
-      PackedSignal sig;
-      sig.name = MslName(port.name);
-      sig.type = TypeForWidth(port.width);
-      sig.array_size = 1;
-      packed_signals.push_back(std::move(sig));
+      state_names.push_back(port.name);
     }
-    for (const auto& reg : reg_names) {
+    state_names.insert(state_names.end(), reg_names.begin(), reg_names.end());
+    std::vector<std::string> cold_state_names;
+    if (locality_layout) {
+      StateLocalityOrder locality = OrderStateByLocality(module, state_names);
+      state_names = std::move(locality.hot);
+      cold_state_names = std::move(locality.cold);
+    }
+    auto add_state_signal = [&](const std::string& name) {
+      const Port* port = FindPort(module, name);
       PackedSignal sig;
-      sig.name = MslName(reg);
-      sig.type = TypeForWidth(SignalWidth(module, reg));
-      sig.array_size = array_size_for(reg);
+      sig.name = MslName(name);
+      sig.type = TypeForWidth(port ? port->width : SignalWidth(module, name));
+      sig.array_size = port ? 1 : array_size_for(name);
       packed_signals.push_back(std::move(sig));
+    };
+    for (const auto& name : state_names) {
+      add_state_signal(name);
     }
     for (const auto* reg : trireg_nets) {
       PackedSignal sig;
@@ -31786,23 +33712,64 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       sig.array_size = std::max(1, net->array_size);
       packed_signals.push_back(std::move(sig));
     }
-  }
-  std::vector<PackedSignal> packed_force_signals;
-  if (pack_signals) {
-    packed_force_signals.reserve(packed_signals.size());
-    for (const auto& sig : packed_signals) {
-      PackedSignal shadow = sig;
-      shadow.name = shadow_any_name(sig.name);
-      packed_force_signals.push_back(std::move(shadow));
+    for (const auto& name : cold_state_names) {
+      add_state_signal(name);
     }
   }
+  // --pack-bits: scalar 1-bit ports and regs share 64-bit bitset words
+  // placed ahead of the regular segments of each packed state buffer.
+  std::unordered_map<std::string, std::pair<uint32_t, uint32_t>>
+      packed_bit_of;
+  uint32_t packed_bit_groups = 0u;
+  if (pack_signals && options.pack_bits && !options.sched_vm) {
+    std::vector<std::string> bit_candidates;
+    bit_candidates.reserve(module.ports.size() + reg_names.size());
+    for (const auto& port : module.ports) {
+      bit_candidates.push_back(port.name);
+    }
+    bit_candidates.insert(bit_candidates.end(), reg_names.begin(),
+                          reg_names.end());
+    PackedBitLayout bit_layout =
+        BuildPackedBitLayout(module, bit_candidates, false);
+    packed_bit_groups = bit_layout.group_count;
+    for (const auto& entry : bit_layout.slots) {
+      packed_bit_of[MslName(entry.first)] = {entry.second.group,
+                                             entry.second.val_bit};
+    }
+  }
+  auto emit_packed_bit_groups = [&](const std::string& words_prefix,
+                                    const std::string& buffer,
+                                    const std::string& offset,
+                                    const std::string& count) {
+    for (uint32_t group = 0; group < packed_bit_groups; ++group) {
+      out << "  device ulong* " << words_prefix << group
+          << " = (device ulong*)(" << buffer << " + " << offset << ");\n";
+      out << "  " << offset << " += (ulong)" << count << " * 8ul;\n";
+    }
+  };
+  auto emit_packed_bit_plane = [&](const std::string& words_prefix,
+                                   const std::string& packed_name,
+                                   const std::string& decl_name) -> bool {
+    auto it = packed_bit_of.find(packed_name);
+    if (it == packed_bit_of.end()) {
+      return false;
+    }
+    out << "  GpgaBitPlane " << decl_name << " = {" << words_prefix
+        << it->second.first << ", 1ul << " << it->second.second << "u};\n";
+    return true;
+  };
   auto emit_packed_signal_setup = [&](const std::string& count_expr) {
     if (!pack_signals) {
       return;
     }
     out << "  uint __gpga_count = " << count_expr << ";\n";
     out << "  ulong __gpga_offset = 0ul;\n";
+    emit_packed_bit_groups("__gpga_bits", "gpga_state", "__gpga_offset",
+                           "__gpga_count");
     for (const auto& sig : packed_signals) {
+      if (emit_packed_bit_plane("__gpga_bits", sig.name, sig.name)) {
+        continue;
+      }
       int array_size = std::max(1, sig.array_size);
       out << "  __gpga_offset = (__gpga_offset + 7ul) & ~7ul;\n";
       out << "  device " << sig.type << "* " << sig.name
@@ -31817,7 +33784,15 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     }
     out << "  uint __gpga_nb_count = " << count_expr << ";\n";
     out << "  ulong __gpga_nb_offset = 0ul;\n";
+    emit_packed_bit_groups("__gpga_nb_bits", "nb_state", "__gpga_nb_offset",
+                           "__gpga_nb_count");
     for (const auto& sig : packed_signals) {
+      if (packed_bit_of.count(sig.name) > 0) {
+        if (nb_packed_names.count(sig.name) > 0u) {
+          emit_packed_bit_plane("__gpga_nb_bits", sig.name, "nb_" + sig.name);
+        }
+        continue;
+      }
       int array_size = std::max(1, sig.array_size);
       out << "  __gpga_nb_offset = (__gpga_nb_offset + 7ul) & ~7ul;\n";
       if (nb_packed_names.count(sig.name) > 0u) {
@@ -31835,10 +33810,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     }
     out << "  uint __gpga_force_count = " << count_expr << ";\n";
     out << "  ulong __gpga_force_offset = 0ul;\n";
-    for (const auto& sig : packed_force_signals) {
+    emit_packed_bit_groups("__gpga_force_bits", "sched_force_state",
+                           "__gpga_force_offset", "__gpga_force_count");
+    for (const auto& sig : packed_signals) {
+      std::string shadow = shadow_any_name(sig.name);
+      if (emit_packed_bit_plane("__gpga_force_bits", sig.name, shadow)) {
+        continue;
+      }
       int array_size = std::max(1, sig.array_size);
       out << "  __gpga_force_offset = (__gpga_force_offset + 7ul) & ~7ul;\n";
-      out << "  device " << sig.type << "* " << sig.name
+      out << "  device " << sig.type << "* " << shadow
           << " = (device " << sig.type
           << "*)(sched_force_state + __gpga_force_offset);\n";
       out << "  __gpga_force_offset += (ulong)__gpga_force_count * "
@@ -31880,6 +33861,135 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         return var;
       };
 
+  std::unordered_set<std::string> locals;
+  std::unordered_set<std::string> regs;
+  std::unordered_set<std::string> declared;
+  for (const auto& net : module.nets) {
+    if (net.array_size > 0) {
+      continue;
+    }
+    if (net.type == NetType::kReg || IsTriregNet(net.type) ||
+        export_wire_set.count(net.name) > 0) {
+      if (port_names.count(net.name) == 0) {
+        regs.insert(net.name);
+      }
+      continue;
+    }
+    if (port_names.count(net.name) == 0) {
+      locals.insert(net.name);
+    }
+  }
+
+  // Hierarchical codegen keeps one struct and eval function per group of
+  // matching instances. Wires written by procedural code (comb always
+  // blocks, force/release) stay flat, as do designs with switches or timing
+  // checks, whose kernels read locals outside the continuous assigns.
+  MslHierarchyPlan hier_plan;
+  bool hierarchical = false;
+  if (options.instance_groups) {
+    std::string fallback;
+    if (!module.switches.empty()) {
+      fallback = "switches are emitted flat";
+    } else if (!module.timing_checks.empty()) {
+      fallback = "timing checks are emitted flat";
+    } else {
+      std::unordered_set<std::string> procedural_targets;
+      for (const auto& block : module.always_blocks) {
+        for (const auto& stmt : block.statements) {
+          CollectAssignedSignals(stmt, &procedural_targets);
+        }
+      }
+      std::unordered_set<std::string> hier_locals;
+      for (const auto& name : locals) {
+        if (procedural_targets.count(name) == 0) {
+          hier_locals.insert(name);
+        }
+      }
+      hierarchical = PlanHierarchicalAssigns(
+          module, *options.instance_groups, hier_locals, &hier_plan);
+      if (!hierarchical) {
+        fallback = "no repeated instance bodies to share";
+      }
+    }
+    if (!hierarchical && options.hier_fallback) {
+      *options.hier_fallback = fallback;
+    }
+  }
+  // Bytes of gpga_inst_state per design instance: one 8-byte aligned
+  // segment per group holding its slots.
+  uint64_t inst_state_bytes = 0;
+  std::vector<uint64_t> inst_struct_bytes;
+  for (const auto& group : hier_plan.groups) {
+    uint64_t size = 0;
+    uint64_t align = 1;
+    for (const auto& member : group.members) {
+      const uint64_t bytes =
+          SignalWidth(module, group.prefixes.front() + member) > 32 ? 8 : 4;
+      size = (size + bytes - 1) / bytes * bytes + bytes;
+      align = std::max(align, bytes);
+    }
+    size = (size + align - 1) / align * align;
+    inst_struct_bytes.push_back(size);
+    inst_state_bytes += (size * group.prefixes.size() + 7) / 8 * 8;
+  }
+  if (hierarchical && !needs_scheduler) {
+    out << "constant constexpr uint GPGA_SCHED_INST_STATE_BYTES = "
+        << inst_state_bytes << "u;\n\n";
+    if (manifest) {
+      manifest->sched.inst_state_bytes =
+          static_cast<uint32_t>(inst_state_bytes);
+    }
+  }
+  for (size_t g = 0; g < hier_plan.groups.size(); ++g) {
+    const auto& group = hier_plan.groups[g];
+    const std::string& first_prefix = group.prefixes.front();
+    std::unordered_map<std::string, std::string> member_aliases;
+    out << "// Module " << group.module_name << ": state of "
+        << group.prefixes.size() << " instances.\n";
+    out << "struct " << group.struct_name << " {\n";
+    for (const auto& member : group.members) {
+      std::string type =
+          TypeForWidth(SignalWidth(module, first_prefix + member));
+      out << "  " << type << " " << MslName(member) << ";\n";
+      member_aliases[first_prefix + member] = "s." + MslName(member);
+    }
+    out << "};\n";
+    out << "static_assert(sizeof(" << group.struct_name
+        << ") == " << inst_struct_bytes[g]
+        << ", \"GPGA_SCHED_INST_STATE_BYTES layout\");\n\n";
+    out << "inline void " << group.eval_name << "(device "
+        << group.struct_name << "& s) {\n";
+    g_msl_local_aliases = &member_aliases;
+    for (size_t index : group.body) {
+      const Assign& assign = module.assigns[index];
+      out << "  " << MslLocalName(assign.lhs) << " = "
+          << EmitExprSized(*assign.rhs, SignalWidth(module, assign.lhs),
+                           module, locals, regs)
+          << ";\n";
+    }
+    g_msl_local_aliases = nullptr;
+    out << "}\n\n";
+  }
+  // Points each group's slot array at this design instance's part of
+  // gpga_inst_state.
+  auto emit_inst_state_setup = [&](const std::string& count_expr,
+                                   const std::string& pad) {
+    if (!hierarchical) {
+      return;
+    }
+    out << pad << "ulong __gpga_inst_offset = 0ul;\n";
+    for (const auto& group : hier_plan.groups) {
+      const size_t slots = group.prefixes.size();
+      out << pad << "device " << group.struct_name << "* "
+          << group.array_name << " = ((device " << group.struct_name
+          << "*)(gpga_inst_state + __gpga_inst_offset)) + (ulong)gid * "
+          << slots << "u;\n";
+      out << pad << "__gpga_inst_offset += ((ulong)" << count_expr << " * "
+          << slots << "u * (ulong)sizeof(" << group.struct_name
+          << ") + 7ul) & ~7ul;\n";
+    }
+  };
+
   out << "kernel void gpga_" << MslName(module.name) << "(";
   int buffer_index = 0;
   bool first = true;
@@ -31933,6 +34043,14 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           << buffer_index++ << ")]]";
     }
   }
+  if (hierarchical) {
+    if (!first) {
+      out << ",\n";
+    }
+    first = false;
+    out << "  device uchar* gpga_inst_state [[buffer(" << buffer_index++
+        << ")]]";
+  }
   if (!first) {
     out << ",\n";
   }
@@ -31946,23 +34064,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     emit_packed_signal_setup("params.count");
   }
 
-  std::unordered_set<std::string> locals;
-  std::unordered_set<std::string> regs;
-  std::unordered_set<std::string> declared;
-  for (const auto& net : module.nets) {
-    if (net.array_size > 0) {
-      continue;
-    }
-    if (net.type == NetType::kReg || IsTriregNet(net.type) ||
-        export_wire_set.count(net.name) > 0) {
-      if (port_names.count(net.name) == 0) {
-        regs.insert(net.name);
-      }
-      continue;
-    }
-    if (port_names.count(net.name) == 0) {
-      locals.insert(net.name);
+  if (hierarchical) {
+    emit_inst_state_setup("params.count", "  ");
+    for (const auto& entry : hier_plan.aliases) {
+      declared.insert(entry.first);
     }
+    g_msl_local_aliases = &hier_plan.aliases;
   }
 
   std::unordered_set<std::string> timing_check_locals;
@@ -32011,7 +34118,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     }
   }
 
-  std::vector<size_t> ordered_assigns = OrderAssigns(module);
+  std::vector<size_t> ordered_assigns =
+      hierarchical ? hier_plan.order : OrderAssigns(module);
   std::unordered_map<std::string, std::vector<size_t>> assign_groups;
   assign_groups.reserve(module.assigns.size());
   for (size_t i = 0; i < module.assigns.size(); ++i) {
@@ -32412,6 +34520,27 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           }
         }
         for (size_t index : ordered_assigns) {
+          if (hier_plan.folded.count(index) > 0) {
+            continue;
+          }
+          auto call = hier_plan.calls.find(index);
+          if (call != hier_plan.calls.end()) {
+            const MslInstanceCall& run = call->second;
+            const auto& group = hier_plan.groups[run.group];
+            if (run.slot_end - run.slot_begin == 1) {
+              out << "  " << group.eval_name << "(" << group.array_name
+                  << "[" << run.slot_begin << "]);\n";
+              continue;
+            }
+            out << "  #pragma clang loop unroll(disable)\n";
+            out << "  for (uint __gpga_slot = " << run.slot_begin
+                << "u; __gpga_slot < " << run.slot_end
+                << "u; ++__gpga_slot) {\n";
+            out << "    " << group.eval_name << "(" << group.array_name
+                << "[__gpga_slot]);\n";
+            out << "  }\n";
+            continue;
+          }
           const auto& assign = module.assigns[index];
           if (!assign.rhs) {
             continue;
@@ -32454,7 +34583,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                   << sized << ";\n";
               declared_ctx->insert(assign.lhs);
             } else {
-              out << "  " << MslName(assign.lhs) << " = " << sized << ";\n";
+              out << "  " << MslLocalName(assign.lhs) << " = " << sized << ";\n";
             }
           } else {
             out << "  // Unmapped assign: " << assign.lhs << " = " << expr
@@ -32732,15 +34861,27 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         }
         return;
       }
+      std::string case_hit =
+          "__gpga_case_hit" + std::to_string(case_temp_index++);
+      if (!EmitCaseTableHit(out, stmt, module, case_value, "", case_hit,
+                            indent)) {
+        case_hit.clear();
+      }
       bool first = true;
-      for (const auto& item : stmt.case_items) {
+      for (size_t item_index = 0; item_index < stmt.case_items.size();
+           ++item_index) {
+        const auto& item = stmt.case_items[item_index];
         std::string cond;
-        for (const auto& label : item.labels) {
-          std::string piece = emit_case_cond(case_value, case_width, *label);
-          if (!cond.empty()) {
-            cond += " || ";
+        if (!case_hit.empty()) {
+          cond = CaseTableItemCond(case_hit, item_index, "");
+        } else {
+          for (const auto& label : item.labels) {
+            std::string piece = emit_case_cond(case_value, case_width, *label);
+            if (!cond.empty()) {
+              cond += " || ";
+            }
+            cond += piece;
           }
-          cond += piece;
         }
         if (cond.empty()) {
           continue;
@@ -32899,6 +35040,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     out << "    " << b_drive << " = " << m_drive << ";\n";
     out << "  }\n";
   }
+  g_msl_local_aliases = nullptr;
   out << "}\n";
 
   std::function<void(int)> emit_force_overrides;
@@ -32924,6 +35066,13 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       comb_declared.insert(timing_check_locals.begin(),
                            timing_check_locals.end());
     }
+    if (hierarchical) {
+      emit_inst_state_setup("sched.count", pad + "  ");
+      for (const auto& entry : hier_plan.aliases) {
+        comb_declared.insert(entry.first);
+      }
+      g_msl_local_aliases = &hier_plan.aliases;
+    }
     emit_continuous_assigns(locals, regs, &comb_declared);
 
     for (const auto& name : switch_nets) {
@@ -33062,6 +35211,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
     if (emit_force_overrides) {
       emit_force_overrides(indent + 2);
     }
+    g_msl_local_aliases = nullptr;
     out << pad << "}\n";
   };
 
@@ -33687,16 +35837,28 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           }
           return;
         }
+        std::string case_hit =
+            "__gpga_case_hit" + std::to_string(case_temp_index++);
+        if (!EmitCaseTableHit(out, stmt, module, case_value, "", case_hit,
+                              indent)) {
+          case_hit.clear();
+        }
         bool first = true;
-        for (const auto& item : stmt.case_items) {
+        for (size_t item_index = 0; item_index < stmt.case_items.size();
+             ++item_index) {
+          const auto& item = stmt.case_items[item_index];
           std::string cond;
-          for (const auto& label : item.labels) {
-            std::string piece =
-                emit_case_cond_tick(case_value, case_width, *label);
-            if (!cond.empty()) {
-              cond += " || ";
+          if (!case_hit.empty()) {
+            cond = CaseTableItemCond(case_hit, item_index, "");
+          } else {
+            for (const auto& label : item.labels) {
+              std::string piece =
+                  emit_case_cond_tick(case_value, case_width, *label);
+              if (!cond.empty()) {
+                cond += " || ";
+              }
+              cond += piece;
             }
-            cond += piece;
           }
           if (cond.empty()) {
             continue;
@@ -35068,8 +37230,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       uint32_t vm_service_assign_count = 0u;
       uint32_t vm_service_arg_count = 0u;
       uint32_t vm_words_per_proc = kSchedulerVmWordsPerProc;
+      uint32_t vm_bytecode_words =
+          static_cast<uint32_t>(procs.size()) * kSchedulerVmWordsPerProc;
       uint32_t vm_expr_word_count = 0u;
       uint32_t vm_expr_imm_word_count = 0u;
+      uint32_t vm_expr_reg_count = 0u;
       uint32_t vm_signal_count = 0u;
       bool vm_needs_call_group = false;
       if (options.sched_vm) {
@@ -35096,6 +37261,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           if (BuildSchedulerVmLayoutFromModule(
                   module, &vm_layout, nullptr, options.four_state)) {
             vm_words_per_proc = vm_layout.words_per_proc;
+            vm_bytecode_words =
+                static_cast<uint32_t>(vm_layout.bytecode.size());
             vm_case_header_count =
                 static_cast<uint32_t>(vm_layout.case_headers.size());
             vm_case_entry_count =
@@ -35111,6 +37278,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
                 static_cast<uint32_t>(vm_layout.expr_table.words.size());
             vm_expr_imm_word_count =
                 static_cast<uint32_t>(vm_layout.expr_table.imm_words.size());
+            vm_expr_reg_count = vm_layout.expr_table.reg_count;
             vm_signal_count =
               static_cast<uint32_t>(vm_layout.signal_entries.size());
           vm_service_arg_count =
@@ -35133,8 +37301,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         vm_service_assign_count = 0u;
         vm_service_arg_count = 0u;
         vm_words_per_proc = kSchedulerVmWordsPerProc;
+        vm_bytecode_words =
+            static_cast<uint32_t>(procs.size()) * kSchedulerVmWordsPerProc;
         vm_expr_word_count = 0u;
         vm_expr_imm_word_count = 0u;
+        vm_expr_reg_count = 0u;
         vm_signal_count = 0u;
       }
       if (options.sched_vm) {
@@ -35333,8 +37504,49 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         vm_service_arg_count = 0u;
         vm_expr_word_count = 0u;
         vm_expr_imm_word_count = 0u;
+        vm_expr_reg_count = 0u;
         vm_signal_count = 0u;
       }
+      if (manifest) {
+        SchedulerConstants sched = MakeManifestConstants(
+            static_cast<uint32_t>(procs.size()),
+            static_cast<uint32_t>(module.events.size()),
+            static_cast<uint32_t>(edge_item_count),
+            static_cast<uint32_t>(edge_star_count), repeat_count, delay_count,
+            max_dnba, monitor_count, monitor_max_args, strobe_count,
+            service_max_args, service_wide_words_local, string_count,
+            static_cast<uint32_t>(force_target_list.size()),
+            static_cast<uint32_t>(passign_target_list.size()),
+            timing_check_count);
+        sched.packed_bit_groups = packed_bit_groups;
+        sched.locality_layout = locality_layout;
+        sched.inst_state_bytes = static_cast<uint32_t>(inst_state_bytes);
+        if (options.sched_vm) {
+          sched.vm_enabled = true;
+          sched.vm_bytecode_words = vm_bytecode_words;
+          sched.vm_cond_count = vm_cond_count;
+          sched.vm_assign_count = vm_assign_count;
+          sched.vm_force_count = vm_force_count;
+          sched.vm_release_count = vm_release_count;
+          sched.vm_service_call_count = vm_service_call_count;
+          sched.vm_service_assign_count = vm_service_assign_count;
+          sched.vm_service_arg_count = vm_service_arg_count;
+          sched.vm_call_frame_words = kSchedulerVmCallFrameWords;
+          sched.vm_call_frame_depth = kSchedulerVmCallFrameDepth;
+          sched.vm_case_header_count = vm_case_header_count;
+          sched.vm_case_entry_count = vm_case_entry_count;
+          sched.vm_case_word_count = vm_case_word_count;
+          sched.vm_expr_word_count = vm_expr_word_count;
+          sched.vm_expr_imm_word_count = vm_expr_imm_word_count;
+          sched.vm_signal_count = vm_signal_count;
+        }
+        manifest->sched = sched;
+        manifest->has_vm_layout =
+            options.sched_vm && !vm_layout.bytecode.empty();
+        if (manifest->has_vm_layout) {
+          manifest->vm_layout = vm_layout;
+        }
+      }
       out << "GPGA_SCHED_DEFINE_CONSTANTS(" << procs.size() << "u, "
           << root_proc_count << "u, " << module.events.size() << "u, "
           << edge_item_count << "u, " << edge_star_count << "u, "
@@ -35351,12 +37563,23 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           << sched_proc_group_size << "u;\n";
       out << "constant constexpr uint GPGA_SCHED_PROC_GROUP_COUNT = "
           << sched_proc_group_count << "u;\n";
+      if (packed_bit_groups > 0u) {
+        out << "constant constexpr uint GPGA_SCHED_PACKED_BIT_GROUPS = "
+            << packed_bit_groups << "u;\n";
+      }
+      if (locality_layout) {
+        out << "constant constexpr uint GPGA_SCHED_LOCALITY_LAYOUT = 1u;\n";
+      }
+      if (hierarchical) {
+        out << "constant constexpr uint GPGA_SCHED_INST_STATE_BYTES = "
+            << inst_state_bytes << "u;\n";
+      }
       if (options.sched_vm) {
         out << "constant constexpr uint GPGA_SCHED_VM_ENABLED = 1u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_WORDS_PER_PROC = "
             << vm_words_per_proc << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_BYTECODE_WORDS = "
-               "GPGA_SCHED_PROC_COUNT * GPGA_SCHED_VM_WORDS_PER_PROC;\n";
+            << vm_bytecode_words << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_COND_COUNT = "
             << vm_cond_count << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_ASSIGN_COUNT = "
@@ -35399,6 +37622,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << static_cast<uint32_t>(SchedulerVmCondKind::kExpr) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_STACK_MAX = "
             << kSchedulerVmExprStackMax << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_EXPR_REG_COUNT = "
+            << vm_expr_reg_count << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_WIDE_WORDS = "
             << vm_expr_wide_words << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_WIDE_BITS = "
@@ -35423,6 +37648,10 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << static_cast<uint32_t>(SchedulerVmExprOp::kIndex) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_CALL = "
             << static_cast<uint32_t>(SchedulerVmExprOp::kCall) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_LOAD_REG = "
+            << static_cast<uint32_t>(SchedulerVmExprOp::kLoadReg) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_EXPR_OP_STORE_REG = "
+            << static_cast<uint32_t>(SchedulerVmExprOp::kStoreReg) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_UNARY_PLUS = "
             << static_cast<uint32_t>(SchedulerVmExprUnaryOp::kPlus) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_UNARY_MINUS = "
@@ -35511,6 +37740,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kDiv) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_MOD = "
             << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kMod) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_POW = "
+            << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kPow) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_SHL = "
             << static_cast<uint32_t>(SchedulerVmExprBinaryOp::kShl) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_EXPR_BINARY_SHR = "
@@ -35553,6 +37784,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << static_cast<uint32_t>(SchedulerVmCaseKind::kCaseX) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_CASE_KIND_CASEZ = "
             << static_cast<uint32_t>(SchedulerVmCaseKind::kCaseZ) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_CASE_STRATEGY_LINEAR = "
+            << static_cast<uint32_t>(SchedulerVmCaseStrategy::kLinear) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_CASE_STRATEGY_LUT = "
+            << static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut) << "u;\n";
+        out << "constant constexpr ulong GPGA_SCHED_VM_CASE_HASH_MUL = "
+            << kSchedulerVmCaseHashMul << "ul;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_OP_DONE = "
             << static_cast<uint32_t>(SchedulerVmOp::kDone) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_OP_CALL_GROUP = "
@@ -35609,6 +37846,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
             << static_cast<uint32_t>(SchedulerVmOp::kRet) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_OP_HALT_SIM = "
             << static_cast<uint32_t>(SchedulerVmOp::kHaltSim) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_OP_ASSIGN_RUN = "
+            << static_cast<uint32_t>(SchedulerVmOp::kAssignRun) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_OP_BRANCH = "
+            << static_cast<uint32_t>(SchedulerVmOp::kBranch) << "u;\n";
+        out << "constant constexpr uint GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP = "
+            << static_cast<uint32_t>(SchedulerVmOp::kWaitEdgeLoop) << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_OP_MASK = "
             << kSchedulerVmOpMask << "u;\n";
         out << "constant constexpr uint GPGA_SCHED_VM_OP_SHIFT = "
@@ -35983,6 +38226,10 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
           emit_param_fn("  device uchar* gpga_state [[buffer(" +
                         std::to_string(buffer_index++) + ")]]");
         }
+        if (hierarchical) {
+          emit_param_fn("  device uchar* gpga_inst_state [[buffer(" +
+                        std::to_string(buffer_index++) + ")]]");
+        }
         if (!pack_signals) {
           for (const auto& port : module.ports) {
             std::string qualifier =
@@ -39181,24 +41428,36 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
               EmitExpr(*stmt.case_expr, module, locals_override, sched_regs);
           int case_width = ExprWidth(*stmt.case_expr, module);
           case_value = maybe_hoist_case_value(case_value, case_width, indent);
+          std::string case_hit =
+              "__gpga_case_hit" + std::to_string(case_temp_index++);
+          if (!EmitCaseTableHit(out, stmt, module, case_value, "", case_hit,
+                                indent)) {
+            case_hit.clear();
+          }
           bool first = true;
-          for (const auto& item : stmt.case_items) {
-            if (StatementListIsEmpty(item.body)) {
+          for (size_t item_index = 0; item_index < stmt.case_items.size();
+               ++item_index) {
+            const auto& item = stmt.case_items[item_index];
+            if (case_hit.empty() && StatementListIsEmpty(item.body)) {
               continue;
             }
             std::string cond;
-            for (const auto& label : item.labels) {
-              int label_width = ExprWidth(*label, module);
-              int target = std::max(case_width, label_width);
-              std::string lhs = ExtendExpr(case_value, case_width, target);
-              std::string rhs = EmitExpr(*label, module, locals_override,
-                                         sched_regs);
-              std::string rhs_ext = ExtendExpr(rhs, label_width, target);
-              std::string piece = "(" + lhs + " == " + rhs_ext + ")";
-              if (!cond.empty()) {
-                cond += " || ";
+            if (!case_hit.empty()) {
+              cond = CaseTableItemCond(case_hit, item_index, "");
+            } else {
+              for (const auto& label : item.labels) {
+                int label_width = ExprWidth(*label, module);
+                int target = std::max(case_width, label_width);
+                std::string lhs = ExtendExpr(case_value, case_width, target);
+                std::string rhs = EmitExpr(*label, module, locals_override,
+                                           sched_regs);
+                std::string rhs_ext = ExtendExpr(rhs, label_width, target);
+                std::string piece = "(" + lhs + " == " + rhs_ext + ")";
+                if (!cond.empty()) {
+                  cond += " || ";
+                }
+                cond += piece;
               }
-              cond += piece;
             }
             if (cond.empty()) {
               continue;
@@ -41701,6 +43960,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         out << "      thread GpgaWide" << vm_expr_wide_bits
             << " __gpga_wide_vals[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
       }
+      if (vm_expr_reg_count > 0u) {
+        EmitSchedulerVmExprRegDecls(
+            out,
+            MakeSchedulerVmExprSlotArrays(false, true, vm_expr_wide_bits),
+            6);
+      }
       out << "      while (__gpga_expr_ok) {\n";
       out << "        uint __gpga_instr = sched_vm_expr[__gpga_ip++];\n";
       out << "        uint __gpga_op = (__gpga_instr & 0xFFu);\n";
@@ -41924,17 +44189,18 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "            uint __gpga_width = sched_vm_expr[__gpga_ip++];\n";
       out << "            const GpgaSchedVmSignalEntry __gpga_sig =\n";
       out << "                sched_vm_signal_entry[__gpga_arg];\n";
-      out << "            if ((__gpga_sig.flags & GPGA_SCHED_VM_SIGNAL_FLAG_REAL) != 0u ||\n";
-      out << "                __gpga_sig.array_size <= 1u) {\n";
-      out << "              __gpga_expr_ok = false;\n";
-      out << "              break;\n";
-      out << "            }\n";
-      out << "            if (__gpga_is_real[__gpga_sp - 1u]) {\n";
+      out << "            if (__gpga_sig.array_size <= 1u) {\n";
       out << "              __gpga_expr_ok = false;\n";
       out << "              break;\n";
       out << "            }\n";
+      out << "            bool __gpga_elem_real =\n";
+      out << "                ((__gpga_sig.flags & GPGA_SCHED_VM_SIGNAL_FLAG_REAL) != 0u);\n";
       out << "            uint __gpga_idx_width = __gpga_widths[__gpga_sp - 1u];\n";
       out << "            ulong __gpga_idx_val = __gpga_vals[__gpga_sp - 1u];\n";
+      out << "            if (__gpga_is_real[__gpga_sp - 1u]) {\n";
+      out << "              __gpga_idx_val = (ulong)gpga_double_to_s64(__gpga_idx_val);\n";
+      out << "              __gpga_idx_width = 64u;\n";
+      out << "            }\n";
       if (vm_expr_wide_bits > 64u) {
         out << "            if (__gpga_idx_width > 64u) {\n";
         out << "              GpgaWide" << vm_expr_wide_bits
@@ -41963,10 +44229,19 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       }
       out << "              __gpga_vals[__gpga_sp - 1u] = 0ul;\n";
       out << "              __gpga_widths[__gpga_sp - 1u] = __gpga_width;\n";
-      out << "              __gpga_is_real[__gpga_sp - 1u] = false;\n";
+      out << "              __gpga_is_real[__gpga_sp - 1u] = __gpga_elem_real;\n";
+      out << "              break;\n";
+      out << "            }\n";
+      out << "            __gpga_is_real[__gpga_sp - 1u] = __gpga_elem_real;\n";
+      out << "            if (__gpga_elem_real) {\n";
+      out << "              ulong __gpga_base = (ulong)gid * (ulong)__gpga_sig.array_size;\n";
+      out << "              ulong __gpga_val_addr = (ulong)__gpga_sig.val_offset +\n";
+      out << "                  (__gpga_base + __gpga_idx_val) * 8ul;\n";
+      out << "              __gpga_vals[__gpga_sp - 1u] = gpga_sched_vm_load_word(\n";
+      out << "                  gpga_state, __gpga_val_addr, 64u);\n";
+      out << "              __gpga_widths[__gpga_sp - 1u] = 64u;\n";
       out << "              break;\n";
       out << "            }\n";
-      out << "            __gpga_is_real[__gpga_sp - 1u] = false;\n";
       if (vm_expr_wide_bits > 64u) {
         out << "            if (__gpga_width > 64u) {\n";
         out << "              uint __gpga_words = (__gpga_width + 63u) >> 6u;\n";
@@ -42938,7 +45213,11 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "                       __gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_SHR ||\n";
       out << "                       __gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_ASHR) {\n";
       out << "              uint __gpga_shift = uint(__gpga_rhs);\n";
-      out << "              if (__gpga_shift >= __gpga_lhs_width) {\n";
+      out << "              if (__gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_SHL) {\n";
+      out << "                __gpga_result = (__gpga_shift >= __gpga_width)\n";
+      out << "                    ? 0ul\n";
+      out << "                    : (__gpga_lhs << __gpga_shift);\n";
+      out << "              } else if (__gpga_shift >= __gpga_lhs_width) {\n";
       out << "                if (__gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_ASHR &&\n";
       out << "                    __gpga_lhs_width > 0u && __gpga_signed) {\n";
       out << "                  ulong __gpga_sign = 1ul << (__gpga_lhs_width - 1u);\n";
@@ -42946,8 +45225,6 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "                } else {\n";
       out << "                  __gpga_result = 0ul;\n";
       out << "                }\n";
-      out << "              } else if (__gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_SHL) {\n";
-      out << "                __gpga_result = __gpga_lhs << __gpga_shift;\n";
       out << "              } else if (__gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_SHR) {\n";
       out << "                __gpga_result = __gpga_lhs >> __gpga_shift;\n";
       out << "              } else {\n";
@@ -43014,6 +45291,13 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "                  __gpga_result = (__gpga_rhs == 0ul) ? 0ul : (__gpga_lhs % __gpga_rhs);\n";
       out << "                }\n";
       out << "              }\n";
+      if (ModuleUsesPower(module)) {
+        out << "            } else if (__gpga_bop == GPGA_SCHED_VM_EXPR_BINARY_POW) {\n";
+        out << "              __gpga_result = __gpga_signed\n";
+        out << "                  ? gpga_pow_s64(gpga_sched_vm_sign64(__gpga_lhs, __gpga_lhs_width),\n";
+        out << "                                 gpga_sched_vm_sign64(__gpga_rhs, __gpga_rhs_width))\n";
+        out << "                  : gpga_pow_u64(__gpga_lhs, __gpga_rhs);\n";
+      }
       out << "            } else {\n";
       out << "              __gpga_expr_ok = false;\n";
       out << "            }\n";
@@ -43034,17 +45318,71 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "              break;\n";
       out << "            }\n";
       out << "            uint __gpga_width = sched_vm_expr[__gpga_ip++];\n";
-      out << "            ulong __gpga_else = __gpga_vals[__gpga_sp - 1u];\n";
-      out << "            ulong __gpga_then = __gpga_vals[__gpga_sp - 2u];\n";
       out << "            ulong __gpga_cond = __gpga_vals[__gpga_sp - 3u];\n";
       out << "            uint __gpga_cond_width = __gpga_widths[__gpga_sp - 3u];\n";
-      out << "            ulong __gpga_cond_mask = (__gpga_cond_width >= 64u)\n";
-      out << "                ? ~0ul\n";
-      out << "                : ((__gpga_cond_width == 0u)\n";
-      out << "                       ? 0ul\n";
-      out << "                       : ((1ul << __gpga_cond_width) - 1ul));\n";
-      out << "            bool __gpga_true = ((__gpga_cond & __gpga_cond_mask) != 0ul);\n";
-      out << "            ulong __gpga_val = __gpga_true ? __gpga_then : __gpga_else;\n";
+      out << "            bool __gpga_true = false;\n";
+      out << "            if (__gpga_is_real[__gpga_sp - 3u]) {\n";
+      out << "              __gpga_true = !gpga_double_is_zero(__gpga_cond);\n";
+      out << "            } else if (__gpga_cond_width > 64u) {\n";
+      if (vm_expr_wide_bits > 64u) {
+        out << "              __gpga_true = gpga_sched_vm_wide_any_masked(\n";
+        out << "                  __gpga_wide_vals[__gpga_sp - 3u], __gpga_cond_width);\n";
+      } else {
+        out << "              __gpga_expr_ok = false;\n";
+        out << "              break;\n";
+      }
+      out << "            } else {\n";
+      out << "              ulong __gpga_cond_mask = (__gpga_cond_width >= 64u)\n";
+      out << "                  ? ~0ul\n";
+      out << "                  : ((__gpga_cond_width == 0u)\n";
+      out << "                         ? 0ul\n";
+      out << "                         : ((1ul << __gpga_cond_width) - 1ul));\n";
+      out << "              __gpga_true = ((__gpga_cond & __gpga_cond_mask) != 0ul);\n";
+      out << "            }\n";
+      out << "            uint __gpga_src = __gpga_true ? (__gpga_sp - 2u) : (__gpga_sp - 1u);\n";
+      out << "            ulong __gpga_val = __gpga_vals[__gpga_src];\n";
+      out << "            uint __gpga_src_width = __gpga_widths[__gpga_src];\n";
+      out << "            if (__gpga_is_real[__gpga_sp - 2u] || __gpga_is_real[__gpga_sp - 1u]) {\n";
+      out << "              if (!__gpga_is_real[__gpga_src]) {\n";
+      out << "                if (__gpga_src_width > 64u) {\n";
+      if (vm_expr_wide_bits > 64u) {
+        out << "                  __gpga_val = gpga_wide_to_u64_" << vm_expr_wide_bits
+            << "(gpga_sched_vm_wide_mask_value(\n";
+        out << "                      __gpga_wide_vals[__gpga_src], __gpga_src_width));\n";
+      } else {
+        out << "                  __gpga_expr_ok = false;\n";
+        out << "                  break;\n";
+      }
+      out << "                } else if (__gpga_src_width < 64u) {\n";
+      out << "                  __gpga_val &= (__gpga_src_width == 0u)\n";
+      out << "                      ? 0ul\n";
+      out << "                      : ((1ul << __gpga_src_width) - 1ul);\n";
+      out << "                }\n";
+      out << "                __gpga_val = gpga_double_from_u64(__gpga_val);\n";
+      out << "              }\n";
+      out << "              __gpga_vals[__gpga_sp - 3u] = __gpga_val;\n";
+      out << "              __gpga_widths[__gpga_sp - 3u] = 64u;\n";
+      out << "              __gpga_is_real[__gpga_sp - 3u] = true;\n";
+      out << "              __gpga_sp -= 2u;\n";
+      out << "              break;\n";
+      out << "            }\n";
+      if (vm_expr_wide_bits > 64u) {
+        out << "            if (__gpga_width > 64u) {\n";
+        out << "              GpgaWide" << vm_expr_wide_bits
+            << " __gpga_wide_val = (__gpga_src_width > 64u)\n";
+        out << "                  ? __gpga_wide_vals[__gpga_src]\n";
+        out << "                  : gpga_wide_from_u64_" << vm_expr_wide_bits
+            << "(__gpga_val);\n";
+        out << "              __gpga_wide_val = gpga_sched_vm_wide_mask_value(\n";
+        out << "                  __gpga_wide_val, __gpga_width);\n";
+        out << "              __gpga_wide_vals[__gpga_sp - 3u] = __gpga_wide_val;\n";
+        out << "              __gpga_vals[__gpga_sp - 3u] = __gpga_wide_val.w[0];\n";
+        out << "              __gpga_widths[__gpga_sp - 3u] = __gpga_width;\n";
+        out << "              __gpga_is_real[__gpga_sp - 3u] = false;\n";
+        out << "              __gpga_sp -= 2u;\n";
+        out << "              break;\n";
+        out << "            }\n";
+      }
       out << "            ulong __gpga_out_mask = (__gpga_width >= 64u)\n";
       out << "                ? ~0ul\n";
       out << "                : ((__gpga_width == 0u)\n";
@@ -43052,9 +45390,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "                       : ((1ul << __gpga_width) - 1ul));\n";
       out << "            __gpga_vals[__gpga_sp - 3u] = __gpga_val & __gpga_out_mask;\n";
       out << "            __gpga_widths[__gpga_sp - 3u] = __gpga_width;\n";
+      out << "            __gpga_is_real[__gpga_sp - 3u] = false;\n";
       out << "            __gpga_sp -= 2u;\n";
       out << "            break;\n";
       out << "          }\n";
+      if (vm_expr_reg_count > 0u) {
+        EmitSchedulerVmExprRegCases(
+            out,
+            MakeSchedulerVmExprSlotArrays(false, true, vm_expr_wide_bits),
+            10);
+      }
       out << "          default: {\n";
       out << "            __gpga_expr_ok = false;\n";
       out << "            break;\n";
@@ -43113,6 +45458,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         out << "  thread GpgaWide" << vm_expr_wide_bits
             << " __gpga_wide_vals[GPGA_SCHED_VM_EXPR_STACK_MAX];\n";
       }
+      if (vm_expr_reg_count > 0u) {
+        EmitSchedulerVmExprRegDecls(
+            out,
+            MakeSchedulerVmExprSlotArrays(false, true, vm_expr_wide_bits),
+            2);
+      }
       out << "  while (__gpga_expr_ok) {\n";
       out << "    uint __gpga_instr = sched_vm_expr[__gpga_ip++];\n";
       out << "    uint __gpga_op = (__gpga_instr & 0xFFu);\n";
@@ -44365,6 +46716,12 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "        __gpga_sp -= 2u;\n";
       out << "        break;\n";
       out << "      }\n";
+      if (vm_expr_reg_count > 0u) {
+        EmitSchedulerVmExprRegCases(
+            out,
+            MakeSchedulerVmExprSlotArrays(false, true, vm_expr_wide_bits),
+            6);
+      }
       out << "      default: {\n";
       out << "        __gpga_expr_ok = false;\n";
       out << "        break;\n";
@@ -44557,9 +46914,6 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "  }\n";
       out << "  const GpgaSchedVmSignalEntry __gpga_sig =\n";
       out << "      sched_vm_signal_entry[__gpga_entry.signal_id];\n";
-      out << "  if ((__gpga_sig.flags & GPGA_SCHED_VM_SIGNAL_FLAG_REAL) != 0u) {\n";
-      out << "    return false;\n";
-      out << "  }\n";
       if (pack_nb && !packed_nb_signals.empty()) {
         out << "  device uchar* __gpga_state = use_nb ? nb_state : gpga_state;\n";
       } else {
@@ -44698,6 +47052,44 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "             : ((1ul << __gpga_header.width) - 1ul));\n";
       out << "  __gpga_case_val &= __gpga_mask;\n";
       out << "  __gpga_case_xz &= __gpga_mask;\n";
+      out << "  if (__gpga_header.strategy != GPGA_SCHED_VM_CASE_STRATEGY_LINEAR &&\n";
+      out << "      __gpga_case_xz == 0ul) {\n";
+      out << "    const uint __gpga_table = __gpga_header.table_offset;\n";
+      out << "    if (__gpga_header.strategy == GPGA_SCHED_VM_CASE_STRATEGY_LUT) {\n";
+      out << "      ulong __gpga_pair = sched_vm_case_words[__gpga_table + uint(__gpga_case_val >> 1ul)];\n";
+      out << "      return uint(__gpga_pair >> ((__gpga_case_val & 1ul) * 32ul));\n";
+      out << "    }\n";
+      out << "    uint __gpga_slot = uint((__gpga_case_val * GPGA_SCHED_VM_CASE_HASH_MUL) >> 32ul) &\n";
+      out << "        __gpga_header.table_mask;\n";
+      out << "    #pragma clang loop unroll(disable)\n";
+      out << "    for (uint __gpga_probe = 0u; __gpga_probe <= __gpga_header.table_mask; ++__gpga_probe) {\n";
+      out << "      uint __gpga_target = uint(sched_vm_case_words[__gpga_table + __gpga_slot * 2u + 1u]);\n";
+      out << "      if (__gpga_target == 0xFFFFFFFFu) {\n";
+      out << "        break;\n";
+      out << "      }\n";
+      out << "      if (sched_vm_case_words[__gpga_table + __gpga_slot * 2u] == __gpga_case_val) {\n";
+      out << "        __gpga_match = __gpga_target;\n";
+      out << "        break;\n";
+      out << "      }\n";
+      out << "      __gpga_slot = (__gpga_slot + 1u) & __gpga_header.table_mask;\n";
+      out << "    }\n";
+      out << "    const uint __gpga_wild = __gpga_table + (__gpga_header.table_mask + 1u) * 2u;\n";
+      out << "    #pragma clang loop unroll(disable)\n";
+      out << "    for (uint __gpga_w = 0u; __gpga_w < __gpga_header.wild_count; ++__gpga_w) {\n";
+      out << "      const GpgaSchedVmCaseEntry __gpga_entry_rec = sched_vm_case_entry[\n";
+      out << "          __gpga_header.entry_offset + uint(sched_vm_case_words[__gpga_wild + __gpga_w])];\n";
+      out << "      if (__gpga_entry_rec.target >= __gpga_match) {\n";
+      out << "        break;\n";
+      out << "      }\n";
+      out << "      ulong __gpga_want = sched_vm_case_words[__gpga_entry_rec.want_offset];\n";
+      out << "      ulong __gpga_aux = sched_vm_case_words[__gpga_entry_rec.care_offset];\n";
+      out << "      if (((__gpga_case_val ^ __gpga_want) & ~__gpga_aux) == 0ul) {\n";
+      out << "        __gpga_match = __gpga_entry_rec.target;\n";
+      out << "        break;\n";
+      out << "      }\n";
+      out << "    }\n";
+      out << "    return __gpga_match;\n";
+      out << "  }\n";
       out << "  #pragma clang loop unroll(disable)\n";
       out << "  for (uint __gpga_entry = 0u; __gpga_entry < __gpga_header.entry_count; ++__gpga_entry) {\n";
       out << "    const GpgaSchedVmCaseEntry __gpga_entry_rec = "
@@ -44730,6 +47122,128 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "  return __gpga_match;\n";
       out << "}\n";
     }
+    if (options.sched_vm && vm_expr_wide_bits > 64u) {
+      const std::string wide_bits = std::to_string(vm_expr_wide_bits);
+      out << "static __attribute__((noinline)) bool gpga_"
+          << MslName(module.name) << "_sched_vm_apply_assign_wide(";
+      emit_sched_param_decls(2);
+      out << ",\n  uint pid,\n  uint assign_id,\n  GpgaWide" << wide_bits
+          << " val,\n  uint idx_val,\n  bool use_nb) {\n";
+      out << "  const GpgaSchedVmAssignEntry __gpga_entry =\n";
+      out << "      sched_vm_assign_entry[assign_id];\n";
+      out << "  const GpgaSchedVmSignalEntry __gpga_sig =\n";
+      out << "      sched_vm_signal_entry[__gpga_entry.signal_id];\n";
+      if (pack_nb && !packed_nb_signals.empty()) {
+        out << "  device uchar* __gpga_state = use_nb ? nb_state : gpga_state;\n";
+      } else {
+        out << "  (void)use_nb;\n";
+        out << "  device uchar* __gpga_state = gpga_state;\n";
+      }
+      out << "  uint __gpga_storage_width = __gpga_sig.width;\n";
+      out << "  if (__gpga_storage_width <= 64u ||\n";
+      out << "      __gpga_storage_width > GPGA_SCHED_VM_EXPR_WIDE_BITS) {\n";
+      out << "    return false;\n";
+      out << "  }\n";
+      out << "  uint __gpga_storage_words = (__gpga_storage_width + 63u) >> 6u;\n";
+      out << "  ulong __gpga_stride = (ulong)__gpga_storage_words * 8ul;\n";
+      out << "  ulong __gpga_elem = (ulong)gid * (ulong)__gpga_sig.array_size;\n";
+      out << "  if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_ARRAY) != 0u) {\n";
+      out << "    if (idx_val >= __gpga_entry.array_size) {\n";
+      out << "      return true;\n";
+      out << "    }\n";
+      out << "    __gpga_elem = (ulong)gid * (ulong)__gpga_entry.array_size +\n";
+      out << "        (ulong)idx_val;\n";
+      out << "  } else if (__gpga_sig.array_size != 1u) {\n";
+      out << "    return false;\n";
+      out << "  }\n";
+      out << "  uint __gpga_start = 0u;\n";
+      out << "  uint __gpga_width = __gpga_storage_width;\n";
+      out << "  if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_BIT_SELECT) != 0u) {\n";
+      out << "    if (idx_val >= __gpga_entry.base_width) {\n";
+      out << "      return true;\n";
+      out << "    }\n";
+      out << "    __gpga_start = idx_val;\n";
+      out << "    __gpga_width = 1u;\n";
+      out << "  } else if ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_RANGE) != 0u) {\n";
+      out << "    bool __gpga_indexed =\n";
+      out << "        ((__gpga_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_IS_INDEXED_RANGE) != 0u);\n";
+      out << "    __gpga_start = __gpga_indexed ? idx_val : __gpga_entry.range_lsb;\n";
+      out << "    __gpga_width = __gpga_entry.width;\n";
+      out << "    if (__gpga_width == 0u || __gpga_entry.base_width < __gpga_width ||\n";
+      out << "        __gpga_start > __gpga_entry.base_width - __gpga_width) {\n";
+      out << "      return true;\n";
+      out << "    }\n";
+      out << "  }\n";
+      out << "  GpgaWide" << wide_bits
+          << " __gpga_mask = gpga_wide_shl_" << wide_bits
+          << "(gpga_sched_vm_wide_mask_bits(__gpga_width), __gpga_start);\n";
+      out << "  GpgaWide" << wide_bits
+          << " __gpga_bits = gpga_wide_shl_" << wide_bits
+          << "(val, __gpga_start);\n";
+      out << "  device ulong* __gpga_val_words = (device ulong*)(__gpga_state +\n";
+      out << "      (ulong)__gpga_sig.val_offset + __gpga_elem * __gpga_stride);\n";
+      out << "  #pragma clang loop unroll(disable)\n";
+      out << "  for (uint __gpga_w = 0u; __gpga_w < __gpga_storage_words; ++__gpga_w) {\n";
+      out << "    ulong __gpga_m = __gpga_mask.w[__gpga_w];\n";
+      out << "    __gpga_val_words[__gpga_w] = (__gpga_val_words[__gpga_w] & ~__gpga_m) |\n";
+      out << "        (__gpga_bits.w[__gpga_w] & __gpga_m);\n";
+      out << "  }\n";
+      out << "  return true;\n";
+      out << "}\n";
+    }
+    if (options.sched_vm) {
+      out << "static __attribute__((noinline)) bool gpga_"
+          << MslName(module.name) << "_sched_vm_assign_cond_rhs(";
+      emit_sched_param_decls(2);
+      out << ",\n  uint pid,\n  uint assign_id,\n  uint idx_val,\n"
+             "  bool use_nb) {\n";
+      out << "  const GpgaSchedVmAssignEntry __gpga_entry =\n";
+      out << "      sched_vm_assign_entry[assign_id];\n";
+      out << "  uint __gpga_cond_val = 0u;\n";
+      out << "  uint __gpga_cond_xz = 0u;\n";
+      out << "  ulong __gpga_val = 0ul;\n";
+      out << "  ulong __gpga_xz = 0ul;\n";
+      out << "  uint __gpga_width = 0u;\n";
+      if (vm_expr_wide_bits > 64u) {
+        out << "  GpgaWide" << vm_expr_wide_bits << " __gpga_wide_val = gpga_wide_zero_"
+            << vm_expr_wide_bits << "();\n";
+        out << "  GpgaWide" << vm_expr_wide_bits << " __gpga_wide_xz = gpga_wide_zero_"
+            << vm_expr_wide_bits << "();\n";
+      }
+      out << "  gpga_" << MslName(module.name) << "_sched_vm_eval_cond(";
+      emit_sched_param_names();
+      out << ", pid, __gpga_entry.rhs_expr, &__gpga_cond_val, &__gpga_cond_xz,\n"
+             "      &__gpga_val, &__gpga_xz, &__gpga_width";
+      if (vm_expr_wide_bits > 64u) {
+        out << ", &__gpga_wide_val, &__gpga_wide_xz";
+      }
+      out << ");\n";
+      out << "  if (__gpga_width == 0u) {\n";
+      out << "    return false;\n";
+      out << "  }\n";
+      if (vm_expr_wide_bits > 64u) {
+        out << "  if (sched_vm_signal_entry[__gpga_entry.signal_id].width > 64u) {\n";
+        out << "    if (__gpga_width <= 64u) {\n";
+        out << "      __gpga_wide_val = gpga_wide_from_u64_" << vm_expr_wide_bits
+            << "(__gpga_val);\n";
+        out << "    }\n";
+        out << "    return gpga_" << MslName(module.name)
+            << "_sched_vm_apply_assign_wide(";
+        emit_sched_param_names();
+        out << ", pid, assign_id, __gpga_wide_val, idx_val, use_nb);\n";
+        out << "  }\n";
+      }
+      out << "  ulong __gpga_mask = (__gpga_entry.width >= 64u)\n";
+      out << "      ? ~0ul\n";
+      out << "      : ((__gpga_entry.width == 0u)\n";
+      out << "             ? 0ul\n";
+      out << "             : ((1ul << __gpga_entry.width) - 1ul));\n";
+      out << "  return gpga_" << MslName(module.name) << "_sched_vm_apply_assign(";
+      emit_sched_param_names();
+      out << ", pid, assign_id, __gpga_val & __gpga_mask, idx_val,\n"
+             "      use_nb);\n";
+      out << "}\n";
+    }
     if (options.sched_vm) {
       out << "static __attribute__((noinline)) void gpga_"
           << MslName(module.name) << "_sched_vm_exec_assign_blocking(";
@@ -44763,7 +47277,15 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "      }\n";
       out << "    }\n";
       out << "    if (__gpga_ok) {\n";
-      out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
+      out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_COND_RHS) != 0u) {\n";
+      out << "        if (!gpga_" << MslName(module.name)
+          << "_sched_vm_assign_cond_rhs(";
+      emit_sched_param_names();
+      out << ", pid, assign_id,\n";
+      out << "            __gpga_idx_val, false)) {\n";
+      out << "          __gpga_ok = false;\n";
+      out << "        }\n";
+      out << "      } else if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
       out << "        if (!gpga_" << MslName(module.name)
           << "_sched_vm_apply_assign(";
       emit_sched_param_names();
@@ -44845,7 +47367,15 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
         out << "      }\n";
         out << "    }\n";
         out << "    if (__gpga_ok) {\n";
-        out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
+        out << "      if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_COND_RHS) != 0u) {\n";
+        out << "        if (!gpga_" << MslName(module.name)
+            << "_sched_vm_assign_cond_rhs(";
+        emit_sched_param_names();
+        out << ", pid, assign_id,\n";
+        out << "            __gpga_idx_val, true)) {\n";
+        out << "          __gpga_ok = false;\n";
+        out << "        }\n";
+        out << "      } else if ((__gpga_assign_entry.flags & GPGA_SCHED_VM_ASSIGN_FLAG_WIDE_CONST) != 0u) {\n";
         out << "        if (!gpga_" << MslName(module.name)
             << "_sched_vm_apply_assign(";
         emit_sched_param_names();
@@ -45960,6 +48490,39 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "      __gpga_ip = __gpga_next_ip;\n";
       out << "      continue;\n";
       out << "    }\n";
+      out << "    if (__gpga_op == GPGA_SCHED_VM_OP_ASSIGN_RUN) {\n";
+      out << "      if (__gpga_next_ip + __gpga_arg > __gpga_bc_len) {\n";
+      out << "        sched_error[gid] = 1u;\n";
+      out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+      out << "        sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+      out << "        return;\n";
+      out << "      }\n";
+      out << "      #pragma clang loop unroll(disable)\n";
+      out << "      for (uint __gpga_k = 0u; __gpga_k < __gpga_arg; ++__gpga_k) {\n";
+      out << "        uint __gpga_run_instr =\n"
+             "            sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip + __gpga_k];\n";
+      out << "        uint __gpga_run_id = __gpga_run_instr >> GPGA_SCHED_VM_OP_SHIFT;\n";
+      out << "        if (__gpga_run_id >= GPGA_SCHED_VM_ASSIGN_COUNT) {\n";
+      out << "          sched_error[gid] = 1u;\n";
+      out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+      out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+      out << "          return;\n";
+      out << "        }\n";
+      out << "        if ((__gpga_run_instr & GPGA_SCHED_VM_OP_MASK) == GPGA_SCHED_VM_OP_ASSIGN_NB) {\n";
+      out << "          gpga_" << MslName(module.name)
+          << "_sched_vm_exec_assign_nb(";
+      emit_sched_param_names();
+      out << ", pid, idx, __gpga_run_id);\n";
+      out << "        } else {\n";
+      out << "          gpga_" << MslName(module.name)
+          << "_sched_vm_exec_assign_blocking(";
+      emit_sched_param_names();
+      out << ", pid, idx, __gpga_run_id);\n";
+      out << "        }\n";
+      out << "      }\n";
+      out << "      __gpga_ip = __gpga_next_ip + __gpga_arg;\n";
+      out << "      continue;\n";
+      out << "    }\n";
       out << "    if (__gpga_op == GPGA_SCHED_VM_OP_ASSIGN_DELAY) {\n";
       out << "      if (__gpga_arg >= GPGA_SCHED_DELAY_COUNT) {\n";
       out << "        sched_error[gid] = 1u;\n";
@@ -46340,7 +48903,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "      sched_vm_ip[__gpga_vm_idx] = 0u;\n";
       out << "      return;\n";
       out << "    }\n";
-      out << "    if (__gpga_op == GPGA_SCHED_VM_OP_JUMP_IF) {\n";
+      out << "    if (__gpga_op == GPGA_SCHED_VM_OP_JUMP_IF ||\n";
+      out << "        __gpga_op == GPGA_SCHED_VM_OP_BRANCH) {\n";
       out << "      if (__gpga_next_ip >= __gpga_bc_len) {\n";
       out << "        sched_error[gid] = 1u;\n";
       out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -46348,6 +48912,16 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "        return;\n";
       out << "      }\n";
       out << "      uint __gpga_target = sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip];\n";
+      out << "      uint __gpga_fall_ip = __gpga_next_ip + 1u;\n";
+      out << "      if (__gpga_op == GPGA_SCHED_VM_OP_BRANCH) {\n";
+      out << "        if (__gpga_fall_ip >= __gpga_bc_len) {\n";
+      out << "          sched_error[gid] = 1u;\n";
+      out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+      out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+      out << "          return;\n";
+      out << "        }\n";
+      out << "        __gpga_fall_ip = sched_vm_bytecode[__gpga_bc_base + __gpga_fall_ip];\n";
+      out << "      }\n";
       out << "      if (__gpga_arg >= GPGA_SCHED_VM_COND_COUNT) {\n";
       out << "        sched_error[gid] = 1u;\n";
       out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -46374,7 +48948,7 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "        sched_vm_ip[__gpga_vm_idx] = 0u;\n";
       out << "        return;\n";
       out << "      }\n";
-      out << "      __gpga_ip = __gpga_take ? __gpga_target : (__gpga_next_ip + 1u);\n";
+      out << "      __gpga_ip = __gpga_take ? __gpga_target : __gpga_fall_ip;\n";
       out << "      continue;\n";
       out << "    }\n";
       out << "    if (__gpga_op == GPGA_SCHED_VM_OP_CASE) {\n";
@@ -46702,7 +49276,8 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "      return;\n";
       }
       out << "    }\n";
-      out << "    if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE) {\n";
+      out << "    if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE ||\n";
+      out << "        __gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP) {\n";
       out << "      if (__gpga_arg >= GPGA_SCHED_EDGE_WAIT_COUNT) {\n";
       out << "        sched_error[gid] = 1u;\n";
       out << "        sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
@@ -46748,7 +49323,17 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
       out << "        }\n";
       out << "      }\n";
       }
-      out << "      sched_vm_ip[__gpga_vm_idx] = __gpga_next_ip;\n";
+      out << "      uint __gpga_resume_ip = __gpga_next_ip;\n";
+      out << "      if (__gpga_op == GPGA_SCHED_VM_OP_WAIT_EDGE_LOOP) {\n";
+      out << "        if (__gpga_next_ip >= __gpga_bc_len) {\n";
+      out << "          sched_error[gid] = 1u;\n";
+      out << "          sched_state[idx] = GPGA_SCHED_PROC_DONE;\n";
+      out << "          sched_vm_ip[__gpga_vm_idx] = 0u;\n";
+      out << "          return;\n";
+      out << "        }\n";
+      out << "        __gpga_resume_ip = sched_vm_bytecode[__gpga_bc_base + __gpga_next_ip];\n";
+      out << "      }\n";
+      out << "      sched_vm_ip[__gpga_vm_idx] = __gpga_resume_ip;\n";
       out << "      sched_state[idx] = GPGA_SCHED_PROC_BLOCKED;\n";
       out << "      return;\n";
       }
@@ -46855,4 +49440,20 @@ std::string EmitMSLStub(const Module& module, const MslEmitOptions& options) {
   return out_buf.str();
 }
 
+}  // namespace
+
+std::string EmitMSLStub(const Module& module, const MslEmitOptions& options,
+                        SchedulerManifest* manifest) {
+  if (manifest) {
+    *manifest = SchedulerManifest{};
+  }
+  std::string source = EmitMSLStubSource(module, options, manifest);
+  if (manifest) {
+    manifest->source_bytes = static_cast<uint64_t>(source.size());
+    manifest->source_hash = SchedulerManifestSourceHash(source);
+    ScanKernelBindingTables(source, &manifest->kernels);
+  }
+  return source;
+}
+
 }  // namespace gpga
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "core/elaboration.hh"
 #include "core/scheduler_vm.hh"
 #include "frontend/ast.hh"
 
@@ -58,20 +60,61 @@ struct SchedulerVmFallbackDiagnostics {
 struct MslEmitOptions {
   bool four_state = false;
   bool sched_vm = false;
+  // Hierarchical codegen: when set, repeated instances in these groups share
+  // one struct and eval function per group instead of being emitted inline;
+  // instance state lives in the gpga_inst_state buffer
+  // (GPGA_SCHED_INST_STATE_BYTES per design instance) and runs of instances
+  // evaluate in one loop over their slots. 2-state kernels only.
+  const std::vector<InstanceGroup>* instance_groups = nullptr;
+  // Set to why instance_groups went unused, when it did; left alone
+  // otherwise.
+  std::string* hier_fallback = nullptr;
+  // 4-state only: nets proven X/Z-free (FindTwoStateNets). Kernel-local ones
+  // carry no _xz lane and read back with a known-zero xz; buffer-backed ones
+  // in scheduler kernels share one zero xz segment of the packed state
+  // (GPGA_SCHED_PRUNE_XZ) instead of one segment each.
+  const std::unordered_set<std::string>* two_state_nets = nullptr;
+  // Scheduler kernels only, ignored with sched_vm: scalar 1-bit ports and
+  // regs of the packed state buffers share 64-bit bitset words
+  // (BuildPackedBitLayout) instead of one segment each.
+  bool pack_bits = false;
+  // Scheduler kernels only, ignored with sched_vm: port and reg segments of
+  // the packed state buffers follow OrderStateByLocality, co-accessed ones
+  // adjacent and cold (testbench-only) ones after the arrays.
+  bool locality_layout = false;
 };
 
+struct SchedulerManifest;
+
+// When `manifest` is non-null it receives the scheduler constants, kernel
+// binding tables and VM layout backing the returned source.
 std::string EmitMSLStub(const Module& module,
-                        const MslEmitOptions& options = {});
+                        const MslEmitOptions& options = {},
+                        SchedulerManifest* manifest = nullptr);
 
-bool BuildSchedulerVmLayoutFromModule(const Module& module,
-                                      SchedulerVmLayout* out,
-                                      std::string* error,
-                                      bool four_state);
+// `two_state_nets` must match MslEmitOptions::two_state_nets of the emitted
+// source: buffer-backed nets in it get the shared zero xz slot.
+bool BuildSchedulerVmLayoutFromModule(
+    const Module& module,
+    SchedulerVmLayout* out,
+    std::string* error,
+    bool four_state,
+    const std::unordered_set<std::string>* two_state_nets = nullptr);
 bool BuildSchedulerVmLayoutFromModuleWithDiag(
     const Module& module,
     SchedulerVmLayout* out,
     std::string* error,
     bool four_state,
-    SchedulerVmFallbackDiagnostics* diag);
+    SchedulerVmFallbackDiagnostics* diag,
+    const std::unordered_set<std::string>* two_state_nets = nullptr);
+
+// For the host interpreter: encodes the continuous assigns of `module` that
+// fully drive a net of `layout` (single driver, no strength, no switch, at
+// most 64 bits, rhs expressible in VM bytecode) into `layout`'s expression
+// table. `skipped` receives the number left out; the kernels still run
+// those.
+void BuildSchedulerVmContinuousAssigns(
+    const Module& module, bool four_state, SchedulerVmLayout* layout,
+    std::vector<SchedulerVmContinuousAssign>* out, uint32_t* skipped);
 
 }  // namespace gpga
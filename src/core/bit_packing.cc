@@ -0,0 +1,68 @@
+#include "core/bit_packing.hh"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "core/state_locality.hh"
+
+namespace gpga {
+
+PackedBitLayout BuildPackedBitLayout(const Module& module,
+                                     const std::vector<std::string>& candidates,
+                                     bool four_state) {
+  PackedBitLayout layout;
+  // Ports take precedence over the net declaration of the same name.
+  std::unordered_map<std::string, bool> is_bit;
+  for (const auto& port : module.ports) {
+    is_bit.emplace(port.name, port.width == 1 && !port.is_real);
+  }
+  for (const auto& net : module.nets) {
+    is_bit.emplace(net.name, net.width == 1 && !net.is_real &&
+                                 net.array_size == 0 &&
+                                 net.type != NetType::kTrireg);
+  }
+  std::unordered_set<std::string> packable;
+  for (const auto& name : candidates) {
+    auto it = is_bit.find(name);
+    if (it != is_bit.end() && it->second) {
+      packable.insert(name);
+    }
+  }
+  if (packable.empty()) {
+    return layout;
+  }
+
+  std::vector<std::string> accesses;
+  for (const auto& process : CollectStateProcessAccesses(module)) {
+    accesses.insert(accesses.end(), process.signals.begin(),
+                    process.signals.end());
+  }
+  accesses.insert(accesses.end(), candidates.begin(), candidates.end());
+
+  const uint32_t bits_per_signal = four_state ? 2u : 1u;
+  uint32_t next_bit = 0u;
+  for (const auto& name : accesses) {
+    if (packable.count(name) == 0 || layout.slots.count(name) > 0) {
+      continue;
+    }
+    if (next_bit + bits_per_signal > kPackedBitsPerWord) {
+      next_bit = 0u;
+    }
+    if (next_bit == 0u) {
+      ++layout.group_count;
+    }
+    PackedBitSlot slot;
+    slot.group = layout.group_count - 1u;
+    slot.val_bit = next_bit;
+    if (four_state) {
+      slot.xz_bit = static_cast<int>(next_bit + 1u);
+    }
+    next_bit += bits_per_signal;
+    layout.slots.emplace(name, slot);
+  }
+  return layout;
+}
+
+}  // namespace gpga
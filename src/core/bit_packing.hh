@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frontend/ast.hh"
+
+namespace gpga {
+
+// Bits per packed word; each group occupies one 64-bit word per instance.
+constexpr uint32_t kPackedBitsPerWord = 64u;
+
+// Where a bit-packed 1-bit signal lives: bit `val_bit` (and `xz_bit` for
+// 4-state, -1 otherwise) of word [gid] in group `group`'s segment.
+struct PackedBitSlot {
+  uint32_t group = 0u;
+  uint32_t val_bit = 0u;
+  int xz_bit = -1;
+};
+
+struct PackedBitLayout {
+  uint32_t group_count = 0u;
+  std::unordered_map<std::string, PackedBitSlot> slots;
+
+  const PackedBitSlot* Find(const std::string& name) const {
+    auto it = slots.find(name);
+    return (it == slots.end()) ? nullptr : &it->second;
+  }
+};
+
+// Assigns the scalar 1-bit members of `candidates` (the port and reg names of
+// the packed state buffer, in packed order) to 64-bit bitset words. Real,
+// array and trireg signals are never packed. Signals are ordered by first
+// access across always blocks, then continuous assigns, then declaration, so
+// signals touched by the same process share words; a 4-state signal keeps its
+// val and xz bits adjacent. Codegen and the host both call this to agree on
+// the layout.
+PackedBitLayout BuildPackedBitLayout(const Module& module,
+                                     const std::vector<std::string>& candidates,
+                                     bool four_state);
+
+}  // namespace gpga
@@ -0,0 +1,884 @@
+#include "core/design_image.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace gpga {
+
+namespace {
+
+constexpr uint32_t kDesignImageMagic = 0x49444747u;  // "GGDI"
+constexpr uint32_t kDesignImageVersion = 1u;
+
+// Little-endian fields; strings and vectors carry a u32 length, optional
+// nodes a presence byte.
+class ImageWriter {
+ public:
+  explicit ImageWriter(std::string* out) : out_(out) {}
+
+  void U8(uint8_t value) { out_->push_back(static_cast<char>(value)); }
+  void Bool(bool value) { U8(value ? 1u : 0u); }
+  void U32(uint32_t value) { Raw(&value, sizeof(value)); }
+  void I32(int value) { U32(static_cast<uint32_t>(value)); }
+  void U64(uint64_t value) { Raw(&value, sizeof(value)); }
+  void Str(const std::string& value) {
+    U32(static_cast<uint32_t>(value.size()));
+    Raw(value.data(), value.size());
+  }
+  template <typename E>
+  void Enum(E value) {
+    U32(static_cast<uint32_t>(value));
+  }
+  template <typename T, typename F>
+  void List(const std::vector<T>& values, F&& write_one) {
+    U32(static_cast<uint32_t>(values.size()));
+    for (const auto& value : values) {
+      write_one(value);
+    }
+  }
+
+  void Expr(const gpga::Expr* expr);
+  void Exprs(const std::vector<std::unique_ptr<gpga::Expr>>& exprs) {
+    List(exprs, [&](const std::unique_ptr<gpga::Expr>& e) { Expr(e.get()); });
+  }
+  void Statements(const std::vector<Statement>& statements) {
+    List(statements, [&](const Statement& s) { Stmt(s); });
+  }
+  void Stmt(const Statement& stmt);
+  void SeqAssign(const SequentialAssign& assign);
+  void Limit(const TimingCheckLimit& limit);
+  void Event(const TimingCheckEvent& event);
+  void Module(const gpga::Module& module);
+
+ private:
+  void Raw(const void* data, size_t size) {
+    out_->append(static_cast<const char*>(data), size);
+  }
+
+  std::string* out_;
+};
+
+void ImageWriter::Expr(const gpga::Expr* expr) {
+  Bool(expr != nullptr);
+  if (!expr) {
+    return;
+  }
+  Enum(expr->kind);
+  Str(expr->ident);
+  Str(expr->string_value);
+  U64(expr->number);
+  U64(expr->value_bits);
+  U64(expr->x_bits);
+  U64(expr->z_bits);
+  I32(expr->number_width);
+  Bool(expr->has_width);
+  Bool(expr->has_base);
+  U8(static_cast<uint8_t>(expr->base_char));
+  Bool(expr->is_signed);
+  Bool(expr->is_real_literal);
+  U8(static_cast<uint8_t>(expr->op));
+  U8(static_cast<uint8_t>(expr->unary_op));
+  Expr(expr->operand.get());
+  Expr(expr->lhs.get());
+  Expr(expr->rhs.get());
+  Expr(expr->condition.get());
+  Expr(expr->then_expr.get());
+  Expr(expr->else_expr.get());
+  Expr(expr->base.get());
+  Expr(expr->index.get());
+  I32(expr->msb);
+  I32(expr->lsb);
+  Bool(expr->has_range);
+  Bool(expr->indexed_range);
+  Bool(expr->indexed_desc);
+  I32(expr->indexed_width);
+  Expr(expr->msb_expr.get());
+  Expr(expr->lsb_expr.get());
+  Exprs(expr->elements);
+  I32(expr->repeat);
+  Expr(expr->repeat_expr.get());
+  Exprs(expr->call_args);
+}
+
+void ImageWriter::SeqAssign(const SequentialAssign& assign) {
+  Str(assign.lhs);
+  Expr(assign.lhs_index.get());
+  Exprs(assign.lhs_indices);
+  Bool(assign.lhs_has_range);
+  Bool(assign.lhs_indexed_range);
+  Bool(assign.lhs_indexed_desc);
+  I32(assign.lhs_indexed_width);
+  I32(assign.lhs_msb);
+  I32(assign.lhs_lsb);
+  Expr(assign.lhs_msb_expr.get());
+  Expr(assign.lhs_lsb_expr.get());
+  Expr(assign.rhs.get());
+  Expr(assign.delay.get());
+  Bool(assign.nonblocking);
+}
+
+void ImageWriter::Stmt(const Statement& stmt) {
+  Enum(stmt.kind);
+  Enum(stmt.case_kind);
+  SeqAssign(stmt.assign);
+  Bool(stmt.is_procedural);
+  Str(stmt.for_init_lhs);
+  Expr(stmt.for_init_rhs.get());
+  Expr(stmt.for_condition.get());
+  Str(stmt.for_step_lhs);
+  Expr(stmt.for_step_rhs.get());
+  Statements(stmt.for_body);
+  Expr(stmt.while_condition.get());
+  Statements(stmt.while_body);
+  Expr(stmt.repeat_count.get());
+  Statements(stmt.repeat_body);
+  Expr(stmt.delay.get());
+  Statements(stmt.delay_body);
+  Enum(stmt.event_edge);
+  Expr(stmt.event_expr.get());
+  List(stmt.event_items, [&](const EventItem& item) {
+    Enum(item.edge);
+    Expr(item.expr.get());
+  });
+  Statements(stmt.event_body);
+  Expr(stmt.wait_condition.get());
+  Statements(stmt.wait_body);
+  Statements(stmt.forever_body);
+  Statements(stmt.fork_branches);
+  Str(stmt.disable_target);
+  Str(stmt.task_name);
+  Exprs(stmt.task_args);
+  Str(stmt.trigger_target);
+  Str(stmt.force_target);
+  Str(stmt.release_target);
+  Expr(stmt.condition.get());
+  Statements(stmt.then_branch);
+  Statements(stmt.else_branch);
+  Statements(stmt.block);
+  Str(stmt.block_label);
+  Expr(stmt.case_expr.get());
+  List(stmt.case_items, [&](const CaseItem& item) {
+    Exprs(item.labels);
+    Statements(item.body);
+  });
+  Statements(stmt.default_branch);
+}
+
+void ImageWriter::Limit(const TimingCheckLimit& limit) {
+  Expr(limit.min.get());
+  Expr(limit.typ.get());
+  Expr(limit.max.get());
+}
+
+void ImageWriter::Event(const TimingCheckEvent& event) {
+  Enum(event.edge);
+  Bool(event.has_edge_list);
+  List(event.edge_list, [&](const TimingEdgePattern& pattern) {
+    Enum(pattern.from);
+    Enum(pattern.to);
+    Str(pattern.raw);
+  });
+  Expr(event.expr.get());
+  Expr(event.cond.get());
+  Str(event.raw_expr);
+  Str(event.raw_cond);
+}
+
+void ImageWriter::Module(const gpga::Module& module) {
+  Str(module.name);
+  Str(module.timescale);
+  List(module.ports, [&](const Port& port) {
+    Enum(port.dir);
+    Str(port.name);
+    I32(port.width);
+    Bool(port.is_signed);
+    Bool(port.is_real);
+    Bool(port.is_declared);
+    Expr(port.msb_expr.get());
+    Expr(port.lsb_expr.get());
+  });
+  List(module.nets, [&](const Net& net) {
+    Enum(net.type);
+    Str(net.name);
+    I32(net.width);
+    Bool(net.is_signed);
+    Bool(net.is_real);
+    Enum(net.charge);
+    Expr(net.msb_expr.get());
+    Expr(net.lsb_expr.get());
+    I32(net.array_size);
+    List(net.array_dims, [&](const ArrayDim& dim) {
+      I32(dim.size);
+      Expr(dim.msb_expr.get());
+      Expr(dim.lsb_expr.get());
+    });
+  });
+  List(module.assigns, [&](const Assign& assign) {
+    Str(assign.lhs);
+    I32(assign.lhs_msb);
+    I32(assign.lhs_lsb);
+    Bool(assign.lhs_has_range);
+    Expr(assign.rhs.get());
+    Enum(assign.strength0);
+    Enum(assign.strength1);
+    Bool(assign.has_strength);
+    Bool(assign.is_implicit);
+    Bool(assign.is_derived);
+    I32(assign.origin_depth);
+  });
+  List(module.switches, [&](const Switch& sw) {
+    Enum(sw.kind);
+    Str(sw.a);
+    Str(sw.b);
+    Expr(sw.control.get());
+    Expr(sw.control_n.get());
+    Enum(sw.strength0);
+    Enum(sw.strength1);
+    Bool(sw.has_strength);
+  });
+  List(module.instances, [&](const Instance& instance) {
+    Str(instance.module_name);
+    Str(instance.name);
+    Bool(instance.has_array);
+    Expr(instance.array_msb.get());
+    Expr(instance.array_lsb.get());
+    List(instance.param_overrides, [&](const ParamOverride& param) {
+      Str(param.name);
+      Expr(param.expr.get());
+    });
+    List(instance.connections, [&](const Connection& connection) {
+      Str(connection.port);
+      Expr(connection.expr.get());
+    });
+  });
+  List(module.always_blocks, [&](const AlwaysBlock& block) {
+    Enum(block.edge);
+    Str(block.clock);
+    Str(block.sensitivity);
+    Bool(block.is_synthesized);
+    Bool(block.is_decl_init);
+    I32(block.origin_depth);
+    Statements(block.statements);
+  });
+  List(module.parameters, [&](const Parameter& param) {
+    Str(param.name);
+    Expr(param.value.get());
+    Bool(param.is_local);
+    Bool(param.is_real);
+  });
+  List(module.functions, [&](const Function& func) {
+    Str(func.name);
+    I32(func.width);
+    Bool(func.is_signed);
+    Bool(func.is_real);
+    Expr(func.msb_expr.get());
+    Expr(func.lsb_expr.get());
+    List(func.args, [&](const FunctionArg& arg) {
+      Str(arg.name);
+      I32(arg.width);
+      Bool(arg.is_signed);
+      Bool(arg.is_real);
+      Expr(arg.msb_expr.get());
+      Expr(arg.lsb_expr.get());
+    });
+    List(func.locals, [&](const LocalVar& local) {
+      Str(local.name);
+      I32(local.width);
+      Bool(local.is_signed);
+      Bool(local.is_real);
+    });
+    Statements(func.body);
+    Expr(func.body_expr.get());
+  });
+  List(module.tasks, [&](const Task& task) {
+    Str(task.name);
+    List(task.args, [&](const TaskArg& arg) {
+      Enum(arg.dir);
+      Str(arg.name);
+      I32(arg.width);
+      Bool(arg.is_signed);
+      Bool(arg.is_real);
+      Expr(arg.msb_expr.get());
+      Expr(arg.lsb_expr.get());
+    });
+    Statements(task.body);
+  });
+  List(module.events, [&](const EventDecl& event) { Str(event.name); });
+  List(module.defparams, [&](const DefParam& defparam) {
+    Str(defparam.instance);
+    Str(defparam.param);
+    Expr(defparam.expr.get());
+    I32(defparam.line);
+    I32(defparam.column);
+  });
+  List(module.timing_checks, [&](const TimingCheck& check) {
+    Str(check.name);
+    Str(check.edge);
+    Str(check.signal);
+    Str(check.condition);
+    Enum(check.kind);
+    Event(check.data_event);
+    Event(check.ref_event);
+    Limit(check.limit);
+    Limit(check.limit2);
+    Expr(check.threshold.get());
+    Expr(check.check_cond.get());
+    Expr(check.event_based_flag.get());
+    Expr(check.remain_active_flag.get());
+    Str(check.notifier);
+    Str(check.delayed_ref);
+    Str(check.delayed_data);
+    I32(check.line);
+    I32(check.column);
+  });
+  List(module.specify_paths, [&](const SpecifyPath& path) {
+    Enum(path.kind);
+    Enum(path.polarity);
+    Event(path.input_event);
+    Expr(path.data_expr.get());
+    SeqAssign(path.target);
+    List(path.delays, [&](const TimingCheckLimit& limit) { Limit(limit); });
+    Expr(path.condition.get());
+    Bool(path.is_conditional);
+    Bool(path.is_ifnone);
+    Bool(path.showcancelled);
+    Str(path.pulse_input);
+    Limit(path.pulse_reject);
+    Limit(path.pulse_error);
+    Bool(path.has_pulse);
+    Bool(path.has_pulse_error);
+    I32(path.line);
+    I32(path.column);
+  });
+  // Hash containers go out sorted so equal designs give equal images.
+  std::vector<std::string> pulse_keys;
+  for (const auto& entry : module.path_pulses) {
+    pulse_keys.push_back(entry.first);
+  }
+  std::sort(pulse_keys.begin(), pulse_keys.end());
+  List(pulse_keys, [&](const std::string& key) {
+    const PathPulseSpec& spec = module.path_pulses.at(key);
+    Str(key);
+    Str(spec.name);
+    Str(spec.input);
+    Str(spec.output);
+    Limit(spec.reject);
+    Limit(spec.error);
+    Bool(spec.has_error);
+  });
+  std::vector<std::string> labels(module.generate_labels.begin(),
+                                  module.generate_labels.end());
+  std::sort(labels.begin(), labels.end());
+  List(labels, [&](const std::string& label) { Str(label); });
+  Enum(module.unconnected_drive);
+}
+
+// Reads what ImageWriter wrote. A short or malformed image sets failed()
+// and yields zero values from then on, so callers check once at the end.
+class ImageReader {
+ public:
+  explicit ImageReader(const std::string& bytes) : bytes_(bytes) {}
+
+  bool failed() const { return failed_; }
+  bool AtEnd() const { return pos_ == bytes_.size(); }
+
+  uint8_t U8() {
+    uint8_t value = 0u;
+    Raw(&value, sizeof(value));
+    return value;
+  }
+  bool Bool() { return U8() != 0u; }
+  uint32_t U32() {
+    uint32_t value = 0u;
+    Raw(&value, sizeof(value));
+    return value;
+  }
+  int I32() { return static_cast<int>(U32()); }
+  uint64_t U64() {
+    uint64_t value = 0u;
+    Raw(&value, sizeof(value));
+    return value;
+  }
+  std::string Str() {
+    const uint32_t size = U32();
+    if (failed_ || size > bytes_.size() - pos_) {
+      failed_ = true;
+      return std::string();
+    }
+    std::string value = bytes_.substr(pos_, size);
+    pos_ += size;
+    return value;
+  }
+  template <typename E>
+  E Enum() {
+    return static_cast<E>(U32());
+  }
+  // Every element takes at least one byte, which bounds a corrupt count.
+  template <typename T, typename F>
+  void List(std::vector<T>* values, F&& read_one) {
+    const uint32_t count = U32();
+    if (failed_ || count > bytes_.size() - pos_) {
+      failed_ = true;
+      return;
+    }
+    values->resize(count);
+    for (auto& value : *values) {
+      read_one(&value);
+      if (failed_) {
+        return;
+      }
+    }
+  }
+
+  std::unique_ptr<gpga::Expr> Expr();
+  std::shared_ptr<gpga::Expr> SharedExpr() { return Expr(); }
+  void Exprs(std::vector<std::unique_ptr<gpga::Expr>>* exprs) {
+    List(exprs, [&](std::unique_ptr<gpga::Expr>* e) { *e = Expr(); });
+  }
+  void Statements(std::vector<Statement>* statements) {
+    List(statements, [&](Statement* s) { Stmt(s); });
+  }
+  void Stmt(Statement* stmt);
+  void SeqAssign(SequentialAssign* assign);
+  void Limit(TimingCheckLimit* limit);
+  void Event(TimingCheckEvent* event);
+  void Module(gpga::Module* module);
+
+ private:
+  void Raw(void* out, size_t size) {
+    if (failed_ || size > bytes_.size() - pos_) {
+      failed_ = true;
+      return;
+    }
+    std::memcpy(out, bytes_.data() + pos_, size);
+    pos_ += size;
+  }
+
+  const std::string& bytes_;
+  size_t pos_ = 0u;
+  bool failed_ = false;
+};
+
+std::unique_ptr<gpga::Expr> ImageReader::Expr() {
+  if (!Bool() || failed_) {
+    return nullptr;
+  }
+  auto expr = std::make_unique<gpga::Expr>();
+  expr->kind = Enum<ExprKind>();
+  expr->ident = Str();
+  expr->string_value = Str();
+  expr->number = U64();
+  expr->value_bits = U64();
+  expr->x_bits = U64();
+  expr->z_bits = U64();
+  expr->number_width = I32();
+  expr->has_width = Bool();
+  expr->has_base = Bool();
+  expr->base_char = static_cast<char>(U8());
+  expr->is_signed = Bool();
+  expr->is_real_literal = Bool();
+  expr->op = static_cast<char>(U8());
+  expr->unary_op = static_cast<char>(U8());
+  expr->operand = Expr();
+  expr->lhs = Expr();
+  expr->rhs = Expr();
+  expr->condition = Expr();
+  expr->then_expr = Expr();
+  expr->else_expr = Expr();
+  expr->base = Expr();
+  expr->index = Expr();
+  expr->msb = I32();
+  expr->lsb = I32();
+  expr->has_range = Bool();
+  expr->indexed_range = Bool();
+  expr->indexed_desc = Bool();
+  expr->indexed_width = I32();
+  expr->msb_expr = Expr();
+  expr->lsb_expr = Expr();
+  Exprs(&expr->elements);
+  expr->repeat = I32();
+  expr->repeat_expr = Expr();
+  Exprs(&expr->call_args);
+  return expr;
+}
+
+void ImageReader::SeqAssign(SequentialAssign* assign) {
+  assign->lhs = Str();
+  assign->lhs_index = Expr();
+  Exprs(&assign->lhs_indices);
+  assign->lhs_has_range = Bool();
+  assign->lhs_indexed_range = Bool();
+  assign->lhs_indexed_desc = Bool();
+  assign->lhs_indexed_width = I32();
+  assign->lhs_msb = I32();
+  assign->lhs_lsb = I32();
+  assign->lhs_msb_expr = Expr();
+  assign->lhs_lsb_expr = Expr();
+  assign->rhs = Expr();
+  assign->delay = Expr();
+  assign->nonblocking = Bool();
+}
+
+void ImageReader::Stmt(Statement* stmt) {
+  stmt->kind = Enum<StatementKind>();
+  stmt->case_kind = Enum<CaseKind>();
+  SeqAssign(&stmt->assign);
+  stmt->is_procedural = Bool();
+  stmt->for_init_lhs = Str();
+  stmt->for_init_rhs = Expr();
+  stmt->for_condition = Expr();
+  stmt->for_step_lhs = Str();
+  stmt->for_step_rhs = Expr();
+  Statements(&stmt->for_body);
+  stmt->while_condition = Expr();
+  Statements(&stmt->while_body);
+  stmt->repeat_count = Expr();
+  Statements(&stmt->repeat_body);
+  stmt->delay = Expr();
+  Statements(&stmt->delay_body);
+  stmt->event_edge = Enum<EventEdgeKind>();
+  stmt->event_expr = Expr();
+  List(&stmt->event_items, [&](EventItem* item) {
+    item->edge = Enum<EventEdgeKind>();
+    item->expr = Expr();
+  });
+  Statements(&stmt->event_body);
+  stmt->wait_condition = Expr();
+  Statements(&stmt->wait_body);
+  Statements(&stmt->forever_body);
+  Statements(&stmt->fork_branches);
+  stmt->disable_target = Str();
+  stmt->task_name = Str();
+  Exprs(&stmt->task_args);
+  stmt->trigger_target = Str();
+  stmt->force_target = Str();
+  stmt->release_target = Str();
+  stmt->condition = Expr();
+  Statements(&stmt->then_branch);
+  Statements(&stmt->else_branch);
+  Statements(&stmt->block);
+  stmt->block_label = Str();
+  stmt->case_expr = Expr();
+  List(&stmt->case_items, [&](CaseItem* item) {
+    Exprs(&item->labels);
+    Statements(&item->body);
+  });
+  Statements(&stmt->default_branch);
+}
+
+void ImageReader::Limit(TimingCheckLimit* limit) {
+  limit->min = Expr();
+  limit->typ = Expr();
+  limit->max = Expr();
+}
+
+void ImageReader::Event(TimingCheckEvent* event) {
+  event->edge = Enum<EventEdgeKind>();
+  event->has_edge_list = Bool();
+  List(&event->edge_list, [&](TimingEdgePattern* pattern) {
+    pattern->from = Enum<TimingEdgeState>();
+    pattern->to = Enum<TimingEdgeState>();
+    pattern->raw = Str();
+  });
+  event->expr = Expr();
+  event->cond = Expr();
+  event->raw_expr = Str();
+  event->raw_cond = Str();
+}
+
+void ImageReader::Module(gpga::Module* module) {
+  module->name = Str();
+  module->timescale = Str();
+  List(&module->ports, [&](Port* port) {
+    port->dir = Enum<PortDir>();
+    port->name = Str();
+    port->width = I32();
+    port->is_signed = Bool();
+    port->is_real = Bool();
+    port->is_declared = Bool();
+    port->msb_expr = SharedExpr();
+    port->lsb_expr = SharedExpr();
+  });
+  List(&module->nets, [&](Net* net) {
+    net->type = Enum<NetType>();
+    net->name = Str();
+    net->width = I32();
+    net->is_signed = Bool();
+    net->is_real = Bool();
+    net->charge = Enum<ChargeStrength>();
+    net->msb_expr = SharedExpr();
+    net->lsb_expr = SharedExpr();
+    net->array_size = I32();
+    List(&net->array_dims, [&](ArrayDim* dim) {
+      dim->size = I32();
+      dim->msb_expr = SharedExpr();
+      dim->lsb_expr = SharedExpr();
+    });
+  });
+  List(&module->assigns, [&](Assign* assign) {
+    assign->lhs = Str();
+    assign->lhs_msb = I32();
+    assign->lhs_lsb = I32();
+    assign->lhs_has_range = Bool();
+    assign->rhs = Expr();
+    assign->strength0 = Enum<Strength>();
+    assign->strength1 = Enum<Strength>();
+    assign->has_strength = Bool();
+    assign->is_implicit = Bool();
+    assign->is_derived = Bool();
+    assign->origin_depth = I32();
+  });
+  List(&module->switches, [&](Switch* sw) {
+    sw->kind = Enum<SwitchKind>();
+    sw->a = Str();
+    sw->b = Str();
+    sw->control = Expr();
+    sw->control_n = Expr();
+    sw->strength0 = Enum<Strength>();
+    sw->strength1 = Enum<Strength>();
+    sw->has_strength = Bool();
+  });
+  List(&module->instances, [&](Instance* instance) {
+    instance->module_name = Str();
+    instance->name = Str();
+    instance->has_array = Bool();
+    instance->array_msb = Expr();
+    instance->array_lsb = Expr();
+    List(&instance->param_overrides, [&](ParamOverride* param) {
+      param->name = Str();
+      param->expr = Expr();
+    });
+    List(&instance->connections, [&](Connection* connection) {
+      connection->port = Str();
+      connection->expr = Expr();
+    });
+  });
+  List(&module->always_blocks, [&](AlwaysBlock* block) {
+    block->edge = Enum<EdgeKind>();
+    block->clock = Str();
+    block->sensitivity = Str();
+    block->is_synthesized = Bool();
+    block->is_decl_init = Bool();
+    block->origin_depth = I32();
+    Statements(&block->statements);
+  });
+  List(&module->parameters, [&](Parameter* param) {
+    param->name = Str();
+    param->value = Expr();
+    param->is_local = Bool();
+    param->is_real = Bool();
+  });
+  List(&module->functions, [&](Function* func) {
+    func->name = Str();
+    func->width = I32();
+    func->is_signed = Bool();
+    func->is_real = Bool();
+    func->msb_expr = SharedExpr();
+    func->lsb_expr = SharedExpr();
+    List(&func->args, [&](FunctionArg* arg) {
+      arg->name = Str();
+      arg->width = I32();
+      arg->is_signed = Bool();
+      arg->is_real = Bool();
+      arg->msb_expr = SharedExpr();
+      arg->lsb_expr = SharedExpr();
+    });
+    List(&func->locals, [&](LocalVar* local) {
+      local->name = Str();
+      local->width = I32();
+      local->is_signed = Bool();
+      local->is_real = Bool();
+    });
+    Statements(&func->body);
+    func->body_expr = Expr();
+  });
+  List(&module->tasks, [&](Task* task) {
+    task->name = Str();
+    List(&task->args, [&](TaskArg* arg) {
+      arg->dir = Enum<TaskArgDir>();
+      arg->name = Str();
+      arg->width = I32();
+      arg->is_signed = Bool();
+      arg->is_real = Bool();
+      arg->msb_expr = SharedExpr();
+      arg->lsb_expr = SharedExpr();
+    });
+    Statements(&task->body);
+  });
+  List(&module->events, [&](EventDecl* event) { event->name = Str(); });
+  List(&module->defparams, [&](DefParam* defparam) {
+    defparam->instance = Str();
+    defparam->param = Str();
+    defparam->expr = Expr();
+    defparam->line = I32();
+    defparam->column = I32();
+  });
+  List(&module->timing_checks, [&](TimingCheck* check) {
+    check->name = Str();
+    check->edge = Str();
+    check->signal = Str();
+    check->condition = Str();
+    check->kind = Enum<TimingCheckKind>();
+    Event(&check->data_event);
+    Event(&check->ref_event);
+    Limit(&check->limit);
+    Limit(&check->limit2);
+    check->threshold = Expr();
+    check->check_cond = Expr();
+    check->event_based_flag = Expr();
+    check->remain_active_flag = Expr();
+    check->notifier = Str();
+    check->delayed_ref = Str();
+    check->delayed_data = Str();
+    check->line = I32();
+    check->column = I32();
+  });
+  List(&module->specify_paths, [&](SpecifyPath* path) {
+    path->kind = Enum<SpecifyPathKind>();
+    path->polarity = Enum<SpecifyPathPolarity>();
+    Event(&path->input_event);
+    path->data_expr = Expr();
+    SeqAssign(&path->target);
+    List(&path->delays, [&](TimingCheckLimit* limit) { Limit(limit); });
+    path->condition = Expr();
+    path->is_conditional = Bool();
+    path->is_ifnone = Bool();
+    path->showcancelled = Bool();
+    path->pulse_input = Str();
+    Limit(&path->pulse_reject);
+    Limit(&path->pulse_error);
+    path->has_pulse = Bool();
+    path->has_pulse_error = Bool();
+    path->line = I32();
+    path->column = I32();
+  });
+  std::vector<std::string> pulse_keys;
+  List(&pulse_keys, [&](std::string* key) {
+    *key = Str();
+    PathPulseSpec& spec = module->path_pulses[*key];
+    spec.name = Str();
+    spec.input = Str();
+    spec.output = Str();
+    Limit(&spec.reject);
+    Limit(&spec.error);
+    spec.has_error = Bool();
+  });
+  std::vector<std::string> labels;
+  List(&labels, [&](std::string* label) { *label = Str(); });
+  module->generate_labels.insert(labels.begin(), labels.end());
+  module->unconnected_drive = Enum<UnconnectedDrive>();
+}
+
+std::vector<std::string> SortedNames(
+    const std::unordered_set<std::string>& names) {
+  std::vector<std::string> sorted(names.begin(), names.end());
+  std::sort(sorted.begin(), sorted.end());
+  return sorted;
+}
+
+}  // namespace
+
+void SerializeDesignImage(const ElaboratedDesign& design,
+                          const std::unordered_set<std::string>& two_state_nets,
+                          const PackedStatePlan& packed, std::string* out) {
+  out->clear();
+  ImageWriter w(out);
+  w.U32(kDesignImageMagic);
+  w.U32(kDesignImageVersion);
+  w.Module(design.top);
+  std::vector<std::pair<std::string, std::string>> hier(
+      design.flat_to_hier.begin(), design.flat_to_hier.end());
+  std::sort(hier.begin(), hier.end());
+  w.List(hier, [&](const std::pair<std::string, std::string>& entry) {
+    w.Str(entry.first);
+    w.Str(entry.second);
+  });
+  w.U64(design.stats.instances);
+  w.U64(design.stats.bodies_built);
+  w.U64(design.stats.bodies_reused);
+  w.U64(design.stats.bodies_flattened);
+  w.List(design.instance_groups, [&](const InstanceGroup& group) {
+    w.Str(group.module_name);
+    w.List(group.members, [&](const std::string& name) { w.Str(name); });
+    w.List(group.prefixes, [&](const std::string& name) { w.Str(name); });
+  });
+  w.List(SortedNames(two_state_nets),
+         [&](const std::string& name) { w.Str(name); });
+  w.U32(packed.bits.group_count);
+  std::vector<std::string> bit_names;
+  for (const auto& entry : packed.bits.slots) {
+    bit_names.push_back(entry.first);
+  }
+  std::sort(bit_names.begin(), bit_names.end());
+  w.List(bit_names, [&](const std::string& name) {
+    const PackedBitSlot& slot = packed.bits.slots.at(name);
+    w.Str(name);
+    w.U32(slot.group);
+    w.U32(slot.val_bit);
+    w.I32(slot.xz_bit);
+  });
+  w.List(packed.segments, [&](const PackedStateSegment& segment) {
+    w.Str(segment.name);
+    w.Bool(segment.is_xz);
+    w.U32(segment.elem_size);
+    w.U32(segment.array_size);
+  });
+}
+
+bool DeserializeDesignImage(const std::string& bytes, DesignImage* out,
+                            std::string* error) {
+  ImageReader r(bytes);
+  if (r.U32() != kDesignImageMagic || r.U32() != kDesignImageVersion) {
+    if (error) {
+      *error = "not a design image of this version";
+    }
+    return false;
+  }
+  DesignImage image;
+  r.Module(&image.design.top);
+  std::vector<std::pair<std::string, std::string>> hier;
+  r.List(&hier, [&](std::pair<std::string, std::string>* entry) {
+    entry->first = r.Str();
+    entry->second = r.Str();
+  });
+  image.design.flat_to_hier.insert(hier.begin(), hier.end());
+  image.design.stats.instances = r.U64();
+  image.design.stats.bodies_built = r.U64();
+  image.design.stats.bodies_reused = r.U64();
+  image.design.stats.bodies_flattened = r.U64();
+  r.List(&image.design.instance_groups, [&](InstanceGroup* group) {
+    group->module_name = r.Str();
+    r.List(&group->members, [&](std::string* name) { *name = r.Str(); });
+    r.List(&group->prefixes, [&](std::string* name) { *name = r.Str(); });
+  });
+  std::vector<std::string> two_state;
+  r.List(&two_state, [&](std::string* name) { *name = r.Str(); });
+  image.two_state_nets.insert(two_state.begin(), two_state.end());
+  image.packed.bits.group_count = r.U32();
+  std::vector<std::string> bit_names;
+  r.List(&bit_names, [&](std::string* name) {
+    *name = r.Str();
+    PackedBitSlot& slot = image.packed.bits.slots[*name];
+    slot.group = r.U32();
+    slot.val_bit = r.U32();
+    slot.xz_bit = r.I32();
+  });
+  r.List(&image.packed.segments, [&](PackedStateSegment* segment) {
+    segment->name = r.Str();
+    segment->is_xz = r.Bool();
+    segment->elem_size = r.U32();
+    segment->array_size = r.U32();
+  });
+  if (r.failed() || !r.AtEnd()) {
+    if (error) {
+      *error = "truncated or corrupt design image";
+    }
+    return false;
+  }
+  *out = std::move(image);
+  return true;
+}
+
+}  // namespace gpga
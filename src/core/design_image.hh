@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "core/bit_packing.hh"
+#include "core/elaboration.hh"
+
+namespace gpga {
+
+// Order of the packed state buffer (gpga_state) that does not depend on the
+// instance count: the --pack-bits bitset groups, then one segment per entry
+// in the order codegen emits them. The host turns it into byte offsets for a
+// given count.
+struct PackedStateSegment {
+  // Empty for the decay segment of the trireg before it.
+  std::string name;
+  bool is_xz = false;
+  uint32_t elem_size = 0u;
+  uint32_t array_size = 1u;
+};
+
+struct PackedStatePlan {
+  PackedBitLayout bits;
+  std::vector<PackedStateSegment> segments;
+};
+
+// Everything --run takes from the frontend, stored with the cached
+// artifacts so a cache hit skips parse and elaboration.
+struct DesignImage {
+  ElaboratedDesign design;
+  // FindTwoStateNets(design.top) for --prune-xz --4state, else empty.
+  std::unordered_set<std::string> two_state_nets;
+  PackedStatePlan packed;
+};
+
+void SerializeDesignImage(const ElaboratedDesign& design,
+                          const std::unordered_set<std::string>& two_state_nets,
+                          const PackedStatePlan& packed, std::string* out);
+// Fails on a truncated or corrupt image, or one from another image version.
+bool DeserializeDesignImage(const std::string& bytes, DesignImage* out,
+                            std::string* error);
+
+}  // namespace gpga
@@ -24,7 +24,66 @@ const Module* FindModule(const Program& program, const std::string& name) {
   return nullptr;
 }
 
+// Name -> position index over the nets of the module being flattened. The
+// flat module has tens of thousands of nets and only ever grows, so lookups
+// on it hash instead of scanning; nets appended since the last lookup are
+// indexed on demand.
+struct NetIndex {
+  const Module* module = nullptr;
+  size_t indexed = 0;
+  std::unordered_map<std::string, size_t> by_name;
+};
+
+thread_local NetIndex* g_net_index = nullptr;
+
+class NetIndexScope {
+ public:
+  explicit NetIndexScope(const Module& module) : previous_(g_net_index) {
+    index_.module = &module;
+    g_net_index = &index_;
+  }
+  ~NetIndexScope() { g_net_index = previous_; }
+  NetIndexScope(const NetIndexScope&) = delete;
+  NetIndexScope& operator=(const NetIndexScope&) = delete;
+
+ private:
+  NetIndex index_;
+  NetIndex* previous_;
+};
+
+// False when `module` has no index in scope, or the index no longer matches
+// its nets; the caller then scans.
+bool FindIndexedNet(const Module& module, const std::string& name,
+                    const Net** out) {
+  NetIndex* index = g_net_index;
+  if (!index || index->module != &module) {
+    return false;
+  }
+  if (module.nets.size() < index->indexed) {
+    index->by_name.clear();
+    index->indexed = 0;
+  }
+  for (; index->indexed < module.nets.size(); ++index->indexed) {
+    // First declaration wins, like the scan.
+    index->by_name.emplace(module.nets[index->indexed].name, index->indexed);
+  }
+  auto it = index->by_name.find(name);
+  if (it == index->by_name.end()) {
+    *out = nullptr;
+    return true;
+  }
+  if (module.nets[it->second].name != name) {
+    return false;
+  }
+  *out = &module.nets[it->second];
+  return true;
+}
+
 const Net* FindNet(const Module& module, const std::string& name) {
+  const Net* indexed = nullptr;
+  if (FindIndexedNet(module, name, &indexed)) {
+    return indexed;
+  }
   for (const auto& net : module.nets) {
     if (net.name == name) {
       return &net;
@@ -3786,10 +3845,8 @@ int SignalWidth(const Module& module, const std::string& name) {
       return port.width;
     }
   }
-  for (const auto& net : module.nets) {
-    if (net.name == name) {
-      return net.width;
-    }
+  if (const Net* net = FindNet(module, name)) {
+    return net->width;
   }
   return 32;
 }
@@ -3800,10 +3857,8 @@ bool SignalIsReal(const Module& module, const std::string& name) {
       return port.is_real;
     }
   }
-  for (const auto& net : module.nets) {
-    if (net.name == name) {
-      return net.is_real;
-    }
+  if (const Net* net = FindNet(module, name)) {
+    return net->is_real;
   }
   return false;
 }
@@ -6209,6 +6264,638 @@ void WarnNonblockingInCombAlways(const Module& flat,
   }
 }
 
+// Appends the body of one module instance (continuous assigns, switches and
+// always blocks) to `out`, resolving parameters and simplifying against the
+// signals already declared in `out`.
+bool FlattenModuleBody(
+    const Module& module, const ParamBindings& params,
+    const std::function<std::string(const std::string&)>& rename,
+    int origin_depth, Module* out, Diagnostics* diagnostics) {
+  for (const auto& assign : module.assigns) {
+    Assign flattened;
+    flattened.lhs = rename(assign.lhs);
+    flattened.lhs_has_range = assign.lhs_has_range;
+    flattened.lhs_msb = assign.lhs_msb;
+    flattened.lhs_lsb = assign.lhs_lsb;
+    flattened.strength0 = assign.strength0;
+    flattened.strength1 = assign.strength1;
+    flattened.has_strength = assign.has_strength;
+    flattened.is_implicit = assign.is_implicit;
+    flattened.is_derived = assign.is_derived;
+    flattened.origin_depth = origin_depth;
+    if (assign.rhs) {
+      flattened.rhs =
+          CloneExprWithParams(*assign.rhs, rename, params, &module,
+                              diagnostics, nullptr);
+      if (!flattened.rhs) {
+        return false;
+      }
+      flattened.rhs = SimplifyExpr(std::move(flattened.rhs), *out);
+    } else {
+      flattened.rhs = nullptr;
+    }
+    out->assigns.push_back(std::move(flattened));
+  }
+  for (const auto& sw : module.switches) {
+    Switch flattened;
+    flattened.kind = sw.kind;
+    flattened.a = rename(sw.a);
+    flattened.b = rename(sw.b);
+    flattened.strength0 = sw.strength0;
+    flattened.strength1 = sw.strength1;
+    flattened.has_strength = sw.has_strength;
+    if (sw.control) {
+      flattened.control = CloneExprWithParams(*sw.control, rename, params,
+                                              &module, diagnostics, nullptr);
+      if (!flattened.control) {
+        return false;
+      }
+      flattened.control = SimplifyExpr(std::move(flattened.control), *out);
+    }
+    if (sw.control_n) {
+      flattened.control_n = CloneExprWithParams(*sw.control_n, rename, params,
+                                                &module, diagnostics, nullptr);
+      if (!flattened.control_n) {
+        return false;
+      }
+      flattened.control_n = SimplifyExpr(std::move(flattened.control_n), *out);
+    }
+    out->switches.push_back(std::move(flattened));
+  }
+  for (const auto& block : module.always_blocks) {
+    AlwaysBlock flattened;
+    flattened.edge = block.edge;
+    flattened.clock = rename(block.clock);
+    flattened.sensitivity = block.sensitivity;
+    flattened.is_synthesized = block.is_synthesized;
+    flattened.is_decl_init = block.is_decl_init;
+    flattened.origin_depth = origin_depth;
+    if (!CloneStatementList(block.statements, rename, params, module, *out,
+                            &flattened.statements, diagnostics)) {
+      return false;
+    }
+    out->always_blocks.push_back(std::move(flattened));
+  }
+  return true;
+}
+
+// Module-local names inside a cached instance body carry this mark in place
+// of the instance prefix. It cannot occur in a Verilog identifier, so
+// replaying the body under a prefix is a plain substitution.
+constexpr char kBodyTemplateLocalMark = '\x01';
+
+// Parameter-resolved, simplified body shared by every instance of one
+// (module, ParamBindings) pair. `context` holds the resolved port nets (the
+// first `port_net_count` entries), the module's own nets and events, and the
+// flattened body, all with marked local names.
+struct InstanceBodyTemplate {
+  bool usable = false;
+  size_t port_net_count = 0;
+  Module context;
+  // Index into InstanceBodyCache::groups of the instances replaying it.
+  size_t group = 0;
+};
+
+struct InstanceBodyCache {
+  std::unordered_map<const Module*,
+                     std::unordered_map<std::string, InstanceBodyTemplate>>
+      entries;
+  std::vector<InstanceGroup> groups;
+  ElaborationStats* stats = nullptr;
+};
+
+void AppendKeyBytes(const void* data, size_t size, std::string* key) {
+  key->append(static_cast<const char*>(data), size);
+}
+
+void AppendKeyString(const std::string& value, std::string* key) {
+  const uint64_t size = value.size();
+  AppendKeyBytes(&size, sizeof(size), key);
+  key->append(value);
+}
+
+void AppendExprKey(const Expr* expr, std::string* key) {
+  if (!expr) {
+    key->push_back('-');
+    return;
+  }
+  key->push_back('+');
+  key->push_back(static_cast<char>(expr->kind));
+  AppendKeyString(expr->ident, key);
+  AppendKeyString(expr->string_value, key);
+  const uint64_t words[4] = {expr->number, expr->value_bits, expr->x_bits,
+                             expr->z_bits};
+  AppendKeyBytes(words, sizeof(words), key);
+  const int ints[7] = {expr->number_width, expr->msb,   expr->lsb,
+                       expr->indexed_width, expr->repeat, 0, 0};
+  AppendKeyBytes(ints, sizeof(ints), key);
+  const char flags[10] = {expr->has_width,     expr->has_base,
+                          expr->base_char,     expr->is_signed,
+                          expr->is_real_literal, expr->op,
+                          expr->unary_op,      expr->has_range,
+                          expr->indexed_range, expr->indexed_desc};
+  AppendKeyBytes(flags, sizeof(flags), key);
+  AppendExprKey(expr->operand.get(), key);
+  AppendExprKey(expr->lhs.get(), key);
+  AppendExprKey(expr->rhs.get(), key);
+  AppendExprKey(expr->condition.get(), key);
+  AppendExprKey(expr->then_expr.get(), key);
+  AppendExprKey(expr->else_expr.get(), key);
+  AppendExprKey(expr->base.get(), key);
+  AppendExprKey(expr->index.get(), key);
+  AppendExprKey(expr->msb_expr.get(), key);
+  AppendExprKey(expr->lsb_expr.get(), key);
+  AppendExprKey(expr->repeat_expr.get(), key);
+  for (const auto* list : {&expr->elements, &expr->call_args}) {
+    const uint64_t count = list->size();
+    AppendKeyBytes(&count, sizeof(count), key);
+    for (const auto& element : *list) {
+      AppendExprKey(element.get(), key);
+    }
+  }
+}
+
+// Canonical byte string for a binding set; equal keys clone identically.
+std::string ParamBindingsKey(const ParamBindings& params) {
+  std::string key;
+  std::vector<const std::string*> names;
+  auto sorted_names = [&](const auto& map) {
+    names.clear();
+    for (const auto& entry : map) {
+      names.push_back(&entry.first);
+    }
+    std::sort(names.begin(), names.end(),
+              [](const std::string* a, const std::string* b) {
+                return *a < *b;
+              });
+  };
+  sorted_names(params.values);
+  for (const auto* name : names) {
+    AppendKeyString(*name, &key);
+    AppendKeyBytes(&params.values.at(*name), sizeof(int64_t), &key);
+  }
+  key.push_back('|');
+  sorted_names(params.real_values);
+  for (const auto* name : names) {
+    AppendKeyString(*name, &key);
+    AppendKeyBytes(&params.real_values.at(*name), sizeof(uint64_t), &key);
+  }
+  key.push_back('|');
+  sorted_names(params.exprs);
+  for (const auto* name : names) {
+    AppendKeyString(*name, &key);
+    AppendExprKey(params.exprs.at(*name).get(), &key);
+  }
+  return key;
+}
+
+// Cloning a while loop, or an assignment to a bound name, looks signals up in
+// the flat module by their unprefixed source name, which a shared body
+// cannot reproduce; such modules are flattened per instance.
+bool StatementAllowsBodyTemplate(const Statement& statement,
+                                 const ParamBindings& params,
+                                 std::vector<std::string>* loop_vars) {
+  if (statement.kind == StatementKind::kWhile) {
+    return false;
+  }
+  if (statement.kind == StatementKind::kAssign ||
+      statement.kind == StatementKind::kForce ||
+      statement.kind == StatementKind::kRelease) {
+    const std::string& lhs = statement.assign.lhs;
+    if (params.values.count(lhs) > 0 || params.real_values.count(lhs) > 0 ||
+        params.exprs.count(lhs) > 0 ||
+        std::find(loop_vars->begin(), loop_vars->end(), lhs) !=
+            loop_vars->end()) {
+      return false;
+    }
+  }
+  auto allows = [&](const std::vector<Statement>& body) {
+    for (const auto& inner : body) {
+      if (!StatementAllowsBodyTemplate(inner, params, loop_vars)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (statement.kind == StatementKind::kFor) {
+    loop_vars->push_back(statement.for_init_lhs);
+    const bool ok = allows(statement.for_body);
+    loop_vars->pop_back();
+    if (!ok) {
+      return false;
+    }
+  }
+  for (const auto& item : statement.case_items) {
+    if (!allows(item.body)) {
+      return false;
+    }
+  }
+  return allows(statement.then_branch) && allows(statement.else_branch) &&
+         allows(statement.block) && allows(statement.default_branch) &&
+         allows(statement.repeat_body) && allows(statement.delay_body) &&
+         allows(statement.event_body) && allows(statement.wait_body) &&
+         allows(statement.forever_body) && allows(statement.fork_branches);
+}
+
+// Rewrites a marked local name to `prefix + name`; fails on any other
+// non-empty name, which means the body referenced something non-local.
+bool RebaseTemplateName(const std::string& name, const std::string& prefix,
+                        std::string* out) {
+  if (name.empty()) {
+    out->clear();
+    return true;
+  }
+  if (name.front() != kBodyTemplateLocalMark) {
+    return false;
+  }
+  out->reserve(prefix.size() + name.size() - 1);
+  out->assign(prefix);
+  out->append(name, 1, std::string::npos);
+  return true;
+}
+
+bool RebaseTemplateExpr(Expr* expr, const std::string& prefix) {
+  if (!expr) {
+    return true;
+  }
+  if (expr->kind == ExprKind::kIdentifier) {
+    std::string name;
+    if (!RebaseTemplateName(expr->ident, prefix, &name)) {
+      return false;
+    }
+    expr->ident = std::move(name);
+  }
+  for (Expr* child : {expr->operand.get(), expr->lhs.get(), expr->rhs.get(),
+                      expr->condition.get(), expr->then_expr.get(),
+                      expr->else_expr.get(), expr->base.get(),
+                      expr->index.get(), expr->msb_expr.get(),
+                      expr->lsb_expr.get(), expr->repeat_expr.get()}) {
+    if (!RebaseTemplateExpr(child, prefix)) {
+      return false;
+    }
+  }
+  for (const auto* list : {&expr->elements, &expr->call_args}) {
+    for (const auto& element : *list) {
+      if (!RebaseTemplateExpr(element.get(), prefix)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ReplayTemplateExpr(const std::unique_ptr<Expr>& expr,
+                        const std::string& prefix,
+                        std::unique_ptr<Expr>* out) {
+  if (!expr) {
+    out->reset();
+    return true;
+  }
+  *out = gpga::CloneExpr(*expr);
+  return RebaseTemplateExpr(out->get(), prefix);
+}
+
+bool ReplayTemplateStatements(const std::vector<Statement>& statements,
+                              const std::string& prefix,
+                              std::vector<Statement>* out);
+
+bool ReplayTemplateStatement(const Statement& statement,
+                             const std::string& prefix, Statement* out) {
+  out->kind = statement.kind;
+  out->case_kind = statement.case_kind;
+  out->is_procedural = statement.is_procedural;
+  const SequentialAssign& assign = statement.assign;
+  if (!RebaseTemplateName(assign.lhs, prefix, &out->assign.lhs) ||
+      !ReplayTemplateExpr(assign.lhs_index, prefix, &out->assign.lhs_index) ||
+      !ReplayTemplateExpr(assign.lhs_msb_expr, prefix,
+                          &out->assign.lhs_msb_expr) ||
+      !ReplayTemplateExpr(assign.lhs_lsb_expr, prefix,
+                          &out->assign.lhs_lsb_expr) ||
+      !ReplayTemplateExpr(assign.rhs, prefix, &out->assign.rhs) ||
+      !ReplayTemplateExpr(assign.delay, prefix, &out->assign.delay)) {
+    return false;
+  }
+  out->assign.lhs_indices.resize(assign.lhs_indices.size());
+  for (size_t i = 0; i < assign.lhs_indices.size(); ++i) {
+    if (!ReplayTemplateExpr(assign.lhs_indices[i], prefix,
+                            &out->assign.lhs_indices[i])) {
+      return false;
+    }
+  }
+  out->assign.lhs_has_range = assign.lhs_has_range;
+  out->assign.lhs_indexed_range = assign.lhs_indexed_range;
+  out->assign.lhs_indexed_desc = assign.lhs_indexed_desc;
+  out->assign.lhs_indexed_width = assign.lhs_indexed_width;
+  out->assign.lhs_msb = assign.lhs_msb;
+  out->assign.lhs_lsb = assign.lhs_lsb;
+  out->assign.nonblocking = assign.nonblocking;
+  out->for_init_lhs = statement.for_init_lhs;
+  out->for_step_lhs = statement.for_step_lhs;
+  out->event_edge = statement.event_edge;
+  out->task_name = statement.task_name;
+  out->block_label = statement.block_label;
+  if (!ReplayTemplateExpr(statement.for_init_rhs, prefix,
+                          &out->for_init_rhs) ||
+      !ReplayTemplateExpr(statement.for_condition, prefix,
+                          &out->for_condition) ||
+      !ReplayTemplateExpr(statement.for_step_rhs, prefix,
+                          &out->for_step_rhs) ||
+      !ReplayTemplateExpr(statement.while_condition, prefix,
+                          &out->while_condition) ||
+      !ReplayTemplateExpr(statement.repeat_count, prefix,
+                          &out->repeat_count) ||
+      !ReplayTemplateExpr(statement.delay, prefix, &out->delay) ||
+      !ReplayTemplateExpr(statement.event_expr, prefix, &out->event_expr) ||
+      !ReplayTemplateExpr(statement.wait_condition, prefix,
+                          &out->wait_condition) ||
+      !ReplayTemplateExpr(statement.condition, prefix, &out->condition) ||
+      !ReplayTemplateExpr(statement.case_expr, prefix, &out->case_expr)) {
+    return false;
+  }
+  if (!RebaseTemplateName(statement.disable_target, prefix,
+                          &out->disable_target) ||
+      !RebaseTemplateName(statement.trigger_target, prefix,
+                          &out->trigger_target) ||
+      !RebaseTemplateName(statement.force_target, prefix,
+                          &out->force_target) ||
+      !RebaseTemplateName(statement.release_target, prefix,
+                          &out->release_target)) {
+    return false;
+  }
+  out->event_items.resize(statement.event_items.size());
+  for (size_t i = 0; i < statement.event_items.size(); ++i) {
+    out->event_items[i].edge = statement.event_items[i].edge;
+    if (!ReplayTemplateExpr(statement.event_items[i].expr, prefix,
+                            &out->event_items[i].expr)) {
+      return false;
+    }
+  }
+  out->task_args.resize(statement.task_args.size());
+  for (size_t i = 0; i < statement.task_args.size(); ++i) {
+    if (!ReplayTemplateExpr(statement.task_args[i], prefix,
+                            &out->task_args[i])) {
+      return false;
+    }
+  }
+  out->case_items.resize(statement.case_items.size());
+  for (size_t i = 0; i < statement.case_items.size(); ++i) {
+    const CaseItem& item = statement.case_items[i];
+    CaseItem& out_item = out->case_items[i];
+    out_item.labels.resize(item.labels.size());
+    for (size_t j = 0; j < item.labels.size(); ++j) {
+      if (!ReplayTemplateExpr(item.labels[j], prefix, &out_item.labels[j])) {
+        return false;
+      }
+    }
+    if (!ReplayTemplateStatements(item.body, prefix, &out_item.body)) {
+      return false;
+    }
+  }
+  return ReplayTemplateStatements(statement.for_body, prefix,
+                                  &out->for_body) &&
+         ReplayTemplateStatements(statement.while_body, prefix,
+                                  &out->while_body) &&
+         ReplayTemplateStatements(statement.repeat_body, prefix,
+                                  &out->repeat_body) &&
+         ReplayTemplateStatements(statement.delay_body, prefix,
+                                  &out->delay_body) &&
+         ReplayTemplateStatements(statement.event_body, prefix,
+                                  &out->event_body) &&
+         ReplayTemplateStatements(statement.wait_body, prefix,
+                                  &out->wait_body) &&
+         ReplayTemplateStatements(statement.forever_body, prefix,
+                                  &out->forever_body) &&
+         ReplayTemplateStatements(statement.fork_branches, prefix,
+                                  &out->fork_branches) &&
+         ReplayTemplateStatements(statement.then_branch, prefix,
+                                  &out->then_branch) &&
+         ReplayTemplateStatements(statement.else_branch, prefix,
+                                  &out->else_branch) &&
+         ReplayTemplateStatements(statement.block, prefix, &out->block) &&
+         ReplayTemplateStatements(statement.default_branch, prefix,
+                                  &out->default_branch);
+}
+
+bool ReplayTemplateStatements(const std::vector<Statement>& statements,
+                              const std::string& prefix,
+                              std::vector<Statement>* out) {
+  out->resize(statements.size());
+  for (size_t i = 0; i < statements.size(); ++i) {
+    if (!ReplayTemplateStatement(statements[i], prefix, &(*out)[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends the cached body under `prefix`. Fails, leaving `out` untouched, if
+// the body names anything that is not module-local.
+bool ReplayInstanceBody(const InstanceBodyTemplate& body,
+                        const std::string& prefix, int origin_depth,
+                        Module* out) {
+  const Module& context = body.context;
+  std::vector<Assign> assigns(context.assigns.size());
+  for (size_t i = 0; i < context.assigns.size(); ++i) {
+    const Assign& assign = context.assigns[i];
+    Assign& flattened = assigns[i];
+    if (!RebaseTemplateName(assign.lhs, prefix, &flattened.lhs) ||
+        !ReplayTemplateExpr(assign.rhs, prefix, &flattened.rhs)) {
+      return false;
+    }
+    flattened.lhs_has_range = assign.lhs_has_range;
+    flattened.lhs_msb = assign.lhs_msb;
+    flattened.lhs_lsb = assign.lhs_lsb;
+    flattened.strength0 = assign.strength0;
+    flattened.strength1 = assign.strength1;
+    flattened.has_strength = assign.has_strength;
+    flattened.is_implicit = assign.is_implicit;
+    flattened.is_derived = assign.is_derived;
+    flattened.origin_depth = origin_depth;
+  }
+  std::vector<Switch> switches(context.switches.size());
+  for (size_t i = 0; i < context.switches.size(); ++i) {
+    const Switch& sw = context.switches[i];
+    Switch& flattened = switches[i];
+    if (!RebaseTemplateName(sw.a, prefix, &flattened.a) ||
+        !RebaseTemplateName(sw.b, prefix, &flattened.b) ||
+        !ReplayTemplateExpr(sw.control, prefix, &flattened.control) ||
+        !ReplayTemplateExpr(sw.control_n, prefix, &flattened.control_n)) {
+      return false;
+    }
+    flattened.kind = sw.kind;
+    flattened.strength0 = sw.strength0;
+    flattened.strength1 = sw.strength1;
+    flattened.has_strength = sw.has_strength;
+  }
+  std::vector<AlwaysBlock> always_blocks(context.always_blocks.size());
+  for (size_t i = 0; i < context.always_blocks.size(); ++i) {
+    const AlwaysBlock& block = context.always_blocks[i];
+    AlwaysBlock& flattened = always_blocks[i];
+    if (!RebaseTemplateName(block.clock, prefix, &flattened.clock) ||
+        !ReplayTemplateStatements(block.statements, prefix,
+                                  &flattened.statements)) {
+      return false;
+    }
+    flattened.edge = block.edge;
+    flattened.sensitivity = block.sensitivity;
+    flattened.is_synthesized = block.is_synthesized;
+    flattened.is_decl_init = block.is_decl_init;
+    flattened.origin_depth = origin_depth;
+  }
+  for (auto& assign : assigns) {
+    out->assigns.push_back(std::move(assign));
+  }
+  for (auto& sw : switches) {
+    out->switches.push_back(std::move(sw));
+  }
+  for (auto& block : always_blocks) {
+    out->always_blocks.push_back(std::move(block));
+  }
+  return true;
+}
+
+// Clones and simplifies `module`'s body once for `params` against its own
+// resolved declarations. Leaves `out->usable` false whenever the result could
+// differ from flattening the instance in place: tasks, timing checks and
+// specify paths, non-local or hierarchical references, and any diagnostic
+// (those name the instance being flattened).
+void BuildInstanceBodyTemplate(
+    const Module& module, const ParamBindings& params,
+    const std::unordered_set<std::string>& local_names,
+    InstanceBodyTemplate* out) {
+  out->usable = false;
+  if (!module.tasks.empty() || !module.timing_checks.empty() ||
+      !module.specify_paths.empty()) {
+    return;
+  }
+  std::vector<std::string> loop_vars;
+  for (const auto& block : module.always_blocks) {
+    for (const auto& statement : block.statements) {
+      if (!StatementAllowsBodyTemplate(statement, params, &loop_vars)) {
+        return;
+      }
+    }
+  }
+
+  Diagnostics scratch;
+  Module& context = out->context;
+  std::unordered_set<std::string> net_names;
+  std::unordered_map<std::string, std::string> flat_to_hier;
+  const std::string mark(1, kBodyTemplateLocalMark);
+  for (const auto& port : module.ports) {
+    int width = port.width;
+    if (!ResolveRangeWidth(port.width, port.msb_expr, port.lsb_expr, params,
+                           module, &width, &scratch,
+                           "port '" + port.name + "'")) {
+      return;
+    }
+    NetType type = NetType::kWire;
+    bool is_real = false;
+    ChargeStrength charge = ChargeStrength::kNone;
+    if (const Net* net = FindNet(module, port.name)) {
+      type = net->type;
+      is_real = net->is_real;
+      charge = net->charge;
+    }
+    if (!AddFlatNet(mark + port.name, width, port.is_signed, type, charge, {},
+                    is_real, port.name, &context, &net_names, &flat_to_hier,
+                    &scratch)) {
+      return;
+    }
+  }
+  out->port_net_count = context.nets.size();
+  for (const auto& net : module.nets) {
+    int width = net.width;
+    if (!ResolveRangeWidth(net.width, net.msb_expr, net.lsb_expr, params,
+                           module, &width, &scratch,
+                           "net '" + net.name + "'")) {
+      return;
+    }
+    std::vector<int> array_dims;
+    if (!ResolveArrayDims(net, params, module, &array_dims, &scratch,
+                          "net '" + net.name + "' array range")) {
+      return;
+    }
+    if (!AddFlatNet(mark + net.name, width, net.is_signed, net.type,
+                    net.charge, array_dims, net.is_real, net.name, &context,
+                    &net_names, &flat_to_hier, &scratch)) {
+      return;
+    }
+  }
+  for (const auto& event_decl : module.events) {
+    EventDecl marked;
+    marked.name = mark + event_decl.name;
+    context.events.push_back(std::move(marked));
+  }
+
+  bool closed = true;
+  auto mark_local = [&](const std::string& ident) -> std::string {
+    if (ident.empty()) {
+      return ident;
+    }
+    if (ident.find('.') == std::string::npos && local_names.count(ident) > 0) {
+      return mark + ident;
+    }
+    closed = false;
+    return ident;
+  };
+  if (!FlattenModuleBody(module, params, mark_local, 0, &context, &scratch) ||
+      !closed || !scratch.Items().empty()) {
+    return;
+  }
+  // Identifiers substituted from bindings bypass `mark_local`; a dry replay
+  // catches any that are not local.
+  Module dry_run;
+  if (!ReplayInstanceBody(*out, "", 0, &dry_run)) {
+    return;
+  }
+  out->usable = true;
+}
+
+// Returns the cached body for this instance of `module`, building it on
+// first use; nullptr means the instance must be flattened in place.
+const InstanceBodyTemplate* FindInstanceBodyTemplate(
+    const Module& module, const ParamBindings& params,
+    const std::string& prefix,
+    const std::unordered_map<std::string, PortBinding>& port_map,
+    const std::unordered_set<std::string>& local_names,
+    InstanceBodyCache* cache) {
+  if (!cache || prefix.empty() || port_map.size() != module.ports.size()) {
+    return nullptr;
+  }
+  for (const auto& entry : port_map) {
+    const std::string& signal = entry.second.signal;
+    if (signal.size() != prefix.size() + entry.first.size() ||
+        signal.compare(0, prefix.size(), prefix) != 0 ||
+        signal.compare(prefix.size(), std::string::npos, entry.first) != 0) {
+      return nullptr;
+    }
+  }
+  auto& by_params = cache->entries[&module];
+  auto inserted = by_params.try_emplace(ParamBindingsKey(params));
+  InstanceBodyTemplate& body = inserted.first->second;
+  if (inserted.second) {
+    BuildInstanceBodyTemplate(module, params, local_names, &body);
+    if (!body.usable) {
+      return nullptr;
+    }
+    ++cache->stats->bodies_built;
+    body.group = cache->groups.size();
+    InstanceGroup group;
+    group.module_name = module.name;
+    for (const auto& net : body.context.nets) {
+      group.members.push_back(net.name.substr(1));
+    }
+    cache->groups.push_back(std::move(group));
+  } else if (body.usable) {
+    ++cache->stats->bodies_reused;
+  } else {
+    return nullptr;
+  }
+  cache->groups[body.group].prefixes.push_back(prefix);
+  return &body;
+}
+
 bool InlineModule(const Program& program, const Module& module,
                   const std::string& prefix, const std::string& hier_prefix,
                   const ParamBindings& params,
@@ -6218,7 +6905,8 @@ bool InlineModule(const Program& program, const Module& module,
                   std::unordered_set<std::string>* net_names,
                   std::unordered_map<std::string, std::string>* flat_to_hier,
                   bool enable_4state,
-                  const std::vector<DefParam>* inherited_defparams) {
+                  const std::vector<DefParam>* inherited_defparams,
+                  InstanceBodyCache* body_cache) {
   if (stack->count(module.name) > 0) {
     diagnostics->Add(Severity::kError,
                      "recursive module instantiation detected");
@@ -6342,6 +7030,19 @@ bool InlineModule(const Program& program, const Module& module,
   const auto* prev_task_renames = g_task_renames;
   g_task_renames = &task_renames;
 
+  const InstanceBodyTemplate* body_template = nullptr;
+  if (body_cache && !prefix.empty()) {
+    ++body_cache->stats->instances;
+    std::unordered_set<std::string> local_names = port_names;
+    local_names.insert(local_net_names.begin(), local_net_names.end());
+    local_names.insert(local_event_names.begin(), local_event_names.end());
+    body_template = FindInstanceBodyTemplate(module, params, prefix, port_map,
+                                             local_names, body_cache);
+    if (!body_template) {
+      ++body_cache->stats->bodies_flattened;
+    }
+  }
+
   if (prefix.empty()) {
     out->name = module.name;
     out->unconnected_drive = module.unconnected_drive;
@@ -6433,6 +7134,32 @@ bool InlineModule(const Program& program, const Module& module,
       }
       out->tasks.push_back(std::move(flat_task));
     }
+  } else if (body_template) {
+    // Declarations were resolved with the body; only the names change.
+    const auto& nets = body_template->context.nets;
+    for (size_t i = body_template->port_net_count; i < nets.size(); ++i) {
+      const Net& net = nets[i];
+      const std::string local_name = net.name.substr(1);
+      std::vector<int> array_dims;
+      for (const auto& dim : net.array_dims) {
+        array_dims.push_back(dim.size);
+      }
+      if (!AddFlatNet(prefix + local_name, net.width, net.is_signed, net.type,
+                      net.charge, array_dims, net.is_real,
+                      hier_prefix + "." + local_name, out, net_names,
+                      flat_to_hier, diagnostics)) {
+        return false;
+      }
+    }
+    for (const auto& event_decl : module.events) {
+      EventDecl flat_event;
+      flat_event.name = prefix + event_decl.name;
+      out->events.push_back(std::move(flat_event));
+      if (!register_event(prefix + event_decl.name,
+                          hier_prefix + "." + event_decl.name)) {
+        return false;
+      }
+    }
   } else {
     for (const auto& port : module.ports) {
       if (port_map.find(port.name) != port_map.end()) {
@@ -6507,70 +7234,16 @@ bool InlineModule(const Program& program, const Module& module,
     }
   }
 
-  for (const auto& assign : module.assigns) {
-    Assign flattened;
-    flattened.lhs = rename(assign.lhs);
-    flattened.lhs_has_range = assign.lhs_has_range;
-    flattened.lhs_msb = assign.lhs_msb;
-    flattened.lhs_lsb = assign.lhs_lsb;
-    flattened.strength0 = assign.strength0;
-    flattened.strength1 = assign.strength1;
-    flattened.has_strength = assign.has_strength;
-    flattened.is_implicit = assign.is_implicit;
-    flattened.is_derived = assign.is_derived;
-    flattened.origin_depth = origin_depth;
-    if (assign.rhs) {
-      flattened.rhs =
-          CloneExprWithParams(*assign.rhs, rename, params, &module,
-                              diagnostics, nullptr);
-      if (!flattened.rhs) {
-        return false;
-      }
-      flattened.rhs = SimplifyExpr(std::move(flattened.rhs), *out);
-    } else {
-      flattened.rhs = nullptr;
-    }
-    out->assigns.push_back(std::move(flattened));
-  }
-  for (const auto& sw : module.switches) {
-    Switch flattened;
-    flattened.kind = sw.kind;
-    flattened.a = rename(sw.a);
-    flattened.b = rename(sw.b);
-    flattened.strength0 = sw.strength0;
-    flattened.strength1 = sw.strength1;
-    flattened.has_strength = sw.has_strength;
-    if (sw.control) {
-      flattened.control = CloneExprWithParams(*sw.control, rename, params,
-                                              &module, diagnostics, nullptr);
-      if (!flattened.control) {
-        return false;
-      }
-      flattened.control = SimplifyExpr(std::move(flattened.control), *out);
-    }
-    if (sw.control_n) {
-      flattened.control_n = CloneExprWithParams(*sw.control_n, rename, params,
-                                                &module, diagnostics, nullptr);
-      if (!flattened.control_n) {
-        return false;
-      }
-      flattened.control_n = SimplifyExpr(std::move(flattened.control_n), *out);
-    }
-    out->switches.push_back(std::move(flattened));
-  }
-  for (const auto& block : module.always_blocks) {
-    AlwaysBlock flattened;
-    flattened.edge = block.edge;
-    flattened.clock = rename(block.clock);
-    flattened.sensitivity = block.sensitivity;
-    flattened.is_synthesized = block.is_synthesized;
-    flattened.is_decl_init = block.is_decl_init;
-    flattened.origin_depth = origin_depth;
-    if (!CloneStatementList(block.statements, rename, params, module, *out,
-                            &flattened.statements, diagnostics)) {
+  if (body_template) {
+    if (!ReplayInstanceBody(*body_template, prefix, origin_depth, out)) {
+      diagnostics->Add(Severity::kError,
+                       "internal error: cached body of module '" +
+                           module.name + "' does not replay");
       return false;
     }
-    out->always_blocks.push_back(std::move(flattened));
+  } else if (!FlattenModuleBody(module, params, rename, origin_depth, out,
+                                diagnostics)) {
+    return false;
   }
 
   auto clone_timing_expr = [&](const std::unique_ptr<Expr>& expr)
@@ -7294,7 +7967,8 @@ bool InlineModule(const Program& program, const Module& module,
         child_defparams.empty() ? nullptr : &child_defparams;
     if (!InlineModule(program, *child, child_prefix, child_hier, child_params,
                       child_port_map, out, diagnostics, stack, net_names,
-                      flat_to_hier, enable_4state, child_defparam_ptr)) {
+                      flat_to_hier, enable_4state, child_defparam_ptr,
+                      body_cache)) {
       return false;
     }
     }
@@ -7353,6 +8027,7 @@ bool Elaborate(const Program& program, const std::string& top_name,
   }
 
   Module flat;
+  NetIndexScope net_index(flat);
   ParamBindings top_params;
   if (!BuildParamBindings(*top, nullptr, nullptr, &top_params, diagnostics)) {
     return false;
@@ -7361,9 +8036,12 @@ bool Elaborate(const Program& program, const std::string& top_name,
   std::unordered_set<std::string> stack;
   std::unordered_set<std::string> net_names;
   std::unordered_map<std::string, std::string> flat_to_hier;
+  ElaborationStats stats;
+  InstanceBodyCache body_cache;
+  body_cache.stats = &stats;
   if (!InlineModule(program, *top, "", top->name, top_params, port_map, &flat,
                     diagnostics, &stack, &net_names, &flat_to_hier,
-                    enable_4state, nullptr)) {
+                    enable_4state, nullptr, &body_cache)) {
     return false;
   }
 
@@ -7416,6 +8094,13 @@ bool Elaborate(const Program& program, const std::string& top_name,
 
   out_design->top = std::move(flat);
   out_design->flat_to_hier = std::move(flat_to_hier);
+  out_design->stats = stats;
+  out_design->instance_groups.clear();
+  for (auto& group : body_cache.groups) {
+    if (group.prefixes.size() > 1) {
+      out_design->instance_groups.push_back(std::move(group));
+    }
+  }
   return true;
 }
 
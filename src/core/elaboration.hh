@@ -1,16 +1,40 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "frontend/ast.hh"
 #include "utils/diagnostics.hh"
 
 namespace gpga {
 
+// Child instances elaborated, and how each instance body was produced:
+// cloned once per unique (module, parameters) and cached, replayed from that
+// cache, or flattened in place because the module cannot share a body.
+struct ElaborationStats {
+  uint64_t instances = 0;
+  uint64_t bodies_built = 0;
+  uint64_t bodies_reused = 0;
+  uint64_t bodies_flattened = 0;
+};
+
+// Instances of one module that replayed the same cached body (same module and
+// parameter bindings). `members` are the module's port and net names in
+// declaration order; an instance's flat signals are `prefix + member`.
+struct InstanceGroup {
+  std::string module_name;
+  std::vector<std::string> members;
+  std::vector<std::string> prefixes;
+};
+
 struct ElaboratedDesign {
   Module top;
   std::unordered_map<std::string, std::string> flat_to_hier;
+  ElaborationStats stats;
+  // Groups of two or more instances, for hierarchical codegen.
+  std::vector<InstanceGroup> instance_groups;
 };
 
 bool Elaborate(const Program& program, ElaboratedDesign* out_design,
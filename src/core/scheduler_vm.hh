@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gpga {
@@ -35,8 +37,19 @@ enum class SchedulerVmOp : uint32_t {
   kTaskCall = 25u,
   kRet = 26u,
   kHaltSim = 27u,
+  // Superinstructions produced by OptimizeSchedulerVmBytecode
+  // (core/scheduler_vm_opt.hh); codegen never emits them directly.
+  // kAssignRun: arg = N, followed by N kAssign/kAssignNb instruction words.
+  kAssignRun = 28u,
+  // kBranch: arg = cond id, followed by the taken and not-taken targets.
+  kBranch = 29u,
+  // kWaitEdgeLoop: arg = edge wait id, followed by the resume target.
+  kWaitEdgeLoop = 30u,
 };
 
+constexpr uint32_t kSchedulerVmOpCount =
+    static_cast<uint32_t>(SchedulerVmOp::kWaitEdgeLoop) + 1u;
+
 enum class SchedulerVmJoinKind : uint32_t {
   kAll = 0u,
   kAny = 1u,
@@ -49,6 +62,14 @@ enum class SchedulerVmDisableKind : uint32_t {
   kCrossProc = 2u,
 };
 
+// Matches GPGA_SCHED_EDGE_* in gpga_sched.h.
+enum class SchedulerVmEdgeKind : uint32_t {
+  kAny = 0u,
+  kPosedge = 1u,
+  kNegedge = 2u,
+  kList = 3u,
+};
+
 enum class SchedulerVmCondKind : uint32_t {
   kDynamic = 0u,
   kConst = 1u,
@@ -68,6 +89,11 @@ enum class SchedulerVmExprOp : uint32_t {
   kConcat = 9u,
   kCall = 10u,
   kPushConstXz = 11u,
+  // Expression registers (see OptimizeSchedulerVmExpr): kStoreReg pops the
+  // top of the stack into register arg, kLoadReg pushes register arg.
+  // Registers are local to one evaluation.
+  kLoadReg = 12u,
+  kStoreReg = 13u,
 };
 
 enum class SchedulerVmExprUnaryOp : uint32_t {
@@ -146,6 +172,17 @@ enum class SchedulerVmCaseKind : uint32_t {
   kCaseZ = 2u,
 };
 
+// How a case finds its first matching label when the selector has no X/Z
+// bits; selectors with X/Z bits always scan the entries in order. Table
+// targets are item indices, so the lowest target is the first label that
+// matches, and kSchedulerVmCaseNoTarget means no label matches.
+//   kLinear: scan the entries.
+//   kLut:    table_mask + 1 (2^width) targets, two per word, low half first.
+//   kBucket: table_mask + 1 slots of {value, target} words, probed linearly
+//            from SchedulerVmCaseSlot(value), holding the first label without
+//            don't-care bits for each value; then wild_count words with the
+//            entry indices (from entry_offset) of the casex/casez labels with
+//            don't-care bits, scanned while their target is below the hit.
 enum class SchedulerVmCaseStrategy : uint32_t {
   kLinear = 0u,
   kBucket = 1u,
@@ -168,6 +205,9 @@ constexpr uint32_t kSchedulerVmAssignFlagIsBitSelect = 1u << 3u;
 constexpr uint32_t kSchedulerVmAssignFlagIsRange = 1u << 4u;
 constexpr uint32_t kSchedulerVmAssignFlagIsIndexedRange = 1u << 5u;
 constexpr uint32_t kSchedulerVmAssignFlagWideConst = 1u << 6u;
+// rhs_expr is a cond entry id: the rhs is evaluated by the full cond
+// evaluator (real, wide and integer-power values) instead of eval_expr.
+constexpr uint32_t kSchedulerVmAssignFlagCondRhs = 1u << 7u;
 constexpr uint32_t kSchedulerVmForceFlagProcedural = 1u << 0u;
 constexpr uint32_t kSchedulerVmForceFlagFallback = 1u << 1u;
 constexpr uint32_t kSchedulerVmForceFlagOverrideReg = 1u << 2u;
@@ -195,6 +235,13 @@ constexpr uint32_t kSchedulerVmServiceArgFlagExpr = 1u << 0u;
 constexpr uint32_t kSchedulerVmServiceArgFlagTime = 1u << 1u;
 constexpr uint32_t kSchedulerVmServiceArgFlagStime = 1u << 2u;
 constexpr uint32_t kSchedulerVmServiceRetAssignFlagFallback = 1u << 0u;
+constexpr uint32_t kSchedulerVmCaseNoTarget = 0xFFFFFFFFu;
+// Cases with fewer labels keep the linear scan.
+constexpr uint32_t kSchedulerVmCaseTableMinEntries = 8u;
+constexpr uint32_t kSchedulerVmCaseLutMaxWidth = 10u;
+// A LUT is used while it has at most this many slots per label.
+constexpr uint32_t kSchedulerVmCaseLutSlotsPerEntry = 16u;
+constexpr uint64_t kSchedulerVmCaseHashMul = 0x9E3779B97F4A7C15ull;
 
 constexpr uint32_t MakeSchedulerVmInstr(SchedulerVmOp op,
                                         uint32_t arg = 0u) {
@@ -214,6 +261,35 @@ constexpr uint32_t DecodeSchedulerVmArg(uint32_t instr) {
   return instr >> kSchedulerVmOpShift;
 }
 
+// Extra bytecode words that follow an op (targets, child pids, ...). code
+// and len bound the proc the op lives in; next is the word after the op.
+inline uint32_t SchedulerVmOperandWords(SchedulerVmOp op, uint32_t arg,
+                                        const uint32_t* code, uint32_t next,
+                                        uint32_t len) {
+  switch (op) {
+    case SchedulerVmOp::kJumpIf:
+    case SchedulerVmOp::kWaitCond:
+    case SchedulerVmOp::kWaitEdgeLoop:
+      return 1u;
+    case SchedulerVmOp::kCase:
+      return (next < len) ? code[next] + 2u : 1u;
+    case SchedulerVmOp::kRepeat:
+    case SchedulerVmOp::kServiceRetBranch:
+    case SchedulerVmOp::kBranch:
+      return 2u;
+    case SchedulerVmOp::kFork:
+      return arg & kSchedulerVmForkCountMask;
+    case SchedulerVmOp::kDisable:
+      return (arg == static_cast<uint32_t>(SchedulerVmDisableKind::kCrossProc))
+                 ? 2u
+                 : 1u;
+    case SchedulerVmOp::kAssignRun:
+      return arg;
+    default:
+      return 0u;
+  }
+}
+
 constexpr uint32_t PackSchedulerVmForkArg(uint32_t count,
                                           SchedulerVmJoinKind kind) {
   return (static_cast<uint32_t>(kind) << kSchedulerVmForkJoinShift) |
@@ -229,11 +305,41 @@ constexpr SchedulerVmJoinKind DecodeSchedulerVmForkKind(uint32_t arg) {
       (arg >> kSchedulerVmForkJoinShift) & 0xFFu);
 }
 
+// Picks the lookup for a case of entry_count constant labels, wild_count of
+// which have don't-care bits that can match a known selector.
+inline SchedulerVmCaseStrategy SelectSchedulerVmCaseStrategy(
+    uint32_t width, uint32_t entry_count, uint32_t wild_count) {
+  if (width == 0u || width > 64u ||
+      entry_count < kSchedulerVmCaseTableMinEntries) {
+    return SchedulerVmCaseStrategy::kLinear;
+  }
+  if (width <= kSchedulerVmCaseLutMaxWidth &&
+      (1ull << width) <= static_cast<uint64_t>(entry_count) *
+                             kSchedulerVmCaseLutSlotsPerEntry) {
+    return SchedulerVmCaseStrategy::kLut;
+  }
+  if (static_cast<uint64_t>(wild_count) * 4u <= entry_count) {
+    return SchedulerVmCaseStrategy::kBucket;
+  }
+  return SchedulerVmCaseStrategy::kLinear;
+}
+
+constexpr uint32_t SchedulerVmCaseSlot(uint64_t value, uint32_t mask) {
+  return static_cast<uint32_t>((value * kSchedulerVmCaseHashMul) >> 32u) &
+         mask;
+}
+
 struct SchedulerVmExprTable {
   // Expression bytecode stream (stack-based ops, optional immediate words).
   std::vector<uint32_t> words;
   // Literal pool storage (implementation-defined layout per op/width).
   std::vector<uint32_t> imm_words;
+  // Registers the kLoadReg/kStoreReg ops use (every reg arg is below it).
+  uint32_t reg_count = 0u;
+  // Width of the wide evaluator (GPGA_SCHED_VM_EXPR_WIDE_BITS), 0 when no
+  // expression is wider than 64 bits. No op or signal is wider than
+  // max(64, wide_bits).
+  uint32_t wide_bits = 0u;
 };
 
 struct SchedulerVmCondEntry {
@@ -257,7 +363,10 @@ struct SchedulerVmSignalEntry {
 };
 
 constexpr uint32_t kSchedulerVmSignalFlagReal = 1u << 0u;
+// --prune-xz: proven X/Z-free; xz_slot is the shared zero slot.
+constexpr uint32_t kSchedulerVmSignalFlagTwoState = 1u << 1u;
 constexpr uint32_t kSchedulerVmExprStackMax = 32u;
+constexpr uint32_t kSchedulerVmExprRegMax = 32u;
 
 struct SchedulerVmCaseHeader {
   uint32_t kind = 0u;
@@ -267,6 +376,10 @@ struct SchedulerVmCaseHeader {
   uint32_t entry_offset = 0u;
   uint32_t expr_offset = kSchedulerVmExprNoExtra;
   uint32_t default_target = 0u;
+  // kLut/kBucket lookup table in case_words (see SchedulerVmCaseStrategy).
+  uint32_t table_offset = 0u;
+  uint32_t table_mask = 0u;
+  uint32_t wild_count = 0u;
 };
 
 struct SchedulerVmCaseEntry {
@@ -341,8 +454,22 @@ struct SchedulerVmServiceRetAssignEntry {
   uint32_t reserved = 0u;
 };
 
+// One per kWaitEdge id. Items index edge_item_expr_offsets/edge_item_kinds
+// (the per-item kind only matters for kList); @* waits index
+// edge_star_expr_offsets instead.
+struct SchedulerVmEdgeWaitEntry {
+  uint32_t kind = 0u;
+  uint32_t item_offset = 0u;
+  uint32_t item_count = 0u;
+  uint32_t star_offset = 0u;
+  uint32_t star_count = 0u;
+};
+
 struct SchedulerVmLayout {
   uint32_t proc_count = 0u;
+  // Longest proc body (at least kSchedulerVmWordsPerProc). Procs are packed
+  // back to back, so this only bounds per-proc reads; the bytecode itself is
+  // addressed through proc_offsets/proc_lengths.
   uint32_t words_per_proc = 0u;
   std::vector<uint32_t> bytecode;
   std::vector<uint32_t> proc_offsets;
@@ -364,6 +491,19 @@ struct SchedulerVmLayout {
   std::vector<uint32_t> edge_item_expr_offsets;
   std::vector<uint32_t> edge_star_expr_offsets;
   std::vector<uint32_t> repeat_expr_offsets;
+  std::vector<SchedulerVmEdgeWaitEntry> edge_wait_entries;
+  std::vector<uint32_t> edge_item_kinds;
+  // kWaitTime delay per delay id (kSchedulerVmExprNoExtra when the delay is
+  // not expressible in VM bytecode).
+  std::vector<uint32_t> delay_expr_offsets;
+};
+
+// Host-only: a continuous assign the interpreter re-evaluates whenever the
+// active region runs, so procs see the nets it drives. The rhs lives in the
+// layout's expression table; the target is the whole of signal_id.
+struct SchedulerVmContinuousAssign {
+  uint32_t signal_id = 0u;
+  uint32_t expr_offset = 0u;
 };
 
 class SchedulerVmBuilder {
@@ -399,8 +539,18 @@ class SchedulerVmExprBuilder {
     return base;
   }
 
+  // Replaces the words from word_base on (an expression being emitted) with
+  // a rewritten version that uses reg_count registers.
+  void ReplaceWords(size_t word_base, const std::vector<uint32_t>& words,
+                    uint32_t reg_count) {
+    words_.resize(word_base);
+    words_.insert(words_.end(), words.begin(), words.end());
+    reg_count_ = std::max(reg_count_, reg_count);
+  }
+
   const std::vector<uint32_t>& words() const { return words_; }
   const std::vector<uint32_t>& imm_words() const { return imm_words_; }
+  uint32_t reg_count() const { return reg_count_; }
   void Truncate(size_t word_size, size_t imm_size) {
     words_.resize(word_size);
     imm_words_.resize(imm_size);
@@ -409,6 +559,7 @@ class SchedulerVmExprBuilder {
  private:
   std::vector<uint32_t> words_;
   std::vector<uint32_t> imm_words_;
+  uint32_t reg_count_ = 0u;
 };
 
 inline bool BuildSchedulerVmLayout(
@@ -440,8 +591,13 @@ inline bool BuildSchedulerVmLayout(
   out->service_ret_entries.clear();
   out->expr_table.words.clear();
   out->expr_table.imm_words.clear();
+  out->expr_table.reg_count = 0u;
   out->edge_item_expr_offsets.clear();
   out->edge_star_expr_offsets.clear();
+  out->repeat_expr_offsets.clear();
+  out->edge_wait_entries.clear();
+  out->edge_item_kinds.clear();
+  out->delay_expr_offsets.clear();
   const uint32_t proc_count = static_cast<uint32_t>(procs.size());
   if (proc_count == 0u) {
     if (error) {
@@ -450,29 +606,91 @@ inline bool BuildSchedulerVmLayout(
     return false;
   }
   uint32_t max_len = 0u;
+  size_t total_words = 0u;
   for (const auto& proc : procs) {
     max_len = std::max<uint32_t>(max_len,
                                  static_cast<uint32_t>(proc.size()));
+    total_words += proc.size();
+  }
+  if (total_words > 0xFFFFFFFFull) {
+    if (error) {
+      *error = "scheduler VM bytecode exceeds 32-bit offsets";
+    }
+    return false;
   }
-  const uint32_t words_per_proc =
-      std::max<uint32_t>(max_len, kSchedulerVmWordsPerProc);
   out->proc_count = proc_count;
-  out->words_per_proc = words_per_proc;
-  out->bytecode.assign(static_cast<size_t>(proc_count) * words_per_proc, 0u);
+  out->words_per_proc = std::max<uint32_t>(max_len, kSchedulerVmWordsPerProc);
+  out->bytecode.reserve(total_words);
   out->proc_offsets.resize(proc_count);
   out->proc_lengths.resize(proc_count);
   for (uint32_t pid = 0u; pid < proc_count; ++pid) {
-    const uint32_t offset = pid * words_per_proc;
-    out->proc_offsets[pid] = offset;
-    out->proc_lengths[pid] =
-        static_cast<uint32_t>(procs[pid].size());
-    if (procs[pid].empty()) {
+    out->proc_offsets[pid] = static_cast<uint32_t>(out->bytecode.size());
+    out->proc_lengths[pid] = static_cast<uint32_t>(procs[pid].size());
+    out->bytecode.insert(out->bytecode.end(), procs[pid].begin(),
+                         procs[pid].end());
+  }
+  return true;
+}
+
+// Words the old fixed-stride layout (every proc padded to the longest one)
+// would have needed; used to report what packing saves.
+inline uint64_t SchedulerVmPaddedWords(const SchedulerVmLayout& layout) {
+  return static_cast<uint64_t>(layout.proc_count) * layout.words_per_proc;
+}
+
+// Folds procs with identical bodies onto one copy of their bytecode. Jump
+// targets are proc-relative, so sharing a body only rewrites proc_offsets.
+// Returns the number of procs that now share another proc's body.
+inline uint32_t DedupSchedulerVmProcBodies(SchedulerVmLayout* layout) {
+  if (!layout || layout->proc_offsets.size() != layout->proc_count ||
+      layout->proc_lengths.size() != layout->proc_count) {
+    return 0u;
+  }
+  for (uint32_t pid = 0u; pid < layout->proc_count; ++pid) {
+    if (static_cast<uint64_t>(layout->proc_offsets[pid]) +
+            layout->proc_lengths[pid] >
+        layout->bytecode.size()) {
+      return 0u;
+    }
+  }
+  auto body_hash = [&](uint32_t pid) {
+    uint64_t hash = 1469598103934665603ull;
+    const uint32_t* words = layout->bytecode.data() + layout->proc_offsets[pid];
+    for (uint32_t i = 0u; i < layout->proc_lengths[pid]; ++i) {
+      hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    return hash ^ layout->proc_lengths[pid];
+  };
+  std::vector<uint32_t> packed;
+  packed.reserve(layout->bytecode.size());
+  std::vector<uint32_t> offsets(layout->proc_count, 0u);
+  // hash -> pids whose body was already emitted into `packed`.
+  std::unordered_map<uint64_t, std::vector<uint32_t>> seen;
+  uint32_t folded = 0u;
+  for (uint32_t pid = 0u; pid < layout->proc_count; ++pid) {
+    const uint32_t len = layout->proc_lengths[pid];
+    const auto body = layout->bytecode.begin() + layout->proc_offsets[pid];
+    bool shared = false;
+    auto& bucket = seen[body_hash(pid)];
+    for (uint32_t other : bucket) {
+      if (layout->proc_lengths[other] == len &&
+          std::equal(body, body + len, packed.begin() + offsets[other])) {
+        offsets[pid] = offsets[other];
+        shared = true;
+        break;
+      }
+    }
+    if (shared) {
+      folded += (len > 0u) ? 1u : 0u;
       continue;
     }
-    std::copy(procs[pid].begin(), procs[pid].end(),
-              out->bytecode.begin() + offset);
+    offsets[pid] = static_cast<uint32_t>(packed.size());
+    packed.insert(packed.end(), body, body + len);
+    bucket.push_back(pid);
   }
-  return true;
+  layout->bytecode.swap(packed);
+  layout->proc_offsets.swap(offsets);
+  return folded;
 }
 
 inline bool BuildSchedulerVmSeedLayout(uint32_t proc_count,
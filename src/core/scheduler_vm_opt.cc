@@ -0,0 +1,881 @@
+#include "core/scheduler_vm_opt.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gpga {
+
+namespace {
+
+constexpr uint32_t kNoIndex = 0xFFFFFFFFu;
+
+// One decoded instruction. While a proc is rewritten, target operands (and
+// the arg of kJump/kTaskCall) hold instruction indices instead of ips.
+struct VmInstr {
+  SchedulerVmOp op = SchedulerVmOp::kDone;
+  uint32_t arg = 0u;
+  std::vector<uint32_t> operands;
+  std::vector<uint8_t> is_target;
+  bool live = true;
+};
+
+struct VmProc {
+  std::vector<VmInstr> instrs;
+  // Old ip -> instruction index (kNoIndex for operand words).
+  std::vector<uint32_t> index_of;
+};
+
+bool ArgIsTarget(SchedulerVmOp op) {
+  return op == SchedulerVmOp::kJump || op == SchedulerVmOp::kTaskCall;
+}
+
+bool IsPlainAssign(SchedulerVmOp op) {
+  return op == SchedulerVmOp::kAssign || op == SchedulerVmOp::kAssignNb;
+}
+
+bool DecodeProc(const uint32_t* code, uint32_t len, VmProc* out) {
+  out->instrs.clear();
+  out->index_of.assign(len, kNoIndex);
+  uint32_t ip = 0u;
+  while (ip < len) {
+    const uint32_t word = code[ip];
+    if ((word & kSchedulerVmOpMask) >= kSchedulerVmOpCount) {
+      return false;
+    }
+    VmInstr instr;
+    instr.op = DecodeSchedulerVmOp(word);
+    instr.arg = DecodeSchedulerVmArg(word);
+    const uint32_t next = ip + 1u;
+    const uint32_t count =
+        SchedulerVmOperandWords(instr.op, instr.arg, code, next, len);
+    if (static_cast<uint64_t>(next) + count > len) {
+      return false;
+    }
+    instr.operands.assign(code + next, code + next + count);
+    instr.is_target.assign(count, 0u);
+    switch (instr.op) {
+      case SchedulerVmOp::kJumpIf:
+      case SchedulerVmOp::kRepeat:
+      case SchedulerVmOp::kServiceRetBranch:
+      case SchedulerVmOp::kBranch:
+      case SchedulerVmOp::kWaitEdgeLoop:
+        std::fill(instr.is_target.begin(), instr.is_target.end(), 1u);
+        break;
+      case SchedulerVmOp::kCase:
+        // Label count, then the label targets and the default target.
+        std::fill(instr.is_target.begin() + 1, instr.is_target.end(), 1u);
+        break;
+      case SchedulerVmOp::kDisable:
+        if (instr.arg ==
+            static_cast<uint32_t>(SchedulerVmDisableKind::kBlock)) {
+          instr.is_target[0] = 1u;
+        }
+        break;
+      default:
+        break;
+    }
+    out->index_of[ip] = static_cast<uint32_t>(out->instrs.size());
+    out->instrs.push_back(std::move(instr));
+    ip = next + count;
+  }
+  auto to_index = [&](uint32_t* target) {
+    if (*target >= len || out->index_of[*target] == kNoIndex) {
+      return false;
+    }
+    *target = out->index_of[*target];
+    return true;
+  };
+  for (auto& instr : out->instrs) {
+    if (ArgIsTarget(instr.op) && !to_index(&instr.arg)) {
+      return false;
+    }
+    for (size_t k = 0; k < instr.operands.size(); ++k) {
+      if (instr.is_target[k] != 0u && !to_index(&instr.operands[k])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Applies fn to every target slot of an instruction.
+template <typename Fn>
+void ForEachTarget(VmInstr& instr, Fn&& fn) {
+  if (ArgIsTarget(instr.op)) {
+    fn(instr.arg);
+  }
+  for (size_t k = 0; k < instr.operands.size(); ++k) {
+    if (instr.is_target[k] != 0u) {
+      fn(instr.operands[k]);
+    }
+  }
+}
+
+// First live instruction at or after i (instrs.size() past the end). Dead
+// instructions are noops or jumps to the next instruction, so control that
+// reaches them falls through to this one.
+uint32_t Resolve(const VmProc& proc, uint32_t i) {
+  const uint32_t n = static_cast<uint32_t>(proc.instrs.size());
+  while (i < n && !proc.instrs[i].live) {
+    ++i;
+  }
+  return i;
+}
+
+// Instructions control can move to after instruction i.
+void Successors(const VmProc& proc, uint32_t i, std::vector<uint32_t>* out) {
+  out->clear();
+  const VmInstr& instr = proc.instrs[i];
+  auto add = [&](uint32_t target) { out->push_back(Resolve(proc, target)); };
+  auto add_targets = [&]() {
+    for (size_t k = 0; k < instr.operands.size(); ++k) {
+      if (instr.is_target[k] != 0u) {
+        add(instr.operands[k]);
+      }
+    }
+  };
+  switch (instr.op) {
+    case SchedulerVmOp::kDone:
+    case SchedulerVmOp::kRet:
+    case SchedulerVmOp::kHaltSim:
+      return;
+    case SchedulerVmOp::kJump:
+      add(instr.arg);
+      return;
+    case SchedulerVmOp::kTaskCall:
+      add(instr.arg);
+      add(i + 1u);
+      return;
+    case SchedulerVmOp::kCase:
+    case SchedulerVmOp::kRepeat:
+    case SchedulerVmOp::kServiceRetBranch:
+    case SchedulerVmOp::kBranch:
+    case SchedulerVmOp::kWaitEdgeLoop:
+      add_targets();
+      return;
+    case SchedulerVmOp::kDisable:
+      if (instr.arg == static_cast<uint32_t>(SchedulerVmDisableKind::kBlock)) {
+        add_targets();
+        return;
+      }
+      add(i + 1u);
+      return;
+    case SchedulerVmOp::kJumpIf:
+      add_targets();
+      add(i + 1u);
+      return;
+    default:
+      add(i + 1u);
+      return;
+  }
+}
+
+struct FusionRules {
+  bool assign_run = false;
+  bool branch = false;
+  bool wait_edge_loop = false;
+};
+
+FusionRules SelectFusionRules(const SchedulerVmOpPairCounts& pairs,
+                              uint64_t min_count) {
+  auto count = [&](SchedulerVmOp a, SchedulerVmOp b) -> uint64_t {
+    const size_t slot = static_cast<size_t>(a) * kSchedulerVmOpCount +
+                        static_cast<size_t>(b);
+    return (slot < pairs.size()) ? pairs[slot] : 0u;
+  };
+  const uint64_t floor = std::max<uint64_t>(min_count, 1u);
+  FusionRules rules;
+  rules.assign_run =
+      count(SchedulerVmOp::kAssign, SchedulerVmOp::kAssign) +
+          count(SchedulerVmOp::kAssign, SchedulerVmOp::kAssignNb) +
+          count(SchedulerVmOp::kAssignNb, SchedulerVmOp::kAssign) +
+          count(SchedulerVmOp::kAssignNb, SchedulerVmOp::kAssignNb) >=
+      floor;
+  rules.branch = count(SchedulerVmOp::kJumpIf, SchedulerVmOp::kJump) >= floor;
+  rules.wait_edge_loop =
+      count(SchedulerVmOp::kJump, SchedulerVmOp::kWaitEdge) >= floor;
+  return rules;
+}
+
+// Follows kJump chains from target (bounded, so jump cycles terminate).
+uint32_t ThreadTarget(const VmProc& proc, uint32_t target) {
+  const uint32_t n = static_cast<uint32_t>(proc.instrs.size());
+  uint32_t t = Resolve(proc, target);
+  for (uint32_t hops = 0u; hops < n && t < n; ++hops) {
+    const VmInstr& instr = proc.instrs[t];
+    if (instr.op != SchedulerVmOp::kJump) {
+      break;
+    }
+    const uint32_t next = Resolve(proc, instr.arg);
+    if (next == t) {
+      break;
+    }
+    t = next;
+  }
+  return t;
+}
+
+void ThreadJumps(VmProc* proc, SchedulerVmOptStats* stats) {
+  const uint32_t n = static_cast<uint32_t>(proc->instrs.size());
+  for (uint32_t i = 0; i < n; ++i) {
+    VmInstr& instr = proc->instrs[i];
+    if (!instr.live) {
+      continue;
+    }
+    ForEachTarget(instr, [&](uint32_t& target) {
+      const uint32_t threaded = ThreadTarget(*proc, target);
+      if (threaded != Resolve(*proc, target)) {
+        stats->threaded_targets += 1u;
+      }
+      target = threaded;
+    });
+    if (instr.op == SchedulerVmOp::kJump && instr.arg < n &&
+        proc->instrs[instr.arg].op == SchedulerVmOp::kDone) {
+      instr.op = SchedulerVmOp::kDone;
+      instr.arg = 0u;
+      stats->threaded_targets += 1u;
+    }
+  }
+}
+
+void RemoveFallThroughJumps(VmProc* proc, SchedulerVmOptStats* stats) {
+  const uint32_t n = static_cast<uint32_t>(proc->instrs.size());
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t i = n; i-- > 0u;) {
+      VmInstr& instr = proc->instrs[i];
+      if (!instr.live || instr.op != SchedulerVmOp::kJump) {
+        continue;
+      }
+      if (Resolve(*proc, instr.arg) == Resolve(*proc, i + 1u)) {
+        instr.live = false;
+        stats->removed_jumps += 1u;
+        changed = true;
+      }
+    }
+  }
+}
+
+void RemoveUnreachable(VmProc* proc, const std::vector<uint32_t>& roots,
+                       SchedulerVmOptStats* stats) {
+  const uint32_t n = static_cast<uint32_t>(proc->instrs.size());
+  std::vector<uint8_t> seen(n, 0u);
+  std::vector<uint32_t> work;
+  std::vector<uint32_t> succ;
+  auto push = [&](uint32_t i) {
+    i = Resolve(*proc, i);
+    if (i < n && seen[i] == 0u) {
+      seen[i] = 1u;
+      work.push_back(i);
+    }
+  };
+  push(0u);
+  for (uint32_t root : roots) {
+    push(root);
+  }
+  while (!work.empty()) {
+    const uint32_t i = work.back();
+    work.pop_back();
+    Successors(*proc, i, &succ);
+    for (uint32_t s : succ) {
+      push(s);
+    }
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    if (proc->instrs[i].live && seen[i] == 0u) {
+      proc->instrs[i].live = false;
+      stats->unreachable_instrs += 1u;
+    }
+  }
+}
+
+void FuseBranches(VmProc* proc, const FusionRules& rules,
+                  SchedulerVmOptStats* stats) {
+  const uint32_t n = static_cast<uint32_t>(proc->instrs.size());
+  for (uint32_t i = 0; i < n; ++i) {
+    VmInstr& instr = proc->instrs[i];
+    if (!instr.live) {
+      continue;
+    }
+    if (rules.branch && instr.op == SchedulerVmOp::kJumpIf) {
+      const uint32_t j = Resolve(*proc, i + 1u);
+      if (j < n && proc->instrs[j].op == SchedulerVmOp::kJump) {
+        // The kJump stays for anything else that lands on it; reachability
+        // drops it otherwise.
+        instr.op = SchedulerVmOp::kBranch;
+        instr.operands.push_back(proc->instrs[j].arg);
+        instr.is_target.push_back(1u);
+        stats->branches += 1u;
+      }
+    } else if (rules.wait_edge_loop && instr.op == SchedulerVmOp::kJump) {
+      const uint32_t t = Resolve(*proc, instr.arg);
+      if (t < n && proc->instrs[t].op == SchedulerVmOp::kWaitEdge) {
+        instr.op = SchedulerVmOp::kWaitEdgeLoop;
+        instr.arg = proc->instrs[t].arg;
+        instr.operands.assign(1u, t + 1u);
+        instr.is_target.assign(1u, 1u);
+        stats->wait_edge_loops += 1u;
+      }
+    }
+  }
+}
+
+void FuseAssignRuns(VmProc* proc, const std::vector<uint32_t>& roots,
+                    SchedulerVmOptStats* stats) {
+  const uint32_t n = static_cast<uint32_t>(proc->instrs.size());
+  // A run may not continue past an instruction something jumps to.
+  std::vector<uint8_t> targeted(n + 1u, 0u);
+  targeted[Resolve(*proc, 0u)] = 1u;
+  for (uint32_t root : roots) {
+    targeted[Resolve(*proc, root)] = 1u;
+  }
+  for (auto& instr : proc->instrs) {
+    if (instr.live) {
+      ForEachTarget(instr, [&](uint32_t& target) {
+        targeted[Resolve(*proc, target)] = 1u;
+      });
+    }
+  }
+  const uint32_t max_run = 0xFFFFFFFFu >> kSchedulerVmOpShift;
+  for (uint32_t i = 0; i < n; ++i) {
+    VmInstr& head = proc->instrs[i];
+    if (!head.live || !IsPlainAssign(head.op)) {
+      continue;
+    }
+    std::vector<uint32_t> members;
+    uint32_t j = Resolve(*proc, i + 1u);
+    while (j < n && IsPlainAssign(proc->instrs[j].op) && targeted[j] == 0u &&
+           members.size() + 1u < max_run) {
+      members.push_back(j);
+      j = Resolve(*proc, j + 1u);
+    }
+    if (members.empty()) {
+      continue;
+    }
+    std::vector<uint32_t> words;
+    words.reserve(members.size() + 1u);
+    words.push_back(MakeSchedulerVmInstr(head.op, head.arg));
+    for (uint32_t m : members) {
+      words.push_back(MakeSchedulerVmInstr(proc->instrs[m].op,
+                                           proc->instrs[m].arg));
+      proc->instrs[m].live = false;
+    }
+    head.op = SchedulerVmOp::kAssignRun;
+    head.arg = static_cast<uint32_t>(words.size());
+    head.operands = std::move(words);
+    head.is_target.assign(head.operands.size(), 0u);
+    stats->assign_runs += 1u;
+    stats->fused_assigns += static_cast<uint32_t>(head.operands.size());
+    i = j - 1u;
+  }
+}
+
+// Re-encodes the live instructions; old_to_new maps every old ip that
+// starts an instruction to its new ip.
+std::vector<uint32_t> EncodeProc(const VmProc& proc, uint32_t old_len,
+                                 std::vector<uint32_t>* old_to_new) {
+  const uint32_t n = static_cast<uint32_t>(proc.instrs.size());
+  std::vector<uint32_t> new_ip(n + 1u, 0u);
+  uint32_t pos = 0u;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (proc.instrs[i].live) {
+      new_ip[i] = pos;
+      pos += 1u + static_cast<uint32_t>(proc.instrs[i].operands.size());
+    }
+  }
+  new_ip[n] = pos;
+  for (uint32_t i = n; i-- > 0u;) {
+    if (!proc.instrs[i].live) {
+      new_ip[i] = new_ip[i + 1u];
+    }
+  }
+  std::vector<uint32_t> words;
+  words.reserve(pos);
+  for (const auto& instr : proc.instrs) {
+    if (!instr.live) {
+      continue;
+    }
+    words.push_back(MakeSchedulerVmInstr(
+        instr.op, ArgIsTarget(instr.op) ? new_ip[instr.arg] : instr.arg));
+    for (size_t k = 0; k < instr.operands.size(); ++k) {
+      words.push_back((instr.is_target[k] != 0u) ? new_ip[instr.operands[k]]
+                                                 : instr.operands[k]);
+    }
+  }
+  old_to_new->assign(old_len, kNoIndex);
+  for (uint32_t ip = 0; ip < old_len; ++ip) {
+    if (proc.index_of[ip] != kNoIndex) {
+      (*old_to_new)[ip] = new_ip[proc.index_of[ip]];
+    }
+  }
+  return words;
+}
+
+bool ProcInBounds(const SchedulerVmLayout& layout, uint32_t pid) {
+  return pid < layout.proc_offsets.size() && pid < layout.proc_lengths.size() &&
+         static_cast<uint64_t>(layout.proc_offsets[pid]) +
+                 layout.proc_lengths[pid] <=
+             layout.bytecode.size();
+}
+
+// Operands an expression op pops (kNoIndex for ops the pass leaves alone).
+uint32_t ExprArity(uint32_t op, uint32_t arg) {
+  switch (static_cast<SchedulerVmExprOp>(op)) {
+    case SchedulerVmExprOp::kPushConst:
+    case SchedulerVmExprOp::kPushConstXz:
+    case SchedulerVmExprOp::kPushSignal:
+      return 0u;
+    case SchedulerVmExprOp::kUnary:
+    case SchedulerVmExprOp::kIndex:
+      return 1u;
+    case SchedulerVmExprOp::kBinary:
+      return 2u;
+    case SchedulerVmExprOp::kTernary:
+      return 3u;
+    case SchedulerVmExprOp::kCall: {
+      const uint32_t call = arg & 0xFFu;
+      if (call <= static_cast<uint32_t>(SchedulerVmExprCallOp::kRealtime)) {
+        return 0u;
+      }
+      if (call >= static_cast<uint32_t>(SchedulerVmExprCallOp::kPow)) {
+        return 2u;
+      }
+      return 1u;
+    }
+    default:
+      return kNoIndex;
+  }
+}
+
+// A distinct subexpression. Nodes are value numbered while parsing, so
+// equal subtrees share one node and kids always precede their parents.
+struct ExprNode {
+  uint32_t op = 0u;
+  uint32_t arg = 0u;
+  uint32_t width = 0u;
+  std::vector<uint32_t> kids;
+  // Operand slots of distinct parents (plus one for the root) that use it.
+  uint32_t uses = 0u;
+  // Ops to evaluate it, counting shared kids as one load.
+  uint64_t cost = 0u;
+  // Stack slots to evaluate it, counting shared kids as one.
+  uint32_t depth = 0u;
+  bool shared = false;
+};
+
+bool ParseExpr(const uint32_t* begin, const uint32_t* end,
+               const std::vector<uint32_t>& imm, std::vector<ExprNode>* nodes,
+               uint32_t* root, uint64_t* op_count) {
+  std::map<std::vector<uint64_t>, uint32_t> numbers;
+  std::vector<uint32_t> stack;
+  std::vector<uint64_t> key;
+  *op_count = 0u;
+  for (const uint32_t* p = begin; p < end;) {
+    const uint32_t op = *p & kSchedulerVmOpMask;
+    const uint32_t arg = *p >> kSchedulerVmOpShift;
+    const uint32_t arity = ExprArity(op, arg);
+    if (arity == kNoIndex || end - p < 2 || stack.size() < arity) {
+      return false;
+    }
+    const uint32_t width = p[1];
+    p += 2;
+    *op_count += 1u;
+    key.assign({op, arg, width});
+    // Constants are keyed by value: every push has its own pool slot.
+    if (op == static_cast<uint32_t>(SchedulerVmExprOp::kPushConst) ||
+        op == static_cast<uint32_t>(SchedulerVmExprOp::kPushConstXz)) {
+      const size_t count =
+          (op == static_cast<uint32_t>(SchedulerVmExprOp::kPushConst)) ? 2u
+                                                                       : 4u;
+      if (static_cast<size_t>(arg) + count > imm.size()) {
+        return false;
+      }
+      key[1] = kNoIndex;
+      key.insert(key.end(), imm.begin() + arg, imm.begin() + arg + count);
+    }
+    const size_t kid_base = stack.size() - arity;
+    key.insert(key.end(), stack.begin() + kid_base, stack.end());
+    auto inserted =
+        numbers.emplace(key, static_cast<uint32_t>(nodes->size()));
+    if (inserted.second) {
+      ExprNode node;
+      node.op = op;
+      node.arg = arg;
+      node.width = width;
+      node.kids.assign(stack.begin() + kid_base, stack.end());
+      for (uint32_t kid : node.kids) {
+        (*nodes)[kid].uses += 1u;
+      }
+      nodes->push_back(std::move(node));
+    }
+    stack.resize(kid_base);
+    stack.push_back(inserted.first->second);
+  }
+  if (stack.size() != 1u) {
+    return false;
+  }
+  *root = stack[0];
+  (*nodes)[*root].uses += 1u;
+  return true;
+}
+
+// One straight-line piece of the rewritten expression: a hoisted
+// subexpression that ends in kStoreReg, or the final expression.
+struct ExprItem {
+  std::vector<uint32_t> words;
+  // (word index, virtual register) of each kLoadReg.
+  std::vector<std::pair<uint32_t, uint32_t>> loads;
+  uint32_t dest = kNoIndex;
+};
+
+class ExprRegEmitter {
+ public:
+  ExprRegEmitter(const std::vector<ExprNode>& nodes, uint32_t stack_max)
+      : nodes_(nodes),
+        stack_max_(stack_max),
+        shared_reg_(nodes.size(), kNoIndex) {}
+
+  void EmitRoot(uint32_t root) {
+    ExprItem item;
+    Inline(root, 0u, true, &item);
+    items_.push_back(std::move(item));
+  }
+
+  std::vector<ExprItem>& items() { return items_; }
+  uint32_t vreg_count() const { return vreg_count_; }
+  uint64_t spilled() const { return spilled_; }
+
+ private:
+  // Evaluates node into a new item ahead of the current one.
+  uint32_t Hoist(uint32_t id) {
+    ExprItem item;
+    Inline(id, 0u, true, &item);
+    item.dest = vreg_count_++;
+    item.words.push_back(
+        MakeSchedulerVmExprInstr(SchedulerVmExprOp::kStoreReg, item.dest));
+    item.words.push_back(nodes_[id].width);
+    items_.push_back(std::move(item));
+    return vreg_count_ - 1u;
+  }
+
+  void Load(uint32_t vreg, uint32_t width, ExprItem* item) {
+    item->loads.emplace_back(static_cast<uint32_t>(item->words.size()), vreg);
+    item->words.push_back(
+        MakeSchedulerVmExprInstr(SchedulerVmExprOp::kLoadReg, vreg));
+    item->words.push_back(width);
+  }
+
+  void Inline(uint32_t id, uint32_t base, bool item_root, ExprItem* item) {
+    const ExprNode& node = nodes_[id];
+    if (node.shared && !item_root) {
+      if (shared_reg_[id] == kNoIndex) {
+        shared_reg_[id] = Hoist(id);
+      }
+      Load(shared_reg_[id], node.width, item);
+      return;
+    }
+    for (size_t i = 0; i < node.kids.size(); ++i) {
+      const uint32_t kid = node.kids[i];
+      const ExprNode& kid_node = nodes_[kid];
+      const uint32_t kid_base = base + static_cast<uint32_t>(i);
+      if (!kid_node.shared && !kid_node.kids.empty() &&
+          kid_base + kid_node.depth > stack_max_) {
+        spilled_ += 1u;
+        Load(Hoist(kid), kid_node.width, item);
+      } else {
+        Inline(kid, kid_base, false, item);
+      }
+    }
+    item->words.push_back(
+        (node.arg << kSchedulerVmOpShift) | (node.op & kSchedulerVmOpMask));
+    item->words.push_back(node.width);
+  }
+
+  const std::vector<ExprNode>& nodes_;
+  const uint32_t stack_max_;
+  std::vector<uint32_t> shared_reg_;
+  std::vector<ExprItem> items_;
+  uint32_t vreg_count_ = 0u;
+  uint64_t spilled_ = 0u;
+};
+
+// Maps virtual registers (one per hoisted item) onto as few registers as
+// the item order allows. Returns the register count.
+uint32_t AllocateExprRegs(std::vector<ExprItem>* items, uint32_t vreg_count) {
+  std::vector<uint32_t> last_use(vreg_count, 0u);
+  for (uint32_t j = 0; j < items->size(); ++j) {
+    for (const auto& load : (*items)[j].loads) {
+      last_use[load.second] = j;
+    }
+  }
+  std::vector<uint32_t> phys(vreg_count, kNoIndex);
+  std::vector<uint32_t> free_regs;
+  uint32_t reg_count = 0u;
+  for (uint32_t j = 0; j < items->size(); ++j) {
+    ExprItem& item = (*items)[j];
+    // Loads run before the item's own store, so registers whose last load
+    // is here can take its result.
+    for (const auto& load : item.loads) {
+      const uint32_t reg = phys[load.second];
+      item.words[load.first] =
+          MakeSchedulerVmExprInstr(SchedulerVmExprOp::kLoadReg, reg);
+      if (last_use[load.second] == j &&
+          std::find(free_regs.begin(), free_regs.end(), reg) ==
+              free_regs.end()) {
+        free_regs.push_back(reg);
+      }
+    }
+    if (item.dest == kNoIndex) {
+      continue;
+    }
+    uint32_t reg = reg_count;
+    if (!free_regs.empty()) {
+      auto lowest = std::min_element(free_regs.begin(), free_regs.end());
+      reg = *lowest;
+      free_regs.erase(lowest);
+    } else {
+      reg_count += 1u;
+    }
+    phys[item.dest] = reg;
+    item.words[item.words.size() - 2u] =
+        MakeSchedulerVmExprInstr(SchedulerVmExprOp::kStoreReg, reg);
+  }
+  return reg_count;
+}
+
+}  // namespace
+
+SchedulerVmOpPairCounts CountSchedulerVmOpPairs(
+    const SchedulerVmLayout& layout) {
+  SchedulerVmOpPairCounts pairs(
+      static_cast<size_t>(kSchedulerVmOpCount) * kSchedulerVmOpCount, 0u);
+  VmProc proc;
+  std::vector<uint32_t> succ;
+  for (uint32_t pid = 0; pid < layout.proc_count; ++pid) {
+    if (!ProcInBounds(layout, pid) ||
+        !DecodeProc(layout.bytecode.data() + layout.proc_offsets[pid],
+                    layout.proc_lengths[pid], &proc)) {
+      continue;
+    }
+    const uint32_t n = static_cast<uint32_t>(proc.instrs.size());
+    for (uint32_t i = 0; i < n; ++i) {
+      Successors(proc, i, &succ);
+      for (uint32_t s : succ) {
+        if (s < n) {
+          pairs[static_cast<size_t>(proc.instrs[i].op) * kSchedulerVmOpCount +
+                static_cast<size_t>(proc.instrs[s].op)] += 1u;
+        }
+      }
+    }
+  }
+  return pairs;
+}
+
+bool OptimizeSchedulerVmBytecode(SchedulerVmLayout* layout,
+                                 const SchedulerVmOptOptions& options,
+                                 SchedulerVmOptStats* stats,
+                                 std::string* error) {
+  if (!layout) {
+    if (error) {
+      *error = "missing scheduler VM layout";
+    }
+    return false;
+  }
+  SchedulerVmOptStats local_stats;
+  SchedulerVmOptStats& st = stats ? *stats : local_stats;
+  st = SchedulerVmOptStats{};
+  const uint32_t proc_count = layout->proc_count;
+  if (layout->proc_offsets.size() != proc_count ||
+      layout->proc_lengths.size() != proc_count) {
+    if (error) {
+      *error = "scheduler VM layout proc table mismatch";
+    }
+    return false;
+  }
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    if (!ProcInBounds(*layout, pid)) {
+      if (error) {
+        *error = "scheduler VM proc " + std::to_string(pid) +
+                 " exceeds the bytecode table";
+      }
+      return false;
+    }
+    st.words_before += layout->proc_lengths[pid];
+  }
+  SchedulerVmOpPairCounts static_pairs;
+  const SchedulerVmOpPairCounts* pairs = options.pair_counts;
+  if (!pairs) {
+    static_pairs = CountSchedulerVmOpPairs(*layout);
+    pairs = &static_pairs;
+  }
+  const FusionRules rules = SelectFusionRules(*pairs, options.min_pair_count);
+
+  std::vector<VmProc> procs(proc_count);
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    if (!DecodeProc(layout->bytecode.data() + layout->proc_offsets[pid],
+                    layout->proc_lengths[pid], &procs[pid])) {
+      // Without every proc decoded the cross-proc disable targets are not
+      // known, so leave the layout as it is.
+      st.skipped_procs = proc_count;
+      st.words_after = st.words_before;
+      return true;
+    }
+  }
+  // Cross-proc disables resume another proc at a fixed ip; those ips stay
+  // reachable and are remapped. A target that is not an instruction
+  // boundary keeps the target proc as it is.
+  std::vector<std::vector<uint32_t>> roots(proc_count);
+  std::vector<uint8_t> rewrite(proc_count, 1u);
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    for (const auto& instr : procs[pid].instrs) {
+      if (instr.op == SchedulerVmOp::kTaskCall) {
+        roots[pid].push_back(instr.arg);
+      }
+      if (instr.op != SchedulerVmOp::kDisable ||
+          instr.arg !=
+              static_cast<uint32_t>(SchedulerVmDisableKind::kCrossProc)) {
+        continue;
+      }
+      const uint32_t target = instr.operands[0];
+      const uint32_t target_ip = instr.operands[1];
+      if (target >= proc_count) {
+        continue;
+      }
+      if (target_ip >= procs[target].index_of.size() ||
+          procs[target].index_of[target_ip] == kNoIndex) {
+        rewrite[target] = 0u;
+        continue;
+      }
+      roots[target].push_back(procs[target].index_of[target_ip]);
+    }
+  }
+
+  std::vector<std::vector<uint32_t>> bodies(proc_count);
+  std::vector<std::vector<uint32_t>> ip_maps(proc_count);
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    const uint32_t* code = layout->bytecode.data() + layout->proc_offsets[pid];
+    const uint32_t len = layout->proc_lengths[pid];
+    if (rewrite[pid] == 0u) {
+      st.skipped_procs += 1u;
+      bodies[pid].assign(code, code + len);
+      continue;
+    }
+    VmProc& proc = procs[pid];
+    for (auto& instr : proc.instrs) {
+      if (instr.op == SchedulerVmOp::kNoop) {
+        instr.live = false;
+        st.removed_noops += 1u;
+      }
+    }
+    ThreadJumps(&proc, &st);
+    RemoveFallThroughJumps(&proc, &st);
+    FuseBranches(&proc, rules, &st);
+    ThreadJumps(&proc, &st);
+    RemoveUnreachable(&proc, roots[pid], &st);
+    RemoveFallThroughJumps(&proc, &st);
+    if (rules.assign_run) {
+      FuseAssignRuns(&proc, roots[pid], &st);
+    }
+    bodies[pid] = EncodeProc(proc, len, &ip_maps[pid]);
+  }
+
+  // Point cross-proc disables at the target proc's new ips.
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    std::vector<uint32_t>& words = bodies[pid];
+    const uint32_t len = static_cast<uint32_t>(words.size());
+    uint32_t ip = 0u;
+    while (ip < len) {
+      const SchedulerVmOp op = DecodeSchedulerVmOp(words[ip]);
+      const uint32_t arg = DecodeSchedulerVmArg(words[ip]);
+      const uint32_t next = ip + 1u;
+      if (op == SchedulerVmOp::kDisable &&
+          arg == static_cast<uint32_t>(SchedulerVmDisableKind::kCrossProc)) {
+        const uint32_t target = words[next];
+        if (target < proc_count && rewrite[target] != 0u) {
+          words[next + 1u] = ip_maps[target][words[next + 1u]];
+        }
+      }
+      ip = next + SchedulerVmOperandWords(op, arg, words.data(), next, len);
+    }
+  }
+
+  std::vector<uint32_t> bytecode;
+  bytecode.reserve(st.words_before);
+  uint32_t max_len = 0u;
+  for (uint32_t pid = 0; pid < proc_count; ++pid) {
+    layout->proc_offsets[pid] = static_cast<uint32_t>(bytecode.size());
+    layout->proc_lengths[pid] = static_cast<uint32_t>(bodies[pid].size());
+    max_len = std::max(max_len, layout->proc_lengths[pid]);
+    bytecode.insert(bytecode.end(), bodies[pid].begin(), bodies[pid].end());
+  }
+  layout->bytecode.swap(bytecode);
+  layout->words_per_proc = std::max(max_len, kSchedulerVmWordsPerProc);
+  st.words_after = layout->bytecode.size();
+  return true;
+}
+
+bool OptimizeSchedulerVmExpr(const uint32_t* begin, const uint32_t* end,
+                             const std::vector<uint32_t>& imm_words,
+                             const SchedulerVmExprOptOptions& options,
+                             std::vector<uint32_t>* out, uint32_t* reg_count,
+                             SchedulerVmExprOptStats* stats) {
+  if (!begin || !end || !out || !reg_count || options.stack_max < 3u) {
+    return false;
+  }
+  std::vector<ExprNode> nodes;
+  uint32_t root = 0u;
+  uint64_t op_count = 0u;
+  if (!ParseExpr(begin, end, imm_words, &nodes, &root, &op_count)) {
+    return false;
+  }
+  uint64_t shared = 0u;
+  for (ExprNode& node : nodes) {
+    node.cost = 1u;
+    node.depth = node.kids.empty() ? 1u : 0u;
+    for (size_t i = 0; i < node.kids.size(); ++i) {
+      const ExprNode& kid = nodes[node.kids[i]];
+      node.cost += kid.shared ? 1u : kid.cost;
+      node.depth = std::max<uint32_t>(
+          node.depth, static_cast<uint32_t>(i) + (kid.shared ? 1u : kid.depth));
+    }
+    // Sharing costs a store and a load per use; only take it when that
+    // beats evaluating every use.
+    node.shared = options.share && !node.kids.empty() && node.uses >= 2u &&
+                  node.uses * node.cost > node.cost + 1u + node.uses;
+    shared += node.shared ? 1u : 0u;
+  }
+  ExprRegEmitter emitter(nodes, options.stack_max);
+  emitter.EmitRoot(root);
+  std::vector<ExprItem>& items = emitter.items();
+  const uint32_t regs = AllocateExprRegs(&items, emitter.vreg_count());
+  if (regs > options.reg_max) {
+    if (shared == 0u) {
+      return false;
+    }
+    SchedulerVmExprOptOptions spill_only = options;
+    spill_only.share = false;
+    return OptimizeSchedulerVmExpr(begin, end, imm_words, spill_only, out,
+                                   reg_count, stats);
+  }
+  out->clear();
+  for (const ExprItem& item : items) {
+    out->insert(out->end(), item.words.begin(), item.words.end());
+  }
+  *reg_count = regs;
+  if (stats) {
+    stats->exprs += 1u;
+    stats->ops_before += op_count;
+    stats->ops_after += out->size() / 2u;
+    stats->shared += shared;
+    stats->spilled += emitter.spilled();
+    stats->max_regs = std::max(stats->max_regs, regs);
+  }
+  return true;
+}
+
+}  // namespace gpga
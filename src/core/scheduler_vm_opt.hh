@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/scheduler_vm.hh"
+
+namespace gpga {
+
+// Opcode-pair frequencies indexed [first * kSchedulerVmOpCount + second]:
+// how often `second` runs right after `first`.
+using SchedulerVmOpPairCounts = std::vector<uint64_t>;
+
+// Static pair counts: every instruction paired with each of its successors
+// (fall-through and branch targets). The host interpreter's profile gives
+// the dynamic counts.
+SchedulerVmOpPairCounts CountSchedulerVmOpPairs(const SchedulerVmLayout& layout);
+
+struct SchedulerVmOptOptions {
+  // Guides fusion: a superinstruction is only formed for pairs seen at
+  // least min_pair_count times. Null uses the static counts of the layout.
+  const SchedulerVmOpPairCounts* pair_counts = nullptr;
+  uint64_t min_pair_count = 1u;
+};
+
+struct SchedulerVmOptStats {
+  uint64_t words_before = 0u;
+  uint64_t words_after = 0u;
+  uint32_t threaded_targets = 0u;
+  uint32_t removed_noops = 0u;
+  uint32_t removed_jumps = 0u;
+  uint32_t unreachable_instrs = 0u;
+  uint32_t assign_runs = 0u;
+  uint32_t fused_assigns = 0u;
+  uint32_t branches = 0u;
+  uint32_t wait_edge_loops = 0u;
+  // Procs left as they were because their bytecode did not decode.
+  uint32_t skipped_procs = 0u;
+};
+
+// Peephole pass over the proc bytecode of a layout:
+//   - drops kNoop and jumps to the next instruction;
+//   - threads jump chains (a target that is a kJump is replaced by that
+//     jump's target, a kJump to kDone becomes kDone);
+//   - fuses `kJumpIf c, T; kJump F` into kBranch, runs of kAssign/kAssignNb
+//     that no jump lands inside into kAssignRun, and a kJump back to a
+//     kWaitEdge (the always @(edge) loop) into kWaitEdgeLoop;
+//   - removes instructions unreachable from ip 0, task call targets and
+//     cross-proc disable targets.
+// Proc-relative targets and cross-proc kDisable ips are remapped, and procs
+// are re-packed (shared bodies from DedupSchedulerVmProcBodies are split
+// again, so dedup should run afterwards). Every other table is unchanged.
+bool OptimizeSchedulerVmBytecode(SchedulerVmLayout* layout,
+                                 const SchedulerVmOptOptions& options,
+                                 SchedulerVmOptStats* stats,
+                                 std::string* error);
+
+struct SchedulerVmExprOptOptions {
+  // Share repeated subexpressions through registers; off only spills.
+  bool share = true;
+  uint32_t stack_max = kSchedulerVmExprStackMax;
+  uint32_t reg_max = kSchedulerVmExprRegMax;
+};
+
+struct SchedulerVmExprOptStats {
+  uint64_t exprs = 0u;
+  uint64_t ops_before = 0u;
+  uint64_t ops_after = 0u;
+  // Subexpressions evaluated once into a register instead of at every use.
+  uint64_t shared = 0u;
+  // Subtrees evaluated ahead into a register to stay within stack_max.
+  uint64_t spilled = 0u;
+  uint32_t max_regs = 0u;
+};
+
+// Register allocation for one postfix expression (words [begin, end),
+// without its kDone). Subexpressions that occur more than once (same ops,
+// widths and constants) are hoisted into a prologue that evaluates each
+// once and kStoreReg's it; every use becomes a kLoadReg. Subtrees that
+// would push the stack past stack_max are hoisted the same way, so any
+// depth fits. The stack VM evaluates every operand (ternary arms
+// included) and reads no state it writes, so hoisting never changes the
+// result. Registers are reused once their last load has run.
+//
+// *out gets the rewritten words (equal to the input when nothing was
+// shared or spilled) and *reg_count the registers they use. Returns false
+// when the words do not parse as one expression or need more than reg_max
+// registers. Stats are added to *stats.
+bool OptimizeSchedulerVmExpr(const uint32_t* begin, const uint32_t* end,
+                             const std::vector<uint32_t>& imm_words,
+                             const SchedulerVmExprOptOptions& options,
+                             std::vector<uint32_t>* out, uint32_t* reg_count,
+                             SchedulerVmExprOptStats* stats);
+
+}  // namespace gpga
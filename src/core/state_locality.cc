@@ -0,0 +1,329 @@
+#include "core/state_locality.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gpga {
+
+namespace {
+
+template <typename Fn>
+void ForEachChildStatement(const Statement& stmt, Fn&& fn) {
+  const std::vector<Statement>* bodies[] = {
+      &stmt.then_branch,  &stmt.else_branch,  &stmt.block,
+      &stmt.for_body,     &stmt.while_body,   &stmt.repeat_body,
+      &stmt.delay_body,   &stmt.event_body,   &stmt.wait_body,
+      &stmt.forever_body, &stmt.fork_branches};
+  for (const auto* body : bodies) {
+    for (const auto& child : *body) {
+      fn(child);
+    }
+  }
+  for (const auto& item : stmt.case_items) {
+    for (const auto& child : item.body) {
+      fn(child);
+    }
+  }
+  for (const auto& child : stmt.default_branch) {
+    fn(child);
+  }
+}
+
+bool IsTimingControl(const Statement& stmt) {
+  return stmt.kind == StatementKind::kDelay ||
+         stmt.kind == StatementKind::kEventControl ||
+         stmt.kind == StatementKind::kWait;
+}
+
+bool ContainsTimingControl(const Statement& stmt) {
+  if (IsTimingControl(stmt)) {
+    return true;
+  }
+  bool found = false;
+  ForEachChildStatement(stmt, [&](const Statement& child) {
+    found = found || ContainsTimingControl(child);
+  });
+  return found;
+}
+
+class AccessList {
+ public:
+  explicit AccessList(std::vector<std::string>* out) : out_(out) {}
+
+  void Add(const std::string& name) {
+    if (!name.empty() && seen_.insert(name).second) {
+      out_->push_back(name);
+    }
+  }
+
+  void AddExpr(const Expr* expr) {
+    if (!expr) {
+      return;
+    }
+    if (expr->kind == ExprKind::kIdentifier) {
+      Add(expr->ident);
+    }
+    const Expr* children[] = {expr->base.get(),      expr->index.get(),
+                              expr->msb_expr.get(),  expr->lsb_expr.get(),
+                              expr->operand.get(),   expr->lhs.get(),
+                              expr->rhs.get(),       expr->condition.get(),
+                              expr->then_expr.get(), expr->else_expr.get(),
+                              expr->repeat_expr.get()};
+    for (const Expr* child : children) {
+      AddExpr(child);
+    }
+    for (const auto& element : expr->elements) {
+      AddExpr(element.get());
+    }
+    for (const auto& arg : expr->call_args) {
+      AddExpr(arg.get());
+    }
+  }
+
+  // The statement's own expressions and targets, not its bodies.
+  void AddStatementHead(const Statement& stmt) {
+    AddExpr(stmt.condition.get());
+    AddExpr(stmt.case_expr.get());
+    for (const auto& item : stmt.case_items) {
+      for (const auto& label : item.labels) {
+        AddExpr(label.get());
+      }
+    }
+    AddExpr(stmt.for_init_rhs.get());
+    AddExpr(stmt.for_condition.get());
+    AddExpr(stmt.for_step_rhs.get());
+    AddExpr(stmt.while_condition.get());
+    AddExpr(stmt.repeat_count.get());
+    AddExpr(stmt.delay.get());
+    AddExpr(stmt.wait_condition.get());
+    AddExpr(stmt.event_expr.get());
+    for (const auto& item : stmt.event_items) {
+      AddExpr(item.expr.get());
+    }
+    AddExpr(stmt.assign.rhs.get());
+    AddExpr(stmt.assign.lhs_index.get());
+    for (const auto& index : stmt.assign.lhs_indices) {
+      AddExpr(index.get());
+    }
+    AddExpr(stmt.assign.lhs_msb_expr.get());
+    AddExpr(stmt.assign.lhs_lsb_expr.get());
+    Add(stmt.assign.lhs);
+    Add(stmt.force_target);
+    Add(stmt.release_target);
+    for (const auto& arg : stmt.task_args) {
+      AddExpr(arg.get());
+    }
+  }
+
+  void AddStatement(const Statement& stmt) {
+    AddStatementHead(stmt);
+    ForEachChildStatement(stmt,
+                          [&](const Statement& child) { AddStatement(child); });
+  }
+
+ private:
+  std::vector<std::string>* out_;
+  std::unordered_set<std::string> seen_;
+};
+
+// Initial blocks: the zero-time prefix runs once, everything from the first
+// delay, event or wait control on is stimulus and runs as often as an always
+// block. Zero-time loops (memory init) stay in the one-shot part.
+void SplitInitialStatements(const std::vector<Statement>& stmts, bool* timed,
+                            AccessList* once, AccessList* stimulus) {
+  for (const auto& stmt : stmts) {
+    if (*timed) {
+      stimulus->AddStatement(stmt);
+    } else if (stmt.kind == StatementKind::kBlock) {
+      SplitInitialStatements(stmt.block, timed, once, stimulus);
+    } else if (IsTimingControl(stmt)) {
+      once->AddStatementHead(stmt);
+      *timed = true;
+      ForEachChildStatement(stmt, [&](const Statement& child) {
+        stimulus->AddStatement(child);
+      });
+    } else if (ContainsTimingControl(stmt)) {
+      stimulus->AddStatement(stmt);
+      *timed = true;
+    } else {
+      once->AddStatement(stmt);
+    }
+  }
+}
+
+std::string ProcessLabel(const AlwaysBlock& block, size_t index) {
+  std::string label;
+  switch (block.edge) {
+    case EdgeKind::kPosedge:
+      label = "always @(posedge " + block.clock + ")";
+      break;
+    case EdgeKind::kNegedge:
+      label = "always @(negedge " + block.clock + ")";
+      break;
+    case EdgeKind::kCombinational:
+      label = "always @(" +
+              (block.sensitivity.empty() ? std::string("*")
+                                         : block.sensitivity) +
+              ")";
+      break;
+    case EdgeKind::kInitial:
+      label = "initial";
+      break;
+  }
+  return label + " #" + std::to_string(index);
+}
+
+}  // namespace
+
+std::vector<StateProcessAccess> CollectStateProcessAccesses(
+    const Module& module) {
+  std::vector<StateProcessAccess> processes;
+  processes.reserve(module.always_blocks.size() + module.assigns.size());
+  for (size_t i = 0; i < module.always_blocks.size(); ++i) {
+    const AlwaysBlock& block = module.always_blocks[i];
+    StateProcessAccess process;
+    process.label = ProcessLabel(block, i);
+    AccessList list(&process.signals);
+    list.Add(block.clock);
+    if (block.edge != EdgeKind::kInitial) {
+      for (const auto& stmt : block.statements) {
+        list.AddStatement(stmt);
+      }
+      processes.push_back(std::move(process));
+      continue;
+    }
+    StateProcessAccess stimulus;
+    stimulus.label = process.label + " stimulus";
+    AccessList stimulus_list(&stimulus.signals);
+    bool timed = false;
+    SplitInitialStatements(block.statements, &timed, &list, &stimulus_list);
+    process.hot = false;
+    processes.push_back(std::move(process));
+    if (!stimulus.signals.empty()) {
+      processes.push_back(std::move(stimulus));
+    }
+  }
+  for (const auto& assign : module.assigns) {
+    StateProcessAccess process;
+    process.label = "assign " + assign.lhs;
+    AccessList list(&process.signals);
+    list.Add(assign.lhs);
+    list.AddExpr(assign.rhs.get());
+    processes.push_back(std::move(process));
+  }
+  return processes;
+}
+
+StateLocalityOrder OrderStateByLocality(
+    const Module& module, const std::vector<std::string>& names) {
+  StateLocalityOrder order;
+  std::unordered_map<std::string, uint32_t> index_of;
+  index_of.reserve(names.size());
+  for (const auto& name : names) {
+    index_of.emplace(name, static_cast<uint32_t>(index_of.size()));
+  }
+  const size_t count = index_of.size();
+  std::vector<std::string> unique_names(count);
+  for (const auto& entry : index_of) {
+    unique_names[entry.second] = entry.first;
+  }
+
+  // Hot names in first-access order, and the weighted co-access graph.
+  std::vector<uint32_t> hot;
+  std::vector<bool> is_hot(count, false);
+  std::vector<std::unordered_map<uint32_t, uint32_t>> links(count);
+  for (const auto& process : CollectStateProcessAccesses(module)) {
+    if (!process.hot) {
+      continue;
+    }
+    std::vector<uint32_t> touched;
+    for (const auto& name : process.signals) {
+      auto it = index_of.find(name);
+      if (it != index_of.end()) {
+        touched.push_back(it->second);
+      }
+    }
+    for (size_t i = 0; i < touched.size(); ++i) {
+      const uint32_t a = touched[i];
+      if (!is_hot[a]) {
+        is_hot[a] = true;
+        hot.push_back(a);
+      }
+      const size_t end =
+          std::min(touched.size(), i + 1u + kStateLocalityWindow);
+      for (size_t j = i + 1u; j < end; ++j) {
+        ++links[a][touched[j]];
+        ++links[touched[j]][a];
+      }
+    }
+  }
+
+  // Greedy placement: next is the unplaced hot name with the most links into
+  // the last kStateLocalityWindow placed ones, ties going to the earliest
+  // accessed. Candidates sit in a max-heap keyed by (score, -rank); a score
+  // change pushes a fresh entry and the stale one is skipped when it surfaces.
+  std::vector<uint32_t> rank(count, 0u);
+  for (size_t i = 0; i < hot.size(); ++i) {
+    rank[hot[i]] = static_cast<uint32_t>(i);
+  }
+  struct Candidate {
+    uint64_t score;
+    uint32_t rank;
+    uint32_t id;
+  };
+  auto lower = [](const Candidate& a, const Candidate& b) {
+    return a.score != b.score ? a.score < b.score : a.rank > b.rank;
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(lower)>
+      candidates(lower);
+  std::vector<bool> placed(count, false);
+  std::vector<uint64_t> score(count, 0u);
+  for (uint32_t id : hot) {
+    candidates.push(Candidate{0u, rank[id], id});
+  }
+  std::deque<uint32_t> window;
+  auto add_links = [&](uint32_t id, bool add) {
+    for (const auto& link : links[id]) {
+      if (add) {
+        score[link.first] += link.second;
+      } else {
+        score[link.first] -= link.second;
+      }
+      if (!placed[link.first]) {
+        candidates.push(
+            Candidate{score[link.first], rank[link.first], link.first});
+      }
+    }
+  };
+  order.hot.reserve(hot.size());
+  while (order.hot.size() < hot.size()) {
+    const Candidate top = candidates.top();
+    candidates.pop();
+    if (placed[top.id] || top.score != score[top.id]) {
+      continue;
+    }
+    const uint32_t best = top.id;
+    placed[best] = true;
+    order.hot.push_back(unique_names[best]);
+    add_links(best, true);
+    window.push_back(best);
+    if (window.size() > kStateLocalityWindow) {
+      add_links(window.front(), false);
+      window.pop_front();
+    }
+  }
+  for (size_t id = 0; id < count; ++id) {
+    if (!is_hot[id]) {
+      order.cold.push_back(unique_names[id]);
+    }
+  }
+  return order;
+}
+
+}  // namespace gpga
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "frontend/ast.hh"
+
+namespace gpga {
+
+// One process's view of module state: an always block or a continuous
+// assign, with every identifier it reads or assigns in first-access order
+// (deduplicated). An initial block yields a cold process for its zero-time
+// prefix and, when it waits, a hot "<label> stimulus" process for the rest.
+struct StateProcessAccess {
+  std::string label;
+  bool hot = true;
+  std::vector<std::string> signals;
+};
+
+// Always/initial blocks in declaration order, then continuous assigns.
+std::vector<StateProcessAccess> CollectStateProcessAccesses(
+    const Module& module);
+
+// A permutation of the names passed to OrderStateByLocality: `hot` holds the
+// names some hot process touches, `cold` the rest in their original order.
+struct StateLocalityOrder {
+  std::vector<std::string> hot;
+  std::vector<std::string> cold;
+};
+
+// Orders `names` (the port and reg segments of the packed state buffer) by
+// co-access. Two names are linked once per hot process that touches both
+// within kStateLocalityWindow accesses of each other; the hot order is then
+// grown greedily, always taking the name most strongly linked to the last
+// kStateLocalityWindow placed ones (first access breaks ties), so the
+// segments of one process land next to each other. Codegen and the host both
+// call this to agree on the layout.
+constexpr size_t kStateLocalityWindow = 16u;
+StateLocalityOrder OrderStateByLocality(const Module& module,
+                                        const std::vector<std::string>& names);
+
+}  // namespace gpga
@@ -0,0 +1,356 @@
+#include "core/x_reachability.hh"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gpga {
+
+namespace {
+
+constexpr int kMaxTwoStateWidth = 64;
+
+void CollectExprIdentifiers(const Expr& expr,
+                            std::unordered_set<std::string>* out) {
+  if (expr.kind == ExprKind::kIdentifier) {
+    out->insert(expr.ident);
+  }
+  const Expr* children[] = {expr.operand.get(),   expr.lhs.get(),
+                            expr.rhs.get(),       expr.condition.get(),
+                            expr.then_expr.get(), expr.else_expr.get(),
+                            expr.base.get(),      expr.index.get(),
+                            expr.msb_expr.get(),  expr.lsb_expr.get(),
+                            expr.repeat_expr.get()};
+  for (const Expr* child : children) {
+    if (child) {
+      CollectExprIdentifiers(*child, out);
+    }
+  }
+  for (const auto& element : expr.elements) {
+    CollectExprIdentifiers(*element, out);
+  }
+  for (const auto& arg : expr.call_args) {
+    CollectExprIdentifiers(*arg, out);
+  }
+}
+
+// Every signal a statement may write: assignment and loop targets,
+// force/release targets, and anything handed to a task call.
+void CollectStatementTargets(const Statement& stmt,
+                             std::unordered_set<std::string>* out) {
+  if (!stmt.assign.lhs.empty()) {
+    out->insert(stmt.assign.lhs);
+  }
+  if (!stmt.for_init_lhs.empty()) {
+    out->insert(stmt.for_init_lhs);
+  }
+  if (!stmt.for_step_lhs.empty()) {
+    out->insert(stmt.for_step_lhs);
+  }
+  if (!stmt.force_target.empty()) {
+    out->insert(stmt.force_target);
+  }
+  if (!stmt.release_target.empty()) {
+    out->insert(stmt.release_target);
+  }
+  for (const auto& arg : stmt.task_args) {
+    if (arg) {
+      CollectExprIdentifiers(*arg, out);
+    }
+  }
+  const std::vector<Statement>* bodies[] = {
+      &stmt.for_body,    &stmt.while_body,  &stmt.repeat_body,
+      &stmt.delay_body,  &stmt.event_body,  &stmt.wait_body,
+      &stmt.forever_body, &stmt.fork_branches, &stmt.then_branch,
+      &stmt.else_branch, &stmt.block,       &stmt.default_branch};
+  for (const auto* body : bodies) {
+    for (const auto& child : *body) {
+      CollectStatementTargets(child, out);
+    }
+  }
+  for (const auto& item : stmt.case_items) {
+    for (const auto& child : item.body) {
+      CollectStatementTargets(child, out);
+    }
+  }
+}
+
+bool IsKnownNumber(const Expr* expr) {
+  return expr && expr->kind == ExprKind::kNumber && !expr->is_real_literal &&
+         expr->IsFullyDetermined();
+}
+
+// Bounds the value of a part-select start built from known numbers and
+// unsigned leaves of `widths` (both up to 32 bits), `+` and non-wrapping `-`.
+// Returns false when it cannot.
+bool StartRange(const Expr& expr,
+                const std::unordered_map<std::string, int>& widths,
+                const std::unordered_set<std::string>& signed_leaves,
+                uint64_t* lo, uint64_t* hi) {
+  switch (expr.kind) {
+    case ExprKind::kNumber:
+      if (!IsKnownNumber(&expr) || expr.value_bits > 0xFFFFFFFFull) {
+        return false;
+      }
+      *lo = expr.value_bits;
+      *hi = expr.value_bits;
+      return true;
+    case ExprKind::kIdentifier: {
+      auto it = widths.find(expr.ident);
+      if (it == widths.end() || it->second > 32 ||
+          signed_leaves.count(expr.ident) > 0) {
+        return false;
+      }
+      *lo = 0;
+      *hi = (1ull << it->second) - 1;
+      return true;
+    }
+    case ExprKind::kBinary: {
+      uint64_t lhs_lo = 0;
+      uint64_t lhs_hi = 0;
+      uint64_t rhs_lo = 0;
+      uint64_t rhs_hi = 0;
+      if ((expr.op != '+' && expr.op != '-') || !expr.lhs || !expr.rhs ||
+          !StartRange(*expr.lhs, widths, signed_leaves, &lhs_lo, &lhs_hi) ||
+          !StartRange(*expr.rhs, widths, signed_leaves, &rhs_lo, &rhs_hi)) {
+        return false;
+      }
+      if (expr.op == '+') {
+        *lo = lhs_lo + rhs_lo;
+        *hi = lhs_hi + rhs_hi;
+        return true;
+      }
+      if (lhs_lo < rhs_hi) {
+        return false;
+      }
+      *lo = lhs_lo - rhs_hi;
+      *hi = lhs_hi - rhs_lo;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Returns true when `expr` cannot produce X or Z as long as every identifier
+// it reads is X-free; those identifiers (all keys of `widths`) are appended
+// to `reads`.
+bool ExprPreservesKnown(const Expr& expr,
+                        const std::unordered_map<std::string, int>& widths,
+                        const std::unordered_set<std::string>& signed_leaves,
+                        std::vector<std::string>* reads) {
+  auto identifier_width = [&](const Expr* base) -> int {
+    if (!base || base->kind != ExprKind::kIdentifier) {
+      return 0;
+    }
+    auto it = widths.find(base->ident);
+    if (it == widths.end()) {
+      return 0;
+    }
+    reads->push_back(base->ident);
+    return it->second;
+  };
+  auto known = [&](const Expr& operand) -> bool {
+    return ExprPreservesKnown(operand, widths, signed_leaves, reads);
+  };
+  switch (expr.kind) {
+    case ExprKind::kIdentifier:
+      return identifier_width(&expr) > 0;
+    case ExprKind::kNumber:
+      return IsKnownNumber(&expr);
+    case ExprKind::kString:
+      return true;
+    case ExprKind::kUnary:
+      switch (expr.unary_op) {
+        case '+':
+        case '-':
+        case '~':
+        case '!':
+        case '&':
+        case '|':
+        case '^':
+        case 'B':
+        case 'S':
+        case 'U':
+          return expr.operand && known(*expr.operand);
+        default:
+          return false;
+      }
+    case ExprKind::kBinary:
+      // Division and modulo by zero yield X, and so can a power.
+      if (expr.op == '/' || expr.op == '%' || expr.op == 'p') {
+        return false;
+      }
+      return expr.lhs && expr.rhs && known(*expr.lhs) && known(*expr.rhs);
+    case ExprKind::kTernary:
+      return expr.condition && expr.then_expr && expr.else_expr &&
+             known(*expr.condition) && known(*expr.then_expr) &&
+             known(*expr.else_expr);
+    case ExprKind::kSelect: {
+      int base_width = identifier_width(expr.base.get());
+      if (base_width <= 0) {
+        return false;
+      }
+      if (expr.indexed_range) {
+        // Window bits past the base read as X, so the start has to keep the
+        // whole window inside it.
+        uint64_t start_lo = 0;
+        uint64_t start_hi = 0;
+        return expr.indexed_width > 0 && expr.lsb_expr &&
+               known(*expr.lsb_expr) &&
+               StartRange(*expr.lsb_expr, widths, signed_leaves, &start_lo,
+                          &start_hi) &&
+               start_hi + static_cast<uint64_t>(expr.indexed_width) <=
+                   static_cast<uint64_t>(base_width);
+      }
+      int lo = expr.msb < expr.lsb ? expr.msb : expr.lsb;
+      int hi = expr.msb < expr.lsb ? expr.lsb : expr.msb;
+      return lo >= 0 && hi < base_width;
+    }
+    case ExprKind::kIndex: {
+      int base_width = identifier_width(expr.base.get());
+      return base_width > 0 && IsKnownNumber(expr.index.get()) &&
+             expr.index->value_bits < static_cast<uint64_t>(base_width);
+    }
+    case ExprKind::kCall:
+      if ((expr.ident != "$signed" && expr.ident != "$unsigned") ||
+          expr.call_args.size() != 1 || !expr.call_args[0]) {
+        return false;
+      }
+      return known(*expr.call_args[0]);
+    case ExprKind::kConcat:
+      if (expr.repeat_expr && !IsKnownNumber(expr.repeat_expr.get())) {
+        return false;
+      }
+      for (const auto& element : expr.elements) {
+        if (!element || !known(*element)) {
+          return false;
+        }
+      }
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::unordered_set<std::string> FindTwoStateNets(const Module& module) {
+  std::unordered_set<std::string> proven;
+  if (!module.timing_checks.empty() || !module.specify_paths.empty()) {
+    return proven;
+  }
+
+  std::unordered_set<std::string> excluded;
+  for (const auto& port : module.ports) {
+    excluded.insert(port.name);
+  }
+  for (const auto& sw : module.switches) {
+    excluded.insert(sw.a);
+    excluded.insert(sw.b);
+  }
+  for (const auto& block : module.always_blocks) {
+    for (const auto& stmt : block.statements) {
+      CollectStatementTargets(stmt, &excluded);
+    }
+  }
+  for (const auto& task : module.tasks) {
+    for (const auto& stmt : task.body) {
+      CollectStatementTargets(stmt, &excluded);
+    }
+  }
+  for (const auto& func : module.functions) {
+    for (const auto& stmt : func.body) {
+      CollectStatementTargets(stmt, &excluded);
+    }
+  }
+
+  // Leaves: top-level inputs (assumed driven 2-state) and candidate nets.
+  std::unordered_map<std::string, int> widths;
+  std::unordered_set<std::string> signed_leaves;
+  for (const auto& port : module.ports) {
+    if (port.dir == PortDir::kInput && !port.is_real && port.width > 0 &&
+        port.width <= kMaxTwoStateWidth) {
+      widths[port.name] = port.width;
+      if (port.is_signed) {
+        signed_leaves.insert(port.name);
+      }
+    }
+  }
+  std::unordered_set<std::string> candidates;
+  for (const auto& net : module.nets) {
+    if (net.type != NetType::kWire || net.array_size > 0 || net.is_real ||
+        net.charge != ChargeStrength::kNone || net.width <= 0 ||
+        net.width > kMaxTwoStateWidth || excluded.count(net.name) > 0) {
+      continue;
+    }
+    candidates.insert(net.name);
+    widths[net.name] = net.width;
+    if (net.is_signed) {
+      signed_leaves.insert(net.name);
+    }
+  }
+
+  std::unordered_map<std::string, const Assign*> drivers;
+  std::unordered_set<std::string> rejected;
+  for (const auto& assign : module.assigns) {
+    if (candidates.count(assign.lhs) == 0) {
+      continue;
+    }
+    bool highz_drive = assign.has_strength &&
+                       (assign.strength0 == Strength::kHighZ ||
+                        assign.strength1 == Strength::kHighZ);
+    if (!assign.rhs || assign.lhs_has_range || highz_drive ||
+        !drivers.emplace(assign.lhs, &assign).second) {
+      rejected.insert(assign.lhs);
+    }
+  }
+
+  // Least fixpoint: a net is proven once every candidate it reads is, so
+  // nets on combinational cycles never qualify.
+  std::unordered_map<std::string, size_t> pending;
+  std::unordered_map<std::string, std::vector<std::string>> dependents;
+  std::vector<std::string> ready;
+  for (const auto& entry : drivers) {
+    const std::string& name = entry.first;
+    if (rejected.count(name) > 0) {
+      continue;
+    }
+    std::vector<std::string> reads;
+    if (!ExprPreservesKnown(*entry.second->rhs, widths, signed_leaves,
+                            &reads)) {
+      continue;
+    }
+    std::unordered_set<std::string> deps;
+    for (const auto& read : reads) {
+      if (candidates.count(read) > 0) {
+        deps.insert(read);
+      }
+    }
+    pending[name] = deps.size();
+    for (const auto& dep : deps) {
+      dependents[dep].push_back(name);
+    }
+    if (deps.empty()) {
+      ready.push_back(name);
+    }
+  }
+  while (!ready.empty()) {
+    std::string name = std::move(ready.back());
+    ready.pop_back();
+    proven.insert(name);
+    auto it = dependents.find(name);
+    if (it == dependents.end()) {
+      continue;
+    }
+    for (const auto& user : it->second) {
+      if (--pending[user] == 0) {
+        ready.push_back(user);
+      }
+    }
+  }
+  return proven;
+}
+
+}  // namespace gpga
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+
+#include "frontend/ast.hh"
+
+namespace gpga {
+
+// X-reachability over a flattened module: returns the internal nets that can
+// never hold X or Z, assuming top-level inputs are driven with known values.
+// A net qualifies when it is a plain wire (up to 64 bits) with exactly one
+// full-width continuous driver whose right-hand side stays X-free given
+// qualifying operands: no x/z literals, no division, modulo or power, no
+// out-of-range constant selects or dynamic bit selects, no calls beyond
+// $signed/$unsigned, and no combinational cycles. Indexed part-selects
+// ([i +: W], [i -: W]) qualify only when the start is provably in range:
+// built from known numbers, unsigned nets of up to 32 bits, `+` and
+// non-wrapping `-`, with its largest value plus W inside the base, since
+// window bits past the base read as X. Regs start at X and ports, switch
+// terminals and procedural/force targets are never included; modules with
+// timing checks or specify paths yield an empty set.
+std::unordered_set<std::string> FindTwoStateNets(const Module& module);
+
+}  // namespace gpga
@@ -1,13 +1,19 @@
 #include "frontend/verilog_parser.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -25,13 +31,88 @@ enum class TokenKind {
   kEnd,
 };
 
+// Token text views the preprocessed source buffer (or the decoded copy of a
+// string literal with escapes) and must not outlive it. Identifiers carry an
+// interned atom so keyword tests are integer compares.
 struct Token {
   TokenKind kind = TokenKind::kEnd;
-  std::string text;
+  std::string_view text;
+  uint32_t atom = 0;
   int line = 1;
   int column = 1;
 };
 
+// Words interned at fixed atoms [1, kKeywordAtomEnd) in table order: the
+// IEEE 1364-2005 reserved words plus the contextual names the parser matches
+// (system task suffixes, attribute names). Every literal passed to
+// Parser::MatchKeyword must be listed here, since identifiers interned past
+// the table are rejected by atom alone.
+constexpr std::string_view kKeywordAtoms[] = {
+    "",
+    "acos", "acosh", "always", "and", "asin", "asinh", "assert", "assign",
+    "atan", "atan2", "atanh", "automatic", "begin", "bits", "bitstoreal", "buf",
+    "bufif0", "bufif1", "case", "casex", "casez", "ceil", "cell", "clog2",
+    "cmos", "config", "cos", "cosh", "deassign", "default", "defparam",
+    "design", "dimensions", "disable", "edge", "else", "end", "endcase",
+    "endconfig", "endfunction", "endgenerate", "endmodule", "endprimitive",
+    "endspecify", "endtable", "endtask", "event", "exp", "feof", "ferror",
+    "fgetc", "fgets", "floor", "fopen", "for", "force", "forever", "fork",
+    "fread", "fscanf", "fseek", "ftell", "function", "generate", "genvar",
+    "high", "highz0", "highz1", "hypot", "if", "ifnone", "incdir", "include",
+    "initial", "inout", "input", "instance", "int", "integer", "itor", "join",
+    "large", "left", "liblist", "library", "ln", "localparam", "log10", "low",
+    "macromodule", "medium", "module", "nand", "negedge", "nmos", "nor",
+    "noshowcancelled", "not", "notif0", "notif1", "or", "output", "parameter",
+    "plusargs", "pmos", "posedge", "pow", "primitive", "priority", "pull0",
+    "pull1", "pulldown", "pullup", "pulsestyle_ondetect", "pulsestyle_onevent",
+    "random", "rcmos", "real", "realtime", "realtobits", "reg", "release",
+    "repeat", "rewind", "right", "rnmos", "rpmos", "rtoi", "rtran", "rtranif0",
+    "rtranif1", "scalared", "showcancelled", "signed", "sin", "sinh", "size",
+    "small", "specify", "specparam", "sqrt", "sscanf", "stime", "strong0",
+    "strong1", "supply0", "supply1", "table", "tan", "tanh", "task", "test",
+    "time", "tran", "tranif0", "tranif1", "tri", "tri0", "tri1", "triand",
+    "trior", "trireg", "ungetc", "unique", "unsigned", "urandom",
+    "urandom_range", "use", "uwire", "value", "vectored", "wait", "wand",
+    "weak0", "weak1", "while", "wire", "wor", "xnor", "xor",
+};
+constexpr uint32_t kKeywordAtomEnd =
+    static_cast<uint32_t>(sizeof(kKeywordAtoms) / sizeof(kKeywordAtoms[0]));
+
+// Per-parse identifier interning. Keys view the source buffer, so the table
+// lives no longer than the tokens it produced.
+class IdentifierTable {
+ public:
+  IdentifierTable() {
+    atoms_.reserve(4096);
+    for (uint32_t atom = 1; atom < kKeywordAtomEnd; ++atom) {
+      atoms_.emplace(kKeywordAtoms[atom], atom);
+    }
+  }
+
+  uint32_t Intern(std::string_view text) {
+    auto inserted = atoms_.emplace(text, next_atom_);
+    if (inserted.second) {
+      ++next_atom_;
+    }
+    return inserted.first->second;
+  }
+
+  // Distinct non-keyword identifiers seen so far.
+  uint32_t identifier_count() const { return next_atom_ - kKeywordAtomEnd; }
+
+ private:
+  std::unordered_map<std::string_view, uint32_t> atoms_;
+  uint32_t next_atom_ = kKeywordAtomEnd;
+};
+
+struct TokenizedSource {
+  std::vector<Token> tokens;
+  // Backing text for string literals whose escapes change their value;
+  // a deque so earlier entries never move.
+  std::deque<std::string> decoded_strings;
+  uint32_t identifier_count = 0;
+};
+
 bool IsIdentStart(char c) {
   return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
 }
@@ -40,9 +121,9 @@ bool IsIdentChar(char c) {
   return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
 }
 
-std::string StripUnderscores(const std::string& text) {
-  if (text.find('_') == std::string::npos) {
-    return text;
+std::string StripUnderscores(std::string_view text) {
+  if (text.find('_') == std::string_view::npos) {
+    return std::string(text);
   }
   std::string cleaned;
   cleaned.reserve(text.size());
@@ -54,19 +135,29 @@ std::string StripUnderscores(const std::string& text) {
   return cleaned;
 }
 
-std::vector<Token> Tokenize(const std::string& text) {
-  std::vector<Token> tokens;
+// Splits preprocessed text into tokens that view `text` in place; `text`
+// must outlive `out`.
+void Tokenize(const std::string& text, TokenizedSource* out) {
+  const std::string_view source(text);
+  std::vector<Token>& tokens = out->tokens;
+  tokens.clear();
+  // Roughly one token per 6 bytes of typical RTL and netlist text.
+  tokens.reserve(text.size() / 6 + 1);
+  IdentifierTable identifiers;
   size_t i = 0;
   int line = 1;
   int column = 1;
-  auto push = [&](TokenKind kind, std::string value, int token_line,
+  auto push = [&](TokenKind kind, std::string_view value, int token_line,
                   int token_column) {
     Token token;
     token.kind = kind;
-    token.text = std::move(value);
+    token.text = value;
+    if (kind == TokenKind::kIdentifier) {
+      token.atom = identifiers.Intern(value);
+    }
     token.line = token_line;
     token.column = token_column;
-    tokens.push_back(std::move(token));
+    tokens.push_back(token);
   };
 
   while (i < text.size()) {
@@ -151,34 +242,43 @@ std::vector<Token> Tokenize(const std::string& text) {
       int token_column = column;
       ++i;
       ++column;
-      std::string value;
+      const size_t start = i;
+      size_t end = std::string::npos;
+      // Literals without escapes view the source; the first escape switches
+      // to a decoded copy.
+      std::string* value = nullptr;
       while (i < text.size()) {
         char ch = text[i];
         if (ch == '"') {
+          end = i;
           ++i;
           ++column;
           break;
         }
         if (ch == '\\' && i + 1 < text.size()) {
+          if (!value) {
+            out->decoded_strings.emplace_back(source.substr(start, i - start));
+            value = &out->decoded_strings.back();
+          }
           char esc = text[i + 1];
           switch (esc) {
             case 'n':
-              value.push_back('\n');
+              value->push_back('\n');
               break;
             case 't':
-              value.push_back('\t');
+              value->push_back('\t');
               break;
             case 'r':
-              value.push_back('\r');
+              value->push_back('\r');
               break;
             case '"':
-              value.push_back('"');
+              value->push_back('"');
               break;
             case '\\':
-              value.push_back('\\');
+              value->push_back('\\');
               break;
             default:
-              value.push_back(esc);
+              value->push_back(esc);
               break;
           }
           i += 2;
@@ -191,10 +291,17 @@ std::vector<Token> Tokenize(const std::string& text) {
         } else {
           ++column;
         }
-        value.push_back(ch);
+        if (value) {
+          value->push_back(ch);
+        }
         ++i;
       }
-      push(TokenKind::kString, value, token_line, token_column);
+      if (end == std::string::npos) {
+        end = i;
+      }
+      push(TokenKind::kString,
+           value ? std::string_view(*value) : source.substr(start, end - start),
+           token_line, token_column);
       continue;
     }
     if (c == '\\') {
@@ -208,7 +315,7 @@ std::vector<Token> Tokenize(const std::string& text) {
         ++i;
         ++column;
       }
-      push(TokenKind::kIdentifier, text.substr(start, i - start), token_line,
+      push(TokenKind::kIdentifier, source.substr(start, i - start), token_line,
            token_column);
       continue;
     }
@@ -222,7 +329,7 @@ std::vector<Token> Tokenize(const std::string& text) {
         ++i;
         ++column;
       }
-      push(TokenKind::kIdentifier, text.substr(start, i - start), token_line,
+      push(TokenKind::kIdentifier, source.substr(start, i - start), token_line,
            token_column);
       continue;
     }
@@ -276,7 +383,7 @@ std::vector<Token> Tokenize(const std::string& text) {
           ++column;
         }
       }
-      push(TokenKind::kNumber, text.substr(start, i - start), token_line,
+      push(TokenKind::kNumber, source.substr(start, i - start), token_line,
            token_column);
       continue;
     }
@@ -284,10 +391,7 @@ std::vector<Token> Tokenize(const std::string& text) {
     if ((c == '+' || c == '-') && i + 1 < text.size() && text[i + 1] == ':') {
       int token_line = line;
       int token_column = column;
-      std::string sym;
-      sym.push_back(c);
-      sym.push_back(':');
-      push(TokenKind::kSymbol, sym, token_line, token_column);
+      push(TokenKind::kSymbol, source.substr(i, 2), token_line, token_column);
       i += 2;
       column += 2;
       continue;
@@ -295,7 +399,7 @@ std::vector<Token> Tokenize(const std::string& text) {
     if (c == '-' && i + 1 < text.size() && text[i + 1] == '>') {
       int token_line = line;
       int token_column = column;
-      push(TokenKind::kSymbol, "->", token_line, token_column);
+      push(TokenKind::kSymbol, source.substr(i, 2), token_line, token_column);
       i += 2;
       column += 2;
       continue;
@@ -303,13 +407,13 @@ std::vector<Token> Tokenize(const std::string& text) {
 
     int token_line = line;
     int token_column = column;
-    push(TokenKind::kSymbol, std::string(1, c), token_line, token_column);
+    push(TokenKind::kSymbol, source.substr(i, 1), token_line, token_column);
     ++i;
     ++column;
   }
 
-  tokens.push_back(Token{TokenKind::kEnd, "", line, column});
-  return tokens;
+  push(TokenKind::kEnd, std::string_view(), line, column);
+  out->identifier_count = identifiers.identifier_count();
 }
 
 struct MacroDef {
@@ -1077,7 +1181,7 @@ class Parser {
       }
       const Token& token = Peek();
       diagnostics_->Add(Severity::kError,
-                        "unexpected token '" + token.text + "'",
+                        "unexpected token '" + std::string(token.text) + "'",
                         SourceLocation{path_, token.line, token.column});
       return false;
     }
@@ -1270,8 +1374,10 @@ class Parser {
     return Peek().kind == TokenKind::kSymbol && Peek().text == symbol;
   }
 
-  bool MatchKeyword(const char* keyword) {
-    if (Peek().kind == TokenKind::kIdentifier && Peek().text == keyword) {
+  bool MatchKeyword(std::string_view keyword) {
+    const Token& token = Peek();
+    if (token.kind == TokenKind::kIdentifier &&
+        token.atom < kKeywordAtomEnd && kKeywordAtoms[token.atom] == keyword) {
       Advance();
       return true;
     }
@@ -1327,7 +1433,7 @@ class Parser {
             Peek(2).kind == TokenKind::kSymbol && Peek(2).text == "]" &&
             Peek(3).kind == TokenKind::kSymbol && Peek(3).text == ".") {
           Advance();
-          std::string index = Peek().text;
+          std::string index(Peek().text);
           Advance();
           Advance();
           name += "__";
@@ -1588,7 +1694,7 @@ class Parser {
       }
       if (Peek().kind == TokenKind::kIdentifier &&
           IsGatePrimitiveKeyword(Peek().text)) {
-        std::string gate = Peek().text;
+        std::string gate(Peek().text);
         Advance();
         std::vector<GateAssign> gate_assigns;
         if (!ParseGatePrimitiveAssignments(gate, &gate_assigns)) {
@@ -1631,7 +1737,7 @@ class Parser {
       }
       if (Peek().kind == TokenKind::kIdentifier &&
           IsSwitchPrimitiveKeyword(Peek().text)) {
-        std::string prim = Peek().text;
+        std::string prim(Peek().text);
         Advance();
         if (!ParseSwitchPrimitive(prim, &module)) {
           return false;
@@ -1644,7 +1750,7 @@ class Parser {
         }
         continue;
       }
-      ErrorHere("unsupported module item '" + Peek().text + "'");
+      ErrorHere("unsupported module item '" + std::string(Peek().text) + "'");
       return false;
     }
 
@@ -2115,7 +2221,7 @@ class Parser {
     }
       if (Peek().kind == TokenKind::kNumber ||
           Peek().kind == TokenKind::kIdentifier) {
-        const std::string text = Peek().text;
+        const std::string text(Peek().text);
         Advance();
         if (text.size() > 2) {
           ErrorHere("invalid UDP edge pattern");
@@ -2416,7 +2522,7 @@ class Parser {
     return true;
   }
 
-  bool IsGatePrimitiveKeyword(const std::string& ident) const {
+  bool IsGatePrimitiveKeyword(std::string_view ident) const {
     return ident == "buf" || ident == "not" || ident == "and" ||
            ident == "nand" || ident == "or" || ident == "nor" ||
            ident == "xor" || ident == "xnor" || ident == "bufif0" ||
@@ -2425,7 +2531,7 @@ class Parser {
            ident == "rpmos";
   }
 
-  bool IsSwitchPrimitiveKeyword(const std::string& ident) const {
+  bool IsSwitchPrimitiveKeyword(std::string_view ident) const {
     return ident == "tran" || ident == "tranif1" || ident == "tranif0" ||
            ident == "cmos" || ident == "rcmos";
   }
@@ -3133,50 +3239,47 @@ class Parser {
   };
 
   SpecifyDelayConfig GetSpecifyDelayConfig() {
-    static bool cached = false;
-    static SpecifyDelayConfig config;
-    if (cached) {
-      return config;
-    }
-    cached = true;
-    if (const char* env = std::getenv("METALFPGA_SPECIFY_DELAY_SELECT")) {
-      std::string lowered;
-      lowered.reserve(std::strlen(env));
-      for (const char* p = env; *p != '\0'; ++p) {
-        lowered.push_back(
-            static_cast<char>(std::tolower(static_cast<unsigned char>(*p))));
-      }
-      if (lowered == "slow") {
-        config.mode = SpecifyDelaySelectMode::kSlow;
-      } else if (lowered != "fast" && !lowered.empty()) {
-        config.invalid_env = true;
+    // Read once; a static initializer is safe under parallel parsing.
+    static const SpecifyDelayConfig config = []() {
+      SpecifyDelayConfig config;
+      if (const char* env = std::getenv("METALFPGA_SPECIFY_DELAY_SELECT")) {
+        std::string lowered;
+        lowered.reserve(std::strlen(env));
+        for (const char* p = env; *p != '\0'; ++p) {
+          lowered.push_back(
+              static_cast<char>(std::tolower(static_cast<unsigned char>(*p))));
+        }
+        if (lowered == "slow") {
+          config.mode = SpecifyDelaySelectMode::kSlow;
+        } else if (lowered != "fast" && !lowered.empty()) {
+          config.invalid_env = true;
+        }
       }
-    }
+      return config;
+    }();
     return config;
   }
 
   NegativeSetupConfig GetNegativeSetupConfig() {
-    static bool cached = false;
-    static NegativeSetupConfig config;
-    if (cached) {
-      return config;
-    }
-    cached = true;
-    if (const char* env = std::getenv("METALFPGA_NEGATIVE_SETUP_MODE")) {
-      std::string lowered;
-      lowered.reserve(std::strlen(env));
-      for (const char* p = env; *p != '\0'; ++p) {
-        lowered.push_back(
-            static_cast<char>(std::tolower(static_cast<unsigned char>(*p))));
-      }
-      if (lowered == "clamp") {
-        config.mode = NegativeSetupMode::kClamp;
-      } else if (lowered == "error") {
-        config.mode = NegativeSetupMode::kError;
-      } else if (lowered != "allow" && !lowered.empty()) {
-        config.invalid_env = true;
+    static const NegativeSetupConfig config = []() {
+      NegativeSetupConfig config;
+      if (const char* env = std::getenv("METALFPGA_NEGATIVE_SETUP_MODE")) {
+        std::string lowered;
+        lowered.reserve(std::strlen(env));
+        for (const char* p = env; *p != '\0'; ++p) {
+          lowered.push_back(
+              static_cast<char>(std::tolower(static_cast<unsigned char>(*p))));
+        }
+        if (lowered == "clamp") {
+          config.mode = NegativeSetupMode::kClamp;
+        } else if (lowered == "error") {
+          config.mode = NegativeSetupMode::kError;
+        } else if (lowered != "allow" && !lowered.empty()) {
+          config.invalid_env = true;
+        }
       }
-    }
+      return config;
+    }();
     return config;
   }
 
@@ -3229,7 +3332,7 @@ class Parser {
     if (!index || *index >= tokens.size()) {
       return {};
     }
-    std::string name = tokens[*index].text;
+    std::string name(tokens[*index].text);
     size_t i = *index + 1;
     while (i + 1 < tokens.size() &&
            tokens[i].kind == TokenKind::kSymbol && tokens[i].text == "." &&
@@ -3376,15 +3479,15 @@ class Parser {
       if (tokens[i].kind != TokenKind::kSymbol) {
         continue;
       }
-      std::string first = tokens[i].text;
-      std::string second =
+      std::string_view first = tokens[i].text;
+      std::string_view second =
           (i + 1 < tokens.size() && tokens[i + 1].kind == TokenKind::kSymbol)
               ? tokens[i + 1].text
-              : "";
-      std::string third =
+              : std::string_view();
+      std::string_view third =
           (i + 2 < tokens.size() && tokens[i + 2].kind == TokenKind::kSymbol)
               ? tokens[i + 2].text
-              : "";
+              : std::string_view();
       if ((first == "+" || first == "-") && second == "=" && third == ">") {
         arrow.index = i;
         arrow.token_count = 3;
@@ -3466,7 +3569,7 @@ class Parser {
     if (tokens[0].kind != TokenKind::kIdentifier) {
       return true;
     }
-    std::string head = tokens[0].text;
+    std::string head(tokens[0].text);
     if (head != "if" && head != "ifnone") {
       return true;
     }
@@ -3784,7 +3887,7 @@ class Parser {
     return false;
   }
 
-  std::string ToLowerAscii(const std::string& value) {
+  std::string ToLowerAscii(std::string_view value) {
     std::string out;
     out.reserve(value.size());
     for (char c : value) {
@@ -3880,7 +3983,6 @@ class Parser {
     std::vector<Token> expr_tokens = tokens;
     Token end;
     end.kind = TokenKind::kEnd;
-    end.text = "";
     end.line = tokens.back().line;
     end.column = tokens.back().column;
     expr_tokens.push_back(end);
@@ -4137,7 +4239,7 @@ class Parser {
                                        start_token.column});
       return false;
     }
-    std::string name = tokens[name_index].text;
+    std::string name(tokens[name_index].text);
     if (!name.empty() && name[0] == '$') {
       name = name.substr(1);
     }
@@ -4352,7 +4454,7 @@ class Parser {
         }
         if (tokens_ptr->size() == 1 &&
             (*tokens_ptr)[0].kind == TokenKind::kIdentifier) {
-          return EnsureImplicitNet(module, (*tokens_ptr)[0].text);
+          return EnsureImplicitNet(module, std::string((*tokens_ptr)[0].text));
         }
         return true;
       };
@@ -6460,7 +6562,7 @@ class Parser {
       while (!IsAtEnd()) {
         if (Peek().kind == TokenKind::kSymbol && paren_depth == 0 &&
             bracket_depth == 0 && brace_depth == 0 &&
-            stop.count(Peek().text) != 0) {
+            stop.count(std::string(Peek().text)) != 0) {
           break;
         }
         const Token& token = Peek();
@@ -7283,12 +7385,12 @@ class Parser {
     return true;
   }
 
-  bool ParseStrengthToken(const std::string& token, Strength* strength,
+  bool ParseStrengthToken(std::string_view token, Strength* strength,
                           int* drive_value) const {
     if (!strength || !drive_value) {
       return false;
     }
-    std::string lower = token;
+    std::string lower(token);
     for (char& c : lower) {
       c = static_cast<char>(std::tolower(c));
     }
@@ -7465,12 +7567,12 @@ class Parser {
     return ParseDriveStrength(strength0, strength1, has_strength);
   }
 
-  bool ParseChargeStrengthToken(const std::string& token,
+  bool ParseChargeStrengthToken(std::string_view token,
                                 ChargeStrength* out) const {
     if (!out) {
       return false;
     }
-    std::string lower = token;
+    std::string lower(token);
     for (char& c : lower) {
       c = static_cast<char>(std::tolower(c));
     }
@@ -9644,7 +9746,7 @@ class Parser {
     }
     if (Peek().kind == TokenKind::kIdentifier &&
         IsGatePrimitiveKeyword(Peek().text)) {
-      std::string gate = Peek().text;
+      std::string gate(Peek().text);
       Advance();
       std::vector<GateAssign> gate_assigns;
       if (!ParseGatePrimitiveAssignments(gate, &gate_assigns, true)) {
@@ -11994,7 +12096,7 @@ class Parser {
     }
   }
 
-  bool IsMinTypMaxStopKeyword(const std::string& name) const {
+  bool IsMinTypMaxStopKeyword(std::string_view name) const {
     return name == "begin" || name == "end" || name == "if" ||
            name == "else" || name == "case" || name == "casez" ||
            name == "casex" || name == "endcase" || name == "default" ||
@@ -12029,7 +12131,7 @@ class Parser {
       if (token.kind != TokenKind::kSymbol) {
         continue;
       }
-      const std::string& sym = token.text;
+      const std::string_view sym = token.text;
       if (sym == "(") {
         ++paren_depth;
         continue;
@@ -12436,7 +12538,7 @@ class Parser {
 
       if (Peek().kind == TokenKind::kIdentifier &&
           Peek().text.find('$') != std::string::npos) {
-        std::string name = Peek().text;
+        std::string name(Peek().text);
         Advance();
         if (name == "test$plusargs" || name == "value$plusargs") {
           expr = parse_system_call("$" + name, false);
@@ -12949,7 +13051,7 @@ class Parser {
       return nullptr;
     }
     const Token base_token = Peek();
-    std::string token = base_token.text;
+    std::string token(base_token.text);
     Advance();
     if (token.empty()) {
       ErrorHere("invalid base literal");
@@ -12971,7 +13073,7 @@ class Parser {
     char base_char = static_cast<char>(std::tolower(
         static_cast<unsigned char>(token[base_index])));
     std::string digits = token.substr(base_index + 1);
-    auto append_token = [&](const Token& next, const std::string& text) {
+    auto append_token = [&](const Token& next, std::string_view text) {
       digits += text;
       last_line = next.line;
       last_end_column = next.column + static_cast<int>(next.text.size());
@@ -14862,9 +14964,9 @@ class Parser {
     if (Peek().kind == TokenKind::kSymbol &&
         Peek(1).kind == TokenKind::kSymbol &&
         Peek(2).kind == TokenKind::kSymbol &&
-        Peek().text == std::string(1, symbol[0]) &&
-        Peek(1).text == std::string(1, symbol[1]) &&
-        Peek(2).text == std::string(1, symbol[2])) {
+        Peek().text == std::string_view(symbol, 1) &&
+        Peek(1).text == std::string_view(symbol + 1, 1) &&
+        Peek(2).text == std::string_view(symbol + 2, 1)) {
       Advance();
       Advance();
       Advance();
@@ -14874,15 +14976,17 @@ class Parser {
   }
 };
 
-}  // namespace
-
-bool ParseVerilogFile(const std::string& path, Program* out_program,
-                      Diagnostics* diagnostics,
-                      const ParseOptions& options) {
-  if (!out_program || !diagnostics) {
-    return false;
-  }
+// `require_modules` rejects a program that is still empty after this file;
+// ParseVerilogFiles leaves that check to the caller's merge.
+bool ParseVerilogSource(const std::string& path, Program* out_program,
+                        Diagnostics* diagnostics, const ParseOptions& options,
+                        ParseStats* stats, bool require_modules) {
 
+  using Clock = std::chrono::steady_clock;
+  auto stage_ms = [](Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+  const Clock::time_point read_start = Clock::now();
   std::ifstream file(path);
   if (!file) {
     diagnostics->Add(Severity::kError,
@@ -14900,19 +15004,39 @@ bool ParseVerilogFile(const std::string& path, Program* out_program,
                      SourceLocation{path});
     return false;
   }
+  const Clock::time_point preprocess_start = Clock::now();
   std::string text;
   std::vector<DirectiveEvent> directives;
   if (!PreprocessVerilog(raw_text, path, diagnostics, &text, &directives)) {
     return false;
   }
 
-  Parser parser(path, Tokenize(text), diagnostics, options,
+  // `text` backs every token view and must stay alive until parsing is done.
+  const Clock::time_point tokenize_start = Clock::now();
+  TokenizedSource source;
+  Tokenize(text, &source);
+  const size_t token_count = source.tokens.size();
+  const Clock::time_point parse_start = Clock::now();
+  Parser parser(path, std::move(source.tokens), diagnostics, options,
                 std::move(directives));
-  if (!parser.ParseProgram(out_program)) {
+  const bool parsed = parser.ParseProgram(out_program);
+  if (stats) {
+    const Clock::time_point parse_end = Clock::now();
+    stats->files += 1;
+    stats->source_bytes += raw_text.size();
+    stats->preprocessed_bytes += text.size();
+    stats->tokens += token_count;
+    stats->identifiers += source.identifier_count;
+    stats->read_ms += stage_ms(read_start, preprocess_start);
+    stats->preprocess_ms += stage_ms(preprocess_start, tokenize_start);
+    stats->tokenize_ms += stage_ms(tokenize_start, parse_start);
+    stats->parse_ms += stage_ms(parse_start, parse_end);
+  }
+  if (!parsed) {
     return false;
   }
 
-  if (out_program->modules.empty() && !options.allow_empty) {
+  if (require_modules && out_program->modules.empty()) {
     diagnostics->Add(Severity::kError,
                      "no modules found in input",
                      SourceLocation{path});
@@ -14921,4 +15045,107 @@ bool ParseVerilogFile(const std::string& path, Program* out_program,
   return true;
 }
 
+}  // namespace
+
+bool ParseVerilogFile(const std::string& path, Program* out_program,
+                      Diagnostics* diagnostics,
+                      const ParseOptions& options, ParseStats* stats) {
+  if (!out_program || !diagnostics) {
+    return false;
+  }
+  return ParseVerilogSource(path, out_program, diagnostics, options, stats,
+                            !options.allow_empty);
+}
+
+void ParseVerilogFiles(const std::vector<std::string>& paths,
+                       const ParseOptions& options, uint32_t threads,
+                       std::vector<ParsedSourceFile>* out) {
+  if (!out) {
+    return;
+  }
+  out->clear();
+  out->resize(paths.size());
+  auto parse_one = [&](size_t index) {
+    ParsedSourceFile& file = (*out)[index];
+    file.path = paths[index];
+    file.ok = ParseVerilogSource(file.path, &file.program, &file.diagnostics,
+                                 options, &file.stats, false);
+  };
+  if (threads == 0u) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<uint32_t>(
+      std::min<size_t>(threads, std::max<size_t>(paths.size(), 1u)));
+  if (threads <= 1u) {
+    for (size_t i = 0; i < paths.size(); ++i) {
+      parse_one(i);
+    }
+    return;
+  }
+  // Workers claim files through a shared cursor; each writes only its own
+  // slot, so the output order is the input order regardless of timing.
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next.fetch_add(1); i < paths.size();
+         i = next.fetch_add(1)) {
+      parse_one(i);
+    }
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1u);
+  for (uint32_t i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+void ParseStats::Add(const ParseStats& other) {
+  files += other.files;
+  source_bytes += other.source_bytes;
+  preprocessed_bytes += other.preprocessed_bytes;
+  tokens += other.tokens;
+  identifiers += other.identifiers;
+  read_ms += other.read_ms;
+  preprocess_ms += other.preprocess_ms;
+  tokenize_ms += other.tokenize_ms;
+  parse_ms += other.parse_ms;
+}
+
+bool AppendPreprocessedVerilog(const std::string& path, std::string* out,
+                               Diagnostics* diagnostics) {
+  if (!out || !diagnostics) {
+    return false;
+  }
+  std::ifstream file(path);
+  if (!file) {
+    diagnostics->Add(Severity::kError, "failed to open input file",
+                     SourceLocation{path});
+    return false;
+  }
+  std::ostringstream buffer;
+  buffer << file.rdbuf();
+  std::string text;
+  std::vector<DirectiveEvent> directives;
+  if (!PreprocessVerilog(buffer.str(), path, diagnostics, &text,
+                         &directives)) {
+    return false;
+  }
+  out->append(text);
+  for (const auto& directive : directives) {
+    out->append("\n`");
+    out->append(std::to_string(static_cast<int>(directive.kind)));
+    out->append(" ");
+    out->append(directive.arg);
+    out->append(" @");
+    out->append(std::to_string(directive.line));
+    out->append(":");
+    out->append(std::to_string(directive.column));
+  }
+  out->push_back('\n');
+  return true;
+}
+
 }  // namespace gpga
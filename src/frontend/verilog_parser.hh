@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "frontend/ast.hh"
 #include "utils/diagnostics.hh"
@@ -13,8 +15,50 @@ struct ParseOptions {
   bool strict_1364 = false;
 };
 
+// Front-end throughput counters. ParseVerilogFile adds to them, so one
+// instance can total several files.
+struct ParseStats {
+  uint64_t files = 0;
+  uint64_t source_bytes = 0;
+  uint64_t preprocessed_bytes = 0;
+  uint64_t tokens = 0;
+  // Distinct non-keyword identifiers, counted per file.
+  uint64_t identifiers = 0;
+  double read_ms = 0.0;
+  double preprocess_ms = 0.0;
+  double tokenize_ms = 0.0;
+  double parse_ms = 0.0;
+
+  void Add(const ParseStats& other);
+};
+
 bool ParseVerilogFile(const std::string& path, Program* out_program,
                       Diagnostics* diagnostics,
-                      const ParseOptions& options = {});
+                      const ParseOptions& options = {},
+                      ParseStats* stats = nullptr);
+
+// Per-file result of ParseVerilogFiles. `ok` is false when the file failed
+// to read, preprocess or parse; an empty `program` is not an error here.
+struct ParsedSourceFile {
+  std::string path;
+  Program program;
+  Diagnostics diagnostics;
+  ParseStats stats;
+  bool ok = false;
+};
+
+// Parses each path into its own ParsedSourceFile on up to `threads` workers
+// (0 = hardware concurrency). Files are preprocessed independently, so
+// (*out)[i] depends only on paths[i] and callers merging in index order get
+// the same Program and diagnostics as a serial ParseVerilogFile loop.
+void ParseVerilogFiles(const std::vector<std::string>& paths,
+                       const ParseOptions& options, uint32_t threads,
+                       std::vector<ParsedSourceFile>* out);
+
+// Appends the preprocessed text of `path` (includes expanded, macros applied)
+// and its compiler directives to `out`. Files with equal output parse to the
+// same Program, so the text can key caches of parse results.
+bool AppendPreprocessedVerilog(const std::string& path, std::string* out,
+                               Diagnostics* diagnostics);
 
 }  // namespace gpga
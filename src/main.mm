@@ -1,38 +1,103 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
+#include <charconv>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdio>
 #include <csignal>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <sys/resource.h>
+
+#include "codegen/cpp_codegen.hh"
 #include "codegen/host_codegen.hh"
 #include "codegen/msl_codegen.hh"
+#include "core/bit_packing.hh"
+#include "core/design_image.hh"
 #include "core/elaboration.hh"
 #include "core/scheduler_vm.hh"
+#include "core/scheduler_vm_opt.hh"
+#include "core/state_locality.hh"
+#include "core/x_reachability.hh"
 #include "frontend/verilog_parser.hh"
 #include "gpga_sched.h"
+#include "runtime/artifact_cache.hh"
+#include "runtime/mem_image.hh"
 #include "runtime/metal_runtime.hh"
+#include "runtime/sched_manifest.hh"
+#include "runtime/scheduler_vm_image.hh"
+#include "runtime/scheduler_vm_interp.hh"
+#include "runtime/waveform.hh"
 #include "utils/msl_naming.hh"
 #include "utils/diagnostics.hh"
 
+#if defined(METALFPGA_COUNT_ALLOCATIONS)
+// Counting builds (-DMETALFPGA_COUNT_ALLOCATIONS=ON) replace operator new so
+// --run-verbose can report heap allocations per drained service record; the
+// default build keeps the standard allocator.
+namespace {
+
+// Heap allocations made by the current thread.
+thread_local uint64_t g_thread_heap_allocations = 0;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  ++g_thread_heap_allocations;
+  if (size == 0u) {
+    size = 1u;
+  }
+  for (;;) {
+    if (void* ptr = std::malloc(size)) {
+      return ptr;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
+
 namespace {
 
+#if defined(METALFPGA_COUNT_ALLOCATIONS)
+constexpr bool kCountHeapAllocations = true;
+uint64_t ThreadHeapAllocations() { return g_thread_heap_allocations; }
+#else
+constexpr bool kCountHeapAllocations = false;
+uint64_t ThreadHeapAllocations() { return 0u; }
+#endif
+
 constexpr const char* kMetalFpgaVersion = "dev";
 volatile sig_atomic_t g_halt_request = 0;
 
@@ -46,16 +111,26 @@ void InstallHaltSignalHandlers() {
 void PrintUsage(const char* argv0) {
   std::cerr << "Usage: " << argv0
             << " <input.v> [<more.v> ...] [--emit-msl <path>] [--emit-host <path>]"
+            << " [--emit-cpp <path>]"
             << " [--emit-flat <path>] [--dump-flat] [--top <module>]"
-            << " [--4state] [--sched-vm] [--fallback-diag] [--auto] [--strict-1364]"
+            << " [--4state] [--sched-vm] [--sched-vm-dedup] [--sched-vm-opt]"
+            << " [--fallback-diag] [--vm-fallback-report]"
+            << " [--hier-codegen] [--prune-xz] [--pack-bits]"
+            << " [--locality-layout]"
+            << " [--auto] [--strict-1364]"
+            << " [--check-manifest] [--artifact-cache]"
+            << " [--emit-vm-image <path>] [--vm-image <path>]"
+            << " [--vm-profile] [--vm-profile-max-time N] [--parse-bench]"
+            << " [--parse-jobs N] [--elab-bench]"
             << " [--sdf <path>] [--version]"
             << " [--verbose]"
-            << " [--run] [--count N] [--service-capacity N]"
+            << " [--run] [--run-cpu] [--count N] [--service-capacity N]"
             << " [--max-steps N] [--max-proc-steps N]"
             << " [--dispatch-timeout-ms N]"
             << " [--run-verbose]"
             << " [--source-bindings]"
             << " [--vcd-dir <path>] [--vcd-steps N]"
+            << " [--wave-format vcd|gpgawf]"
             << " [+ARG[=VALUE] ...]\n";
 }
 
@@ -1788,8 +1863,10 @@ bool ModuleUsesDumpvars(const gpga::Module& module) {
   return info.has_dumpvars;
 }
 
-gpga::ModuleInfo BuildModuleInfo(const gpga::Module& module,
-                                 bool four_state) {
+// `two_state_nets`: --prune-xz nets whose packed xz segment codegen dropped.
+gpga::ModuleInfo BuildModuleInfo(
+    const gpga::Module& module, bool four_state,
+    const std::unordered_set<std::string>* two_state_nets = nullptr) {
   gpga::ModuleInfo info;
   info.name = module.name;
   info.four_state = four_state;
@@ -1825,6 +1902,14 @@ gpga::ModuleInfo BuildModuleInfo(const gpga::Module& module,
       }
     }
   }
+  if (two_state_nets) {
+    for (const auto& name : *two_state_nets) {
+      auto it = signals.find(name);
+      if (it != signals.end()) {
+        it->second.two_state = true;
+      }
+    }
+  }
   info.signals.reserve(signals.size());
   for (auto& entry : signals) {
     info.signals.push_back(std::move(entry.second));
@@ -1906,8 +1991,6 @@ bool InitSchedulerVmBuffers(
       layout ? static_cast<uint32_t>(layout->bytecode.size())
              : sched.vm_bytecode_words;
   const uint32_t layout_proc_count = layout ? layout->proc_count : proc_count;
-  const uint32_t layout_words_per_proc =
-      layout ? layout->words_per_proc : 0u;
   if (proc_count == 0u || vm_words == 0u) {
     if (error) {
       *error = "scheduler VM enabled without bytecode sizing";
@@ -1926,32 +2009,15 @@ bool InitSchedulerVmBuffers(
     }
     return false;
   }
-  if (vm_words < proc_count * kMinWordsPerProc) {
+  // Layout procs are packed back to back at proc_offsets; without a layout
+  // every proc gets a fixed kCallGroup/kDone stub.
+  const uint32_t words_per_proc = layout ? 0u : vm_words / proc_count;
+  if (!layout && words_per_proc < kMinWordsPerProc) {
     if (error) {
       *error = "scheduler VM bytecode buffer too small for proc count";
     }
     return false;
   }
-  if (vm_words % proc_count != 0u) {
-    if (error) {
-      *error = "scheduler VM bytecode words not divisible by proc count";
-    }
-    return false;
-  }
-  const uint32_t words_per_proc = vm_words / proc_count;
-  if (words_per_proc < kMinWordsPerProc) {
-    if (error) {
-      *error = "scheduler VM words per proc below minimum";
-    }
-    return false;
-  }
-  if (layout && layout_words_per_proc != 0u &&
-      layout_words_per_proc != words_per_proc) {
-    if (error) {
-      *error = "scheduler VM layout words-per-proc mismatch";
-    }
-    return false;
-  }
   auto* bytecode_buf = FindBufferMutable(buffers, "sched_vm_bytecode", "");
   auto* offset_buf =
       FindBufferMutable(buffers, "sched_vm_proc_bytecode_offset", "");
@@ -2245,23 +2311,17 @@ bool InitSchedulerVmBuffers(
     if (has_layout) {
       std::memcpy(bytecode + vm_base, layout_bytecode,
                   sizeof(uint32_t) * layout->bytecode.size());
-      // Diagnostic: verify bytecode buffer contents on host
-      if (gid == 0 && layout->bytecode.size() > 0) {
-        fprintf(stderr, "host-bytecode-diag: gid=0 vm_base=%zu bc[0]=0x%08x bc[1]=0x%08x bc[2]=0x%08x bc[624]=0x%08x\n",
-                vm_base, bytecode[vm_base], bytecode[vm_base + 1],
-                bytecode[vm_base + 2], bytecode[vm_base + 624]);
-      }
     }
     for (uint32_t pid = 0u; pid < proc_count; ++pid) {
-      const size_t bc_index = vm_base + (pid * words_per_proc);
-      const uint32_t offset = static_cast<uint32_t>(bc_index);
       if (has_layout) {
         offsets[proc_base + pid] =
             static_cast<uint32_t>(vm_base + layout_offsets[pid]);
         lengths[proc_base + pid] = layout_lengths[pid];
         continue;
       }
-      offsets[proc_base + pid] = offset;
+      const size_t bc_index =
+          vm_base + static_cast<size_t>(pid) * words_per_proc;
+      offsets[proc_base + pid] = static_cast<uint32_t>(bc_index);
       lengths[proc_base + pid] = kMinWordsPerProc;
       bytecode[bc_index] = gpga::MakeSchedulerVmInstr(
           gpga::SchedulerVmOp::kCallGroup);
@@ -2282,6 +2342,9 @@ bool InitSchedulerVmBuffers(
         headers[i].entry_offset = src.entry_offset;
         headers[i].expr_offset = src.expr_offset;
         headers[i].default_target = src.default_target;
+        headers[i].table_offset = src.table_offset;
+        headers[i].table_mask = src.table_mask;
+        headers[i].wild_count = src.wild_count;
       }
     }
     if (!layout->case_entries.empty()) {
@@ -2527,14 +2590,29 @@ bool ReadSignalWordFromBuffer(const gpga::SignalInfo& sig, uint32_t gid,
   return true;
 }
 
+// `bit` >= 0 addresses a --pack-bits signal: bit `bit` of the 64-bit word at
+// [gid] of the group segment starting at `base_offset`.
 bool ReadPackedSignalWordFromBuffer(const gpga::SignalInfo& sig, uint32_t gid,
                                     uint64_t array_index,
                                     const gpga::MetalBuffer& buffer,
                                     size_t base_offset, size_t word_index,
-                                    uint64_t* value_out) {
+                                    uint64_t* value_out, int bit = -1) {
   if (!value_out || !buffer.contents()) {
     return false;
   }
+  if (bit >= 0) {
+    size_t offset = base_offset + static_cast<size_t>(gid) * sizeof(uint64_t);
+    if (word_index != 0u || array_index != 0u ||
+        buffer.length() < offset + sizeof(uint64_t)) {
+      return false;
+    }
+    uint64_t word = 0;
+    std::memcpy(&word,
+                static_cast<const uint8_t*>(buffer.contents()) + offset,
+                sizeof(uint64_t));
+    *value_out = (word >> bit) & 1ull;
+    return true;
+  }
   size_t word_count = SignalWordCount(sig);
   if (word_index >= word_count) {
     return false;
@@ -2570,10 +2648,24 @@ bool WritePackedSignalWordToBuffer(const gpga::SignalInfo& sig, uint32_t gid,
                                    uint64_t array_index,
                                    gpga::MetalBuffer* buffer,
                                    size_t base_offset, size_t word_index,
-                                   uint64_t value) {
+                                   uint64_t value, int bit = -1) {
   if (!buffer || !buffer->contents()) {
     return false;
   }
+  if (bit >= 0) {
+    size_t offset = base_offset + static_cast<size_t>(gid) * sizeof(uint64_t);
+    if (word_index != 0u || array_index != 0u ||
+        buffer->length() < offset + sizeof(uint64_t)) {
+      return false;
+    }
+    uint8_t* ptr = static_cast<uint8_t*>(buffer->contents()) + offset;
+    uint64_t word = 0;
+    std::memcpy(&word, ptr, sizeof(uint64_t));
+    const uint64_t mask = 1ull << bit;
+    word = (value & 1ull) ? (word | mask) : (word & ~mask);
+    std::memcpy(ptr, &word, sizeof(uint64_t));
+    return true;
+  }
   size_t word_count = SignalWordCount(sig);
   if (word_index >= word_count) {
     return false;
@@ -2772,7 +2864,7 @@ std::vector<uint64_t> PackStringWords(const std::string& value,
   return words;
 }
 
-std::string UnpackStringWords(const std::vector<uint64_t>& words,
+std::string UnpackStringWords(gpga::ServiceWordSpan words,
                               size_t max_bytes) {
   if (words.empty() || max_bytes == 0u) {
     return {};
@@ -2810,13 +2902,20 @@ std::string ReadSignalString(const gpga::SignalInfo& sig, uint32_t gid,
                              const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
   size_t max_bytes = (SignalBitWidth(sig) + 7u) / 8u;
   size_t word_count = SignalWordCount(sig);
-  std::vector<uint64_t> words(word_count, 0ull);
+  // Strings of up to 32 characters are read without a heap buffer.
+  std::array<uint64_t, 4> small_words{};
+  std::vector<uint64_t> large_words;
+  uint64_t* words = small_words.data();
+  if (word_count > small_words.size()) {
+    large_words.assign(word_count, 0ull);
+    words = large_words.data();
+  }
   for (size_t i = 0; i < word_count; ++i) {
     if (!ReadSignalWord(sig, gid, 0u, buffers, i, &words[i])) {
       return {};
     }
   }
-  return UnpackStringWords(words, max_bytes);
+  return UnpackStringWords({words, word_count}, max_bytes);
 }
 
 struct FormatSpec {
@@ -3118,18 +3217,6 @@ bool ParseTokenWords(const std::string& token_in, char spec, uint32_t width,
   return true;
 }
 
-uint32_t ReadU32(const uint8_t* base, size_t offset) {
-  uint32_t value = 0;
-  std::memcpy(&value, base + offset, sizeof(value));
-  return value;
-}
-
-uint64_t ReadU64(const uint8_t* base, size_t offset) {
-  uint64_t value = 0;
-  std::memcpy(&value, base + offset, sizeof(value));
-  return value;
-}
-
 std::string ResolveString(const gpga::ServiceStringTable& strings,
                           uint32_t id) {
   if (id >= strings.entries.size()) {
@@ -3231,8 +3318,10 @@ int ParseTimescaleExponent(const std::string& timescale) {
   return unit_exp + mag_exp;
 }
 
-std::string FormatBits(uint64_t value, uint64_t xz, uint32_t width, int base,
-                       bool has_xz) {
+// Writes the base-2/8/16 digits of a narrow value to `out` (at least 64
+// chars) and returns their count; X/Z digits print as 'x' when has_xz.
+size_t WriteBitDigits(uint64_t value, uint64_t xz, uint32_t width, int base,
+                      bool has_xz, char* out) {
   if (width == 0u) {
     width = 1u;
   }
@@ -3250,28 +3339,34 @@ std::string FormatBits(uint64_t value, uint64_t xz, uint32_t width, int base,
     group = 3;
   }
   int digits = static_cast<int>((width + group - 1u) / group);
-  std::string out;
-  out.reserve(static_cast<size_t>(digits));
+  size_t count = 0;
   for (int i = digits - 1; i >= 0; --i) {
     int shift = i * group;
     uint64_t group_mask = ((1ull << group) - 1ull) << shift;
     if (has_xz && (xz & group_mask) != 0ull) {
-      out.push_back('x');
+      out[count++] = 'x';
       continue;
     }
     uint64_t digit = (value >> shift) & ((1ull << group) - 1ull);
     if (base == 16) {
-      out.push_back("0123456789abcdef"[digit & 0xF]);
+      out[count++] = "0123456789abcdef"[digit & 0xF];
     } else if (base == 8) {
-      out.push_back("01234567"[digit & 0x7]);
+      out[count++] = "01234567"[digit & 0x7];
     } else {
-      out.push_back((digit & 1ull) ? '1' : '0');
+      out[count++] = (digit & 1ull) ? '1' : '0';
     }
   }
-  return out;
+  return count;
+}
+
+std::string FormatBits(uint64_t value, uint64_t xz, uint32_t width, int base,
+                       bool has_xz) {
+  char digits[64];
+  size_t count = WriteBitDigits(value, xz, width, base, has_xz, digits);
+  return std::string(digits, count);
 }
 
-bool WideHasXz(const std::vector<uint64_t>& words) {
+bool WideHasXz(gpga::ServiceWordSpan words) {
   for (uint64_t word : words) {
     if (word != 0u) {
       return true;
@@ -3280,7 +3375,7 @@ bool WideHasXz(const std::vector<uint64_t>& words) {
   return false;
 }
 
-bool WideBit(const std::vector<uint64_t>& words, uint32_t bit) {
+bool WideBit(gpga::ServiceWordSpan words, uint32_t bit) {
   size_t word_index = bit / 64u;
   if (word_index >= words.size()) {
     return false;
@@ -3306,9 +3401,9 @@ std::vector<uint64_t> MaskWideWords(std::vector<uint64_t> words,
   return words;
 }
 
-std::string FormatWideBits(const std::vector<uint64_t>& value_words,
-                           const std::vector<uint64_t>& xz_words,
-                           uint32_t width, int base, bool has_xz) {
+std::string FormatWideBits(gpga::ServiceWordSpan value_words,
+                           gpga::ServiceWordSpan xz_words, uint32_t width,
+                           int base, bool has_xz) {
   if (width == 0u) {
     width = 1u;
   }
@@ -3382,7 +3477,7 @@ std::string FormatWideSigned(std::vector<uint64_t> words, uint32_t width) {
   if (width == 0u || words.empty()) {
     return "0";
   }
-  bool sign = WideBit(words, width - 1u);
+  bool sign = WideBit({words.data(), words.size()}, width - 1u);
   if (!sign) {
     return FormatWideUnsigned(words, width);
   }
@@ -3414,8 +3509,8 @@ std::string ApplyPadding(std::string text, int width, bool zero_pad) {
 std::string FormatNumeric(const gpga::ServiceArgView& arg, char spec,
                           bool has_xz) {
   if (arg.kind == gpga::ServiceArgKind::kWide && !arg.wide_value.empty()) {
-    const std::vector<uint64_t>& val = arg.wide_value;
-    const std::vector<uint64_t>& xz = arg.wide_xz;
+    gpga::ServiceWordSpan val = arg.wide_value;
+    gpga::ServiceWordSpan xz = arg.wide_xz;
     if (has_xz && WideHasXz(xz) &&
         (spec == 'd' || spec == 'u' || spec == 't')) {
       return "x";
@@ -3430,9 +3525,9 @@ std::string FormatNumeric(const gpga::ServiceArgView& arg, char spec,
       return FormatWideBits(val, xz, arg.width, 16, has_xz);
     }
     if (spec == 'u' || spec == 't') {
-      return FormatWideUnsigned(val, arg.width);
+      return FormatWideUnsigned({val.begin(), val.end()}, arg.width);
     }
-    return FormatWideSigned(val, arg.width);
+    return FormatWideSigned({val.begin(), val.end()}, arg.width);
   }
   if (has_xz && arg.xz != 0u &&
       (spec == 'd' || spec == 'u' || spec == 't')) {
@@ -3480,6 +3575,10 @@ struct PackedSignalOffsets {
   size_t array_size = 1u;
   bool has_val = false;
   bool has_xz = false;
+  // --pack-bits: bit within the 64-bit word at [gid] of the group segment at
+  // val_offset/xz_offset; -1 for regular segments.
+  int val_bit = -1;
+  int xz_bit = -1;
 };
 
 struct PackedStateLayout {
@@ -3498,11 +3597,13 @@ size_t Align8(size_t value) {
   return (value + 7u) & ~static_cast<size_t>(7u);
 }
 
-PackedStateLayout BuildPackedStateLayout(const gpga::Module& module,
-                                         const gpga::ModuleInfo& info,
-                                         bool four_state,
-                                         uint32_t count) {
-  PackedStateLayout layout;
+// The segment order of the packed state, which only depends on the design
+// and the emitted constants; cached in the design image.
+gpga::PackedStatePlan BuildPackedStatePlan(const gpga::Module& module,
+                                           const gpga::ModuleInfo& info,
+                                           bool four_state, bool pack_bits,
+                                           bool locality_layout) {
+  gpga::PackedStatePlan plan;
   std::unordered_set<std::string> scheduled_reads;
   for (const auto& block : module.always_blocks) {
     if (block.edge == gpga::EdgeKind::kCombinational) {
@@ -3552,41 +3653,60 @@ PackedStateLayout BuildPackedStateLayout(const gpga::Module& module,
       array_nets.push_back(&net);
     }
   }
-  size_t offset = 0;
+  // Bit groups come first, in the order codegen emits them.
+  gpga::PackedBitLayout& bit_layout = plan.bits;
+  if (pack_bits) {
+    std::vector<std::string> bit_candidates;
+    bit_candidates.reserve(module.ports.size() + reg_names.size());
+    for (const auto& port : module.ports) {
+      bit_candidates.push_back(port.name);
+    }
+    bit_candidates.insert(bit_candidates.end(), reg_names.begin(),
+                          reg_names.end());
+    bit_layout = gpga::BuildPackedBitLayout(module, bit_candidates, four_state);
+  }
+  for (auto it = bit_layout.slots.begin(); it != bit_layout.slots.end();) {
+    it = FindSignalInfo(info, it->first) ? std::next(it)
+                                         : bit_layout.slots.erase(it);
+  }
   auto add_segment = [&](const std::string& base_name, bool is_xz) {
-    const gpga::SignalInfo* sig = FindSignalInfo(info, base_name);
-    if (!sig) {
+    if (bit_layout.Find(base_name)) {
       return;
     }
-    size_t array_size = sig->array_size > 0 ? sig->array_size : 1u;
-    size_t elem_size = SignalElementSize(*sig);
-    offset = Align8(offset);
-    PackedSignalOffsets& entry = layout.offsets[base_name];
-    entry.elem_size = elem_size;
-    entry.array_size = array_size;
-    if (is_xz) {
-      entry.has_xz = true;
-      entry.xz_offset = offset;
-    } else {
-      entry.has_val = true;
-      entry.val_offset = offset;
+    const gpga::SignalInfo* sig = FindSignalInfo(info, base_name);
+    if (!sig || (is_xz && sig->two_state)) {
+      return;
     }
-    offset += static_cast<size_t>(count) * array_size * elem_size;
+    gpga::PackedStateSegment segment;
+    segment.name = base_name;
+    segment.is_xz = is_xz;
+    segment.elem_size = static_cast<uint32_t>(SignalElementSize(*sig));
+    segment.array_size = sig->array_size > 0 ? sig->array_size : 1u;
+    plan.segments.push_back(std::move(segment));
   };
   auto add_decay = [&]() {
-    offset = Align8(offset);
-    offset += static_cast<size_t>(count) * sizeof(uint64_t);
+    gpga::PackedStateSegment segment;
+    segment.elem_size = sizeof(uint64_t);
+    plan.segments.push_back(std::move(segment));
   };
+  // Port and reg segments in the order codegen emits them.
+  std::vector<std::string> state_names;
+  state_names.reserve(module.ports.size() + reg_names.size());
   for (const auto& port : module.ports) {
-    add_segment(port.name, false);
+    state_names.push_back(port.name);
+  }
+  state_names.insert(state_names.end(), reg_names.begin(), reg_names.end());
+  std::vector<std::string> cold_state_names;
+  if (locality_layout) {
+    gpga::StateLocalityOrder locality =
+        gpga::OrderStateByLocality(module, state_names);
+    state_names = std::move(locality.hot);
+    cold_state_names = std::move(locality.cold);
+  }
+  for (const auto& name : state_names) {
+    add_segment(name, false);
     if (four_state) {
-      add_segment(port.name, true);
-    }
-  }
-  for (const auto& reg : reg_names) {
-    add_segment(reg, false);
-    if (four_state) {
-      add_segment(reg, true);
+      add_segment(name, true);
     }
   }
   for (const auto* reg : trireg_nets) {
@@ -3602,9 +3722,83 @@ PackedStateLayout BuildPackedStateLayout(const gpga::Module& module,
       add_segment(net->name, true);
     }
   }
+  for (const auto& name : cold_state_names) {
+    add_segment(name, false);
+    if (four_state) {
+      add_segment(name, true);
+    }
+  }
+  return plan;
+}
+
+PackedStateLayout LayoutPackedState(const gpga::PackedStatePlan& plan,
+                                    bool four_state, uint32_t count) {
+  PackedStateLayout layout;
+  for (const auto& entry : plan.bits.slots) {
+    size_t group_offset = static_cast<size_t>(entry.second.group) *
+                          static_cast<size_t>(count) * sizeof(uint64_t);
+    PackedSignalOffsets& packed = layout.offsets[entry.first];
+    packed.elem_size = sizeof(uint64_t);
+    packed.array_size = 1u;
+    packed.has_val = true;
+    packed.val_offset = group_offset;
+    packed.val_bit = static_cast<int>(entry.second.val_bit);
+    if (four_state) {
+      packed.has_xz = true;
+      packed.xz_offset = group_offset;
+      packed.xz_bit = entry.second.xz_bit;
+    }
+  }
+  size_t offset = static_cast<size_t>(plan.bits.group_count) *
+                  static_cast<size_t>(count) * sizeof(uint64_t);
+  for (const auto& segment : plan.segments) {
+    offset = Align8(offset);
+    if (!segment.name.empty()) {
+      PackedSignalOffsets& entry = layout.offsets[segment.name];
+      entry.elem_size = segment.elem_size;
+      entry.array_size = segment.array_size;
+      if (segment.is_xz) {
+        entry.has_xz = true;
+        entry.xz_offset = offset;
+      } else {
+        entry.has_val = true;
+        entry.val_offset = offset;
+      }
+    }
+    offset += static_cast<size_t>(count) * segment.array_size *
+              segment.elem_size;
+  }
   return layout;
 }
 
+// 64-byte lines between the first and last byte of instance 0 that `process`
+// touches in the packed state buffer; 0 when it touches none.
+size_t ProcessStateSpanLines(const gpga::StateProcessAccess& process,
+                             const PackedStateLayout& layout) {
+  size_t lo = std::numeric_limits<size_t>::max();
+  size_t hi = 0;
+  auto touch = [&](size_t offset, size_t bytes) {
+    lo = std::min(lo, offset);
+    hi = std::max(hi, offset + bytes);
+  };
+  for (const auto& name : process.signals) {
+    const PackedSignalOffsets* packed = layout.Find(name);
+    if (!packed) {
+      continue;
+    }
+    if (packed->has_val) {
+      touch(packed->val_offset, packed->elem_size);
+    }
+    if (packed->has_xz) {
+      touch(packed->xz_offset, packed->elem_size);
+    }
+  }
+  if (hi == 0) {
+    return 0;
+  }
+  return (hi - 1u) / 64u - lo / 64u + 1u;
+}
+
 std::string FormatReal(const gpga::ServiceArgView& arg, char spec,
                        int precision, bool has_xz) {
   if (has_xz && arg.xz != 0u) {
@@ -3646,48 +3840,111 @@ std::string FormatArg(const gpga::ServiceArgView& arg, char spec, int precision,
   return FormatNumeric(arg, spec, has_xz);
 }
 
-std::string FormatWithSpec(const std::string& fmt,
-                           const std::vector<gpga::ServiceArgView>& args,
-                           size_t start_index,
-                           const gpga::ServiceStringTable& strings,
-                           bool has_xz,
-                           const gpga::ModuleInfo* module,
-                           const std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
-                           uint32_t gid) {
-  std::ostringstream oss;
-  size_t arg_index = start_index;
+// Conversion of one format specifier, resolved when the format is compiled.
+enum class FormatConv : uint8_t {
+  kBin,
+  kOct,
+  kHex,
+  kDec,       // %d: signed, "x" when any bit is X/Z
+  kUnsigned,  // %u
+  kTime,      // %t, scaled by $timeformat when active
+  kReal,      // %f %e %g
+  kString,    // %s
+  kOther,     // any other letter prints the signed value
+};
+
+struct FormatOp {
+  bool literal = false;
+  // Literal ops: span of FormatProgram::literals.
+  uint32_t literal_begin = 0;
+  uint32_t literal_size = 0;
+  // Argument ops.
+  FormatConv conv = FormatConv::kDec;
+  char spec = 'd';
+  bool zero_pad = false;
+  int width = 0;
+  int precision = -1;
+};
+
+// A $display-style format string parsed once: literal text spans and
+// argument conversions with their width, padding and precision.
+struct FormatProgram {
+  std::string literals;
+  std::vector<FormatOp> ops;
+};
+
+FormatConv FormatConvForSpec(char spec) {
+  switch (spec) {
+    case 'b':
+      return FormatConv::kBin;
+    case 'o':
+      return FormatConv::kOct;
+    case 'h':
+    case 'x':
+      return FormatConv::kHex;
+    case 'd':
+      return FormatConv::kDec;
+    case 'u':
+      return FormatConv::kUnsigned;
+    case 't':
+      return FormatConv::kTime;
+    case 'f':
+    case 'e':
+    case 'g':
+      return FormatConv::kReal;
+    case 's':
+      return FormatConv::kString;
+    default:
+      return FormatConv::kOther;
+  }
+}
+
+FormatProgram CompileFormat(const std::string& fmt) {
+  FormatProgram program;
+  size_t literal_begin = 0;
+  auto close_literal = [&]() {
+    size_t size = program.literals.size() - literal_begin;
+    if (size == 0u) {
+      return;
+    }
+    FormatOp op;
+    op.literal = true;
+    op.literal_begin = static_cast<uint32_t>(literal_begin);
+    op.literal_size = static_cast<uint32_t>(size);
+    program.ops.push_back(op);
+    literal_begin = program.literals.size();
+  };
   for (size_t i = 0; i < fmt.size(); ++i) {
     char c = fmt[i];
     if (c != '%') {
-      oss << c;
+      program.literals.push_back(c);
       continue;
     }
     if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
-      oss << '%';
+      program.literals.push_back('%');
       ++i;
       continue;
     }
-    bool zero_pad = false;
-    int width = 0;
-    int precision = -1;
+    FormatOp op;
     size_t j = i + 1;
     if (j < fmt.size() && fmt[j] == '0') {
-      zero_pad = true;
+      op.zero_pad = true;
       ++j;
     }
     while (j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9') {
-      width = (width * 10) + (fmt[j] - '0');
+      op.width = (op.width * 10) + (fmt[j] - '0');
       ++j;
     }
     if (j < fmt.size() && fmt[j] == '.') {
       ++j;
-      precision = 0;
+      op.precision = 0;
       while (j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9') {
-        precision = (precision * 10) + (fmt[j] - '0');
+        op.precision = (op.precision * 10) + (fmt[j] - '0');
         ++j;
       }
     }
     if (j >= fmt.size()) {
+      // A dangling specifier ends the output.
       break;
     }
     char spec = fmt[j];
@@ -3695,13 +3952,106 @@ std::string FormatWithSpec(const std::string& fmt,
       spec = static_cast<char>(spec - 'A' + 'a');
     }
     i = j;
+    close_literal();
+    op.spec = spec;
+    op.conv = FormatConvForSpec(spec);
+    program.ops.push_back(op);
+  }
+  close_literal();
+  return program;
+}
+
+// ApplyPadding, appending to `out`.
+void AppendPadded(std::string* out, const char* text, size_t size, int width,
+                  bool zero_pad) {
+  if (width <= 0 || size >= static_cast<size_t>(width)) {
+    out->append(text, size);
+    return;
+  }
+  size_t pad_len = static_cast<size_t>(width) - size;
+  if (zero_pad && size > 0u && text[0] == '-') {
+    out->push_back('-');
+    out->append(pad_len, '0');
+    out->append(text + 1, size - 1u);
+    return;
+  }
+  out->append(pad_len, zero_pad ? '0' : ' ');
+  out->append(text, size);
+}
+
+void AppendPadded(std::string* out, const std::string& text, int width,
+                  bool zero_pad) {
+  AppendPadded(out, text.data(), text.size(), width, zero_pad);
+}
+
+// FormatNumeric for values that fit a word, written to `out` (at least 64
+// chars) without building strings. Returns false for the cases it does not
+// cover (wide values, $timeformat-scaled %t, non-numeric conversions).
+bool WriteNarrowNumeric(const gpga::ServiceArgView& arg, FormatConv conv,
+                        bool has_xz, char* out, size_t* size) {
+  if (arg.kind == gpga::ServiceArgKind::kWide && !arg.wide_value.empty()) {
+    return false;
+  }
+  switch (conv) {
+    case FormatConv::kBin:
+      *size = WriteBitDigits(arg.value, arg.xz, arg.width, 2, has_xz, out);
+      return true;
+    case FormatConv::kOct:
+      *size = WriteBitDigits(arg.value, arg.xz, arg.width, 8, has_xz, out);
+      return true;
+    case FormatConv::kHex:
+      *size = WriteBitDigits(arg.value, arg.xz, arg.width, 16, has_xz, out);
+      return true;
+    case FormatConv::kDec:
+    case FormatConv::kUnsigned:
+    case FormatConv::kTime:
+      if (has_xz && arg.xz != 0u) {
+        out[0] = 'x';
+        *size = 1u;
+        return true;
+      }
+      break;
+    case FormatConv::kOther:
+      break;
+    default:
+      return false;
+  }
+  std::to_chars_result res;
+  if (conv == FormatConv::kTime) {
+    if (g_time_format.active) {
+      return false;
+    }
+    res = std::to_chars(out, out + 64, arg.value);
+  } else if (conv == FormatConv::kUnsigned) {
+    res = std::to_chars(out, out + 64, arg.value & MaskForWidth(arg.width));
+  } else {
+    res = std::to_chars(out, out + 64, SignExtend(arg.value, arg.width));
+  }
+  *size = static_cast<size_t>(res.ptr - out);
+  return true;
+}
+
+// Runs `program` over args[start_index..), appending the text to `out`.
+void AppendFormatted(const FormatProgram& program,
+                     const gpga::ServiceArgList& args, size_t start_index,
+                     const gpga::ServiceStringTable& strings, bool has_xz,
+                     const gpga::ModuleInfo* module,
+                     const std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
+                     uint32_t gid, std::string* out) {
+  size_t arg_index = start_index;
+  char digits[64];
+  for (const FormatOp& op : program.ops) {
+    if (op.literal) {
+      out->append(program.literals, op.literal_begin, op.literal_size);
+      continue;
+    }
     if (arg_index >= args.size()) {
-      oss << ApplyPadding("<missing>", width, false);
+      AppendPadded(out, "<missing>", 9u, op.width, false);
       continue;
     }
-    std::string text;
-    if (spec == 's') {
-      const auto& arg = args[arg_index];
+    const gpga::ServiceArgView arg = args[arg_index++];
+    if (op.conv == FormatConv::kString) {
+      std::string text;
       if (arg.kind == gpga::ServiceArgKind::kIdent && module && buffers) {
         std::string name =
             ResolveString(strings, static_cast<uint32_t>(arg.value));
@@ -3723,130 +4073,102 @@ std::string FormatWithSpec(const std::string& fmt,
         max_bytes = std::min(max_bytes, sizeof(uint64_t));
         text = UnpackStringBits(arg.value, max_bytes);
       }
-    } else {
-      text = FormatArg(args[arg_index], spec, precision, strings, has_xz);
+      AppendPadded(out, text, op.width, op.zero_pad);
+      continue;
+    }
+    size_t size = 0;
+    if (arg.kind != gpga::ServiceArgKind::kString &&
+        arg.kind != gpga::ServiceArgKind::kIdent &&
+        WriteNarrowNumeric(arg, op.conv, has_xz, digits, &size)) {
+      AppendPadded(out, digits, size, op.width, op.zero_pad);
+      continue;
     }
-    ++arg_index;
-    oss << ApplyPadding(std::move(text), width, zero_pad);
+    AppendPadded(out, FormatArg(arg, op.spec, op.precision, strings, has_xz),
+                 op.width, op.zero_pad);
   }
-  return oss.str();
 }
 
-std::string FormatDefaultArgs(const std::vector<gpga::ServiceArgView>& args,
-                              const gpga::ServiceStringTable& strings,
-                              bool has_xz) {
-  std::ostringstream oss;
+// Space-separated default formatting of a $display without a format string.
+void AppendDefaultArgs(const gpga::ServiceArgList& args,
+                       const gpga::ServiceStringTable& strings, bool has_xz,
+                       std::string* out) {
+  char digits[64];
   for (size_t i = 0; i < args.size(); ++i) {
     if (i > 0) {
-      oss << " ";
+      out->push_back(' ');
     }
-    const auto& arg = args[i];
+    const gpga::ServiceArgView arg = args[i];
+    size_t size = 0;
     if (arg.kind == gpga::ServiceArgKind::kString ||
         arg.kind == gpga::ServiceArgKind::kIdent) {
-      oss << ResolveString(strings, static_cast<uint32_t>(arg.value));
+      out->append(ResolveString(strings, static_cast<uint32_t>(arg.value)));
     } else if (arg.kind == gpga::ServiceArgKind::kReal) {
-      oss << FormatReal(arg, 'g', -1, has_xz);
+      out->append(FormatReal(arg, 'g', -1, has_xz));
+    } else if (WriteNarrowNumeric(arg, FormatConv::kDec, has_xz, digits,
+                                  &size)) {
+      out->append(digits, size);
     } else {
-      oss << FormatNumeric(arg, 'd', has_xz);
+      out->append(FormatNumeric(arg, 'd', has_xz));
     }
   }
-  return oss.str();
 }
 
-struct DecodedServiceRecord {
-  gpga::ServiceKind kind = gpga::ServiceKind::kDisplay;
-  uint32_t pid = 0;
-  uint32_t format_id = 0xFFFFFFFFu;
-  std::vector<gpga::ServiceArgView> args;
-};
+// Stdout text of drained records is collected here and written in bulk.
+constexpr size_t kServiceStdoutFlushBytes = 64u * 1024u;
 
-void DecodeServiceRecords(const void* records, uint32_t record_count,
-                          uint32_t max_args, uint32_t wide_words, bool has_xz,
-                          std::vector<DecodedServiceRecord>* out) {
-  if (!out) {
-    return;
-  }
-  out->clear();
-  if (!records || record_count == 0 || max_args == 0) {
-    return;
-  }
-  const auto* base = static_cast<const uint8_t*>(records);
-  const size_t stride =
-      gpga::ServiceRecordStride(max_args, wide_words, has_xz);
-  out->reserve(record_count);
-  for (uint32_t i = 0; i < record_count; ++i) {
-    const uint8_t* rec = base + (stride * i);
-    DecodedServiceRecord record;
-    uint32_t kind_raw = ReadU32(rec, 0);
-    record.kind = static_cast<gpga::ServiceKind>(kind_raw);
-    record.pid = ReadU32(rec, sizeof(uint32_t));
-    record.format_id = ReadU32(rec, sizeof(uint32_t) * 2u);
-    uint32_t arg_count = ReadU32(rec, sizeof(uint32_t) * 3u);
-    if (arg_count > max_args) {
-      arg_count = max_args;
-    }
-
-    size_t offset = sizeof(uint32_t) * 4u;
-    const size_t arg_kind_offset = offset;
-    const size_t arg_width_offset =
-        arg_kind_offset + sizeof(uint32_t) * max_args;
-    const size_t arg_val_offset =
-        arg_width_offset + sizeof(uint32_t) * max_args;
-    const size_t arg_xz_offset = arg_val_offset + sizeof(uint64_t) * max_args;
-    const size_t arg_wide_val_offset =
-        arg_xz_offset + (has_xz ? sizeof(uint64_t) * max_args : 0u);
-    const size_t arg_wide_xz_offset =
-        arg_wide_val_offset +
-        sizeof(uint64_t) * max_args * static_cast<size_t>(wide_words);
-
-    record.args.reserve(arg_count);
-    for (uint32_t a = 0; a < arg_count; ++a) {
-      gpga::ServiceArgView arg;
-      arg.kind = static_cast<gpga::ServiceArgKind>(
-          ReadU32(rec, arg_kind_offset + sizeof(uint32_t) * a));
-      arg.width = ReadU32(rec, arg_width_offset + sizeof(uint32_t) * a);
-      arg.value = ReadU64(rec, arg_val_offset + sizeof(uint64_t) * a);
-      if (has_xz) {
-        arg.xz = ReadU64(rec, arg_xz_offset + sizeof(uint64_t) * a);
-      }
-      if (arg.kind == gpga::ServiceArgKind::kWide && wide_words > 0u) {
-        uint32_t word_count = (arg.width + 63u) / 64u;
-        size_t base =
-            arg_wide_val_offset +
-            sizeof(uint64_t) * (static_cast<size_t>(a) * wide_words);
-        arg.wide_value.resize(word_count, 0ull);
-        for (uint32_t w = 0; w < word_count; ++w) {
-          arg.wide_value[w] =
-              ReadU64(rec, base + sizeof(uint64_t) * w);
-        }
-        if (has_xz) {
-          size_t xz_base =
-              arg_wide_xz_offset +
-              sizeof(uint64_t) * (static_cast<size_t>(a) * wide_words);
-          arg.wide_xz.resize(word_count, 0ull);
-          for (uint32_t w = 0; w < word_count; ++w) {
-            arg.wide_xz[w] =
-                ReadU64(rec, xz_base + sizeof(uint64_t) * w);
-          }
-        }
+// Format programs for every service string (indexed by string id, so by
+// format_id), plus reused output buffers for draining records.
+struct ServiceFormatter {
+  std::vector<FormatProgram> programs;
+  std::string line;
+  std::string stdout_text;
+
+  // Appends the text of a $display-style record to `out`: its format_id
+  // program over args, or the default formatting without a format.
+  void Append(uint32_t format_id, const gpga::ServiceArgList& args,
+              const gpga::ServiceStringTable& strings,
+              bool has_xz, const gpga::ModuleInfo* module,
+              const std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
+              uint32_t gid, std::string* out) const {
+    if (format_id == 0xFFFFFFFFu ||
+        (format_id < strings.entries.size() &&
+         strings.entries[format_id].empty())) {
+      AppendDefaultArgs(args, strings, has_xz, out);
+      return;
+    }
+    if (format_id >= programs.size()) {
+      out->append(ResolveString(strings, format_id));
+      return;
+    }
+    size_t start_index = 0;
+    if (!args.empty()) {
+      const gpga::ServiceArgView first = args.front();
+      if (first.kind == gpga::ServiceArgKind::kString &&
+          first.value == static_cast<uint64_t>(format_id)) {
+        start_index = 1;
       }
-      record.args.push_back(arg);
     }
-    out->push_back(std::move(record));
+    AppendFormatted(programs[format_id], args, start_index,
+                    strings, has_xz, module, buffers, gid, out);
   }
-}
 
-std::string VcdIdForIndex(size_t index) {
-  const int base = 94;
-  const int first = 33;
-  std::string id;
-  size_t value = index;
-  do {
-    int digit = static_cast<int>(value % base);
-    id.push_back(static_cast<char>(first + digit));
-    value /= base;
-  } while (value > 0);
-  return id;
+  void FlushStdout() {
+    if (stdout_text.empty()) {
+      return;
+    }
+    std::fwrite(stdout_text.data(), 1, stdout_text.size(), stdout);
+    stdout_text.clear();
+  }
+};
+
+ServiceFormatter BuildServiceFormatter(
+    const gpga::ServiceStringTable& strings) {
+  ServiceFormatter formatter;
+  formatter.programs.reserve(strings.entries.size());
+  for (const auto& entry : strings.entries) {
+    formatter.programs.push_back(CompileFormat(entry));
+  }
+  return formatter;
 }
 
 struct VcdSignal {
@@ -3864,14 +4186,44 @@ struct VcdSignal {
   std::vector<uint64_t> last_val_words;
   std::vector<uint64_t> last_xz_words;
   bool has_value = false;
+  // Resolved once by VcdWriter::BindSignals: byte offsets of this element in
+  // the writer's shadow copy; unbound signals have no readable storage.
+  bool bound = false;
+  bool has_xz = false;
+  uint32_t word_size = 4;
+  size_t val_shadow = 0;
+  size_t xz_shadow = 0;
+  int val_bit = -1;
+  int xz_bit = -1;
 };
 
+// Change detection granularity of the VCD shadow copy: blocks are compared
+// first, then the chunks of a differing block.
+constexpr size_t kVcdChunkBytes = 64u;
+constexpr size_t kVcdBlockBytes = 1024u;
+// Staging ring between the dispatch loop and the waveform writer thread:
+// as many watched-state copies as fit in kVcdStagingBytes, clamped to
+// [kVcdMinStagingBuffers, kVcdMaxStagingBuffers]. The writer is woken once
+// half the ring is queued (or the ring is full), so small per-step
+// snapshots cost a memcpy rather than a thread handoff each.
+constexpr size_t kVcdStagingBytes = 8u << 20;
+constexpr size_t kVcdMinStagingBuffers = 4u;
+constexpr size_t kVcdMaxStagingBuffers = 4096u;
+
+// Signal storage is resolved once in Start (the buffers must outlive the
+// writer). Each snapshot copies the dumped bytes into a staging buffer and
+// hands it to a writer thread, which diffs it against a shadow copy and only
+// formats signals in changed chunks, so the dispatch loop does not wait on
+// formatting or I/O. Changes go to VCD text or, with
+// gpga::WaveFormat::kGpgawf, to a compressed gpga::WaveWriter file.
 class VcdWriter {
  public:
   void SetPackedLayout(const PackedStateLayout* layout) {
     packed_layout_ = layout;
   }
 
+  void SetFormat(gpga::WaveFormat format) { format_ = format; }
+
   bool Start(const std::string& filename, const std::string& output_dir,
              const gpga::ModuleInfo& module,
              const std::vector<std::string>& filter, uint32_t depth,
@@ -3885,6 +4237,15 @@ class VcdWriter {
       return true;
     }
     std::string path = filename.empty() ? "dump.vcd" : filename;
+    if (format_ == gpga::WaveFormat::kGpgawf) {
+      std::filesystem::path wave_path(path);
+      if (wave_path.extension() == ".vcd") {
+        wave_path.replace_extension(gpga::kWaveFileExtension);
+        path = wave_path.string();
+      } else {
+        path += gpga::kWaveFileExtension;
+      }
+    }
     if (!output_dir.empty()) {
       std::filesystem::path base(output_dir);
       std::filesystem::path out_path(path);
@@ -3902,13 +4263,6 @@ class VcdWriter {
       }
       path = out_path.string();
     }
-    out_.open(path, std::ios::out | std::ios::trunc);
-    if (!out_) {
-      if (error) {
-        *error = "failed to open VCD file: " + path;
-      }
-      return false;
-    }
     four_state_ = four_state;
     timescale_ = timescale.empty() ? "1ns" : timescale;
     dumping_ = true;
@@ -3920,58 +4274,101 @@ class VcdWriter {
       }
     }
     BuildSignals(module, filter, dump_all, depth, instance_count, flat_to_hier);
-    WriteHeader(module.name);
-    EmitInitialValues(buffers);
+    BindSignals(buffers);
+    if (format_ == gpga::WaveFormat::kGpgawf) {
+      if (!wave_.Open(path, timescale_, module.name, wave_signals_, error)) {
+        return false;
+      }
+    } else {
+      out_.open(path, std::ios::out | std::ios::trunc);
+      if (!out_) {
+        if (error) {
+          *error = "failed to open VCD file: " + path;
+        }
+        return false;
+      }
+      gpga::WriteVcdHeader(out_, timescale_, module.name, wave_signals_);
+    }
+    CheckDumpLimit();
+    // With a single core the writer thread would only add context switches,
+    // so jobs run inline unless METALFPGA_VCD_ASYNC says otherwise.
+    async_ = EnvTriState("METALFPGA_VCD_ASYNC")
+                 .value_or(std::thread::hardware_concurrency() > 1u);
+    const size_t slots =
+        async_ ? std::clamp(
+                     kVcdStagingBytes / std::max<size_t>(1u, shadow_.size()),
+                     kVcdMinStagingBuffers, kVcdMaxStagingBuffers)
+               : 1u;
+    staging_.assign(slots, std::vector<uint8_t>(shadow_.size()));
+    wake_batch_ = std::max<size_t>(1u, slots / 2u);
+    free_slots_.clear();
+    for (size_t i = 0; i < staging_.size(); ++i) {
+      free_slots_.push_back(staging_.size() - 1u - i);
+    }
+    stop_ = false;
+    if (async_) {
+      writer_ = std::thread([this]() { WriterLoop(); });
+    }
     active_ = true;
+    Submit(WriterJobKind::kInitial, 0u, true);
     return true;
   }
 
-  void Update(uint64_t time,
-              const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
-    if (!dumping_) {
+  ~VcdWriter() { Close(); }
+
+  void Update(uint64_t time) {
+    if (!active_ || !dumping_ || limit_reached_.load()) {
       return;
     }
-    EmitSnapshot(time, buffers, false);
+    Submit(WriterJobKind::kUpdate, time, true);
   }
 
-  void FinalSnapshot(
-      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
-    if (!active_) {
-      return;
-    }
-    if (!dumping_) {
+  void FinalSnapshot() {
+    if (!active_ || !dumping_ || limit_reached_.load()) {
       return;
     }
-    uint64_t time = has_time_ ? last_time_ : 0;
-    if (!last_time_had_values_) {
-      EmitSnapshot(time, buffers, true);
-    }
+    Submit(WriterJobKind::kFinal, 0u, true);
   }
 
-  void ForceSnapshot(
-      uint64_t time,
-      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
-    if (!active_ || !dumping_) {
+  void ForceSnapshot(uint64_t time) {
+    if (!active_ || !dumping_ || limit_reached_.load()) {
       return;
     }
-    EmitSnapshot(time, buffers, true);
+    Submit(WriterJobKind::kForce, time, true);
   }
 
   void SetDumping(bool enabled) { dumping_ = enabled; }
 
   void SetDumpLimit(uint64_t limit) {
-    dump_limit_ = limit;
-    CheckDumpLimit();
+    if (active_) {
+      Submit(WriterJobKind::kDumpLimit, limit, false);
+    } else {
+      dump_limit_ = limit;
+    }
   }
 
   void Flush() {
-    if (out_) {
-      out_.flush();
+    if (active_) {
+      Submit(WriterJobKind::kFlush, 0u, false);
     }
   }
 
+  // Drains the writer thread, then closes the file.
   void Close() {
-    if (out_) {
+    if (writer_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      job_ready_.notify_one();
+      writer_.join();
+    }
+    if (wave_.is_open()) {
+      std::string error;
+      if (!wave_.Close(&error)) {
+        std::cerr << "warning: " << error << "\n";
+      }
+    } else if (out_.is_open()) {
       out_.flush();
       out_.close();
     }
@@ -3980,35 +4377,298 @@ class VcdWriter {
 
   bool active() const { return active_; }
 
+  // Writer-side counters are only stable after Close.
+  size_t signal_count() const { return signals_.size(); }
+  size_t watched_bytes() const { return shadow_.size(); }
+  uint64_t snapshot_count() const { return snapshot_count_; }
+  double snapshot_ms() const { return snapshot_ms_; }
+  double stage_ms() const { return stage_ms_; }
+  uint64_t stall_count() const { return stall_count_; }
+  double stall_ms() const { return stall_ms_; }
+
  private:
-  void BuildSignals(const gpga::ModuleInfo& module,
-                    const std::vector<std::string>& filter, bool dump_all,
-                    uint32_t depth_limit, uint32_t instance_count,
-                    const std::unordered_map<std::string, std::string>* flat_to_hier) {
-    std::unordered_set<std::string> wanted(filter.begin(), filter.end());
-    signals_.clear();
-    size_t index = 0;
-    for (const auto& sig : module.signals) {
-      std::string display_base = sig.name;
-      if (flat_to_hier) {
-        auto it = flat_to_hier->find(sig.name);
-        if (it != flat_to_hier->end() && !it->second.empty()) {
-          display_base = it->second;
+  struct WatchRange {
+    const gpga::MetalBuffer* buffer = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    size_t shadow_offset = 0;
+  };
+
+  // Locates one element of `sig` in `buffer`, mirroring
+  // ReadSignalWordFromBuffer (packed == nullptr) and
+  // ReadPackedSignalWordFromBuffer.
+  bool LocateSignal(const VcdSignal& sig, const gpga::MetalBuffer* buffer,
+                    const PackedSignalOffsets* packed, bool is_xz,
+                    size_t* offset, size_t* bytes) const {
+    if (!buffer || !buffer->contents()) {
+      return false;
+    }
+    const size_t element_size =
+        static_cast<size_t>(sig.word_size) * sig.word_count;
+    const size_t element_index =
+        static_cast<size_t>(sig.instance_index) * sig.array_size +
+        sig.array_index;
+    if (packed) {
+      const int bit = is_xz ? packed->xz_bit : packed->val_bit;
+      const size_t base = is_xz ? packed->xz_offset : packed->val_offset;
+      if (bit >= 0) {
+        if (sig.array_index != 0u) {
+          return false;
         }
+        *offset = base + static_cast<size_t>(sig.instance_index) *
+                             sizeof(uint64_t);
+        *bytes = sizeof(uint64_t);
+      } else {
+        *offset = base + element_index * element_size;
+        *bytes = element_size;
       }
-      std::string display_rel = StripModulePrefix(display_base, module.name);
-      if (display_rel.empty()) {
-        display_rel = display_base;
+    } else {
+      if (element_size == 0 ||
+          element_index >= buffer->length() / element_size) {
+        return false;
       }
-      uint32_t array_size = sig.array_size > 0 ? sig.array_size : 1u;
-      uint32_t inst_count = std::max<uint32_t>(1u, instance_count);
-      for (uint32_t inst = 0; inst < inst_count; ++inst) {
-        std::string display_name = display_rel;
-        if (inst_count > 1u) {
-          display_name =
-              "inst" + std::to_string(inst) + "." + display_rel;
-        }
-        for (uint32_t i = 0; i < array_size; ++i) {
+      *offset = element_index * element_size;
+      *bytes = element_size;
+    }
+    return buffer->length() >= *offset + *bytes;
+  }
+
+  // Resolves every signal to its storage once, then sets up the shadow copy:
+  // the 64-byte-aligned spans of each buffer that hold dumped elements,
+  // merged into ranges, plus a chunk -> signals index for change detection.
+  void BindSignals(
+      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
+    struct Span {
+      const gpga::MetalBuffer* buffer = nullptr;
+      size_t offset = 0;
+      size_t bytes = 0;
+      uint32_t signal = 0;
+      bool is_xz = false;
+    };
+    std::vector<Span> spans;
+    spans.reserve(signals_.size() * (four_state_ ? 2u : 1u));
+    const gpga::MetalBuffer* packed_buf =
+        packed_layout_ ? FindBuffer(buffers, "gpga_state", "") : nullptr;
+    for (size_t i = 0; i < signals_.size(); ++i) {
+      VcdSignal& sig = signals_[i];
+      sig.word_size = sig.width > 32u ? 8u : 4u;
+      const gpga::MetalBuffer* val_buf =
+          FindBuffer(buffers, MslSignalName(sig.base_name), "_val");
+      const gpga::MetalBuffer* xz_buf = nullptr;
+      const PackedSignalOffsets* packed = nullptr;
+      if (four_state_) {
+        xz_buf = FindBuffer(buffers, MslSignalName(sig.base_name), "_xz");
+      }
+      if (!val_buf && packed_layout_ && packed_buf) {
+        packed = packed_layout_->Find(sig.base_name);
+        if (packed && !packed->has_val) {
+          packed = nullptr;
+        }
+      }
+      Span val_span;
+      val_span.signal = static_cast<uint32_t>(i);
+      val_span.buffer = packed ? packed_buf : val_buf;
+      if (!LocateSignal(sig, val_span.buffer, packed, false, &val_span.offset,
+                        &val_span.bytes)) {
+        continue;
+      }
+      Span xz_span;
+      xz_span.signal = static_cast<uint32_t>(i);
+      xz_span.is_xz = true;
+      bool has_xz = false;
+      if (four_state_ && packed && packed->has_xz) {
+        xz_span.buffer = packed_buf;
+        if (!LocateSignal(sig, packed_buf, packed, true, &xz_span.offset,
+                          &xz_span.bytes)) {
+          continue;
+        }
+        has_xz = true;
+      } else if (four_state_ && !packed && xz_buf) {
+        xz_span.buffer = xz_buf;
+        has_xz = LocateSignal(sig, xz_buf, nullptr, true, &xz_span.offset,
+                              &xz_span.bytes);
+      }
+      sig.bound = true;
+      sig.has_xz = has_xz;
+      sig.val_bit = packed ? packed->val_bit : -1;
+      sig.xz_bit = (packed && has_xz) ? packed->xz_bit : -1;
+      spans.push_back(val_span);
+      if (has_xz) {
+        spans.push_back(xz_span);
+      }
+    }
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+      if (a.buffer != b.buffer) {
+        return std::less<const gpga::MetalBuffer*>()(a.buffer, b.buffer);
+      }
+      return a.offset < b.offset;
+    });
+    ranges_.clear();
+    size_t shadow_bytes = 0;
+    for (const auto& span : spans) {
+      const size_t begin = span.offset & ~(kVcdChunkBytes - 1u);
+      const size_t end = std::min(
+          span.buffer->length(),
+          (span.offset + span.bytes + kVcdChunkBytes - 1u) &
+              ~(kVcdChunkBytes - 1u));
+      if (!ranges_.empty() && ranges_.back().buffer == span.buffer &&
+          begin <= ranges_.back().end) {
+        WatchRange& range = ranges_.back();
+        shadow_bytes += std::max(range.end, end) - range.end;
+        range.end = std::max(range.end, end);
+        continue;
+      }
+      shadow_bytes = (shadow_bytes + kVcdChunkBytes - 1u) &
+                     ~(kVcdChunkBytes - 1u);
+      WatchRange range;
+      range.buffer = span.buffer;
+      range.begin = begin;
+      range.end = end;
+      range.shadow_offset = shadow_bytes;
+      shadow_bytes += end - begin;
+      ranges_.push_back(range);
+    }
+    shadow_.assign(shadow_bytes, 0u);
+    const size_t chunk_count =
+        (shadow_bytes + kVcdChunkBytes - 1u) / kVcdChunkBytes;
+    std::vector<std::pair<uint32_t, uint32_t>> chunk_entries;
+    chunk_entries.reserve(spans.size());
+    size_t range_index = 0;
+    for (const auto& span : spans) {
+      while (ranges_[range_index].buffer != span.buffer ||
+             span.offset >= ranges_[range_index].end) {
+        ++range_index;
+      }
+      const WatchRange& range = ranges_[range_index];
+      const size_t shadow = range.shadow_offset + span.offset - range.begin;
+      VcdSignal& sig = signals_[span.signal];
+      if (span.is_xz) {
+        sig.xz_shadow = shadow;
+      } else {
+        sig.val_shadow = shadow;
+      }
+      const size_t last = (shadow + span.bytes - 1u) / kVcdChunkBytes;
+      for (size_t chunk = shadow / kVcdChunkBytes; chunk <= last; ++chunk) {
+        chunk_entries.emplace_back(static_cast<uint32_t>(chunk), span.signal);
+      }
+    }
+    chunk_begin_.assign(chunk_count + 1u, 0u);
+    for (const auto& entry : chunk_entries) {
+      ++chunk_begin_[entry.first + 1u];
+    }
+    for (size_t i = 0; i < chunk_count; ++i) {
+      chunk_begin_[i + 1u] += chunk_begin_[i];
+    }
+    chunk_signals_.assign(chunk_entries.size(), 0u);
+    std::vector<uint32_t> fill(chunk_begin_.begin(), chunk_begin_.end() - 1);
+    for (const auto& entry : chunk_entries) {
+      chunk_signals_[fill[entry.first]++] = entry.second;
+    }
+    signal_stamp_.assign(signals_.size(), 0u);
+    stamp_ = 0;
+  }
+
+  // Host side: copies the watched ranges into a staging buffer laid out like
+  // the shadow copy.
+  void StageState(uint8_t* staged) const {
+    for (const auto& range : ranges_) {
+      std::memcpy(staged + range.shadow_offset,
+                  static_cast<const uint8_t*>(range.buffer->contents()) +
+                      range.begin,
+                  range.end - range.begin);
+    }
+  }
+
+  void RefreshShadow(const uint8_t* staged) {
+    for (const auto& range : ranges_) {
+      std::memcpy(shadow_.data() + range.shadow_offset,
+                  staged + range.shadow_offset, range.end - range.begin);
+    }
+  }
+
+  // Compares a staged state against the shadow copy, block by block and
+  // then chunk by chunk, copies changed chunks over and queues the signals
+  // stored in them (ascending, so emission order matches a full walk).
+  void CollectChangedSignals(const uint8_t* staged) {
+    dirty_signals_.clear();
+    ++stamp_;
+    for (const auto& range : ranges_) {
+      const uint8_t* live = staged + range.shadow_offset;
+      uint8_t* shadow = shadow_.data() + range.shadow_offset;
+      const size_t bytes = range.end - range.begin;
+      for (size_t block = 0; block < bytes; block += kVcdBlockBytes) {
+        const size_t block_bytes = std::min(kVcdBlockBytes, bytes - block);
+        if (std::memcmp(live + block, shadow + block, block_bytes) == 0) {
+          continue;
+        }
+        for (size_t off = block; off < block + block_bytes;
+             off += kVcdChunkBytes) {
+          const size_t n = std::min(kVcdChunkBytes, bytes - off);
+          if (std::memcmp(live + off, shadow + off, n) == 0) {
+            continue;
+          }
+          std::memcpy(shadow + off, live + off, n);
+          const size_t chunk = (range.shadow_offset + off) / kVcdChunkBytes;
+          for (uint32_t i = chunk_begin_[chunk]; i < chunk_begin_[chunk + 1u];
+               ++i) {
+            const uint32_t signal = chunk_signals_[i];
+            if (signal_stamp_[signal] != stamp_) {
+              signal_stamp_[signal] = stamp_;
+              dirty_signals_.push_back(signal);
+            }
+          }
+        }
+      }
+    }
+    std::sort(dirty_signals_.begin(), dirty_signals_.end());
+  }
+
+  uint64_t ShadowWord(size_t offset, uint32_t word, uint32_t word_size,
+                      int bit) const {
+    const uint8_t* ptr = shadow_.data() + offset;
+    if (bit >= 0) {
+      uint64_t value = 0;
+      std::memcpy(&value, ptr, sizeof(value));
+      return (value >> bit) & 1ull;
+    }
+    ptr += static_cast<size_t>(word) * word_size;
+    if (word_size == sizeof(uint64_t)) {
+      uint64_t value = 0;
+      std::memcpy(&value, ptr, sizeof(value));
+      return value;
+    }
+    uint32_t value = 0;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+  void BuildSignals(const gpga::ModuleInfo& module,
+                    const std::vector<std::string>& filter, bool dump_all,
+                    uint32_t depth_limit, uint32_t instance_count,
+                    const std::unordered_map<std::string, std::string>* flat_to_hier) {
+    std::unordered_set<std::string> wanted(filter.begin(), filter.end());
+    signals_.clear();
+    size_t index = 0;
+    for (const auto& sig : module.signals) {
+      std::string display_base = sig.name;
+      if (flat_to_hier) {
+        auto it = flat_to_hier->find(sig.name);
+        if (it != flat_to_hier->end() && !it->second.empty()) {
+          display_base = it->second;
+        }
+      }
+      std::string display_rel = StripModulePrefix(display_base, module.name);
+      if (display_rel.empty()) {
+        display_rel = display_base;
+      }
+      uint32_t array_size = sig.array_size > 0 ? sig.array_size : 1u;
+      uint32_t inst_count = std::max<uint32_t>(1u, instance_count);
+      for (uint32_t inst = 0; inst < inst_count; ++inst) {
+        std::string display_name = display_rel;
+        if (inst_count > 1u) {
+          display_name =
+              "inst" + std::to_string(inst) + "." + display_rel;
+        }
+        for (uint32_t i = 0; i < array_size; ++i) {
           bool include = dump_all || wanted.empty();
           if (!include) {
             include =
@@ -4031,7 +4691,7 @@ class VcdWriter {
           entry.width = sig.is_real ? 64u : std::max<uint32_t>(1u, sig.width);
           entry.word_count = entry.width <= 64u ? 1u :
               static_cast<uint32_t>((entry.width + 63u) / 64u);
-          entry.id = VcdIdForIndex(index++);
+          entry.id = gpga::WaveIdForIndex(index++);
           if (array_size > 1u) {
             entry.name = display_name + "[" + std::to_string(i) + "]";
           } else {
@@ -4041,6 +4701,16 @@ class VcdWriter {
         }
       }
     }
+    wave_signals_.clear();
+    wave_signals_.reserve(signals_.size());
+    for (const auto& sig : signals_) {
+      gpga::WaveSignalInfo info;
+      info.name = sig.name;
+      info.id = sig.id;
+      info.width = sig.width;
+      info.is_real = sig.is_real;
+      wave_signals_.push_back(std::move(info));
+    }
   }
 
   bool PassesDepth(const std::string& name, uint32_t depth_limit) const {
@@ -4049,7 +4719,7 @@ class VcdWriter {
     }
     std::vector<std::string> scope;
     std::string leaf;
-    SplitHierName(name, &scope, &leaf);
+    gpga::SplitWaveHierName(name, &scope, &leaf);
     uint32_t depth = scope.empty() ? 1u
                                    : static_cast<uint32_t>(scope.size() + 1u);
     return depth <= depth_limit;
@@ -4111,151 +4781,29 @@ class VcdWriter {
     return name;
   }
 
-  void SplitHierName(const std::string& name, std::vector<std::string>* scope,
-                     std::string* leaf) const {
-    if (scope) {
-      scope->clear();
-    }
-    if (leaf) {
-      *leaf = name;
-    }
-    if (!scope || !leaf) {
-      return;
-    }
-    std::vector<std::string> parts;
-    std::string current;
-    int bracket_depth = 0;
-    for (size_t i = 0; i < name.size(); ++i) {
-      char c = name[i];
-      if (c == '[') {
-        bracket_depth++;
-        current.push_back(c);
+  void EmitInitialValues(const uint8_t* staged) {
+    EmitTime(0);
+    RefreshShadow(staged);
+    for (uint32_t index = 0; index < signals_.size(); ++index) {
+      VcdSignal& sig = signals_[index];
+      if (!sig.bound) {
         continue;
       }
-      if (c == ']') {
-        if (bracket_depth > 0) {
-          bracket_depth--;
-        }
-        current.push_back(c);
-        continue;
-      }
-      if (bracket_depth == 0 && c == '.') {
-        if (!current.empty()) {
-          parts.push_back(current);
-          current.clear();
-        }
-        continue;
-      }
-      if (bracket_depth == 0 && c == '_' && i + 1 < name.size() &&
-          name[i + 1] == '_') {
-        if (!current.empty()) {
-          parts.push_back(current);
-          current.clear();
-        }
-        i++;
-        continue;
-      }
-      current.push_back(c);
-    }
-    if (!current.empty()) {
-      parts.push_back(current);
-    }
-    if (parts.empty()) {
-      return;
-    }
-    if (parts.size() == 1) {
-      *leaf = parts[0];
-      return;
-    }
-    scope->assign(parts.begin(), parts.end() - 1);
-    *leaf = parts.back();
-  }
-
-  void WriteHeader(const std::string& module_name) {
-    out_ << "$date\n  today\n$end\n";
-    out_ << "$version\n  metalfpga\n$end\n";
-    out_ << "$timescale " << timescale_ << " $end\n";
-    out_ << "$scope module " << module_name << " $end\n";
-    struct ScopedSignal {
-      std::vector<std::string> scope;
-      std::string leaf;
-      const VcdSignal* signal = nullptr;
-    };
-    std::vector<ScopedSignal> ordered;
-    ordered.reserve(signals_.size());
-    for (const auto& sig : signals_) {
-      ScopedSignal entry;
-      entry.signal = &sig;
-      SplitHierName(sig.name, &entry.scope, &entry.leaf);
-      if (entry.leaf.empty()) {
-        entry.leaf = sig.name;
-      }
-      ordered.push_back(std::move(entry));
-    }
-    std::sort(ordered.begin(), ordered.end(),
-              [](const ScopedSignal& a, const ScopedSignal& b) {
-                if (a.scope != b.scope) {
-                  return std::lexicographical_compare(
-                      a.scope.begin(), a.scope.end(), b.scope.begin(),
-                      b.scope.end());
-                }
-                return a.leaf < b.leaf;
-              });
-    std::vector<std::string> current;
-    for (const auto& entry : ordered) {
-      size_t common = 0;
-      while (common < current.size() && common < entry.scope.size() &&
-             current[common] == entry.scope[common]) {
-        common++;
-      }
-      for (size_t i = current.size(); i > common; --i) {
-        out_ << "$upscope $end\n";
-      }
-      for (size_t i = common; i < entry.scope.size(); ++i) {
-        out_ << "$scope module " << entry.scope[i] << " $end\n";
-      }
-      current = entry.scope;
-      const auto& sig = *entry.signal;
-      if (sig.is_real) {
-        out_ << "$var real 64 " << sig.id << " " << entry.leaf << " $end\n";
-      } else {
-        out_ << "$var wire " << sig.width << " " << sig.id << " "
-             << entry.leaf << " $end\n";
-      }
-    }
-    for (size_t i = current.size(); i > 0; --i) {
-      out_ << "$upscope $end\n";
-    }
-    out_ << "$upscope $end\n";
-    out_ << "$enddefinitions $end\n";
-    CheckDumpLimit();
-  }
-
-  void EmitInitialValues(
-      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers) {
-    out_ << "#0\n";
-    for (auto& sig : signals_) {
       if (sig.word_count <= 1u) {
         uint64_t val = 0;
         uint64_t xz = 0;
-        if (!ReadSignal(sig, buffers, &val, &xz)) {
-          continue;
-        }
+        ReadSignal(sig, &val, &xz);
         sig.last_val = val;
         sig.last_xz = xz;
         sig.has_value = true;
-        EmitValue(sig, val, xz);
-        continue;
-      }
-      std::vector<uint64_t> val_words;
-      std::vector<uint64_t> xz_words;
-      if (!ReadSignalWords(sig, buffers, &val_words, &xz_words)) {
+        EmitValue(index, &val, &xz);
         continue;
       }
-      sig.last_val_words = val_words;
-      sig.last_xz_words = xz_words;
+      ReadSignalWords(sig, &val_words_, &xz_words_);
+      sig.last_val_words = val_words_;
+      sig.last_xz_words = xz_words_;
       sig.has_value = true;
-      EmitValueWords(sig, val_words, xz_words);
+      EmitValue(index, val_words_.data(), xz_words_.data());
     }
     last_time_ = 0;
     has_time_ = true;
@@ -4263,130 +4811,27 @@ class VcdWriter {
     CheckDumpLimit();
   }
 
-  bool ReadSignal(const VcdSignal& sig,
-                  const std::unordered_map<std::string, gpga::MetalBuffer>& buffers,
-                  uint64_t* val, uint64_t* xz) const {
-    if (!val || !xz) {
-      return false;
-    }
-    const gpga::MetalBuffer* val_buf =
-        FindBuffer(buffers, MslSignalName(sig.base_name), "_val");
-    const gpga::MetalBuffer* xz_buf = nullptr;
-    const gpga::MetalBuffer* packed_buf = nullptr;
-    const PackedSignalOffsets* packed = nullptr;
-    if (four_state_) {
-      xz_buf = FindBuffer(buffers, MslSignalName(sig.base_name), "_xz");
-    }
-    if (!val_buf && packed_layout_) {
-      packed = packed_layout_->Find(sig.base_name);
-      if (packed) {
-        packed_buf = FindBuffer(buffers, "gpga_state", "");
-      }
-    }
-    if (!val_buf && (!packed || !packed_buf || !packed->has_val)) {
-      return false;
-    }
-    gpga::SignalInfo info;
-    info.name = sig.base_name;
-    info.width = sig.width;
-    info.array_size = sig.array_size;
-    info.is_real = sig.is_real;
-    uint64_t val_word = 0;
-    if (packed) {
-      if (!ReadPackedSignalWordFromBuffer(
-              info, sig.instance_index, sig.array_index, *packed_buf,
-              packed->val_offset, 0u, &val_word)) {
-        return false;
-      }
-    } else {
-      if (!ReadSignalWordFromBuffer(info, sig.instance_index, sig.array_index,
-                                    *val_buf, 0u, &val_word)) {
-        return false;
-      }
-    }
-    *val = val_word;
-    if (four_state_) {
-      if (packed && packed_buf && packed->has_xz) {
-        return ReadPackedSignalWordFromBuffer(
-            info, sig.instance_index, sig.array_index, *packed_buf,
-            packed->xz_offset, 0u, xz);
-      }
-      if (xz_buf && xz_buf->contents() &&
-          ReadSignalWordFromBuffer(info, sig.instance_index, sig.array_index,
-                                   *xz_buf, 0u, xz)) {
-        return true;
-      }
-      *xz = 0;
-    } else {
-      *xz = 0;
-    }
-    return true;
+  // Reads a bound signal from the shadow copy.
+  void ReadSignal(const VcdSignal& sig, uint64_t* val, uint64_t* xz) const {
+    *val = ShadowWord(sig.val_shadow, 0u, sig.word_size, sig.val_bit);
+    *xz = sig.has_xz
+              ? ShadowWord(sig.xz_shadow, 0u, sig.word_size, sig.xz_bit)
+              : 0ull;
   }
 
-  bool ReadSignalWords(
-      const VcdSignal& sig,
-      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers,
-      std::vector<uint64_t>* val_words,
-      std::vector<uint64_t>* xz_words) const {
-    if (!val_words || !xz_words) {
-      return false;
-    }
-    const gpga::MetalBuffer* val_buf =
-        FindBuffer(buffers, MslSignalName(sig.base_name), "_val");
-    const gpga::MetalBuffer* xz_buf = nullptr;
-    const gpga::MetalBuffer* packed_buf = nullptr;
-    const PackedSignalOffsets* packed = nullptr;
-    if (four_state_) {
-      xz_buf = FindBuffer(buffers, MslSignalName(sig.base_name), "_xz");
-    }
-    if (!val_buf && packed_layout_) {
-      packed = packed_layout_->Find(sig.base_name);
-      if (packed) {
-        packed_buf = FindBuffer(buffers, "gpga_state", "");
-      }
-    }
-    if (!val_buf && (!packed || !packed_buf || !packed->has_val)) {
-      return false;
-    }
-    gpga::SignalInfo info;
-    info.name = sig.base_name;
-    info.width = sig.width;
-    info.array_size = sig.array_size;
-    info.is_real = sig.is_real;
+  void ReadSignalWords(const VcdSignal& sig,
+                       std::vector<uint64_t>* val_words,
+                       std::vector<uint64_t>* xz_words) const {
     val_words->assign(sig.word_count, 0ull);
     xz_words->assign(sig.word_count, 0ull);
     for (uint32_t word = 0; word < sig.word_count; ++word) {
-      if (packed) {
-        if (!ReadPackedSignalWordFromBuffer(
-                info, sig.instance_index, sig.array_index, *packed_buf,
-                packed->val_offset, word, &(*val_words)[word])) {
-          return false;
-        }
-      } else {
-        if (!ReadSignalWordFromBuffer(info, sig.instance_index, sig.array_index,
-                                      *val_buf, word, &(*val_words)[word])) {
-          return false;
-        }
-      }
-      if (four_state_) {
-        if (packed && packed_buf && packed->has_xz) {
-          if (!ReadPackedSignalWordFromBuffer(
-                  info, sig.instance_index, sig.array_index, *packed_buf,
-                  packed->xz_offset, word, &(*xz_words)[word])) {
-            return false;
-          }
-          continue;
-        }
-        if (xz_buf && xz_buf->contents()) {
-          if (!ReadSignalWordFromBuffer(
-                  info, sig.instance_index, sig.array_index, *xz_buf, word,
-                  &(*xz_words)[word])) {
-            return false;
-          }
-        }
+      (*val_words)[word] =
+          ShadowWord(sig.val_shadow, word, sig.word_size, sig.val_bit);
+      if (sig.has_xz) {
+        (*xz_words)[word] =
+            ShadowWord(sig.xz_shadow, word, sig.word_size, sig.xz_bit);
       }
     }
-    return true;
   }
 
   const gpga::MetalBuffer* FindBuffer(
@@ -4403,96 +4848,56 @@ class VcdWriter {
     return nullptr;
   }
 
-  void EmitValue(const VcdSignal& sig, uint64_t val, uint64_t xz) {
-    if (sig.is_real) {
-      if (xz != 0) {
-        out_ << "rnan " << sig.id << "\n";
-        return;
-      }
-      double real_val = 0.0;
-      std::memcpy(&real_val, &val, sizeof(real_val));
-      out_ << "r" << real_val << " " << sig.id << "\n";
-      return;
-    }
-    std::string bits;
-    bits.reserve(sig.width);
-    for (int i = static_cast<int>(sig.width) - 1; i >= 0; --i) {
-      uint64_t mask = 1ull << static_cast<uint32_t>(i);
-      bool bit_xz = (xz & mask) != 0ull;
-      bool bit_val = (val & mask) != 0ull;
-      if (bit_xz) {
-        bits.push_back(bit_val ? 'x' : 'z');
-      } else {
-        bits.push_back(bit_val ? '1' : '0');
-      }
-    }
-    if (sig.width == 1u) {
-      out_ << bits[0] << sig.id << "\n";
+  void EmitTime(uint64_t time) {
+    if (wave_.is_open()) {
+      wave_.Time(time);
     } else {
-      out_ << "b" << bits << " " << sig.id << "\n";
+      out_ << "#" << time << "\n";
     }
   }
 
-  void EmitValueWords(const VcdSignal& sig,
-                      const std::vector<uint64_t>& val_words,
-                      const std::vector<uint64_t>& xz_words) {
-    if (sig.is_real) {
-      EmitValue(sig, val_words.empty() ? 0ull : val_words[0],
-                xz_words.empty() ? 0ull : xz_words[0]);
-      return;
-    }
-    std::string bits;
-    bits.reserve(sig.width);
-    for (int i = static_cast<int>(sig.width) - 1; i >= 0; --i) {
-      uint32_t bit_index = static_cast<uint32_t>(i);
-      uint32_t word_index = bit_index / 64u;
-      uint32_t word_bit = bit_index % 64u;
-      uint64_t mask = 1ull << word_bit;
-      bool bit_xz = word_index < xz_words.size() &&
-                    (xz_words[word_index] & mask) != 0ull;
-      bool bit_val = word_index < val_words.size() &&
-                     (val_words[word_index] & mask) != 0ull;
-      if (bit_xz) {
-        bits.push_back(bit_val ? 'x' : 'z');
-      } else {
-        bits.push_back(bit_val ? '1' : '0');
-      }
-    }
-    if (sig.width == 1u) {
-      out_ << bits[0] << sig.id << "\n";
+  // `val_words`/`xz_words` hold the signal's word_count words.
+  void EmitValue(uint32_t index, const uint64_t* val_words,
+                 const uint64_t* xz_words) {
+    if (wave_.is_open()) {
+      wave_.Value(index, val_words, xz_words);
     } else {
-      out_ << "b" << bits << " " << sig.id << "\n";
+      gpga::WriteVcdValue(out_, wave_signals_[index], val_words, xz_words);
     }
   }
 
-  void EmitSnapshot(
-      uint64_t time,
-      const std::unordered_map<std::string, gpga::MetalBuffer>& buffers,
-      bool force_values) {
-    if (!active_) {
+  // Only signals whose shadow chunks changed are read unless
+  // `force_values`, which re-emits every bound signal.
+  void EmitSnapshot(uint64_t time, bool force_values, const uint8_t* staged) {
+    if (dump_limit_ != 0u && BytesWritten() >= dump_limit_) {
+      limit_reached_.store(true);
       return;
     }
-    if (dump_limit_ != 0u && out_) {
-      std::streampos pos = out_.tellp();
-      if (pos >= 0 &&
-          static_cast<uint64_t>(pos) >= dump_limit_) {
-        dumping_ = false;
-        return;
-      }
-    }
+    const auto start = std::chrono::steady_clock::now();
     if (!has_time_ || time != last_time_) {
-      out_ << "#" << time << "\n";
+      EmitTime(time);
       last_time_ = time;
       has_time_ = true;
       last_time_had_values_ = false;
     }
-    for (auto& sig : signals_) {
+    if (force_values) {
+      RefreshShadow(staged);
+      dirty_signals_.clear();
+      for (size_t i = 0; i < signals_.size(); ++i) {
+        dirty_signals_.push_back(static_cast<uint32_t>(i));
+      }
+    } else {
+      CollectChangedSignals(staged);
+    }
+    for (uint32_t index : dirty_signals_) {
+      VcdSignal& sig = signals_[index];
+      if (!sig.bound) {
+        continue;
+      }
       if (sig.word_count <= 1u) {
         uint64_t val = 0;
         uint64_t xz = 0;
-        if (!ReadSignal(sig, buffers, &val, &xz)) {
-          continue;
-        }
+        ReadSignal(sig, &val, &xz);
         if (!force_values && sig.has_value && sig.last_val == val &&
             sig.last_xz == xz) {
           continue;
@@ -4500,40 +4905,173 @@ class VcdWriter {
         sig.last_val = val;
         sig.last_xz = xz;
         sig.has_value = true;
-        EmitValue(sig, val, xz);
+        EmitValue(index, &val, &xz);
         last_time_had_values_ = true;
         continue;
       }
-      std::vector<uint64_t> val_words;
-      std::vector<uint64_t> xz_words;
-      if (!ReadSignalWords(sig, buffers, &val_words, &xz_words)) {
-        continue;
-      }
+      ReadSignalWords(sig, &val_words_, &xz_words_);
       if (!force_values && sig.has_value &&
-          sig.last_val_words == val_words &&
-          sig.last_xz_words == xz_words) {
+          sig.last_val_words == val_words_ &&
+          sig.last_xz_words == xz_words_) {
         continue;
       }
-      sig.last_val_words = val_words;
-      sig.last_xz_words = xz_words;
+      sig.last_val_words = val_words_;
+      sig.last_xz_words = xz_words_;
       sig.has_value = true;
-      EmitValueWords(sig, val_words, xz_words);
+      EmitValue(index, val_words_.data(), xz_words_.data());
       last_time_had_values_ = true;
     }
     CheckDumpLimit();
+    ++snapshot_count_;
+    snapshot_ms_ += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
   }
 
-  void CheckDumpLimit() {
-    if (!dumping_ || dump_limit_ == 0u || !out_) {
-      return;
+  // $dumplimit counts the bytes of whichever file is written (for gpgawf,
+  // including the records not yet compressed).
+  uint64_t BytesWritten() {
+    if (wave_.is_open()) {
+      return wave_.bytes_written();
+    }
+    if (!out_) {
+      return 0u;
     }
     std::streampos pos = out_.tellp();
-    if (pos < 0) {
+    return pos < 0 ? 0u : static_cast<uint64_t>(pos);
+  }
+
+  void CheckDumpLimit() {
+    if (dump_limit_ != 0u && BytesWritten() >= dump_limit_) {
+      limit_reached_.store(true);
+    }
+  }
+
+  enum class WriterJobKind {
+    kInitial,
+    kUpdate,
+    kForce,
+    kFinal,
+    kFlush,
+    kDumpLimit,
+  };
+
+  struct WriterJob {
+    WriterJobKind kind = WriterJobKind::kUpdate;
+    uint64_t value = 0;  // time, or the limit for kDumpLimit
+    int slot = -1;       // staging buffer holding the state, if any
+  };
+
+  // Host side: queues a job for the writer thread (or runs it inline when
+  // there is none). With `stage_state` the watched ranges are copied into a
+  // free staging buffer first, waiting for the writer to release one when
+  // the whole ring is queued.
+  void Submit(WriterJobKind kind, uint64_t value, bool stage_state) {
+    WriterJob job;
+    job.kind = kind;
+    job.value = value;
+    if (!async_) {
+      if (stage_state) {
+        const auto start = std::chrono::steady_clock::now();
+        StageState(staging_[0].data());
+        stage_ms_ += std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+      }
+      RunJob(job, stage_state ? staging_[0].data() : nullptr);
       return;
     }
-    uint64_t written = static_cast<uint64_t>(pos);
-    if (written >= dump_limit_) {
-      dumping_ = false;
+    if (stage_state) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (free_slots_.empty()) {
+        const auto wait_start = std::chrono::steady_clock::now();
+        slot_free_.wait(lock, [this]() { return !free_slots_.empty(); });
+        ++stall_count_;
+        stall_ms_ += std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - wait_start)
+                         .count();
+      }
+      job.slot = static_cast<int>(free_slots_.back());
+      free_slots_.pop_back();
+      lock.unlock();
+      const auto start = std::chrono::steady_clock::now();
+      StageState(staging_[static_cast<size_t>(job.slot)].data());
+      stage_ms_ += std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    }
+    bool wake = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+      wake = !stage_state || jobs_.size() >= wake_batch_ ||
+             free_slots_.empty();
+    }
+    if (wake) {
+      job_ready_.notify_one();
+    }
+  }
+
+  // Writer thread: owns the shadow copy, the per-signal last values and the
+  // output file from Start until Close. Jobs run in submission order; Close
+  // stops the loop once the queue is empty.
+  void WriterLoop() {
+    while (true) {
+      WriterJob job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_ready_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;
+        }
+        job = jobs_.front();
+        jobs_.pop_front();
+      }
+      const uint8_t* staged =
+          job.slot >= 0 ? staging_[static_cast<size_t>(job.slot)].data()
+                        : nullptr;
+      RunJob(job, staged);
+      if (job.slot >= 0) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          free_slots_.push_back(static_cast<size_t>(job.slot));
+        }
+        slot_free_.notify_one();
+      }
+    }
+  }
+
+  void RunJob(const WriterJob& job, const uint8_t* staged) {
+    switch (job.kind) {
+      case WriterJobKind::kInitial:
+        EmitInitialValues(staged);
+        break;
+      case WriterJobKind::kUpdate:
+        if (!limit_reached_.load()) {
+          EmitSnapshot(job.value, false, staged);
+        }
+        break;
+      case WriterJobKind::kForce:
+        if (!limit_reached_.load()) {
+          EmitSnapshot(job.value, true, staged);
+        }
+        break;
+      case WriterJobKind::kFinal:
+        if (!limit_reached_.load() && !last_time_had_values_) {
+          EmitSnapshot(has_time_ ? last_time_ : 0u, true, staged);
+        }
+        break;
+      case WriterJobKind::kFlush:
+        if (wave_.is_open()) {
+          wave_.Flush();
+        } else {
+          out_.flush();
+        }
+        break;
+      case WriterJobKind::kDumpLimit:
+        dump_limit_ = job.value;
+        CheckDumpLimit();
+        break;
     }
   }
 
@@ -4542,12 +5080,45 @@ class VcdWriter {
   bool has_time_ = false;
   bool last_time_had_values_ = false;
   bool dumping_ = true;
+  // Set by the writer once $dumplimit is reached; the host then stops
+  // queueing snapshots.
+  std::atomic<bool> limit_reached_{false};
   uint64_t last_time_ = 0;
   uint64_t dump_limit_ = 0;
   std::string timescale_ = "1ns";
   const PackedStateLayout* packed_layout_ = nullptr;
+  gpga::WaveFormat format_ = gpga::WaveFormat::kVcd;
   std::ofstream out_;
+  gpga::WaveWriter wave_;
   std::vector<VcdSignal> signals_;
+  std::vector<gpga::WaveSignalInfo> wave_signals_;
+  std::vector<WatchRange> ranges_;
+  std::vector<uint8_t> shadow_;
+  // Signals stored in shadow chunk c: chunk_signals_[chunk_begin_[c] ..
+  // chunk_begin_[c + 1]).
+  std::vector<uint32_t> chunk_begin_;
+  std::vector<uint32_t> chunk_signals_;
+  std::vector<uint32_t> dirty_signals_;
+  std::vector<uint64_t> signal_stamp_;
+  uint64_t stamp_ = 0;
+  std::vector<uint64_t> val_words_;
+  std::vector<uint64_t> xz_words_;
+  uint64_t snapshot_count_ = 0;
+  double snapshot_ms_ = 0.0;
+  // Writer thread and the staging ring, guarded by mutex_.
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable slot_free_;
+  std::deque<WriterJob> jobs_;
+  std::vector<size_t> free_slots_;
+  size_t wake_batch_ = 1;
+  bool stop_ = false;
+  bool async_ = false;
+  std::vector<std::vector<uint8_t>> staging_;
+  double stage_ms_ = 0.0;
+  uint64_t stall_count_ = 0;
+  double stall_ms_ = 0.0;
 };
 
 std::string StripComments(const std::string& line) {
@@ -4764,6 +5335,68 @@ bool ParseMemValueWords(const std::string& token_in, bool is_hex,
   return true;
 }
 
+// Threads for the mapped $readmem loader and the $writemem writer; 0 keeps
+// the line-by-line loader and per-word writer.
+uint32_t MemImageThreads() {
+  return EnvUint("METALFPGA_MEM_IMAGE_THREADS",
+                 std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Storage of `signal` for $readmem/$writemem: its _val/_xz buffers, or its
+// segment of the packed state. False when neither is there or the signal
+// lives in a --pack-bits bit group.
+bool FindMemImageLayout(
+    const gpga::SignalInfo& signal, bool four_state,
+    std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
+    const PackedStateLayout* packed_layout,
+    gpga::MetalBuffer* packed_state_buf, uint32_t instance_count,
+    gpga::MemImageLayout* layout) {
+  if (!layout) {
+    return false;
+  }
+  layout->element_stride = SignalElementSize(signal);
+  layout->word_size = SignalWordSize(signal);
+  layout->word_count = static_cast<uint32_t>(SignalWordCount(signal));
+  layout->width = SignalBitWidth(signal);
+  layout->array_size = signal.array_size > 0 ? signal.array_size : 1u;
+  layout->instance_count = instance_count;
+  const std::string base = MslSignalName(signal.name);
+  if (gpga::MetalBuffer* val_buf = FindBufferMutable(buffers, base, "_val")) {
+    if (!val_buf->contents()) {
+      return false;
+    }
+    layout->val = static_cast<uint8_t*>(val_buf->contents());
+    layout->val_elements = SignalElementCount(signal, *val_buf);
+    gpga::MetalBuffer* xz_buf =
+        four_state ? FindBufferMutable(buffers, base, "_xz") : nullptr;
+    if (xz_buf && xz_buf->contents()) {
+      layout->xz = static_cast<uint8_t*>(xz_buf->contents());
+      layout->xz_elements = SignalElementCount(signal, *xz_buf);
+    }
+    return true;
+  }
+  if (!packed_layout || !packed_state_buf || !packed_state_buf->contents()) {
+    return false;
+  }
+  const PackedSignalOffsets* packed = packed_layout->Find(signal.name);
+  if (!packed || !packed->has_val || packed->val_bit >= 0 ||
+      packed->xz_bit >= 0) {
+    return false;
+  }
+  auto* state = static_cast<uint8_t*>(packed_state_buf->contents());
+  const size_t length = packed_state_buf->length();
+  auto elements_from = [&](size_t offset) -> uint64_t {
+    return length > offset ? (length - offset) / layout->element_stride : 0u;
+  };
+  layout->val = state + packed->val_offset;
+  layout->val_elements = elements_from(packed->val_offset);
+  if (four_state && packed->has_xz) {
+    layout->xz = state + packed->xz_offset;
+    layout->xz_elements = elements_from(packed->xz_offset);
+  }
+  return true;
+}
+
 bool ApplyReadmem(const std::string& filename, bool is_hex,
                   const gpga::SignalInfo& signal, bool four_state,
                   std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
@@ -4811,10 +5444,12 @@ bool ApplyReadmem(const std::string& filename, bool is_hex,
       return;
     }
     WritePackedSignalWordToBuffer(signal, gid, array_index, packed_state_buf,
-                                  packed->val_offset, word_index, value);
+                                  packed->val_offset, word_index, value,
+                                  packed->val_bit);
     if (four_state && packed->has_xz) {
       WritePackedSignalWordToBuffer(signal, gid, array_index, packed_state_buf,
-                                    packed->xz_offset, word_index, xz);
+                                    packed->xz_offset, word_index, xz,
+                                    packed->xz_bit);
     }
   };
   uint32_t width = signal.is_real ? 64u : signal.width;
@@ -4828,6 +5463,16 @@ bool ApplyReadmem(const std::string& filename, bool is_hex,
   if (start > end) {
     std::swap(start, end);
   }
+  // Mapped, multi-threaded loader; it declines (and this loop takes over)
+  // for syntax it does not handle and for bit-packed signals.
+  const uint32_t threads = MemImageThreads();
+  gpga::MemImageLayout layout;
+  if (threads > 0u &&
+      FindMemImageLayout(signal, four_state, buffers, packed_layout,
+                         packed_state_buf, instance_count, &layout) &&
+      gpga::LoadMemImage(filename, is_hex, layout, start, end, threads)) {
+    return true;
+  }
   uint64_t address = start;
   std::string line;
   while (std::getline(in, line)) {
@@ -4929,13 +5574,13 @@ std::string FormatMemWords(const std::vector<uint64_t>& val_words,
   std::string out;
   out.reserve(digits);
   for (uint32_t d = 0; d < digits; ++d) {
-    int start_bit = static_cast<int>(width) - 1 - static_cast<int>(d * 4u);
+    int start_bit = static_cast<int>((digits - 1u - d) * 4u) + 3;
     uint32_t nibble_val = 0u;
     uint32_t nibble_xz = 0u;
     uint32_t nibble_mask = 0u;
     for (int b = 0; b < 4; ++b) {
       int bit_index = start_bit - b;
-      if (bit_index < 0) {
+      if (bit_index >= static_cast<int>(width)) {
         continue;
       }
       uint32_t nibble_bit = 1u << (3 - b);
@@ -4988,13 +5633,13 @@ std::string FormatMemWord(uint64_t val, uint64_t xz, uint32_t width,
   std::string out;
   out.reserve(digits);
   for (uint32_t d = 0; d < digits; ++d) {
-    int start_bit = static_cast<int>(width) - 1 - static_cast<int>(d * 4u);
+    int start_bit = static_cast<int>((digits - 1u - d) * 4u) + 3;
     uint32_t nibble_val = 0u;
     uint32_t nibble_xz = 0u;
     uint32_t nibble_mask = 0u;
     for (int b = 0; b < 4; ++b) {
       int bit_index = start_bit - b;
-      if (bit_index < 0) {
+      if (bit_index >= static_cast<int>(width)) {
         continue;
       }
       uint32_t nibble_bit = 1u << (3 - b);
@@ -5024,10 +5669,33 @@ std::string FormatMemWord(uint64_t val, uint64_t xz, uint32_t width,
 bool ApplyWritemem(const std::string& filename, bool is_hex,
                    const gpga::SignalInfo& signal, bool four_state,
                    std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
-                   uint64_t start, uint64_t end, std::string* error) {
+                   const PackedStateLayout* packed_layout,
+                   gpga::MetalBuffer* packed_state_buf, uint64_t start,
+                   uint64_t end, std::string* error) {
   if (!buffers) {
     return false;
   }
+  gpga::MemImageLayout layout;
+  if (!FindMemImageLayout(signal, four_state, buffers, packed_layout,
+                          packed_state_buf, 1u, &layout)) {
+    if (error) {
+      *error = "writemem target buffer not found: " + signal.name;
+    }
+    return false;
+  }
+  const uint32_t width = layout.width;
+  const uint64_t array_size = layout.array_size;
+  if (end == std::numeric_limits<uint64_t>::max()) {
+    end = array_size - 1u;
+  }
+  if (start > end) {
+    std::swap(start, end);
+  }
+  const uint32_t threads = MemImageThreads();
+  if (threads > 0u) {
+    return gpga::WriteMemImage(filename, is_hex, layout, start, end, threads,
+                               error);
+  }
   std::ofstream out(filename, std::ios::out | std::ios::trunc);
   if (!out) {
     if (error) {
@@ -5035,70 +5703,36 @@ bool ApplyWritemem(const std::string& filename, bool is_hex,
     }
     return false;
   }
-  const std::string base = MslSignalName(signal.name);
-  auto it_val = buffers->find(base + "_val");
-  if (it_val == buffers->end()) {
-    it_val = buffers->find(base);
-  }
-  if (it_val == buffers->end()) {
-    if (error) {
-      *error = "writemem target buffer not found: " + signal.name;
-    }
-    return false;
-  }
-  gpga::MetalBuffer* val_buf = &it_val->second;
-  gpga::MetalBuffer* xz_buf = nullptr;
-  if (four_state) {
-    auto it_xz = buffers->find(base + "_xz");
-    if (it_xz != buffers->end()) {
-      xz_buf = &it_xz->second;
-    }
-  }
-  uint32_t width = signal.is_real ? 64u : signal.width;
-  if (width == 0u) {
-    width = 1u;
-  }
-  uint32_t array_size = signal.array_size > 0 ? signal.array_size : 1u;
-  if (end == std::numeric_limits<uint64_t>::max()) {
-    end = (array_size > 0) ? static_cast<uint64_t>(array_size - 1u) : 0u;
-  }
-  if (start > end) {
-    std::swap(start, end);
-  }
-  if (array_size == 0 || start >= array_size) {
-    return true;
+  if (start >= array_size) {
+    return true;
   }
+  auto read_word = [&](const uint8_t* base, uint64_t addr,
+                       size_t word) -> uint64_t {
+    const size_t offset = static_cast<size_t>(addr) * layout.element_stride +
+                          word * layout.word_size;
+    uint64_t value = 0;
+    std::memcpy(&value, base + offset, layout.word_size);
+    return value;
+  };
   uint64_t limit_end = std::min<uint64_t>(end, array_size - 1u);
   for (uint64_t addr = start; addr <= limit_end; ++addr) {
+    if (addr >= layout.val_elements) {
+      break;
+    }
+    const bool has_xz = layout.xz && addr < layout.xz_elements;
     if (width <= 64u) {
-      uint64_t val = 0;
-      uint64_t xz = 0;
-      if (!ReadSignalWordFromBuffer(signal, 0u, addr, *val_buf, 0u, &val)) {
-        break;
-      }
-      if (four_state && xz_buf) {
-        ReadSignalWordFromBuffer(signal, 0u, addr, *xz_buf, 0u, &xz);
-      }
+      uint64_t val = read_word(layout.val, addr, 0u);
+      uint64_t xz = has_xz ? read_word(layout.xz, addr, 0u) : 0u;
       out << FormatMemWord(val, xz, width, is_hex, four_state) << "\n";
     } else {
-      const size_t word_count = SignalWordCount(signal);
-      std::vector<uint64_t> val_words(word_count, 0ull);
-      std::vector<uint64_t> xz_words(word_count, 0ull);
-      bool ok = true;
-      for (size_t word = 0; word < word_count; ++word) {
-        if (!ReadSignalWordFromBuffer(signal, 0u, addr, *val_buf, word,
-                                      &val_words[word])) {
-          ok = false;
-          break;
-        }
-        if (four_state && xz_buf) {
-          ReadSignalWordFromBuffer(signal, 0u, addr, *xz_buf, word,
-                                   &xz_words[word]);
+      std::vector<uint64_t> val_words(layout.word_count, 0ull);
+      std::vector<uint64_t> xz_words(layout.word_count, 0ull);
+      for (size_t word = 0; word < layout.word_count; ++word) {
+        val_words[word] = read_word(layout.val, addr, word);
+        if (has_xz) {
+          xz_words[word] = read_word(layout.xz, addr, word);
         }
       }
-      if (!ok) {
-        break;
-      }
       out << FormatMemWords(val_words, xz_words, width, is_hex, four_state)
           << "\n";
     }
@@ -5113,7 +5747,7 @@ bool ApplyWritemem(const std::string& filename, bool is_hex,
 }
 
 bool HandleServiceRecords(
-    const std::vector<DecodedServiceRecord>& records,
+    const std::vector<gpga::ServiceRecordView>& records,
     const gpga::ServiceStringTable& strings, const gpga::ModuleInfo& module,
     const std::string& vcd_dir,
     const std::unordered_map<std::string, std::string>* flat_to_hier,
@@ -5123,9 +5757,10 @@ bool HandleServiceRecords(
     uint32_t proc_count, FileTable* files,
     const std::vector<std::string>& plusargs,
     std::unordered_map<std::string, gpga::MetalBuffer>* buffers,
-    VcdWriter* vcd, gpga::ServiceDrainResult* result,
-    std::string* dumpfile, std::string* error) {
-  if (!buffers || !vcd || !dumpfile || !files) {
+    VcdWriter* vcd, ServiceFormatter* formatter,
+    gpga::ServiceDrainResult* result, std::string* dumpfile,
+    std::string* error) {
+  if (!buffers || !vcd || !formatter || !dumpfile || !files) {
     return false;
   }
   if (result) {
@@ -5200,7 +5835,7 @@ bool HandleServiceRecords(
     }
     return ReadPackedSignalWordFromBuffer(
         sig, gid, array_index, *packed_state_buf, packed->val_offset,
-        word_index, value_out);
+        word_index, value_out, packed->val_bit);
   };
   auto read_signal_string =
       [&](const gpga::SignalInfo& sig) -> std::string {
@@ -5212,7 +5847,7 @@ bool HandleServiceRecords(
         return {};
       }
     }
-    return UnpackStringWords(words, max_bytes);
+    return UnpackStringWords({words.data(), words.size()}, max_bytes);
   };
   auto write_signal_word =
       [&](const gpga::SignalInfo& sig, uint64_t array_index, size_t word_index,
@@ -5231,13 +5866,15 @@ bool HandleServiceRecords(
     }
     if (!WritePackedSignalWordToBuffer(sig, gid, array_index,
                                        packed_state_buf_mut,
-                                       packed->val_offset, word_index, value)) {
+                                       packed->val_offset, word_index, value,
+                                       packed->val_bit)) {
       return false;
     }
     if (four_state && packed->has_xz) {
       if (!WritePackedSignalWordToBuffer(sig, gid, array_index,
                                          packed_state_buf_mut,
-                                         packed->xz_offset, word_index, xz)) {
+                                         packed->xz_offset, word_index, xz,
+                                         packed->xz_bit)) {
         return false;
       }
     }
@@ -5313,12 +5950,12 @@ bool HandleServiceRecords(
   for (size_t i = 0; i < records.size(); ++i) {
     last_record_for_pid[records[i].pid] = i;
   }
-  auto should_resume = [&](const DecodedServiceRecord& rec,
+  auto should_resume = [&](const gpga::ServiceRecordView& rec,
                            size_t record_index) -> bool {
     auto it = last_record_for_pid.find(rec.pid);
     return it != last_record_for_pid.end() && it->second == record_index;
   };
-  auto resume_if_waiting = [&](const DecodedServiceRecord& rec,
+  auto resume_if_waiting = [&](const gpga::ServiceRecordView& rec,
                                size_t record_index, uint64_t value) -> void {
     if (!should_resume(rec, record_index)) {
       return;
@@ -5328,6 +5965,14 @@ bool HandleServiceRecords(
   for (size_t record_index = 0; record_index < records.size();
        ++record_index) {
     const auto& rec = records[record_index];
+    if (rec.kind != gpga::ServiceKind::kDisplay &&
+        rec.kind != gpga::ServiceKind::kWrite &&
+        rec.kind != gpga::ServiceKind::kMonitor &&
+        rec.kind != gpga::ServiceKind::kStrobe) {
+      // Keep buffered $display text ahead of anything else this record
+      // prints.
+      formatter->FlushStdout();
+    }
     switch (rec.kind) {
       case gpga::ServiceKind::kDumpfile: {
         *dumpfile = ResolveString(strings, rec.format_id);
@@ -5408,23 +6053,14 @@ bool HandleServiceRecords(
       case gpga::ServiceKind::kWrite:
       case gpga::ServiceKind::kMonitor:
       case gpga::ServiceKind::kStrobe: {
-        std::string fmt = (rec.format_id != 0xFFFFFFFFu)
-                              ? ResolveString(strings, rec.format_id)
-                              : "";
-        size_t start_index = 0;
-        if (!fmt.empty() && !rec.args.empty() &&
-            rec.args.front().kind == gpga::ServiceArgKind::kString &&
-            rec.args.front().value ==
-                static_cast<uint64_t>(rec.format_id)) {
-          start_index = 1;
-        }
-        std::string line =
-            fmt.empty() ? FormatDefaultArgs(rec.args, strings, four_state)
-                        : FormatWithSpec(fmt, rec.args, start_index, strings,
-                                         four_state, &module, buffers, gid);
-        std::cout << line;
+        std::string& text = formatter->stdout_text;
+        formatter->Append(rec.format_id, rec.args, strings, four_state,
+                          &module, buffers, gid, &text);
         if (rec.kind != gpga::ServiceKind::kWrite) {
-          std::cout << "\n";
+          text.push_back('\n');
+        }
+        if (text.size() >= kServiceStdoutFlushBytes) {
+          formatter->FlushStdout();
         }
         break;
       }
@@ -5433,24 +6069,10 @@ bool HandleServiceRecords(
             rec.args.front().kind != gpga::ServiceArgKind::kIdent) {
           break;
         }
-        std::vector<gpga::ServiceArgView> fmt_args;
-        if (rec.args.size() > 1) {
-          fmt_args.assign(rec.args.begin() + 1, rec.args.end());
-        }
-        std::string fmt = (rec.format_id != 0xFFFFFFFFu)
-                              ? ResolveString(strings, rec.format_id)
-                              : "";
-        size_t start_index = 0;
-        if (!fmt.empty() && !fmt_args.empty() &&
-            fmt_args.front().kind == gpga::ServiceArgKind::kString &&
-            fmt_args.front().value ==
-                static_cast<uint64_t>(rec.format_id)) {
-          start_index = 1;
-        }
-        std::string line =
-            fmt.empty() ? FormatDefaultArgs(fmt_args, strings, four_state)
-                        : FormatWithSpec(fmt, fmt_args, start_index, strings,
-                                         four_state, &module, buffers, gid);
+        std::string& line = formatter->line;
+        line.clear();
+        formatter->Append(rec.format_id, rec.args.Skip(1), strings,
+                          four_state, &module, buffers, gid, &line);
         write_output_arg(rec.args.front(), 0, line, nullptr);
         break;
       }
@@ -5588,28 +6210,14 @@ bool HandleServiceRecords(
         if (file_it == files->handles.end() || !file_it->second.file) {
           break;
         }
-        std::vector<gpga::ServiceArgView> fmt_args;
-        if (rec.args.size() > 1) {
-          fmt_args.assign(rec.args.begin() + 1, rec.args.end());
-        }
-        std::string fmt = (rec.format_id != 0xFFFFFFFFu)
-                              ? ResolveString(strings, rec.format_id)
-                              : "";
-        size_t start_index = 0;
-        if (!fmt.empty() && !fmt_args.empty() &&
-            fmt_args.front().kind == gpga::ServiceArgKind::kString &&
-            fmt_args.front().value ==
-                static_cast<uint64_t>(rec.format_id)) {
-          start_index = 1;
-        }
-        std::string line =
-            fmt.empty() ? FormatDefaultArgs(fmt_args, strings, four_state)
-                        : FormatWithSpec(fmt, fmt_args, start_index, strings,
-                                         four_state, &module, buffers, gid);
-        std::fwrite(line.data(), 1, line.size(), file_it->second.file);
+        std::string& line = formatter->line;
+        line.clear();
+        formatter->Append(rec.format_id, rec.args.Skip(1), strings,
+                          four_state, &module, buffers, gid, &line);
         if (rec.kind == gpga::ServiceKind::kFdisplay) {
-          std::fputc('\n', file_it->second.file);
+          line.push_back('\n');
         }
+        std::fwrite(line.data(), 1, line.size(), file_it->second.file);
         std::fflush(file_it->second.file);
         break;
       }
@@ -6109,7 +6717,7 @@ bool HandleServiceRecords(
       }
       case gpga::ServiceKind::kDumpon: {
         vcd->SetDumping(true);
-        vcd->ForceSnapshot(current_time(), *buffers);
+        vcd->ForceSnapshot(current_time());
         std::cout << "$dumpon (pid=" << rec.pid << ")\n";
         break;
       }
@@ -6119,7 +6727,7 @@ bool HandleServiceRecords(
         break;
       }
       case gpga::ServiceKind::kDumpall: {
-        vcd->ForceSnapshot(current_time(), *buffers);
+        vcd->ForceSnapshot(current_time());
         std::cout << "$dumpall (pid=" << rec.pid << ")\n";
         break;
       }
@@ -6264,8 +6872,9 @@ bool HandleServiceRecords(
           return false;
         }
         bool is_hex = rec.kind == gpga::ServiceKind::kWritememh;
-        if (!ApplyWritemem(filename, is_hex, *it, four_state, buffers, start,
-                           end, error)) {
+        if (!ApplyWritemem(filename, is_hex, *it, four_state, buffers,
+                           packed_layout, packed_state_buf_mut, start, end,
+                           error)) {
           return false;
         }
         std::cout << label << " \"" << filename << "\" (pid=" << rec.pid << ")";
@@ -6440,20 +7049,67 @@ void SwapNextBuffers(std::unordered_map<std::string, gpga::MetalBuffer>* buffers
   }
 }
 
+// Nets of FindTwoStateNets(module) whose xz segment the emitted --prune-xz
+// layout dropped; 1-bit ones under --pack-bits keep their bitset xz bit.
+std::unordered_set<std::string> PackedTwoStateNets(
+    const gpga::Module& module, const gpga::SchedulerConstants& sched,
+    const std::unordered_set<std::string>& proven) {
+  std::unordered_set<std::string> two_state_nets;
+  for (const auto& net : module.nets) {
+    if (proven.count(net.name) == 0 ||
+        (sched.packed_bit_groups > 0u && net.width == 1)) {
+      continue;
+    }
+    two_state_nets.insert(net.name);
+  }
+  return two_state_nets;
+}
+
+// The packed state plan RunMetal builds for `module` under `sched`, for the
+// design image of the artifact cache.
+gpga::PackedStatePlan BuildRunPackedStatePlan(
+    const gpga::Module& module, const gpga::SchedulerConstants& sched,
+    bool four_state, const std::unordered_set<std::string>& proven) {
+  std::unordered_set<std::string> two_state_nets;
+  if (four_state && sched.prune_xz) {
+    two_state_nets = PackedTwoStateNets(module, sched, proven);
+  }
+  const gpga::ModuleInfo info = BuildModuleInfo(
+      module, four_state, sched.prune_xz ? &two_state_nets : nullptr);
+  return BuildPackedStatePlan(module, info, four_state,
+                              sched.packed_bit_groups > 0u,
+                              sched.locality_layout);
+}
+
 bool RunMetal(const gpga::Module& module, const std::string& msl,
+              const gpga::SchedulerManifest* manifest,
+              const gpga::SchedulerVmImageView* vm_image,
+              gpga::RuntimeBackend backend,
               const std::unordered_map<std::string, std::string>& flat_to_hier,
+              const std::unordered_set<std::string>* proven_two_state,
+              const gpga::PackedStatePlan* packed_plan,
               bool enable_4state, uint32_t count, uint32_t service_capacity,
               uint32_t max_steps, uint32_t max_proc_steps,
               uint32_t dispatch_timeout_ms,
               bool run_verbose,
               bool source_bindings,
+              bool vm_dedup,
+              bool vm_opt,
               const std::string& vcd_dir, uint32_t vcd_steps,
+              gpga::WaveFormat wave_format,
               const std::vector<std::string>& plusargs,
               std::string* error) {
   gpga::MetalRuntime runtime;
+  runtime.SetBackend(backend);
   runtime.SetPreferSourceBindings(source_bindings);
+  if (manifest) {
+    runtime.SetKernelBindingTables(manifest->kernels);
+  }
   if (run_verbose) {
-    std::cerr << "Compiling Metal source (" << msl.size() << " bytes)...\n";
+    std::cerr << "Compiling "
+              << (runtime.Backend() == gpga::RuntimeBackend::kCpu ? "host C++"
+                                                                  : "Metal")
+              << " source (" << msl.size() << " bytes)...\n";
   }
   auto compile_start = std::chrono::steady_clock::now();
   if (!runtime.CompileSource(msl, {"include"}, error)) {
@@ -6580,7 +7236,20 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
   }
 
   gpga::SchedulerConstants sched;
-  gpga::ParseSchedulerConstants(msl, &sched, error);
+  if (manifest) {
+    sched = manifest->sched;
+  } else {
+    gpga::ParseSchedulerConstants(msl, &sched, error);
+  }
+  // --prune-xz: the emitted layout dropped the xz segments of these nets.
+  std::unordered_set<std::string> two_state_nets;
+  if (enable_4state && sched.prune_xz) {
+    two_state_nets = PackedTwoStateNets(
+        module, sched,
+        proven_two_state ? *proven_two_state : gpga::FindTwoStateNets(module));
+  }
+  const std::unordered_set<std::string>* two_state_ptr =
+      sched.prune_xz ? &two_state_nets : nullptr;
   gpga::SchedulerVmLayout vm_layout;
   const gpga::SchedulerVmLayout* vm_layout_ptr = nullptr;
   uint32_t callgroup_procs = 0u;
@@ -6593,11 +7262,84 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
     const char* label;
   };
   std::vector<VmWatchProc> vm_watch_procs;
+  if (vm_image && !sched.vm_enabled) {
+    *error = "scheduler VM image given for a design emitted without --sched-vm";
+    return false;
+  }
   if (sched.vm_enabled) {
-    if (!gpga::BuildSchedulerVmLayoutFromModule(
-            module, &vm_layout, error, enable_4state)) {
+    if (vm_image) {
+      // Table counts are compiled into the kernels, so the image must come
+      // from this exact MSL.
+      if (vm_image->source_bytes != msl.size() ||
+          vm_image->source_hash != gpga::SchedulerManifestSourceHash(msl) ||
+          vm_image->four_state != enable_4state) {
+        *error = "scheduler VM image was written for a different MSL source";
+        return false;
+      }
+      // The state buffers are sized and laid out from the design, so the
+      // image's slots must be the ones built for it.
+      gpga::SchedulerVmLayout built_layout;
+      const gpga::SchedulerVmLayout* design_layout = &built_layout;
+      if (manifest && manifest->has_vm_layout) {
+        design_layout = &manifest->vm_layout;
+      } else if (!gpga::BuildSchedulerVmLayoutFromModule(
+                     module, &built_layout, error, enable_4state,
+                     two_state_ptr)) {
+        return false;
+      }
+      if (!gpga::CheckSchedulerVmImageState(*vm_image, *design_layout,
+                                            error)) {
+        return false;
+      }
+      gpga::CopySchedulerVmImageLayout(*vm_image, &vm_layout);
+    } else if (manifest && manifest->has_vm_layout) {
+      vm_layout = manifest->vm_layout;
+    } else if (!gpga::BuildSchedulerVmLayoutFromModule(
+                   module, &vm_layout, error, enable_4state, two_state_ptr)) {
       return false;
     }
+    if (vm_opt) {
+      gpga::SchedulerVmOptStats opt_stats;
+      if (!gpga::OptimizeSchedulerVmBytecode(
+              &vm_layout, gpga::SchedulerVmOptOptions{}, &opt_stats, error)) {
+        return false;
+      }
+      if (run_verbose) {
+        std::cerr << "sched-vm-opt: bytecode " << opt_stats.words_before
+                  << " -> " << opt_stats.words_after << " words; "
+                  << opt_stats.threaded_targets << " targets threaded, "
+                  << opt_stats.removed_noops << " noops, "
+                  << opt_stats.removed_jumps << " jumps and "
+                  << opt_stats.unreachable_instrs
+                  << " unreachable instrs removed; " << opt_stats.assign_runs
+                  << " assign runs (" << opt_stats.fused_assigns
+                  << " assigns), " << opt_stats.branches << " branches, "
+                  << opt_stats.wait_edge_loops << " wait-edge loops";
+        if (opt_stats.skipped_procs != 0u) {
+          std::cerr << "; " << opt_stats.skipped_procs << " procs skipped";
+        }
+        std::cerr << "\n";
+      }
+    }
+    const uint32_t vm_dedup_procs =
+        vm_dedup ? gpga::DedupSchedulerVmProcBodies(&vm_layout) : 0u;
+    if (run_verbose && !vm_layout.bytecode.empty()) {
+      const uint64_t padded_words = gpga::SchedulerVmPaddedWords(vm_layout);
+      const uint64_t packed_words = vm_layout.bytecode.size();
+      const uint64_t saved_bytes =
+          (padded_words > packed_words)
+              ? (padded_words - packed_words) * sizeof(uint32_t) * count
+              : 0u;
+      std::cerr << "sched-vm: bytecode " << packed_words << " words ("
+                << vm_layout.proc_count << " procs, longest "
+                << vm_layout.words_per_proc << "); padded layout would need "
+                << padded_words << ", saved " << saved_bytes << " bytes over "
+                << count << " instance(s)";
+      if (vm_dedup) {
+        std::cerr << ", " << vm_dedup_procs << " proc bodies deduplicated";
+      }
+      std::cerr << "\n";
+    }
     if (!vm_layout.bytecode.empty()) {
       sched.vm_bytecode_words =
           static_cast<uint32_t>(vm_layout.bytecode.size());
@@ -6752,7 +7494,8 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
     }
   }
 
-  gpga::ModuleInfo info = BuildModuleInfo(module, enable_4state);
+  gpga::ModuleInfo info =
+      BuildModuleInfo(module, enable_4state, two_state_ptr);
 
   gpga::MetalKernel comb_kernel;
   gpga::MetalKernel init_kernel;
@@ -6955,8 +7698,61 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
   PackedStateLayout packed_layout;
   bool has_packed_layout = false;
   if (buffers.find("gpga_state") != buffers.end()) {
-    packed_layout = BuildPackedStateLayout(module, info, enable_4state, count);
+    packed_layout = LayoutPackedState(
+        packed_plan ? *packed_plan
+                    : BuildPackedStatePlan(module, info, enable_4state,
+                                           sched.packed_bit_groups > 0u,
+                                           sched.locality_layout),
+        enable_4state, count);
     has_packed_layout = true;
+    if (run_verbose) {
+      std::cerr << "packed state: " << buffers["gpga_state"].length()
+                << " bytes, " << sched.packed_bit_groups
+                << " bit groups\n";
+    }
+    if (run_verbose && sched.prune_xz) {
+      // Segments the dropped xz copies would have taken, less the shared
+      // zero segment.
+      size_t pruned = 0;
+      size_t saved = 0;
+      for (const auto& sig : info.signals) {
+        const PackedSignalOffsets* packed = packed_layout.Find(sig.name);
+        if (!sig.two_state || !packed || !packed->has_val ||
+            packed->val_bit >= 0) {
+          continue;
+        }
+        ++pruned;
+        saved += Align8(static_cast<size_t>(count) * packed->array_size *
+                        packed->elem_size);
+      }
+      const size_t zero_bytes = static_cast<size_t>(count) * sizeof(uint64_t);
+      saved = saved > zero_bytes ? saved - zero_bytes : 0u;
+      std::cerr << "prune-xz: " << pruned
+                << " buffer-backed nets share one zero xz segment, " << saved
+                << " bytes saved\n";
+    }
+    if (run_verbose && sched.locality_layout) {
+      const PackedStateLayout declared_layout = LayoutPackedState(
+          BuildPackedStatePlan(module, info, enable_4state,
+                               sched.packed_bit_groups > 0u, false),
+          enable_4state, count);
+      size_t total_before = 0;
+      size_t total_after = 0;
+      for (const auto& process : gpga::CollectStateProcessAccesses(module)) {
+        const size_t before = ProcessStateSpanLines(process, declared_layout);
+        const size_t after = ProcessStateSpanLines(process, packed_layout);
+        if (before == 0 && after == 0) {
+          continue;
+        }
+        total_before += before;
+        total_after += after;
+        std::cerr << "locality: " << process.label
+                  << (process.hot ? "" : " (cold)") << ": " << before
+                  << " -> " << after << " cache lines\n";
+      }
+      std::cerr << "locality: total " << total_before << " -> " << total_after
+                << " cache lines\n";
+    }
   }
 
   const bool has_dumpvars = ModuleUsesDumpvars(module);
@@ -7011,13 +7807,20 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
   }
 
   gpga::ServiceStringTable strings = BuildStringTable(module);
+  ServiceFormatter formatter = BuildServiceFormatter(strings);
   VcdWriter vcd;
+  vcd.SetFormat(wave_format);
   if (has_packed_layout) {
     vcd.SetPackedLayout(&packed_layout);
   }
   std::string dumpfile;
   std::vector<FileTable> file_tables(count);
 
+  // Set when the scheduler stops in GPGA_SCHED_STATUS_ERROR (for example a
+  // statement neither the VM nor the fallback path can run); the run then
+  // fails instead of reporting whatever state it reached.
+  bool sched_failed = false;
+  uint32_t sched_error_code = 0u;
   if (has_sched) {
     if (sched_halt_mode) {
       InstallHaltSignalHandlers();
@@ -7069,6 +7872,11 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
     const uint32_t kStatusStopped = 4u;
     const uint32_t kStatusIdle = 1u;
     uint32_t last_status_val = std::numeric_limits<uint32_t>::max();
+    // Reused across drains: the copy of a wrapped ring and the record views.
+    std::vector<uint8_t> service_staging;
+    std::vector<gpga::ServiceRecordView> service_views;
+    uint64_t service_records_drained = 0u;
+    uint64_t service_drain_allocations = 0u;
     for (uint64_t iter = 0ull;; ++iter) {
       if (sched_params && has_dumpvars) {
         sched_params->max_steps = vcd.active() ? vcd_step_budget : max_steps;
@@ -7249,37 +8057,40 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
           }
           const uint8_t* rec_base =
               records + (gid * service_capacity * stride);
-          std::vector<uint8_t> staging;
-          staging.resize(static_cast<size_t>(used) * stride);
+          const uint64_t allocations_before = ThreadHeapAllocations();
           uint32_t head_slot =
               service_capacity ? (head % service_capacity) : 0u;
           uint32_t first_span =
               std::min<uint32_t>(used, service_capacity - head_slot);
-          std::memcpy(staging.data(),
-                      rec_base + (static_cast<size_t>(head_slot) * stride),
-                      static_cast<size_t>(first_span) * stride);
+          const uint8_t* span_base =
+              rec_base + (static_cast<size_t>(head_slot) * stride);
           if (used > first_span) {
+            // The records wrap around the ring; copy them contiguous.
+            service_staging.resize(static_cast<size_t>(used) * stride);
+            std::memcpy(service_staging.data(), span_base,
+                        static_cast<size_t>(first_span) * stride);
             std::memcpy(
-                staging.data() + (static_cast<size_t>(first_span) * stride),
-                rec_base,
-                static_cast<size_t>(used - first_span) * stride);
+                service_staging.data() +
+                    (static_cast<size_t>(first_span) * stride),
+                rec_base, static_cast<size_t>(used - first_span) * stride);
+            span_base = service_staging.data();
           }
-          std::vector<DecodedServiceRecord> decoded;
-          DecodeServiceRecords(staging.data(), used,
-                               std::max<uint32_t>(1u,
-                                                  sched.service_max_args),
-                               sched.service_wide_words, enable_4state,
-                               &decoded);
+          gpga::ReadServiceRecords(
+              span_base, used,
+              std::max<uint32_t>(1u, sched.service_max_args),
+              sched.service_wide_words, enable_4state, &service_views);
           gpga::ServiceDrainResult result;
-          if (!HandleServiceRecords(decoded, strings, info, vcd_dir,
-                                    &flat_to_hier,
-                                    has_packed_layout ? &packed_layout
-                                                      : nullptr,
-                                    module.timescale,
-                                    enable_4state, count, gid,
-                                    sched.proc_count, &file_tables[gid],
-                                    plusargs, &buffers, &vcd, &result,
-                                    &dumpfile, error)) {
+          bool handled = HandleServiceRecords(
+              service_views, strings, info, vcd_dir, &flat_to_hier,
+              has_packed_layout ? &packed_layout : nullptr, module.timescale,
+              enable_4state, count, gid, sched.proc_count, &file_tables[gid],
+              plusargs, &buffers, &vcd, &formatter, &result, &dumpfile,
+              error);
+          formatter.FlushStdout();
+          service_records_drained += used;
+          service_drain_allocations +=
+              ThreadHeapAllocations() - allocations_before;
+          if (!handled) {
             return false;
           }
           if (result.saw_finish || result.saw_stop || result.saw_error) {
@@ -7305,9 +8116,9 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
         if (time_it != buffers.end() && time_it->second.contents()) {
           uint64_t time = 0;
           std::memcpy(&time, time_it->second.contents(), sizeof(time));
-          vcd.Update(time, buffers);
+          vcd.Update(time);
         } else {
-          vcd.Update(static_cast<uint64_t>(iter), buffers);
+          vcd.Update(static_cast<uint64_t>(iter));
         }
       }
       if (do_ready) {
@@ -7704,6 +8515,9 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
                               << " entry_offset=" << header.entry_offset
                               << " expr_offset=" << header.expr_offset
                               << " default_target=" << header.default_target
+                              << " table_offset=" << header.table_offset
+                              << " table_mask=" << header.table_mask
+                              << " wild_count=" << header.wild_count
                               << "\n";
                   } else {
                     std::cerr << "sched-vm-case-header: case_id=" << arg
@@ -7797,8 +8611,39 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
         if (!drain_services(true)) {
           return false;
         }
-        vcd.FinalSnapshot(buffers);
+        vcd.FinalSnapshot();
+        const bool vcd_was_active = vcd.active();
         vcd.Close();
+        if (run_verbose && vcd_was_active) {
+          std::cerr << "vcd: " << vcd.signal_count() << " signals, "
+                    << vcd.watched_bytes() << " watched bytes, "
+                    << vcd.snapshot_count() << " snapshots, "
+                    << vcd.snapshot_ms() << " ms writer, "
+                    << vcd.stage_ms() << " ms staging, "
+                    << vcd.stall_ms() << " ms stalled ("
+                    << vcd.stall_count() << " waits)\n";
+        }
+        if (run_verbose && service_records_drained > 0u) {
+          std::cerr << "services: " << service_records_drained
+                    << " records";
+          if (kCountHeapAllocations) {
+            std::cerr << ", " << service_drain_allocations
+                      << " heap allocations (" << std::fixed
+                      << std::setprecision(2)
+                      << static_cast<double>(service_drain_allocations) /
+                             static_cast<double>(service_records_drained)
+                      << std::defaultfloat << " per record)\n";
+          } else {
+            std::cerr << " (heap allocations are counted in builds "
+                         "configured with -DMETALFPGA_COUNT_ALLOCATIONS=ON)\n";
+          }
+        }
+        if (status_val == kStatusError) {
+          auto* error_buf =
+              static_cast<uint32_t*>(buffers["sched_error"].contents());
+          sched_failed = true;
+          sched_error_code = error_buf ? error_buf[0] : 0u;
+        }
         break;
       }
     }
@@ -7839,6 +8684,11 @@ bool RunMetal(const gpga::Module& module, const std::string& msl,
     }
     table.handles.clear();
   }
+  if (sched_failed) {
+    *error = "scheduler stopped with an error (sched_error=" +
+             std::to_string(sched_error_code) + ")";
+    return false;
+  }
   return true;
 }
 
@@ -8984,6 +9834,501 @@ void DumpFlat(const gpga::ElaboratedDesign& design, std::ostream& os) {
   }
 }
 
+// Round-trips the emitted manifest through its binary encoding and compares
+// it with what the regex-based MSL scanner recovers from the same source.
+bool CheckSchedulerManifest(const std::string& msl,
+                            const gpga::SchedulerManifest& manifest,
+                            std::string* report) {
+  std::ostringstream out;
+  bool ok = true;
+  std::string bytes;
+  std::string error;
+  gpga::SchedulerManifest decoded;
+  if (!gpga::SerializeSchedulerManifest(manifest, &bytes, &error) ||
+      !gpga::DeserializeSchedulerManifest(bytes.data(), bytes.size(),
+                                          &decoded, &error)) {
+    out << "  encode/decode: " << error << "\n";
+    *report = out.str();
+    return false;
+  }
+  if (!gpga::SchedulerManifestMatchesSource(decoded, msl)) {
+    out << "  source hash mismatch\n";
+    ok = false;
+  }
+  gpga::SchedulerConstants scanned;
+  gpga::ParseSchedulerConstants(msl, &scanned, &error);
+  const gpga::SchedulerConstants& sched = decoded.sched;
+  auto check = [&](const char* name, uint32_t manifest_value,
+                   uint32_t scanned_value) {
+    if (manifest_value != scanned_value) {
+      out << "  " << name << ": manifest=" << manifest_value
+          << " scanned=" << scanned_value << "\n";
+      ok = false;
+    }
+  };
+  check("has_scheduler", sched.has_scheduler, scanned.has_scheduler);
+  check("proc_count", sched.proc_count, scanned.proc_count);
+  check("event_count", sched.event_count, scanned.event_count);
+  check("edge_count", sched.edge_count, scanned.edge_count);
+  check("edge_star_count", sched.edge_star_count, scanned.edge_star_count);
+  check("repeat_count", sched.repeat_count, scanned.repeat_count);
+  check("delay_count", sched.delay_count, scanned.delay_count);
+  check("max_dnba", sched.max_dnba, scanned.max_dnba);
+  check("monitor_count", sched.monitor_count, scanned.monitor_count);
+  check("monitor_max_args", sched.monitor_max_args, scanned.monitor_max_args);
+  check("strobe_count", sched.strobe_count, scanned.strobe_count);
+  check("service_max_args", sched.service_max_args, scanned.service_max_args);
+  check("service_wide_words", sched.service_wide_words,
+        scanned.service_wide_words);
+  check("string_count", sched.string_count, scanned.string_count);
+  check("force_count", sched.force_count, scanned.force_count);
+  check("pcont_count", sched.pcont_count, scanned.pcont_count);
+  check("timing_check_count", sched.timing_check_count,
+        scanned.timing_check_count);
+  check("vm_enabled", sched.vm_enabled, scanned.vm_enabled);
+  check("vm_bytecode_words", sched.vm_bytecode_words,
+        scanned.vm_bytecode_words);
+  check("vm_cond_count", sched.vm_cond_count, scanned.vm_cond_count);
+  check("vm_assign_count", sched.vm_assign_count, scanned.vm_assign_count);
+  check("vm_force_count", sched.vm_force_count, scanned.vm_force_count);
+  check("vm_release_count", sched.vm_release_count, scanned.vm_release_count);
+  check("vm_service_call_count", sched.vm_service_call_count,
+        scanned.vm_service_call_count);
+  check("vm_service_assign_count", sched.vm_service_assign_count,
+        scanned.vm_service_assign_count);
+  check("vm_service_arg_count", sched.vm_service_arg_count,
+        scanned.vm_service_arg_count);
+  check("vm_call_frame_words", sched.vm_call_frame_words,
+        scanned.vm_call_frame_words);
+  check("vm_call_frame_depth", sched.vm_call_frame_depth,
+        scanned.vm_call_frame_depth);
+  check("vm_case_header_count", sched.vm_case_header_count,
+        scanned.vm_case_header_count);
+  check("vm_case_entry_count", sched.vm_case_entry_count,
+        scanned.vm_case_entry_count);
+  check("vm_case_word_count", sched.vm_case_word_count,
+        scanned.vm_case_word_count);
+  check("vm_expr_word_count", sched.vm_expr_word_count,
+        scanned.vm_expr_word_count);
+  check("vm_expr_imm_word_count", sched.vm_expr_imm_word_count,
+        scanned.vm_expr_imm_word_count);
+  check("vm_signal_count", sched.vm_signal_count, scanned.vm_signal_count);
+  check("inst_state_bytes", sched.inst_state_bytes,
+        scanned.inst_state_bytes);
+  if (decoded.kernels.size() != manifest.kernels.size()) {
+    out << "  kernel table count changed across encode/decode\n";
+    ok = false;
+  }
+  for (const auto& table : decoded.kernels) {
+    const gpga::KernelBindingTable* original =
+        gpga::FindKernelBindingTable(manifest.kernels, table.kernel);
+    if (!original || original->buffers != table.buffers) {
+      out << "  kernel bindings differ: " << table.kernel << "\n";
+      ok = false;
+    }
+  }
+  if (decoded.has_vm_layout != manifest.has_vm_layout ||
+      (decoded.has_vm_layout &&
+       (decoded.vm_layout.bytecode != manifest.vm_layout.bytecode ||
+        decoded.vm_layout.proc_offsets != manifest.vm_layout.proc_offsets ||
+        decoded.vm_layout.expr_table.words !=
+            manifest.vm_layout.expr_table.words ||
+        decoded.vm_layout.expr_table.reg_count !=
+            manifest.vm_layout.expr_table.reg_count ||
+        decoded.vm_layout.case_words != manifest.vm_layout.case_words))) {
+    out << "  vm layout differs after encode/decode\n";
+    ok = false;
+  }
+  *report = out.str();
+  return ok;
+}
+
+// Runs one profiled pass of `layout` on the host interpreter and prints the
+// per-opcode / per-proc histogram under `title`.
+bool RunSchedulerVmProfile(
+    const gpga::SchedulerVmLayout& layout,
+    const std::vector<gpga::SchedulerVmContinuousAssign>& continuous_assigns,
+    const std::string& title, bool four_state, uint32_t instance_count,
+    uint64_t max_time, gpga::SchedulerVmRunResult* result,
+    std::string* error) {
+  gpga::SchedulerVmInterpreter interp(layout, four_state);
+  gpga::SchedulerVmRunOptions options;
+  options.instance_count = instance_count;
+  options.max_time = max_time;
+  options.profile = true;
+  options.continuous_assigns = &continuous_assigns;
+  const auto start = std::chrono::steady_clock::now();
+  if (!interp.Run(options, result, error)) {
+    return false;
+  }
+  const double elapsed_ms =
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  std::cout << title << ": procs=" << layout.proc_count
+            << " instances=" << instance_count
+            << " time=" << result->final_time
+            << " activations=" << result->activations
+            << " deltas=" << result->delta_cycles << " wall_ms=" << std::fixed
+            << std::setprecision(3) << elapsed_ms << std::defaultfloat
+            << (result->finished ? " ($finish)" : "")
+            << (result->stopped ? " ($stop)" : "") << "\n";
+  std::cout << result->profile.Format(16u);
+  bool any_skipped = false;
+  for (uint32_t op = 0; op < gpga::kSchedulerVmOpCount; ++op) {
+    if (result->skipped_ops[op] == 0u) {
+      continue;
+    }
+    if (!any_skipped) {
+      std::cout << "skipped ops (need generated kernels)\n";
+      any_skipped = true;
+    }
+    std::cout << "  " << gpga::SchedulerVmOpName(op) << ": "
+              << result->skipped_ops[op] << "\n";
+  }
+  if (result->expr_failures != 0u) {
+    std::cout << "expr failures: " << result->expr_failures << "\n";
+  }
+  if (result->continuous_assign_updates != 0u) {
+    std::cout << "continuous assign updates: "
+              << result->continuous_assign_updates << "\n";
+  }
+  return true;
+}
+
+// The interpreter only approximates the kernels; say on stderr how much of
+// the run it could not model so the histogram is not read as the full cost.
+void WarnSchedulerVmProfileGaps(const gpga::SchedulerVmRunResult& result,
+                                uint32_t unmodelled_assigns) {
+  uint64_t skipped = 0u;
+  std::ostringstream ops;
+  for (uint32_t op = 0; op < gpga::kSchedulerVmOpCount; ++op) {
+    if (result.skipped_ops[op] == 0u) {
+      continue;
+    }
+    skipped += result.skipped_ops[op];
+    ops << (ops.tellp() > 0 ? ", " : "") << gpga::SchedulerVmOpName(op) << " x"
+        << result.skipped_ops[op];
+  }
+  if (skipped == 0u && unmodelled_assigns == 0u &&
+      result.expr_failures == 0u) {
+    return;
+  }
+  std::cerr << "warning: --vm-profile did not model part of the design:";
+  if (skipped != 0u) {
+    std::cerr << " " << skipped << " skipped ops (" << ops.str() << ");";
+  }
+  if (unmodelled_assigns != 0u) {
+    std::cerr << " " << unmodelled_assigns
+              << " continuous assigns left to the kernels;";
+  }
+  if (result.expr_failures != 0u) {
+    std::cerr << " " << result.expr_failures << " expr failures;";
+  }
+  std::cerr << " counts cover the interpreted bytecode only\n";
+}
+
+// Runs the top module's scheduler VM bytecode on the host interpreter and
+// prints the per-opcode / per-proc histogram. With `optimize`, the profiled
+// op pairs then guide OptimizeSchedulerVmBytecode, the optimized bytecode is
+// profiled again and the dynamic instruction counts are compared.
+bool ProfileSchedulerVm(const gpga::Module& module, bool four_state,
+                        uint32_t instance_count, uint64_t max_time,
+                        bool optimize, std::string* error) {
+  gpga::SchedulerVmLayout layout;
+  if (!gpga::BuildSchedulerVmLayoutFromModule(module, &layout, error,
+                                              four_state)) {
+    return false;
+  }
+  std::vector<gpga::SchedulerVmContinuousAssign> continuous_assigns;
+  uint32_t unmodelled_assigns = 0u;
+  gpga::BuildSchedulerVmContinuousAssigns(module, four_state, &layout,
+                                          &continuous_assigns,
+                                          &unmodelled_assigns);
+  gpga::SchedulerVmRunResult result;
+  if (!RunSchedulerVmProfile(layout, continuous_assigns,
+                             "vm profile for " + module.name, four_state,
+                             instance_count, max_time, &result, error)) {
+    return false;
+  }
+  WarnSchedulerVmProfileGaps(result, unmodelled_assigns);
+  if (!optimize) {
+    return true;
+  }
+  const gpga::SchedulerVmOpPairCounts pairs(result.profile.op_pairs.begin(),
+                                            result.profile.op_pairs.end());
+  gpga::SchedulerVmOptOptions opt_options;
+  opt_options.pair_counts = &pairs;
+  gpga::SchedulerVmOptStats stats;
+  if (!gpga::OptimizeSchedulerVmBytecode(&layout, opt_options, &stats,
+                                         error)) {
+    return false;
+  }
+  gpga::SchedulerVmRunResult opt_result;
+  if (!RunSchedulerVmProfile(layout, continuous_assigns,
+                             "vm profile for " + module.name + " (optimized)",
+                             four_state, instance_count, max_time, &opt_result,
+                             error)) {
+    return false;
+  }
+  auto total_ops = [](const gpga::SchedulerVmRunResult& run) {
+    uint64_t total = 0u;
+    for (uint64_t count : run.profile.op_count) {
+      total += count;
+    }
+    return total;
+  };
+  const uint64_t before = total_ops(result);
+  const uint64_t after = total_ops(opt_result);
+  std::cout << "vm opt: bytecode " << stats.words_before << " -> "
+            << stats.words_after << " words, dynamic ops " << before << " -> "
+            << after;
+  if (before != 0u) {
+    std::cout << " (" << std::fixed << std::setprecision(1)
+              << (100.0 * static_cast<double>(after) /
+                  static_cast<double>(before))
+              << std::defaultfloat << "%)";
+  }
+  std::cout << "\n";
+  std::cout << "  " << stats.threaded_targets << " targets threaded, "
+            << stats.removed_noops << " noops, " << stats.removed_jumps
+            << " jumps, " << stats.unreachable_instrs
+            << " unreachable instrs removed\n";
+  std::cout << "  " << stats.assign_runs << " assign runs ("
+            << stats.fused_assigns << " assigns), " << stats.branches
+            << " branches, " << stats.wait_edge_loops
+            << " wait-edge loops\n";
+  return true;
+}
+
+// Writes the MSL-derived outputs requested on the command line: the MSL and
+// its manifest sidecar, the host C++ translation, the scheduler VM image and
+// the manifest check.
+bool WriteMslOutputs(const std::string& top_name, const std::string& msl,
+                     const gpga::SchedulerManifest& manifest,
+                     const std::string& msl_out, const std::string& cpp_out,
+                     const std::string& vm_image_out, bool four_state,
+                     bool check_manifest, gpga::Diagnostics* diagnostics) {
+  if (!msl_out.empty()) {
+    if (!WriteFile(msl_out, msl, diagnostics)) {
+      diagnostics->RenderTo(std::cerr);
+      return false;
+    }
+    std::string manifest_error;
+    if (!gpga::WriteSchedulerManifest(
+            gpga::SchedulerManifestPathForMsl(msl_out), manifest,
+            &manifest_error)) {
+      std::cerr << "warning: " << manifest_error << "\n";
+    }
+  }
+  if (!cpp_out.empty()) {
+    std::string cpp;
+    std::string cpp_error;
+    if (!gpga::TranslateMslToCpp(msl, &cpp, &cpp_error)) {
+      std::cerr << "C++ emit failed: " << cpp_error << "\n";
+      return false;
+    }
+    if (!WriteFile(cpp_out, cpp, diagnostics)) {
+      diagnostics->RenderTo(std::cerr);
+      return false;
+    }
+  }
+  if (!vm_image_out.empty()) {
+    if (!manifest.has_vm_layout) {
+      std::cerr << "--emit-vm-image needs a scheduler VM layout (--sched-vm)\n";
+      return false;
+    }
+    gpga::SchedulerVmImageView view =
+        gpga::ViewSchedulerVmLayout(manifest.vm_layout);
+    view.source_bytes = msl.size();
+    view.source_hash = gpga::SchedulerManifestSourceHash(msl);
+    view.four_state = four_state;
+    std::string image_error;
+    if (!gpga::WriteSchedulerVmImage(vm_image_out, view, &image_error)) {
+      std::cerr << "VM image emit failed: " << image_error << "\n";
+      return false;
+    }
+  }
+  if (check_manifest) {
+    std::string report;
+    if (!CheckSchedulerManifest(msl, manifest, &report)) {
+      std::cerr << "manifest check failed for " << top_name << ":\n"
+                << report;
+      return false;
+    }
+    std::cout << "manifest check ok for " << top_name << " ("
+              << manifest.kernels.size() << " kernels)\n";
+  }
+  return true;
+}
+
+bool WriteFlatOutputs(const std::string& flat_text, bool dump_flat,
+                      const std::string& flat_out,
+                      gpga::Diagnostics* diagnostics) {
+  if (dump_flat) {
+    std::cout << flat_text;
+  }
+  if (!flat_out.empty() && !WriteFile(flat_out, flat_text, diagnostics)) {
+    diagnostics->RenderTo(std::cerr);
+    return false;
+  }
+  return true;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Stage times are summed over files, so with --parse-jobs they are CPU time;
+// the wall line is the elapsed time of the whole parse.
+void PrintParseBench(const gpga::ParseStats& stats, double wall_ms) {
+  auto mb_per_s = [](uint64_t bytes, double ms) {
+    return ms > 0.0 ? (static_cast<double>(bytes) / 1e6) / (ms / 1e3) : 0.0;
+  };
+  auto per_s = [](uint64_t count, double ms) {
+    return ms > 0.0 ? static_cast<double>(count) / (ms / 1e3) : 0.0;
+  };
+  const double front_ms =
+      stats.read_ms + stats.preprocess_ms + stats.tokenize_ms + stats.parse_ms;
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  out << "parse-bench: " << stats.files << " files, " << stats.source_bytes
+      << " source bytes, " << stats.preprocessed_bytes
+      << " preprocessed bytes, " << stats.tokens << " tokens, "
+      << stats.identifiers << " distinct identifiers\n";
+  out << "  read        " << stats.read_ms << " ms  "
+      << mb_per_s(stats.source_bytes, stats.read_ms) << " MB/s\n";
+  out << "  preprocess  " << stats.preprocess_ms << " ms  "
+      << mb_per_s(stats.source_bytes, stats.preprocess_ms) << " MB/s\n";
+  out << "  tokenize    " << stats.tokenize_ms << " ms  "
+      << mb_per_s(stats.preprocessed_bytes, stats.tokenize_ms) << " MB/s  "
+      << per_s(stats.tokens, stats.tokenize_ms) << " tokens/s\n";
+  out << "  parse       " << stats.parse_ms << " ms  "
+      << mb_per_s(stats.preprocessed_bytes, stats.parse_ms) << " MB/s  "
+      << per_s(stats.tokens, stats.parse_ms) << " tokens/s\n";
+  out << "  total       " << front_ms << " ms  "
+      << mb_per_s(stats.source_bytes, front_ms) << " MB/s  "
+      << per_s(stats.tokens, front_ms) << " tokens/s\n";
+  out << "  wall        " << wall_ms << " ms  "
+      << mb_per_s(stats.source_bytes, wall_ms) << " MB/s  "
+      << per_s(stats.tokens, wall_ms) << " tokens/s\n";
+  std::cout << out.str();
+}
+
+uint64_t PeakResidentBytes() {
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0u;
+  }
+#if defined(__APPLE__)
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024u;
+#endif
+}
+
+void PrintElabBench(const gpga::Program& program,
+                    const gpga::ElaboratedDesign& design, double parse_ms,
+                    double elaborate_ms) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  out << "elab-bench: " << program.modules.size() << " modules, top '"
+      << design.top.name << "' " << design.top.nets.size() << " nets, "
+      << design.top.assigns.size() << " assigns, "
+      << design.top.always_blocks.size() << " always blocks\n";
+  out << "  parse       " << parse_ms << " ms\n";
+  out << "  elaborate   " << elaborate_ms << " ms\n";
+  out << "  instances   " << design.stats.instances << " ("
+      << design.stats.bodies_built << " bodies built, "
+      << design.stats.bodies_reused << " reused, "
+      << design.stats.bodies_flattened << " flattened in place)\n";
+  out << "  peak RSS    "
+      << (static_cast<double>(PeakResidentBytes()) / (1024.0 * 1024.0))
+      << " MB\n";
+  std::cout << out.str();
+}
+
+// One line per fallback category and per reason, meant to be summed over a
+// corpus (scripts/run_vm_fallback_report.sh).
+bool PrintVmFallbackReport(const gpga::Module& top, bool four_state) {
+  gpga::SchedulerVmLayout layout;
+  gpga::SchedulerVmFallbackDiagnostics info;
+  std::string error;
+  std::ostringstream out;
+  out << "vm-fallback-report: top '" << top.name << "' "
+      << (four_state ? "4state" : "2state");
+  if (!gpga::BuildSchedulerVmLayoutFromModuleWithDiag(top, &layout, &error,
+                                                      four_state, &info)) {
+    out << " layout failed: " << error << "\n";
+    std::cout << out.str();
+    return false;
+  }
+  out << "\n";
+  size_t delay_count = 0u;
+  for (const auto& entry : layout.delay_assign_entries) {
+    if ((entry.flags & gpga::kSchedulerVmDelayAssignFlagFallback) != 0u) {
+      delay_count += 1u;
+    }
+  }
+  size_t force_count = 0u;
+  for (const auto& entry : layout.force_entries) {
+    if ((entry.flags & gpga::kSchedulerVmForceFlagFallback) != 0u) {
+      force_count += 1u;
+    }
+  }
+  size_t release_count = 0u;
+  for (const auto& entry : layout.release_entries) {
+    if ((entry.flags & gpga::kSchedulerVmForceFlagFallback) != 0u) {
+      release_count += 1u;
+    }
+  }
+  size_t service_ret_count = 0u;
+  for (const auto& entry : layout.service_ret_entries) {
+    if ((entry.flags & gpga::kSchedulerVmServiceRetAssignFlagFallback) != 0u) {
+      service_ret_count += 1u;
+    }
+  }
+  size_t callgroup_count = 0u;
+  const size_t proc_count =
+      std::min(layout.proc_offsets.size(), layout.proc_lengths.size());
+  for (size_t pid = 0; pid < proc_count; ++pid) {
+    if (layout.proc_lengths[pid] == 0u) {
+      continue;
+    }
+    const size_t offset = layout.proc_offsets[pid];
+    if (offset >= layout.bytecode.size() ||
+        gpga::DecodeSchedulerVmOp(layout.bytecode[offset]) ==
+            gpga::SchedulerVmOp::kCallGroup) {
+      callgroup_count += 1u;
+    }
+  }
+  std::map<std::string, size_t> reasons;
+  for (const auto& item : info.assign_fallbacks) {
+    for (const auto& reason : item.reasons) {
+      reasons["assign:" + reason] += 1u;
+    }
+  }
+  for (const auto& item : info.service_fallbacks) {
+    for (const auto& reason : item.reasons) {
+      reasons["service:" + reason] += 1u;
+    }
+  }
+  out << "  assign " << info.assign_fallbacks.size() << "\n";
+  out << "  delay_assign " << delay_count << "\n";
+  out << "  force " << force_count << "\n";
+  out << "  release " << release_count << "\n";
+  out << "  service " << info.service_fallbacks.size() << "\n";
+  out << "  service_ret " << service_ret_count << "\n";
+  out << "  callgroup " << callgroup_count << "\n";
+  for (const auto& entry : reasons) {
+    out << "  reason " << entry.first << " " << entry.second << "\n";
+  }
+  std::cout << out.str();
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -8998,18 +10343,36 @@ int main(int argc, char** argv) {
 
   std::vector<std::string> input_paths;
   std::string msl_out;
+  std::string cpp_out;
   std::string host_out;
   std::string flat_out;
+  std::string vm_image_out;
+  std::string vm_image_path;
   std::string top_name;
   std::string sdf_path;
   bool dump_flat = false;
   bool enable_4state = false;
   bool sched_vm = false;
+  bool sched_vm_dedup = false;
+  bool sched_vm_opt = false;
+  bool hier_codegen = false;
+  bool prune_xz = false;
+  bool pack_bits = false;
+  bool locality_layout = false;
   bool fallback_diag = false;
+  bool check_manifest = false;
+  bool artifact_cache_enabled = false;
+  bool vm_profile = false;
+  uint64_t vm_profile_max_time = 1000000u;
+  bool parse_bench = false;
+  bool elab_bench = false;
+  bool vm_fallback_report = false;
+  uint32_t parse_jobs = 1u;
   bool auto_discover = false;
   bool strict_1364 = false;
   bool verbose_warnings = false;
   bool run = false;
+  bool run_cpu = false;
   bool run_verbose = false;
   bool run_source_bindings = false;
   uint32_t run_count = 1u;
@@ -9019,6 +10382,7 @@ int main(int argc, char** argv) {
   uint32_t run_dispatch_timeout_ms = 0u;
   std::string vcd_dir;
   uint32_t vcd_steps = 0u;
+  gpga::WaveFormat wave_format = gpga::WaveFormat::kVcd;
   std::vector<std::string> plusargs;
 
   for (int i = 1; i < argc; ++i) {
@@ -9029,6 +10393,12 @@ int main(int argc, char** argv) {
         return 2;
       }
       msl_out = argv[++i];
+    } else if (arg == "--emit-cpp") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      cpp_out = argv[++i];
     } else if (arg == "--emit-flat") {
       if (i + 1 >= argc) {
         PrintUsage(argv[0]);
@@ -9059,8 +10429,57 @@ int main(int argc, char** argv) {
       enable_4state = true;
     } else if (arg == "--sched-vm") {
       sched_vm = true;
+    } else if (arg == "--sched-vm-dedup") {
+      sched_vm_dedup = true;
+    } else if (arg == "--sched-vm-opt") {
+      sched_vm_opt = true;
+    } else if (arg == "--hier-codegen") {
+      hier_codegen = true;
+    } else if (arg == "--prune-xz") {
+      prune_xz = true;
+    } else if (arg == "--pack-bits") {
+      pack_bits = true;
+    } else if (arg == "--locality-layout") {
+      locality_layout = true;
     } else if (arg == "--fallback-diag") {
       fallback_diag = true;
+    } else if (arg == "--check-manifest") {
+      check_manifest = true;
+    } else if (arg == "--artifact-cache") {
+      artifact_cache_enabled = true;
+    } else if (arg == "--emit-vm-image") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      vm_image_out = argv[++i];
+    } else if (arg == "--vm-image") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      vm_image_path = argv[++i];
+    } else if (arg == "--vm-profile") {
+      vm_profile = true;
+    } else if (arg == "--vm-profile-max-time") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      vm_profile = true;
+      vm_profile_max_time = static_cast<uint64_t>(std::stoull(argv[++i]));
+    } else if (arg == "--parse-bench") {
+      parse_bench = true;
+    } else if (arg == "--elab-bench") {
+      elab_bench = true;
+    } else if (arg == "--vm-fallback-report") {
+      vm_fallback_report = true;
+    } else if (arg == "--parse-jobs") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      parse_jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
     } else if (arg == "--auto") {
       auto_discover = true;
     } else if (arg == "--strict-1364") {
@@ -9072,6 +10491,9 @@ int main(int argc, char** argv) {
       return 0;
     } else if (arg == "--run") {
       run = true;
+    } else if (arg == "--run-cpu") {
+      run = true;
+      run_cpu = true;
     } else if (arg == "--run-verbose") {
       run_verbose = true;
     } else if (arg == "--source-bindings") {
@@ -9125,6 +10547,20 @@ int main(int argc, char** argv) {
         return 2;
       }
       vcd_steps = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--wave-format") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 2;
+      }
+      const std::string format = argv[++i];
+      if (format == "vcd") {
+        wave_format = gpga::WaveFormat::kVcd;
+      } else if (format == "gpgawf") {
+        wave_format = gpga::WaveFormat::kGpgawf;
+      } else {
+        PrintUsage(argv[0]);
+        return 2;
+      }
     } else if (!arg.empty() && arg[0] == '+') {
       plusargs.push_back(arg.substr(1));
     } else if (!arg.empty() && arg[0] == '-') {
@@ -9139,6 +10575,14 @@ int main(int argc, char** argv) {
     PrintUsage(argv[0]);
     return 2;
   }
+  // The VM kernels address state through their own slot table, which has
+  // no bitset words or reordered segments.
+  if (sched_vm && pack_bits) {
+    std::cerr << "warning: --pack-bits is ignored with --sched-vm\n";
+  }
+  if (sched_vm && locality_layout) {
+    std::cerr << "warning: --locality-layout is ignored with --sched-vm\n";
+  }
 
   gpga::Diagnostics diagnostics;
   gpga::Program program;
@@ -9207,186 +10651,347 @@ int main(int argc, char** argv) {
     }
   }
 
-  for (const auto& item : parse_queue) {
-    if (item.explicit_input) {
-      size_t before_count = program.modules.size();
-      if (!gpga::ParseVerilogFile(item.path, &program, &diagnostics,
-                                  parse_options)) {
-        diagnostics.RenderTo(std::cerr);
-        return 1;
-      }
-      if (diagnostics.HasErrors()) {
-        diagnostics.RenderTo(std::cerr);
-        return 1;
+  // Codegen artifacts are keyed by the preprocessed sources plus every flag
+  // that changes them. Runs that need the elaborated module (--run,
+  // --emit-host, ...) load it from the cached design image on a hit.
+  const bool needs_msl = !msl_out.empty() || !cpp_out.empty() ||
+                         !vm_image_out.empty() || run || check_manifest;
+  const bool needs_design =
+      run || !host_out.empty() || vm_profile || fallback_diag;
+  gpga::ArtifactCache artifact_cache;
+  std::string artifact_key;
+  std::string artifact_material;
+  gpga::CachedArtifacts cached_artifacts;
+  bool artifact_hit = false;
+  if (artifact_cache_enabled && needs_msl && !parse_bench && !elab_bench &&
+      !vm_fallback_report) {
+    // The version string is "dev" for every build, so the binary's hash
+    // stands in for it: any change to the compiler invalidates the cache.
+    const std::string& build_id = gpga::ArtifactCache::BuildId();
+    std::ostringstream material;
+    material << "metalfpga " << kMetalFpgaVersion << " build " << build_id
+             << "\n"
+             << "manifest " << gpga::kSchedulerManifestVersion << "\n"
+             << "top " << top_name << "\n"
+             << "4state " << enable_4state << " strict " << strict_1364
+             << " sched_vm " << sched_vm << " auto " << auto_discover
+             << " hier " << hier_codegen << " prune_xz " << prune_xz
+             << " pack_bits " << pack_bits << " locality_layout "
+             << locality_layout << "\n";
+    if (const char* case_tables = std::getenv("METALFPGA_CASE_TABLES")) {
+      material << "case_tables " << case_tables << "\n";
+    }
+    if (const char* expr_regs = std::getenv("METALFPGA_VM_EXPR_REGS")) {
+      material << "expr_regs " << expr_regs << "\n";
+    }
+    if (const char* string_pad = std::getenv("METALFPGA_STRING_PAD")) {
+      material << "string_pad " << string_pad << "\n";
+    }
+    if (const char* delay_select =
+            std::getenv("METALFPGA_SPECIFY_DELAY_SELECT")) {
+      material << "specify_delay_select " << delay_select << "\n";
+    }
+    if (const char* negative_setup =
+            std::getenv("METALFPGA_NEGATIVE_SETUP_MODE")) {
+      material << "negative_setup_mode " << negative_setup << "\n";
+    }
+    std::string material_text = material.str();
+    bool keyed = !build_id.empty();
+    for (const auto& item : parse_queue) {
+      if (!keyed) {
+        break;
       }
-      size_t after_count = program.modules.size();
-      for (size_t i = before_count; i < after_count; ++i) {
-        explicit_module_indices.insert(i);
+      gpga::Diagnostics key_diag;
+      material_text += "file " + item.path +
+                       (item.explicit_input ? " explicit\n" : "\n");
+      if (!gpga::AppendPreprocessedVerilog(item.path, &material_text,
+                                           &key_diag) &&
+          item.explicit_input) {
+        keyed = false;
+        break;
       }
-      continue;
     }
-    gpga::Program temp_program;
-    gpga::Diagnostics temp_diag;
-    if (!gpga::ParseVerilogFile(item.path, &temp_program, &temp_diag,
-                                parse_options)) {
-      continue;
+    if (!sdf_path.empty()) {
+      std::ifstream sdf_in(sdf_path, std::ios::binary);
+      std::ostringstream sdf_text;
+      sdf_text << sdf_in.rdbuf();
+      material_text += "sdf " + sdf_path + "\n" + sdf_text.str();
+    }
+    if (keyed) {
+      artifact_key = gpga::ArtifactCache::MakeKey(material_text);
+      artifact_hit =
+          artifact_cache.Load(artifact_key, material_text, &cached_artifacts);
+      artifact_material = std::move(material_text);
+    }
+  }
+  if (artifact_hit && !needs_design) {
+    const gpga::ArtifactStageTimes& saved = cached_artifacts.times;
+    std::cerr << "artifact cache hit " << artifact_key
+              << ": skipped parse (" << saved.parse_ms << " ms), elaborate ("
+              << saved.elaborate_ms << " ms), emit (" << saved.emit_ms
+              << " ms)\n";
+    if (!WriteMslOutputs(cached_artifacts.top_name, cached_artifacts.msl,
+                         cached_artifacts.manifest, msl_out, cpp_out,
+                         vm_image_out, enable_4state, check_manifest,
+                         &diagnostics)) {
+      return 1;
     }
-    if (temp_diag.HasErrors()) {
-      continue;
+    if (msl_out.empty() && cpp_out.empty() && vm_image_out.empty()) {
+      std::cout << "Elaborated top module '" << cached_artifacts.top_name
+                << "'. Use --emit-msl/--emit-host to write stubs.\n";
     }
-    for (auto& module : temp_program.modules) {
-      program.modules.push_back(std::move(module));
+    if (!WriteFlatOutputs(cached_artifacts.flat, dump_flat, flat_out,
+                          &diagnostics)) {
+      return 1;
     }
+    return 0;
   }
 
-  if (auto_discover && !explicit_module_indices.empty()) {
-    std::unordered_map<std::string, std::vector<std::string>> graph;
-    graph.reserve(program.modules.size());
-    for (const auto& module : program.modules) {
-      auto& edges = graph[module.name];
-      for (const auto& instance : module.instances) {
-        edges.push_back(instance.module_name);
-      }
-    }
-    active_module_names.clear();
-    active_module_names.reserve(program.modules.size());
-    have_active_modules = true;
-    std::vector<std::string> stack;
-    for (size_t idx : explicit_module_indices) {
-      if (idx >= program.modules.size()) {
-        continue;
-      }
-      const std::string& name = program.modules[idx].name;
-      if (active_module_names.insert(name).second) {
-        stack.push_back(name);
-      }
-    }
-    while (!stack.empty()) {
-      std::string name = std::move(stack.back());
-      stack.pop_back();
-      auto it = graph.find(name);
-      if (it == graph.end()) {
+  // A hit that still needs the design (--run, --emit-host, ...) loads the
+  // elaborated module from the cached design image instead of running the
+  // frontend again.
+  gpga::ElaboratedDesign design;
+  gpga::DesignImage cached_image;
+  bool design_cached = false;
+  if (artifact_hit) {
+    std::string image_error;
+    design_cached = gpga::DeserializeDesignImage(cached_artifacts.design,
+                                                 &cached_image, &image_error);
+    if (design_cached) {
+      design = std::move(cached_image.design);
+      std::cerr << "artifact cache hit " << artifact_key
+                << ": skipped parse (" << cached_artifacts.times.parse_ms
+                << " ms), elaborate (" << cached_artifacts.times.elaborate_ms
+                << " ms)\n";
+    } else {
+      std::cerr << "warning: artifact cache " << artifact_key << ": "
+                << image_error << "; running the frontend\n";
+    }
+  }
+  double parse_ms = 0.0;
+  double elaborate_ms = 0.0;
+  if (!design_cached) {
+    // Files parse independently (on --parse-jobs workers) and merge here in
+    // queue order, so the Program, the module indices and the diagnostics do
+    // not depend on the job count.
+    const auto parse_start = std::chrono::steady_clock::now();
+    std::vector<std::string> parse_paths;
+    parse_paths.reserve(parse_queue.size());
+    for (const auto& item : parse_queue) {
+      parse_paths.push_back(item.path);
+    }
+    std::vector<gpga::ParsedSourceFile> parsed_files;
+    gpga::ParseVerilogFiles(parse_paths, parse_options, parse_jobs,
+                            &parsed_files);
+    gpga::ParseStats parse_stats;
+    std::unordered_map<std::string, std::string> module_origin;
+    for (size_t file_index = 0; file_index < parsed_files.size();
+         ++file_index) {
+      gpga::ParsedSourceFile& parsed = parsed_files[file_index];
+      parse_stats.Add(parsed.stats);
+      const bool explicit_input = parse_queue[file_index].explicit_input;
+      if (explicit_input) {
+        for (const auto& item : parsed.diagnostics.Items()) {
+          diagnostics.Add(item.severity, item.message, item.location);
+        }
+        if (!parsed.ok || diagnostics.HasErrors()) {
+          diagnostics.RenderTo(std::cerr);
+          return 1;
+        }
+      } else if (!parsed.ok || parsed.diagnostics.HasErrors() ||
+                 (parsed.program.modules.empty() &&
+                  !parse_options.allow_empty)) {
         continue;
       }
-      for (const auto& child : it->second) {
-        if (active_module_names.insert(child).second) {
-          stack.push_back(child);
+      size_t before_count = program.modules.size();
+      for (auto& module : parsed.program.modules) {
+        auto origin = module_origin.emplace(module.name, parsed.path);
+        if (!origin.second && verbose_warnings) {
+          diagnostics.Add(gpga::Severity::kWarning,
+                          "module '" + module.name + "' redefined; using the "
+                          "definition from " + origin.first->second,
+                          gpga::SourceLocation{parsed.path});
         }
+        program.modules.push_back(std::move(module));
       }
-    }
-    for (auto& module : program.modules) {
-      if (active_module_names.count(module.name) == 0) {
-        module.defparams.clear();
+      if (explicit_input) {
+        if (program.modules.empty() && !parse_options.allow_empty) {
+          diagnostics.Add(gpga::Severity::kError, "no modules found in input",
+                          gpga::SourceLocation{parsed.path});
+          diagnostics.RenderTo(std::cerr);
+          return 1;
+        }
+        size_t after_count = program.modules.size();
+        for (size_t i = before_count; i < after_count; ++i) {
+          explicit_module_indices.insert(i);
+        }
       }
     }
-  }
+    parsed_files.clear();
 
-  if (!sdf_path.empty()) {
-    std::vector<SdfTimingCheck> sdf_checks;
-    if (!LoadSdfTimingChecks(sdf_path, &sdf_checks, &diagnostics)) {
-      diagnostics.RenderTo(std::cerr);
-      return 1;
-    }
-    ApplySdfTimingChecks(sdf_path, sdf_checks, &program, &diagnostics);
-    if (diagnostics.HasErrors()) {
-      diagnostics.RenderTo(std::cerr);
-      return 1;
+    parse_ms = MillisecondsSince(parse_start);
+    if (parse_bench) {
+      PrintParseBench(parse_stats, parse_ms);
+      return 0;
     }
-  }
+    const auto elaborate_start = std::chrono::steady_clock::now();
 
-  gpga::ElaboratedDesign design;
-  bool elaborated = false;
-  if (top_name.empty() && auto_discover &&
-      !explicit_module_indices.empty()) {
-    auto is_active = [&](const std::string& name) -> bool {
-      return !have_active_modules || active_module_names.count(name) > 0;
-    };
-    std::unordered_set<std::string> instantiated;
-    for (const auto& module : program.modules) {
-      if (!is_active(module.name)) {
-        continue;
+    if (auto_discover && !explicit_module_indices.empty()) {
+      std::unordered_map<std::string, std::vector<std::string>> graph;
+      graph.reserve(program.modules.size());
+      for (const auto& module : program.modules) {
+        auto& edges = graph[module.name];
+        for (const auto& instance : module.instances) {
+          edges.push_back(instance.module_name);
+        }
       }
-      for (const auto& instance : module.instances) {
-        if (is_active(instance.module_name)) {
-          instantiated.insert(instance.module_name);
+      active_module_names.clear();
+      active_module_names.reserve(program.modules.size());
+      have_active_modules = true;
+      std::vector<std::string> stack;
+      for (size_t idx : explicit_module_indices) {
+        if (idx >= program.modules.size()) {
+          continue;
+        }
+        const std::string& name = program.modules[idx].name;
+        if (active_module_names.insert(name).second) {
+          stack.push_back(name);
         }
       }
-    }
-    std::vector<const gpga::Module*> roots;
-    for (size_t i = 0; i < program.modules.size(); ++i) {
-      if (explicit_module_indices.count(i) == 0) {
-        continue;
+      while (!stack.empty()) {
+        std::string name = std::move(stack.back());
+        stack.pop_back();
+        auto it = graph.find(name);
+        if (it == graph.end()) {
+          continue;
+        }
+        for (const auto& child : it->second) {
+          if (active_module_names.insert(child).second) {
+            stack.push_back(child);
+          }
+        }
       }
-      const auto& module = program.modules[i];
-      if (!is_active(module.name)) {
-        continue;
+      for (auto& module : program.modules) {
+        if (active_module_names.count(module.name) == 0) {
+          module.defparams.clear();
+        }
       }
-      if (instantiated.count(module.name) == 0) {
-        roots.push_back(&module);
+    }
+
+    if (!sdf_path.empty()) {
+      std::vector<SdfTimingCheck> sdf_checks;
+      if (!LoadSdfTimingChecks(sdf_path, &sdf_checks, &diagnostics)) {
+        diagnostics.RenderTo(std::cerr);
+        return 1;
+      }
+      ApplySdfTimingChecks(sdf_path, sdf_checks, &program, &diagnostics);
+      if (diagnostics.HasErrors()) {
+        diagnostics.RenderTo(std::cerr);
+        return 1;
       }
     }
-    if (!roots.empty()) {
-      auto has_initial = [](const gpga::Module& module) -> bool {
-        for (const auto& block : module.always_blocks) {
-          if (block.edge == gpga::EdgeKind::kInitial) {
-            return true;
+
+    bool elaborated = false;
+    if (top_name.empty() && auto_discover &&
+        !explicit_module_indices.empty()) {
+      auto is_active = [&](const std::string& name) -> bool {
+        return !have_active_modules || active_module_names.count(name) > 0;
+      };
+      std::unordered_set<std::string> instantiated;
+      for (const auto& module : program.modules) {
+        if (!is_active(module.name)) {
+          continue;
+        }
+        for (const auto& instance : module.instances) {
+          if (is_active(instance.module_name)) {
+            instantiated.insert(instance.module_name);
           }
         }
-        return false;
-      };
-      auto is_test = [](const std::string& name) -> bool {
-        return name.rfind("test_", 0) == 0;
-      };
-      const gpga::Module* chosen = nullptr;
-      for (const auto* module : roots) {
-        if (has_initial(*module) && is_test(module->name)) {
-          chosen = module;
-          break;
+      }
+      std::vector<const gpga::Module*> roots;
+      for (size_t i = 0; i < program.modules.size(); ++i) {
+        if (explicit_module_indices.count(i) == 0) {
+          continue;
+        }
+        const auto& module = program.modules[i];
+        if (!is_active(module.name)) {
+          continue;
+        }
+        if (instantiated.count(module.name) == 0) {
+          roots.push_back(&module);
         }
       }
-      if (!chosen) {
+      if (!roots.empty()) {
+        auto has_initial = [](const gpga::Module& module) -> bool {
+          for (const auto& block : module.always_blocks) {
+            if (block.edge == gpga::EdgeKind::kInitial) {
+              return true;
+            }
+          }
+          return false;
+        };
+        auto is_test = [](const std::string& name) -> bool {
+          return name.rfind("test_", 0) == 0;
+        };
+        const gpga::Module* chosen = nullptr;
         for (const auto* module : roots) {
-          if (has_initial(*module)) {
+          if (has_initial(*module) && is_test(module->name)) {
             chosen = module;
             break;
           }
         }
-      }
-      if (!chosen) {
-        for (const auto* module : roots) {
-          if (is_test(module->name)) {
-            chosen = module;
-            break;
+        if (!chosen) {
+          for (const auto* module : roots) {
+            if (has_initial(*module)) {
+              chosen = module;
+              break;
+            }
           }
         }
+        if (!chosen) {
+          for (const auto* module : roots) {
+            if (is_test(module->name)) {
+              chosen = module;
+              break;
+            }
+          }
+        }
+        if (!chosen) {
+          chosen = roots.front();
+        }
+        if (roots.size() > 1) {
+          diagnostics.Add(gpga::Severity::kWarning,
+                          "multiple top-level modules found; using '" +
+                              chosen->name +
+                              "' (use --top <name> to override)");
+        }
+        top_name = chosen->name;
       }
-      if (!chosen) {
-        chosen = roots.front();
-      }
-      if (roots.size() > 1) {
-        diagnostics.Add(gpga::Severity::kWarning,
-                        "multiple top-level modules found; using '" +
-                            chosen->name +
-                            "' (use --top <name> to override)");
-      }
-      top_name = chosen->name;
     }
-  }
-  if (!top_name.empty()) {
-    elaborated =
-        gpga::Elaborate(program, top_name, &design, &diagnostics,
-                        enable_4state, verbose_warnings);
-  } else {
-    elaborated =
-        gpga::Elaborate(program, &design, &diagnostics, enable_4state,
-                        verbose_warnings);
-  }
-  if (!elaborated || diagnostics.HasErrors()) {
-    diagnostics.RenderTo(std::cerr);
-    return 1;
-  }
-  if (!diagnostics.Items().empty()) {
-    diagnostics.RenderTo(std::cerr);
+    if (!top_name.empty()) {
+      elaborated =
+          gpga::Elaborate(program, top_name, &design, &diagnostics,
+                          enable_4state, verbose_warnings);
+    } else {
+      elaborated =
+          gpga::Elaborate(program, &design, &diagnostics, enable_4state,
+                          verbose_warnings);
+    }
+    if (!elaborated || diagnostics.HasErrors()) {
+      diagnostics.RenderTo(std::cerr);
+      return 1;
+    }
+    if (!diagnostics.Items().empty()) {
+      diagnostics.RenderTo(std::cerr);
+    }
+    elaborate_ms = MillisecondsSince(elaborate_start);
+    if (elab_bench) {
+      PrintElabBench(program, design, parse_ms, elaborate_ms);
+      return 0;
+    }
+    if (vm_fallback_report) {
+      return PrintVmFallbackReport(design.top, enable_4state) ? 0 : 1;
+    }
   }
 
   if (fallback_diag) {
@@ -9432,6 +11037,7 @@ int main(int argc, char** argv) {
              << "\n";
       report << "  expr_imm_words: " << diag_layout.expr_table.imm_words.size()
              << "\n";
+      report << "  expr_regs: " << diag_layout.expr_table.reg_count << "\n";
       report << "  edge_item_expr_offsets: "
              << diag_layout.edge_item_expr_offsets.size() << "\n";
       report << "  edge_star_expr_offsets: "
@@ -9674,17 +11280,88 @@ int main(int argc, char** argv) {
   }
 
   std::string msl;
-  if (!msl_out.empty() || run) {
-    gpga::MslEmitOptions msl_options;
-    msl_options.four_state = enable_4state;
-    msl_options.sched_vm = sched_vm;
-    msl = gpga::EmitMSLStub(design.top, msl_options);
-    if (!msl_out.empty()) {
-      if (!WriteFile(msl_out, msl, &diagnostics)) {
-        diagnostics.RenderTo(std::cerr);
-        return 1;
+  gpga::SchedulerManifest manifest;
+  // Run inputs that come with the design image: from the cache on a hit,
+  // computed for the store on a miss.
+  const std::unordered_set<std::string>* proven_two_state = nullptr;
+  const gpga::PackedStatePlan* packed_plan = nullptr;
+  if (design_cached) {
+    proven_two_state = &cached_image.two_state_nets;
+    packed_plan = &cached_image.packed;
+  }
+  if (needs_msl) {
+    if (artifact_hit) {
+      std::cerr << "artifact cache hit " << artifact_key << ": skipped emit ("
+                << cached_artifacts.times.emit_ms << " ms)\n";
+      msl = std::move(cached_artifacts.msl);
+      manifest = std::move(cached_artifacts.manifest);
+    } else {
+      const auto emit_start = std::chrono::steady_clock::now();
+      gpga::MslEmitOptions msl_options;
+      msl_options.four_state = enable_4state;
+      msl_options.sched_vm = sched_vm;
+      msl_options.pack_bits = pack_bits;
+      msl_options.locality_layout = locality_layout;
+      std::string hier_fallback;
+      if (hier_codegen) {
+        msl_options.instance_groups = &design.instance_groups;
+        msl_options.hier_fallback = &hier_fallback;
+      }
+      std::unordered_set<std::string> two_state_nets;
+      if (prune_xz && enable_4state) {
+        two_state_nets = gpga::FindTwoStateNets(design.top);
+        msl_options.two_state_nets = &two_state_nets;
+      }
+      msl = gpga::EmitMSLStub(design.top, msl_options, &manifest);
+      if (!hier_fallback.empty()) {
+        std::cerr << "warning: --hier-codegen fell back to flat codegen: "
+                  << hier_fallback << "\n";
+      }
+      if (!artifact_key.empty()) {
+        gpga::CachedArtifacts artifacts;
+        artifacts.top_name = design.top.name;
+        artifacts.msl = msl;
+        artifacts.manifest = manifest;
+        std::ostringstream flat;
+        DumpFlat(design, flat);
+        artifacts.flat = flat.str();
+        cached_image.two_state_nets = std::move(two_state_nets);
+        cached_image.packed = BuildRunPackedStatePlan(
+            design.top, manifest.sched, enable_4state,
+            cached_image.two_state_nets);
+        gpga::SerializeDesignImage(design, cached_image.two_state_nets,
+                                   cached_image.packed, &artifacts.design);
+        proven_two_state = &cached_image.two_state_nets;
+        packed_plan = &cached_image.packed;
+        artifacts.times.parse_ms = parse_ms;
+        artifacts.times.elaborate_ms = elaborate_ms;
+        artifacts.times.emit_ms = MillisecondsSince(emit_start);
+        std::string cache_error;
+        if (artifact_cache.Store(artifact_key, artifact_material, artifacts,
+                                 &cache_error)) {
+          std::cerr << "artifact cache miss " << artifact_key
+                    << ": stored (parse " << parse_ms << " ms, elaborate "
+                    << elaborate_ms << " ms, emit " << artifacts.times.emit_ms
+                    << " ms)\n";
+        } else {
+          std::cerr << "warning: " << cache_error << "\n";
+        }
       }
     }
+    if (!WriteMslOutputs(design.top.name, msl, manifest, msl_out, cpp_out,
+                         vm_image_out, enable_4state, check_manifest,
+                         &diagnostics)) {
+      return 1;
+    }
+  }
+
+  if (vm_profile) {
+    std::string error;
+    if (!ProfileSchedulerVm(design.top, enable_4state, run_count,
+                            vm_profile_max_time, sched_vm_opt, &error)) {
+      std::cerr << "vm profile failed: " << error << "\n";
+      return 1;
+    }
   }
 
   if (!host_out.empty()) {
@@ -9697,32 +11374,37 @@ int main(int argc, char** argv) {
 
   if (run) {
     std::string error;
-    if (!RunMetal(design.top, msl, design.flat_to_hier, enable_4state,
+    const gpga::RuntimeBackend backend =
+        run_cpu ? gpga::RuntimeBackend::kCpu : gpga::RuntimeBackend::kMetal;
+    gpga::SchedulerVmImage vm_image;
+    if (!vm_image_path.empty() && !vm_image.Load(vm_image_path, &error)) {
+      std::cerr << "Run failed: " << error << "\n";
+      return 1;
+    }
+    if (!RunMetal(design.top, msl, &manifest,
+                  vm_image.loaded() ? &vm_image.view() : nullptr, backend,
+                  design.flat_to_hier, proven_two_state, packed_plan,
+                  enable_4state,
                   run_count,
                   run_service_capacity, run_max_steps, run_max_proc_steps,
                   run_dispatch_timeout_ms, run_verbose, run_source_bindings,
-                  vcd_dir, vcd_steps, plusargs, &error)) {
+                  sched_vm_dedup, sched_vm_opt,
+                  vcd_dir, vcd_steps, wave_format, plusargs, &error)) {
       std::cerr << "Run failed: " << error << "\n";
       return 1;
     }
   }
 
-  if (msl_out.empty() && host_out.empty() && !run) {
+  if (msl_out.empty() && cpp_out.empty() && host_out.empty() && !run &&
+      !vm_profile && vm_image_out.empty()) {
     std::cout << "Elaborated top module '" << design.top.name
               << "'. Use --emit-msl/--emit-host to write stubs.\n";
   }
   if (dump_flat || !flat_out.empty()) {
     std::ostringstream os;
     DumpFlat(design, os);
-    const std::string flat_text = os.str();
-    if (dump_flat) {
-      std::cout << flat_text;
-    }
-    if (!flat_out.empty()) {
-      if (!WriteFile(flat_out, flat_text, &diagnostics)) {
-        diagnostics.RenderTo(std::cerr);
-        return 1;
-      }
+    if (!WriteFlatOutputs(os.str(), dump_flat, flat_out, &diagnostics)) {
+      return 1;
     }
   }
 
@@ -0,0 +1,188 @@
+#include "runtime/artifact_cache.hh"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+#include "utils/msl_naming.hh"
+
+namespace gpga {
+
+namespace {
+
+bool ReadFileBytes(const std::filesystem::path& path, std::string* out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::ostringstream buffer;
+  buffer << in.rdbuf();
+  *out = buffer.str();
+  return static_cast<bool>(in) || in.eof();
+}
+
+// Writes under a per-process name and renames into place so concurrent runs
+// sharing the cache never observe a partial file.
+bool WriteFileAtomic(const std::filesystem::path& path,
+                     const std::string& bytes, std::string* error) {
+  const std::filesystem::path tmp_path =
+      path.string() + "." +
+      std::to_string(static_cast<unsigned long>(getpid())) + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!out) {
+      if (error) {
+        *error = "failed to write " + tmp_path.string();
+      }
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    if (error) {
+      *error = "failed to install " + path.string();
+    }
+    return false;
+  }
+  return true;
+}
+
+std::filesystem::path ExecutablePath() {
+#if defined(__APPLE__)
+  uint32_t size = 0;
+  _NSGetExecutablePath(nullptr, &size);
+  std::string buffer(size, '\0');
+  if (_NSGetExecutablePath(buffer.data(), &size) != 0) {
+    return {};
+  }
+  buffer.resize(std::char_traits<char>::length(buffer.c_str()));
+  return std::filesystem::path(buffer);
+#else
+  std::error_code ec;
+  std::filesystem::path path =
+      std::filesystem::read_symlink("/proc/self/exe", ec);
+  return ec ? std::filesystem::path() : path;
+#endif
+}
+
+}  // namespace
+
+ArtifactCache::ArtifactCache() {
+  const char* override_dir = std::getenv("METALFPGA_ARTIFACT_CACHE");
+  if (override_dir && *override_dir) {
+    dir_ = override_dir;
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::path base = std::filesystem::temp_directory_path(ec);
+  if (ec) {
+    base = std::filesystem::current_path();
+  }
+  dir_ = (base / "metalfpga_artifacts").string();
+}
+
+std::string ArtifactCache::MakeKey(const std::string& material) {
+  return Hex64(Fnv1aHash64(material));
+}
+
+const std::string& ArtifactCache::BuildId() {
+  static const std::string build_id = [] {
+    const std::filesystem::path exe = ExecutablePath();
+    std::string bytes;
+    if (exe.empty() || !ReadFileBytes(exe, &bytes) || bytes.empty()) {
+      return std::string();
+    }
+    return Hex64(Fnv1aHash64(bytes));
+  }();
+  return build_id;
+}
+
+bool ArtifactCache::Load(const std::string& key, const std::string& material,
+                         CachedArtifacts* out) const {
+  if (!out) {
+    return false;
+  }
+  const std::filesystem::path base = std::filesystem::path(dir_) / key;
+  std::string meta;
+  std::string stored_material;
+  if (!ReadFileBytes(base.string() + ".meta", &meta) ||
+      !ReadFileBytes(base.string() + ".key", &stored_material) ||
+      stored_material != material) {
+    return false;
+  }
+  CachedArtifacts loaded;
+  std::istringstream meta_in(meta);
+  std::string field;
+  while (meta_in >> field) {
+    if (field == "top") {
+      meta_in >> loaded.top_name;
+    } else if (field == "parse_ms") {
+      meta_in >> loaded.times.parse_ms;
+    } else if (field == "elaborate_ms") {
+      meta_in >> loaded.times.elaborate_ms;
+    } else if (field == "emit_ms") {
+      meta_in >> loaded.times.emit_ms;
+    } else {
+      std::string ignored;
+      std::getline(meta_in, ignored);
+    }
+  }
+  std::string manifest_bytes;
+  std::string error;
+  if (loaded.top_name.empty() ||
+      !ReadFileBytes(base.string() + ".msl", &loaded.msl) ||
+      !ReadFileBytes(base.string() + ".flat", &loaded.flat) ||
+      !ReadFileBytes(base.string() + ".design", &loaded.design) ||
+      !ReadFileBytes(base.string() + ".gpgamf", &manifest_bytes) ||
+      !DeserializeSchedulerManifest(manifest_bytes.data(),
+                                    manifest_bytes.size(), &loaded.manifest,
+                                    &error) ||
+      !SchedulerManifestMatchesSource(loaded.manifest, loaded.msl)) {
+    return false;
+  }
+  *out = std::move(loaded);
+  return true;
+}
+
+bool ArtifactCache::Store(const std::string& key, const std::string& material,
+                          const CachedArtifacts& artifacts,
+                          std::string* error) const {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec) {
+    if (error) {
+      *error = "failed to create artifact cache dir " + dir_ + ": " +
+               ec.message();
+    }
+    return false;
+  }
+  std::string manifest_bytes;
+  if (!SerializeSchedulerManifest(artifacts.manifest, &manifest_bytes,
+                                  error)) {
+    return false;
+  }
+  std::ostringstream meta;
+  meta << "top " << artifacts.top_name << "\n"
+       << "parse_ms " << artifacts.times.parse_ms << "\n"
+       << "elaborate_ms " << artifacts.times.elaborate_ms << "\n"
+       << "emit_ms " << artifacts.times.emit_ms << "\n";
+  const std::string base = (std::filesystem::path(dir_) / key).string();
+  return WriteFileAtomic(base + ".msl", artifacts.msl, error) &&
+         WriteFileAtomic(base + ".gpgamf", manifest_bytes, error) &&
+         WriteFileAtomic(base + ".flat", artifacts.flat, error) &&
+         WriteFileAtomic(base + ".design", artifacts.design, error) &&
+         WriteFileAtomic(base + ".key", material, error) &&
+         WriteFileAtomic(base + ".meta", meta.str(), error);
+}
+
+}  // namespace gpga
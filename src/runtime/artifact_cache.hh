@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+#include "runtime/sched_manifest.hh"
+
+namespace gpga {
+
+// Wall time of the front-end stages that produced a cache entry, replayed on
+// a hit to report what was skipped.
+struct ArtifactStageTimes {
+  double parse_ms = 0.0;
+  double elaborate_ms = 0.0;
+  double emit_ms = 0.0;
+};
+
+// Everything codegen produces for one (sources, top, flags) combination: the
+// MSL, its scheduler manifest (constants, kernel bindings, VM layout), the
+// flattened design dump and the design image (SerializeDesignImage: the
+// elaborated module, flat_to_hier and packed state plan) that lets --run skip
+// the frontend.
+struct CachedArtifacts {
+  std::string top_name;
+  std::string msl;
+  SchedulerManifest manifest;
+  std::string flat;
+  std::string design;
+  ArtifactStageTimes times;
+};
+
+// On-disk cache of CachedArtifacts keyed by a hash of the inputs. Entries are
+// <key>.msl, <key>.gpgamf, <key>.flat, <key>.design and <key>.key (the full
+// key material, compared on load so a hash collision is a miss) plus a
+// <key>.meta file that is written last, so readers never see a half-written
+// entry.
+//
+// Environment:
+//   METALFPGA_ARTIFACT_CACHE  cache directory (default: <tmp>/metalfpga_artifacts)
+class ArtifactCache {
+ public:
+  ArtifactCache();
+
+  const std::string& dir() const { return dir_; }
+
+  // Returns false on a miss (or an unreadable / stale entry, or one stored
+  // for different key material).
+  bool Load(const std::string& key, const std::string& material,
+            CachedArtifacts* out) const;
+  bool Store(const std::string& key, const std::string& material,
+             const CachedArtifacts& artifacts, std::string* error) const;
+
+  // Hex digest of the key material; callers append every input that can
+  // change the artifacts, starting with BuildId().
+  static std::string MakeKey(const std::string& material);
+
+  // Hash of the running metalfpga binary, so a rebuild never reuses entries
+  // from an older compiler. Empty when the executable cannot be read.
+  static const std::string& BuildId();
+
+ private:
+  std::string dir_;
+};
+
+}  // namespace gpga
@@ -0,0 +1,558 @@
+#include "runtime/cpu_runtime.hh"
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "codegen/cpp_codegen.hh"
+#include "runtime/sched_manifest.hh"
+#include "utils/msl_naming.hh"
+
+namespace gpga {
+
+namespace {
+
+using CpuKernelEntry = void (*)(void* const* buffers, uint32_t gid_begin,
+                                uint32_t gid_end);
+
+constexpr size_t kCpuBufferAlignment = 64u;
+// Below this many gids per worker a dispatch runs inline on the caller.
+constexpr uint32_t kCpuMinGidsPerChunk = 64u;
+
+std::string EnvString(const char* key) {
+  const char* value = std::getenv(key);
+  return value ? std::string(value) : std::string();
+}
+
+std::string ShellQuote(const std::string& value) {
+  std::string out = "'";
+  for (char c : value) {
+    if (c == '\'') {
+      out += "'\\''";
+    } else {
+      out += c;
+    }
+  }
+  out += "'";
+  return out;
+}
+
+std::string ReadTextFile(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  std::ostringstream oss;
+  oss << file.rdbuf();
+  return oss.str();
+}
+
+// Headers pulled in with #include "..." (the gpga_*.h runtime headers), plus
+// the ones they include on the CPU path.
+std::vector<std::string> IncludedHeaders(const std::string& source) {
+  std::vector<std::string> out = {"gpga_cpu.h"};
+  const std::string token = "#include \"";
+  size_t pos = 0;
+  while ((pos = source.find(token, pos)) != std::string::npos) {
+    size_t start = pos + token.size();
+    size_t end = source.find('"', start);
+    if (end == std::string::npos) {
+      break;
+    }
+    std::string name = source.substr(start, end - start);
+    if (std::find(out.begin(), out.end(), name) == out.end()) {
+      out.push_back(name);
+    }
+    pos = end;
+  }
+  return out;
+}
+
+// Per-process name next to `path`: each run writes there and renames into
+// place, so concurrent runs sharing the cache never see a partial file.
+std::filesystem::path ProcessTempPath(const std::filesystem::path& path) {
+  return path.string() + "." +
+         std::to_string(static_cast<unsigned long>(getpid())) + ".tmp";
+}
+
+std::filesystem::path CpuCacheDir() {
+  std::string override_dir = EnvString("METALFPGA_CPU_CACHE");
+  if (!override_dir.empty()) {
+    return std::filesystem::path(override_dir);
+  }
+  std::error_code ec;
+  std::filesystem::path base = std::filesystem::temp_directory_path(ec);
+  if (ec) {
+    base = std::filesystem::current_path();
+  }
+  return base / "metalfpga_cpu";
+}
+
+// Fixed-size pool; Run() hands out [begin, end) gid chunks through an atomic
+// cursor and returns once every chunk has executed.
+class CpuWorkerPool {
+ public:
+  explicit CpuWorkerPool(uint32_t workers) {
+    for (uint32_t i = 0; i < workers; ++i) {
+      threads_.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+
+  ~CpuWorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Run(CpuKernelEntry entry, void* const* buffers, uint32_t grid_size,
+           uint32_t chunk_count) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entry_ = entry;
+      buffers_ = buffers;
+      grid_size_ = grid_size;
+      chunk_count_ = chunk_count;
+      next_chunk_.store(0u);
+      pending_ = chunk_count;
+      ++generation_;
+    }
+    wake_.notify_all();
+    RunChunks();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0u; });
+  }
+
+ private:
+  void WorkerLoop() {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+      RunChunks();
+    }
+  }
+
+  void RunChunks() {
+    uint32_t finished = 0;
+    while (true) {
+      uint32_t chunk = next_chunk_.fetch_add(1u);
+      if (chunk >= chunk_count_) {
+        break;
+      }
+      uint64_t begin =
+          (static_cast<uint64_t>(grid_size_) * chunk) / chunk_count_;
+      uint64_t end =
+          (static_cast<uint64_t>(grid_size_) * (chunk + 1u)) / chunk_count_;
+      entry_(buffers_, static_cast<uint32_t>(begin),
+             static_cast<uint32_t>(end));
+      ++finished;
+    }
+    if (finished == 0u) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ -= finished;
+    if (pending_ == 0u) {
+      done_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool stop_ = false;
+  uint64_t generation_ = 0;
+  CpuKernelEntry entry_ = nullptr;
+  void* const* buffers_ = nullptr;
+  uint32_t grid_size_ = 0;
+  uint32_t chunk_count_ = 0;
+  std::atomic<uint32_t> next_chunk_{0u};
+  uint32_t pending_ = 0;
+};
+
+}  // namespace
+
+struct CpuRuntime::Impl {
+  void* library = nullptr;
+  std::string msl_source;
+  std::vector<KernelBindingTable> bindings;
+  std::unique_ptr<CpuWorkerPool> pool;
+  uint32_t thread_count = 1u;
+
+  ~Impl() {
+    pool.reset();
+    if (library) {
+      dlclose(library);
+    }
+  }
+
+  bool Run(const MetalKernel& kernel,
+           const std::vector<MetalBufferBinding>& bindings,
+           uint32_t grid_size, std::string* error) {
+    auto entry = reinterpret_cast<CpuKernelEntry>(kernel.host_entry_);
+    if (!entry) {
+      if (error) {
+        *error = "CPU kernel not resolved: " + kernel.Name();
+      }
+      return false;
+    }
+    std::vector<void*> slots(kernel.MaxBufferBindings(), nullptr);
+    for (const auto& binding : bindings) {
+      if (!binding.buffer) {
+        continue;
+      }
+      if (binding.index >= slots.size()) {
+        slots.resize(binding.index + 1u, nullptr);
+      }
+      slots[binding.index] =
+          static_cast<uint8_t*>(binding.buffer->contents()) + binding.offset;
+    }
+    if (grid_size == 0u) {
+      return true;
+    }
+    uint32_t chunks =
+        std::min<uint32_t>(thread_count,
+                           (grid_size + kCpuMinGidsPerChunk - 1u) /
+                               kCpuMinGidsPerChunk);
+    if (chunks <= 1u || !pool) {
+      entry(slots.data(), 0u, grid_size);
+      return true;
+    }
+    pool->Run(entry, slots.data(), grid_size, chunks);
+    return true;
+  }
+};
+
+CpuRuntime::CpuRuntime() : impl_(std::make_unique<Impl>()) {
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string override_threads = EnvString("METALFPGA_CPU_THREADS");
+  if (!override_threads.empty()) {
+    threads = static_cast<uint32_t>(
+        std::max(1ul, std::strtoul(override_threads.c_str(), nullptr, 10)));
+  }
+  impl_->thread_count = threads;
+  if (threads > 1u) {
+    // The dispatching thread runs chunks too.
+    impl_->pool = std::make_unique<CpuWorkerPool>(threads - 1u);
+  }
+}
+
+CpuRuntime::~CpuRuntime() = default;
+
+bool CpuRuntime::CompileSource(const std::string& source,
+                               const std::vector<std::string>& include_paths,
+                               std::string* error) {
+  std::string cpp;
+  if (!TranslateMslToCpp(source, &cpp, error)) {
+    return false;
+  }
+  std::string compiler = EnvString("METALFPGA_CPU_CXX");
+  if (compiler.empty()) {
+    compiler = EnvString("CXX");
+  }
+  if (compiler.empty()) {
+    compiler = "c++";
+  }
+  std::string flags = EnvString("METALFPGA_CPU_CXXFLAGS");
+  if (flags.empty()) {
+    flags = "-O2";
+  }
+  std::string command = compiler + " -std=c++17 " + flags +
+                        " -fPIC -shared -Wno-unknown-pragmas";
+  for (const auto& path : include_paths) {
+    std::error_code ec;
+    std::filesystem::path abs = std::filesystem::absolute(path, ec);
+    command += " -I" + ShellQuote(ec ? path : abs.string());
+  }
+
+  // Reuse the shared object when source, headers and command line are
+  // unchanged.
+  std::string key_text = command + "\n" + cpp;
+  for (const auto& header : IncludedHeaders(cpp)) {
+    for (const auto& path : include_paths) {
+      std::filesystem::path candidate = std::filesystem::path(path) / header;
+      if (std::filesystem::exists(candidate)) {
+        key_text += ReadTextFile(candidate);
+        break;
+      }
+    }
+  }
+  const std::string key = Hex64(Fnv1aHash64(key_text));
+  const std::filesystem::path dir = CpuCacheDir();
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    if (error) {
+      *error = "failed to create CPU cache dir " + dir.string() + ": " +
+               ec.message();
+    }
+    return false;
+  }
+  const std::filesystem::path cpp_path = dir / (key + ".cc");
+  const std::filesystem::path so_path = dir / (key + ".so");
+  const std::filesystem::path log_path = dir / (key + ".log");
+  if (!std::filesystem::exists(so_path)) {
+    // Every run with this key writes the same .cc, so the compiler can read
+    // it under its final name once it is renamed into place; the log and
+    // the object stay per-process until they are complete.
+    const std::filesystem::path cpp_tmp = ProcessTempPath(cpp_path);
+    const std::filesystem::path so_tmp = ProcessTempPath(so_path);
+    const std::filesystem::path log_tmp = ProcessTempPath(log_path);
+    {
+      std::ofstream out(cpp_tmp, std::ios::binary);
+      out << cpp;
+      if (!out) {
+        if (error) {
+          *error = "failed to write " + cpp_tmp.string();
+        }
+        return false;
+      }
+    }
+    std::filesystem::rename(cpp_tmp, cpp_path, ec);
+    if (ec) {
+      std::filesystem::remove(cpp_tmp, ec);
+      if (error) {
+        *error = "failed to install " + cpp_path.string();
+      }
+      return false;
+    }
+    std::string full = command + " " + ShellQuote(cpp_path.string()) +
+                       " -o " + ShellQuote(so_tmp.string()) + " > " +
+                       ShellQuote(log_tmp.string()) + " 2>&1";
+    const bool compiled = std::system(full.c_str()) == 0;
+    const std::string log = ReadTextFile(log_tmp);
+    std::filesystem::rename(log_tmp, log_path, ec);
+    if (ec) {
+      std::filesystem::remove(log_tmp, ec);
+    }
+    if (!compiled) {
+      std::filesystem::remove(so_tmp, ec);
+      if (error) {
+        *error = "host compile failed (" + cpp_path.string() + "):\n" + log;
+      }
+      return false;
+    }
+    std::filesystem::rename(so_tmp, so_path, ec);
+    if (ec) {
+      std::filesystem::remove(so_tmp, ec);
+      if (error) {
+        *error = "failed to install " + so_path.string() + ": " + ec.message();
+      }
+      return false;
+    }
+  }
+
+  void* library = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    if (error) {
+      const char* reason = dlerror();
+      *error = "dlopen failed for " + so_path.string() + ": " +
+               (reason ? reason : "unknown error");
+    }
+    return false;
+  }
+  if (impl_->library) {
+    dlclose(impl_->library);
+  }
+  impl_->library = library;
+  impl_->msl_source = source;
+  impl_->bindings.clear();
+  ScanKernelBindingTables(source, &impl_->bindings);
+  return true;
+}
+
+bool CpuRuntime::GetLastSource(std::string* out) const {
+  if (!out || impl_->msl_source.empty()) {
+    return false;
+  }
+  *out = impl_->msl_source;
+  return true;
+}
+
+bool CpuRuntime::CreateKernel(const std::string& name, MetalKernel* kernel,
+                              std::string* error) {
+  if (!kernel) {
+    if (error) {
+      *error = "kernel output pointer is null";
+    }
+    return false;
+  }
+  if (!impl_->library) {
+    if (error) {
+      *error = "CPU runtime has no compiled library";
+    }
+    return false;
+  }
+  const std::string symbol = name + kCpuKernelEntrySuffix;
+  void* entry = dlsym(impl_->library, symbol.c_str());
+  if (!entry) {
+    if (error) {
+      *error = "CPU kernel entry not found: " + symbol;
+    }
+    return false;
+  }
+  const KernelBindingTable* table =
+      FindKernelBindingTable(impl_->bindings, name);
+  if (!table) {
+    if (error) {
+      *error = "no buffer bindings found for kernel " + name;
+    }
+    return false;
+  }
+  *kernel = MetalKernel{};
+  kernel->name_ = name;
+  kernel->host_entry_ = entry;
+  uint32_t max_index = 0u;
+  for (const auto& buffer : table->buffers) {
+    kernel->buffer_indices_[buffer.first] = buffer.second;
+    max_index = std::max(max_index, buffer.second + 1u);
+  }
+  kernel->max_buffer_bindings_ = max_index;
+  kernel->thread_execution_width_ = 1u;
+  kernel->max_threads_per_threadgroup_ = 1u;
+  kernel->required_threads_per_threadgroup_ = 0u;
+  return true;
+}
+
+MetalBuffer CpuRuntime::CreateBuffer(size_t length, const void* initial_data) {
+  MetalBuffer buffer;
+  size_t padded = std::max<size_t>(length, 1u);
+  padded = (padded + kCpuBufferAlignment - 1u) & ~(kCpuBufferAlignment - 1u);
+  void* storage = std::aligned_alloc(kCpuBufferAlignment, padded);
+  if (!storage) {
+    return buffer;
+  }
+  std::memset(storage, 0, padded);
+  if (initial_data && length > 0u) {
+    std::memcpy(storage, initial_data, length);
+  }
+  buffer.contents_ = storage;
+  buffer.length_ = length;
+  return buffer;
+}
+
+void CpuRuntime::ReleaseBuffer(MetalBuffer* buffer) {
+  if (!buffer) {
+    return;
+  }
+  std::free(buffer->contents_);
+  buffer->contents_ = nullptr;
+  buffer->length_ = 0;
+}
+
+bool CpuRuntime::EncodeArgumentBuffer(
+    const std::vector<MetalBufferBinding>& bindings, MetalBuffer* out,
+    std::string* error) {
+  if (!out) {
+    if (error) {
+      *error = "argument buffer output is null";
+    }
+    return false;
+  }
+  uint32_t slot_count = 0u;
+  for (const auto& binding : bindings) {
+    slot_count = std::max(slot_count, binding.index + 1u);
+  }
+  MetalBuffer buffer = CreateBuffer(sizeof(void*) * slot_count, nullptr);
+  if (!buffer.contents()) {
+    if (error) {
+      *error = "Failed to allocate CPU argument buffer";
+    }
+    return false;
+  }
+  auto* slots = static_cast<void**>(buffer.contents());
+  for (const auto& binding : bindings) {
+    if (!binding.buffer || !binding.buffer->contents()) {
+      continue;
+    }
+    if (binding.offset >= binding.buffer->length()) {
+      if (error) {
+        *error = "CPU argument buffer binding offset out of range (offset=" +
+                 std::to_string(binding.offset) + ", length=" +
+                 std::to_string(binding.buffer->length()) + ")";
+      }
+      return false;
+    }
+    slots[binding.index] =
+        static_cast<uint8_t*>(binding.buffer->contents()) + binding.offset;
+  }
+  *out = std::move(buffer);
+  return true;
+}
+
+bool CpuRuntime::Dispatch(const MetalKernel& kernel,
+                          const std::vector<MetalBufferBinding>& bindings,
+                          uint32_t grid_size, std::string* error) {
+  return impl_->Run(kernel, bindings, grid_size, error);
+}
+
+bool CpuRuntime::DispatchIndirectThreads(
+    const MetalKernel& kernel, const std::vector<MetalBufferBinding>& bindings,
+    const MetalBuffer& indirect_buffer, size_t indirect_offset,
+    std::string* error) {
+  // Same layout as MTLDispatchThreadsIndirectArguments; only the grid width
+  // matters on the CPU.
+  if (!indirect_buffer.contents() ||
+      indirect_offset + sizeof(uint32_t) * 6u > indirect_buffer.length()) {
+    if (error) {
+      *error = "Indirect dispatch buffer too small";
+    }
+    return false;
+  }
+  uint32_t grid_size = 0u;
+  std::memcpy(&grid_size,
+              static_cast<const uint8_t*>(indirect_buffer.contents()) +
+                  indirect_offset,
+              sizeof(grid_size));
+  return impl_->Run(kernel, bindings, grid_size, error);
+}
+
+bool CpuRuntime::DispatchBatch(const std::vector<MetalDispatch>& dispatches,
+                               uint32_t grid_size, std::string* error) {
+  for (const auto& dispatch : dispatches) {
+    if (!dispatch.kernel || !dispatch.bindings) {
+      if (error) {
+        *error = "CPU batch dispatch missing kernel or bindings";
+      }
+      return false;
+    }
+    bool ok = dispatch.indirect_buffer
+                  ? DispatchIndirectThreads(*dispatch.kernel,
+                                            *dispatch.bindings,
+                                            *dispatch.indirect_buffer,
+                                            dispatch.indirect_offset, error)
+                  : impl_->Run(*dispatch.kernel, *dispatch.bindings,
+                               dispatch.grid_size ? dispatch.grid_size
+                                                  : grid_size,
+                               error);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t CpuRuntime::ComputeThreadgroupSize(const MetalKernel&) const {
+  return 1u;
+}
+
+}  // namespace gpga
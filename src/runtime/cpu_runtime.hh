@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runtime/metal_runtime.hh"
+
+namespace gpga {
+
+// Host execution backend behind RuntimeBackend::kCpu. The MSL source is
+// translated with TranslateMslToCpp, compiled by the host compiler into a
+// shared object (cached by content hash) and loaded with dlopen. Dispatches
+// split the grid across a worker pool; each gid runs the kernel body once.
+//
+// Environment:
+//   METALFPGA_CPU_CXX       host compiler (default: $CXX, then c++)
+//   METALFPGA_CPU_CXXFLAGS  optimisation flags (default: -O2)
+//   METALFPGA_CPU_CACHE     shared object cache directory
+//   METALFPGA_CPU_THREADS   worker threads (default: hardware concurrency)
+class CpuRuntime {
+ public:
+  CpuRuntime();
+  ~CpuRuntime();
+  CpuRuntime(const CpuRuntime&) = delete;
+  CpuRuntime& operator=(const CpuRuntime&) = delete;
+
+  bool CompileSource(const std::string& source,
+                     const std::vector<std::string>& include_paths,
+                     std::string* error);
+  bool GetLastSource(std::string* out) const;
+  bool CreateKernel(const std::string& name, MetalKernel* kernel,
+                    std::string* error);
+  MetalBuffer CreateBuffer(size_t length, const void* initial_data);
+  // Argument buffers are plain arrays of pointers indexed by [[id(N)]].
+  bool EncodeArgumentBuffer(const std::vector<MetalBufferBinding>& bindings,
+                            MetalBuffer* out, std::string* error);
+  bool Dispatch(const MetalKernel& kernel,
+                const std::vector<MetalBufferBinding>& bindings,
+                uint32_t grid_size, std::string* error);
+  bool DispatchIndirectThreads(const MetalKernel& kernel,
+                               const std::vector<MetalBufferBinding>& bindings,
+                               const MetalBuffer& indirect_buffer,
+                               size_t indirect_offset, std::string* error);
+  bool DispatchBatch(const std::vector<MetalDispatch>& dispatches,
+                     uint32_t grid_size, std::string* error);
+  // Every CPU "threadgroup" is a single gid.
+  uint32_t ComputeThreadgroupSize(const MetalKernel& kernel) const;
+
+  // Frees host storage owned by a buffer from CreateBuffer.
+  static void ReleaseBuffer(MetalBuffer* buffer);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace gpga
@@ -0,0 +1,559 @@
+#include "runtime/mem_image.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gpga {
+
+namespace {
+
+// Digit table entries: bits 0-3 are the value bits of the digit, bits 4-7 its
+// X/Z bits ('x' sets both, 'z' only the X/Z bits), as in ParseMemValue.
+constexpr uint16_t kDigitUnderscore = 0x100u;
+constexpr uint16_t kDigitInvalid = 0x200u;
+
+using DigitTable = std::array<uint16_t, 256>;
+
+DigitTable BuildDigitTable(bool is_hex) {
+  DigitTable table;
+  table.fill(kDigitInvalid);
+  const uint16_t all = is_hex ? 0xFu : 0x1u;
+  if (is_hex) {
+    for (uint16_t d = 0; d < 10u; ++d) {
+      table['0' + d] = d;
+    }
+    for (uint16_t d = 0; d < 6u; ++d) {
+      table['a' + d] = static_cast<uint16_t>(10u + d);
+      table['A' + d] = static_cast<uint16_t>(10u + d);
+    }
+  } else {
+    table['0'] = 0u;
+    table['1'] = 1u;
+  }
+  table['x'] = table['X'] = static_cast<uint16_t>(all | (all << 4));
+  table['z'] = table['Z'] = static_cast<uint16_t>(all << 4);
+  table['_'] = kDigitUnderscore;
+  return table;
+}
+
+const DigitTable& Digits(bool is_hex) {
+  static const DigitTable kHex = BuildDigitTable(true);
+  static const DigitTable kBinary = BuildDigitTable(false);
+  return is_hex ? kHex : kBinary;
+}
+
+bool IsSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+bool CommentStart(const char* pos, const char* limit) {
+  return *pos == '#' || (*pos == '/' && pos + 1 < limit && pos[1] == '/');
+}
+
+// Calls `token(begin, end)` for each whitespace-separated token, dropping
+// "//" and "#" comments up to the end of their line. Stops when `token`
+// returns false.
+template <typename TokenFn>
+void ForEachToken(const char* pos, const char* limit, TokenFn&& token) {
+  while (pos < limit) {
+    if (IsSpace(*pos)) {
+      ++pos;
+      continue;
+    }
+    if (CommentStart(pos, limit)) {
+      const void* newline =
+          std::memchr(pos, '\n', static_cast<size_t>(limit - pos));
+      pos = newline ? static_cast<const char*>(newline) : limit;
+      continue;
+    }
+    const char* begin = pos;
+    while (pos < limit && !IsSpace(*pos) && !CommentStart(pos, limit)) {
+      ++pos;
+    }
+    if (!token(begin, pos)) {
+      return;
+    }
+  }
+}
+
+const char* SkipUnderscores(const char* pos, const char* end) {
+  while (pos < end && *pos == '_') {
+    ++pos;
+  }
+  return pos;
+}
+
+// @address digits; false where std::stoull would differ or throw.
+bool ParseAddress(const char* pos, const char* end, bool is_hex,
+                  uint64_t* out) {
+  const DigitTable& digits = Digits(is_hex);
+  const int shift = is_hex ? 4 : 1;
+  uint64_t value = 0;
+  bool any = false;
+  for (; pos < end; ++pos) {
+    uint16_t digit = digits[static_cast<uint8_t>(*pos)];
+    if (digit == kDigitUnderscore) {
+      continue;
+    }
+    if (digit > 0xFu || (value >> (64 - shift)) != 0u) {
+      return false;
+    }
+    value = (value << shift) | digit;
+    any = true;
+  }
+  *out = value;
+  return any;
+}
+
+// 0x/0b prefixes switch the radix in ParseMemValue; left to that loader. In
+// a hex image "0b" only counts when the rest reads as binary ("0b12" is hex).
+bool HasRadixPrefix(const char* pos, const char* end, bool is_hex) {
+  if (pos == end || *pos != '0') {
+    return false;
+  }
+  pos = SkipUnderscores(pos + 1, end);
+  if (pos == end) {
+    return false;
+  }
+  if (*pos == 'x' || *pos == 'X') {
+    return true;
+  }
+  if (*pos != 'b' && *pos != 'B') {
+    return false;
+  }
+  if (!is_hex) {
+    return true;
+  }
+  const DigitTable& binary = Digits(false);
+  bool any = false;
+  for (++pos; pos < end; ++pos) {
+    uint16_t digit = binary[static_cast<uint8_t>(*pos)];
+    if (digit == kDigitInvalid) {
+      return false;
+    }
+    any = any || digit != kDigitUnderscore;
+  }
+  return any;
+}
+
+// Values up to 64 bits: one table load, shift and or per digit; invalid
+// digits are checked once at the end.
+bool ParseNarrow(const char* pos, const char* end, const DigitTable& digits,
+                 int shift, uint64_t mask, uint64_t* val, uint64_t* xz) {
+  uint64_t out_val = 0;
+  uint64_t out_xz = 0;
+  uint16_t seen = 0;
+  for (; pos < end; ++pos) {
+    uint16_t digit = digits[static_cast<uint8_t>(*pos)];
+    if (digit == kDigitUnderscore) {
+      continue;
+    }
+    seen |= digit;
+    out_val = (out_val << shift) | (digit & 0xFu);
+    out_xz = (out_xz << shift) | ((digit >> 4) & 0xFu);
+  }
+  if ((seen & kDigitInvalid) != 0u) {
+    return false;
+  }
+  *val = out_val & mask;
+  *xz = out_xz & mask;
+  return true;
+}
+
+// Wider values, least significant digit first into word arrays.
+bool ParseWide(const char* begin, const char* end, const DigitTable& digits,
+               int shift, uint32_t width, uint64_t* val, uint64_t* xz,
+               uint32_t word_count) {
+  std::fill(val, val + word_count, 0ull);
+  std::fill(xz, xz + word_count, 0ull);
+  uint32_t bit = 0;
+  for (const char* pos = end; pos > begin && bit < width;) {
+    --pos;
+    uint16_t digit = digits[static_cast<uint8_t>(*pos)];
+    if (digit == kDigitUnderscore) {
+      continue;
+    }
+    if (digit == kDigitInvalid) {
+      return false;
+    }
+    for (int b = 0; b < shift && bit < width; ++b, ++bit) {
+      const uint64_t word_bit = 1ull << (bit % 64u);
+      if ((digit >> b) & 1u) {
+        val[bit / 64u] |= word_bit;
+      }
+      if ((digit >> (4 + b)) & 1u) {
+        xz[bit / 64u] |= word_bit;
+      }
+    }
+  }
+  return true;
+}
+
+void StoreWord(uint8_t* base, size_t offset, size_t word_size,
+               uint64_t value) {
+  if (word_size == sizeof(uint64_t)) {
+    std::memcpy(base + offset, &value, sizeof(uint64_t));
+  } else {
+    uint32_t narrow = static_cast<uint32_t>(value);
+    std::memcpy(base + offset, &narrow, sizeof(uint32_t));
+  }
+}
+
+void StoreElement(const MemImageLayout& target, uint64_t address,
+                  const uint64_t* val, const uint64_t* xz) {
+  for (uint32_t gid = 0; gid < target.instance_count; ++gid) {
+    const uint64_t element =
+        static_cast<uint64_t>(gid) * target.array_size + address;
+    const size_t offset = static_cast<size_t>(element) * target.element_stride;
+    if (element >= target.val_elements) {
+      continue;
+    }
+    for (uint32_t w = 0; w < target.word_count; ++w) {
+      StoreWord(target.val, offset + w * target.word_size, target.word_size,
+                val[w]);
+    }
+    if (target.xz && element < target.xz_elements) {
+      for (uint32_t w = 0; w < target.word_count; ++w) {
+        StoreWord(target.xz, offset + w * target.word_size, target.word_size,
+                  xz[w]);
+      }
+    }
+  }
+}
+
+// A line-aligned slice of the file. The scan pass fills everything but
+// `base`, which the prefix pass derives from the chunks before it.
+struct MemImageChunk {
+  const char* begin = nullptr;
+  const char* end = nullptr;
+  uint64_t leading = 0;  // values before the first @address
+  bool has_address = false;
+  uint64_t next = 0;  // address after the chunk, when has_address
+  // Addresses of the values after the first @address.
+  uint64_t lo = std::numeric_limits<uint64_t>::max();
+  uint64_t hi = 0;
+  bool stops = false;  // a value after the first @address is past `last`
+  bool unsupported = false;
+  uint64_t base = 0;
+};
+
+void ScanChunk(MemImageChunk* chunk, bool is_hex, uint64_t last) {
+  uint64_t address = 0;
+  ForEachToken(chunk->begin, chunk->end, [&](const char* begin,
+                                             const char* end) {
+    begin = SkipUnderscores(begin, end);
+    if (begin == end) {
+      return true;
+    }
+    if (*begin == '@') {
+      if (!ParseAddress(begin + 1, end, is_hex, &address)) {
+        chunk->unsupported = true;
+        return false;
+      }
+      chunk->has_address = true;
+      return true;
+    }
+    if (!chunk->has_address) {
+      ++chunk->leading;
+      return true;
+    }
+    if (address > last) {
+      chunk->stops = true;
+      return false;
+    }
+    chunk->lo = std::min(chunk->lo, address);
+    chunk->hi = std::max(chunk->hi, address);
+    ++address;
+    return true;
+  });
+  chunk->next = address;
+}
+
+bool LoadChunk(const MemImageChunk& chunk, bool is_hex,
+               const MemImageLayout& target, uint64_t last) {
+  const DigitTable& digits = Digits(is_hex);
+  const int shift = is_hex ? 4 : 1;
+  const uint64_t mask = target.width >= 64u
+                            ? std::numeric_limits<uint64_t>::max()
+                            : (1ull << target.width) - 1ull;
+  const bool wide = target.width > 64u;
+  std::vector<uint64_t> words(wide ? target.word_count * 2u : 2u, 0ull);
+  uint64_t* val = words.data();
+  uint64_t* xz = words.data() + (wide ? target.word_count : 1u);
+  uint64_t address = chunk.base;
+  bool ok = true;
+  ForEachToken(chunk.begin, chunk.end, [&](const char* begin,
+                                           const char* end) {
+    begin = SkipUnderscores(begin, end);
+    if (begin == end) {
+      return true;
+    }
+    if (*begin == '@') {
+      ParseAddress(begin + 1, end, is_hex, &address);
+      return true;
+    }
+    if (address > last) {
+      return false;
+    }
+    if (address >= target.array_size) {
+      ++address;
+      return true;
+    }
+    if (HasRadixPrefix(begin, end, is_hex)) {
+      ok = false;
+      return false;
+    }
+    const bool parsed =
+        wide ? ParseWide(begin, end, digits, shift, target.width, val, xz,
+                         target.word_count)
+             : ParseNarrow(begin, end, digits, shift, mask, val, xz);
+    if (!parsed) {
+      ok = false;
+      return false;
+    }
+    StoreElement(target, address, val, xz);
+    ++address;
+    return true;
+  });
+  return ok;
+}
+
+// Runs fn(0..count-1), on one thread per chunk when `parallel`.
+template <typename ChunkFn>
+void RunChunks(size_t count, bool parallel, ChunkFn&& fn) {
+  if (!parallel || count < 2u) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(count - 1u);
+  for (size_t i = 1; i < count; ++i) {
+    workers.emplace_back([&fn, i]() { fn(i); });
+  }
+  fn(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+bool LoadMapped(const char* data, size_t size, bool is_hex,
+                const MemImageLayout& target, uint64_t start, uint64_t last,
+                uint32_t threads) {
+  size_t chunk_count = std::max<size_t>(1u, size / kMemImageMinChunkBytes);
+  chunk_count = std::min<size_t>(chunk_count, std::max<uint32_t>(1u, threads));
+  std::vector<MemImageChunk> chunks(chunk_count);
+  const char* pos = data;
+  const char* limit = data + size;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    const char* split = data + (size * (i + 1u)) / chunk_count;
+    if (i + 1u < chunk_count && split > pos) {
+      const void* newline =
+          std::memchr(split - 1, '\n', static_cast<size_t>(limit - split + 1));
+      split = newline ? static_cast<const char*>(newline) + 1 : limit;
+    }
+    split = std::max(split, pos);
+    chunks[i].begin = pos;
+    chunks[i].end = split;
+    pos = split;
+  }
+  chunks.back().end = limit;
+
+  RunChunks(chunk_count, true,
+            [&](size_t i) { ScanChunk(&chunks[i], is_hex, last); });
+
+  // Chunk start addresses, where the load stops, and whether the chunks
+  // write disjoint ascending address ranges (so they may run concurrently).
+  uint64_t address = start;
+  size_t used = chunk_count;
+  bool disjoint = true;
+  bool have_prev = false;
+  uint64_t prev_hi = 0;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    MemImageChunk& chunk = chunks[i];
+    chunk.base = address;
+    const bool leading_stops =
+        chunk.leading > 0u &&
+        (address > last || chunk.leading - 1u > last - address);
+    if (!leading_stops && chunk.unsupported) {
+      return false;
+    }
+    uint64_t lo = chunk.lo;
+    uint64_t hi = chunk.hi;
+    if (chunk.leading > 0u) {
+      const uint64_t leading_hi = address + (chunk.leading - 1u);
+      if (leading_hi < address) {
+        disjoint = false;
+      }
+      lo = std::min(lo, address);
+      hi = std::max(hi, leading_hi);
+    }
+    if (lo <= hi) {
+      if (have_prev && lo <= prev_hi) {
+        disjoint = false;
+      }
+      prev_hi = hi;
+      have_prev = true;
+    }
+    if (leading_stops || chunk.stops) {
+      used = i + 1u;
+      break;
+    }
+    address = chunk.has_address ? chunk.next : address + chunk.leading;
+  }
+
+  std::vector<char> ok(used, 1);
+  RunChunks(used, disjoint, [&](size_t i) {
+    if (!disjoint && i > 0u && !ok[i - 1u]) {
+      ok[i] = 0;
+      return;
+    }
+    ok[i] = LoadChunk(chunks[i], is_hex, target, last) ? 1 : 0;
+  });
+  return std::all_of(ok.begin(), ok.end(), [](char v) { return v != 0; });
+}
+
+uint64_t LoadWord(const uint8_t* base, size_t offset, size_t word_size) {
+  if (word_size == sizeof(uint64_t)) {
+    uint64_t value = 0;
+    std::memcpy(&value, base + offset, sizeof(uint64_t));
+    return value;
+  }
+  uint32_t narrow = 0;
+  std::memcpy(&narrow, base + offset, sizeof(uint32_t));
+  return narrow;
+}
+
+// One element as FormatMemWord(s) prints it, most significant digit first.
+// A hex digit with any X/Z bit prints 'z' when all its bits are Z, 'x'
+// otherwise; binary digits index "01zx" by (xz << 1) | val.
+void FormatElement(const MemImageLayout& layout, bool is_hex, size_t offset,
+                   bool has_xz, uint32_t digits, char* out) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  static const char kBinaryDigits[] = "01zx";
+  const uint32_t shift = is_hex ? 4u : 1u;
+  uint32_t loaded = std::numeric_limits<uint32_t>::max();
+  uint64_t val = 0;
+  uint64_t xz = 0;
+  for (uint32_t d = 0; d < digits; ++d) {
+    const uint32_t bit = (digits - 1u - d) * shift;
+    const uint32_t word = bit / 64u;
+    if (word != loaded) {
+      const size_t word_offset = offset + word * layout.word_size;
+      val = LoadWord(layout.val, word_offset, layout.word_size);
+      xz = has_xz ? LoadWord(layout.xz, word_offset, layout.word_size) : 0u;
+      loaded = word;
+    }
+    const uint32_t remaining = layout.width - bit;
+    const uint32_t mask =
+        (remaining >= shift) ? (1u << shift) - 1u : (1u << remaining) - 1u;
+    const uint32_t v = static_cast<uint32_t>(val >> (bit % 64u)) & mask;
+    const uint32_t x = static_cast<uint32_t>(xz >> (bit % 64u)) & mask;
+    if (!is_hex) {
+      out[d] = kBinaryDigits[(x << 1) | v];
+    } else if (x == 0u) {
+      out[d] = kHexDigits[v];
+    } else {
+      out[d] = (x == mask && v == 0u) ? 'z' : 'x';
+    }
+  }
+  out[digits] = '\n';
+}
+
+}  // namespace
+
+bool LoadMemImage(const std::string& path, bool is_hex,
+                  const MemImageLayout& target, uint64_t start, uint64_t end,
+                  uint32_t threads) {
+  if (!target.val || target.element_stride == 0u || target.word_count == 0u) {
+    return false;
+  }
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  if (size == 0u) {
+    ::close(fd);
+    return true;
+  }
+  void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  ::madvise(mapped, size, MADV_SEQUENTIAL);
+  const bool loaded = LoadMapped(static_cast<const char*>(mapped), size,
+                                 is_hex, target, start, end, threads);
+  ::munmap(mapped, size);
+  return loaded;
+}
+
+bool WriteMemImage(const std::string& path, bool is_hex,
+                   const MemImageLayout& layout, uint64_t start, uint64_t end,
+                   uint32_t threads, std::string* error) {
+  std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!out) {
+    if (error) {
+      *error = "failed to open writemem file: " + path;
+    }
+    return false;
+  }
+  const uint64_t stop =
+      std::min({end, layout.array_size - 1u,
+                layout.val_elements > 0u ? layout.val_elements - 1u : 0u});
+  if (!layout.val || layout.val_elements == 0u || layout.array_size == 0u ||
+      start > stop) {
+    return true;
+  }
+  const uint32_t width = std::max(layout.width, 1u);
+  const uint32_t digits = is_hex ? (width + 3u) / 4u : width;
+  const size_t line_bytes = digits + 1u;
+  const uint64_t lines_per_chunk =
+      std::max<uint64_t>(1u, kMemImageWriteChunkBytes / line_bytes);
+  const uint32_t workers = std::max(threads, 1u);
+  std::vector<char> text;
+  for (uint64_t first = start; first <= stop;) {
+    const uint64_t remaining = stop - first + 1u;
+    const size_t chunks = static_cast<size_t>(std::min<uint64_t>(
+        workers, (remaining + lines_per_chunk - 1u) / lines_per_chunk));
+    const uint64_t lines = std::min(remaining, chunks * lines_per_chunk);
+    text.resize(static_cast<size_t>(lines) * line_bytes);
+    RunChunks(chunks, true, [&](size_t i) {
+      const uint64_t begin = i * lines_per_chunk;
+      const uint64_t end_line = std::min(lines, begin + lines_per_chunk);
+      char* line = text.data() + begin * line_bytes;
+      for (uint64_t n = begin; n < end_line; ++n, line += line_bytes) {
+        const uint64_t element = first + n;
+        FormatElement(layout, is_hex,
+                      static_cast<size_t>(element) * layout.element_stride,
+                      layout.xz && element < layout.xz_elements, digits, line);
+      }
+    });
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    if (!out) {
+      if (error) {
+        *error = "failed to write writemem file: " + path;
+      }
+      return false;
+    }
+    first += lines;
+  }
+  return true;
+}
+
+}  // namespace gpga
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gpga {
+
+// Files smaller than this per thread are parsed by fewer threads.
+constexpr size_t kMemImageMinChunkBytes = 1u << 20;
+// Text each thread formats per pass of the $writemem writer.
+constexpr size_t kMemImageWriteChunkBytes = 4u << 20;
+
+// Storage of a memory for $readmem/$writemem: element
+// gid * array_size + address has word_count words of word_size bytes (low
+// word first) at val + element * element_stride, and the same in xz when
+// four-state (xz is null otherwise).
+struct MemImageLayout {
+  uint8_t* val = nullptr;
+  uint8_t* xz = nullptr;
+  // Elements that fit in the val/xz storage; writes past them are dropped.
+  uint64_t val_elements = 0;
+  uint64_t xz_elements = 0;
+  size_t element_stride = 0;
+  size_t word_size = sizeof(uint64_t);
+  uint32_t word_count = 1;
+  uint32_t width = 1;
+  uint64_t array_size = 1;
+  uint32_t instance_count = 1;
+};
+
+// Loads a memory image for addresses start..end into `target`: the file is
+// mapped, split at line boundaries across up to `threads` threads, and each
+// chunk writes its values straight into the target. Tokens, comments and
+// @address directives follow the line-by-line loader in main.mm.
+//
+// Returns false when the file cannot be mapped or uses syntax left to the
+// line-by-line loader (0x/0b prefixes, malformed tokens); the caller then
+// loads the file that way, which rewrites anything written here and reports
+// the errors.
+bool LoadMemImage(const std::string& path, bool is_hex,
+                  const MemImageLayout& target, uint64_t start, uint64_t end,
+                  uint32_t threads);
+
+// Writes addresses start..end of instance 0 as $writememh/$writememb text,
+// one element per line, stopping at the end of the array or of the val
+// storage. Lines have a fixed length, so each thread formats its range of
+// elements straight from `layout` into its slice of a shared buffer that is
+// written in order.
+bool WriteMemImage(const std::string& path, bool is_hex,
+                   const MemImageLayout& layout, uint64_t start, uint64_t end,
+                   uint32_t threads, std::string* error);
+
+}  // namespace gpga
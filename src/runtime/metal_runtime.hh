@@ -68,20 +68,93 @@ struct ServiceStringTable {
   std::vector<std::string> entries;
 };
 
+// 64-bit words pointing into a service record buffer.
+class ServiceWordSpan {
+ public:
+  ServiceWordSpan() = default;
+  ServiceWordSpan(const uint64_t* data, size_t size)
+      : data_(data), size_(size) {}
+
+  const uint64_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0u; }
+  const uint64_t* begin() const { return data_; }
+  const uint64_t* end() const { return data_ + size_; }
+  uint64_t operator[](size_t index) const { return data_[index]; }
+
+ private:
+  const uint64_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
 struct ServiceArgView {
   ServiceArgKind kind = ServiceArgKind::kValue;
   uint32_t width = 0;
   uint64_t value = 0;
   uint64_t xz = 0;
-  std::vector<uint64_t> wide_value;
-  std::vector<uint64_t> wide_xz;
+  // kWide args: ceil(width / 64) words in the record buffer; wide_xz is
+  // empty without 4-state.
+  ServiceWordSpan wide_value;
+  ServiceWordSpan wide_xz;
+};
+
+// Args of one record, decoded on access from the record buffer laid out by
+// ServiceRecordStride; nothing is copied or allocated.
+class ServiceArgList {
+ public:
+  class Iterator {
+   public:
+    Iterator(const ServiceArgList* list, size_t index)
+        : list_(list), index_(index) {}
+    ServiceArgView operator*() const { return (*list_)[index_]; }
+    Iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+    bool operator!=(const Iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    const ServiceArgList* list_;
+    size_t index_;
+  };
+
+  ServiceArgList() = default;
+  ServiceArgList(const uint8_t* record, uint32_t count, uint32_t max_args,
+                 uint32_t wide_words, bool has_xz)
+      : record_(record),
+        count_(count),
+        max_args_(max_args),
+        wide_words_(wide_words),
+        has_xz_(has_xz) {}
+
+  size_t size() const { return count_ - first_; }
+  bool empty() const { return first_ == count_; }
+  ServiceArgView operator[](size_t index) const;
+  ServiceArgView front() const { return (*this)[0]; }
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, size()); }
+  // The args after the first `count` (e.g. past a file descriptor).
+  ServiceArgList Skip(size_t count) const;
+
+ private:
+  const uint8_t* record_ = nullptr;
+  uint32_t first_ = 0;
+  uint32_t count_ = 0;
+  uint32_t max_args_ = 0;
+  uint32_t wide_words_ = 0;
+  bool has_xz_ = false;
 };
 
+// One service record read in place. The record buffer must outlive the view
+// and be 8-byte aligned (record strides are multiples of 8), since wide words
+// are exposed as pointers into it.
 struct ServiceRecordView {
   ServiceKind kind = ServiceKind::kDisplay;
   uint32_t pid = 0;
   uint32_t format_id = 0xFFFFFFFFu;
-  std::vector<ServiceArgView> args;
+  ServiceArgList args;
 };
 
 struct ServiceDrainResult {
@@ -92,6 +165,11 @@ struct ServiceDrainResult {
 
 size_t ServiceRecordStride(uint32_t max_args, uint32_t wide_words, bool has_xz);
 
+// Views of `record_count` consecutive records; `out` is cleared and reused.
+void ReadServiceRecords(const void* records, uint32_t record_count,
+                        uint32_t max_args, uint32_t wide_words, bool has_xz,
+                        std::vector<ServiceRecordView>* out);
+
 ServiceDrainResult DrainSchedulerServices(
     const void* records, uint32_t record_count, uint32_t max_args,
     uint32_t wide_words, bool has_xz, const ServiceStringTable& strings,
@@ -114,6 +192,8 @@ struct SignalInfo {
   uint32_t array_size = 0;
   bool is_real = false;
   bool is_trireg = false;
+  // --prune-xz: proven X/Z-free, so the packed state holds no xz segment.
+  bool two_state = false;
 };
 
 struct ModuleInfo {
@@ -158,6 +238,18 @@ struct SchedulerConstants {
   uint32_t vm_expr_word_count = 0;
   uint32_t vm_expr_imm_word_count = 0;
   uint32_t vm_signal_count = 0;
+  // Bitset words per instance holding --pack-bits 1-bit signals at the front
+  // of gpga_state/nb_state/sched_force_state; 0 when bit packing is off.
+  uint32_t packed_bit_groups = 0;
+  // --locality-layout: port/reg segments of the packed state buffers follow
+  // OrderStateByLocality instead of declaration order.
+  bool locality_layout = false;
+  // --prune-xz: buffer-backed X/Z-free nets have no xz segment and share one
+  // 8-byte-per-instance zero segment after all the others.
+  bool prune_xz = false;
+  // --hier-codegen: gpga_inst_state bytes per instance holding the shared
+  // instance structs; 0 when no instance group is shared.
+  uint32_t inst_state_bytes = 0;
 };
 
 struct BufferSpec {
@@ -165,6 +257,16 @@ struct BufferSpec {
   size_t length = 0;
 };
 
+// Execution backend behind MetalRuntime. kCpu compiles the source as host C++
+// (see TranslateMslToCpp) and runs kernels on CPU threads; it is the only
+// backend available on hosts without Metal.
+enum class RuntimeBackend : uint32_t {
+  kMetal = 0u,
+  kCpu = 1u,
+};
+
+class CpuRuntime;
+
 class MetalBuffer {
  public:
   MetalBuffer() = default;
@@ -179,6 +281,8 @@ class MetalBuffer {
 
  private:
   friend class MetalRuntime;
+  friend class CpuRuntime;
+  // CPU backend buffers have no handle; contents_ is then host-owned.
   void* handle_ = nullptr;
   void* contents_ = nullptr;
   size_t length_ = 0;
@@ -191,6 +295,7 @@ struct MetalBufferBinding {
 };
 
 class MetalKernel;
+struct KernelBindingTable;
 
 struct MetalDispatch {
   const MetalKernel* kernel = nullptr;
@@ -226,8 +331,10 @@ class MetalKernel {
 
  private:
   friend class MetalRuntime;
+  friend class CpuRuntime;
   void* pipeline_ = nullptr;
   void* argument_table_ = nullptr;
+  void* host_entry_ = nullptr;
   std::string name_;
   std::unordered_map<std::string, uint32_t> buffer_indices_;
   uint32_t max_buffer_bindings_ = 0;
@@ -244,8 +351,14 @@ class MetalRuntime {
   MetalRuntime(const MetalRuntime&) = delete;
   MetalRuntime& operator=(const MetalRuntime&) = delete;
 
+  // Must be called before Initialize().
+  void SetBackend(RuntimeBackend backend);
+  RuntimeBackend Backend() const;
   bool Initialize(std::string* error);
   void SetPreferSourceBindings(bool value);
+  // Binding tables from a scheduler manifest; consulted before the MSL text
+  // when source bindings are preferred.
+  void SetKernelBindingTables(const std::vector<KernelBindingTable>& tables);
   bool CompileSource(const std::string& source,
                      const std::vector<std::string>& include_paths,
                      std::string* error);
@@ -20,6 +20,8 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "runtime/cpu_runtime.hh"
+#include "runtime/sched_manifest.hh"
 #include "utils/msl_naming.hh"
 
 #import <Foundation/Foundation.h>
@@ -333,6 +335,9 @@ struct MetalRuntime::Impl {
   SourceStats last_source_stats;
   bool last_source_stats_valid = false;
   bool prefer_source_bindings = false;
+  std::vector<KernelBindingTable> binding_tables;
+  RuntimeBackend backend = RuntimeBackend::kMetal;
+  std::unique_ptr<CpuRuntime> cpu;
   bool ShouldSampleGpuTimestamps() {
     if (!gpu_timestamps) {
       return false;
@@ -737,387 +742,6 @@ uint32_t ReadU32(const uint8_t* base, size_t offset) {
   return value;
 }
 
-uint64_t ReadU64(const uint8_t* base, size_t offset) {
-  uint64_t value = 0;
-  std::memcpy(&value, base + offset, sizeof(value));
-  return value;
-}
-
-std::string ResolveString(const ServiceStringTable& strings, uint32_t id) {
-  if (id >= strings.entries.size()) {
-    return "<invalid_string_id>";
-  }
-  return strings.entries[id];
-}
-
-uint64_t MaskForWidth(uint32_t width) {
-  if (width >= 64u) {
-    return 0xFFFFFFFFFFFFFFFFull;
-  }
-  if (width == 0u) {
-    return 0ull;
-  }
-  return (1ull << width) - 1ull;
-}
-
-int64_t SignExtend(uint64_t value, uint32_t width) {
-  if (width == 0u || width >= 64u) {
-    return static_cast<int64_t>(value);
-  }
-  uint64_t mask = MaskForWidth(width);
-  uint64_t sign_bit = 1ull << (width - 1u);
-  uint64_t masked = value & mask;
-  if ((masked & sign_bit) != 0ull) {
-    return static_cast<int64_t>(masked | ~mask);
-  }
-  return static_cast<int64_t>(masked);
-}
-
-std::string FormatBits(uint64_t value, uint64_t xz, uint32_t width, int base,
-                       bool has_xz) {
-  if (width == 0u) {
-    width = 1u;
-  }
-  if (width > 64u) {
-    width = 64u;
-  }
-  uint64_t mask = MaskForWidth(width);
-  value &= mask;
-  xz &= mask;
-
-  int group = 1;
-  if (base == 16) {
-    group = 4;
-  } else if (base == 8) {
-    group = 3;
-  }
-  int digits = static_cast<int>((width + group - 1u) / group);
-  std::string out;
-  out.reserve(static_cast<size_t>(digits));
-  for (int i = digits - 1; i >= 0; --i) {
-    int shift = i * group;
-    uint64_t group_mask = ((1ull << group) - 1ull) << shift;
-    if (has_xz && (xz & group_mask) != 0ull) {
-      out.push_back('x');
-      continue;
-    }
-    uint64_t digit = (value >> shift) & ((1ull << group) - 1ull);
-    if (base == 16) {
-      out.push_back("0123456789abcdef"[digit & 0xF]);
-    } else if (base == 8) {
-      out.push_back("01234567"[digit & 0x7]);
-    } else {
-      out.push_back((digit & 1ull) ? '1' : '0');
-    }
-  }
-  return out;
-}
-
-bool WideHasXz(const std::vector<uint64_t>& words) {
-  for (uint64_t word : words) {
-    if (word != 0u) {
-      return true;
-    }
-  }
-  return false;
-}
-
-bool WideBit(const std::vector<uint64_t>& words, uint32_t bit) {
-  size_t word_index = bit / 64u;
-  if (word_index >= words.size()) {
-    return false;
-  }
-  uint32_t shift = bit % 64u;
-  return ((words[word_index] >> shift) & 1ull) != 0ull;
-}
-
-std::vector<uint64_t> MaskWideWords(std::vector<uint64_t> words,
-                                    uint32_t width) {
-  if (width == 0u || words.empty()) {
-    return words;
-  }
-  uint32_t word_count = (width + 63u) / 64u;
-  if (words.size() > word_count) {
-    words.resize(word_count);
-  }
-  uint32_t rem = width % 64u;
-  if (rem != 0u && !words.empty()) {
-    uint64_t mask = (1ull << rem) - 1ull;
-    words.back() &= mask;
-  }
-  return words;
-}
-
-std::string FormatWideBits(const std::vector<uint64_t>& value_words,
-                           const std::vector<uint64_t>& xz_words,
-                           uint32_t width, int base, bool has_xz) {
-  if (width == 0u) {
-    width = 1u;
-  }
-  int group = 1;
-  if (base == 16) {
-    group = 4;
-  } else if (base == 8) {
-    group = 3;
-  }
-  int digits = static_cast<int>((width + group - 1u) / group);
-  std::string out;
-  out.reserve(static_cast<size_t>(digits));
-  for (int i = digits - 1; i >= 0; --i) {
-    int shift = i * group;
-    bool group_xz = false;
-    uint64_t digit = 0;
-    for (int bit = 0; bit < group; ++bit) {
-      int bit_index = shift + bit;
-      if (bit_index >= static_cast<int>(width)) {
-        continue;
-      }
-      if (has_xz && WideBit(xz_words, static_cast<uint32_t>(bit_index))) {
-        group_xz = true;
-      }
-      if (WideBit(value_words, static_cast<uint32_t>(bit_index))) {
-        digit |= (1ull << bit);
-      }
-    }
-    if (has_xz && group_xz) {
-      out.push_back('x');
-      continue;
-    }
-    if (base == 16) {
-      out.push_back("0123456789abcdef"[digit & 0xF]);
-    } else if (base == 8) {
-      out.push_back("01234567"[digit & 0x7]);
-    } else {
-      out.push_back((digit & 1ull) ? '1' : '0');
-    }
-  }
-  return out;
-}
-
-std::string FormatWideUnsigned(std::vector<uint64_t> words, uint32_t width) {
-  words = MaskWideWords(std::move(words), width);
-  while (!words.empty() && words.back() == 0u) {
-    words.pop_back();
-  }
-  if (words.empty()) {
-    return "0";
-  }
-  std::string out;
-  while (!words.empty()) {
-    unsigned __int128 rem = 0;
-    for (size_t i = words.size(); i-- > 0;) {
-      unsigned __int128 cur = (rem << 64) | words[i];
-      words[i] = static_cast<uint64_t>(cur / 10u);
-      rem = cur % 10u;
-    }
-    out.push_back(static_cast<char>('0' + static_cast<uint32_t>(rem)));
-    while (!words.empty() && words.back() == 0u) {
-      words.pop_back();
-    }
-  }
-  std::reverse(out.begin(), out.end());
-  return out;
-}
-
-std::string FormatWideSigned(std::vector<uint64_t> words, uint32_t width) {
-  words = MaskWideWords(std::move(words), width);
-  if (width == 0u || words.empty()) {
-    return "0";
-  }
-  bool sign = WideBit(words, width - 1u);
-  if (!sign) {
-    return FormatWideUnsigned(words, width);
-  }
-  for (auto& word : words) {
-    word = ~word;
-  }
-  words = MaskWideWords(std::move(words), width);
-  uint64_t carry = 1u;
-  for (auto& word : words) {
-    uint64_t prev = word;
-    word += carry;
-    carry = (word < prev) ? 1u : 0u;
-  }
-  return "-" + FormatWideUnsigned(words, width);
-}
-
-std::string ApplyPadding(std::string text, int width, bool zero_pad) {
-  if (width <= 0 || static_cast<int>(text.size()) >= width) {
-    return text;
-  }
-  char pad_char = zero_pad ? '0' : ' ';
-  int pad_len = width - static_cast<int>(text.size());
-  if (zero_pad && !text.empty() && text[0] == '-') {
-    return "-" + std::string(pad_len, pad_char) + text.substr(1);
-  }
-  return std::string(pad_len, pad_char) + text;
-}
-
-std::string FormatNumeric(const ServiceArgView& arg, char spec, bool has_xz) {
-  if (arg.kind == ServiceArgKind::kWide && !arg.wide_value.empty()) {
-    const std::vector<uint64_t>& val = arg.wide_value;
-    const std::vector<uint64_t>& xz = arg.wide_xz;
-    if (has_xz && WideHasXz(xz) &&
-        (spec == 'd' || spec == 'u' || spec == 't')) {
-      return "x";
-    }
-    if (spec == 'b') {
-      return FormatWideBits(val, xz, arg.width, 2, has_xz);
-    }
-    if (spec == 'o') {
-      return FormatWideBits(val, xz, arg.width, 8, has_xz);
-    }
-    if (spec == 'h' || spec == 'x') {
-      return FormatWideBits(val, xz, arg.width, 16, has_xz);
-    }
-    if (spec == 'u' || spec == 't') {
-      return FormatWideUnsigned(val, arg.width);
-    }
-    return FormatWideSigned(val, arg.width);
-  }
-  if (has_xz && arg.xz != 0u &&
-      (spec == 'd' || spec == 'u' || spec == 't')) {
-    return "x";
-  }
-  uint32_t width = arg.width;
-  if (spec == 'b') {
-    return FormatBits(arg.value, arg.xz, width, 2, has_xz);
-  }
-  if (spec == 'o') {
-    return FormatBits(arg.value, arg.xz, width, 8, has_xz);
-  }
-  if (spec == 'h' || spec == 'x') {
-    return FormatBits(arg.value, arg.xz, width, 16, has_xz);
-  }
-  if (spec == 't') {
-    return std::to_string(arg.value);
-  }
-  if (spec == 'u') {
-    uint64_t mask = MaskForWidth(width);
-    return std::to_string(arg.value & mask);
-  }
-  int64_t signed_value = SignExtend(arg.value, width);
-  return std::to_string(signed_value);
-}
-
-std::string FormatReal(const ServiceArgView& arg, char spec, int precision,
-                       bool has_xz) {
-  if (has_xz && arg.xz != 0u) {
-    return "x";
-  }
-  double value = 0.0;
-  if (arg.kind == ServiceArgKind::kReal) {
-    uint64_t bits = arg.value;
-    std::memcpy(&value, &bits, sizeof(value));
-  } else {
-    int64_t signed_value = SignExtend(arg.value, arg.width);
-    value = static_cast<double>(signed_value);
-  }
-  std::ostringstream oss;
-  if (spec == 'f') {
-    oss << std::fixed;
-  } else if (spec == 'e') {
-    oss << std::scientific;
-  }
-  if (precision >= 0) {
-    oss << std::setprecision(precision);
-  }
-  oss << value;
-  return oss.str();
-}
-
-std::string FormatArg(const ServiceArgView& arg, char spec, int precision,
-                      const ServiceStringTable& strings, bool has_xz) {
-  if (arg.kind == ServiceArgKind::kString ||
-      arg.kind == ServiceArgKind::kIdent) {
-    return ResolveString(strings, static_cast<uint32_t>(arg.value));
-  }
-  if (spec == 's') {
-    return FormatNumeric(arg, 'd', has_xz);
-  }
-  if (spec == 'f' || spec == 'e' || spec == 'g') {
-    return FormatReal(arg, spec, precision, has_xz);
-  }
-  return FormatNumeric(arg, spec, has_xz);
-}
-
-std::string FormatWithSpec(const std::string& fmt,
-                           const std::vector<ServiceArgView>& args,
-                           size_t start_index,
-                           const ServiceStringTable& strings, bool has_xz) {
-  std::ostringstream oss;
-  size_t arg_index = start_index;
-  for (size_t i = 0; i < fmt.size(); ++i) {
-    char c = fmt[i];
-    if (c != '%') {
-      oss << c;
-      continue;
-    }
-    if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
-      oss << '%';
-      ++i;
-      continue;
-    }
-    bool zero_pad = false;
-    int width = 0;
-    int precision = -1;
-    size_t j = i + 1;
-    if (j < fmt.size() && fmt[j] == '0') {
-      zero_pad = true;
-      ++j;
-    }
-    while (j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9') {
-      width = (width * 10) + (fmt[j] - '0');
-      ++j;
-    }
-    if (j < fmt.size() && fmt[j] == '.') {
-      ++j;
-      precision = 0;
-      while (j < fmt.size() && fmt[j] >= '0' && fmt[j] <= '9') {
-        precision = (precision * 10) + (fmt[j] - '0');
-        ++j;
-      }
-    }
-    if (j >= fmt.size()) {
-      break;
-    }
-    char spec = fmt[j];
-    if (spec >= 'A' && spec <= 'Z') {
-      spec = static_cast<char>(spec - 'A' + 'a');
-    }
-    i = j;
-    if (arg_index >= args.size()) {
-      oss << ApplyPadding("<missing>", width, false);
-      continue;
-    }
-    std::string text =
-        FormatArg(args[arg_index], spec, precision, strings, has_xz);
-    ++arg_index;
-    oss << ApplyPadding(std::move(text), width, zero_pad);
-  }
-  return oss.str();
-}
-
-std::string FormatDefaultArgs(const std::vector<ServiceArgView>& args,
-                              const ServiceStringTable& strings, bool has_xz) {
-  std::ostringstream oss;
-  for (size_t i = 0; i < args.size(); ++i) {
-    if (i > 0) {
-      oss << " ";
-    }
-    const auto& arg = args[i];
-    if (arg.kind == ServiceArgKind::kString ||
-        arg.kind == ServiceArgKind::kIdent) {
-      oss << ResolveString(strings, static_cast<uint32_t>(arg.value));
-    } else if (arg.kind == ServiceArgKind::kReal) {
-      oss << FormatReal(arg, 'g', -1, has_xz);
-    } else {
-      oss << FormatNumeric(arg, 'd', has_xz);
-    }
-  }
-  return oss.str();
-}
-
 std::string ReadFileContents(const std::string& path, std::string* error) {
   std::ifstream file(path);
   if (!file) {
@@ -1273,12 +897,6 @@ bool StartsWith(const std::string& value, const std::string& prefix) {
          value.compare(0, prefix.size(), prefix) == 0;
 }
 
-bool EndsWith(const std::string& value, const std::string& suffix) {
-  return value.size() >= suffix.size() &&
-         value.compare(value.size() - suffix.size(), suffix.size(), suffix) ==
-             0;
-}
-
 std::string ExpandIncludes(const std::string& source,
                            const std::vector<std::string>& include_paths,
                            std::string* error) {
@@ -1391,170 +1009,6 @@ bool ParseKernelBindingsFromSource(
   return true;
 }
 
-std::string SchedulerConstSliceString(const std::string& source) {
-  constexpr size_t kConstSpan = 128u * 1024u;
-  const std::string token = "GPGA_SCHED_DEFINE_CONSTANTS";
-  size_t token_pos = source.find(token);
-  if (token_pos != std::string::npos) {
-    size_t end = std::min(source.size(), token_pos + kConstSpan);
-    return source.substr(token_pos, end - token_pos);
-  }
-  size_t limit = source.size();
-  size_t kernel_pos = source.find("kernel void gpga_");
-  if (kernel_pos != std::string::npos) {
-    limit = std::min(limit, kernel_pos);
-  }
-  constexpr size_t kMaxPrefix = 2u * 1024u * 1024u;
-  if (limit > kMaxPrefix) {
-    limit = kMaxPrefix;
-  }
-  return source.substr(0, limit);
-}
-
-bool ParseUintConst(const std::string& source, const std::string& name,
-                    uint32_t* value_out) {
-  std::regex pattern("(?:constant\\s+)?constexpr\\s+uint\\s+" + name +
-                     "\\s*=\\s*([0-9]+)u;");
-  std::smatch match;
-  if (!std::regex_search(source, match, pattern)) {
-    return false;
-  }
-  if (match.size() < 2) {
-    return false;
-  }
-  try {
-    *value_out = static_cast<uint32_t>(std::stoul(match[1].str()));
-  } catch (...) {
-    return false;
-  }
-  return true;
-}
-
-bool ParseSchedDefineConstants(const std::string& source,
-                               SchedulerConstants* out) {
-  if (!out) {
-    return false;
-  }
-  const std::string token = "GPGA_SCHED_DEFINE_CONSTANTS";
-  auto parse_args = [&](const std::string& args,
-                        SchedulerConstants* info) -> bool {
-    std::vector<uint32_t> values;
-    for (size_t i = 0; i < args.size();) {
-      while (i < args.size() &&
-             !std::isdigit(static_cast<unsigned char>(args[i]))) {
-        ++i;
-      }
-      if (i >= args.size()) {
-        break;
-      }
-      size_t start = i;
-      while (i < args.size() &&
-             std::isdigit(static_cast<unsigned char>(args[i]))) {
-        ++i;
-      }
-      uint32_t value = 0u;
-      try {
-        value = static_cast<uint32_t>(
-            std::stoul(args.substr(start, i - start)));
-      } catch (...) {
-        return false;
-      }
-      values.push_back(value);
-      while (i < args.size() &&
-             (args[i] == 'u' || args[i] == 'U' || args[i] == 'l' ||
-              args[i] == 'L')) {
-        ++i;
-      }
-    }
-    if (values.size() < 17u) {
-      return false;
-    }
-    info->proc_count = values[0];
-    info->event_count = values[2];
-    info->edge_count = values[3];
-    info->edge_star_count = values[4];
-    info->repeat_count = values[8];
-    info->delay_count = values[9];
-    info->max_dnba = values[10];
-    info->monitor_count = values[11];
-    info->monitor_max_args = values[12];
-    info->strobe_count = values[13];
-    info->service_max_args = values[14];
-    info->service_wide_words = values[15];
-    info->string_count = values[16];
-    if (values.size() > 17u) {
-      info->force_count = values[17];
-    }
-    if (values.size() > 18u) {
-      info->pcont_count = values[18];
-    }
-    info->has_scheduler = info->proc_count > 0u;
-    info->has_services = info->service_max_args > 0u;
-    return true;
-  };
-
-  std::istringstream in(source);
-  std::string line;
-  while (std::getline(in, line)) {
-    std::string trimmed = line;
-    trimmed.erase(trimmed.begin(),
-                  std::find_if(trimmed.begin(), trimmed.end(),
-                               [](unsigned char c) { return c != ' '; }));
-    if (StartsWith(trimmed, "#define")) {
-      continue;
-    }
-    size_t pos = trimmed.find(token);
-    if (pos == std::string::npos) {
-      continue;
-    }
-    size_t open = trimmed.find('(', pos + token.size());
-    size_t close = trimmed.rfind(')');
-    if (open == std::string::npos || close == std::string::npos ||
-        close <= open + 1) {
-      break;
-    }
-    SchedulerConstants info;
-    if (parse_args(trimmed.substr(open + 1, close - open - 1), &info)) {
-      *out = info;
-      return true;
-    }
-  }
-
-  size_t pos = 0;
-  while (true) {
-    pos = source.find(token, pos);
-    if (pos == std::string::npos) {
-      return false;
-    }
-    size_t open = source.find('(', pos + token.size());
-    if (open == std::string::npos) {
-      return false;
-    }
-    size_t close = std::string::npos;
-    int depth = 0;
-    for (size_t i = open; i < source.size(); ++i) {
-      if (source[i] == '(') {
-        depth++;
-      } else if (source[i] == ')') {
-        depth--;
-        if (depth == 0) {
-          close = i;
-          break;
-        }
-      }
-    }
-    if (close == std::string::npos || close <= open + 1) {
-      return false;
-    }
-    SchedulerConstants info;
-    if (parse_args(source.substr(open + 1, close - open - 1), &info)) {
-      *out = info;
-      return true;
-    }
-    pos = close + 1;
-  }
-}
-
 }  // namespace
 
 void LogPipeline(bool enabled, const std::string& message) {
@@ -1644,6 +1098,8 @@ MetalBuffer::~MetalBuffer() {
     handle_ = nullptr;
     contents_ = nullptr;
     length_ = 0;
+  } else if (contents_) {
+    CpuRuntime::ReleaseBuffer(this);
   }
 }
 
@@ -1663,6 +1119,8 @@ MetalBuffer& MetalBuffer::operator=(MetalBuffer&& other) noexcept {
   if (handle_) {
     id<MTLBuffer> buffer = (id<MTLBuffer>)handle_;
     [buffer release];
+  } else if (contents_) {
+    CpuRuntime::ReleaseBuffer(this);
   }
   handle_ = other.handle_;
   contents_ = other.contents_;
@@ -1685,6 +1143,7 @@ MetalKernel::~MetalKernel() {
     [table release];
     argument_table_ = nullptr;
   }
+  host_entry_ = nullptr;
   buffer_indices_.clear();
   max_buffer_bindings_ = 0;
   thread_execution_width_ = 0;
@@ -1695,6 +1154,7 @@ MetalKernel::~MetalKernel() {
 MetalKernel::MetalKernel(MetalKernel&& other) noexcept
     : pipeline_(other.pipeline_),
       argument_table_(other.argument_table_),
+      host_entry_(other.host_entry_),
       name_(std::move(other.name_)),
       buffer_indices_(std::move(other.buffer_indices_)),
       max_buffer_bindings_(other.max_buffer_bindings_),
@@ -1704,6 +1164,7 @@ MetalKernel::MetalKernel(MetalKernel&& other) noexcept
       last_binding_addresses_(std::move(other.last_binding_addresses_)) {
   other.pipeline_ = nullptr;
   other.argument_table_ = nullptr;
+  other.host_entry_ = nullptr;
   other.max_buffer_bindings_ = 0;
   other.thread_execution_width_ = 0;
   other.max_threads_per_threadgroup_ = 0;
@@ -1725,6 +1186,7 @@ MetalKernel& MetalKernel::operator=(MetalKernel&& other) noexcept {
   }
   pipeline_ = other.pipeline_;
   argument_table_ = other.argument_table_;
+  host_entry_ = other.host_entry_;
   name_ = std::move(other.name_);
   buffer_indices_ = std::move(other.buffer_indices_);
   max_buffer_bindings_ = other.max_buffer_bindings_;
@@ -1734,6 +1196,7 @@ MetalKernel& MetalKernel::operator=(MetalKernel&& other) noexcept {
   last_binding_addresses_ = std::move(other.last_binding_addresses_);
   other.pipeline_ = nullptr;
   other.argument_table_ = nullptr;
+  other.host_entry_ = nullptr;
   other.max_buffer_bindings_ = 0;
   other.thread_execution_width_ = 0;
   other.max_threads_per_threadgroup_ = 0;
@@ -1757,6 +1220,17 @@ MetalRuntime::MetalRuntime() : impl_(std::make_unique<Impl>()) {}
 
 MetalRuntime::~MetalRuntime() = default;
 
+void MetalRuntime::SetBackend(RuntimeBackend backend) {
+  if (!impl_) {
+    impl_ = std::make_unique<Impl>();
+  }
+  impl_->backend = backend;
+}
+
+RuntimeBackend MetalRuntime::Backend() const {
+  return impl_ ? impl_->backend : RuntimeBackend::kMetal;
+}
+
 void MetalRuntime::SetPreferSourceBindings(bool value) {
   if (!impl_) {
     impl_ = std::make_unique<Impl>();
@@ -1764,10 +1238,24 @@ void MetalRuntime::SetPreferSourceBindings(bool value) {
   impl_->prefer_source_bindings = value;
 }
 
+void MetalRuntime::SetKernelBindingTables(
+    const std::vector<KernelBindingTable>& tables) {
+  if (!impl_) {
+    impl_ = std::make_unique<Impl>();
+  }
+  impl_->binding_tables = tables;
+}
+
 bool MetalRuntime::Initialize(std::string* error) {
   if (!impl_) {
     impl_ = std::make_unique<Impl>();
   }
+  if (impl_->backend == RuntimeBackend::kCpu) {
+    if (!impl_->cpu) {
+      impl_->cpu = std::make_unique<CpuRuntime>();
+    }
+    return true;
+  }
   if (!impl_->device) {
     impl_->device = MTLCreateSystemDefaultDevice();
   }
@@ -1934,6 +1422,9 @@ bool MetalRuntime::CompileSource(const std::string& source,
   if (!Initialize(error)) {
     return false;
   }
+  if (impl_->cpu) {
+    return impl_->cpu->CompileSource(source, include_paths, error);
+  }
   if (!impl_->compiler) {
     if (error) {
       *error = "Metal 4 compiler unavailable";
@@ -2043,6 +1534,9 @@ bool MetalRuntime::GetLastSource(std::string* out) const {
   if (!out || !impl_) {
     return false;
   }
+  if (impl_->cpu) {
+    return impl_->cpu->GetLastSource(out);
+  }
   *out = impl_->last_source;
   return !impl_->last_source.empty();
 }
@@ -2055,6 +1549,9 @@ bool MetalRuntime::CreateKernel(const std::string& name, MetalKernel* kernel,
     }
     return false;
   }
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->CreateKernel(name, kernel, error);
+  }
   if (!impl_ || !impl_->library) {
     if (error) {
       *error = "Metal library not initialized";
@@ -2352,7 +1849,19 @@ bool MetalRuntime::CreateKernel(const std::string& name, MetalKernel* kernel,
   }
   uint32_t max_index = 0;
   bool has_index = false;
-  if (impl_->prefer_source_bindings && !impl_->last_source.empty()) {
+  const KernelBindingTable* binding_table =
+      impl_->prefer_source_bindings
+          ? FindKernelBindingTable(impl_->binding_tables, name)
+          : nullptr;
+  if (binding_table) {
+    for (const auto& entry : binding_table->buffers) {
+      temp.buffer_indices_[entry.first] = entry.second;
+      if (!has_index || entry.second > max_index) {
+        max_index = entry.second;
+        has_index = true;
+      }
+    }
+  } else if (impl_->prefer_source_bindings && !impl_->last_source.empty()) {
     std::unordered_map<std::string, uint32_t> bindings;
     if (!ParseKernelBindingsFromSource(impl_->last_source, name, &bindings,
                                        error)) {
@@ -2432,7 +1941,7 @@ bool MetalRuntime::PrecompileKernels(const std::vector<std::string>& names,
   if (!Initialize(error)) {
     return false;
   }
-  if (!impl_ || !impl_->pipeline_async) {
+  if (!impl_ || impl_->cpu || !impl_->pipeline_async) {
     return true;
   }
   if (!impl_->library) {
@@ -2646,6 +2155,9 @@ bool MetalRuntime::PrecompileKernels(const std::vector<std::string>& names,
 
 MetalBuffer MetalRuntime::CreateBuffer(size_t length,
                                        const void* initial_data) {
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->CreateBuffer(length, initial_data);
+  }
   MetalBuffer buffer;
   if (!impl_ || !impl_->device || length == 0) {
     return buffer;
@@ -2683,6 +2195,9 @@ bool MetalRuntime::EncodeArgumentBuffer(
     return false;
   }
   *out = MetalBuffer{};
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->EncodeArgumentBuffer(bindings, out, error);
+  }
   if (!impl_ || !impl_->device || !kernel.pipeline_) {
     if (error) {
       *error = "Metal runtime not initialized for argument buffer";
@@ -2753,6 +2268,9 @@ bool MetalRuntime::Dispatch(const MetalKernel& kernel,
                             const std::vector<MetalBufferBinding>& bindings,
                             uint32_t grid_size, std::string* error,
                             uint32_t timeout_ms) {
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->Dispatch(kernel, bindings, grid_size, error);
+  }
   if (!impl_ || !impl_->queue || !impl_->allocator || !kernel.pipeline_) {
     if (error) {
       *error = "Metal runtime not initialized";
@@ -3038,6 +2556,11 @@ bool MetalRuntime::DispatchIndirectThreads(
     const MetalKernel& kernel, const std::vector<MetalBufferBinding>& bindings,
     const MetalBuffer& indirect_buffer, size_t indirect_offset,
     std::string* error, uint32_t timeout_ms) {
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->DispatchIndirectThreads(kernel, bindings,
+                                               indirect_buffer,
+                                               indirect_offset, error);
+  }
   if (!impl_ || !impl_->queue || !impl_->allocator || !kernel.pipeline_) {
     if (error) {
       *error = "Metal runtime not initialized";
@@ -3371,6 +2894,9 @@ uint32_t MetalRuntime::ComputeThreadgroupSize(
   if (!impl_) {
     return 1u;
   }
+  if (impl_->cpu) {
+    return impl_->cpu->ComputeThreadgroupSize(kernel);
+  }
   if (kernel.RequiredThreadsPerThreadgroup() > 0u) {
     return kernel.RequiredThreadsPerThreadgroup();
   }
@@ -3405,6 +2931,9 @@ bool MetalRuntime::DispatchBatch(const std::vector<MetalDispatch>& dispatches,
   if (dispatches.empty()) {
     return true;
   }
+  if (impl_ && impl_->cpu) {
+    return impl_->cpu->DispatchBatch(dispatches, grid_size, error);
+  }
   if (!impl_ || !impl_->queue || !impl_->allocator) {
     if (error) {
       *error = "Metal runtime not initialized";
@@ -3825,817 +3354,4 @@ bool MetalRuntime::DispatchBatch(const std::vector<MetalDispatch>& dispatches,
   return true;
 }
 
-bool ParseSchedulerConstants(const std::string& source,
-                             SchedulerConstants* out,
-                             std::string* error) {
-  if (!out) {
-    if (error) {
-      *error = "scheduler output pointer is null";
-    }
-    return false;
-  }
-  SchedulerConstants info;
-  std::string sliced = SchedulerConstSliceString(source);
-  const bool parsed_define = ParseSchedDefineConstants(sliced, &info);
-  if (!parsed_define) {
-    ParseUintConst(sliced, "GPGA_SCHED_PROC_COUNT", &info.proc_count);
-    ParseUintConst(sliced, "GPGA_SCHED_EVENT_COUNT", &info.event_count);
-    ParseUintConst(sliced, "GPGA_SCHED_EDGE_COUNT", &info.edge_count);
-    ParseUintConst(sliced, "GPGA_SCHED_EDGE_STAR_COUNT",
-                   &info.edge_star_count);
-    ParseUintConst(sliced, "GPGA_SCHED_REPEAT_COUNT", &info.repeat_count);
-    ParseUintConst(sliced, "GPGA_SCHED_DELAY_COUNT", &info.delay_count);
-    ParseUintConst(sliced, "GPGA_SCHED_MAX_DNBA", &info.max_dnba);
-    ParseUintConst(sliced, "GPGA_SCHED_MONITOR_COUNT", &info.monitor_count);
-    ParseUintConst(sliced, "GPGA_SCHED_MONITOR_MAX_ARGS",
-                   &info.monitor_max_args);
-    ParseUintConst(sliced, "GPGA_SCHED_STROBE_COUNT", &info.strobe_count);
-    ParseUintConst(sliced, "GPGA_SCHED_SERVICE_MAX_ARGS",
-                   &info.service_max_args);
-    ParseUintConst(sliced, "GPGA_SCHED_SERVICE_WIDE_WORDS",
-                   &info.service_wide_words);
-    ParseUintConst(sliced, "GPGA_SCHED_STRING_COUNT", &info.string_count);
-    ParseUintConst(sliced, "GPGA_SCHED_FORCE_COUNT", &info.force_count);
-    ParseUintConst(sliced, "GPGA_SCHED_PCONT_COUNT", &info.pcont_count);
-  }
-  ParseUintConst(sliced, "GPGA_SCHED_TIMING_CHECK_COUNT",
-                 &info.timing_check_count);
-  uint32_t vm_enabled = 0u;
-  if (ParseUintConst(sliced, "GPGA_SCHED_VM_ENABLED", &vm_enabled)) {
-    info.vm_enabled = (vm_enabled != 0u);
-  }
-  ParseUintConst(sliced, "GPGA_SCHED_VM_BYTECODE_WORDS",
-                 &info.vm_bytecode_words);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_COND_COUNT", &info.vm_cond_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_ASSIGN_COUNT",
-                 &info.vm_assign_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_FORCE_COUNT",
-                 &info.vm_force_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_RELEASE_COUNT",
-                 &info.vm_release_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_SERVICE_CALL_COUNT",
-                 &info.vm_service_call_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_SERVICE_ASSIGN_COUNT",
-                 &info.vm_service_assign_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_SERVICE_ARG_COUNT",
-                 &info.vm_service_arg_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_CALL_FRAME_WORDS",
-                 &info.vm_call_frame_words);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_CALL_FRAME_DEPTH",
-                 &info.vm_call_frame_depth);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_CASE_HEADER_COUNT",
-                 &info.vm_case_header_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_CASE_ENTRY_COUNT",
-                 &info.vm_case_entry_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_CASE_WORD_COUNT",
-                 &info.vm_case_word_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_EXPR_WORD_COUNT",
-                 &info.vm_expr_word_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_EXPR_IMM_WORD_COUNT",
-                 &info.vm_expr_imm_word_count);
-  ParseUintConst(sliced, "GPGA_SCHED_VM_SIGNAL_COUNT",
-                 &info.vm_signal_count);
-  info.has_scheduler = info.proc_count > 0u;
-  info.has_services = info.service_max_args > 0u;
-  *out = info;
-  return true;
-}
-
-bool BuildBufferSpecs(const ModuleInfo& module, const MetalKernel& kernel,
-                      const SchedulerConstants& sched,
-                      uint32_t instance_count, uint32_t service_capacity,
-                      std::vector<BufferSpec>* specs, std::string* error) {
-  if (!specs) {
-    if (error) {
-      *error = "buffer spec output is null";
-    }
-    return false;
-  }
-  std::unordered_map<std::string, SignalInfo> signals;
-  for (const auto& signal : module.signals) {
-    signals[MslMangleIdentifier(signal.name)] = signal;
-  }
-  auto signal_bytes = [&](const SignalInfo& signal) -> size_t {
-    uint32_t width = signal.width;
-    if (signal.is_real && width < 64u) {
-      width = 64u;
-    }
-    if (width == 0u) {
-      width = 1u;
-    }
-    size_t word_size = (width > 32u) ? sizeof(uint64_t) : sizeof(uint32_t);
-    size_t word_count = (width <= 64u) ? 1u : ((width + 63u) / 64u);
-    return word_size * word_count;
-  };
-  auto signal_elements = [&](const SignalInfo& signal) -> size_t {
-    uint32_t array_size = signal.array_size > 0 ? signal.array_size : 1u;
-    return static_cast<size_t>(instance_count) *
-           static_cast<size_t>(array_size);
-  };
-  auto align8 = [](size_t value) -> size_t {
-    return (value + 7u) & ~static_cast<size_t>(7u);
-  };
-  auto packed_state_bytes = [&]() -> size_t {
-    size_t total = 0;
-    for (const auto& signal : module.signals) {
-      size_t bytes = signal_bytes(signal) * signal_elements(signal);
-      total = align8(total);
-      total += bytes;
-      if (module.four_state) {
-        total = align8(total);
-        total += bytes;
-      }
-      if (signal.is_trireg) {
-        total = align8(total);
-        total += sizeof(uint64_t) * signal_elements(signal);
-      }
-    }
-    if (total == 0) {
-      total = 1;
-    }
-    return total;
-  };
-  specs->clear();
-  const auto& indices = kernel.BufferIndices();
-  const bool use_vm_arg_buffer =
-      sched.vm_enabled && kernel.HasBuffer("sched_vm_args");
-  specs->reserve(indices.size());
-  for (const auto& entry : indices) {
-    BufferSpec spec;
-    spec.name = entry.first;
-    const std::string& name = spec.name;
-    if (name == "sched_vm_args") {
-      continue;
-    }
-    if (name == "gpga_state") {
-      spec.length = packed_state_bytes();
-      specs->push_back(spec);
-      continue;
-    }
-    if (name == "nb_state") {
-      spec.length = packed_state_bytes();
-      specs->push_back(spec);
-      continue;
-    }
-    if (name == "params") {
-      spec.length = sizeof(GpgaParams);
-      specs->push_back(spec);
-      continue;
-    }
-    if (name == "sched") {
-      spec.length = sizeof(GpgaSchedParams);
-      specs->push_back(spec);
-      continue;
-    }
-    if (StartsWith(name, "sched_")) {
-      if (!sched.has_scheduler) {
-        if (error) {
-          *error = "scheduler buffers requested but no scheduler constants";
-        }
-        return false;
-      }
-      if (StartsWith(name, "sched_vm_") && !sched.vm_enabled) {
-        if (error) {
-          *error = "scheduler VM buffers requested but VM not enabled";
-        }
-        return false;
-      }
-      if (name == "sched_pc" || name == "sched_state" ||
-          name == "sched_wait_kind" || name == "sched_wait_edge_kind" ||
-          name == "sched_wait_id" || name == "sched_wait_event" ||
-          name == "sched_join_count" || name == "sched_parent" ||
-          name == "sched_join_tag") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.proc_count;
-      } else if (name == "sched_wait_time") {
-        spec.length = sizeof(uint64_t) * instance_count * sched.proc_count;
-      } else if (name == "sched_time") {
-        spec.length = sizeof(uint64_t) * instance_count;
-      } else if (name == "sched_phase" || name == "sched_flags" ||
-                 name == "sched_error" || name == "sched_status" ||
-                 name == "sched_halt_mode") {
-        spec.length = sizeof(uint32_t) * instance_count;
-      } else if (name == "sched_repeat_left" ||
-                 name == "sched_repeat_active") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.repeat_count;
-      } else if (name == "sched_edge_prev_val" ||
-                 name == "sched_edge_prev_xz") {
-        spec.length = sizeof(uint64_t) * instance_count * sched.edge_count;
-      } else if (name == "sched_edge_star_prev_val" ||
-                 name == "sched_edge_star_prev_xz") {
-        spec.length = sizeof(uint64_t) * instance_count *
-                      sched.edge_star_count;
-      } else if (name == "sched_timing_prev_val" ||
-                 name == "sched_timing_prev_xz") {
-        spec.length = sizeof(uint64_t) * instance_count *
-                      sched.timing_check_count * 2u;
-      } else if (name == "sched_timing_data_time" ||
-                 name == "sched_timing_ref_time" ||
-                 name == "sched_timing_window_start" ||
-                 name == "sched_timing_window_end") {
-        spec.length = sizeof(uint64_t) * instance_count *
-                      sched.timing_check_count;
-      } else if (name == "sched_event_pending") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.event_count;
-      } else if (name == "sched_delay_val" || name == "sched_delay_xz") {
-        spec.length = sizeof(uint64_t) * instance_count * sched.delay_count;
-      } else if (name == "sched_delay_index_val" ||
-                 name == "sched_delay_index_xz") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.delay_count;
-      } else if (name == "sched_dnba_count") {
-        spec.length = sizeof(uint32_t) * instance_count;
-      } else if (name == "sched_dnba_time" || name == "sched_dnba_val" ||
-                 name == "sched_dnba_xz") {
-        spec.length = sizeof(uint64_t) * instance_count * sched.max_dnba;
-      } else if (name == "sched_dnba_id" ||
-                 name == "sched_dnba_index_val" ||
-                 name == "sched_dnba_index_xz") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.max_dnba;
-      } else if (name == "sched_monitor_active") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.monitor_count;
-      } else if (name == "sched_monitor_enable") {
-        spec.length = sizeof(uint32_t) * instance_count;
-      } else if (name == "sched_monitor_val" ||
-                 name == "sched_monitor_xz") {
-        spec.length = sizeof(uint64_t) * instance_count * sched.monitor_count *
-                      sched.monitor_max_args;
-      } else if (name == "sched_monitor_wide_val" ||
-                 name == "sched_monitor_wide_xz") {
-        if (sched.service_wide_words == 0u) {
-          if (error) {
-            *error = "scheduler wide monitor buffer requested without wide words";
-          }
-          return false;
-        }
-        spec.length = sizeof(uint64_t) * instance_count * sched.monitor_count *
-                      sched.monitor_max_args * sched.service_wide_words;
-      } else if (name == "sched_strobe_pending") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.strobe_count;
-      } else if (name == "sched_service_count") {
-        spec.length = sizeof(uint32_t) * instance_count * 2u;
-      } else if (name == "sched_service_head") {
-        spec.length = sizeof(uint32_t) * instance_count;
-      } else if (name == "sched_service") {
-        size_t stride =
-            ServiceRecordStride(std::max<uint32_t>(1, sched.service_max_args),
-                                sched.service_wide_words, module.four_state);
-        spec.length = stride * instance_count * service_capacity;
-      } else if (name == "sched_ready") {
-        const size_t stride =
-            static_cast<size_t>(instance_count) * sched.proc_count;
-        spec.length = sizeof(uint32_t) *
-                      ((stride * 2u) + instance_count + 6u);
-      } else if (name == "sched_force_id") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.force_count;
-      } else if (name == "sched_passign_id") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.pcont_count;
-      } else if (name == "sched_force_state") {
-        spec.length = packed_state_bytes();
-      } else if (name == "sched_vm_bytecode") {
-        if (sched.vm_bytecode_words == 0u) {
-          if (error) {
-            *error = "sched_vm_bytecode requested without bytecode words";
-          }
-          return false;
-        }
-        spec.length =
-            sizeof(uint32_t) * instance_count * sched.vm_bytecode_words;
-      } else if (name == "sched_vm_cond_val" ||
-                 name == "sched_vm_cond_xz") {
-        if (sched.vm_cond_count == 0u) {
-          if (error) {
-            *error = "sched_vm_cond buffers requested without cond sizing";
-          }
-          return false;
-        }
-        spec.length = sizeof(uint32_t) * instance_count * sched.proc_count *
-                      sched.vm_cond_count;
-      } else if (name == "sched_vm_cond_entry") {
-        const size_t count =
-            (sched.vm_cond_count > 0u) ? sched.vm_cond_count : 1u;
-        spec.length = sizeof(uint32_t) * 4u * count;
-      } else if (name == "sched_vm_signal_entry") {
-        const size_t count =
-            (sched.vm_signal_count > 0u) ? sched.vm_signal_count : 1u;
-        spec.length = sizeof(uint32_t) * 5u * count;
-      } else if (name == "sched_vm_proc_bytecode_offset" ||
-                 name == "sched_vm_proc_bytecode_length" ||
-                 name == "sched_vm_ip" ||
-                 name == "sched_vm_call_sp") {
-        spec.length = sizeof(uint32_t) * instance_count * sched.proc_count;
-      } else if (name == "sched_vm_call_frame") {
-        if (sched.vm_call_frame_words == 0u || sched.vm_call_frame_depth == 0u) {
-          if (error) {
-            *error = "sched_vm_call_frame requested without frame sizing";
-          }
-          return false;
-        }
-        spec.length = sizeof(uint32_t) * instance_count * sched.proc_count *
-                      sched.vm_call_frame_words * sched.vm_call_frame_depth;
-      } else if (name == "sched_vm_debug") {
-        spec.length = sizeof(uint32_t) * instance_count *
-                      GPGA_SCHED_VM_DEBUG_WORDS;
-      } else if (name == "sched_vm_case_header") {
-        const size_t count =
-            (sched.vm_case_header_count > 0u) ? sched.vm_case_header_count : 1u;
-        spec.length = sizeof(GpgaSchedVmCaseHeader) * count;
-      } else if (name == "sched_vm_case_entry") {
-        const size_t count =
-            (sched.vm_case_entry_count > 0u) ? sched.vm_case_entry_count : 1u;
-        spec.length = sizeof(uint32_t) * 3u * count;
-      } else if (name == "sched_vm_case_words") {
-        const size_t count =
-            (sched.vm_case_word_count > 0u) ? sched.vm_case_word_count : 1u;
-        spec.length = sizeof(uint64_t) * count;
-      } else if (name == "sched_vm_expr") {
-        const size_t count =
-            (sched.vm_expr_word_count > 0u) ? sched.vm_expr_word_count : 1u;
-        spec.length = sizeof(uint32_t) * count;
-      } else if (name == "sched_vm_expr_imm") {
-        const size_t count = (sched.vm_expr_imm_word_count > 0u)
-                                 ? sched.vm_expr_imm_word_count
-                                 : 1u;
-        spec.length = sizeof(uint32_t) * count;
-      } else if (name == "sched_vm_assign_entry") {
-        const size_t count =
-            (sched.vm_assign_count > 0u) ? sched.vm_assign_count : 1u;
-        spec.length = sizeof(GpgaSchedVmAssignEntry) * count;
-      } else if (name == "sched_vm_force_entry") {
-        const size_t count =
-            (sched.vm_force_count > 0u) ? sched.vm_force_count : 1u;
-        spec.length = sizeof(uint32_t) * 6u * count;
-      } else if (name == "sched_vm_release_entry") {
-        const size_t count =
-            (sched.vm_release_count > 0u) ? sched.vm_release_count : 1u;
-        spec.length = sizeof(uint32_t) * 4u * count;
-      } else if (name == "sched_vm_service_entry") {
-        const size_t count = (sched.vm_service_call_count > 0u)
-                                 ? sched.vm_service_call_count
-                                 : 1u;
-        spec.length = sizeof(GpgaSchedVmServiceEntry) * count;
-      } else if (name == "sched_vm_service_arg") {
-        const size_t count = (sched.vm_service_arg_count > 0u)
-                                 ? sched.vm_service_arg_count
-                                 : 1u;
-        spec.length = sizeof(GpgaSchedVmServiceArg) * count;
-      } else if (name == "sched_vm_service_ret_assign_entry") {
-        const size_t count = (sched.vm_service_assign_count > 0u)
-                                 ? sched.vm_service_assign_count
-                                 : 1u;
-        spec.length = sizeof(GpgaSchedVmServiceRetAssignEntry) * count;
-      } else if (name == "sched_vm_delay_assign_entry") {
-        const size_t count =
-            (sched.delay_count > 0u) ? sched.delay_count : 1u;
-        spec.length = sizeof(uint32_t) * 11u * count;
-      } else {
-        if (error) {
-          *error = "unknown scheduler buffer: " + name;
-        }
-        return false;
-      }
-      specs->push_back(spec);
-      continue;
-    }
-
-    std::string base = name;
-    if (StartsWith(base, "nb_")) {
-      base = base.substr(3);
-    }
-    if (EndsWith(base, "_val")) {
-      base = base.substr(0, base.size() - 4);
-    } else if (EndsWith(base, "_xz")) {
-      base = base.substr(0, base.size() - 3);
-    }
-    if (EndsWith(base, "_next")) {
-      base = base.substr(0, base.size() - 5);
-    }
-    auto it = signals.find(base);
-    if (it == signals.end()) {
-      if (error) {
-        *error = "unknown signal buffer: " + name;
-      }
-      return false;
-    }
-    const SignalInfo& signal = it->second;
-    spec.length = signal_bytes(signal) * signal_elements(signal);
-    specs->push_back(spec);
-  }
-  if (use_vm_arg_buffer) {
-    auto push_vm = [&](const std::string& name, size_t length) {
-      BufferSpec spec;
-      spec.name = name;
-      spec.length = length;
-      specs->push_back(spec);
-    };
-    if (sched.vm_bytecode_words == 0u) {
-      if (error) {
-        *error = "sched_vm_bytecode requested without bytecode words";
-      }
-      return false;
-    }
-    push_vm("sched_vm_bytecode",
-            sizeof(uint32_t) * instance_count * sched.vm_bytecode_words);
-    if (sched.vm_cond_count == 0u) {
-      if (error) {
-        *error = "sched_vm_cond buffers requested without cond sizing";
-      }
-      return false;
-    }
-    const size_t cond_len = sizeof(uint32_t) * instance_count *
-                            sched.proc_count * sched.vm_cond_count;
-    push_vm("sched_vm_cond_val", cond_len);
-    push_vm("sched_vm_cond_xz", cond_len);
-    {
-      const size_t count =
-          (sched.vm_cond_count > 0u) ? sched.vm_cond_count : 1u;
-      push_vm("sched_vm_cond_entry", sizeof(uint32_t) * 4u * count);
-    }
-    {
-      const size_t count =
-          (sched.vm_signal_count > 0u) ? sched.vm_signal_count : 1u;
-      push_vm("sched_vm_signal_entry", sizeof(uint32_t) * 5u * count);
-    }
-    const size_t proc_words =
-        sizeof(uint32_t) * instance_count * sched.proc_count;
-    push_vm("sched_vm_proc_bytecode_offset", proc_words);
-    push_vm("sched_vm_proc_bytecode_length", proc_words);
-    push_vm("sched_vm_ip", proc_words);
-    push_vm("sched_vm_call_sp", proc_words);
-    if (sched.vm_call_frame_words == 0u || sched.vm_call_frame_depth == 0u) {
-      if (error) {
-        *error = "sched_vm_call_frame requested without frame sizing";
-      }
-      return false;
-    }
-    push_vm("sched_vm_call_frame",
-            sizeof(uint32_t) * instance_count * sched.proc_count *
-                sched.vm_call_frame_words * sched.vm_call_frame_depth);
-    {
-      const size_t count = (sched.vm_case_header_count > 0u)
-                               ? sched.vm_case_header_count
-                               : 1u;
-      push_vm("sched_vm_case_header", sizeof(GpgaSchedVmCaseHeader) * count);
-    }
-    {
-      const size_t count = (sched.vm_case_entry_count > 0u)
-                               ? sched.vm_case_entry_count
-                               : 1u;
-      push_vm("sched_vm_case_entry", sizeof(uint32_t) * 3u * count);
-    }
-    {
-      const size_t count = (sched.vm_case_word_count > 0u)
-                               ? sched.vm_case_word_count
-                               : 1u;
-      push_vm("sched_vm_case_words", sizeof(uint64_t) * count);
-    }
-    {
-      const size_t count = (sched.vm_expr_word_count > 0u)
-                               ? sched.vm_expr_word_count
-                               : 1u;
-      push_vm("sched_vm_expr", sizeof(uint32_t) * count);
-    }
-    {
-      const size_t count = (sched.vm_expr_imm_word_count > 0u)
-                               ? sched.vm_expr_imm_word_count
-                               : 1u;
-      push_vm("sched_vm_expr_imm", sizeof(uint32_t) * count);
-    }
-    {
-      const size_t count =
-          (sched.vm_assign_count > 0u) ? sched.vm_assign_count : 1u;
-      push_vm("sched_vm_assign_entry", sizeof(GpgaSchedVmAssignEntry) * count);
-    }
-    {
-      const size_t count =
-          (sched.vm_force_count > 0u) ? sched.vm_force_count : 1u;
-      push_vm("sched_vm_force_entry", sizeof(uint32_t) * 6u * count);
-    }
-    {
-      const size_t count =
-          (sched.vm_release_count > 0u) ? sched.vm_release_count : 1u;
-      push_vm("sched_vm_release_entry", sizeof(uint32_t) * 4u * count);
-    }
-    {
-      const size_t count = (sched.vm_service_call_count > 0u)
-                               ? sched.vm_service_call_count
-                               : 1u;
-      push_vm("sched_vm_service_entry",
-              sizeof(GpgaSchedVmServiceEntry) * count);
-    }
-    {
-      const size_t count = (sched.vm_service_arg_count > 0u)
-                               ? sched.vm_service_arg_count
-                               : 1u;
-      push_vm("sched_vm_service_arg",
-              sizeof(GpgaSchedVmServiceArg) * count);
-    }
-    {
-      const size_t count = (sched.vm_service_assign_count > 0u)
-                               ? sched.vm_service_assign_count
-                               : 1u;
-      push_vm("sched_vm_service_ret_assign_entry",
-              sizeof(GpgaSchedVmServiceRetAssignEntry) * count);
-    }
-    {
-      const size_t count = (sched.delay_count > 0u) ? sched.delay_count : 1u;
-      push_vm("sched_vm_delay_assign_entry", sizeof(uint32_t) * 11u * count);
-    }
-  }
-  return true;
-}
-
-size_t ServiceRecordStride(uint32_t max_args, uint32_t wide_words,
-                           bool has_xz) {
-  size_t header = sizeof(uint32_t) * 4u;
-  size_t arg_kind = sizeof(uint32_t) * max_args;
-  size_t arg_width = sizeof(uint32_t) * max_args;
-  size_t arg_val = sizeof(uint64_t) * max_args;
-  size_t arg_xz = has_xz ? sizeof(uint64_t) * max_args : 0u;
-  size_t arg_wide_val = sizeof(uint64_t) * max_args * wide_words;
-  size_t arg_wide_xz = has_xz ? sizeof(uint64_t) * max_args * wide_words : 0u;
-  return header + arg_kind + arg_width + arg_val + arg_xz + arg_wide_val +
-         arg_wide_xz;
-}
-
-ServiceDrainResult DrainSchedulerServices(
-    const void* records, uint32_t record_count, uint32_t max_args,
-    uint32_t wide_words, bool has_xz, const ServiceStringTable& strings,
-    std::ostream& out) {
-  ServiceDrainResult result;
-  if (!records || record_count == 0 || max_args == 0) {
-    return result;
-  }
-  const auto* base = static_cast<const uint8_t*>(records);
-  const size_t stride = ServiceRecordStride(max_args, wide_words, has_xz);
-  for (uint32_t i = 0; i < record_count; ++i) {
-    const uint8_t* rec = base + (stride * i);
-    uint32_t kind_raw = ReadU32(rec, 0);
-    uint32_t pid = ReadU32(rec, sizeof(uint32_t));
-    uint32_t format_id = ReadU32(rec, sizeof(uint32_t) * 2u);
-    uint32_t arg_count = ReadU32(rec, sizeof(uint32_t) * 3u);
-    if (arg_count > max_args) {
-      arg_count = max_args;
-    }
-
-    size_t offset = sizeof(uint32_t) * 4u;
-    const size_t arg_kind_offset = offset;
-    const size_t arg_width_offset =
-        arg_kind_offset + sizeof(uint32_t) * max_args;
-    const size_t arg_val_offset =
-        arg_width_offset + sizeof(uint32_t) * max_args;
-    const size_t arg_xz_offset = arg_val_offset + sizeof(uint64_t) * max_args;
-    const size_t arg_wide_val_offset =
-        arg_xz_offset + (has_xz ? sizeof(uint64_t) * max_args : 0u);
-    const size_t arg_wide_xz_offset =
-        arg_wide_val_offset +
-        sizeof(uint64_t) * max_args * static_cast<size_t>(wide_words);
-
-    auto read_arg = [&](uint32_t index) -> ServiceArgView {
-      ServiceArgView arg;
-      arg.kind =
-          static_cast<ServiceArgKind>(ReadU32(rec, arg_kind_offset +
-                                                        sizeof(uint32_t) * index));
-      arg.width = ReadU32(rec, arg_width_offset + sizeof(uint32_t) * index);
-      arg.value = ReadU64(rec, arg_val_offset + sizeof(uint64_t) * index);
-      if (has_xz) {
-        arg.xz = ReadU64(rec, arg_xz_offset + sizeof(uint64_t) * index);
-      }
-      if (arg.kind == ServiceArgKind::kWide && wide_words > 0u) {
-        uint32_t word_count = (arg.width + 63u) / 64u;
-        size_t base =
-            arg_wide_val_offset +
-            sizeof(uint64_t) * (static_cast<size_t>(index) * wide_words);
-        arg.wide_value.resize(word_count, 0ull);
-        for (uint32_t w = 0; w < word_count; ++w) {
-          arg.wide_value[w] =
-              ReadU64(rec, base + sizeof(uint64_t) * w);
-        }
-        if (has_xz) {
-          size_t xz_base =
-              arg_wide_xz_offset +
-              sizeof(uint64_t) * (static_cast<size_t>(index) * wide_words);
-          arg.wide_xz.resize(word_count, 0ull);
-          for (uint32_t w = 0; w < word_count; ++w) {
-            arg.wide_xz[w] =
-                ReadU64(rec, xz_base + sizeof(uint64_t) * w);
-          }
-        }
-      }
-      return arg;
-    };
-
-    std::vector<ServiceArgView> args;
-    args.reserve(arg_count);
-    for (uint32_t a = 0; a < arg_count; ++a) {
-      args.push_back(read_arg(a));
-    }
-
-    ServiceKind kind = static_cast<ServiceKind>(kind_raw);
-    switch (kind) {
-      case ServiceKind::kFinish:
-        result.saw_finish = true;
-        out << "$finish (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kStop:
-        result.saw_stop = true;
-        out << "$stop (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kDisplay:
-      case ServiceKind::kWrite:
-      case ServiceKind::kMonitor:
-      case ServiceKind::kStrobe: {
-        std::string fmt = (format_id != 0xFFFFFFFFu)
-                              ? ResolveString(strings, format_id)
-                              : "";
-        size_t start_index = 0;
-        if (!fmt.empty() && !args.empty() &&
-            args.front().kind == ServiceArgKind::kString &&
-            args.front().value == static_cast<uint64_t>(format_id)) {
-          start_index = 1;
-        }
-        std::string line =
-            fmt.empty() ? FormatDefaultArgs(args, strings, has_xz)
-                        : FormatWithSpec(fmt, args, start_index, strings,
-                                         has_xz);
-        out << line;
-        if (kind != ServiceKind::kWrite) {
-          out << "\n";
-        }
-        break;
-      }
-      case ServiceKind::kSformat:
-        out << "$sformat (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kTimeformat:
-        out << "$timeformat (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kPrinttimescale:
-        out << "$printtimescale (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kTestPlusargs:
-        out << "$test$plusargs (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kValuePlusargs:
-        out << "$value$plusargs (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kAsyncAndArray:
-      case ServiceKind::kSyncOrPlane:
-      case ServiceKind::kAsyncNorPlane:
-      case ServiceKind::kSyncNandPlane: {
-        const char* label = "$async$and$array";
-        switch (kind) {
-          case ServiceKind::kSyncOrPlane:
-            label = "$sync$or$plane";
-            break;
-          case ServiceKind::kAsyncNorPlane:
-            label = "$async$nor$plane";
-            break;
-          case ServiceKind::kSyncNandPlane:
-            label = "$sync$nand$plane";
-            break;
-          default:
-            break;
-        }
-        out << label << " (pid=" << pid << ")";
-        for (uint32_t a = 0; a < arg_count; ++a) {
-          const ServiceArgView& arg = args[a];
-          out << " ";
-          if (arg.kind == ServiceArgKind::kString ||
-              arg.kind == ServiceArgKind::kIdent) {
-            out << ResolveString(strings,
-                                 static_cast<uint32_t>(arg.value));
-          } else {
-            out << FormatNumeric(arg, 'h', has_xz);
-          }
-        }
-        out << "\n";
-        break;
-      }
-      case ServiceKind::kDumpfile: {
-        std::string filename = ResolveString(strings, format_id);
-        out << "$dumpfile \"" << filename << "\" (pid=" << pid << ")\n";
-        break;
-      }
-      case ServiceKind::kDumpvars: {
-        out << "$dumpvars (pid=" << pid << ")";
-        for (uint32_t a = 0; a < arg_count; ++a) {
-          const ServiceArgView& arg = args[a];
-          out << " ";
-          if (arg.kind == ServiceArgKind::kString ||
-              arg.kind == ServiceArgKind::kIdent) {
-            out << ResolveString(strings,
-                                 static_cast<uint32_t>(arg.value));
-          } else {
-            out << FormatNumeric(arg, 'h', has_xz);
-          }
-        }
-        out << "\n";
-        break;
-      }
-      case ServiceKind::kShowcancelled: {
-        out << "$showcancelled (pid=" << pid << ")";
-        if (arg_count > 0u) {
-          out << " delay_id=" << FormatNumeric(args[0], 'h', has_xz);
-        }
-        if (arg_count > 1u) {
-          out << " index=" << FormatNumeric(args[1], 'h', has_xz);
-        }
-        if (arg_count > 2u) {
-          out << " index_xz=" << FormatNumeric(args[2], 'h', has_xz);
-        }
-        if (arg_count > 3u) {
-          out << " time=" << FormatNumeric(args[3], 'd', has_xz);
-        }
-        out << "\n";
-        break;
-      }
-      case ServiceKind::kDumpoff:
-        out << "$dumpoff (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kDumpon:
-        out << "$dumpon (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kDumpflush:
-        out << "$dumpflush (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kDumpall:
-        out << "$dumpall (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kDumplimit: {
-        out << "$dumplimit (pid=" << pid << ")";
-        if (!args.empty()) {
-          out << " " << FormatNumeric(args.front(), 'h', has_xz);
-        }
-        out << "\n";
-        break;
-      }
-      case ServiceKind::kFtell:
-        out << "$ftell (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kRewind:
-        out << "$rewind (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kFseek:
-        out << "$fseek (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kFflush:
-        out << "$fflush (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kFerror:
-        out << "$ferror (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kFungetc:
-        out << "$ungetc (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kFread:
-        out << "$fread (pid=" << pid << ")\n";
-        break;
-      case ServiceKind::kReadmemh:
-      case ServiceKind::kReadmemb: {
-        std::string label =
-            (kind == ServiceKind::kReadmemh) ? "$readmemh" : "$readmemb";
-        std::string filename = ResolveString(strings, format_id);
-        out << label << " \"" << filename << "\" (pid=" << pid << ")";
-        for (uint32_t a = 0; a < arg_count; ++a) {
-          const ServiceArgView& arg = args[a];
-          out << " ";
-          if (arg.kind == ServiceArgKind::kString ||
-              arg.kind == ServiceArgKind::kIdent) {
-            out << ResolveString(strings,
-                                 static_cast<uint32_t>(arg.value));
-          } else {
-            out << FormatNumeric(arg, 'h', has_xz);
-          }
-        }
-        out << "\n";
-        break;
-      }
-      case ServiceKind::kWritememh:
-      case ServiceKind::kWritememb: {
-        std::string label =
-            (kind == ServiceKind::kWritememh) ? "$writememh" : "$writememb";
-        std::string filename = ResolveString(strings, format_id);
-        out << label << " \"" << filename << "\" (pid=" << pid << ")";
-        for (uint32_t a = 0; a < arg_count; ++a) {
-          const ServiceArgView& arg = args[a];
-          out << " ";
-          if (arg.kind == ServiceArgKind::kString ||
-              arg.kind == ServiceArgKind::kIdent) {
-            out << ResolveString(strings,
-                                 static_cast<uint32_t>(arg.value));
-          } else {
-            out << FormatNumeric(arg, 'h', has_xz);
-          }
-        }
-        out << "\n";
-        break;
-      }
-      default:
-        result.saw_error = true;
-        out << "unknown service kind " << kind_raw << " (pid=" << pid << ")\n";
-        break;
-    }
-  }
-  return result;
-}
-
 }  // namespace gpga
@@ -0,0 +1,180 @@
+#include "runtime/metal_runtime.hh"
+
+#include <limits>
+#include <utility>
+
+#include "runtime/cpu_runtime.hh"
+
+// MetalRuntime for hosts without Metal (Linux build servers): the CPU backend
+// is the only one available, so every call goes straight to CpuRuntime.
+
+namespace gpga {
+
+MetalBuffer::~MetalBuffer() {
+  if (contents_) {
+    CpuRuntime::ReleaseBuffer(this);
+  }
+}
+
+MetalBuffer::MetalBuffer(MetalBuffer&& other) noexcept {
+  handle_ = other.handle_;
+  contents_ = other.contents_;
+  length_ = other.length_;
+  other.handle_ = nullptr;
+  other.contents_ = nullptr;
+  other.length_ = 0;
+}
+
+MetalBuffer& MetalBuffer::operator=(MetalBuffer&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  if (contents_) {
+    CpuRuntime::ReleaseBuffer(this);
+  }
+  handle_ = other.handle_;
+  contents_ = other.contents_;
+  length_ = other.length_;
+  other.handle_ = nullptr;
+  other.contents_ = nullptr;
+  other.length_ = 0;
+  return *this;
+}
+
+MetalKernel::~MetalKernel() = default;
+
+MetalKernel::MetalKernel(MetalKernel&& other) noexcept
+    : pipeline_(other.pipeline_),
+      argument_table_(other.argument_table_),
+      host_entry_(other.host_entry_),
+      name_(std::move(other.name_)),
+      buffer_indices_(std::move(other.buffer_indices_)),
+      max_buffer_bindings_(other.max_buffer_bindings_),
+      thread_execution_width_(other.thread_execution_width_),
+      max_threads_per_threadgroup_(other.max_threads_per_threadgroup_),
+      required_threads_per_threadgroup_(other.required_threads_per_threadgroup_),
+      last_binding_addresses_(std::move(other.last_binding_addresses_)) {
+  other.pipeline_ = nullptr;
+  other.argument_table_ = nullptr;
+  other.host_entry_ = nullptr;
+  other.max_buffer_bindings_ = 0;
+  other.thread_execution_width_ = 0;
+  other.max_threads_per_threadgroup_ = 0;
+  other.required_threads_per_threadgroup_ = 0;
+}
+
+MetalKernel& MetalKernel::operator=(MetalKernel&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  pipeline_ = other.pipeline_;
+  argument_table_ = other.argument_table_;
+  host_entry_ = other.host_entry_;
+  name_ = std::move(other.name_);
+  buffer_indices_ = std::move(other.buffer_indices_);
+  max_buffer_bindings_ = other.max_buffer_bindings_;
+  thread_execution_width_ = other.thread_execution_width_;
+  max_threads_per_threadgroup_ = other.max_threads_per_threadgroup_;
+  required_threads_per_threadgroup_ = other.required_threads_per_threadgroup_;
+  last_binding_addresses_ = std::move(other.last_binding_addresses_);
+  other.pipeline_ = nullptr;
+  other.argument_table_ = nullptr;
+  other.host_entry_ = nullptr;
+  other.max_buffer_bindings_ = 0;
+  other.thread_execution_width_ = 0;
+  other.max_threads_per_threadgroup_ = 0;
+  other.required_threads_per_threadgroup_ = 0;
+  return *this;
+}
+
+uint32_t MetalKernel::BufferIndex(const std::string& name) const {
+  auto it = buffer_indices_.find(name);
+  if (it == buffer_indices_.end()) {
+    return std::numeric_limits<uint32_t>::max();
+  }
+  return it->second;
+}
+
+bool MetalKernel::HasBuffer(const std::string& name) const {
+  return buffer_indices_.find(name) != buffer_indices_.end();
+}
+
+struct MetalRuntime::Impl {
+  CpuRuntime cpu;
+};
+
+MetalRuntime::MetalRuntime() : impl_(std::make_unique<Impl>()) {}
+
+MetalRuntime::~MetalRuntime() = default;
+
+void MetalRuntime::SetBackend(RuntimeBackend) {}
+
+RuntimeBackend MetalRuntime::Backend() const { return RuntimeBackend::kCpu; }
+
+bool MetalRuntime::Initialize(std::string*) { return true; }
+
+// Bindings always come from the source on the CPU backend.
+void MetalRuntime::SetPreferSourceBindings(bool) {}
+
+void MetalRuntime::SetKernelBindingTables(
+    const std::vector<KernelBindingTable>&) {}
+
+bool MetalRuntime::CompileSource(const std::string& source,
+                                 const std::vector<std::string>& include_paths,
+                                 std::string* error) {
+  return impl_->cpu.CompileSource(source, include_paths, error);
+}
+
+bool MetalRuntime::GetLastSource(std::string* out) const {
+  return impl_->cpu.GetLastSource(out);
+}
+
+bool MetalRuntime::CreateKernel(const std::string& name, MetalKernel* kernel,
+                                std::string* error) {
+  return impl_->cpu.CreateKernel(name, kernel, error);
+}
+
+bool MetalRuntime::PrecompileKernels(const std::vector<std::string>&,
+                                     std::string*) {
+  return true;
+}
+
+MetalBuffer MetalRuntime::CreateBuffer(size_t length,
+                                       const void* initial_data) {
+  return impl_->cpu.CreateBuffer(length, initial_data);
+}
+
+bool MetalRuntime::EncodeArgumentBuffer(
+    const MetalKernel&, uint32_t,
+    const std::vector<MetalBufferBinding>& bindings, MetalBuffer* out,
+    std::string* error) {
+  return impl_->cpu.EncodeArgumentBuffer(bindings, out, error);
+}
+
+bool MetalRuntime::Dispatch(const MetalKernel& kernel,
+                            const std::vector<MetalBufferBinding>& bindings,
+                            uint32_t grid_size, std::string* error,
+                            uint32_t) {
+  return impl_->cpu.Dispatch(kernel, bindings, grid_size, error);
+}
+
+bool MetalRuntime::DispatchIndirectThreads(
+    const MetalKernel& kernel, const std::vector<MetalBufferBinding>& bindings,
+    const MetalBuffer& indirect_buffer, size_t indirect_offset,
+    std::string* error, uint32_t) {
+  return impl_->cpu.DispatchIndirectThreads(kernel, bindings, indirect_buffer,
+                                            indirect_offset, error);
+}
+
+bool MetalRuntime::DispatchBatch(const std::vector<MetalDispatch>& dispatches,
+                                 uint32_t grid_size, std::string* error,
+                                 uint32_t) {
+  return impl_->cpu.DispatchBatch(dispatches, grid_size, error);
+}
+
+uint32_t MetalRuntime::ComputeThreadgroupSize(
+    const MetalKernel& kernel) const {
+  return impl_->cpu.ComputeThreadgroupSize(kernel);
+}
+
+}  // namespace gpga
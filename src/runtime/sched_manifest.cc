@@ -0,0 +1,698 @@
+#include "runtime/sched_manifest.hh"
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/msl_naming.hh"
+
+namespace gpga {
+
+namespace {
+
+struct ManifestHeader {
+  uint32_t magic = kSchedulerManifestMagic;
+  uint32_t version = kSchedulerManifestVersion;
+  uint32_t header_bytes = 0u;
+  uint32_t section_count = 0u;
+  uint64_t total_bytes = 0u;
+  uint64_t source_bytes = 0u;
+  uint64_t source_hash = 0u;
+};
+
+struct ManifestSectionEntry {
+  uint32_t id = 0u;
+  uint32_t reserved = 0u;
+  uint64_t offset = 0u;
+  uint64_t size = 0u;
+};
+
+static_assert(sizeof(ManifestHeader) == 40u, "manifest header layout");
+static_assert(sizeof(ManifestSectionEntry) == 24u, "manifest section layout");
+
+class ByteWriter {
+ public:
+  explicit ByteWriter(std::string* out) : out_(out) {}
+
+  void U32(uint32_t value) { Raw(&value, sizeof(value)); }
+  void U64(uint64_t value) { Raw(&value, sizeof(value)); }
+  void Str(const std::string& value) {
+    U32(static_cast<uint32_t>(value.size()));
+    Raw(value.data(), value.size());
+  }
+  void Raw(const void* data, size_t size) {
+    out_->append(static_cast<const char*>(data), size);
+  }
+  template <typename T>
+  void Vec(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "manifest vectors must be trivially copyable");
+    U64(static_cast<uint64_t>(values.size()));
+    if (!values.empty()) {
+      Raw(values.data(), values.size() * sizeof(T));
+    }
+  }
+
+ private:
+  std::string* out_;
+};
+
+class ByteReader {
+ public:
+  ByteReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  bool U32(uint32_t* value) { return Raw(value, sizeof(*value)); }
+  bool U64(uint64_t* value) { return Raw(value, sizeof(*value)); }
+  bool Str(std::string* value) {
+    uint32_t len = 0u;
+    if (!U32(&len) || len > size_ - pos_) {
+      return false;
+    }
+    value->assign(reinterpret_cast<const char*>(data_ + pos_), len);
+    pos_ += len;
+    return true;
+  }
+  bool Raw(void* out, size_t size) {
+    if (size > size_ - pos_) {
+      return false;
+    }
+    std::memcpy(out, data_ + pos_, size);
+    pos_ += size;
+    return true;
+  }
+  template <typename T>
+  bool Vec(std::vector<T>* values) {
+    uint64_t count = 0u;
+    if (!U64(&count) || count > (size_ - pos_) / sizeof(T)) {
+      return false;
+    }
+    values->resize(static_cast<size_t>(count));
+    return count == 0u || Raw(values->data(), values->size() * sizeof(T));
+  }
+  bool AtEnd() const { return pos_ == size_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0u;
+};
+
+void WriteConstants(const SchedulerConstants& sched, ByteWriter* out) {
+  const std::pair<SchedulerManifestKey, uint32_t> entries[] = {
+      {SchedulerManifestKey::kProcCount, sched.proc_count},
+      {SchedulerManifestKey::kEventCount, sched.event_count},
+      {SchedulerManifestKey::kEdgeCount, sched.edge_count},
+      {SchedulerManifestKey::kEdgeStarCount, sched.edge_star_count},
+      {SchedulerManifestKey::kRepeatCount, sched.repeat_count},
+      {SchedulerManifestKey::kDelayCount, sched.delay_count},
+      {SchedulerManifestKey::kMaxDnba, sched.max_dnba},
+      {SchedulerManifestKey::kMonitorCount, sched.monitor_count},
+      {SchedulerManifestKey::kMonitorMaxArgs, sched.monitor_max_args},
+      {SchedulerManifestKey::kStrobeCount, sched.strobe_count},
+      {SchedulerManifestKey::kServiceMaxArgs, sched.service_max_args},
+      {SchedulerManifestKey::kServiceWideWords, sched.service_wide_words},
+      {SchedulerManifestKey::kStringCount, sched.string_count},
+      {SchedulerManifestKey::kForceCount, sched.force_count},
+      {SchedulerManifestKey::kPcontCount, sched.pcont_count},
+      {SchedulerManifestKey::kTimingCheckCount, sched.timing_check_count},
+      {SchedulerManifestKey::kVmEnabled, sched.vm_enabled ? 1u : 0u},
+      {SchedulerManifestKey::kVmBytecodeWords, sched.vm_bytecode_words},
+      {SchedulerManifestKey::kVmCondCount, sched.vm_cond_count},
+      {SchedulerManifestKey::kVmAssignCount, sched.vm_assign_count},
+      {SchedulerManifestKey::kVmForceCount, sched.vm_force_count},
+      {SchedulerManifestKey::kVmReleaseCount, sched.vm_release_count},
+      {SchedulerManifestKey::kVmServiceCallCount,
+       sched.vm_service_call_count},
+      {SchedulerManifestKey::kVmServiceAssignCount,
+       sched.vm_service_assign_count},
+      {SchedulerManifestKey::kVmServiceArgCount, sched.vm_service_arg_count},
+      {SchedulerManifestKey::kVmCallFrameWords, sched.vm_call_frame_words},
+      {SchedulerManifestKey::kVmCallFrameDepth, sched.vm_call_frame_depth},
+      {SchedulerManifestKey::kVmCaseHeaderCount, sched.vm_case_header_count},
+      {SchedulerManifestKey::kVmCaseEntryCount, sched.vm_case_entry_count},
+      {SchedulerManifestKey::kVmCaseWordCount, sched.vm_case_word_count},
+      {SchedulerManifestKey::kVmExprWordCount, sched.vm_expr_word_count},
+      {SchedulerManifestKey::kVmExprImmWordCount,
+       sched.vm_expr_imm_word_count},
+      {SchedulerManifestKey::kVmSignalCount, sched.vm_signal_count},
+      {SchedulerManifestKey::kPackedBitGroups, sched.packed_bit_groups},
+      {SchedulerManifestKey::kLocalityLayout, sched.locality_layout ? 1u : 0u},
+      {SchedulerManifestKey::kPruneXz, sched.prune_xz ? 1u : 0u},
+      {SchedulerManifestKey::kInstStateBytes, sched.inst_state_bytes},
+  };
+  out->U32(static_cast<uint32_t>(sizeof(entries) / sizeof(entries[0])));
+  for (const auto& entry : entries) {
+    out->U32(static_cast<uint32_t>(entry.first));
+    out->U32(entry.second);
+  }
+}
+
+bool ReadConstants(ByteReader* in, SchedulerConstants* sched) {
+  uint32_t count = 0u;
+  if (!in->U32(&count)) {
+    return false;
+  }
+  SchedulerConstants info;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t key = 0u;
+    uint32_t value = 0u;
+    if (!in->U32(&key) || !in->U32(&value)) {
+      return false;
+    }
+    switch (static_cast<SchedulerManifestKey>(key)) {
+      case SchedulerManifestKey::kProcCount:
+        info.proc_count = value;
+        break;
+      case SchedulerManifestKey::kEventCount:
+        info.event_count = value;
+        break;
+      case SchedulerManifestKey::kEdgeCount:
+        info.edge_count = value;
+        break;
+      case SchedulerManifestKey::kEdgeStarCount:
+        info.edge_star_count = value;
+        break;
+      case SchedulerManifestKey::kRepeatCount:
+        info.repeat_count = value;
+        break;
+      case SchedulerManifestKey::kDelayCount:
+        info.delay_count = value;
+        break;
+      case SchedulerManifestKey::kMaxDnba:
+        info.max_dnba = value;
+        break;
+      case SchedulerManifestKey::kMonitorCount:
+        info.monitor_count = value;
+        break;
+      case SchedulerManifestKey::kMonitorMaxArgs:
+        info.monitor_max_args = value;
+        break;
+      case SchedulerManifestKey::kStrobeCount:
+        info.strobe_count = value;
+        break;
+      case SchedulerManifestKey::kServiceMaxArgs:
+        info.service_max_args = value;
+        break;
+      case SchedulerManifestKey::kServiceWideWords:
+        info.service_wide_words = value;
+        break;
+      case SchedulerManifestKey::kStringCount:
+        info.string_count = value;
+        break;
+      case SchedulerManifestKey::kForceCount:
+        info.force_count = value;
+        break;
+      case SchedulerManifestKey::kPcontCount:
+        info.pcont_count = value;
+        break;
+      case SchedulerManifestKey::kTimingCheckCount:
+        info.timing_check_count = value;
+        break;
+      case SchedulerManifestKey::kVmEnabled:
+        info.vm_enabled = (value != 0u);
+        break;
+      case SchedulerManifestKey::kVmBytecodeWords:
+        info.vm_bytecode_words = value;
+        break;
+      case SchedulerManifestKey::kVmCondCount:
+        info.vm_cond_count = value;
+        break;
+      case SchedulerManifestKey::kVmAssignCount:
+        info.vm_assign_count = value;
+        break;
+      case SchedulerManifestKey::kVmForceCount:
+        info.vm_force_count = value;
+        break;
+      case SchedulerManifestKey::kVmReleaseCount:
+        info.vm_release_count = value;
+        break;
+      case SchedulerManifestKey::kVmServiceCallCount:
+        info.vm_service_call_count = value;
+        break;
+      case SchedulerManifestKey::kVmServiceAssignCount:
+        info.vm_service_assign_count = value;
+        break;
+      case SchedulerManifestKey::kVmServiceArgCount:
+        info.vm_service_arg_count = value;
+        break;
+      case SchedulerManifestKey::kVmCallFrameWords:
+        info.vm_call_frame_words = value;
+        break;
+      case SchedulerManifestKey::kVmCallFrameDepth:
+        info.vm_call_frame_depth = value;
+        break;
+      case SchedulerManifestKey::kVmCaseHeaderCount:
+        info.vm_case_header_count = value;
+        break;
+      case SchedulerManifestKey::kVmCaseEntryCount:
+        info.vm_case_entry_count = value;
+        break;
+      case SchedulerManifestKey::kVmCaseWordCount:
+        info.vm_case_word_count = value;
+        break;
+      case SchedulerManifestKey::kVmExprWordCount:
+        info.vm_expr_word_count = value;
+        break;
+      case SchedulerManifestKey::kVmExprImmWordCount:
+        info.vm_expr_imm_word_count = value;
+        break;
+      case SchedulerManifestKey::kVmSignalCount:
+        info.vm_signal_count = value;
+        break;
+      case SchedulerManifestKey::kPackedBitGroups:
+        info.packed_bit_groups = value;
+        break;
+      case SchedulerManifestKey::kLocalityLayout:
+        info.locality_layout = (value != 0u);
+        break;
+      case SchedulerManifestKey::kPruneXz:
+        info.prune_xz = (value != 0u);
+        break;
+      case SchedulerManifestKey::kInstStateBytes:
+        info.inst_state_bytes = value;
+        break;
+      default:
+        break;
+    }
+  }
+  info.has_scheduler = info.proc_count > 0u;
+  info.has_services = info.service_max_args > 0u;
+  *sched = info;
+  return true;
+}
+
+void WriteKernelBindings(const std::vector<KernelBindingTable>& tables,
+                         ByteWriter* out) {
+  out->U32(static_cast<uint32_t>(tables.size()));
+  for (const auto& table : tables) {
+    out->Str(table.kernel);
+    out->U32(static_cast<uint32_t>(table.buffers.size()));
+    for (const auto& binding : table.buffers) {
+      out->Str(binding.first);
+      out->U32(binding.second);
+    }
+  }
+}
+
+bool ReadKernelBindings(ByteReader* in,
+                        std::vector<KernelBindingTable>* tables) {
+  uint32_t count = 0u;
+  if (!in->U32(&count)) {
+    return false;
+  }
+  tables->clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    KernelBindingTable table;
+    uint32_t buffer_count = 0u;
+    if (!in->Str(&table.kernel) || !in->U32(&buffer_count)) {
+      return false;
+    }
+    for (uint32_t b = 0; b < buffer_count; ++b) {
+      std::pair<std::string, uint32_t> binding;
+      if (!in->Str(&binding.first) || !in->U32(&binding.second)) {
+        return false;
+      }
+      table.buffers.push_back(std::move(binding));
+    }
+    tables->push_back(std::move(table));
+  }
+  return true;
+}
+
+void WriteVmLayout(const SchedulerVmLayout& layout, ByteWriter* out) {
+  out->U32(layout.proc_count);
+  out->U32(layout.words_per_proc);
+  out->Vec(layout.bytecode);
+  out->Vec(layout.proc_offsets);
+  out->Vec(layout.proc_lengths);
+  out->Vec(layout.packed_slots);
+  out->Vec(layout.signal_entries);
+  out->Vec(layout.cond_entries);
+  out->Vec(layout.case_headers);
+  out->Vec(layout.case_entries);
+  out->Vec(layout.case_words);
+  out->Vec(layout.assign_entries);
+  out->Vec(layout.delay_assign_entries);
+  out->Vec(layout.force_entries);
+  out->Vec(layout.release_entries);
+  out->Vec(layout.service_entries);
+  out->Vec(layout.service_args);
+  out->Vec(layout.service_ret_entries);
+  out->Vec(layout.expr_table.words);
+  out->Vec(layout.expr_table.imm_words);
+  out->U32(layout.expr_table.reg_count);
+  out->U32(layout.expr_table.wide_bits);
+  out->Vec(layout.edge_item_expr_offsets);
+  out->Vec(layout.edge_star_expr_offsets);
+  out->Vec(layout.repeat_expr_offsets);
+  out->Vec(layout.edge_wait_entries);
+  out->Vec(layout.edge_item_kinds);
+  out->Vec(layout.delay_expr_offsets);
+}
+
+bool ReadVmLayout(ByteReader* in, SchedulerVmLayout* layout) {
+  return in->U32(&layout->proc_count) && in->U32(&layout->words_per_proc) &&
+         in->Vec(&layout->bytecode) && in->Vec(&layout->proc_offsets) &&
+         in->Vec(&layout->proc_lengths) && in->Vec(&layout->packed_slots) &&
+         in->Vec(&layout->signal_entries) && in->Vec(&layout->cond_entries) &&
+         in->Vec(&layout->case_headers) && in->Vec(&layout->case_entries) &&
+         in->Vec(&layout->case_words) && in->Vec(&layout->assign_entries) &&
+         in->Vec(&layout->delay_assign_entries) &&
+         in->Vec(&layout->force_entries) &&
+         in->Vec(&layout->release_entries) &&
+         in->Vec(&layout->service_entries) &&
+         in->Vec(&layout->service_args) &&
+         in->Vec(&layout->service_ret_entries) &&
+         in->Vec(&layout->expr_table.words) &&
+         in->Vec(&layout->expr_table.imm_words) &&
+         in->U32(&layout->expr_table.reg_count) &&
+         in->U32(&layout->expr_table.wide_bits) &&
+         in->Vec(&layout->edge_item_expr_offsets) &&
+         in->Vec(&layout->edge_star_expr_offsets) &&
+         in->Vec(&layout->repeat_expr_offsets) &&
+         in->Vec(&layout->edge_wait_entries) &&
+         in->Vec(&layout->edge_item_kinds) &&
+         in->Vec(&layout->delay_expr_offsets);
+}
+
+size_t MatchParen(const std::string& source, size_t open) {
+  int depth = 0;
+  for (size_t i = open; i < source.size(); ++i) {
+    if (source[i] == '(') {
+      depth += 1;
+    } else if (source[i] == ')') {
+      depth -= 1;
+      if (depth == 0) {
+        return i;
+      }
+    }
+  }
+  return std::string::npos;
+}
+
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() {
+    if (data_ && data_ != MAP_FAILED) {
+      munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::string& path, std::string* error) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      if (error) {
+        *error = "failed to open " + path;
+      }
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size <= 0) {
+      if (error) {
+        *error = "empty or unreadable file " + path;
+      }
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      if (error) {
+        *error = "failed to map " + path;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  const void* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  int fd_ = -1;
+  void* data_ = nullptr;
+  size_t size_ = 0u;
+};
+
+}  // namespace
+
+std::string SchedulerManifestPathForMsl(const std::string& msl_path) {
+  return msl_path + kSchedulerManifestExtension;
+}
+
+uint64_t SchedulerManifestSourceHash(const std::string& source) {
+  return Fnv1aHash64(source);
+}
+
+bool SchedulerManifestMatchesSource(const SchedulerManifest& manifest,
+                                    const std::string& source) {
+  return manifest.source_bytes == static_cast<uint64_t>(source.size()) &&
+         manifest.source_hash == SchedulerManifestSourceHash(source);
+}
+
+void ScanKernelBindingTables(const std::string& source,
+                             std::vector<KernelBindingTable>* out) {
+  if (!out) {
+    return;
+  }
+  out->clear();
+  const std::string needle = "kernel void ";
+  const std::string binding = "[[buffer(";
+  size_t pos = source.find(needle);
+  while (pos != std::string::npos) {
+    size_t name_start = pos + needle.size();
+    size_t name_end = name_start;
+    while (name_end < source.size() && IsMslIdentChar(source[name_end])) {
+      ++name_end;
+    }
+    size_t open = source.find('(', name_end);
+    size_t close =
+        (open == std::string::npos) ? open : MatchParen(source, open);
+    if (name_end == name_start || close == std::string::npos) {
+      break;
+    }
+    KernelBindingTable table;
+    table.kernel = source.substr(name_start, name_end - name_start);
+    size_t at = source.find(binding, open);
+    while (at != std::string::npos && at < close) {
+      size_t ident_end = at;
+      while (ident_end > open &&
+             std::isspace(static_cast<unsigned char>(source[ident_end - 1]))) {
+        --ident_end;
+      }
+      size_t ident_start = ident_end;
+      while (ident_start > open && IsMslIdentChar(source[ident_start - 1])) {
+        --ident_start;
+      }
+      size_t digit = at + binding.size();
+      uint32_t index = 0u;
+      bool has_digit = false;
+      while (digit < close &&
+             std::isdigit(static_cast<unsigned char>(source[digit]))) {
+        index = index * 10u + static_cast<uint32_t>(source[digit] - '0');
+        has_digit = true;
+        ++digit;
+      }
+      if (has_digit && ident_start < ident_end &&
+          IsMslIdentStart(source[ident_start])) {
+        table.buffers.emplace_back(
+            source.substr(ident_start, ident_end - ident_start), index);
+      }
+      at = source.find(binding, at + binding.size());
+    }
+    if (!table.buffers.empty()) {
+      out->push_back(std::move(table));
+    }
+    pos = source.find(needle, close);
+  }
+}
+
+const KernelBindingTable* FindKernelBindingTable(
+    const std::vector<KernelBindingTable>& tables, const std::string& kernel) {
+  for (const auto& table : tables) {
+    if (table.kernel == kernel) {
+      return &table;
+    }
+  }
+  return nullptr;
+}
+
+bool SerializeSchedulerManifest(const SchedulerManifest& manifest,
+                                std::string* out, std::string* error) {
+  if (!out) {
+    if (error) {
+      *error = "manifest output is null";
+    }
+    return false;
+  }
+  std::vector<std::pair<SchedulerManifestSection, std::string>> sections;
+  {
+    std::string payload;
+    ByteWriter writer(&payload);
+    WriteConstants(manifest.sched, &writer);
+    sections.emplace_back(SchedulerManifestSection::kConstants,
+                          std::move(payload));
+  }
+  {
+    std::string payload;
+    ByteWriter writer(&payload);
+    WriteKernelBindings(manifest.kernels, &writer);
+    sections.emplace_back(SchedulerManifestSection::kKernelBindings,
+                          std::move(payload));
+  }
+  if (manifest.has_vm_layout) {
+    std::string payload;
+    ByteWriter writer(&payload);
+    WriteVmLayout(manifest.vm_layout, &writer);
+    sections.emplace_back(SchedulerManifestSection::kVmLayout,
+                          std::move(payload));
+  }
+  ManifestHeader header;
+  header.header_bytes = static_cast<uint32_t>(sizeof(ManifestHeader));
+  header.section_count = static_cast<uint32_t>(sections.size());
+  header.source_bytes = manifest.source_bytes;
+  header.source_hash = manifest.source_hash;
+  uint64_t offset = sizeof(ManifestHeader) +
+                    sections.size() * sizeof(ManifestSectionEntry);
+  std::vector<ManifestSectionEntry> entries;
+  for (const auto& section : sections) {
+    ManifestSectionEntry entry;
+    entry.id = static_cast<uint32_t>(section.first);
+    entry.offset = offset;
+    entry.size = section.second.size();
+    // Keep section payloads 8-byte aligned for in-place readers.
+    offset += (entry.size + 7u) & ~static_cast<uint64_t>(7u);
+    entries.push_back(entry);
+  }
+  header.total_bytes = offset;
+  out->clear();
+  out->reserve(static_cast<size_t>(offset));
+  ByteWriter writer(out);
+  writer.Raw(&header, sizeof(header));
+  for (const auto& entry : entries) {
+    writer.Raw(&entry, sizeof(entry));
+  }
+  for (const auto& section : sections) {
+    writer.Raw(section.second.data(), section.second.size());
+    out->append((8u - (section.second.size() & 7u)) & 7u, '\0');
+  }
+  return true;
+}
+
+bool DeserializeSchedulerManifest(const void* data, size_t size,
+                                  SchedulerManifest* out, std::string* error) {
+  auto fail = [&](const std::string& message) {
+    if (error) {
+      *error = "scheduler manifest: " + message;
+    }
+    return false;
+  };
+  if (!data || !out) {
+    return fail("null input");
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  ManifestHeader header;
+  if (size < sizeof(header)) {
+    return fail("truncated header");
+  }
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != kSchedulerManifestMagic) {
+    return fail("bad magic");
+  }
+  if (header.version != kSchedulerManifestVersion) {
+    return fail("unsupported version " + std::to_string(header.version));
+  }
+  if (header.header_bytes != sizeof(ManifestHeader) ||
+      header.total_bytes != size) {
+    return fail("size mismatch");
+  }
+  const size_t table_bytes =
+      static_cast<size_t>(header.section_count) * sizeof(ManifestSectionEntry);
+  if (header.section_count > 64u || table_bytes > size - sizeof(header)) {
+    return fail("bad section table");
+  }
+  SchedulerManifest manifest;
+  manifest.source_bytes = header.source_bytes;
+  manifest.source_hash = header.source_hash;
+  bool saw_constants = false;
+  for (uint32_t i = 0; i < header.section_count; ++i) {
+    ManifestSectionEntry entry;
+    std::memcpy(&entry, bytes + sizeof(header) + i * sizeof(entry),
+                sizeof(entry));
+    if (entry.offset > size || entry.size > size - entry.offset) {
+      return fail("section out of range");
+    }
+    ByteReader reader(bytes + entry.offset, static_cast<size_t>(entry.size));
+    bool ok = true;
+    switch (static_cast<SchedulerManifestSection>(entry.id)) {
+      case SchedulerManifestSection::kConstants:
+        ok = ReadConstants(&reader, &manifest.sched);
+        saw_constants = ok;
+        break;
+      case SchedulerManifestSection::kKernelBindings:
+        ok = ReadKernelBindings(&reader, &manifest.kernels);
+        break;
+      case SchedulerManifestSection::kVmLayout:
+        ok = ReadVmLayout(&reader, &manifest.vm_layout) && reader.AtEnd();
+        manifest.has_vm_layout = ok;
+        break;
+      default:
+        break;
+    }
+    if (!ok) {
+      return fail("malformed section " + std::to_string(entry.id));
+    }
+  }
+  if (!saw_constants) {
+    return fail("missing constants section");
+  }
+  *out = std::move(manifest);
+  return true;
+}
+
+bool WriteSchedulerManifest(const std::string& path,
+                            const SchedulerManifest& manifest,
+                            std::string* error) {
+  std::string bytes;
+  if (!SerializeSchedulerManifest(manifest, &bytes, error)) {
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    if (error) {
+      *error = "failed to open " + path + " for write";
+    }
+    return false;
+  }
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  if (!out) {
+    if (error) {
+      *error = "failed to write " + path;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool LoadSchedulerManifest(const std::string& path, SchedulerManifest* out,
+                           std::string* error) {
+  MappedFile file;
+  if (!file.Open(path, error)) {
+    return false;
+  }
+  return DeserializeSchedulerManifest(file.data(), file.size(), out, error);
+}
+
+}  // namespace gpga
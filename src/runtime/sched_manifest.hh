@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/scheduler_vm.hh"
+#include "runtime/metal_runtime.hh"
+
+namespace gpga {
+
+// Binary sidecar written next to emitted MSL ("<file>.gpgamf"). It carries the
+// values the host otherwise recovers by scanning the Metal source: scheduler
+// constants, per-kernel buffer bindings and (in VM mode) the scheduler VM
+// layout. All integers are stored little-endian.
+constexpr uint32_t kSchedulerManifestMagic = 0x464D4747u;  // "GGMF"
+constexpr uint32_t kSchedulerManifestVersion = 5u;
+constexpr const char* kSchedulerManifestExtension = ".gpgamf";
+
+enum class SchedulerManifestSection : uint32_t {
+  kConstants = 1u,
+  kKernelBindings = 2u,
+  kVmLayout = 3u,
+};
+
+// Keys for the constants section. Values are stored as (key, value) pairs so
+// readers skip keys they do not know; never renumber existing keys.
+enum class SchedulerManifestKey : uint32_t {
+  kProcCount = 0u,
+  kEventCount = 1u,
+  kEdgeCount = 2u,
+  kEdgeStarCount = 3u,
+  kRepeatCount = 4u,
+  kDelayCount = 5u,
+  kMaxDnba = 6u,
+  kMonitorCount = 7u,
+  kMonitorMaxArgs = 8u,
+  kStrobeCount = 9u,
+  kServiceMaxArgs = 10u,
+  kServiceWideWords = 11u,
+  kStringCount = 12u,
+  kForceCount = 13u,
+  kPcontCount = 14u,
+  kTimingCheckCount = 15u,
+  kVmEnabled = 16u,
+  kVmBytecodeWords = 17u,
+  kVmCondCount = 18u,
+  kVmAssignCount = 19u,
+  kVmForceCount = 20u,
+  kVmReleaseCount = 21u,
+  kVmServiceCallCount = 22u,
+  kVmServiceAssignCount = 23u,
+  kVmServiceArgCount = 24u,
+  kVmCallFrameWords = 25u,
+  kVmCallFrameDepth = 26u,
+  kVmCaseHeaderCount = 27u,
+  kVmCaseEntryCount = 28u,
+  kVmCaseWordCount = 29u,
+  kVmExprWordCount = 30u,
+  kVmExprImmWordCount = 31u,
+  kVmSignalCount = 32u,
+  kPackedBitGroups = 33u,
+  kLocalityLayout = 34u,
+  kPruneXz = 35u,
+  kInstStateBytes = 36u,
+};
+
+struct KernelBindingTable {
+  std::string kernel;
+  std::vector<std::pair<std::string, uint32_t>> buffers;
+};
+
+struct SchedulerManifest {
+  uint64_t source_bytes = 0u;
+  uint64_t source_hash = 0u;
+  SchedulerConstants sched;
+  std::vector<KernelBindingTable> kernels;
+  bool has_vm_layout = false;
+  SchedulerVmLayout vm_layout;
+};
+
+std::string SchedulerManifestPathForMsl(const std::string& msl_path);
+uint64_t SchedulerManifestSourceHash(const std::string& source);
+
+// Returns true when the manifest was produced for exactly this MSL source.
+bool SchedulerManifestMatchesSource(const SchedulerManifest& manifest,
+                                    const std::string& source);
+
+// Scans `kernel void <name>(...)` signatures for `[[buffer(N)]]` bindings.
+// This is the emit-time counterpart of the runtime's source binding parser.
+void ScanKernelBindingTables(const std::string& source,
+                             std::vector<KernelBindingTable>* out);
+const KernelBindingTable* FindKernelBindingTable(
+    const std::vector<KernelBindingTable>& tables, const std::string& kernel);
+
+bool SerializeSchedulerManifest(const SchedulerManifest& manifest,
+                                std::string* out, std::string* error);
+bool DeserializeSchedulerManifest(const void* data, size_t size,
+                                  SchedulerManifest* out, std::string* error);
+bool WriteSchedulerManifest(const std::string& path,
+                            const SchedulerManifest& manifest,
+                            std::string* error);
+// Maps the file read-only and decodes it in place; missing or stale files
+// return false so callers can fall back to scanning the MSL text.
+bool LoadSchedulerManifest(const std::string& path, SchedulerManifest* out,
+                           std::string* error);
+
+}  // namespace gpga
@@ -0,0 +1,1139 @@
+#include "runtime/scheduler_vm_image.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gpga {
+
+namespace {
+
+struct ImageHeader {
+  uint32_t magic = kSchedulerVmImageMagic;
+  uint32_t version = kSchedulerVmImageVersion;
+  uint32_t header_bytes = 0u;
+  uint32_t section_count = 0u;
+  uint64_t total_bytes = 0u;
+  // 64-bit FNV-1a over the file taken as 8-byte words, with this field zero.
+  uint64_t checksum = 0u;
+  uint64_t source_bytes = 0u;
+  uint64_t source_hash = 0u;
+  uint32_t flags = 0u;
+  uint32_t proc_count = 0u;
+  uint32_t words_per_proc = 0u;
+  uint32_t expr_reg_count = 0u;
+  uint32_t expr_wide_bits = 0u;
+  uint32_t reserved = 0u;
+};
+
+struct ImageSectionEntry {
+  uint32_t id = 0u;
+  uint32_t elem_size = 0u;
+  uint64_t offset = 0u;
+  uint64_t count = 0u;
+};
+
+static_assert(sizeof(ImageHeader) == 72u, "vm image header layout");
+static_assert(sizeof(ImageSectionEntry) == 24u, "vm image section layout");
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t HashWords(uint64_t hash, const uint8_t* bytes, size_t size) {
+  for (size_t i = 0; i + 8u <= size; i += 8u) {
+    uint64_t word = 0u;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * kFnvPrime;
+  }
+  return hash;
+}
+
+uint64_t ImageChecksum(const ImageHeader& header, const uint8_t* bytes,
+                       size_t size) {
+  ImageHeader zeroed = header;
+  zeroed.checksum = 0u;
+  const uint64_t hash =
+      HashWords(kFnvOffset, reinterpret_cast<const uint8_t*>(&zeroed),
+                sizeof(zeroed));
+  return HashWords(hash, bytes + sizeof(ImageHeader),
+                   size - sizeof(ImageHeader));
+}
+
+uint64_t AlignUp(uint64_t value) {
+  return (value + kSchedulerVmImageAlign - 1u) &
+         ~static_cast<uint64_t>(kSchedulerVmImageAlign - 1u);
+}
+
+// Calls fn(id, span) for every table of the view, in section id order.
+template <typename View, typename Fn>
+void ForEachSection(View* view, Fn&& fn) {
+  fn(SchedulerVmImageSection::kBytecode, &view->bytecode);
+  fn(SchedulerVmImageSection::kProcOffsets, &view->proc_offsets);
+  fn(SchedulerVmImageSection::kProcLengths, &view->proc_lengths);
+  fn(SchedulerVmImageSection::kPackedSlots, &view->packed_slots);
+  fn(SchedulerVmImageSection::kSignalEntries, &view->signal_entries);
+  fn(SchedulerVmImageSection::kCondEntries, &view->cond_entries);
+  fn(SchedulerVmImageSection::kCaseHeaders, &view->case_headers);
+  fn(SchedulerVmImageSection::kCaseEntries, &view->case_entries);
+  fn(SchedulerVmImageSection::kCaseWords, &view->case_words);
+  fn(SchedulerVmImageSection::kAssignEntries, &view->assign_entries);
+  fn(SchedulerVmImageSection::kDelayAssignEntries,
+     &view->delay_assign_entries);
+  fn(SchedulerVmImageSection::kForceEntries, &view->force_entries);
+  fn(SchedulerVmImageSection::kReleaseEntries, &view->release_entries);
+  fn(SchedulerVmImageSection::kServiceEntries, &view->service_entries);
+  fn(SchedulerVmImageSection::kServiceArgs, &view->service_args);
+  fn(SchedulerVmImageSection::kServiceRetEntries, &view->service_ret_entries);
+  fn(SchedulerVmImageSection::kExprWords, &view->expr_words);
+  fn(SchedulerVmImageSection::kExprImmWords, &view->expr_imm_words);
+  fn(SchedulerVmImageSection::kEdgeItemExprOffsets,
+     &view->edge_item_expr_offsets);
+  fn(SchedulerVmImageSection::kEdgeStarExprOffsets,
+     &view->edge_star_expr_offsets);
+  fn(SchedulerVmImageSection::kRepeatExprOffsets, &view->repeat_expr_offsets);
+  fn(SchedulerVmImageSection::kEdgeWaitEntries, &view->edge_wait_entries);
+  fn(SchedulerVmImageSection::kEdgeItemKinds, &view->edge_item_kinds);
+  fn(SchedulerVmImageSection::kDelayExprOffsets, &view->delay_expr_offsets);
+}
+
+template <typename T>
+SchedulerVmImageSpan<T> SpanOf(const std::vector<T>& values) {
+  SchedulerVmImageSpan<T> span;
+  span.data = values.data();
+  span.count = values.size();
+  return span;
+}
+
+template <typename T>
+void CopySpan(const SchedulerVmImageSpan<T>& span, std::vector<T>* out) {
+  out->resize(span.count);
+  if (span.count != 0u) {
+    std::memcpy(out->data(), span.data, span.count * sizeof(T));
+  }
+}
+
+// Operands an expression op pops and pushes; false for ops no VM kernel
+// implements.
+bool ExprStackEffect(uint32_t op, uint32_t arg, uint32_t* pops,
+                     uint32_t* pushes) {
+  *pushes = 1u;
+  switch (static_cast<SchedulerVmExprOp>(op)) {
+    case SchedulerVmExprOp::kPushConst:
+    case SchedulerVmExprOp::kPushConstXz:
+    case SchedulerVmExprOp::kPushSignal:
+    case SchedulerVmExprOp::kLoadReg:
+      *pops = 0u;
+      return true;
+    case SchedulerVmExprOp::kUnary:
+    case SchedulerVmExprOp::kIndex:
+      *pops = 1u;
+      return true;
+    case SchedulerVmExprOp::kBinary:
+      *pops = 2u;
+      return true;
+    case SchedulerVmExprOp::kTernary:
+      *pops = 3u;
+      return true;
+    case SchedulerVmExprOp::kStoreReg:
+      *pops = 1u;
+      *pushes = 0u;
+      return true;
+    case SchedulerVmExprOp::kCall: {
+      const uint32_t call = arg & 0xFFu;
+      if (call > static_cast<uint32_t>(SchedulerVmExprCallOp::kHypot)) {
+        return false;
+      }
+      if (call <= static_cast<uint32_t>(SchedulerVmExprCallOp::kRealtime)) {
+        *pops = 0u;
+      } else if (call >= static_cast<uint32_t>(SchedulerVmExprCallOp::kPow)) {
+        *pops = 2u;
+      } else {
+        *pops = 1u;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+class ImageVerifier {
+ public:
+  explicit ImageVerifier(const SchedulerVmImageView& view)
+      : v_(view),
+        max_width_(std::max<uint32_t>(64u, view.expr_wide_bits)),
+        expr_state_(view.expr_words.size(), kUnknown),
+        case_label_count_(view.case_headers.size(), kSchedulerVmCaseNoTarget) {
+  }
+
+  bool Verify(std::string* message) {
+    const bool ok = CheckShape() && CheckSignals() && CheckConds() &&
+                    CheckCases() && CheckAssigns() && CheckForces() &&
+                    CheckServices() && CheckWaits() && CheckProcs();
+    if (!ok && message) {
+      *message = message_;
+    }
+    return ok;
+  }
+
+ private:
+  enum : uint8_t { kUnknown = 0u, kValid = 1u, kInvalid = 2u };
+
+  bool Fail(const std::string& what, size_t id, const std::string& problem) {
+    message_ = what + " " + std::to_string(id) + ": " + problem;
+    return false;
+  }
+
+  static std::string Num(uint64_t value) { return std::to_string(value); }
+
+  // True when a well-formed expression starts at offset: every op is known,
+  // its operands are in range and its width is 1..max_width_, the stack
+  // neither underflows nor passes kSchedulerVmExprStackMax, and the walk
+  // reaches kDone with a result.
+  bool Expr(uint32_t offset) {
+    if (offset >= v_.expr_words.size()) {
+      return false;
+    }
+    if (expr_state_[offset] != kUnknown) {
+      return expr_state_[offset] == kValid;
+    }
+    const size_t count = v_.expr_words.size();
+    uint32_t sp = 0u;
+    bool ok = false;
+    for (size_t ip = offset; ip < count;) {
+      const uint32_t op = v_.expr_words[ip] & kSchedulerVmOpMask;
+      const uint32_t arg = v_.expr_words[ip] >> kSchedulerVmOpShift;
+      if (op == static_cast<uint32_t>(SchedulerVmExprOp::kDone)) {
+        ok = sp != 0u;
+        break;
+      }
+      uint32_t pops = 0u;
+      uint32_t pushes = 0u;
+      if (ip + 1u >= count || !ExprStackEffect(op, arg, &pops, &pushes) ||
+          sp < pops || sp - pops + pushes > kSchedulerVmExprStackMax) {
+        break;
+      }
+      const uint32_t width = v_.expr_words[ip + 1u];
+      if (width == 0u || width > max_width_) {
+        break;
+      }
+      bool operand_ok = true;
+      switch (static_cast<SchedulerVmExprOp>(op)) {
+        case SchedulerVmExprOp::kPushConst:
+          operand_ok = static_cast<uint64_t>(arg) + 2u <=
+                       v_.expr_imm_words.size();
+          break;
+        case SchedulerVmExprOp::kPushConstXz:
+          operand_ok = static_cast<uint64_t>(arg) + 4u <=
+                       v_.expr_imm_words.size();
+          break;
+        case SchedulerVmExprOp::kPushSignal:
+        case SchedulerVmExprOp::kIndex:
+          operand_ok = arg < v_.signal_entries.size();
+          break;
+        case SchedulerVmExprOp::kLoadReg:
+        case SchedulerVmExprOp::kStoreReg:
+          operand_ok = arg < v_.expr_reg_count;
+          break;
+        default:
+          break;
+      }
+      if (!operand_ok) {
+        break;
+      }
+      sp = sp - pops + pushes;
+      ip += 2u;
+    }
+    expr_state_[offset] = ok ? kValid : kInvalid;
+    return ok;
+  }
+
+  bool OptionalExpr(uint32_t offset) {
+    return offset == kSchedulerVmExprNoExtra || Expr(offset);
+  }
+
+  bool CheckShape() {
+    if (v_.proc_count == 0u) {
+      return Fail("layout", 0u, "no procs");
+    }
+    if (v_.proc_offsets.size() != v_.proc_count ||
+        v_.proc_lengths.size() != v_.proc_count) {
+      return Fail("layout", 0u,
+                  "proc tables do not match proc count " +
+                      Num(v_.proc_count));
+    }
+    if (v_.expr_wide_bits != 0u && v_.expr_wide_bits <= 64u) {
+      return Fail("layout", 0u,
+                  "wide evaluator width " + Num(v_.expr_wide_bits) +
+                      " is not over 64 bits");
+    }
+    if (v_.expr_reg_count > kSchedulerVmExprRegMax) {
+      return Fail("layout", 0u,
+                  "expression register count " + Num(v_.expr_reg_count) +
+                      " exceeds " + Num(kSchedulerVmExprRegMax));
+    }
+    if (v_.bytecode.size() > 0xFFFFFFFFull ||
+        v_.expr_words.size() > 0xFFFFFFFFull) {
+      return Fail("layout", 0u, "tables exceed 32-bit offsets");
+    }
+    return true;
+  }
+
+  // Slot sizes place every later segment of the state buffers, so each
+  // slot must have a size a signal of at most max_width_ bits can take, and
+  // a signal's slots the size its width and array size give.
+  bool CheckSignals() {
+    const uint64_t max_word_size = ((max_width_ + 63u) / 64u) * 8u;
+    for (size_t i = 0; i < v_.packed_slots.size(); ++i) {
+      const SchedulerVmPackedSlot& slot = v_.packed_slots[i];
+      if ((slot.word_size != 4u && (slot.word_size % 8u) != 0u) ||
+          slot.word_size == 0u || slot.word_size > max_word_size) {
+        return Fail("packed slot", i, "bad word size " + Num(slot.word_size));
+      }
+      if (slot.array_size == 0u) {
+        return Fail("packed slot", i, "empty array");
+      }
+    }
+    for (size_t i = 0; i < v_.signal_entries.size(); ++i) {
+      const SchedulerVmSignalEntry& entry = v_.signal_entries[i];
+      if (entry.val_slot >= v_.packed_slots.size() ||
+          entry.xz_slot >= v_.packed_slots.size()) {
+        return Fail("signal", i, "packed slot out of range");
+      }
+      if (entry.width == 0u || entry.width > max_width_) {
+        return Fail("signal", i, "bad width " + Num(entry.width));
+      }
+      uint32_t word_size = 4u;
+      if ((entry.flags & kSchedulerVmSignalFlagReal) != 0u) {
+        word_size = 8u;
+      } else if (entry.width > 64u) {
+        word_size = ((entry.width + 63u) / 64u) * 8u;
+      } else if (entry.width > 32u) {
+        word_size = 8u;
+      }
+      if ((entry.flags & kSchedulerVmSignalFlagTwoState) != 0u) {
+        // The shared zero slot: one 8-byte word, enough for any 2-state net.
+        const SchedulerVmPackedSlot& zero = v_.packed_slots[entry.xz_slot];
+        if (word_size > 8u || entry.array_size != 1u ||
+            zero.word_size != 8u || zero.array_size != 1u) {
+          return Fail("signal", i, "bad 2-state zero slot");
+        }
+      }
+      for (uint32_t slot_id : {entry.val_slot, entry.xz_slot}) {
+        if (slot_id == entry.xz_slot &&
+            (entry.flags & kSchedulerVmSignalFlagTwoState) != 0u) {
+          continue;
+        }
+        const SchedulerVmPackedSlot& slot = v_.packed_slots[slot_id];
+        if (slot.word_size != word_size ||
+            slot.array_size != entry.array_size) {
+          return Fail("signal", i,
+                      "slot " + Num(slot_id) +
+                          " does not match its width and array size");
+        }
+      }
+    }
+    return true;
+  }
+
+  bool CheckConds() {
+    for (size_t i = 0; i < v_.cond_entries.size(); ++i) {
+      const SchedulerVmCondEntry& entry = v_.cond_entries[i];
+      if (entry.kind > static_cast<uint32_t>(SchedulerVmCondKind::kExpr)) {
+        return Fail("cond", i, "unknown kind " + Num(entry.kind));
+      }
+      if (entry.kind == static_cast<uint32_t>(SchedulerVmCondKind::kExpr) &&
+          !Expr(entry.expr_offset)) {
+        return Fail("cond", i, "bad expr at " + Num(entry.expr_offset));
+      }
+    }
+    return true;
+  }
+
+  bool CheckCases() {
+    const size_t words = v_.case_words.size();
+    for (size_t i = 0; i < v_.case_entries.size(); ++i) {
+      const SchedulerVmCaseEntry& entry = v_.case_entries[i];
+      if (entry.want_offset >= words || entry.care_offset >= words) {
+        return Fail("case entry", i, "word offset out of range");
+      }
+    }
+    for (size_t i = 0; i < v_.case_headers.size(); ++i) {
+      const SchedulerVmCaseHeader& header = v_.case_headers[i];
+      if (header.kind > static_cast<uint32_t>(SchedulerVmCaseKind::kCaseZ) ||
+          header.strategy >
+              static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut)) {
+        return Fail("case", i, "unknown kind or strategy");
+      }
+      if (static_cast<uint64_t>(header.entry_offset) + header.entry_count >
+          v_.case_entries.size()) {
+        return Fail("case", i, "entries out of range");
+      }
+      if (!OptionalExpr(header.expr_offset)) {
+        return Fail("case", i, "bad selector expr at " +
+                                   Num(header.expr_offset));
+      }
+      if (header.strategy ==
+          static_cast<uint32_t>(SchedulerVmCaseStrategy::kLinear)) {
+        continue;
+      }
+      // Lookups index the table with the masked selector and probe until
+      // an empty slot, so its size must match what they assume.
+      const uint64_t slots = static_cast<uint64_t>(header.table_mask) + 1u;
+      if ((slots & (slots - 1u)) != 0u) {
+        return Fail("case", i, "table size is not a power of two");
+      }
+      uint64_t table_words = 0u;
+      if (header.strategy ==
+          static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut)) {
+        if (header.width >= 32u || slots != (1ull << header.width)) {
+          return Fail("case", i, "lookup table does not cover the selector");
+        }
+        table_words = (slots + 1u) / 2u;
+      } else {
+        table_words = slots * 2u + header.wild_count;
+      }
+      if (static_cast<uint64_t>(header.table_offset) + table_words > words) {
+        return Fail("case", i, "table out of range");
+      }
+      if (header.strategy ==
+          static_cast<uint32_t>(SchedulerVmCaseStrategy::kBucket)) {
+        const size_t wild_base = header.table_offset + slots * 2u;
+        for (uint32_t w = 0; w < header.wild_count; ++w) {
+          if (v_.case_words[wild_base + w] >= header.entry_count) {
+            return Fail("case", i, "wildcard entry out of range");
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  // Targets a case can produce must index the kCase label targets.
+  bool CheckCaseTargets(uint32_t case_id, uint32_t label_count) {
+    if (case_label_count_[case_id] == label_count) {
+      return true;
+    }
+    const SchedulerVmCaseHeader& header = v_.case_headers[case_id];
+    auto target_ok = [&](uint32_t target) {
+      return target == kSchedulerVmCaseNoTarget || target < label_count;
+    };
+    for (uint32_t i = 0; i < header.entry_count; ++i) {
+      if (v_.case_entries[header.entry_offset + i].target >= label_count) {
+        return Fail("case", case_id, "entry target past the case labels");
+      }
+    }
+    const uint64_t slots = static_cast<uint64_t>(header.table_mask) + 1u;
+    if (header.strategy ==
+        static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut)) {
+      for (uint64_t s = 0; s < slots; ++s) {
+        const uint64_t pair = v_.case_words[header.table_offset + (s >> 1u)];
+        if (!target_ok(static_cast<uint32_t>(pair >> ((s & 1u) * 32u)))) {
+          return Fail("case", case_id, "table target past the case labels");
+        }
+      }
+    } else if (header.strategy ==
+               static_cast<uint32_t>(SchedulerVmCaseStrategy::kBucket)) {
+      for (uint64_t s = 0; s < slots; ++s) {
+        const uint64_t word = v_.case_words[header.table_offset + s * 2u + 1u];
+        if (!target_ok(static_cast<uint32_t>(word))) {
+          return Fail("case", case_id, "table target past the case labels");
+        }
+      }
+    }
+    case_label_count_[case_id] = label_count;
+    return true;
+  }
+
+  bool CheckAssigns() {
+    const size_t signals = v_.signal_entries.size();
+    for (size_t i = 0; i < v_.assign_entries.size(); ++i) {
+      const SchedulerVmAssignEntry& entry = v_.assign_entries[i];
+      if ((entry.flags & kSchedulerVmAssignFlagFallback) != 0u) {
+        continue;
+      }
+      if (entry.signal_id >= signals) {
+        return Fail("assign", i, "signal out of range");
+      }
+      if ((entry.flags & kSchedulerVmAssignFlagWideConst) != 0u) {
+        const uint64_t imm_words =
+            2u * ((static_cast<uint64_t>(entry.base_width) + 63u) / 64u);
+        if (static_cast<uint64_t>(entry.rhs_expr) + imm_words >
+            v_.expr_imm_words.size()) {
+          return Fail("assign", i, "wide constant out of range");
+        }
+      } else if ((entry.flags & kSchedulerVmAssignFlagCondRhs) != 0u) {
+        if (entry.rhs_expr >= v_.cond_entries.size()) {
+          return Fail("assign", i, "rhs cond out of range");
+        }
+      } else if (!OptionalExpr(entry.rhs_expr)) {
+        return Fail("assign", i, "bad rhs expr at " + Num(entry.rhs_expr));
+      }
+      if (!OptionalExpr(entry.idx_expr)) {
+        return Fail("assign", i, "bad index expr at " + Num(entry.idx_expr));
+      }
+    }
+    for (size_t i = 0; i < v_.delay_assign_entries.size(); ++i) {
+      const SchedulerVmDelayAssignEntry& entry = v_.delay_assign_entries[i];
+      if ((entry.flags & kSchedulerVmDelayAssignFlagFallback) != 0u) {
+        continue;
+      }
+      if (entry.signal_id >= signals) {
+        return Fail("delay assign", i, "signal out of range");
+      }
+      if (!OptionalExpr(entry.rhs_expr) || !OptionalExpr(entry.delay_expr) ||
+          !OptionalExpr(entry.idx_expr) ||
+          !OptionalExpr(entry.pulse_reject_expr) ||
+          !OptionalExpr(entry.pulse_error_expr)) {
+        return Fail("delay assign", i, "bad expr");
+      }
+    }
+    return true;
+  }
+
+  bool CheckForces() {
+    const size_t signals = v_.signal_entries.size();
+    for (size_t i = 0; i < v_.force_entries.size(); ++i) {
+      const SchedulerVmForceEntry& entry = v_.force_entries[i];
+      if ((entry.flags & kSchedulerVmForceFlagFallback) != 0u) {
+        continue;
+      }
+      if (entry.signal_id >= signals) {
+        return Fail("force", i, "signal out of range");
+      }
+      if (!OptionalExpr(entry.rhs_expr)) {
+        return Fail("force", i, "bad rhs expr at " + Num(entry.rhs_expr));
+      }
+    }
+    for (size_t i = 0; i < v_.release_entries.size(); ++i) {
+      const SchedulerVmReleaseEntry& entry = v_.release_entries[i];
+      if ((entry.flags & kSchedulerVmForceFlagFallback) == 0u &&
+          entry.signal_id >= signals) {
+        return Fail("release", i, "signal out of range");
+      }
+    }
+    return true;
+  }
+
+  bool CheckServices() {
+    for (size_t i = 0; i < v_.service_entries.size(); ++i) {
+      const SchedulerVmServiceEntry& entry = v_.service_entries[i];
+      if ((entry.flags & kSchedulerVmServiceFlagFallback) == 0u &&
+          static_cast<uint64_t>(entry.arg_offset) + entry.arg_count >
+              v_.service_args.size()) {
+        return Fail("service", i, "args out of range");
+      }
+    }
+    for (size_t i = 0; i < v_.service_args.size(); ++i) {
+      // Expression args are evaluated through a cond entry.
+      const SchedulerVmServiceArg& arg = v_.service_args[i];
+      if ((arg.flags & kSchedulerVmServiceArgFlagExpr) != 0u &&
+          arg.payload != kSchedulerVmExprNoExtra &&
+          arg.payload >= v_.cond_entries.size()) {
+        return Fail("service arg", i, "cond out of range");
+      }
+    }
+    for (size_t i = 0; i < v_.service_ret_entries.size(); ++i) {
+      const SchedulerVmServiceRetAssignEntry& entry =
+          v_.service_ret_entries[i];
+      if ((entry.flags & kSchedulerVmServiceRetAssignFlagFallback) == 0u &&
+          entry.signal_id >= v_.signal_entries.size()) {
+        return Fail("service ret", i, "signal out of range");
+      }
+    }
+    return true;
+  }
+
+  bool CheckOffsets(const char* what,
+                    const SchedulerVmImageSpan<uint32_t>& offsets) {
+    for (size_t i = 0; i < offsets.count; ++i) {
+      if (!OptionalExpr(offsets[i])) {
+        return Fail(what, i, "bad expr at " + Num(offsets[i]));
+      }
+    }
+    return true;
+  }
+
+  bool CheckWaits() {
+    for (size_t i = 0; i < v_.edge_wait_entries.size(); ++i) {
+      const SchedulerVmEdgeWaitEntry& entry = v_.edge_wait_entries[i];
+      if (entry.kind > static_cast<uint32_t>(SchedulerVmEdgeKind::kList)) {
+        return Fail("edge wait", i, "unknown kind " + Num(entry.kind));
+      }
+      const uint64_t item_end =
+          static_cast<uint64_t>(entry.item_offset) + entry.item_count;
+      if (item_end > v_.edge_item_expr_offsets.size() ||
+          (entry.kind == static_cast<uint32_t>(SchedulerVmEdgeKind::kList) &&
+           item_end > v_.edge_item_kinds.size())) {
+        return Fail("edge wait", i, "items out of range");
+      }
+      if (static_cast<uint64_t>(entry.star_offset) + entry.star_count >
+          v_.edge_star_expr_offsets.size()) {
+        return Fail("edge wait", i, "@* items out of range");
+      }
+    }
+    return CheckOffsets("edge item", v_.edge_item_expr_offsets) &&
+           CheckOffsets("edge star item", v_.edge_star_expr_offsets) &&
+           CheckOffsets("repeat", v_.repeat_expr_offsets) &&
+           CheckOffsets("delay", v_.delay_expr_offsets);
+  }
+
+  bool CheckProcs() {
+    for (uint32_t pid = 0; pid < v_.proc_count; ++pid) {
+      const uint32_t len = v_.proc_lengths[pid];
+      if (static_cast<uint64_t>(v_.proc_offsets[pid]) + len >
+          v_.bytecode.size()) {
+        return Fail("proc", pid, "bytecode out of range");
+      }
+      if (len > v_.words_per_proc) {
+        return Fail("proc", pid,
+                    "length " + Num(len) + " exceeds words per proc " +
+                        Num(v_.words_per_proc));
+      }
+      if (!CheckProc(pid)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Decodes one proc: every op is known, its operands fit in the proc, ids
+  // index their tables and every target is the start of an instruction.
+  bool CheckProc(uint32_t pid) {
+    const uint32_t* code = v_.bytecode.data + v_.proc_offsets[pid];
+    const uint32_t len = v_.proc_lengths[pid];
+    starts_.assign(len, 0u);
+    targets_.clear();
+    uint32_t ip = 0u;
+    auto bad = [&](const std::string& problem) {
+      return Fail("proc", pid, "ip " + Num(ip) + ": " + problem);
+    };
+    auto in_table = [&](uint32_t id, size_t size, const char* table) {
+      return id < size || bad(std::string(table) + " id " + Num(id) +
+                              " out of range");
+    };
+    while (ip < len) {
+      const uint32_t word = code[ip];
+      if ((word & kSchedulerVmOpMask) >= kSchedulerVmOpCount) {
+        return bad("unknown opcode " + Num(word & kSchedulerVmOpMask));
+      }
+      const SchedulerVmOp op = DecodeSchedulerVmOp(word);
+      const uint32_t arg = DecodeSchedulerVmArg(word);
+      const uint32_t next = ip + 1u;
+      if (op == SchedulerVmOp::kCase && next < len && code[next] >= len) {
+        return bad("truncated case");
+      }
+      const uint32_t count = SchedulerVmOperandWords(op, arg, code, next, len);
+      if (static_cast<uint64_t>(next) + count > len) {
+        return bad("truncated operands");
+      }
+      const uint32_t* operands = code + next;
+      starts_[ip] = 1u;
+      switch (op) {
+        case SchedulerVmOp::kJump:
+        case SchedulerVmOp::kTaskCall:
+          targets_.push_back(arg);
+          break;
+        case SchedulerVmOp::kJumpIf:
+          if (!in_table(arg, v_.cond_entries.size(), "cond")) {
+            return false;
+          }
+          targets_.push_back(operands[0]);
+          break;
+        case SchedulerVmOp::kBranch:
+          if (!in_table(arg, v_.cond_entries.size(), "cond")) {
+            return false;
+          }
+          targets_.insert(targets_.end(), operands, operands + 2);
+          break;
+        case SchedulerVmOp::kWaitCond:
+          if (!in_table(arg, v_.cond_entries.size(), "cond")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kCase:
+          // Label count, the label targets, then the default target.
+          if (!in_table(arg, v_.case_headers.size(), "case") ||
+              !CheckCaseTargets(arg, operands[0])) {
+            return false;
+          }
+          targets_.insert(targets_.end(), operands + 1, operands + count);
+          break;
+        case SchedulerVmOp::kRepeat:
+          if (!in_table(arg, v_.repeat_expr_offsets.size(), "repeat")) {
+            return false;
+          }
+          targets_.insert(targets_.end(), operands, operands + 2);
+          break;
+        case SchedulerVmOp::kAssign:
+        case SchedulerVmOp::kAssignNb:
+          if (!in_table(arg, v_.assign_entries.size(), "assign")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kAssignRun:
+          for (uint32_t k = 0; k < count; ++k) {
+            const SchedulerVmOp inner = DecodeSchedulerVmOp(operands[k]);
+            if ((operands[k] & kSchedulerVmOpMask) >= kSchedulerVmOpCount ||
+                (inner != SchedulerVmOp::kAssign &&
+                 inner != SchedulerVmOp::kAssignNb)) {
+              return bad("assign run holds a non-assign op");
+            }
+            if (!in_table(DecodeSchedulerVmArg(operands[k]),
+                          v_.assign_entries.size(), "assign")) {
+              return false;
+            }
+          }
+          break;
+        case SchedulerVmOp::kAssignDelay:
+          if (!in_table(arg, v_.delay_assign_entries.size(), "delay assign")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kForce:
+          if (!in_table(arg, v_.force_entries.size(), "force")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kRelease:
+          if (!in_table(arg, v_.release_entries.size(), "release")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kWaitTime:
+          if (!in_table(arg, v_.delay_expr_offsets.size(), "delay")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kWaitEdge:
+          if (!in_table(arg, v_.edge_wait_entries.size(), "edge wait")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kWaitEdgeLoop:
+          if (!in_table(arg, v_.edge_wait_entries.size(), "edge wait")) {
+            return false;
+          }
+          targets_.push_back(operands[0]);
+          break;
+        case SchedulerVmOp::kFork:
+          if (count == 0u) {
+            return bad("fork without children");
+          }
+          for (uint32_t k = 0; k < count; ++k) {
+            if (!in_table(operands[k], v_.proc_count, "child proc")) {
+              return false;
+            }
+          }
+          break;
+        case SchedulerVmOp::kDisable:
+          switch (static_cast<SchedulerVmDisableKind>(arg)) {
+            case SchedulerVmDisableKind::kBlock:
+              targets_.push_back(operands[0]);
+              break;
+            case SchedulerVmDisableKind::kChildProc:
+              if (!in_table(operands[0], v_.proc_count, "child proc")) {
+                return false;
+              }
+              break;
+            case SchedulerVmDisableKind::kCrossProc:
+              if (!in_table(operands[0], v_.proc_count, "proc")) {
+                return false;
+              }
+              if (operands[1] >= v_.proc_lengths[operands[0]]) {
+                return bad("disable target out of range");
+              }
+              break;
+            default:
+              return bad("unknown disable kind " + Num(arg));
+          }
+          break;
+        case SchedulerVmOp::kServiceCall:
+          if (!in_table(arg, v_.service_entries.size(), "service")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kServiceRetAssign:
+          if (!in_table(arg, v_.service_ret_entries.size(), "service ret")) {
+            return false;
+          }
+          break;
+        case SchedulerVmOp::kServiceRetBranch:
+          targets_.insert(targets_.end(), operands, operands + 2);
+          break;
+        case SchedulerVmOp::kHaltSim:
+          if (arg > 1u) {
+            return bad("unknown halt kind " + Num(arg));
+          }
+          break;
+        default:
+          break;
+      }
+      ip = next + count;
+    }
+    for (uint32_t target : targets_) {
+      if (target >= len || starts_[target] == 0u) {
+        return Fail("proc", pid,
+                    "target " + Num(target) + " is not an instruction");
+      }
+    }
+    return true;
+  }
+
+  const SchedulerVmImageView& v_;
+  // Widest value the kernels handle: 64 bits, or the wide evaluator width.
+  const uint32_t max_width_;
+  std::vector<uint8_t> expr_state_;
+  // Label count each case header was last checked against.
+  std::vector<uint32_t> case_label_count_;
+  std::vector<uint8_t> starts_;
+  std::vector<uint32_t> targets_;
+  std::string message_;
+};
+
+}  // namespace
+
+SchedulerVmImageView ViewSchedulerVmLayout(const SchedulerVmLayout& layout) {
+  SchedulerVmImageView view;
+  view.proc_count = layout.proc_count;
+  view.words_per_proc = layout.words_per_proc;
+  view.expr_reg_count = layout.expr_table.reg_count;
+  view.expr_wide_bits = layout.expr_table.wide_bits;
+  view.bytecode = SpanOf(layout.bytecode);
+  view.proc_offsets = SpanOf(layout.proc_offsets);
+  view.proc_lengths = SpanOf(layout.proc_lengths);
+  view.packed_slots = SpanOf(layout.packed_slots);
+  view.signal_entries = SpanOf(layout.signal_entries);
+  view.cond_entries = SpanOf(layout.cond_entries);
+  view.case_headers = SpanOf(layout.case_headers);
+  view.case_entries = SpanOf(layout.case_entries);
+  view.case_words = SpanOf(layout.case_words);
+  view.assign_entries = SpanOf(layout.assign_entries);
+  view.delay_assign_entries = SpanOf(layout.delay_assign_entries);
+  view.force_entries = SpanOf(layout.force_entries);
+  view.release_entries = SpanOf(layout.release_entries);
+  view.service_entries = SpanOf(layout.service_entries);
+  view.service_args = SpanOf(layout.service_args);
+  view.service_ret_entries = SpanOf(layout.service_ret_entries);
+  view.expr_words = SpanOf(layout.expr_table.words);
+  view.expr_imm_words = SpanOf(layout.expr_table.imm_words);
+  view.edge_item_expr_offsets = SpanOf(layout.edge_item_expr_offsets);
+  view.edge_star_expr_offsets = SpanOf(layout.edge_star_expr_offsets);
+  view.repeat_expr_offsets = SpanOf(layout.repeat_expr_offsets);
+  view.edge_wait_entries = SpanOf(layout.edge_wait_entries);
+  view.edge_item_kinds = SpanOf(layout.edge_item_kinds);
+  view.delay_expr_offsets = SpanOf(layout.delay_expr_offsets);
+  return view;
+}
+
+void CopySchedulerVmImageLayout(const SchedulerVmImageView& view,
+                                SchedulerVmLayout* out) {
+  out->proc_count = view.proc_count;
+  out->words_per_proc = view.words_per_proc;
+  out->expr_table.reg_count = view.expr_reg_count;
+  out->expr_table.wide_bits = view.expr_wide_bits;
+  CopySpan(view.bytecode, &out->bytecode);
+  CopySpan(view.proc_offsets, &out->proc_offsets);
+  CopySpan(view.proc_lengths, &out->proc_lengths);
+  CopySpan(view.packed_slots, &out->packed_slots);
+  CopySpan(view.signal_entries, &out->signal_entries);
+  CopySpan(view.cond_entries, &out->cond_entries);
+  CopySpan(view.case_headers, &out->case_headers);
+  CopySpan(view.case_entries, &out->case_entries);
+  CopySpan(view.case_words, &out->case_words);
+  CopySpan(view.assign_entries, &out->assign_entries);
+  CopySpan(view.delay_assign_entries, &out->delay_assign_entries);
+  CopySpan(view.force_entries, &out->force_entries);
+  CopySpan(view.release_entries, &out->release_entries);
+  CopySpan(view.service_entries, &out->service_entries);
+  CopySpan(view.service_args, &out->service_args);
+  CopySpan(view.service_ret_entries, &out->service_ret_entries);
+  CopySpan(view.expr_words, &out->expr_table.words);
+  CopySpan(view.expr_imm_words, &out->expr_table.imm_words);
+  CopySpan(view.edge_item_expr_offsets, &out->edge_item_expr_offsets);
+  CopySpan(view.edge_star_expr_offsets, &out->edge_star_expr_offsets);
+  CopySpan(view.repeat_expr_offsets, &out->repeat_expr_offsets);
+  CopySpan(view.edge_wait_entries, &out->edge_wait_entries);
+  CopySpan(view.edge_item_kinds, &out->edge_item_kinds);
+  CopySpan(view.delay_expr_offsets, &out->delay_expr_offsets);
+}
+
+bool VerifySchedulerVmImage(const SchedulerVmImageView& view,
+                            std::string* error) {
+  ImageVerifier verifier(view);
+  std::string message;
+  if (!verifier.Verify(&message)) {
+    if (error) {
+      *error = "scheduler VM image: " + message;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool CheckSchedulerVmImageState(const SchedulerVmImageView& view,
+                                const SchedulerVmLayout& layout,
+                                std::string* error) {
+  auto fail = [&](const std::string& message) {
+    if (error) {
+      *error = "scheduler VM image: " + message;
+    }
+    return false;
+  };
+  if (view.expr_wide_bits != layout.expr_table.wide_bits) {
+    return fail("wide evaluator width " + std::to_string(view.expr_wide_bits) +
+                " does not match the design (" +
+                std::to_string(layout.expr_table.wide_bits) + ")");
+  }
+  if (view.packed_slots.size() != layout.packed_slots.size() ||
+      view.signal_entries.size() != layout.signal_entries.size()) {
+    return fail("signal tables do not match the design");
+  }
+  for (size_t i = 0; i < view.packed_slots.size(); ++i) {
+    const SchedulerVmPackedSlot& a = view.packed_slots[i];
+    const SchedulerVmPackedSlot& b = layout.packed_slots[i];
+    if (a.word_size != b.word_size || a.array_size != b.array_size) {
+      return fail("packed slot " + std::to_string(i) +
+                  " does not match the design");
+    }
+  }
+  for (size_t i = 0; i < view.signal_entries.size(); ++i) {
+    const SchedulerVmSignalEntry& a = view.signal_entries[i];
+    const SchedulerVmSignalEntry& b = layout.signal_entries[i];
+    if (a.val_slot != b.val_slot || a.xz_slot != b.xz_slot ||
+        a.width != b.width || a.array_size != b.array_size ||
+        a.flags != b.flags) {
+      return fail("signal " + std::to_string(i) +
+                  " does not match the design");
+    }
+  }
+  return true;
+}
+
+bool SerializeSchedulerVmImage(const SchedulerVmImageView& view,
+                               std::string* out, std::string* error) {
+  if (!out) {
+    if (error) {
+      *error = "scheduler VM image output is null";
+    }
+    return false;
+  }
+  if (!VerifySchedulerVmImage(view, error)) {
+    return false;
+  }
+  std::vector<ImageSectionEntry> entries;
+  entries.reserve(kSchedulerVmImageSectionCount);
+  uint64_t offset = AlignUp(sizeof(ImageHeader) + kSchedulerVmImageSectionCount *
+                                                      sizeof(ImageSectionEntry));
+  ForEachSection(&view, [&](SchedulerVmImageSection id, const auto* span) {
+    ImageSectionEntry entry;
+    entry.id = static_cast<uint32_t>(id);
+    entry.elem_size = static_cast<uint32_t>(sizeof(span->data[0]));
+    entry.offset = offset;
+    entry.count = span->count;
+    offset = AlignUp(offset + entry.count * entry.elem_size);
+    entries.push_back(entry);
+  });
+  ImageHeader header;
+  header.header_bytes = static_cast<uint32_t>(sizeof(ImageHeader));
+  header.section_count = static_cast<uint32_t>(entries.size());
+  header.total_bytes = offset;
+  header.source_bytes = view.source_bytes;
+  header.source_hash = view.source_hash;
+  header.flags = view.four_state ? kSchedulerVmImageFlagFourState : 0u;
+  header.proc_count = view.proc_count;
+  header.words_per_proc = view.words_per_proc;
+  header.expr_reg_count = view.expr_reg_count;
+  header.expr_wide_bits = view.expr_wide_bits;
+  out->assign(static_cast<size_t>(offset), '\0');
+  char* bytes = &(*out)[0];
+  std::memcpy(bytes + sizeof(ImageHeader), entries.data(),
+              entries.size() * sizeof(ImageSectionEntry));
+  size_t index = 0u;
+  ForEachSection(&view, [&](SchedulerVmImageSection, const auto* span) {
+    const ImageSectionEntry& entry = entries[index++];
+    if (entry.count != 0u) {
+      std::memcpy(bytes + entry.offset, span->data,
+                  static_cast<size_t>(entry.count * entry.elem_size));
+    }
+  });
+  header.checksum = ImageChecksum(
+      header, reinterpret_cast<const uint8_t*>(bytes), out->size());
+  std::memcpy(bytes, &header, sizeof(header));
+  return true;
+}
+
+bool WriteSchedulerVmImage(const std::string& path,
+                           const SchedulerVmImageView& view,
+                           std::string* error) {
+  std::string bytes;
+  if (!SerializeSchedulerVmImage(view, &bytes, error)) {
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    if (error) {
+      *error = "failed to open " + path + " for write";
+    }
+    return false;
+  }
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  if (!out) {
+    if (error) {
+      *error = "failed to write " + path;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool MapSchedulerVmImage(const void* data, size_t size,
+                         SchedulerVmImageView* out, std::string* error) {
+  auto fail = [&](const std::string& message) {
+    if (error) {
+      *error = "scheduler VM image: " + message;
+    }
+    return false;
+  };
+  if (!data || !out) {
+    return fail("null input");
+  }
+  if ((reinterpret_cast<uintptr_t>(data) & 7u) != 0u) {
+    return fail("image is not 8-byte aligned");
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  ImageHeader header;
+  if (size < sizeof(header)) {
+    return fail("truncated header");
+  }
+  std::memcpy(&header, bytes, sizeof(header));
+  if (header.magic != kSchedulerVmImageMagic) {
+    return fail("bad magic");
+  }
+  if (header.version != kSchedulerVmImageVersion) {
+    return fail("unsupported version " + std::to_string(header.version));
+  }
+  if (header.header_bytes != sizeof(ImageHeader) ||
+      header.total_bytes != size || (size & 7u) != 0u) {
+    return fail("size mismatch");
+  }
+  const size_t table_bytes =
+      static_cast<size_t>(header.section_count) * sizeof(ImageSectionEntry);
+  if (header.section_count > 64u || table_bytes > size - sizeof(header)) {
+    return fail("bad section table");
+  }
+  if (ImageChecksum(header, bytes, size) != header.checksum) {
+    return fail("checksum mismatch");
+  }
+  // Section table by id; ids this version does not know are skipped.
+  std::vector<ImageSectionEntry> by_id(kSchedulerVmImageSectionCount);
+  for (uint32_t i = 0; i < header.section_count; ++i) {
+    ImageSectionEntry entry;
+    std::memcpy(&entry, bytes + sizeof(header) + i * sizeof(entry),
+                sizeof(entry));
+    if (entry.id == 0u || entry.id > kSchedulerVmImageSectionCount) {
+      continue;
+    }
+    if (by_id[entry.id - 1u].id != 0u) {
+      return fail("duplicate section " + std::to_string(entry.id));
+    }
+    by_id[entry.id - 1u] = entry;
+  }
+  SchedulerVmImageView view;
+  view.source_bytes = header.source_bytes;
+  view.source_hash = header.source_hash;
+  view.four_state = (header.flags & kSchedulerVmImageFlagFourState) != 0u;
+  view.proc_count = header.proc_count;
+  view.words_per_proc = header.words_per_proc;
+  view.expr_reg_count = header.expr_reg_count;
+  view.expr_wide_bits = header.expr_wide_bits;
+  std::string section_error;
+  ForEachSection(&view, [&](SchedulerVmImageSection id, auto* span) {
+    using Elem = typename std::remove_const<
+        typename std::remove_pointer<decltype(span->data)>::type>::type;
+    const ImageSectionEntry& entry = by_id[static_cast<uint32_t>(id) - 1u];
+    if (!section_error.empty()) {
+      return;
+    }
+    if (entry.id == 0u) {
+      section_error = "missing section " +
+                      std::to_string(static_cast<uint32_t>(id));
+      return;
+    }
+    if (entry.elem_size != sizeof(Elem) ||
+        (entry.offset & (alignof(Elem) - 1u)) != 0u ||
+        entry.offset < sizeof(header) + table_bytes || entry.offset > size ||
+        entry.count > (size - entry.offset) / sizeof(Elem)) {
+      section_error = "malformed section " + std::to_string(entry.id);
+      return;
+    }
+    span->data = reinterpret_cast<const Elem*>(bytes + entry.offset);
+    span->count = static_cast<size_t>(entry.count);
+  });
+  if (!section_error.empty()) {
+    return fail(section_error);
+  }
+  if (!VerifySchedulerVmImage(view, error)) {
+    return false;
+  }
+  *out = view;
+  return true;
+}
+
+SchedulerVmImage::~SchedulerVmImage() { Unmap(); }
+
+void SchedulerVmImage::Unmap() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0u;
+  view_ = SchedulerVmImageView{};
+}
+
+bool SchedulerVmImage::Load(const std::string& path, std::string* error) {
+  Unmap();
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    if (error) {
+      *error = "failed to open " + path;
+    }
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size <= 0) {
+    if (error) {
+      *error = "empty or unreadable file " + path;
+    }
+    Unmap();
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED) {
+    if (error) {
+      *error = "failed to map " + path;
+    }
+    Unmap();
+    return false;
+  }
+  data_ = data;
+  if (!MapSchedulerVmImage(data_, size_, &view_, error)) {
+    Unmap();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace gpga
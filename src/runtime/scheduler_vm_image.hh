@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "core/scheduler_vm.hh"
+
+namespace gpga {
+
+// Scheduler VM image (".gpgavm"): a SchedulerVmLayout stored so it can be
+// used straight out of a read-only mapping. A fixed header and a section
+// table are followed by one section per layout table, each aligned to
+// kSchedulerVmImageAlign and holding the table's elements exactly as they
+// are laid out in memory. Loading checks the header and checksum, points a
+// SchedulerVmImageView at the sections and verifies it; nothing is decoded.
+// All integers are stored little-endian.
+constexpr uint32_t kSchedulerVmImageMagic = 0x4D564747u;  // "GGVM"
+constexpr uint32_t kSchedulerVmImageVersion = 2u;
+constexpr const char* kSchedulerVmImageExtension = ".gpgavm";
+constexpr uint32_t kSchedulerVmImageAlign = 64u;
+constexpr uint32_t kSchedulerVmImageFlagFourState = 1u << 0u;
+
+// One section per SchedulerVmLayout table; never renumber existing ids.
+enum class SchedulerVmImageSection : uint32_t {
+  kBytecode = 1u,
+  kProcOffsets = 2u,
+  kProcLengths = 3u,
+  kPackedSlots = 4u,
+  kSignalEntries = 5u,
+  kCondEntries = 6u,
+  kCaseHeaders = 7u,
+  kCaseEntries = 8u,
+  kCaseWords = 9u,
+  kAssignEntries = 10u,
+  kDelayAssignEntries = 11u,
+  kForceEntries = 12u,
+  kReleaseEntries = 13u,
+  kServiceEntries = 14u,
+  kServiceArgs = 15u,
+  kServiceRetEntries = 16u,
+  kExprWords = 17u,
+  kExprImmWords = 18u,
+  kEdgeItemExprOffsets = 19u,
+  kEdgeStarExprOffsets = 20u,
+  kRepeatExprOffsets = 21u,
+  kEdgeWaitEntries = 22u,
+  kEdgeItemKinds = 23u,
+  kDelayExprOffsets = 24u,
+};
+
+constexpr uint32_t kSchedulerVmImageSectionCount =
+    static_cast<uint32_t>(SchedulerVmImageSection::kDelayExprOffsets);
+
+// Read-only view of one table: into an image mapping or a layout vector.
+template <typename T>
+struct SchedulerVmImageSpan {
+  const T* data = nullptr;
+  size_t count = 0u;
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0u; }
+  const T* begin() const { return data; }
+  const T* end() const { return data + count; }
+  const T& operator[](size_t i) const { return data[i]; }
+};
+
+// The tables of a SchedulerVmLayout without ownership. source_bytes and
+// source_hash identify the MSL the layout was emitted with (see
+// SchedulerManifestSourceHash): kernel constants such as the table counts
+// are compiled into that source, so an image only runs against it.
+struct SchedulerVmImageView {
+  uint64_t source_bytes = 0u;
+  uint64_t source_hash = 0u;
+  bool four_state = false;
+  uint32_t proc_count = 0u;
+  uint32_t words_per_proc = 0u;
+  uint32_t expr_reg_count = 0u;
+  uint32_t expr_wide_bits = 0u;
+  SchedulerVmImageSpan<uint32_t> bytecode;
+  SchedulerVmImageSpan<uint32_t> proc_offsets;
+  SchedulerVmImageSpan<uint32_t> proc_lengths;
+  SchedulerVmImageSpan<SchedulerVmPackedSlot> packed_slots;
+  SchedulerVmImageSpan<SchedulerVmSignalEntry> signal_entries;
+  SchedulerVmImageSpan<SchedulerVmCondEntry> cond_entries;
+  SchedulerVmImageSpan<SchedulerVmCaseHeader> case_headers;
+  SchedulerVmImageSpan<SchedulerVmCaseEntry> case_entries;
+  SchedulerVmImageSpan<uint64_t> case_words;
+  SchedulerVmImageSpan<SchedulerVmAssignEntry> assign_entries;
+  SchedulerVmImageSpan<SchedulerVmDelayAssignEntry> delay_assign_entries;
+  SchedulerVmImageSpan<SchedulerVmForceEntry> force_entries;
+  SchedulerVmImageSpan<SchedulerVmReleaseEntry> release_entries;
+  SchedulerVmImageSpan<SchedulerVmServiceEntry> service_entries;
+  SchedulerVmImageSpan<SchedulerVmServiceArg> service_args;
+  SchedulerVmImageSpan<SchedulerVmServiceRetAssignEntry> service_ret_entries;
+  SchedulerVmImageSpan<uint32_t> expr_words;
+  SchedulerVmImageSpan<uint32_t> expr_imm_words;
+  SchedulerVmImageSpan<uint32_t> edge_item_expr_offsets;
+  SchedulerVmImageSpan<uint32_t> edge_star_expr_offsets;
+  SchedulerVmImageSpan<uint32_t> repeat_expr_offsets;
+  SchedulerVmImageSpan<SchedulerVmEdgeWaitEntry> edge_wait_entries;
+  SchedulerVmImageSpan<uint32_t> edge_item_kinds;
+  SchedulerVmImageSpan<uint32_t> delay_expr_offsets;
+};
+
+// View of an in-memory layout; valid while the layout is unchanged.
+SchedulerVmImageView ViewSchedulerVmLayout(const SchedulerVmLayout& layout);
+// Copies the tables of a view into *out (one memcpy per table).
+void CopySchedulerVmImageLayout(const SchedulerVmImageView& view,
+                                SchedulerVmLayout* out);
+
+// Bounds-checks everything the VM kernels index without checking: proc
+// bytecode (every instruction decodes, targets land on instructions of the
+// same proc, table ids and child pids are in range), every expression an
+// entry refers to (starts on an op, only uses known ops with in-range
+// signal/immediate/register operands and widths up to the wide evaluator
+// width, stays within the stack and ends in kDone), the packed slots
+// (sizes a signal can have, matching the width of each signal using them)
+// and the case lookup tables (sizes, power-of-two hash tables, targets
+// below the label count of every kCase using them). Entries flagged as
+// fallbacks are run by generated code and are not checked. Event ids, force
+// slots and format ids index tables outside the layout.
+bool VerifySchedulerVmImage(const SchedulerVmImageView& view,
+                            std::string* error);
+
+// Checks that the view addresses signal state exactly as layout does: the
+// same packed slots (the segments of the state buffers), signal entries and
+// wide evaluator width. The verifier only sees the image, so run this
+// against the layout built for the MSL the image runs with.
+bool CheckSchedulerVmImageState(const SchedulerVmImageView& view,
+                                const SchedulerVmLayout& layout,
+                                std::string* error);
+
+// Verifies the view and lays it out as an image.
+bool SerializeSchedulerVmImage(const SchedulerVmImageView& view,
+                               std::string* out, std::string* error);
+bool WriteSchedulerVmImage(const std::string& path,
+                           const SchedulerVmImageView& view,
+                           std::string* error);
+// Checks the header and checksum of an image at data (8-byte aligned, kept
+// alive by the caller), points *out into it and verifies it.
+bool MapSchedulerVmImage(const void* data, size_t size,
+                         SchedulerVmImageView* out, std::string* error);
+
+// A mapped image file; the view stays valid while the object lives.
+class SchedulerVmImage {
+ public:
+  SchedulerVmImage() = default;
+  ~SchedulerVmImage();
+  SchedulerVmImage(const SchedulerVmImage&) = delete;
+  SchedulerVmImage& operator=(const SchedulerVmImage&) = delete;
+
+  // Maps path read-only and runs MapSchedulerVmImage on it.
+  bool Load(const std::string& path, std::string* error);
+  bool loaded() const { return data_ != nullptr; }
+  const SchedulerVmImageView& view() const { return view_; }
+
+ private:
+  void Unmap();
+
+  int fd_ = -1;
+  void* data_ = nullptr;
+  size_t size_ = 0u;
+  SchedulerVmImageView view_;
+};
+
+}  // namespace gpga
@@ -0,0 +1,2379 @@
+#include "runtime/scheduler_vm_interp.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+namespace gpga {
+
+// The kernels' four-state helpers, kept out of gpga:: so the header's
+// uint/ulong typedefs do not leak.
+namespace fs {
+#include "gpga_4state.h"
+}  // namespace fs
+
+// Threaded dispatch needs labels-as-values (GCC and Clang).
+#if defined(__GNUC__)
+#define GPGA_SCHED_VM_THREADED 1
+#else
+#define GPGA_SCHED_VM_THREADED 0
+#endif
+
+namespace {
+
+constexpr uint32_t kNoParent = 0xFFFFFFFFu;
+constexpr uint32_t kNoMatch = 0xFFFFFFFFu;
+
+const char* const kSchedulerVmOpNames[kSchedulerVmOpCount] = {
+    "done",        "call_group",     "noop",        "jump",
+    "jump_if",     "case",           "repeat",      "assign",
+    "assign_nb",   "assign_delay",   "force",       "release",
+    "wait_time",   "wait_delta",     "wait_event",  "wait_edge",
+    "wait_cond",   "wait_join",      "wait_service", "event_trigger",
+    "fork",        "disable",        "service_call", "service_ret_assign",
+    "service_ret_branch", "task_call", "ret",        "halt_sim",
+    "assign_run",  "branch",         "wait_edge_loop",
+};
+
+const char* const kSchedulerVmExprOpNames[kSchedulerVmExprOpCount] = {
+    "done",  "push_const", "push_signal", "push_imm",
+    "unary", "binary",     "ternary",     "select",
+    "index", "concat",     "call",        "push_const_xz",
+    "load_reg", "store_reg",
+};
+
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(_M_X64)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t value = 0u;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+  return value;
+#else
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+inline uint64_t MaskForWidth(uint32_t width) {
+  if (width >= 64u) {
+    return ~0ull;
+  }
+  return (width == 0u) ? 0ull : ((1ull << width) - 1ull);
+}
+
+inline double BitsToDouble(uint64_t bits) {
+  double out = 0.0;
+  std::memcpy(&out, &bits, sizeof(out));
+  return out;
+}
+
+inline uint64_t DoubleToBits(double value) {
+  uint64_t out = 0u;
+  std::memcpy(&out, &value, sizeof(out));
+  return out;
+}
+
+inline int64_t SignExtend(uint64_t value, uint32_t width) {
+  if (width == 0u || width >= 64u) {
+    return static_cast<int64_t>(value);
+  }
+  const uint64_t sign = 1ull << (width - 1u);
+  value &= MaskForWidth(width);
+  return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+enum class ProcStatus : uint8_t {
+  kReady = 0u,
+  kBlocked = 1u,
+  kDone = 2u,
+};
+
+enum class WaitKind : uint8_t {
+  kNone = 0u,
+  kTime = 1u,
+  kDelta = 2u,
+  kEvent = 3u,
+  kEdge = 4u,
+  kCond = 5u,
+  kJoin = 6u,
+};
+
+enum class ExecExit : uint8_t {
+  kYield = 0u,
+  kHalt = 1u,
+  kError = 2u,
+};
+
+// Assign and delayed-assign entries reduced to the fields a store needs.
+struct StoreTarget {
+  uint32_t signal_id = 0u;
+  uint32_t width = 0u;
+  uint32_t base_width = 0u;
+  uint32_t range_lsb = 0u;
+  uint32_t array_size = 0u;
+  bool is_array = false;
+  bool is_bit_select = false;
+  bool is_range = false;
+  bool is_indexed_range = false;
+};
+
+struct PendingStore {
+  const StoreTarget* target = nullptr;
+  uint64_t val = 0u;
+  uint64_t xz = 0u;
+  uint32_t idx_val = 0u;
+  bool idx_xz = false;
+};
+
+struct TimedStore {
+  uint64_t time = 0u;
+  PendingStore store;
+};
+
+struct ProcState {
+  uint32_t ip = 0u;
+  uint32_t call_sp = 0u;
+  uint32_t call_stack[kSchedulerVmCallFrameDepth] = {};
+  ProcStatus status = ProcStatus::kReady;
+  WaitKind wait = WaitKind::kNone;
+  uint32_t wait_id = 0u;
+  uint64_t wait_time = 0u;
+  uint32_t join_count = 0u;
+  uint32_t parent = kNoParent;
+  // Blocking intra-assignment delay (a = #d b) applied on wake-up.
+  bool has_pending = false;
+  PendingStore pending;
+};
+
+struct Value {
+  uint64_t val = 0u;
+  uint64_t xz = 0u;
+  uint32_t width = 0u;
+  bool real = false;
+};
+
+inline fs::FourState64 ToFs(const Value& v) { return {v.val, v.xz}; }
+
+}  // namespace
+
+const char* SchedulerVmOpName(uint32_t op) {
+  return (op < kSchedulerVmOpCount) ? kSchedulerVmOpNames[op] : "?";
+}
+
+const char* SchedulerVmExprOpName(uint32_t op) {
+  return (op < kSchedulerVmExprOpCount) ? kSchedulerVmExprOpNames[op] : "?";
+}
+
+void SchedulerVmProfile::Reset(uint32_t proc_count) {
+  op_count.fill(0u);
+  op_cycles.fill(0u);
+  op_pairs.fill(0u);
+  expr_op_count.fill(0u);
+  expr_op_cycles.fill(0u);
+  proc_steps.assign(proc_count, 0u);
+  proc_cycles.assign(proc_count, 0u);
+}
+
+std::string SchedulerVmProfile::Format(uint32_t top_procs) const {
+  std::ostringstream out;
+  auto emit_table = [&](const char* title, const char* const* names,
+                        const uint64_t* counts, const uint64_t* cycles,
+                        uint32_t size) {
+    uint64_t total = 0u;
+    for (uint32_t i = 0; i < size; ++i) {
+      total += cycles[i];
+    }
+    std::vector<uint32_t> order(size);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return cycles[a] > cycles[b];
+    });
+    out << title << " (cycles=" << total << ")\n";
+    for (uint32_t i : order) {
+      if (counts[i] == 0u) {
+        continue;
+      }
+      const double share =
+          (total == 0u) ? 0.0 : (100.0 * static_cast<double>(cycles[i]) /
+                                 static_cast<double>(total));
+      out << "  " << std::left << std::setw(20) << names[i] << std::right
+          << " count=" << std::setw(12) << counts[i]
+          << " cycles=" << std::setw(14) << cycles[i]
+          << " avg=" << std::setw(8) << (cycles[i] / counts[i]) << " "
+          << std::fixed << std::setprecision(1) << std::setw(5) << share
+          << "%\n";
+    }
+  };
+  emit_table("vm ops", kSchedulerVmOpNames, op_count.data(), op_cycles.data(),
+             kSchedulerVmOpCount);
+  emit_table("vm expr ops", kSchedulerVmExprOpNames, expr_op_count.data(),
+             expr_op_cycles.data(), kSchedulerVmExprOpCount);
+  std::vector<uint32_t> pairs;
+  for (uint32_t i = 0; i < op_pairs.size(); ++i) {
+    if (op_pairs[i] != 0u) {
+      pairs.push_back(i);
+    }
+  }
+  std::stable_sort(pairs.begin(), pairs.end(), [&](uint32_t a, uint32_t b) {
+    return op_pairs[a] > op_pairs[b];
+  });
+  if (pairs.size() > top_procs) {
+    pairs.resize(top_procs);
+  }
+  out << "vm op pairs\n";
+  for (uint32_t i : pairs) {
+    const std::string pair =
+        std::string(kSchedulerVmOpNames[i / kSchedulerVmOpCount]) + " -> " +
+        kSchedulerVmOpNames[i % kSchedulerVmOpCount];
+    out << "  " << std::left << std::setw(36) << pair << std::right
+        << " count=" << std::setw(12) << op_pairs[i] << "\n";
+  }
+  std::vector<uint32_t> procs(proc_cycles.size());
+  std::iota(procs.begin(), procs.end(), 0u);
+  std::stable_sort(procs.begin(), procs.end(), [&](uint32_t a, uint32_t b) {
+    return proc_cycles[a] > proc_cycles[b];
+  });
+  if (procs.size() > top_procs) {
+    procs.resize(top_procs);
+  }
+  out << "hot procs\n";
+  for (uint32_t pid : procs) {
+    if (proc_steps[pid] == 0u) {
+      continue;
+    }
+    out << "  pid " << std::setw(6) << pid << " steps=" << std::setw(12)
+        << proc_steps[pid] << " cycles=" << std::setw(14) << proc_cycles[pid]
+        << "\n";
+  }
+  return out.str();
+}
+
+struct SchedulerVmInterpreter::Impl {
+  Impl(const SchedulerVmLayout& layout_in, bool four_state_in)
+      : layout(layout_in), four_state(four_state_in) {}
+
+  const SchedulerVmLayout& layout;
+  const bool four_state;
+
+  std::vector<uint8_t> state;
+  std::vector<uint64_t> val_offsets;
+  std::vector<uint64_t> xz_offsets;
+  std::vector<StoreTarget> assign_targets;
+  std::vector<StoreTarget> delay_targets;
+  const std::vector<SchedulerVmContinuousAssign>* continuous_assigns = nullptr;
+  std::vector<StoreTarget> continuous_targets;
+  std::vector<bool> is_fork_child;
+  uint32_t event_count = 0u;
+
+  // Per-instance scheduler state; instances run one after another.
+  uint32_t gid = 0u;
+  uint64_t time = 0u;
+  std::vector<ProcState> procs;
+  std::vector<uint8_t> event_pending;
+  std::vector<uint32_t> repeat_left;
+  std::vector<uint8_t> repeat_active;
+  std::vector<Value> edge_prev;
+  std::vector<Value> edge_star_prev;
+  std::vector<PendingStore> nba_queue;
+  std::vector<TimedStore> delayed_nba;
+  uint64_t service_ret = 0u;
+  bool halted = false;
+
+  uint64_t max_steps = 0u;
+  SchedulerVmRunResult* result = nullptr;
+  SchedulerVmProfile* profile = nullptr;
+  std::string* error = nullptr;
+
+  bool Prepare(uint32_t instance_count, std::string* err);
+  void ResetInstance(uint32_t instance);
+
+  bool Fail(uint32_t pid, const std::string& what) {
+    if (error) {
+      *error = "scheduler VM proc " + std::to_string(pid) + " (gid " +
+               std::to_string(gid) + "): " + what;
+    }
+    return false;
+  }
+
+  bool Load(uint64_t addr, uint32_t width, uint64_t* out) const {
+    const uint64_t bytes = (width > 32u) ? 8u : 4u;
+    if (addr + bytes > state.size()) {
+      return false;
+    }
+    if (bytes == 8u) {
+      std::memcpy(out, state.data() + addr, 8u);
+    } else {
+      uint32_t word = 0u;
+      std::memcpy(&word, state.data() + addr, 4u);
+      *out = word;
+    }
+    return true;
+  }
+
+  bool Store(uint64_t addr, uint32_t width, uint64_t value) {
+    const uint64_t bytes = (width > 32u) ? 8u : 4u;
+    if (addr + bytes > state.size()) {
+      return false;
+    }
+    if (bytes == 8u) {
+      std::memcpy(state.data() + addr, &value, 8u);
+    } else {
+      const uint32_t word = static_cast<uint32_t>(value);
+      std::memcpy(state.data() + addr, &word, 4u);
+    }
+    return true;
+  }
+
+  bool LoadElement(uint32_t signal_id, uint64_t element, uint32_t width,
+                   Value* out) const {
+    const uint64_t stride = (width > 32u) ? 8u : 4u;
+    if (!Load(val_offsets[signal_id] + element * stride, width, &out->val)) {
+      return false;
+    }
+    out->xz = 0u;
+    if (four_state &&
+        !Load(xz_offsets[signal_id] + element * stride, width, &out->xz)) {
+      return false;
+    }
+    const uint64_t mask = MaskForWidth(width);
+    out->val &= mask;
+    out->xz &= mask;
+    out->width = width;
+    out->real = false;
+    return true;
+  }
+
+  template <bool kProfile>
+  bool EvalExpr(uint32_t offset, Value* out);
+  bool EvalUnary(uint32_t uop, uint32_t width, Value* v) const;
+  bool EvalBinary(uint32_t arg, uint32_t width, const Value& lhs,
+                  const Value& rhs, Value* out) const;
+  bool EvalCall(uint32_t arg, uint32_t width, Value* args, uint32_t argc,
+                Value* out) const;
+
+  template <bool kProfile>
+  bool EvalCond(uint32_t cond_id, bool* taken);
+  template <bool kProfile>
+  bool EvalCase(uint32_t case_id, uint32_t* match);
+  bool LookupCase(const SchedulerVmCaseHeader& header, uint64_t val,
+                  uint32_t* match) const;
+  template <bool kProfile>
+  bool EvalIndexAndValue(const StoreTarget& target, bool has_index,
+                         uint32_t idx_expr, uint32_t rhs_expr, bool wide_const,
+                         PendingStore* store);
+  bool ApplyStore(const PendingStore& store);
+  bool SettleContinuousAssigns();
+
+  template <bool kProfile>
+  bool SnapshotEdges(uint32_t wait_id);
+  template <bool kProfile>
+  bool EdgeFired(uint32_t wait_id);
+
+  void FinishProc(uint32_t pid);
+  void Block(uint32_t pid, WaitKind wait, uint32_t resume_ip) {
+    ProcState& proc = procs[pid];
+    proc.status = ProcStatus::kBlocked;
+    proc.wait = wait;
+    proc.ip = resume_ip;
+  }
+
+  template <bool kProfile>
+  ExecExit Exec(uint32_t pid);
+  template <bool kProfile>
+  bool RunInstance(uint64_t max_time);
+};
+
+bool SchedulerVmInterpreter::Impl::Prepare(uint32_t instance_count,
+                                           std::string* err) {
+  std::vector<uint64_t> slot_offsets(layout.packed_slots.size(), 0u);
+  uint64_t offset = 0u;
+  for (size_t i = 0; i < layout.packed_slots.size(); ++i) {
+    offset = (offset + 7u) & ~static_cast<uint64_t>(7u);
+    slot_offsets[i] = offset;
+    const SchedulerVmPackedSlot& slot = layout.packed_slots[i];
+    offset += static_cast<uint64_t>(instance_count) *
+              std::max<uint32_t>(1u, slot.array_size) *
+              std::max<uint32_t>(1u, slot.word_size);
+  }
+  state.assign(static_cast<size_t>(offset), 0u);
+  val_offsets.assign(layout.signal_entries.size(), 0u);
+  xz_offsets.assign(layout.signal_entries.size(), 0u);
+  for (size_t i = 0; i < layout.signal_entries.size(); ++i) {
+    const SchedulerVmSignalEntry& sig = layout.signal_entries[i];
+    if (sig.val_slot < slot_offsets.size()) {
+      val_offsets[i] = slot_offsets[sig.val_slot];
+    }
+    if (sig.xz_slot < slot_offsets.size()) {
+      xz_offsets[i] = slot_offsets[sig.xz_slot];
+    }
+  }
+  if (four_state) {
+    // Regs power up as X; the --prune-xz zero slot stays zero.
+    std::vector<bool> xz_slot(layout.packed_slots.size(), false);
+    for (const auto& sig : layout.signal_entries) {
+      if ((sig.flags & (kSchedulerVmSignalFlagReal |
+                        kSchedulerVmSignalFlagTwoState)) == 0u &&
+          sig.xz_slot < xz_slot.size() && sig.xz_slot != sig.val_slot) {
+        xz_slot[sig.xz_slot] = true;
+      }
+    }
+    for (size_t i = 0; i < xz_slot.size(); ++i) {
+      if (!xz_slot[i]) {
+        continue;
+      }
+      const SchedulerVmPackedSlot& slot = layout.packed_slots[i];
+      const uint64_t bytes = static_cast<uint64_t>(instance_count) *
+                             std::max<uint32_t>(1u, slot.array_size) *
+                             std::max<uint32_t>(1u, slot.word_size);
+      std::memset(state.data() + slot_offsets[i], 0xFF,
+                  static_cast<size_t>(bytes));
+    }
+  }
+
+  auto make_target = [](uint32_t signal_id, uint32_t width,
+                        uint32_t base_width, uint32_t range_lsb,
+                        uint32_t array_size) {
+    StoreTarget target;
+    target.signal_id = signal_id;
+    target.width = width;
+    target.base_width = base_width;
+    target.range_lsb = range_lsb;
+    target.array_size = array_size;
+    return target;
+  };
+  assign_targets.clear();
+  for (const auto& entry : layout.assign_entries) {
+    StoreTarget target =
+        make_target(entry.signal_id, entry.width, entry.base_width,
+                    entry.range_lsb, entry.array_size);
+    target.is_array = (entry.flags & kSchedulerVmAssignFlagIsArray) != 0u;
+    target.is_bit_select =
+        (entry.flags & kSchedulerVmAssignFlagIsBitSelect) != 0u;
+    target.is_range = (entry.flags & kSchedulerVmAssignFlagIsRange) != 0u;
+    target.is_indexed_range =
+        (entry.flags & kSchedulerVmAssignFlagIsIndexedRange) != 0u;
+    assign_targets.push_back(target);
+  }
+  delay_targets.clear();
+  for (const auto& entry : layout.delay_assign_entries) {
+    StoreTarget target =
+        make_target(entry.signal_id, entry.width, entry.base_width,
+                    entry.range_lsb, entry.array_size);
+    target.is_array =
+        (entry.flags & kSchedulerVmDelayAssignFlagIsArray) != 0u;
+    target.is_bit_select =
+        (entry.flags & kSchedulerVmDelayAssignFlagIsBitSelect) != 0u;
+    target.is_range =
+        (entry.flags & kSchedulerVmDelayAssignFlagIsRange) != 0u;
+    target.is_indexed_range =
+        (entry.flags & kSchedulerVmDelayAssignFlagIsIndexedRange) != 0u;
+    delay_targets.push_back(target);
+  }
+
+  continuous_targets.clear();
+  if (continuous_assigns) {
+    for (const auto& assign : *continuous_assigns) {
+      if (assign.signal_id >= layout.signal_entries.size()) {
+        if (err) {
+          *err = "scheduler VM continuous assign target out of range";
+        }
+        return false;
+      }
+      const SchedulerVmSignalEntry& sig =
+          layout.signal_entries[assign.signal_id];
+      continuous_targets.push_back(make_target(
+          assign.signal_id, sig.width, sig.width, 0u, sig.array_size));
+    }
+  }
+
+  // Fork children start idle; everything else (initial/always) is a root.
+  // The proc table carries no parent links, so recover them from the forks.
+  is_fork_child.assign(layout.proc_count, false);
+  event_count = 0u;
+  for (uint32_t pid = 0; pid < layout.proc_count; ++pid) {
+    const uint32_t base = layout.proc_offsets[pid];
+    const uint32_t len = layout.proc_lengths[pid];
+    if (static_cast<uint64_t>(base) + len > layout.bytecode.size()) {
+      if (err) {
+        *err = "scheduler VM proc " + std::to_string(pid) +
+               " exceeds the bytecode table";
+      }
+      return false;
+    }
+    const uint32_t* code = layout.bytecode.data() + base;
+    uint32_t ip = 0u;
+    while (ip < len) {
+      const uint32_t instr = code[ip];
+      const SchedulerVmOp op = DecodeSchedulerVmOp(instr);
+      const uint32_t arg = DecodeSchedulerVmArg(instr);
+      const uint32_t next = ip + 1u;
+      if (op == SchedulerVmOp::kFork) {
+        const uint32_t count = DecodeSchedulerVmForkCount(arg);
+        for (uint32_t c = 0; c < count && next + c < len; ++c) {
+          if (code[next + c] < layout.proc_count) {
+            is_fork_child[code[next + c]] = true;
+          }
+        }
+      } else if (op == SchedulerVmOp::kWaitEvent ||
+                 op == SchedulerVmOp::kEventTrigger) {
+        event_count = std::max(event_count, arg + 1u);
+      }
+      ip = next + SchedulerVmOperandWords(op, arg, code, next, len);
+    }
+  }
+  return true;
+}
+
+void SchedulerVmInterpreter::Impl::ResetInstance(uint32_t instance) {
+  gid = instance;
+  time = 0u;
+  procs.assign(layout.proc_count, ProcState{});
+  for (uint32_t pid = 0; pid < layout.proc_count; ++pid) {
+    if (is_fork_child[pid]) {
+      procs[pid].status = ProcStatus::kDone;
+    }
+  }
+  event_pending.assign(event_count, 0u);
+  repeat_left.assign(layout.repeat_expr_offsets.size(), 0u);
+  repeat_active.assign(layout.repeat_expr_offsets.size(), 0u);
+  edge_prev.assign(layout.edge_item_expr_offsets.size(), Value{});
+  edge_star_prev.assign(layout.edge_star_expr_offsets.size(), Value{});
+  nba_queue.clear();
+  delayed_nba.clear();
+  service_ret = 0u;
+  halted = false;
+}
+
+bool SchedulerVmInterpreter::Impl::EvalUnary(uint32_t uop, uint32_t width,
+                                             Value* v) const {
+  using fs::FourState64;
+  if (v->real) {
+    const double x = BitsToDouble(v->val);
+    switch (static_cast<SchedulerVmExprUnaryOp>(uop)) {
+      case SchedulerVmExprUnaryOp::kLogNot:
+        *v = Value{(x == 0.0) ? 1ull : 0ull, 0u, 1u, false};
+        return true;
+      case SchedulerVmExprUnaryOp::kMinus:
+        v->val = DoubleToBits(-x);
+        return true;
+      case SchedulerVmExprUnaryOp::kPlus:
+        return true;
+      default:
+        return false;
+    }
+  }
+  const uint32_t in_width = v->width;
+  const FourState64 a = ToFs(*v);
+  FourState64 r = a;
+  switch (static_cast<SchedulerVmExprUnaryOp>(uop)) {
+    case SchedulerVmExprUnaryOp::kPlus:
+      break;
+    case SchedulerVmExprUnaryOp::kMinus:
+      r = fs::fs_sub64(FourState64{0u, 0u}, fs::fs_resize64(a, width), width);
+      break;
+    case SchedulerVmExprUnaryOp::kBitNot:
+      r = fs::fs_not64(fs::fs_resize64(a, width), width);
+      break;
+    case SchedulerVmExprUnaryOp::kLogNot:
+      r = fs::fs_log_not64(a, in_width);
+      break;
+    case SchedulerVmExprUnaryOp::kRedAnd:
+      r = fs::fs_red_and64(a, in_width);
+      break;
+    case SchedulerVmExprUnaryOp::kRedNand:
+      r = fs::fs_log_not64(fs::fs_red_and64(a, in_width), 1u);
+      break;
+    case SchedulerVmExprUnaryOp::kRedOr:
+      r = fs::fs_red_or64(a, in_width);
+      break;
+    case SchedulerVmExprUnaryOp::kRedNor:
+      r = fs::fs_log_not64(fs::fs_red_or64(a, in_width), 1u);
+      break;
+    case SchedulerVmExprUnaryOp::kRedXor:
+      r = fs::fs_red_xor64(a, in_width);
+      break;
+    case SchedulerVmExprUnaryOp::kRedXnor:
+      r = fs::fs_log_not64(fs::fs_red_xor64(a, in_width), 1u);
+      break;
+    default:
+      return false;
+  }
+  r = fs::fs_resize64(r, width);
+  *v = Value{r.val, r.xz, width, false};
+  return true;
+}
+
+bool SchedulerVmInterpreter::Impl::EvalBinary(uint32_t arg, uint32_t width,
+                                              const Value& lhs,
+                                              const Value& rhs,
+                                              Value* out) const {
+  using fs::FourState64;
+  const auto bop = static_cast<SchedulerVmExprBinaryOp>(arg & 0xFFu);
+  const bool is_signed = (arg & kSchedulerVmExprSignedFlag) != 0u;
+  if (lhs.real || rhs.real) {
+    auto to_real = [&](const Value& v) {
+      if (v.real) {
+        return BitsToDouble(v.val);
+      }
+      return is_signed ? static_cast<double>(SignExtend(v.val, v.width))
+                       : static_cast<double>(v.val & MaskForWidth(v.width));
+    };
+    const bool unknown = (!lhs.real && lhs.xz != 0u) ||
+                         (!rhs.real && rhs.xz != 0u);
+    const double a = to_real(lhs);
+    const double b = to_real(rhs);
+    bool pred = false;
+    double value = 0.0;
+    bool is_pred = true;
+    switch (bop) {
+      case SchedulerVmExprBinaryOp::kEq:
+      case SchedulerVmExprBinaryOp::kCaseEq:
+        pred = (a == b);
+        break;
+      case SchedulerVmExprBinaryOp::kNeq:
+      case SchedulerVmExprBinaryOp::kCaseNeq:
+        pred = (a != b);
+        break;
+      case SchedulerVmExprBinaryOp::kLt:
+        pred = (a < b);
+        break;
+      case SchedulerVmExprBinaryOp::kLe:
+        pred = (a <= b);
+        break;
+      case SchedulerVmExprBinaryOp::kGt:
+        pred = (a > b);
+        break;
+      case SchedulerVmExprBinaryOp::kGe:
+        pred = (a >= b);
+        break;
+      case SchedulerVmExprBinaryOp::kLogAnd:
+        pred = (a != 0.0) && (b != 0.0);
+        break;
+      case SchedulerVmExprBinaryOp::kLogOr:
+        pred = (a != 0.0) || (b != 0.0);
+        break;
+      case SchedulerVmExprBinaryOp::kAdd:
+        value = a + b;
+        is_pred = false;
+        break;
+      case SchedulerVmExprBinaryOp::kSub:
+        value = a - b;
+        is_pred = false;
+        break;
+      case SchedulerVmExprBinaryOp::kMul:
+        value = a * b;
+        is_pred = false;
+        break;
+      case SchedulerVmExprBinaryOp::kDiv:
+        value = a / b;
+        is_pred = false;
+        break;
+      case SchedulerVmExprBinaryOp::kPow:
+        value = std::pow(a, b);
+        is_pred = false;
+        break;
+      default:
+        return false;
+    }
+    if (is_pred) {
+      *out = Value{pred ? 1ull : 0ull, unknown ? 1ull : 0ull, 1u, false};
+    } else {
+      *out = Value{DoubleToBits(value), unknown ? 1ull : 0ull, 64u, true};
+    }
+    return true;
+  }
+
+  const FourState64 a = ToFs(lhs);
+  const FourState64 b = ToFs(rhs);
+  const uint32_t eval_width = std::max(lhs.width, rhs.width);
+  FourState64 r{0u, 0u};
+  switch (bop) {
+    case SchedulerVmExprBinaryOp::kLogAnd:
+      r = fs::fs_log_and64(fs::fs_resize64(a, eval_width),
+                           fs::fs_resize64(b, eval_width), eval_width);
+      break;
+    case SchedulerVmExprBinaryOp::kLogOr:
+      r = fs::fs_log_or64(fs::fs_resize64(a, eval_width),
+                          fs::fs_resize64(b, eval_width), eval_width);
+      break;
+    case SchedulerVmExprBinaryOp::kEq:
+    case SchedulerVmExprBinaryOp::kNeq: {
+      FourState64 ea = fs::fs_resize64(a, eval_width);
+      FourState64 eb = fs::fs_resize64(b, eval_width);
+      if (is_signed) {
+        ea = fs::fs_sext64(a, lhs.width, eval_width);
+        eb = fs::fs_sext64(b, rhs.width, eval_width);
+      }
+      r = (bop == SchedulerVmExprBinaryOp::kEq)
+              ? fs::fs_eq64(ea, eb, eval_width)
+              : fs::fs_ne64(ea, eb, eval_width);
+      break;
+    }
+    case SchedulerVmExprBinaryOp::kCaseEq:
+    case SchedulerVmExprBinaryOp::kCaseNeq: {
+      const bool eq = fs::fs_case_eq64(fs::fs_resize64(a, eval_width),
+                                       fs::fs_resize64(b, eval_width),
+                                       eval_width);
+      r = FourState64{
+          (eq == (bop == SchedulerVmExprBinaryOp::kCaseEq)) ? 1ull : 0ull,
+          0u};
+      break;
+    }
+    case SchedulerVmExprBinaryOp::kLt:
+    case SchedulerVmExprBinaryOp::kLe:
+    case SchedulerVmExprBinaryOp::kGt:
+    case SchedulerVmExprBinaryOp::kGe:
+      if (is_signed) {
+        const FourState64 sa = fs::fs_sext64(a, lhs.width, eval_width);
+        const FourState64 sb = fs::fs_sext64(b, rhs.width, eval_width);
+        r = (bop == SchedulerVmExprBinaryOp::kLt)   ? fs::fs_slt64(sa, sb, eval_width)
+            : (bop == SchedulerVmExprBinaryOp::kLe) ? fs::fs_sle64(sa, sb, eval_width)
+            : (bop == SchedulerVmExprBinaryOp::kGt) ? fs::fs_sgt64(sa, sb, eval_width)
+                                                    : fs::fs_sge64(sa, sb, eval_width);
+      } else {
+        const FourState64 ua = fs::fs_resize64(a, eval_width);
+        const FourState64 ub = fs::fs_resize64(b, eval_width);
+        r = (bop == SchedulerVmExprBinaryOp::kLt)   ? fs::fs_lt64(ua, ub, eval_width)
+            : (bop == SchedulerVmExprBinaryOp::kLe) ? fs::fs_le64(ua, ub, eval_width)
+            : (bop == SchedulerVmExprBinaryOp::kGt) ? fs::fs_gt64(ua, ub, eval_width)
+                                                    : fs::fs_ge64(ua, ub, eval_width);
+      }
+      break;
+    case SchedulerVmExprBinaryOp::kShl:
+    case SchedulerVmExprBinaryOp::kShr:
+    case SchedulerVmExprBinaryOp::kAshr: {
+      FourState64 sa = fs::fs_resize64(a, width);
+      if (is_signed) {
+        sa = fs::fs_sext64(a, lhs.width, width);
+      }
+      if (bop == SchedulerVmExprBinaryOp::kShl) {
+        r = fs::fs_shl64(sa, b, width);
+      } else if (bop == SchedulerVmExprBinaryOp::kShr || !is_signed) {
+        r = fs::fs_shr64(fs::fs_resize64(a, width), b, width);
+      } else {
+        r = fs::fs_sar64(sa, b, width);
+      }
+      break;
+    }
+    case SchedulerVmExprBinaryOp::kAnd:
+    case SchedulerVmExprBinaryOp::kOr:
+    case SchedulerVmExprBinaryOp::kXor:
+    case SchedulerVmExprBinaryOp::kXnor: {
+      FourState64 ba = fs::fs_resize64(a, width);
+      FourState64 bb = fs::fs_resize64(b, width);
+      if (is_signed) {
+        ba = fs::fs_sext64(a, lhs.width, width);
+        bb = fs::fs_sext64(b, rhs.width, width);
+      }
+      if (bop == SchedulerVmExprBinaryOp::kAnd) {
+        r = fs::fs_and64(ba, bb, width);
+      } else if (bop == SchedulerVmExprBinaryOp::kOr) {
+        r = fs::fs_or64(ba, bb, width);
+      } else if (bop == SchedulerVmExprBinaryOp::kXor) {
+        r = fs::fs_xor64(ba, bb, width);
+      } else {
+        r = fs::fs_not64(fs::fs_xor64(ba, bb, width), width);
+      }
+      break;
+    }
+    case SchedulerVmExprBinaryOp::kAdd:
+    case SchedulerVmExprBinaryOp::kSub:
+    case SchedulerVmExprBinaryOp::kMul:
+    case SchedulerVmExprBinaryOp::kDiv:
+    case SchedulerVmExprBinaryOp::kMod:
+    case SchedulerVmExprBinaryOp::kPow: {
+      FourState64 na = fs::fs_resize64(a, width);
+      FourState64 nb = fs::fs_resize64(b, width);
+      if (is_signed) {
+        na = fs::fs_sext64(a, lhs.width, width);
+        nb = fs::fs_sext64(b, rhs.width, width);
+      }
+      switch (bop) {
+        case SchedulerVmExprBinaryOp::kAdd:
+          r = fs::fs_add64(na, nb, width);
+          break;
+        case SchedulerVmExprBinaryOp::kSub:
+          r = fs::fs_sub64(na, nb, width);
+          break;
+        case SchedulerVmExprBinaryOp::kMul:
+          r = fs::fs_mul64(na, nb, width);
+          break;
+        case SchedulerVmExprBinaryOp::kDiv:
+          r = is_signed ? fs::fs_sdiv64(na, nb, width)
+                        : fs::fs_div64(na, nb, width);
+          break;
+        case SchedulerVmExprBinaryOp::kPow:
+          r = is_signed ? fs::fs_spow64(na, nb, width)
+                        : fs::fs_pow64(na, nb, width);
+          break;
+        default:
+          r = is_signed ? fs::fs_smod64(na, nb, width)
+                        : fs::fs_mod64(na, nb, width);
+          break;
+      }
+      if (!four_state && r.xz != 0u) {
+        // Two-state divide by zero yields 0.
+        r = FourState64{0u, 0u};
+      }
+      break;
+    }
+    default:
+      return false;
+  }
+  r = fs::fs_resize64(r, width);
+  *out = Value{r.val, r.xz, width, false};
+  return true;
+}
+
+bool SchedulerVmInterpreter::Impl::EvalCall(uint32_t arg, uint32_t width,
+                                            Value* args, uint32_t argc,
+                                            Value* out) const {
+  const auto call = static_cast<SchedulerVmExprCallOp>(arg & 0xFFu);
+  const bool is_signed = (arg & kSchedulerVmExprSignedFlag) != 0u;
+  switch (call) {
+    case SchedulerVmExprCallOp::kTime:
+      *out = Value{time & MaskForWidth(width), 0u, width, false};
+      return true;
+    case SchedulerVmExprCallOp::kStime:
+      *out = Value{static_cast<uint32_t>(time) & MaskForWidth(width), 0u,
+                   width, false};
+      return true;
+    case SchedulerVmExprCallOp::kRealtime:
+      *out = Value{DoubleToBits(static_cast<double>(time)), 0u, 64u, true};
+      return true;
+    default:
+      break;
+  }
+  for (uint32_t i = 0; i < argc; ++i) {
+    if (!args[i].real && args[i].xz != 0u) {
+      *out = Value{0u, four_state ? MaskForWidth(width) : 0u, width, false};
+      return true;
+    }
+  }
+  auto as_real = [&](const Value& v) {
+    if (v.real) {
+      return BitsToDouble(v.val);
+    }
+    return is_signed ? static_cast<double>(SignExtend(v.val, v.width))
+                     : static_cast<double>(v.val);
+  };
+  const double x = as_real(args[0]);
+  double y = 0.0;
+  switch (call) {
+    case SchedulerVmExprCallOp::kIToR:
+      y = x;
+      break;
+    case SchedulerVmExprCallOp::kBitsToReal:
+      *out = Value{args[0].val, 0u, 64u, true};
+      return true;
+    case SchedulerVmExprCallOp::kRealToBits:
+      *out = Value{args[0].val & MaskForWidth(width), 0u, width, false};
+      return true;
+    case SchedulerVmExprCallOp::kRToI:
+      *out = Value{static_cast<uint64_t>(static_cast<int64_t>(x)) &
+                       MaskForWidth(width),
+                   0u, width, false};
+      return true;
+    case SchedulerVmExprCallOp::kLog10:
+      y = std::log10(x);
+      break;
+    case SchedulerVmExprCallOp::kLn:
+      y = std::log(x);
+      break;
+    case SchedulerVmExprCallOp::kExp:
+      y = std::exp(x);
+      break;
+    case SchedulerVmExprCallOp::kSqrt:
+      y = std::sqrt(x);
+      break;
+    case SchedulerVmExprCallOp::kFloor:
+      y = std::floor(x);
+      break;
+    case SchedulerVmExprCallOp::kCeil:
+      y = std::ceil(x);
+      break;
+    case SchedulerVmExprCallOp::kSin:
+      y = std::sin(x);
+      break;
+    case SchedulerVmExprCallOp::kCos:
+      y = std::cos(x);
+      break;
+    case SchedulerVmExprCallOp::kTan:
+      y = std::tan(x);
+      break;
+    case SchedulerVmExprCallOp::kAsin:
+      y = std::asin(x);
+      break;
+    case SchedulerVmExprCallOp::kAcos:
+      y = std::acos(x);
+      break;
+    case SchedulerVmExprCallOp::kAtan:
+      y = std::atan(x);
+      break;
+    case SchedulerVmExprCallOp::kSinh:
+      y = std::sinh(x);
+      break;
+    case SchedulerVmExprCallOp::kCosh:
+      y = std::cosh(x);
+      break;
+    case SchedulerVmExprCallOp::kTanh:
+      y = std::tanh(x);
+      break;
+    case SchedulerVmExprCallOp::kAsinh:
+      y = std::asinh(x);
+      break;
+    case SchedulerVmExprCallOp::kAcosh:
+      y = std::acosh(x);
+      break;
+    case SchedulerVmExprCallOp::kAtanh:
+      y = std::atanh(x);
+      break;
+    case SchedulerVmExprCallOp::kPow:
+      y = std::pow(x, as_real(args[1]));
+      break;
+    case SchedulerVmExprCallOp::kAtan2:
+      y = std::atan2(x, as_real(args[1]));
+      break;
+    case SchedulerVmExprCallOp::kHypot:
+      y = std::hypot(x, as_real(args[1]));
+      break;
+    default:
+      return false;
+  }
+  *out = Value{DoubleToBits(y), 0u, 64u, true};
+  return true;
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::EvalExpr(uint32_t offset, Value* out) {
+  const std::vector<uint32_t>& words = layout.expr_table.words;
+  const std::vector<uint32_t>& imm = layout.expr_table.imm_words;
+  const uint32_t word_count = static_cast<uint32_t>(words.size());
+  Value stack[kSchedulerVmExprStackMax];
+  Value regs[kSchedulerVmExprRegMax];
+  const uint32_t reg_count =
+      std::min(layout.expr_table.reg_count, kSchedulerVmExprRegMax);
+  uint32_t sp = 0u;
+  uint32_t ip = offset;
+  uint32_t op = 0u;
+  uint32_t arg = 0u;
+  uint32_t width = 0u;
+  uint64_t t0 = 0u;
+  uint32_t timed_op = kSchedulerVmExprOpCount;
+
+  auto account = [&]() {
+    if constexpr (kProfile) {
+      const uint64_t now = ReadCycleCounter();
+      if (timed_op < kSchedulerVmExprOpCount) {
+        profile->expr_op_cycles[timed_op] += now - t0;
+      }
+      t0 = now;
+      timed_op = op;
+      profile->expr_op_count[op] += 1u;
+    }
+  };
+  auto finish = [&]() {
+    if constexpr (kProfile) {
+      if (timed_op < kSchedulerVmExprOpCount) {
+        profile->expr_op_cycles[timed_op] += ReadCycleCounter() - t0;
+      }
+    }
+  };
+
+  // Every op except kDone carries its result width in the next word.
+#define GPGA_SCHED_VM_EXPR_FETCH()                                   \
+  do {                                                               \
+    if (ip >= word_count) {                                          \
+      goto expr_fail;                                                \
+    }                                                                \
+    op = words[ip] & kSchedulerVmOpMask;                             \
+    arg = words[ip] >> kSchedulerVmOpShift;                          \
+    ip += 1u;                                                        \
+    if (op >= kSchedulerVmExprOpCount) {                             \
+      goto expr_fail;                                                \
+    }                                                                \
+    account();                                                       \
+    if (op != static_cast<uint32_t>(SchedulerVmExprOp::kDone)) {     \
+      if (ip >= word_count) {                                        \
+        goto expr_fail;                                              \
+      }                                                              \
+      width = words[ip++];                                           \
+    }                                                                \
+  } while (0)
+
+#if GPGA_SCHED_VM_THREADED
+  static void* const kExprTable[kSchedulerVmExprOpCount] = {
+      &&expr_done,  &&expr_push_const, &&expr_push_signal, &&expr_fail,
+      &&expr_unary, &&expr_binary,     &&expr_ternary,     &&expr_fail,
+      &&expr_index, &&expr_fail,       &&expr_call,        &&expr_push_const_xz,
+      &&expr_load_reg, &&expr_store_reg,
+  };
+#define GPGA_SCHED_VM_EXPR_CASE(label, op_name) label:
+#define GPGA_SCHED_VM_EXPR_NEXT()  \
+  do {                             \
+    GPGA_SCHED_VM_EXPR_FETCH();    \
+    goto* kExprTable[op];          \
+  } while (0)
+  GPGA_SCHED_VM_EXPR_NEXT();
+#else
+#define GPGA_SCHED_VM_EXPR_CASE(label, op_name) \
+  case static_cast<uint32_t>(SchedulerVmExprOp::op_name):
+#define GPGA_SCHED_VM_EXPR_NEXT() continue
+  for (;;) {
+    GPGA_SCHED_VM_EXPR_FETCH();
+    switch (op) {
+#endif
+
+  GPGA_SCHED_VM_EXPR_CASE(expr_done, kDone) {
+    if (sp == 0u) {
+      goto expr_fail;
+    }
+    Value top = stack[sp - 1u];
+    if (!top.real) {
+      const uint64_t mask = MaskForWidth(top.width);
+      top.val &= mask;
+      top.xz &= mask;
+    }
+    finish();
+    *out = top;
+    return true;
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_push_const, kPushConst) {
+    if (sp >= kSchedulerVmExprStackMax || width > 64u ||
+        static_cast<size_t>(arg) + 1u >= imm.size()) {
+      goto expr_fail;
+    }
+    const uint64_t val = static_cast<uint64_t>(imm[arg]) |
+                         (static_cast<uint64_t>(imm[arg + 1u]) << 32u);
+    stack[sp++] = Value{val & MaskForWidth(width), 0u, width, false};
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_push_const_xz, kPushConstXz) {
+    if (sp >= kSchedulerVmExprStackMax || width > 64u ||
+        static_cast<size_t>(arg) + 3u >= imm.size()) {
+      goto expr_fail;
+    }
+    const uint64_t mask = MaskForWidth(width);
+    const uint64_t val = static_cast<uint64_t>(imm[arg]) |
+                         (static_cast<uint64_t>(imm[arg + 1u]) << 32u);
+    const uint64_t xz = static_cast<uint64_t>(imm[arg + 2u]) |
+                        (static_cast<uint64_t>(imm[arg + 3u]) << 32u);
+    stack[sp++] =
+        Value{val & mask, four_state ? (xz & mask) : 0u, width, false};
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_push_signal, kPushSignal) {
+    if (sp >= kSchedulerVmExprStackMax ||
+        arg >= layout.signal_entries.size()) {
+      goto expr_fail;
+    }
+    const SchedulerVmSignalEntry& sig = layout.signal_entries[arg];
+    if (sig.array_size != 1u) {
+      goto expr_fail;
+    }
+    if ((sig.flags & kSchedulerVmSignalFlagReal) != 0u) {
+      Value v;
+      if (!Load(val_offsets[arg] + static_cast<uint64_t>(gid) * 8u, 64u,
+                &v.val)) {
+        goto expr_fail;
+      }
+      v.width = 64u;
+      v.real = true;
+      stack[sp++] = v;
+      GPGA_SCHED_VM_EXPR_NEXT();
+    }
+    if (width > 64u || !LoadElement(arg, gid, width, &stack[sp])) {
+      goto expr_fail;
+    }
+    sp += 1u;
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_index, kIndex) {
+    if (sp == 0u || arg >= layout.signal_entries.size() || width > 64u) {
+      goto expr_fail;
+    }
+    const SchedulerVmSignalEntry& sig = layout.signal_entries[arg];
+    if (sig.array_size <= 1u) {
+      goto expr_fail;
+    }
+    const bool elem_real = (sig.flags & kSchedulerVmSignalFlagReal) != 0u;
+    Value& slot = stack[sp - 1u];
+    uint64_t index = slot.val;
+    if (slot.real) {
+      index = static_cast<uint64_t>(
+          static_cast<int64_t>(BitsToDouble(slot.val)));
+    } else if (slot.width > 64u) {
+      goto expr_fail;
+    } else if (slot.xz != 0u) {
+      slot = Value{0u, MaskForWidth(width), width, false};
+      GPGA_SCHED_VM_EXPR_NEXT();
+    }
+    if (index >= sig.array_size) {
+      slot = Value{0u, 0u, elem_real ? 64u : width, elem_real};
+      GPGA_SCHED_VM_EXPR_NEXT();
+    }
+    if (!LoadElement(arg,
+                     static_cast<uint64_t>(gid) * sig.array_size + index,
+                     elem_real ? 64u : width, &slot)) {
+      goto expr_fail;
+    }
+    slot.real = elem_real;
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_unary, kUnary) {
+    if (sp == 0u || width > 64u || stack[sp - 1u].width > 64u ||
+        !EvalUnary(arg, width, &stack[sp - 1u])) {
+      goto expr_fail;
+    }
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_binary, kBinary) {
+    if (sp < 2u || width > 64u || stack[sp - 1u].width > 64u ||
+        stack[sp - 2u].width > 64u ||
+        !EvalBinary(arg, width, stack[sp - 2u], stack[sp - 1u],
+                    &stack[sp - 2u])) {
+      goto expr_fail;
+    }
+    sp -= 1u;
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_ternary, kTernary) {
+    if (sp < 3u || width > 64u) {
+      goto expr_fail;
+    }
+    const Value& cond = stack[sp - 3u];
+    const Value& then_v = stack[sp - 2u];
+    const Value& else_v = stack[sp - 1u];
+    Value result;
+    if (!cond.real && cond.xz != 0u) {
+      if (then_v.real || else_v.real) {
+        result = Value{0u, 1u, 64u, true};
+      } else {
+        const fs::FourState64 merged =
+            fs::fs_merge64(ToFs(then_v), ToFs(else_v), width);
+        result = Value{merged.val, merged.xz, width, false};
+      }
+    } else {
+      const bool take_then = cond.real ? (BitsToDouble(cond.val) != 0.0)
+                                       : (cond.val != 0u);
+      const Value& src = take_then ? then_v : else_v;
+      if (then_v.real || else_v.real) {
+        result = src;
+        if (!src.real) {
+          result = Value{DoubleToBits(static_cast<double>(src.val)), 0u, 64u,
+                         true};
+        }
+      } else {
+        const uint64_t mask = MaskForWidth(width);
+        result = Value{src.val & mask, src.xz & mask, width, false};
+      }
+    }
+    stack[sp - 3u] = result;
+    sp -= 2u;
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_call, kCall) {
+    const uint32_t call = arg & 0xFFu;
+    uint32_t argc = 1u;
+    if (call <= static_cast<uint32_t>(SchedulerVmExprCallOp::kRealtime)) {
+      argc = 0u;
+    } else if (call >= static_cast<uint32_t>(SchedulerVmExprCallOp::kPow)) {
+      argc = 2u;
+    }
+    if (sp < argc || (argc == 0u && sp >= kSchedulerVmExprStackMax)) {
+      goto expr_fail;
+    }
+    Value result;
+    if (!EvalCall(arg, width, stack + (sp - argc), argc, &result)) {
+      goto expr_fail;
+    }
+    sp -= argc;
+    stack[sp++] = result;
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+
+  GPGA_SCHED_VM_EXPR_CASE(expr_load_reg, kLoadReg) {
+    if (sp >= kSchedulerVmExprStackMax || arg >= reg_count) {
+      goto expr_fail;
+    }
+    stack[sp++] = regs[arg];
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+  GPGA_SCHED_VM_EXPR_CASE(expr_store_reg, kStoreReg) {
+    if (sp == 0u || arg >= reg_count) {
+      goto expr_fail;
+    }
+    regs[arg] = stack[--sp];
+    GPGA_SCHED_VM_EXPR_NEXT();
+  }
+
+#if !GPGA_SCHED_VM_THREADED
+      default:
+        goto expr_fail;
+    }
+  }
+#endif
+
+expr_fail:
+  finish();
+  return false;
+
+#undef GPGA_SCHED_VM_EXPR_FETCH
+#undef GPGA_SCHED_VM_EXPR_CASE
+#undef GPGA_SCHED_VM_EXPR_NEXT
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::EvalCond(uint32_t cond_id, bool* taken) {
+  *taken = false;
+  if (cond_id >= layout.cond_entries.size()) {
+    return false;
+  }
+  const SchedulerVmCondEntry& entry = layout.cond_entries[cond_id];
+  switch (static_cast<SchedulerVmCondKind>(entry.kind)) {
+    case SchedulerVmCondKind::kConst:
+      *taken = (entry.xz == 0u) && (entry.val != 0u);
+      return true;
+    case SchedulerVmCondKind::kExpr: {
+      Value v;
+      if (!EvalExpr<kProfile>(entry.expr_offset, &v)) {
+        return false;
+      }
+      *taken = v.real ? (BitsToDouble(v.val) != 0.0)
+                      : (v.xz == 0u && v.val != 0u);
+      return true;
+    }
+    default:
+      // Dynamic conds are evaluated by generated code.
+      return false;
+  }
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::EvalCase(uint32_t case_id,
+                                            uint32_t* match) {
+  *match = kNoMatch;
+  if (case_id >= layout.case_headers.size()) {
+    return false;
+  }
+  const SchedulerVmCaseHeader& header = layout.case_headers[case_id];
+  Value v;
+  if (header.expr_offset == kSchedulerVmExprNoExtra ||
+      !EvalExpr<kProfile>(header.expr_offset, &v) || v.real ||
+      v.width != header.width || header.width > 64u) {
+    return false;
+  }
+  const uint64_t mask = MaskForWidth(header.width);
+  const auto kind = static_cast<SchedulerVmCaseKind>(header.kind);
+  const auto strategy = static_cast<SchedulerVmCaseStrategy>(header.strategy);
+  if (strategy != SchedulerVmCaseStrategy::kLinear && (v.xz & mask) == 0u) {
+    return LookupCase(header, v.val & mask, match);
+  }
+  for (uint32_t i = 0; i < header.entry_count; ++i) {
+    const size_t index = static_cast<size_t>(header.entry_offset) + i;
+    if (index >= layout.case_entries.size()) {
+      return false;
+    }
+    const SchedulerVmCaseEntry& entry = layout.case_entries[index];
+    if (entry.want_offset >= layout.case_words.size() ||
+        entry.care_offset >= layout.case_words.size()) {
+      return false;
+    }
+    const uint64_t want = layout.case_words[entry.want_offset];
+    const uint64_t aux = layout.case_words[entry.care_offset];
+    bool hit = false;
+    if (kind == SchedulerVmCaseKind::kCaseX) {
+      hit = (((v.val ^ want) & ~(v.xz | aux)) & mask) == 0u;
+    } else if (kind == SchedulerVmCaseKind::kCaseZ) {
+      const uint64_t cared = ~aux & mask;
+      hit = ((v.xz & cared) | ((v.val ^ want) & cared)) == 0u;
+    } else {
+      hit = (((v.xz ^ aux) | ((v.val ^ want) & ~(v.xz | aux))) & mask) == 0u;
+    }
+    if (hit) {
+      *match = entry.target;
+      return true;
+    }
+  }
+  return true;
+}
+
+bool SchedulerVmInterpreter::Impl::LookupCase(
+    const SchedulerVmCaseHeader& header, uint64_t val,
+    uint32_t* match) const {
+  const std::vector<uint64_t>& words = layout.case_words;
+  const size_t base = header.table_offset;
+  if (header.strategy == static_cast<uint32_t>(SchedulerVmCaseStrategy::kLut)) {
+    if (val > header.table_mask || base + (val >> 1u) >= words.size()) {
+      return false;
+    }
+    *match = static_cast<uint32_t>(words[base + (val >> 1u)] >>
+                                   ((val & 1u) * 32u));
+    return true;
+  }
+  if (header.strategy !=
+      static_cast<uint32_t>(SchedulerVmCaseStrategy::kBucket)) {
+    return false;
+  }
+  const size_t slots = static_cast<size_t>(header.table_mask) + 1u;
+  if (base + slots * 2u + header.wild_count > words.size()) {
+    return false;
+  }
+  uint32_t best = kNoMatch;
+  uint32_t slot = SchedulerVmCaseSlot(val, header.table_mask);
+  for (size_t probes = 0; probes < slots; ++probes) {
+    const uint32_t target = static_cast<uint32_t>(words[base + slot * 2u + 1u]);
+    if (target == kSchedulerVmCaseNoTarget) {
+      break;
+    }
+    if (words[base + slot * 2u] == val) {
+      best = target;
+      break;
+    }
+    slot = (slot + 1u) & header.table_mask;
+  }
+  // Labels with don't-care bits, in label order; only those before the
+  // exact hit can take precedence over it.
+  const size_t wild_base = base + slots * 2u;
+  for (uint32_t i = 0; i < header.wild_count; ++i) {
+    const size_t index =
+        static_cast<size_t>(header.entry_offset) + words[wild_base + i];
+    if (index >= layout.case_entries.size()) {
+      return false;
+    }
+    const SchedulerVmCaseEntry& entry = layout.case_entries[index];
+    if (entry.target >= best) {
+      break;
+    }
+    if (entry.want_offset >= words.size() ||
+        entry.care_offset >= words.size()) {
+      return false;
+    }
+    const uint64_t want = words[entry.want_offset];
+    const uint64_t aux = words[entry.care_offset];
+    if (((val ^ want) & ~aux) == 0u) {
+      best = entry.target;
+      break;
+    }
+  }
+  *match = best;
+  return true;
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::EvalIndexAndValue(
+    const StoreTarget& target, bool has_index, uint32_t idx_expr,
+    uint32_t rhs_expr, bool wide_const, PendingStore* store) {
+  store->target = &target;
+  if (has_index) {
+    Value idx;
+    if (!EvalExpr<kProfile>(idx_expr, &idx) || idx.real) {
+      return false;
+    }
+    store->idx_val = static_cast<uint32_t>(idx.val);
+    store->idx_xz = idx.xz != 0u;
+  }
+  if (wide_const) {
+    store->val = 0u;
+    store->xz = 0u;
+    return true;
+  }
+  Value rhs;
+  if (!EvalExpr<kProfile>(rhs_expr, &rhs)) {
+    return false;
+  }
+  const uint64_t mask = MaskForWidth(target.width);
+  store->val = rhs.val & mask;
+  store->xz = rhs.xz & mask;
+  return true;
+}
+
+bool SchedulerVmInterpreter::Impl::ApplyStore(const PendingStore& store) {
+  const StoreTarget& target = *store.target;
+  if (target.signal_id >= layout.signal_entries.size()) {
+    return false;
+  }
+  const SchedulerVmSignalEntry& sig = layout.signal_entries[target.signal_id];
+  if (sig.width > 64u) {
+    return false;
+  }
+  uint64_t element = static_cast<uint64_t>(gid) * sig.array_size;
+  if (target.is_array) {
+    if (store.idx_xz || store.idx_val >= target.array_size) {
+      return true;
+    }
+    element = static_cast<uint64_t>(gid) * target.array_size + store.idx_val;
+  } else if (sig.array_size != 1u) {
+    return false;
+  }
+  Value cur;
+  if (!LoadElement(target.signal_id, element, sig.width, &cur)) {
+    return false;
+  }
+  uint64_t val = store.val;
+  uint64_t xz = store.xz;
+  if (target.is_bit_select) {
+    if (store.idx_xz || store.idx_val >= target.base_width ||
+        store.idx_val >= 64u) {
+      return true;
+    }
+    const uint64_t bit = 1ull << store.idx_val;
+    val = (cur.val & ~bit) | ((store.val & 1u) << store.idx_val);
+    xz = (cur.xz & ~bit) | ((store.xz & 1u) << store.idx_val);
+  } else if (target.is_range) {
+    if (target.width == 0u) {
+      return true;
+    }
+    uint32_t start = target.range_lsb;
+    if (target.is_indexed_range) {
+      if (store.idx_xz || target.base_width < target.width ||
+          store.idx_val > target.base_width - target.width) {
+        return true;
+      }
+      start = store.idx_val;
+    }
+    if (start >= 64u) {
+      return true;
+    }
+    if (target.width >= 64u && start != 0u) {
+      return false;
+    }
+    const uint64_t mask = MaskForWidth(target.width) << start;
+    val = (cur.val & ~mask) | ((store.val << start) & mask);
+    xz = (cur.xz & ~mask) | ((store.xz << start) & mask);
+  }
+  const uint64_t stride = (sig.width > 32u) ? 8u : 4u;
+  const uint64_t mask = MaskForWidth(sig.width);
+  if (!Store(val_offsets[target.signal_id] + element * stride, sig.width,
+             val & mask)) {
+    return false;
+  }
+  if (four_state &&
+      !Store(xz_offsets[target.signal_id] + element * stride, sig.width,
+             xz & mask)) {
+    return false;
+  }
+  return true;
+}
+
+// Re-evaluates the continuous assigns until the nets they drive stop
+// changing. One pass per assign settles any acyclic chain; a combinational
+// loop is left where the last pass put it. Unprofiled: the kernels, not the
+// VM, run these.
+bool SchedulerVmInterpreter::Impl::SettleContinuousAssigns() {
+  if (!continuous_assigns || continuous_assigns->empty()) {
+    return true;
+  }
+  const size_t count = continuous_assigns->size();
+  for (size_t pass = 0; pass <= count; ++pass) {
+    bool changed = false;
+    for (size_t i = 0; i < count; ++i) {
+      const SchedulerVmContinuousAssign& assign = (*continuous_assigns)[i];
+      const StoreTarget& target = continuous_targets[i];
+      Value value;
+      Value cur;
+      if (!EvalExpr<false>(assign.expr_offset, &value)) {
+        result->expr_failures += 1u;
+        continue;
+      }
+      if (!LoadElement(target.signal_id, gid, target.width, &cur)) {
+        return false;
+      }
+      const uint64_t mask = MaskForWidth(target.width);
+      const uint64_t xz = four_state ? (value.xz & mask) : 0u;
+      if ((value.val & mask) == cur.val && xz == cur.xz) {
+        continue;
+      }
+      PendingStore store;
+      store.target = &target;
+      store.val = value.val;
+      store.xz = xz;
+      if (!ApplyStore(store)) {
+        return false;
+      }
+      result->continuous_assign_updates += 1u;
+      changed = true;
+    }
+    if (!changed) {
+      break;
+    }
+  }
+  return true;
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::SnapshotEdges(uint32_t wait_id) {
+  if (wait_id >= layout.edge_wait_entries.size()) {
+    return false;
+  }
+  const SchedulerVmEdgeWaitEntry& entry = layout.edge_wait_entries[wait_id];
+  for (uint32_t i = 0; i < entry.item_count; ++i) {
+    const size_t item = static_cast<size_t>(entry.item_offset) + i;
+    if (item >= layout.edge_item_expr_offsets.size() ||
+        !EvalExpr<kProfile>(layout.edge_item_expr_offsets[item],
+                            &edge_prev[item])) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < entry.star_count; ++i) {
+    const size_t item = static_cast<size_t>(entry.star_offset) + i;
+    if (item >= layout.edge_star_expr_offsets.size() ||
+        !EvalExpr<kProfile>(layout.edge_star_expr_offsets[item],
+                            &edge_star_prev[item])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::EdgeFired(uint32_t wait_id) {
+  const SchedulerVmEdgeWaitEntry& entry = layout.edge_wait_entries[wait_id];
+  bool fired = false;
+  for (uint32_t i = 0; i < entry.item_count; ++i) {
+    const size_t item = static_cast<size_t>(entry.item_offset) + i;
+    Value curr;
+    if (!EvalExpr<kProfile>(layout.edge_item_expr_offsets[item], &curr)) {
+      result->expr_failures += 1u;
+      continue;
+    }
+    Value& prev = edge_prev[item];
+    uint32_t kind = entry.kind;
+    if (kind == static_cast<uint32_t>(SchedulerVmEdgeKind::kList) &&
+        item < layout.edge_item_kinds.size()) {
+      kind = layout.edge_item_kinds[item];
+    }
+    const uint64_t mask = MaskForWidth(curr.width);
+    const uint64_t prev0 = ~prev.val & ~prev.xz & mask;
+    const uint64_t prev1 = prev.val & ~prev.xz & mask;
+    const uint64_t prevx = prev.xz & mask;
+    const uint64_t curr0 = ~curr.val & ~curr.xz & mask;
+    const uint64_t curr1 = curr.val & ~curr.xz & mask;
+    const uint64_t currx = curr.xz & mask;
+    bool hit = false;
+    switch (static_cast<SchedulerVmEdgeKind>(kind)) {
+      case SchedulerVmEdgeKind::kPosedge:
+        hit = ((prev0 & (curr1 | currx)) | (prevx & curr1)) != 0u;
+        break;
+      case SchedulerVmEdgeKind::kNegedge:
+        hit = ((prev1 & (curr0 | currx)) | (prevx & curr0)) != 0u;
+        break;
+      default:
+        hit = ((prev.val ^ curr.val) | (prev.xz ^ curr.xz)) != 0u;
+        break;
+    }
+    prev = curr;
+    fired = fired || hit;
+  }
+  for (uint32_t i = 0; i < entry.star_count; ++i) {
+    const size_t item = static_cast<size_t>(entry.star_offset) + i;
+    Value curr;
+    if (!EvalExpr<kProfile>(layout.edge_star_expr_offsets[item], &curr)) {
+      result->expr_failures += 1u;
+      continue;
+    }
+    Value& prev = edge_star_prev[item];
+    fired = fired || prev.val != curr.val || prev.xz != curr.xz;
+    prev = curr;
+  }
+  return fired;
+}
+
+void SchedulerVmInterpreter::Impl::FinishProc(uint32_t pid) {
+  ProcState& proc = procs[pid];
+  proc.status = ProcStatus::kDone;
+  proc.wait = WaitKind::kNone;
+  proc.call_sp = 0u;
+  proc.ip = 0u;
+  if (proc.parent == kNoParent) {
+    return;
+  }
+  ProcState& parent = procs[proc.parent];
+  proc.parent = kNoParent;
+  if (parent.status == ProcStatus::kBlocked &&
+      parent.wait == WaitKind::kJoin) {
+    if (parent.join_count > 0u) {
+      parent.join_count -= 1u;
+    }
+    if (parent.join_count == 0u) {
+      parent.status = ProcStatus::kReady;
+      parent.wait = WaitKind::kNone;
+    }
+  }
+}
+
+// Runs one proc until it blocks, finishes or halts the simulation.
+template <bool kProfile>
+ExecExit SchedulerVmInterpreter::Impl::Exec(uint32_t pid) {
+  ProcState& proc = procs[pid];
+  const uint32_t* code = layout.bytecode.data() + layout.proc_offsets[pid];
+  const uint32_t len = layout.proc_lengths[pid];
+  uint32_t ip = proc.ip;
+  uint32_t op = 0u;
+  uint32_t arg = 0u;
+  uint32_t next = 0u;
+  uint64_t steps = 0u;
+  uint64_t t0 = 0u;
+  uint32_t timed_op = kSchedulerVmOpCount;
+  if constexpr (kProfile) {
+    t0 = ReadCycleCounter();
+  }
+
+  auto account = [&]() {
+    if constexpr (kProfile) {
+      const uint64_t now = ReadCycleCounter();
+      if (timed_op < kSchedulerVmOpCount) {
+        profile->op_cycles[timed_op] += now - t0;
+        profile->proc_cycles[pid] += now - t0;
+        profile->op_pairs[timed_op * kSchedulerVmOpCount + op] += 1u;
+      }
+      t0 = now;
+      timed_op = op;
+      profile->op_count[op] += 1u;
+      profile->proc_steps[pid] += 1u;
+    }
+  };
+  auto leave = [&](ExecExit exit) {
+    if constexpr (kProfile) {
+      if (timed_op < kSchedulerVmOpCount) {
+        const uint64_t delta = ReadCycleCounter() - t0;
+        profile->op_cycles[timed_op] += delta;
+        profile->proc_cycles[pid] += delta;
+      }
+    }
+    return exit;
+  };
+  auto fail = [&](const char* what) {
+    Fail(pid, std::string(what) + " at ip " + std::to_string(ip) + " (" +
+                  SchedulerVmOpName(op) + ")");
+    return leave(ExecExit::kError);
+  };
+
+  // Shared by kAssign/kAssignNb and the entries of kAssignRun; returns why
+  // the op is malformed, or null.
+  auto run_assign = [&](uint32_t assign_op, uint32_t id) -> const char* {
+    if (id >= layout.assign_entries.size()) {
+      return "assign id out of range";
+    }
+    const SchedulerVmAssignEntry& entry = layout.assign_entries[id];
+    const bool nb = (entry.flags & kSchedulerVmAssignFlagNonblocking) != 0u;
+    if (nb != (assign_op == static_cast<uint32_t>(SchedulerVmOp::kAssignNb))) {
+      return "assign kind does not match its entry";
+    }
+    if ((entry.flags & kSchedulerVmAssignFlagFallback) != 0u) {
+      result->skipped_ops[assign_op] += 1u;
+      return nullptr;
+    }
+    // A cond rhs names a cond entry; its expression is evaluated here as
+    // usual. Targets wider than 64 bits are left to the generated kernel.
+    uint32_t rhs_expr = entry.rhs_expr;
+    if ((entry.flags & kSchedulerVmAssignFlagCondRhs) != 0u) {
+      if (rhs_expr >= layout.cond_entries.size()) {
+        return "assign cond rhs out of range";
+      }
+      if (assign_targets[id].signal_id >= layout.signal_entries.size() ||
+          layout.signal_entries[assign_targets[id].signal_id].width > 64u) {
+        result->skipped_ops[assign_op] += 1u;
+        return nullptr;
+      }
+      rhs_expr = layout.cond_entries[rhs_expr].expr_offset;
+    }
+    PendingStore store;
+    const bool has_index =
+        (entry.flags &
+         (kSchedulerVmAssignFlagIsArray | kSchedulerVmAssignFlagIsBitSelect |
+          kSchedulerVmAssignFlagIsIndexedRange)) != 0u;
+    if (!EvalIndexAndValue<kProfile>(
+            assign_targets[id], has_index, entry.idx_expr, rhs_expr,
+            (entry.flags & kSchedulerVmAssignFlagWideConst) != 0u, &store)) {
+      result->expr_failures += 1u;
+    } else if (nb) {
+      nba_queue.push_back(store);
+    } else if (!ApplyStore(store)) {
+      result->skipped_ops[assign_op] += 1u;
+    }
+    return nullptr;
+  };
+
+#define GPGA_SCHED_VM_FETCH()                                  \
+  do {                                                         \
+    if (ip >= len) {                                           \
+      return fail("ip out of range");                          \
+    }                                                          \
+    if (++steps > max_steps) {                                 \
+      return fail("step limit reached (zero-delay loop?)");    \
+    }                                                          \
+    op = code[ip] & kSchedulerVmOpMask;                        \
+    arg = code[ip] >> kSchedulerVmOpShift;                     \
+    next = ip + 1u;                                            \
+    if (op >= kSchedulerVmOpCount) {                           \
+      return fail("unknown opcode");                           \
+    }                                                          \
+    account();                                                 \
+  } while (0)
+
+#if GPGA_SCHED_VM_THREADED
+  static void* const kOpTable[kSchedulerVmOpCount] = {
+      &&op_done,          &&op_call_group,    &&op_noop,
+      &&op_jump,          &&op_jump_if,       &&op_case,
+      &&op_repeat,        &&op_assign,        &&op_assign,
+      &&op_assign_delay,  &&op_skip,          &&op_skip,
+      &&op_wait_time,     &&op_wait_delta,    &&op_wait_event,
+      &&op_wait_edge,     &&op_wait_cond,     &&op_wait_join,
+      &&op_wait_service,  &&op_event_trigger, &&op_fork,
+      &&op_disable,       &&op_service_call,  &&op_skip,
+      &&op_service_ret_branch, &&op_task_call, &&op_ret,
+      &&op_halt_sim,      &&op_assign_run,    &&op_branch,
+      &&op_wait_edge_loop,
+  };
+#define GPGA_SCHED_VM_CASE(label) label:
+#define GPGA_SCHED_VM_NEXT()  \
+  do {                        \
+    GPGA_SCHED_VM_FETCH();    \
+    goto* kOpTable[op];       \
+  } while (0)
+  GPGA_SCHED_VM_NEXT();
+#else
+#define GPGA_SCHED_VM_CASE(label) case kLabel_##label:
+#define GPGA_SCHED_VM_NEXT() continue
+  enum : uint32_t {
+    kLabel_op_done = static_cast<uint32_t>(SchedulerVmOp::kDone),
+    kLabel_op_call_group = static_cast<uint32_t>(SchedulerVmOp::kCallGroup),
+    kLabel_op_noop = static_cast<uint32_t>(SchedulerVmOp::kNoop),
+    kLabel_op_jump = static_cast<uint32_t>(SchedulerVmOp::kJump),
+    kLabel_op_jump_if = static_cast<uint32_t>(SchedulerVmOp::kJumpIf),
+    kLabel_op_case = static_cast<uint32_t>(SchedulerVmOp::kCase),
+    kLabel_op_repeat = static_cast<uint32_t>(SchedulerVmOp::kRepeat),
+    kLabel_op_assign = static_cast<uint32_t>(SchedulerVmOp::kAssign),
+    kLabel_op_assign_delay =
+        static_cast<uint32_t>(SchedulerVmOp::kAssignDelay),
+    kLabel_op_skip = static_cast<uint32_t>(SchedulerVmOp::kForce),
+    kLabel_op_wait_time = static_cast<uint32_t>(SchedulerVmOp::kWaitTime),
+    kLabel_op_wait_delta = static_cast<uint32_t>(SchedulerVmOp::kWaitDelta),
+    kLabel_op_wait_event = static_cast<uint32_t>(SchedulerVmOp::kWaitEvent),
+    kLabel_op_wait_edge = static_cast<uint32_t>(SchedulerVmOp::kWaitEdge),
+    kLabel_op_wait_cond = static_cast<uint32_t>(SchedulerVmOp::kWaitCond),
+    kLabel_op_wait_join = static_cast<uint32_t>(SchedulerVmOp::kWaitJoin),
+    kLabel_op_wait_service =
+        static_cast<uint32_t>(SchedulerVmOp::kWaitService),
+    kLabel_op_event_trigger =
+        static_cast<uint32_t>(SchedulerVmOp::kEventTrigger),
+    kLabel_op_fork = static_cast<uint32_t>(SchedulerVmOp::kFork),
+    kLabel_op_disable = static_cast<uint32_t>(SchedulerVmOp::kDisable),
+    kLabel_op_service_call =
+        static_cast<uint32_t>(SchedulerVmOp::kServiceCall),
+    kLabel_op_service_ret_branch =
+        static_cast<uint32_t>(SchedulerVmOp::kServiceRetBranch),
+    kLabel_op_task_call = static_cast<uint32_t>(SchedulerVmOp::kTaskCall),
+    kLabel_op_ret = static_cast<uint32_t>(SchedulerVmOp::kRet),
+    kLabel_op_halt_sim = static_cast<uint32_t>(SchedulerVmOp::kHaltSim),
+    kLabel_op_assign_run = static_cast<uint32_t>(SchedulerVmOp::kAssignRun),
+    kLabel_op_branch = static_cast<uint32_t>(SchedulerVmOp::kBranch),
+    kLabel_op_wait_edge_loop =
+        static_cast<uint32_t>(SchedulerVmOp::kWaitEdgeLoop),
+  };
+  for (;;) {
+    GPGA_SCHED_VM_FETCH();
+    // Ops sharing a handler with another op dispatch to its label.
+    uint32_t handler = op;
+    if (op == static_cast<uint32_t>(SchedulerVmOp::kAssignNb)) {
+      handler = kLabel_op_assign;
+    } else if (op == static_cast<uint32_t>(SchedulerVmOp::kRelease) ||
+               op == static_cast<uint32_t>(SchedulerVmOp::kServiceRetAssign)) {
+      handler = kLabel_op_skip;
+    }
+    switch (handler) {
+#endif
+
+  GPGA_SCHED_VM_CASE(op_done) {
+    FinishProc(pid);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_call_group) {
+    // Call groups run statements the VM could not lower; they only exist
+    // in generated kernels.
+    result->skipped_ops[op] += 1u;
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_skip) {
+    result->skipped_ops[op] += 1u;
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_noop) {
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_jump) {
+    if (arg >= len) {
+      return fail("jump target out of range");
+    }
+    ip = arg;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_jump_if) {
+    if (next >= len || code[next] >= len) {
+      return fail("jump target out of range");
+    }
+    bool taken = false;
+    if (!EvalCond<kProfile>(arg, &taken)) {
+      result->expr_failures += 1u;
+    }
+    ip = taken ? code[next] : next + 1u;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_branch) {
+    if (next + 1u >= len || code[next] >= len || code[next + 1u] >= len) {
+      return fail("jump target out of range");
+    }
+    bool taken = false;
+    if (!EvalCond<kProfile>(arg, &taken)) {
+      result->expr_failures += 1u;
+    }
+    ip = taken ? code[next] : code[next + 1u];
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_case) {
+    if (next >= len) {
+      return fail("truncated case");
+    }
+    const uint32_t count = code[next];
+    const uint32_t target_base = next + 1u;
+    const uint32_t default_index = target_base + count;
+    if (default_index >= len) {
+      return fail("truncated case");
+    }
+    uint32_t match = kNoMatch;
+    if (!EvalCase<kProfile>(arg, &match)) {
+      result->expr_failures += 1u;
+      match = kNoMatch;
+    }
+    if (match != kNoMatch && match >= count) {
+      return fail("case target out of range");
+    }
+    const uint32_t target =
+        code[(match == kNoMatch) ? default_index : target_base + match];
+    if (target >= len) {
+      return fail("case target out of range");
+    }
+    ip = target;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_repeat) {
+    if (next + 1u >= len || arg >= repeat_left.size()) {
+      return fail("malformed repeat");
+    }
+    const uint32_t body = code[next];
+    const uint32_t after = code[next + 1u];
+    if (body >= len || after >= len) {
+      return fail("repeat target out of range");
+    }
+    if (repeat_active[arg] == 0u) {
+      Value count;
+      const uint32_t expr = layout.repeat_expr_offsets[arg];
+      if (expr == kSchedulerVmExprNoExtra ||
+          !EvalExpr<kProfile>(expr, &count) || count.real) {
+        return fail("repeat count not evaluable");
+      }
+      repeat_left[arg] = static_cast<uint32_t>(
+          count.val & MaskForWidth(std::min(count.width, 32u)));
+      repeat_active[arg] = 1u;
+    }
+    if (repeat_left[arg] == 0u || body == after) {
+      repeat_left[arg] = 0u;
+      repeat_active[arg] = 0u;
+      ip = after;
+      GPGA_SCHED_VM_NEXT();
+    }
+    repeat_left[arg] -= 1u;
+    ip = body;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_assign) {
+    if (const char* what = run_assign(op, arg)) {
+      return fail(what);
+    }
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_assign_run) {
+    if (next + arg > len) {
+      return fail("truncated assign run");
+    }
+    for (uint32_t k = 0; k < arg; ++k) {
+      const uint32_t instr = code[next + k];
+      const uint32_t assign_op = instr & kSchedulerVmOpMask;
+      if (assign_op != static_cast<uint32_t>(SchedulerVmOp::kAssign) &&
+          assign_op != static_cast<uint32_t>(SchedulerVmOp::kAssignNb)) {
+        return fail("assign run holds a non-assign op");
+      }
+      if (const char* what =
+              run_assign(assign_op, instr >> kSchedulerVmOpShift)) {
+        return fail(what);
+      }
+    }
+    ip = next + arg;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_assign_delay) {
+    // Transport delay only: inertial pulse filtering is not modelled.
+    if (arg >= layout.delay_assign_entries.size()) {
+      return fail("delay assign id out of range");
+    }
+    const SchedulerVmDelayAssignEntry& entry =
+        layout.delay_assign_entries[arg];
+    if ((entry.flags & kSchedulerVmDelayAssignFlagFallback) != 0u ||
+        (entry.flags & kSchedulerVmDelayAssignFlagIsReal) != 0u) {
+      result->skipped_ops[op] += 1u;
+      ip = next;
+      GPGA_SCHED_VM_NEXT();
+    }
+    PendingStore store;
+    Value delay;
+    const bool has_index =
+        (entry.flags & (kSchedulerVmDelayAssignFlagIsArray |
+                        kSchedulerVmDelayAssignFlagIsBitSelect |
+                        kSchedulerVmDelayAssignFlagIsIndexedRange)) != 0u;
+    if (!EvalIndexAndValue<kProfile>(delay_targets[arg], has_index,
+                                     entry.idx_expr, entry.rhs_expr, false,
+                                     &store) ||
+        !EvalExpr<kProfile>(entry.delay_expr, &delay) || delay.real) {
+      result->expr_failures += 1u;
+      ip = next;
+      GPGA_SCHED_VM_NEXT();
+    }
+    const uint64_t amount = (delay.xz == 0u) ? delay.val : 0u;
+    if ((entry.flags & kSchedulerVmDelayAssignFlagNonblocking) != 0u) {
+      if (amount == 0u) {
+        nba_queue.push_back(store);
+      } else {
+        delayed_nba.push_back(TimedStore{time + amount, store});
+      }
+      ip = next;
+      GPGA_SCHED_VM_NEXT();
+    }
+    if (amount == 0u) {
+      if (!ApplyStore(store)) {
+        result->skipped_ops[op] += 1u;
+      }
+      ip = next;
+      GPGA_SCHED_VM_NEXT();
+    }
+    proc.has_pending = true;
+    proc.pending = store;
+    proc.wait_time = time + amount;
+    Block(pid, WaitKind::kTime, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_time) {
+    if (arg >= layout.delay_expr_offsets.size()) {
+      return fail("delay id out of range");
+    }
+    Value delay;
+    const uint32_t expr = layout.delay_expr_offsets[arg];
+    if (expr == kSchedulerVmExprNoExtra || !EvalExpr<kProfile>(expr, &delay) ||
+        delay.real || delay.xz != 0u) {
+      return fail("delay not evaluable");
+    }
+    proc.wait_time = time + delay.val;
+    Block(pid, (delay.val == 0u) ? WaitKind::kDelta : WaitKind::kTime, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_delta) {
+    Block(pid, WaitKind::kDelta, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_event) {
+    if (arg >= event_count) {
+      return fail("event id out of range");
+    }
+    proc.wait_id = arg;
+    Block(pid, WaitKind::kEvent, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_edge) {
+    if (!SnapshotEdges<kProfile>(arg)) {
+      return fail("edge wait not evaluable");
+    }
+    proc.wait_id = arg;
+    Block(pid, WaitKind::kEdge, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_edge_loop) {
+    // The loop's `jump` back to a kWaitEdge, resuming after that wait.
+    if (next >= len || code[next] >= len) {
+      return fail("wait resume target out of range");
+    }
+    if (!SnapshotEdges<kProfile>(arg)) {
+      return fail("edge wait not evaluable");
+    }
+    proc.wait_id = arg;
+    Block(pid, WaitKind::kEdge, code[next]);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_cond) {
+    if (next >= len) {
+      return fail("truncated wait");
+    }
+    bool taken = false;
+    if (!EvalCond<kProfile>(arg, &taken)) {
+      return fail("wait condition not evaluable");
+    }
+    if (taken) {
+      ip = next + 1u;
+      GPGA_SCHED_VM_NEXT();
+    }
+    // Re-run the op on wake-up so the condition is evaluated again.
+    proc.wait_id = arg;
+    Block(pid, WaitKind::kCond, ip);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_join) {
+    if (proc.join_count == 0u) {
+      ip = next;
+      GPGA_SCHED_VM_NEXT();
+    }
+    Block(pid, WaitKind::kJoin, next);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_wait_service) {
+    // Services complete immediately on the host.
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_event_trigger) {
+    if (arg >= event_count) {
+      return fail("event id out of range");
+    }
+    event_pending[arg] = 1u;
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_fork) {
+    const uint32_t count = DecodeSchedulerVmForkCount(arg);
+    const SchedulerVmJoinKind kind = DecodeSchedulerVmForkKind(arg);
+    if (count == 0u || next + count >= len) {
+      return fail("malformed fork");
+    }
+    for (uint32_t c = 0; c < count; ++c) {
+      const uint32_t child = code[next + c];
+      if (child >= procs.size()) {
+        return fail("fork child out of range");
+      }
+      ProcState& child_proc = procs[child];
+      child_proc = ProcState{};
+      child_proc.parent = (kind == SchedulerVmJoinKind::kNone) ? kNoParent
+                                                               : pid;
+    }
+    if (kind == SchedulerVmJoinKind::kNone) {
+      ip = next + count;
+      GPGA_SCHED_VM_NEXT();
+    }
+    proc.join_count = (kind == SchedulerVmJoinKind::kAny) ? 1u : count;
+    Block(pid, WaitKind::kJoin, next + count);
+    return leave(ExecExit::kYield);
+  }
+  GPGA_SCHED_VM_CASE(op_disable) {
+    if (next >= len) {
+      return fail("truncated disable");
+    }
+    switch (static_cast<SchedulerVmDisableKind>(arg)) {
+      case SchedulerVmDisableKind::kBlock:
+        if (code[next] >= len) {
+          return fail("disable target out of range");
+        }
+        ip = code[next];
+        break;
+      case SchedulerVmDisableKind::kChildProc: {
+        const uint32_t child = code[next];
+        if (child >= procs.size()) {
+          return fail("disable child out of range");
+        }
+        if (procs[child].status != ProcStatus::kDone) {
+          FinishProc(child);
+        }
+        ip = next + 1u;
+        break;
+      }
+      case SchedulerVmDisableKind::kCrossProc: {
+        if (next + 1u >= len) {
+          return fail("truncated disable");
+        }
+        const uint32_t target = code[next];
+        const uint32_t target_ip = code[next + 1u];
+        if (target >= procs.size() ||
+            target_ip >= layout.proc_lengths[target]) {
+          return fail("disable target out of range");
+        }
+        procs[target].ip = target_ip;
+        procs[target].status = ProcStatus::kReady;
+        procs[target].wait = WaitKind::kNone;
+        procs[target].has_pending = false;
+        ip = next + 2u;
+        break;
+      }
+      default:
+        return fail("unknown disable kind");
+    }
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_service_call) {
+    if (arg >= layout.service_entries.size()) {
+      return fail("service id out of range");
+    }
+    const uint32_t flags = layout.service_entries[arg].flags;
+    service_ret = 0u;
+    if ((flags & (kSchedulerVmServiceFlagFinish |
+                  kSchedulerVmServiceFlagStop)) != 0u) {
+      result->finished = (flags & kSchedulerVmServiceFlagFinish) != 0u;
+      result->stopped = (flags & kSchedulerVmServiceFlagStop) != 0u;
+      halted = true;
+      FinishProc(pid);
+      return leave(ExecExit::kHalt);
+    }
+    result->skipped_ops[op] += 1u;
+    ip = next;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_service_ret_branch) {
+    if (next + 1u >= len || code[next] >= len || code[next + 1u] >= len) {
+      return fail("service branch target out of range");
+    }
+    bool cond = (service_ret & 1u) != 0u;
+    if (arg != 0u) {
+      cond = !cond;
+    }
+    ip = cond ? code[next] : code[next + 1u];
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_task_call) {
+    if (proc.call_sp >= kSchedulerVmCallFrameDepth) {
+      return fail("call stack overflow");
+    }
+    if (arg >= len) {
+      return fail("task target out of range");
+    }
+    proc.call_stack[proc.call_sp++] = next;
+    ip = arg;
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_ret) {
+    if (proc.call_sp == 0u) {
+      return fail("return with empty call stack");
+    }
+    ip = proc.call_stack[--proc.call_sp];
+    GPGA_SCHED_VM_NEXT();
+  }
+  GPGA_SCHED_VM_CASE(op_halt_sim) {
+    if (arg > 1u) {
+      return fail("unknown halt kind");
+    }
+    result->finished = (arg == 0u);
+    result->stopped = (arg == 1u);
+    halted = true;
+    FinishProc(pid);
+    return leave(ExecExit::kHalt);
+  }
+
+#if !GPGA_SCHED_VM_THREADED
+      default:
+        return fail("unknown opcode");
+    }
+  }
+#endif
+
+#undef GPGA_SCHED_VM_FETCH
+#undef GPGA_SCHED_VM_CASE
+#undef GPGA_SCHED_VM_NEXT
+}
+
+template <bool kProfile>
+bool SchedulerVmInterpreter::Impl::RunInstance(uint64_t max_time) {
+  const uint32_t proc_count = layout.proc_count;
+  for (;;) {
+    // Active region: run ready procs, then wake event/edge/cond waiters
+    // until nothing is runnable.
+    bool progressed = true;
+    while (progressed && !halted) {
+      progressed = false;
+      if (!SettleContinuousAssigns()) {
+        return Fail(0u, "continuous assign store failed");
+      }
+      for (uint32_t pid = 0; pid < proc_count && !halted; ++pid) {
+        if (procs[pid].status != ProcStatus::kReady) {
+          continue;
+        }
+        progressed = true;
+        result->activations += 1u;
+        if (Exec<kProfile>(pid) == ExecExit::kError) {
+          return false;
+        }
+        if (!SettleContinuousAssigns()) {
+          return Fail(pid, "continuous assign store failed");
+        }
+      }
+      if (halted) {
+        break;
+      }
+      for (uint32_t pid = 0; pid < proc_count; ++pid) {
+        ProcState& proc = procs[pid];
+        if (proc.status != ProcStatus::kBlocked) {
+          continue;
+        }
+        bool wake = false;
+        if (proc.wait == WaitKind::kEvent) {
+          wake = event_pending[proc.wait_id] != 0u;
+        } else if (proc.wait == WaitKind::kEdge) {
+          wake = EdgeFired<kProfile>(proc.wait_id);
+        } else if (proc.wait == WaitKind::kCond) {
+          bool taken = false;
+          wake = EvalCond<kProfile>(proc.wait_id, &taken) && taken;
+        }
+        if (wake) {
+          proc.status = ProcStatus::kReady;
+          proc.wait = WaitKind::kNone;
+          progressed = true;
+        }
+      }
+      std::fill(event_pending.begin(), event_pending.end(), 0u);
+    }
+    if (halted) {
+      return true;
+    }
+    // Inactive region (#0), then NBA commit; either starts a new delta.
+    bool delta = false;
+    for (auto& proc : procs) {
+      if (proc.status == ProcStatus::kBlocked &&
+          proc.wait == WaitKind::kDelta) {
+        proc.status = ProcStatus::kReady;
+        proc.wait = WaitKind::kNone;
+        delta = true;
+      }
+    }
+    if (!delta && !nba_queue.empty()) {
+      for (const PendingStore& store : nba_queue) {
+        if (!ApplyStore(store)) {
+          result->skipped_ops[static_cast<uint32_t>(
+              SchedulerVmOp::kAssignNb)] += 1u;
+        }
+      }
+      nba_queue.clear();
+      delta = true;
+    }
+    if (delta) {
+      result->delta_cycles += 1u;
+      continue;
+    }
+    // Advance time to the next timed wait or delayed NBA.
+    uint64_t next_time = ~0ull;
+    for (const auto& proc : procs) {
+      if (proc.status == ProcStatus::kBlocked &&
+          proc.wait == WaitKind::kTime) {
+        next_time = std::min(next_time, proc.wait_time);
+      }
+    }
+    for (const auto& pending : delayed_nba) {
+      next_time = std::min(next_time, pending.time);
+    }
+    if (next_time == ~0ull || next_time > max_time) {
+      return true;
+    }
+    time = next_time;
+    for (auto& proc : procs) {
+      if (proc.status == ProcStatus::kBlocked &&
+          proc.wait == WaitKind::kTime && proc.wait_time == time) {
+        if (proc.has_pending) {
+          proc.has_pending = false;
+          if (!ApplyStore(proc.pending)) {
+            result->skipped_ops[static_cast<uint32_t>(
+                SchedulerVmOp::kAssignDelay)] += 1u;
+          }
+        }
+        proc.status = ProcStatus::kReady;
+        proc.wait = WaitKind::kNone;
+      }
+    }
+    auto due = std::stable_partition(
+        delayed_nba.begin(), delayed_nba.end(),
+        [&](const TimedStore& pending) { return pending.time != time; });
+    for (auto it = due; it != delayed_nba.end(); ++it) {
+      nba_queue.push_back(it->store);
+    }
+    delayed_nba.erase(due, delayed_nba.end());
+  }
+}
+
+SchedulerVmInterpreter::SchedulerVmInterpreter(const SchedulerVmLayout& layout,
+                                               bool four_state)
+    : impl_(std::make_unique<Impl>(layout, four_state)) {}
+
+SchedulerVmInterpreter::~SchedulerVmInterpreter() = default;
+
+const std::vector<uint8_t>& SchedulerVmInterpreter::state() const {
+  return impl_->state;
+}
+
+bool SchedulerVmInterpreter::Run(const SchedulerVmRunOptions& options,
+                                 SchedulerVmRunResult* result,
+                                 std::string* error) {
+  if (!result) {
+    if (error) {
+      *error = "missing scheduler VM run result";
+    }
+    return false;
+  }
+  Impl& impl = *impl_;
+  const SchedulerVmLayout& layout = impl.layout;
+  *result = SchedulerVmRunResult{};
+  if (layout.proc_count == 0u ||
+      layout.proc_offsets.size() != layout.proc_count ||
+      layout.proc_lengths.size() != layout.proc_count) {
+    if (error) {
+      *error = "scheduler VM layout has no procs";
+    }
+    return false;
+  }
+  if (options.instance_count == 0u) {
+    if (error) {
+      *error = "scheduler VM run needs at least one instance";
+    }
+    return false;
+  }
+  impl.continuous_assigns = options.continuous_assigns;
+  if (!impl.Prepare(options.instance_count, error)) {
+    return false;
+  }
+  result->profile.Reset(layout.proc_count);
+  impl.result = result;
+  impl.profile = &result->profile;
+  impl.error = error;
+  impl.max_steps = (options.max_steps_per_activation == 0u)
+                       ? ~0ull
+                       : options.max_steps_per_activation;
+  for (uint32_t gid = 0; gid < options.instance_count; ++gid) {
+    impl.ResetInstance(gid);
+    const bool ok = options.profile
+                        ? impl.RunInstance<true>(options.max_time)
+                        : impl.RunInstance<false>(options.max_time);
+    if (!ok) {
+      return false;
+    }
+    result->final_time = std::max(result->final_time, impl.time);
+  }
+  return true;
+}
+
+}  // namespace gpga
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/scheduler_vm.hh"
+
+namespace gpga {
+
+constexpr uint32_t kSchedulerVmExprOpCount =
+    static_cast<uint32_t>(SchedulerVmExprOp::kStoreReg) + 1u;
+
+const char* SchedulerVmOpName(uint32_t op);
+const char* SchedulerVmExprOpName(uint32_t op);
+
+// Per-opcode and per-proc counters gathered by SchedulerVmInterpreter when
+// profiling is enabled. Cycles come from the CPU timestamp counter
+// (steady_clock nanoseconds where none is available). Expression ops are
+// timed individually and their cycles are also part of the proc op that
+// evaluated them.
+struct SchedulerVmProfile {
+  std::array<uint64_t, kSchedulerVmOpCount> op_count{};
+  std::array<uint64_t, kSchedulerVmOpCount> op_cycles{};
+  // Dynamic opcode pairs within an activation, indexed
+  // [first * kSchedulerVmOpCount + second] like SchedulerVmOpPairCounts.
+  std::array<uint64_t, kSchedulerVmOpCount * kSchedulerVmOpCount> op_pairs{};
+  std::array<uint64_t, kSchedulerVmExprOpCount> expr_op_count{};
+  std::array<uint64_t, kSchedulerVmExprOpCount> expr_op_cycles{};
+  std::vector<uint64_t> proc_steps;
+  std::vector<uint64_t> proc_cycles;
+
+  void Reset(uint32_t proc_count);
+  // Opcode histograms plus the top_procs most frequent op pairs and hottest
+  // procs by cycles.
+  std::string Format(uint32_t top_procs) const;
+};
+
+struct SchedulerVmRunOptions {
+  uint32_t instance_count = 1u;
+  // Simulation stops once the next event lies beyond max_time.
+  uint64_t max_time = ~0ull;
+  // Ops a single activation may execute before it is treated as a
+  // zero-delay loop and the run fails.
+  uint64_t max_steps_per_activation = 1ull << 24;
+  bool profile = false;
+  // Continuous assigns to keep up to date in the active region
+  // (BuildSchedulerVmContinuousAssigns); their expressions are not profiled.
+  const std::vector<SchedulerVmContinuousAssign>* continuous_assigns = nullptr;
+};
+
+struct SchedulerVmRunResult {
+  uint64_t final_time = 0u;
+  bool finished = false;
+  bool stopped = false;
+  uint64_t activations = 0u;
+  uint64_t delta_cycles = 0u;
+  // Ops that need generated kernel code (call groups, $display-style
+  // services, force/release). The interpreter steps over them.
+  std::array<uint64_t, kSchedulerVmOpCount> skipped_ops{};
+  // Expressions the interpreter could not evaluate (wide values, dynamic
+  // conds, missing tables); the affected statement is skipped.
+  uint64_t expr_failures = 0u;
+  // Net updates made by continuous assigns.
+  uint64_t continuous_assign_updates = 0u;
+  SchedulerVmProfile profile;
+};
+
+// Host interpreter for SchedulerVmLayout bytecode. It owns a copy of the
+// packed signal state (same layout as the Metal sched state buffer) and runs
+// the procs of every instance under a small event-driven scheduler: active
+// region, #0 deltas, NBA commit, then time advance. Proc and expression
+// dispatch are threaded (computed goto) on GCC/Clang and fall back to a
+// switch elsewhere.
+//
+// Procedural bytecode is executed, plus the continuous assigns passed in
+// SchedulerVmRunOptions. Anything the VM lowers to kCallGroup, services and
+// force/release live in generated kernels and are only counted (see
+// skipped_ops), so the run is intended for profiling the VM rather than as a
+// reference simulator.
+class SchedulerVmInterpreter {
+ public:
+  SchedulerVmInterpreter(const SchedulerVmLayout& layout, bool four_state);
+  ~SchedulerVmInterpreter();
+  SchedulerVmInterpreter(const SchedulerVmInterpreter&) = delete;
+  SchedulerVmInterpreter& operator=(const SchedulerVmInterpreter&) = delete;
+
+  bool Run(const SchedulerVmRunOptions& options, SchedulerVmRunResult* result,
+           std::string* error);
+
+  // Packed signal state after Run, laid out like the Metal sched state.
+  const std::vector<uint8_t>& state() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace gpga
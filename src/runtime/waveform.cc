@@ -0,0 +1,795 @@
+#include "runtime/waveform.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace gpga {
+
+namespace {
+
+// Record tags inside a block. Value records use kWaveTagValue +
+// (zigzag(signal - previous signal - 1) << 1 | has_xz); the previous signal
+// restarts at -1 with every time record, keyframe and block, so the
+// ascending changes of one snapshot mostly get one-byte tags.
+constexpr uint64_t kWaveTagTimeDelta = 0u;
+constexpr uint64_t kWaveTagTimeAbsolute = 1u;
+constexpr uint64_t kWaveTagValue = 2u;
+
+constexpr size_t kWaveBlockHeaderBytes = 28u;
+constexpr size_t kWaveTrailerBytes = 12u;
+constexpr size_t kWaveIndexEntryBytes = 24u;
+
+uint32_t WordCount(const WaveSignalInfo& signal) {
+  return signal.is_real ? 1u : (signal.width + 63u) / 64u;
+}
+
+uint64_t ZigZag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1u);
+}
+
+// Offsets of each signal's val words (xz words follow) in a flat vector;
+// returns the total word count.
+size_t LayoutWords(const std::vector<WaveSignalInfo>& signals,
+                   std::vector<size_t>* offsets) {
+  offsets->resize(signals.size());
+  size_t total = 0;
+  for (size_t i = 0; i < signals.size(); ++i) {
+    (*offsets)[i] = total;
+    total += 2u * WordCount(signals[i]);
+  }
+  return total;
+}
+
+void PutVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80u) {
+    out->push_back(static_cast<char>((value & 0x7Fu) | 0x80u));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void PutU32(std::string* out, uint32_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutU64(std::string* out, uint64_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutStr(std::string* out, const std::string& value) {
+  PutU32(out, static_cast<uint32_t>(value.size()));
+  out->append(value);
+}
+
+class WaveByteReader {
+ public:
+  WaveByteReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  bool U32(uint32_t* value) { return Raw(value, sizeof(*value)); }
+  bool U64(uint64_t* value) { return Raw(value, sizeof(*value)); }
+  bool Str(std::string* value) {
+    uint32_t len = 0u;
+    if (!U32(&len) || len > size_ - pos_) {
+      return false;
+    }
+    value->assign(reinterpret_cast<const char*>(data_ + pos_), len);
+    pos_ += len;
+    return true;
+  }
+  bool Raw(void* out, size_t size) {
+    if (size > size_ - pos_) {
+      return false;
+    }
+    std::memcpy(out, data_ + pos_, size);
+    pos_ += size;
+    return true;
+  }
+  bool Varint(uint64_t* value) {
+    uint64_t result = 0u;
+    for (uint32_t shift = 0u; shift < 64u; shift += 7u) {
+      if (pos_ >= size_) {
+        return false;
+      }
+      const uint8_t byte = data_[pos_++];
+      result |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+      if ((byte & 0x80u) == 0u) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+  size_t pos() const { return pos_; }
+  bool AtEnd() const { return pos_ == size_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+}  // namespace
+
+std::string WaveIdForIndex(size_t index) {
+  const int base = 94;
+  const int first = 33;
+  std::string id;
+  size_t value = index;
+  do {
+    int digit = static_cast<int>(value % base);
+    id.push_back(static_cast<char>(first + digit));
+    value /= base;
+  } while (value > 0);
+  return id;
+}
+
+void SplitWaveHierName(const std::string& name,
+                       std::vector<std::string>* scope, std::string* leaf) {
+  if (scope) {
+    scope->clear();
+  }
+  if (leaf) {
+    *leaf = name;
+  }
+  if (!scope || !leaf) {
+    return;
+  }
+  std::vector<std::string> parts;
+  std::string current;
+  int bracket_depth = 0;
+  for (size_t i = 0; i < name.size(); ++i) {
+    char c = name[i];
+    if (c == '[') {
+      bracket_depth++;
+      current.push_back(c);
+      continue;
+    }
+    if (c == ']') {
+      if (bracket_depth > 0) {
+        bracket_depth--;
+      }
+      current.push_back(c);
+      continue;
+    }
+    if (bracket_depth == 0 && c == '.') {
+      if (!current.empty()) {
+        parts.push_back(current);
+        current.clear();
+      }
+      continue;
+    }
+    if (bracket_depth == 0 && c == '_' && i + 1 < name.size() &&
+        name[i + 1] == '_') {
+      if (!current.empty()) {
+        parts.push_back(current);
+        current.clear();
+      }
+      i++;
+      continue;
+    }
+    current.push_back(c);
+  }
+  if (!current.empty()) {
+    parts.push_back(current);
+  }
+  if (parts.empty()) {
+    return;
+  }
+  if (parts.size() == 1) {
+    *leaf = parts[0];
+    return;
+  }
+  scope->assign(parts.begin(), parts.end() - 1);
+  *leaf = parts.back();
+}
+
+void WriteVcdHeader(std::ostream& out, const std::string& timescale,
+                    const std::string& module_name,
+                    const std::vector<WaveSignalInfo>& signals) {
+  out << "$date\n  today\n$end\n";
+  out << "$version\n  metalfpga\n$end\n";
+  out << "$timescale " << timescale << " $end\n";
+  out << "$scope module " << module_name << " $end\n";
+  struct ScopedSignal {
+    std::vector<std::string> scope;
+    std::string leaf;
+    const WaveSignalInfo* signal = nullptr;
+  };
+  std::vector<ScopedSignal> ordered;
+  ordered.reserve(signals.size());
+  for (const auto& sig : signals) {
+    ScopedSignal entry;
+    entry.signal = &sig;
+    SplitWaveHierName(sig.name, &entry.scope, &entry.leaf);
+    if (entry.leaf.empty()) {
+      entry.leaf = sig.name;
+    }
+    ordered.push_back(std::move(entry));
+  }
+  std::sort(ordered.begin(), ordered.end(),
+            [](const ScopedSignal& a, const ScopedSignal& b) {
+              if (a.scope != b.scope) {
+                return std::lexicographical_compare(
+                    a.scope.begin(), a.scope.end(), b.scope.begin(),
+                    b.scope.end());
+              }
+              return a.leaf < b.leaf;
+            });
+  std::vector<std::string> current;
+  for (const auto& entry : ordered) {
+    size_t common = 0;
+    while (common < current.size() && common < entry.scope.size() &&
+           current[common] == entry.scope[common]) {
+      common++;
+    }
+    for (size_t i = current.size(); i > common; --i) {
+      out << "$upscope $end\n";
+    }
+    for (size_t i = common; i < entry.scope.size(); ++i) {
+      out << "$scope module " << entry.scope[i] << " $end\n";
+    }
+    current = entry.scope;
+    const auto& sig = *entry.signal;
+    if (sig.is_real) {
+      out << "$var real 64 " << sig.id << " " << entry.leaf << " $end\n";
+    } else {
+      out << "$var wire " << sig.width << " " << sig.id << " " << entry.leaf
+          << " $end\n";
+    }
+  }
+  for (size_t i = current.size(); i > 0; --i) {
+    out << "$upscope $end\n";
+  }
+  out << "$upscope $end\n";
+  out << "$enddefinitions $end\n";
+}
+
+void WriteVcdValue(std::ostream& out, const WaveSignalInfo& signal,
+                   const uint64_t* val_words, const uint64_t* xz_words) {
+  if (signal.is_real) {
+    if (xz_words[0] != 0ull) {
+      out << "rnan " << signal.id << "\n";
+      return;
+    }
+    double real_val = 0.0;
+    std::memcpy(&real_val, &val_words[0], sizeof(real_val));
+    out << "r" << real_val << " " << signal.id << "\n";
+    return;
+  }
+  std::string line;
+  line.reserve(signal.width + signal.id.size() + 3u);
+  if (signal.width != 1u) {
+    line.push_back('b');
+  }
+  for (uint32_t i = signal.width; i-- > 0u;) {
+    const uint64_t mask = 1ull << (i % 64u);
+    const bool bit_xz = (xz_words[i / 64u] & mask) != 0ull;
+    const bool bit_val = (val_words[i / 64u] & mask) != 0ull;
+    if (bit_xz) {
+      line.push_back(bit_val ? 'x' : 'z');
+    } else {
+      line.push_back(bit_val ? '1' : '0');
+    }
+  }
+  if (signal.width != 1u) {
+    line.push_back(' ');
+  }
+  line.append(signal.id);
+  line.push_back('\n');
+  out << line;
+}
+
+WaveWriter::~WaveWriter() {
+  if (file_) {
+    Close(nullptr);
+  }
+}
+
+bool WaveWriter::Open(const std::string& path, const std::string& timescale,
+                      const std::string& module_name,
+                      const std::vector<WaveSignalInfo>& signals,
+                      std::string* error) {
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) {
+    if (error) {
+      *error = "failed to open waveform file: " + path;
+    }
+    return false;
+  }
+  signals_ = signals;
+  last_words_.assign(LayoutWords(signals_, &word_offset_), 0ull);
+  dumped_.assign(signals_.size(), 0u);
+  last_signal_ = ~0ull;
+  key_bytes_ = 0;
+  std::string header;
+  PutU32(&header, kWaveFileMagic);
+  PutU32(&header, kWaveFileVersion);
+  PutStr(&header, timescale);
+  PutStr(&header, module_name);
+  PutU32(&header, static_cast<uint32_t>(signals_.size()));
+  for (const auto& sig : signals_) {
+    PutStr(&header, sig.name);
+    PutU32(&header, sig.width);
+    PutU32(&header, sig.is_real ? 1u : 0u);
+  }
+  failed_ = std::fwrite(header.data(), 1, header.size(), file_) !=
+            header.size();
+  file_bytes_ = header.size();
+  pending_.clear();
+  pending_.reserve(kWaveBlockBytes + 64u);
+  index_.clear();
+  time_ = 0;
+  block_begin_ = 0;
+  return !failed_;
+}
+
+void WaveWriter::Time(uint64_t time) {
+  if (pending_.empty()) {
+    BeginBlock();
+  }
+  if (time >= time_) {
+    PutVarint(&pending_, kWaveTagTimeDelta);
+    PutVarint(&pending_, time - time_);
+  } else {
+    PutVarint(&pending_, kWaveTagTimeAbsolute);
+    PutVarint(&pending_, time);
+  }
+  time_ = time;
+  last_signal_ = ~0ull;
+  if (pending_.size() - key_bytes_ >= kWaveBlockBytes) {
+    FlushBlock();
+  }
+}
+
+void WaveWriter::Value(uint32_t signal, const uint64_t* val_words,
+                       const uint64_t* xz_words) {
+  if (pending_.empty()) {
+    BeginBlock();
+  }
+  PutValue(signal, val_words, xz_words);
+  dumped_[signal] = 1u;
+  if (pending_.size() - key_bytes_ >= kWaveBlockBytes) {
+    FlushBlock();
+  }
+}
+
+// Opens a block with its keyframe: one value record per signal dumped so
+// far, XORed with zero, so the block decodes without its predecessors.
+void WaveWriter::BeginBlock() {
+  const std::vector<uint64_t> state = last_words_;
+  std::fill(last_words_.begin(), last_words_.end(), 0ull);
+  last_signal_ = ~0ull;
+  for (uint32_t i = 0; i < signals_.size(); ++i) {
+    if (dumped_[i]) {
+      const uint64_t* words = &state[word_offset_[i]];
+      PutValue(i, words, words + WordCount(signals_[i]));
+    }
+  }
+  last_words_ = state;
+  last_signal_ = ~0ull;
+  key_bytes_ = static_cast<uint32_t>(pending_.size());
+}
+
+void WaveWriter::PutValue(uint32_t signal, const uint64_t* val_words,
+                          const uint64_t* xz_words) {
+  const WaveSignalInfo& sig = signals_[signal];
+  const uint32_t words = WordCount(sig);
+  bool has_xz = false;
+  for (uint32_t i = 0; i < words; ++i) {
+    has_xz = has_xz || xz_words[i] != 0ull;
+  }
+  const int64_t step = static_cast<int64_t>(signal) -
+                       static_cast<int64_t>(last_signal_ + 1u);
+  PutVarint(&pending_,
+            kWaveTagValue + ((ZigZag(step) << 1) | (has_xz ? 1u : 0u)));
+  last_signal_ = signal;
+  if (sig.is_real) {
+    // NaN-boxed X/Z needs no payload: the converter prints "rnan".
+    if (!has_xz) {
+      PutU64(&pending_, val_words[0]);
+    }
+    last_words_[word_offset_[signal]] = has_xz ? 0ull : val_words[0];
+    last_words_[word_offset_[signal] + 1u] = has_xz ? 1ull : 0ull;
+  } else {
+    // Words are XORed with the signal's previous value, so a counter step
+    // or a few toggled bits encode in a byte or two. Bits above the width
+    // never reach the VCD text and are dropped.
+    const uint32_t top_bits = sig.width % 64u;
+    const uint64_t top_mask =
+        top_bits == 0u ? ~0ull : ((1ull << top_bits) - 1ull);
+    uint64_t* last_val = &last_words_[word_offset_[signal]];
+    uint64_t* last_xz = last_val + words;
+    for (uint32_t i = 0; i < words; ++i) {
+      const uint64_t word =
+          i + 1u == words ? val_words[i] & top_mask : val_words[i];
+      PutVarint(&pending_, word ^ last_val[i]);
+      last_val[i] = word;
+    }
+    for (uint32_t i = 0; i < words; ++i) {
+      const uint64_t word =
+          i + 1u == words ? xz_words[i] & top_mask : xz_words[i];
+      if (has_xz) {
+        PutVarint(&pending_, word ^ last_xz[i]);
+      }
+      last_xz[i] = word;
+    }
+  }
+}
+
+void WaveWriter::FlushBlock() {
+  if (!file_ || pending_.empty()) {
+    return;
+  }
+  uLongf packed_bytes = compressBound(static_cast<uLong>(pending_.size()));
+  packed_.resize(packed_bytes);
+  if (compress2(packed_.data(), &packed_bytes,
+                reinterpret_cast<const Bytef*>(pending_.data()),
+                static_cast<uLong>(pending_.size()), Z_BEST_SPEED) != Z_OK) {
+    failed_ = true;
+    pending_.clear();
+    return;
+  }
+  WaveBlockIndexEntry entry;
+  entry.time_begin = block_begin_;
+  entry.time_end = time_;
+  entry.offset = file_bytes_;
+  std::string header;
+  PutU64(&header, entry.time_begin);
+  PutU64(&header, entry.time_end);
+  PutU32(&header, static_cast<uint32_t>(pending_.size()));
+  PutU32(&header, static_cast<uint32_t>(packed_bytes));
+  PutU32(&header, key_bytes_);
+  if (std::fwrite(header.data(), 1, header.size(), file_) != header.size() ||
+      std::fwrite(packed_.data(), 1, packed_bytes, file_) != packed_bytes) {
+    failed_ = true;
+  }
+  file_bytes_ += header.size() + packed_bytes;
+  index_.push_back(entry);
+  pending_.clear();
+  block_begin_ = time_;
+  last_signal_ = ~0ull;
+  key_bytes_ = 0;
+}
+
+void WaveWriter::Flush() {
+  if (!file_) {
+    return;
+  }
+  FlushBlock();
+  std::fflush(file_);
+}
+
+bool WaveWriter::Close(std::string* error) {
+  if (!file_) {
+    return true;
+  }
+  FlushBlock();
+  std::string tail;
+  const uint64_t index_offset = file_bytes_;
+  PutU64(&tail, static_cast<uint64_t>(index_.size()));
+  for (const auto& entry : index_) {
+    PutU64(&tail, entry.time_begin);
+    PutU64(&tail, entry.time_end);
+    PutU64(&tail, entry.offset);
+  }
+  PutU64(&tail, index_offset);
+  PutU32(&tail, kWaveTrailerMagic);
+  if (std::fwrite(tail.data(), 1, tail.size(), file_) != tail.size()) {
+    failed_ = true;
+  }
+  file_bytes_ += tail.size();
+  if (std::fclose(file_) != 0) {
+    failed_ = true;
+  }
+  file_ = nullptr;
+  if (failed_ && error) {
+    *error = "failed to write waveform file";
+  }
+  return !failed_;
+}
+
+WaveReader::~WaveReader() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool WaveReader::Open(const std::string& path, std::string* error) {
+  auto fail = [&](const std::string& message) {
+    if (error) {
+      *error = message + ": " + path;
+    }
+    return false;
+  };
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return fail("failed to open waveform file");
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size <= 0) {
+    return fail("empty or unreadable waveform file");
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (mapped == MAP_FAILED) {
+    size_ = 0;
+    return fail("failed to map waveform file");
+  }
+  data_ = static_cast<const uint8_t*>(mapped);
+
+  WaveByteReader in(data_, size_);
+  uint32_t magic = 0u;
+  uint32_t version = 0u;
+  uint32_t signal_count = 0u;
+  if (!in.U32(&magic) || magic != kWaveFileMagic || !in.U32(&version)) {
+    return fail("not a gpgawf file");
+  }
+  if (version != kWaveFileVersion) {
+    return fail("unsupported gpgawf version " + std::to_string(version));
+  }
+  if (!in.Str(&timescale_) || !in.Str(&module_name_) ||
+      !in.U32(&signal_count)) {
+    return fail("truncated gpgawf header");
+  }
+  signals_.clear();
+  for (uint32_t i = 0; i < signal_count; ++i) {
+    WaveSignalInfo sig;
+    uint32_t flags = 0u;
+    if (!in.Str(&sig.name) || !in.U32(&sig.width) || !in.U32(&flags)) {
+      return fail("truncated gpgawf signal table");
+    }
+    sig.is_real = (flags & 1u) != 0u;
+    sig.id = WaveIdForIndex(i);
+    signals_.push_back(std::move(sig));
+  }
+  const size_t first_block = in.pos();
+
+  // The trailer points at the block index; without it (or when it does not
+  // check out) the complete blocks are found by walking their headers.
+  blocks_.clear();
+  indexed_ = false;
+  if (size_ >= first_block + kWaveTrailerBytes) {
+    WaveByteReader tail(data_ + size_ - kWaveTrailerBytes, kWaveTrailerBytes);
+    uint64_t index_offset = 0u;
+    uint32_t tail_magic = 0u;
+    tail.U64(&index_offset);
+    tail.U32(&tail_magic);
+    uint64_t count = 0u;
+    if (tail_magic == kWaveTrailerMagic && index_offset >= first_block &&
+        index_offset + sizeof(uint64_t) <= size_ - kWaveTrailerBytes) {
+      WaveByteReader index(data_ + index_offset,
+                           size_ - kWaveTrailerBytes - index_offset);
+      if (index.U64(&count) &&
+          count == (size_ - kWaveTrailerBytes - index_offset -
+                    sizeof(uint64_t)) /
+                       kWaveIndexEntryBytes) {
+        blocks_.resize(static_cast<size_t>(count));
+        indexed_ = true;
+        for (auto& entry : blocks_) {
+          indexed_ = indexed_ && index.U64(&entry.time_begin) &&
+                     index.U64(&entry.time_end) && index.U64(&entry.offset) &&
+                     entry.offset >= first_block &&
+                     entry.offset + kWaveBlockHeaderBytes <= index_offset;
+        }
+      }
+    }
+  }
+  if (!indexed_) {
+    blocks_.clear();
+    size_t offset = first_block;
+    while (size_ - offset >= kWaveBlockHeaderBytes) {
+      WaveByteReader header(data_ + offset, kWaveBlockHeaderBytes);
+      WaveBlockIndexEntry entry;
+      uint32_t raw_bytes = 0u;
+      uint32_t packed_bytes = 0u;
+      uint32_t key_bytes = 0u;
+      header.U64(&entry.time_begin);
+      header.U64(&entry.time_end);
+      header.U32(&raw_bytes);
+      header.U32(&packed_bytes);
+      header.U32(&key_bytes);
+      if (raw_bytes == 0u || key_bytes > raw_bytes ||
+          packed_bytes > size_ - offset - kWaveBlockHeaderBytes) {
+        break;
+      }
+      entry.offset = offset;
+      blocks_.push_back(entry);
+      offset += kWaveBlockHeaderBytes + packed_bytes;
+    }
+  }
+  return true;
+}
+
+size_t WaveReader::FindBlock(uint64_t time) const {
+  auto it = std::lower_bound(
+      blocks_.begin(), blocks_.end(), time,
+      [](const WaveBlockIndexEntry& entry, uint64_t value) {
+        return entry.time_end < value;
+      });
+  return static_cast<size_t>(it - blocks_.begin());
+}
+
+bool WaveReader::WriteBlockVcd(size_t index, std::ostream& out,
+                               uint64_t* raw_bytes, std::string* error,
+                               bool keyframe) const {
+  auto fail = [&](const std::string& message) {
+    if (error) {
+      *error = message + " in block " + std::to_string(index);
+    }
+    return false;
+  };
+  if (index >= blocks_.size()) {
+    return fail("no such block");
+  }
+  const WaveBlockIndexEntry& entry = blocks_[index];
+  WaveByteReader header(data_ + entry.offset, kWaveBlockHeaderBytes);
+  uint64_t time = 0u;
+  uint64_t time_end = 0u;
+  uint32_t raw_size = 0u;
+  uint32_t packed_size = 0u;
+  uint32_t key_size = 0u;
+  header.U64(&time);
+  header.U64(&time_end);
+  header.U32(&raw_size);
+  header.U32(&packed_size);
+  header.U32(&key_size);
+  if (packed_size > size_ - entry.offset - kWaveBlockHeaderBytes) {
+    return fail("truncated data");
+  }
+  if (key_size > raw_size) {
+    return fail("bad keyframe size");
+  }
+  std::vector<uint8_t> raw(raw_size);
+  uLongf unpacked = raw_size;
+  if (uncompress(raw.data(), &unpacked,
+                 data_ + entry.offset + kWaveBlockHeaderBytes,
+                 packed_size) != Z_OK ||
+      unpacked != raw_size) {
+    return fail("corrupt compressed data");
+  }
+  if (raw_bytes) {
+    *raw_bytes = raw_size;
+  }
+  WaveByteReader in(raw.data(), raw.size());
+  std::vector<size_t> word_offset;
+  std::vector<uint64_t> last_words(LayoutWords(signals_, &word_offset), 0ull);
+  int64_t last_signal = -1;
+  std::vector<uint64_t> val_words;
+  std::vector<uint64_t> xz_words;
+  // The keyframe only seeds the previous values unless asked for.
+  if (keyframe) {
+    out << "#" << time << "\n$dumpvars\n";
+  }
+  bool in_keyframe = key_size != 0u;
+  while (!in.AtEnd()) {
+    if (in_keyframe && in.pos() >= key_size) {
+      if (in.pos() != key_size) {
+        return fail("keyframe overrun");
+      }
+      in_keyframe = false;
+      last_signal = -1;
+    }
+    uint64_t tag = 0u;
+    uint64_t value = 0u;
+    if (!in.Varint(&tag)) {
+      return fail("truncated record");
+    }
+    if (tag == kWaveTagTimeDelta || tag == kWaveTagTimeAbsolute) {
+      if (in_keyframe) {
+        return fail("time record in keyframe");
+      }
+      if (keyframe) {
+        out << "$end\n";
+        keyframe = false;
+      }
+      if (!in.Varint(&value)) {
+        return fail("truncated time record");
+      }
+      time = (tag == kWaveTagTimeDelta) ? time + value : value;
+      last_signal = -1;
+      out << "#" << time << "\n";
+      continue;
+    }
+    if (keyframe && !in_keyframe) {
+      out << "$end\n";
+      keyframe = false;
+    }
+    const int64_t signal =
+        last_signal + 1 + UnZigZag((tag - kWaveTagValue) >> 1);
+    const bool has_xz = ((tag - kWaveTagValue) & 1u) != 0u;
+    if (signal < 0 || static_cast<uint64_t>(signal) >= signals_.size()) {
+      return fail("bad signal index");
+    }
+    last_signal = signal;
+    const WaveSignalInfo& sig = signals_[static_cast<size_t>(signal)];
+    const uint32_t words = WordCount(sig);
+    val_words.assign(words, 0ull);
+    xz_words.assign(words, 0ull);
+    if (sig.is_real) {
+      if (has_xz) {
+        xz_words[0] = 1ull;
+      } else if (!in.U64(&val_words[0])) {
+        return fail("truncated real value");
+      }
+    } else {
+      uint64_t* last_val =
+          &last_words[word_offset[static_cast<size_t>(signal)]];
+      uint64_t* last_xz = last_val + words;
+      for (uint32_t i = 0; i < words; ++i) {
+        if (!in.Varint(&val_words[i])) {
+          return fail("truncated value");
+        }
+        val_words[i] ^= last_val[i];
+        last_val[i] = val_words[i];
+      }
+      for (uint32_t i = 0; i < words; ++i) {
+        if (has_xz && !in.Varint(&xz_words[i])) {
+          return fail("truncated value");
+        }
+        xz_words[i] ^= has_xz ? last_xz[i] : 0ull;
+        last_xz[i] = xz_words[i];
+      }
+    }
+    if (!in_keyframe || keyframe) {
+      WriteVcdValue(out, sig, val_words.data(), xz_words.data());
+    }
+  }
+  if (in_keyframe && in.pos() != key_size) {
+    return fail("truncated keyframe");
+  }
+  if (keyframe) {
+    out << "$end\n";
+  }
+  return true;
+}
+
+bool ConvertWaveToVcd(const std::string& wave_path,
+                      const std::string& vcd_path, std::string* error,
+                      uint64_t from_time) {
+  WaveReader reader;
+  if (!reader.Open(wave_path, error)) {
+    return false;
+  }
+  std::ofstream out(vcd_path, std::ios::out | std::ios::trunc);
+  if (!out) {
+    if (error) {
+      *error = "failed to open VCD file: " + vcd_path;
+    }
+    return false;
+  }
+  WriteVcdHeader(out, reader.timescale(), reader.module_name(),
+                 reader.signals());
+  const size_t first = from_time == 0 ? 0 : reader.FindBlock(from_time);
+  for (size_t i = first; i < reader.blocks().size(); ++i) {
+    if (!reader.WriteBlockVcd(i, out, nullptr, error,
+                              i == first && from_time != 0)) {
+      return false;
+    }
+  }
+  out.flush();
+  if (!out) {
+    if (error) {
+      *error = "failed to write VCD file: " + vcd_path;
+    }
+    return false;
+  }
+  return true;
+}
+
+}  // namespace gpga
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace gpga {
+
+// Output format of the $dumpfile/$dumpvars writer.
+enum class WaveFormat {
+  kVcd,
+  kGpgawf,
+};
+
+// Binary waveform file ("<dumpfile>.gpgawf"): the VCD signal table followed
+// by deflate-compressed blocks of value changes and a time -> block index.
+// Each block opens with a keyframe of every dumped value, so a reader can
+// start at any block. See docs/GPGA_WAVE_FORMAT.md. All integers are stored
+// little-endian.
+constexpr uint32_t kWaveFileMagic = 0x46574747u;     // "GGWF"
+constexpr uint32_t kWaveTrailerMagic = 0x58574747u;  // "GGWX"
+constexpr uint32_t kWaveFileVersion = 2u;
+constexpr const char* kWaveFileExtension = ".gpgawf";
+// Uncompressed records per block; a block is also closed by Flush.
+constexpr size_t kWaveBlockBytes = 256u * 1024u;
+
+struct WaveSignalInfo {
+  std::string name;  // scope parts separated by '.' or "__"
+  std::string id;    // VCD identifier code, WaveIdForIndex(position)
+  uint32_t width = 1;
+  bool is_real = false;
+};
+
+struct WaveBlockIndexEntry {
+  uint64_t time_begin = 0;
+  uint64_t time_end = 0;
+  uint64_t offset = 0;  // file offset of the block header
+};
+
+// Printable VCD identifier code of the index-th signal.
+std::string WaveIdForIndex(size_t index);
+
+// Splits a dumped signal name into its scope path and leaf, at '.' and "__"
+// outside of brackets.
+void SplitWaveHierName(const std::string& name,
+                       std::vector<std::string>* scope, std::string* leaf);
+
+// VCD text shared by the direct writer and the converter, so both produce
+// the same bytes: the header up to $enddefinitions, and one value change.
+// `val_words`/`xz_words` hold ceil(width / 64) words (one for reals).
+void WriteVcdHeader(std::ostream& out, const std::string& timescale,
+                    const std::string& module_name,
+                    const std::vector<WaveSignalInfo>& signals);
+void WriteVcdValue(std::ostream& out, const WaveSignalInfo& signal,
+                   const uint64_t* val_words, const uint64_t* xz_words);
+
+// Streams value changes into a .gpgawf file. Call Time when simulation time
+// advances (each call becomes one "#t" line after conversion, even with no
+// changes), then Value per changed signal.
+class WaveWriter {
+ public:
+  WaveWriter() = default;
+  WaveWriter(const WaveWriter&) = delete;
+  WaveWriter& operator=(const WaveWriter&) = delete;
+  ~WaveWriter();
+
+  bool Open(const std::string& path, const std::string& timescale,
+            const std::string& module_name,
+            const std::vector<WaveSignalInfo>& signals, std::string* error);
+  void Time(uint64_t time);
+  void Value(uint32_t signal, const uint64_t* val_words,
+             const uint64_t* xz_words);
+  // Compresses the pending records into a block and flushes the file.
+  void Flush();
+  // Writes the last block, the block index and the trailer.
+  bool Close(std::string* error);
+
+  bool is_open() const { return file_ != nullptr; }
+  // Bytes on disk plus the pending uncompressed records.
+  uint64_t bytes_written() const { return file_bytes_ + pending_.size(); }
+
+ private:
+  void BeginBlock();
+  void PutValue(uint32_t signal, const uint64_t* val_words,
+                const uint64_t* xz_words);
+  void FlushBlock();
+
+  std::FILE* file_ = nullptr;
+  bool failed_ = false;
+  std::vector<WaveSignalInfo> signals_;
+  // Per-signal current val/xz words, and whether the signal was dumped yet;
+  // the next block's keyframe is written from them.
+  std::vector<size_t> word_offset_;
+  std::vector<uint64_t> last_words_;
+  std::vector<uint8_t> dumped_;
+  uint64_t last_signal_ = 0;
+  std::string pending_;
+  // Leading bytes of pending_ that hold the keyframe.
+  uint32_t key_bytes_ = 0;
+  std::vector<uint8_t> packed_;
+  uint64_t block_begin_ = 0;
+  uint64_t time_ = 0;
+  uint64_t file_bytes_ = 0;
+  std::vector<WaveBlockIndexEntry> index_;
+};
+
+// Reads a .gpgawf file. Files without a valid trailer (a run that did not
+// close its dump) are indexed by scanning the blocks that are complete.
+class WaveReader {
+ public:
+  WaveReader() = default;
+  WaveReader(const WaveReader&) = delete;
+  WaveReader& operator=(const WaveReader&) = delete;
+  ~WaveReader();
+
+  // Maps the file read-only; blocks are decompressed on demand.
+  bool Open(const std::string& path, std::string* error);
+
+  const std::string& timescale() const { return timescale_; }
+  const std::string& module_name() const { return module_name_; }
+  const std::vector<WaveSignalInfo>& signals() const { return signals_; }
+  const std::vector<WaveBlockIndexEntry>& blocks() const { return blocks_; }
+  bool indexed() const { return indexed_; }
+  uint64_t file_bytes() const { return size_; }
+
+  // First block whose time range ends at or after `time` (blocks().size()
+  // when none does).
+  size_t FindBlock(uint64_t time) const;
+
+  // Decompresses block `index` and appends its changes as VCD text. Blocks
+  // are self-contained, so any block can be converted on its own; with
+  // `keyframe` the values in effect at the block's start come first, as a
+  // "#time_begin" $dumpvars section, so the text stands alone.
+  bool WriteBlockVcd(size_t index, std::ostream& out, uint64_t* raw_bytes,
+                     std::string* error, bool keyframe = false) const;
+
+ private:
+  int fd_ = -1;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  std::string timescale_;
+  std::string module_name_;
+  std::vector<WaveSignalInfo> signals_;
+  std::vector<WaveBlockIndexEntry> blocks_;
+  bool indexed_ = false;
+};
+
+// Converts a .gpgawf file to the VCD text the direct writer would have
+// produced for the same run. With a nonzero `from_time` the output starts at
+// the keyframe of the block covering that time instead.
+bool ConvertWaveToVcd(const std::string& wave_path,
+                      const std::string& vcd_path, std::string* error,
+                      uint64_t from_time = 0);
+
+}  // namespace gpga
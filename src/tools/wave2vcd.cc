@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "runtime/waveform.hh"
+
+namespace {
+
+void PrintUsage() {
+  std::cout << "Usage: metalfpga_wave2vcd <in.gpgawf> [out.vcd] [--info]\n"
+               "                            [--from T]\n"
+               "  Converts a --wave-format gpgawf dump to VCD (default: the\n"
+               "  input path with a .vcd extension). --info prints the block\n"
+               "  index instead. --from T starts at the keyframe of the block\n"
+               "  covering time T, skipping the blocks before it.\n";
+}
+
+int PrintInfo(const std::string& path) {
+  gpga::WaveReader reader;
+  std::string error;
+  if (!reader.Open(path, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  std::cout << path << ": module " << reader.module_name() << ", timescale "
+            << reader.timescale() << ", " << reader.signals().size()
+            << " signals, " << reader.blocks().size() << " blocks, "
+            << reader.file_bytes() << " bytes"
+            << (reader.indexed() ? "" : " (no index, scanned)") << "\n";
+  uint64_t raw_total = 0u;
+  for (size_t i = 0; i < reader.blocks().size(); ++i) {
+    const gpga::WaveBlockIndexEntry& block = reader.blocks()[i];
+    std::cout << "  block " << i << ": time " << block.time_begin << ".."
+              << block.time_end << " @" << block.offset << "\n";
+  }
+  for (size_t i = 0; i < reader.blocks().size(); ++i) {
+    uint64_t raw = 0u;
+    std::ostream sink(nullptr);
+    if (!reader.WriteBlockVcd(i, sink, &raw, &error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    raw_total += raw;
+  }
+  std::cout << "  records: " << raw_total << " bytes uncompressed\n";
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string in_path;
+  std::string out_path;
+  bool info = false;
+  uint64_t from_time = 0u;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--info") {
+      info = true;
+    } else if (arg == "--from") {
+      if (i + 1 >= argc) {
+        PrintUsage();
+        return 2;
+      }
+      from_time = static_cast<uint64_t>(std::stoull(argv[++i]));
+    } else if (arg == "--help") {
+      PrintUsage();
+      return 0;
+    } else if (!arg.empty() && arg[0] == '-') {
+      PrintUsage();
+      return 2;
+    } else if (in_path.empty()) {
+      in_path = arg;
+    } else if (out_path.empty()) {
+      out_path = arg;
+    } else {
+      PrintUsage();
+      return 2;
+    }
+  }
+  if (in_path.empty()) {
+    PrintUsage();
+    return 2;
+  }
+  if (info) {
+    return PrintInfo(in_path);
+  }
+  if (out_path.empty()) {
+    const std::string ext = gpga::kWaveFileExtension;
+    out_path = in_path;
+    if (out_path.size() > ext.size() &&
+        out_path.compare(out_path.size() - ext.size(), ext.size(), ext) ==
+            0) {
+      out_path.resize(out_path.size() - ext.size());
+    }
+    out_path += ".vcd";
+  }
+  std::string error;
+  if (!gpga::ConvertWaveToVcd(in_path, out_path, &error, from_time)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  return 0;
+}